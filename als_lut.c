@@ -0,0 +1,139 @@
+/**
+ * @file als_lut.c
+ * ALS profile lookup tables -- this maps lux values to brightness
+ * levels using ALS profiles compiled into searchable tables
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <string.h>			/* memcpy() */
+
+#include "als_lut.h"
+
+/**
+ * Compile an ALS profile into a lookup table
+ *
+ * @param[out] lut The lookup table to fill in
+ * @param profile The profile to compile
+ * @return TRUE on success, FALSE if the profile lacks
+ *         the terminating { -1, -1 } range
+ */
+gboolean als_lut_compile(als_lut_t *lut, const als_profile_struct *profile)
+{
+	gint i;
+
+	lut->sorted = TRUE;
+
+	for (i = 0; i < ALS_RANGES; i++) {
+		if (profile->range[i][0] == -1)
+			break;
+
+		lut->down[i] = profile->range[i][0];
+		lut->up[i] = profile->range[i][1];
+
+		if ((i > 0) && ((lut->down[i] < lut->down[i - 1]) ||
+				(lut->up[i] < lut->up[i - 1])))
+			lut->sorted = FALSE;
+	}
+
+	lut->levels = i;
+	memcpy(lut->value, profile->value, sizeof lut->value);
+
+	return i < ALS_RANGES;
+}
+
+/**
+ * Find the first threshold a lux value is below
+ *
+ * @param thr Sorted thresholds
+ * @param lo First index to consider
+ * @param hi One past the last index to consider
+ * @param lux The lux value
+ * @return The first index in [lo, hi) with lux < thr[index], or hi
+ */
+static gint als_lut_search(const gint *thr, gint lo, gint hi, gint lux)
+{
+	while (lo < hi) {
+		gint mid = lo + (hi - lo) / 2;
+
+		if (lux < thr[mid])
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/**
+ * Look up the brightness for a lux value
+ *
+ * Levels below the current one are entered when the lux drops below
+ * their lower bound, levels above it when the lux reaches their upper
+ * bound; this gives hysteresis around each level change
+ *
+ * @param lut The compiled profile to use
+ * @param lux The lux value
+ * @param interpolate TRUE to interpolate the brightness linearly
+ *                    towards the next level
+ * @param threshold_max Upper threshold to use above the top range
+ * @param[in,out] level The old level; will be replaced by the new level
+ * @param[out] lower The new lower ALS interrupt threshold
+ * @param[out] upper The new upper ALS interrupt threshold
+ * @return The brightness in % of maximum + possible HBM boost
+ */
+gint als_lut_lookup(const als_lut_t *lut, gint lux,
+		    gboolean interpolate, gint threshold_max,
+		    gint *level, gint *lower, gint *upper)
+{
+	gint tmp = CLAMP(*level, 0, lut->levels);
+	gint value;
+	gint i;
+
+	if (lut->sorted == TRUE) {
+		i = als_lut_search(lut->down, 0, tmp, lux);
+
+		if (i == tmp)
+			i = als_lut_search(lut->up, tmp, lut->levels, lux);
+	} else {
+		for (i = 0; i < lut->levels; i++) {
+			if (lux < ((i < tmp) ? lut->down[i] : lut->up[i]))
+				break;
+		}
+	}
+
+	*level = i;
+	*lower = (i == 0) ? 0 : lut->down[i - 1];
+	*upper = ((i == lut->levels) || (lut->up[i] == -1)) ?
+		threshold_max : lut->up[i];
+
+	value = lut->value[i];
+
+	/* Interpolate towards the next level, unless the
+	 * high brightness mode boost would change on the way
+	 */
+	if ((interpolate == TRUE) && (i < lut->levels) &&
+	    ((value >> 8) == (lut->value[i + 1] >> 8))) {
+		gint from = (i == 0) ? 0 : lut->up[i - 1];
+		gint to = lut->up[i];
+
+		if ((to > from) && (lux > from))
+			value += (gint)((gint64)(lut->value[i + 1] - value) *
+					(MIN(lux, to) - from) / (to - from));
+	}
+
+	return value;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file als_lut.h
+ * Headers for the ALS profile lookup tables
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ALS_LUT_H_
+#define _ALS_LUT_H_
+
+#include <glib.h>
+
+/** Number of ranges in ALS profile */
+#define ALS_RANGES			11
+
+/** ALS profile */
+typedef struct {
+	/** Lower and upper bound for each brightness range */
+	const gint range[ALS_RANGES][2];
+	/** Brightness in % + possible HBM boost (boost level * 256) */
+	const gint value[ALS_RANGES + 1];
+} als_profile_struct;
+
+/** ALS profile compiled for lookups */
+typedef struct {
+	/** Number of ranges; the top level is the one above all ranges */
+	gint levels;
+	/** Lux below which a level lower than the current one is used */
+	gint down[ALS_RANGES];
+	/** Lux at or above which the next level up is used */
+	gint up[ALS_RANGES];
+	/** Brightness in % + possible HBM boost for each level */
+	gint value[ALS_RANGES + 1];
+	/** TRUE if down[] and up[] are both sorted and can be searched */
+	gboolean sorted;
+} als_lut_t;
+
+gboolean als_lut_compile(als_lut_t *lut, const als_profile_struct *profile);
+gint als_lut_lookup(const als_lut_t *lut, gint lux,
+		    gboolean interpolate, gint threshold_max,
+		    gint *level, gint *lower, gint *upper);
+
+#endif /* _ALS_LUT_H_ */
@@ -28,6 +28,8 @@
 
 #include "mce-log.h"
 #include "mce-io.h"
+#include "mce-conf.h"
+#include "mce-memstat.h"
 
 /* ========================================================================= *
  *
@@ -47,6 +49,15 @@
 /** Path to persistent storage file */
 #define VALUES_PATH G_STRINGIFY(MCE_VAR_DIR)"/builtin-gconf.values"
 
+/** Name of builtin-gconf configuration group */
+#define MCE_CONF_BUILTIN_GCONF_GROUP "BuiltinGConf"
+
+/** Name of configuration key for minimum delay between value saves */
+#define MCE_CONF_BUILTIN_GCONF_SAVE_DELAY "SaveDelay"
+
+/** Default minimum delay between value saves in milliseconds */
+#define DEFAULT_SAVE_DELAY 2000
+
 /* ========================================================================= *
  *
  * MACROS
@@ -124,7 +135,7 @@ typedef struct GConfEntry
 {
   // public
 
-  char *key;
+  const char *key;   // points to gconf_defaults, never copied
   GConfValue *value;
 
   // private
@@ -145,6 +156,18 @@ typedef struct GConfClient
 
   GSList  *notify_list;
 
+  /** Lookup table for entries; key -> GConfEntry */
+  GHashTable *entry_index;
+
+  /** Lookup table for notifiers; key or dir -> GSList of GConfClientNotify */
+  GHashTable *notify_index;
+
+  /** Values have changed since the last save */
+  gboolean dirty;
+
+  /** Timer for delayed saving of values */
+  guint    save_id;
+
 } GConfClient;
 
 typedef enum
@@ -211,9 +234,11 @@ GConfValueType gconf_value_get_list_type(const GConfValue *self);
 void gconf_value_set_list_type(GConfValue *self, GConfValueType list_type);
 GSList *gconf_value_get_list(const GConfValue *self);
 void gconf_value_set_list(GConfValue *self, GSList *list);
+void gconf_value_set_list_nocopy(GConfValue *self, GSList *list);
 static GConfEntry *gconf_entry_init(const char *key, const char *type, const char *data);
 const char *gconf_entry_get_key(const GConfEntry *entry);
 GConfValue *gconf_entry_get_value(const GConfEntry *entry);
+void gconf_entry_free(GConfEntry *entry);
 #if GCONF_ENABLE_DEBUG_LOGGING
 static void gconf_client_debug(GConfClient *self);
 #endif
@@ -221,7 +246,11 @@ GConfClient *gconf_client_get_default(void);
 void gconf_client_add_dir(GConfClient *client, const gchar *dir, GConfClientPreloadType preload, GError **err);
 static GConfEntry *gconf_client_find_entry(GConfClient *self, const gchar *key, GError **err);
 static GConfValue *gconf_client_find_value(GConfClient *self, const gchar *key, GError **err);
+static gboolean gconf_client_dir_exists(GConfClient *self, const gchar *dir);
 GConfValue *gconf_client_get(GConfClient *self, const gchar *key, GError **err);
+static const char *gconf_client_child_name(const gchar *key, const gchar *dir);
+GSList *gconf_client_all_entries(GConfClient *self, const gchar *dir, GError **err);
+GSList *gconf_client_all_dirs(GConfClient *self, const gchar *dir, GError **err);
 static void gconf_client_notify_free(GConfClientNotify *self);
 static GConfClientNotify *gconf_client_notify_new(const gchar *namespace_section, GConfClientNotifyFunc func, gpointer user_data, GFreeFunc destroy_notify);
 static void gconf_client_notify_change(GConfClient *client, const gchar *namespace_section);
@@ -232,7 +261,10 @@ gboolean gconf_client_set_int(GConfClient *client, const gchar *key, gint val, G
 gboolean gconf_client_set_float(GConfClient *client, const gchar *key, double val, GError **err);
 gboolean gconf_client_set_string(GConfClient *client, const gchar *key, const gchar *val, GError **err);
 gboolean gconf_client_set_list(GConfClient *client, const gchar *key, GConfValueType list_type, GSList *list, GError **err);
+gboolean gconf_client_set_list_nocopy(GConfClient *client, const gchar *key, GConfValueType list_type, GSList *list, GError **err);
 void gconf_client_suggest_sync(GConfClient *client, GError **err);
+static gboolean gconf_client_save_cb(gpointer aptr);
+void gconf_client_save_pending(GConfClient *client);
 
 /* ========================================================================= *
  *
@@ -749,7 +781,11 @@ gconf_value_list_validata(GSList *src, GConfValueType type)
   return TRUE;
 }
 
-/** Helper for deep copying list of values */
+/** Helper for copying list of values
+ *
+ * The list elements are never modified in place, so the copy
+ * shares them with the source instead of duplicating each one
+ */
 static
 GSList *
 gconf_value_list_copy(GSList *src)
@@ -758,7 +794,10 @@ gconf_value_list_copy(GSList *src)
 
   for( ; src; src = src->next )
   {
-    res = g_slist_prepend(res, gconf_value_copy(src->data));
+    GConfValue *elem = src->data;
+
+    elem->refcount += 1;
+    res = g_slist_prepend(res, elem);
   }
   res = g_slist_reverse(res);
 
@@ -848,6 +887,8 @@ gconf_value_init(GConfValueType type, GConfValueType list_type,
 {
   GConfValue *self = calloc(1, sizeof *self);
 
+  mce_memstat_alloc("gconf:values", sizeof *self);
+
   self->refcount  = 1;
   self->list_type = GCONF_VALUE_INVALID;
   self->type      = type;
@@ -929,6 +970,7 @@ gconf_value_free(GConfValue *self)
     self->list_type = GCONF_VALUE_INVALID;
 
     /* free the value itself too */
+    mce_memstat_free("gconf:values", sizeof *self);
     free(self);
   }
 }
@@ -1081,6 +1123,26 @@ gconf_value_set_list(GConfValue *self, GSList *list)
   }
 }
 
+/** See GConf API documentation
+ *
+ * The list and its elements are owned by the value afterwards;
+ * a list that does not match the list type is released
+ */
+void
+gconf_value_set_list_nocopy(GConfValue *self, GSList *list)
+{
+  self->list_head = gconf_value_list_free(self->list_head);
+
+  if( gconf_value_list_validata(list, self->list_type) )
+  {
+    self->list_head = list;
+  }
+  else
+  {
+    gconf_value_list_free(list);
+  }
+}
+
 /* ========================================================================= *
  *
  * GConfEntry
@@ -1093,7 +1155,8 @@ GConfEntry *
 gconf_entry_init(const char *key, const char *type, const char *data)
 {
   GConfEntry *self = calloc(1, sizeof *self);
-  self->key = strdup(key);
+  mce_memstat_alloc("gconf:entries", sizeof *self);
+  self->key = key;
   self->def = data ? strdup(data) : 0;
 
   GConfValueType ltype = GCONF_VALUE_INVALID;
@@ -1122,6 +1185,19 @@ gconf_entry_get_value(const GConfEntry *entry)
   return entry ? entry->value : 0;
 }
 
+/** See GConf API documentation */
+void
+gconf_entry_free(GConfEntry *entry)
+{
+  if( entry )
+  {
+    gconf_value_free(entry->value);
+    free(entry->def);
+    mce_memstat_free("gconf:entries", sizeof *entry);
+    free(entry);
+  }
+}
+
 /* ========================================================================= *
  *
  * DATABASE
@@ -1132,7 +1208,7 @@ gconf_entry_get_value(const GConfEntry *entry)
 typedef struct
 {
   const char *key;
-  const char *type;
+  char        type[4];  // inline; avoids a relocated pointer per entry
   const char *def;
 } setting_t;
 
@@ -1357,7 +1433,7 @@ static void gconf_client_save_values(GConfClient *self, const char *path)
 
   if( data )
   {
-    mce_io_update_file_atomic(path, data, size, 0664, FALSE);
+    mce_io_update_file_atomic_async(path, data, size, 0664, FALSE, 0, 0);
   }
 
 cleanup:
@@ -1515,11 +1591,16 @@ gconf_client_get_default(void)
   {
     GConfClient *self = calloc(1, sizeof *self);
 
+    self->entry_index  = g_hash_table_new(g_str_hash, g_str_equal);
+    self->notify_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, 0);
+
     // initialize to hard coded defaults
     for( const setting_t *elem = gconf_defaults; elem->key; ++elem )
     {
       GConfEntry *add = gconf_entry_init(elem->key, elem->type, elem->def);
       self->entries = g_slist_prepend(self->entries, add);
+      g_hash_table_replace(self->entry_index, (gpointer)add->key, add);
     }
     self->entries = g_slist_reverse(self->entries);
 
@@ -1573,17 +1654,7 @@ gconf_client_find_entry(GConfClient *self, const gchar *key, GError **err)
     goto cleanup;
   }
 
-  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
-  {
-    GConfEntry *entry = e_iter->data;
-    if( !strcmp(entry->key, key) )
-    {
-      res = entry;
-      break;
-    }
-  }
-
-  if( !res )
+  if( !(res = g_hash_table_lookup(self->entry_index, key)) )
   {
     gconf_set_error(err, GCONF_ERROR_FAILED, "%s: does not exist", key);
   }
@@ -1593,6 +1664,24 @@ cleanup:
   return res;
 }
 
+/** Check if there are any keys under the given directory */
+static
+gboolean
+gconf_client_dir_exists(GConfClient *self, const gchar *dir)
+{
+  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
+  {
+    GConfEntry *entry = e_iter->data;
+
+    if( gconf_client_child_name(entry->key, dir) )
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 /** Locate GConfValue by key */
 static
 GConfValue *
@@ -1629,6 +1718,109 @@ gconf_client_get(GConfClient *self, const gchar *key, GError **err)
   return res;
 }
 
+/** Get path of key relative to directory
+ *
+ * @return part of key after "dir/", or NULL if key is not under dir
+ */
+static
+const char *
+gconf_client_child_name(const gchar *key, const gchar *dir)
+{
+  size_t len = strlen(dir);
+
+  /* "/" is the only directory name that ends with a slash */
+  if( len && dir[len-1] == '/' )
+  {
+    --len;
+  }
+
+  if( strncmp(key, dir, len) || key[len] != '/' || !key[len+1] )
+  {
+    return 0;
+  }
+
+  return key + len + 1;
+}
+
+/** See GConf API documentation */
+GSList *
+gconf_client_all_entries(GConfClient *self, const gchar *dir, GError **err)
+{
+  GSList *res = 0;
+
+  if( !gconf_client_is_valid(self, err) )
+  {
+    goto cleanup;
+  }
+
+  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
+  {
+    GConfEntry *entry = e_iter->data;
+    const char *name  = gconf_client_child_name(entry->key, dir);
+
+    if( !name || strchr(name, '/') )
+    {
+      continue;
+    }
+
+    /* Values are shared with the database -> see gconf_client_get() */
+    GConfEntry *copy = calloc(1, sizeof *copy);
+    mce_memstat_alloc("gconf:entries", sizeof *copy);
+    copy->key   = entry->key;
+    copy->value = entry->value;
+    copy->value->refcount += 1;
+
+    res = g_slist_prepend(res, copy);
+  }
+
+  res = g_slist_reverse(res);
+
+cleanup:
+
+  return res;
+}
+
+/** See GConf API documentation */
+GSList *
+gconf_client_all_dirs(GConfClient *self, const gchar *dir, GError **err)
+{
+  GSList *res = 0;
+
+  if( !gconf_client_is_valid(self, err) )
+  {
+    goto cleanup;
+  }
+
+  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
+  {
+    GConfEntry *entry = e_iter->data;
+    const char *name  = gconf_client_child_name(entry->key, dir);
+    const char *end   = name ? strchr(name, '/') : 0;
+
+    if( !end )
+    {
+      continue;
+    }
+
+    gchar *path = g_strndup(entry->key, end - entry->key);
+
+    if( g_slist_find_custom(res, path, (GCompareFunc)strcmp) )
+    {
+      g_free(path);
+    }
+    else
+    {
+      res = g_slist_prepend(res, path);
+    }
+  }
+
+  res = g_slist_reverse(res);
+
+cleanup:
+
+  return res;
+}
+
 /** See GConf API documentation */
 gboolean
 gconf_client_set_bool(GConfClient *client,
@@ -1777,14 +1969,130 @@ gconf_client_set_list(GConfClient *client,
   return res;
 }
 
-/** See GConf API documentation */
+/** Set list value without copying the list
+ *
+ * Not part of GConf API; like gconf_client_set_list(), but the
+ * list and its elements are always owned by builtin-gconf
+ * afterwards, so that values decoded from D-Bus can be stored
+ * without an intermediate copy
+ */
+gboolean
+gconf_client_set_list_nocopy(GConfClient *client,
+                             const gchar *key,
+                             GConfValueType list_type,
+                             GSList *list,
+                             GError **err)
+{
+  gboolean res = FALSE;
+  GConfValue *value = gconf_client_find_value(client, key, err);
+
+  if( !value || !gconf_require_list_type(key, value, list_type, err) )
+  {
+    gconf_value_list_free(list);
+    goto cleanup;
+  }
+
+  gconf_value_set_list_nocopy(value, list);
+
+  res = TRUE;
+
+#if GCONF_ENABLE_DEBUG_LOGGING
+  if( gconf_log_debug_p() )
+  {
+    char *repr = gconf_value_repr(key, value);
+    gconf_log_debug("SET %s", repr);
+    free(repr);
+  }
+#endif
+
+  gconf_client_notify_change(client, key);
+
+cleanup:
+  return res;
+}
+
+/** Timer callback for saving changed values */
+static
+gboolean
+gconf_client_save_cb(gpointer aptr)
+{
+  GConfClient *client = aptr;
+
+  client->save_id = 0;
+
+  if( client->dirty )
+  {
+    client->dirty = FALSE;
+    gconf_client_save_values(client, VALUES_PATH);
+  }
+
+  return FALSE;
+}
+
+/** See GConf API documentation
+ *
+ * Saving is delayed so that a burst of changes, e.g. from a
+ * slider in settings UI, triggers only one write per
+ * SaveDelay milliseconds.
+ */
 void
 gconf_client_suggest_sync(GConfClient *client, GError **err)
 {
-  if( gconf_client_is_valid(client, err) ) {
-    // FIXME: do we need delayed save?
-    gconf_client_save_values(client, VALUES_PATH);
+  gint delay;
+
+  if( !gconf_client_is_valid(client, err) )
+  {
+    goto cleanup;
+  }
+
+  client->dirty = TRUE;
+
+  if( client->save_id )
+  {
+    goto cleanup;
+  }
+
+  delay = mce_conf_get_int(MCE_CONF_BUILTIN_GCONF_GROUP,
+                           MCE_CONF_BUILTIN_GCONF_SAVE_DELAY,
+                           DEFAULT_SAVE_DELAY);
+
+  if( delay <= 0 )
+  {
+    gconf_client_save_cb(client);
   }
+  else
+  {
+    client->save_id = g_timeout_add(delay, gconf_client_save_cb, client);
+  }
+
+cleanup:
+
+  return;
+}
+
+/** Save changed values immediately
+ *
+ * Not a GConf API function; used at mce exit so that values
+ * pending for delayed save are not lost
+ */
+void
+gconf_client_save_pending(GConfClient *client)
+{
+  if( !gconf_client_is_valid(client, 0) )
+  {
+    goto cleanup;
+  }
+
+  if( client->save_id )
+  {
+    g_source_remove(client->save_id), client->save_id = 0;
+  }
+
+  gconf_client_save_cb(client);
+
+cleanup:
+
+  return;
 }
 
 /* ========================================================================= *
@@ -1837,7 +2145,11 @@ gconf_client_notify_new(const gchar           *namespace_section,
   return self;
 }
 
-/** Dispatch change notifications via installed  callbacks */
+/** Dispatch change notifications via installed  callbacks
+ *
+ * Notifiers installed for the key itself and for all
+ * directories containing the key are called.
+ */
 static
 void
 gconf_client_notify_change(GConfClient           *client,
@@ -1845,10 +2157,21 @@ gconf_client_notify_change(GConfClient           *client,
 {
   GError *err = 0;
   GConfEntry *entry = gconf_client_find_entry(client, namespace_section, &err);
+  gchar *path = 0;
 
-  if( entry )
+  if( !entry )
   {
-    for( GSList *item = client->notify_list; item; item = item->next )
+    goto cleanup;
+  }
+
+  path = g_strdup(namespace_section);
+
+  for( ;; )
+  {
+    GSList *bucket = g_hash_table_lookup(client->notify_index, path);
+    char   *slash  = 0;
+
+    for( GSList *item = bucket; item; item = item->next )
     {
       GConfClientNotify *notify = item->data;
 
@@ -1857,14 +2180,29 @@ gconf_client_notify_change(GConfClient           *client,
         continue;
       }
 
-      if( !strcmp(notify->namespace_section, namespace_section) )
-      {
-	gconf_log_debug("id=%u, namespace=%s", notify->id, notify->namespace_section);
-        notify->func(client, notify->id, entry, notify->user_data);
-      }
+      gconf_log_debug("id=%u, namespace=%s", notify->id, notify->namespace_section);
+      notify->func(client, notify->id, entry, notify->user_data);
+    }
+
+    /* Continue from the parent directory, the root included */
+    if( !(slash = strrchr(path, '/')) || !strcmp(path, "/") )
+    {
+      break;
+    }
+
+    if( slash == path )
+    {
+      slash[1] = 0;
+    }
+    else
+    {
+      *slash = 0;
     }
   }
 
+cleanup:
+
+  g_free(path);
   g_clear_error(&err);
 }
 
@@ -1878,21 +2216,33 @@ gconf_client_notify_add(GConfClient *client,
                         GError **err)
 {
   GConfClientNotify *notify = 0;
+  GSList            *bucket = 0;
 
   if( !gconf_client_is_valid(client, err) )
   {
     goto cleanup;
   }
 
-  if( gconf_client_find_value(client, namespace_section, err) )
+  if( gconf_client_dir_exists(client, namespace_section) )
   {
-    notify = gconf_client_notify_new(namespace_section,
-                                     func, user_data,
-                                     destroy_notify);
-
-    client->notify_list = g_slist_prepend(client->notify_list, notify);
+    g_clear_error(err);
+  }
+  else if( !gconf_client_find_value(client, namespace_section, err) )
+  {
+    goto cleanup;
   }
 
+  notify = gconf_client_notify_new(namespace_section,
+                                   func, user_data,
+                                   destroy_notify);
+
+  client->notify_list = g_slist_prepend(client->notify_list, notify);
+
+  bucket = g_hash_table_lookup(client->notify_index, namespace_section);
+  bucket = g_slist_prepend(bucket, notify);
+  g_hash_table_replace(client->notify_index,
+                       g_strdup(namespace_section), bucket);
+
 cleanup:
 
   return notify ? notify->id : 0;
@@ -1913,6 +2263,21 @@ gconf_client_notify_remove(GConfClient *client, guint cnxn)
 
     if( notify->id == cnxn )
     {
+      GSList *bucket = g_hash_table_lookup(client->notify_index,
+                                           notify->namespace_section);
+
+      bucket = g_slist_remove(bucket, notify);
+
+      if( bucket )
+      {
+        g_hash_table_replace(client->notify_index,
+                             g_strdup(notify->namespace_section), bucket);
+      }
+      else
+      {
+        g_hash_table_remove(client->notify_index, notify->namespace_section);
+      }
+
       gconf_client_notify_free(notify);
       client->notify_list = g_slist_delete_link(client->notify_list, item);
       break;
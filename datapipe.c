@@ -21,9 +21,335 @@
  */
 #include <glib.h>
 
+#include <stdio.h>			/* fopen(), getline(), sscanf() */
+#include <stdlib.h>			/* free() */
+#include <string.h>			/* memset(), strcmp() */
+
 #include "datapipe.h"
 
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-lib.h"			/* mce_lib_get_time_us() */
+
+/** List of initialised datapipes, in setup order */
+static GSList *datapipe_list = NULL;
+
+/** Datapipes with a queued deferred execution, in queuing order */
+static GSList *deferred_list = NULL;
+
+/** ID for the idle callback that runs deferred executions */
+static guint deferred_id = 0;
+
+/** Number of entries in the execution trace ring buffer */
+#define DATAPIPE_TRACE_SIZE		512
+
+/** Execution trace entry */
+typedef struct {
+	guint64 time;			/**< Execution time [us] */
+	const gchar *name;		/**< Name of the executed datapipe */
+	gint value;			/**< Indata; 0 for non-pointer pipes */
+} datapipe_trace_t;
+
+/** Ring buffer of the latest datapipe executions */
+static datapipe_trace_t datapipe_trace[DATAPIPE_TRACE_SIZE];
+
+/** Total number of executions written to the trace ring buffer */
+static guint datapipe_trace_count = 0;
+
+/** Replayed trace entry */
+typedef struct {
+	guint64 time;			/**< Time relative to the first entry [us] */
+	datapipe_struct *datapipe;	/**< The datapipe to execute */
+	gint value;			/**< Indata */
+} datapipe_replay_t;
+
+/** Trace entries waiting to be replayed; data is datapipe_replay_t */
+static GSList *replay_list = NULL;
+
+/** Monotonic time corresponding to trace time zero during replay */
+static gint64 replay_offset = 0;
+
+/** ID for the timer callback that feeds the replayed trace */
+static guint replay_id = 0;
+
+/**
+ * Update execution statistics of a datapipe
+ *
+ * @param datapipe The datapipe that was executed
+ * @param triggers Number of triggers that were called
+ * @param filter_time Time spent in filters [us]
+ * @param trigger_time Time spent in triggers [us]
+ */
+static void datapipe_update_stats(datapipe_struct *const datapipe,
+				  const guint triggers,
+				  const guint64 filter_time,
+				  const guint64 trigger_time)
+{
+	datapipe_stats_t *stats = &datapipe->stats;
+	guint64 total = filter_time + trigger_time;
+	guint64 limit = 10;
+	guint bucket = 0;
+
+	stats->exec_count++;
+	stats->trigger_count += triggers;
+	stats->filter_time += filter_time;
+	stats->trigger_time += trigger_time;
+
+	if (total > stats->max_time)
+		stats->max_time = total;
+
+	while ((bucket < DATAPIPE_HISTOGRAM_BUCKETS - 1) && (total >= limit)) {
+		limit *= 10;
+		bucket++;
+	}
+
+	stats->histogram[bucket]++;
+}
+
+/**
+ * Check whether a datapipe passes its data as plain pointers
+ *
+ * @param datapipe The datapipe to check
+ * @return TRUE if the data is neither copied nor freed, FALSE otherwise
+ */
+static gboolean datapipe_is_pointer_pipe(const datapipe_struct *const datapipe)
+{
+	return ((datapipe->free_cache == DONT_FREE_CACHE) &&
+		(datapipe->datasize == 0));
+}
+
+/**
+ * Record a datapipe execution in the trace ring buffer
+ *
+ * @param datapipe The datapipe being executed
+ * @param time Execution time [us]
+ * @param data The data passed to the datapipe
+ */
+static void datapipe_trace_record(const datapipe_struct *const datapipe,
+				  const guint64 time, gconstpointer data)
+{
+	datapipe_trace_t *entry;
+
+	entry = &datapipe_trace[datapipe_trace_count++ % DATAPIPE_TRACE_SIZE];
+	entry->time = time;
+	entry->name = datapipe_get_name(*datapipe);
+	entry->value = datapipe_is_pointer_pipe(datapipe) ?
+		       GPOINTER_TO_INT(data) : 0;
+}
+
+/**
+ * Call a function for each recorded trace entry, oldest first
+ *
+ * @param callback The function to call
+ * @param user_data Data to pass to the callback
+ */
+void datapipe_trace_foreach(void (*callback)(guint64 time,
+					     const gchar *name,
+					     gint value,
+					     gpointer user_data),
+			    gpointer user_data)
+{
+	guint i = 0;
+
+	if (callback == NULL) {
+		mce_log(LL_ERR,
+			"datapipe_trace_foreach() called "
+			"without a valid callback");
+		goto EXIT;
+	}
+
+	if (datapipe_trace_count > DATAPIPE_TRACE_SIZE)
+		i = datapipe_trace_count - DATAPIPE_TRACE_SIZE;
+
+	for (; i < datapipe_trace_count; i++) {
+		const datapipe_trace_t *entry =
+			&datapipe_trace[i % DATAPIPE_TRACE_SIZE];
+
+		callback(entry->time, entry->name, entry->value, user_data);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Look up an initialised datapipe by name
+ *
+ * @param name The name of the datapipe
+ * @return The datapipe, or NULL if not found
+ */
+static datapipe_struct *datapipe_find(const gchar *const name)
+{
+	GSList *item;
+
+	for (item = datapipe_list; item != NULL; item = item->next) {
+		datapipe_struct *datapipe = item->data;
+
+		if ((datapipe->name != NULL) && !strcmp(datapipe->name, name))
+			return datapipe;
+	}
+
+	return NULL;
+}
+
+/**
+ * Feed due entries of a replayed trace to their datapipes
+ *
+ * @param data Unused
+ * @return Always returns FALSE; the timer is rescheduled as needed
+ */
+static gboolean datapipe_trace_replay_cb(gpointer data)
+{
+	gint64 now = mce_lib_get_time_us(CLOCK_MONOTONIC) - replay_offset;
+
+	(void)data;
+
+	replay_id = 0;
+
+	while (replay_list != NULL) {
+		datapipe_replay_t *entry = replay_list->data;
+
+		if ((gint64)entry->time > now) {
+			replay_id = g_timeout_add((entry->time - now + 999) / 1000,
+						  datapipe_trace_replay_cb,
+						  NULL);
+			break;
+		}
+
+		replay_list = g_slist_delete_link(replay_list, replay_list);
+
+		(void)execute_datapipe(entry->datapipe,
+				       GINT_TO_POINTER(entry->value),
+				       USE_INDATA, CACHE_INDATA);
+		g_free(entry);
+	}
+
+	if (replay_list == NULL)
+		mce_log(LL_NOTICE, "Datapipe trace replay finished");
+
+	return FALSE;
+}
+
+/**
+ * Load a datapipe trace and start feeding it to the datapipes
+ *
+ * The file has one "<time [us]> <datapipe name> <value>" entry per
+ * line, as printed by mcetool --get-datapipe-trace; the entries are
+ * fed with the original relative timing.  Only datapipes that pass
+ * data as pointers can be replayed, others are skipped
+ *
+ * @param path The file to read the trace from
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean datapipe_trace_replay(const gchar *const path)
+{
+	gboolean status = FALSE;
+	FILE *file = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	char name[64];
+	unsigned long long time;
+	gint value;
+	GSList *list = NULL;
+	guint64 origin = 0;
+
+	if (replay_list != NULL) {
+		mce_log(LL_ERR,
+			"Datapipe trace replay already in progress");
+		goto EXIT;
+	}
+
+	if ((file = fopen(path, "r")) == NULL) {
+		mce_log(LL_ERR, "Cannot open `%s'; %m", path);
+		goto EXIT;
+	}
+
+	while (getline(&line, &size, file) != -1) {
+		datapipe_replay_t *entry;
+		datapipe_struct *datapipe;
+
+		if (sscanf(line, "%llu %63s %d", &time, name, &value) != 3)
+			continue;
+
+		if (((datapipe = datapipe_find(name)) == NULL) ||
+		    (datapipe_is_pointer_pipe(datapipe) == FALSE)) {
+			mce_log(LL_WARN,
+				"Skipping trace entry for datapipe `%s'",
+				name);
+			continue;
+		}
+
+		if (list == NULL)
+			origin = time;
+
+		entry = g_malloc(sizeof *entry);
+		entry->time = (time > origin) ? (time - origin) : 0;
+		entry->datapipe = datapipe;
+		entry->value = value;
+		list = g_slist_prepend(list, entry);
+	}
+
+	replay_list = g_slist_reverse(list);
+	replay_offset = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	mce_log(LL_NOTICE, "Replaying %u datapipe trace entries from `%s'",
+		g_slist_length(replay_list), path);
+
+	if (replay_list != NULL)
+		replay_id = g_idle_add(datapipe_trace_replay_cb, NULL);
+
+	status = TRUE;
+
+EXIT:
+	free(line);
+
+	if (file != NULL)
+		fclose(file);
+
+	return status;
+}
+
+/**
+ * Call a function for each initialised datapipe
+ *
+ * @param callback The function to call
+ * @param user_data Data to pass to the callback
+ */
+void datapipe_foreach(void (*callback)(const datapipe_struct *const datapipe,
+				       gpointer user_data),
+		      gpointer user_data)
+{
+	GSList *item;
+
+	if (callback == NULL) {
+		mce_log(LL_ERR,
+			"datapipe_foreach() called "
+			"without a valid callback");
+		goto EXIT;
+	}
+
+	for (item = datapipe_list; item != NULL; item = item->next)
+		callback(item->data, user_data);
+
+EXIT:
+	return;
+}
+
+/**
+ * Call all reference count triggers of a datapipe
+ *
+ * @param datapipe The datapipe whose reference count changed
+ */
+static void execute_datapipe_refcount_triggers(datapipe_struct *const datapipe)
+{
+	GPtrArray *triggers = datapipe->refcount_triggers;
+	void (*refcount_trigger)(void);
+	guint i;
+
+	for (i = 0; i < datapipe_get_array_refcount(triggers); i++) {
+		refcount_trigger = g_ptr_array_index(triggers, i);
+		refcount_trigger();
+	}
+}
 
 /**
  * Execute the input triggers of a datapipe
@@ -41,8 +367,9 @@ void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
 				     const caching_policy_t cache_indata)
 {
 	void (*trigger)(gconstpointer const input);
+	GPtrArray *triggers;
 	gpointer data;
-	gint i;
+	guint i;
 
 	if (datapipe == NULL) {
 		/* Potential memory leak! */
@@ -63,8 +390,10 @@ void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
 		}
 	}
 
-	for (i = 0; (trigger = g_slist_nth_data(datapipe->input_triggers,
-						i)) != NULL; i++) {
+	triggers = datapipe->input_triggers;
+
+	for (i = 0; i < datapipe_get_array_refcount(triggers); i++) {
+		trigger = g_ptr_array_index(triggers, i);
 		trigger(data);
 	}
 
@@ -86,9 +415,10 @@ gconstpointer execute_datapipe_filters(datapipe_struct *const datapipe,
 				       const data_source_t use_cache)
 {
 	gpointer (*filter)(gpointer input);
+	GPtrArray *filters;
 	gpointer data;
 	gconstpointer retval = NULL;
-	gint i;
+	guint i;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -99,9 +429,13 @@ gconstpointer execute_datapipe_filters(datapipe_struct *const datapipe,
 
 	data = (use_cache == USE_CACHE) ? datapipe->cached_data : indata;
 
-	for (i = 0; (filter = g_slist_nth_data(datapipe->filters,
-					       i)) != NULL; i++) {
-		gpointer tmp = filter(data);
+	filters = datapipe->filters;
+
+	for (i = 0; i < datapipe_get_array_refcount(filters); i++) {
+		gpointer tmp;
+
+		filter = g_ptr_array_index(filters, i);
+		tmp = filter(data);
 
 		/* If the data needs to be freed, and this isn't the indata,
 		 * or if we're not using the cache, then free the data
@@ -132,8 +466,9 @@ void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
 				      const data_source_t use_cache)
 {
 	void (*trigger)(gconstpointer input);
+	GPtrArray *triggers;
 	gconstpointer data;
-	gint i;
+	guint i;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -144,8 +479,10 @@ void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
 
 	data = (use_cache == USE_CACHE) ? datapipe->cached_data : indata;
 
-	for (i = 0; (trigger = g_slist_nth_data(datapipe->output_triggers,
-						i)) != NULL; i++) {
+	triggers = datapipe->output_triggers;
+
+	for (i = 0; i < datapipe_get_array_refcount(triggers); i++) {
+		trigger = g_ptr_array_index(triggers, i);
 		trigger(data);
 	}
 
@@ -170,6 +507,8 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 			       const caching_policy_t cache_indata)
 {
 	gconstpointer data = NULL;
+	guint64 t_input, t_filter, t_output, t_done;
+	guint triggers;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -178,16 +517,46 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
+	t_input = mce_lib_get_time_us(CLOCK_MONOTONIC);
+	triggers = datapipe_get_input_trigger_refcount(*datapipe);
+
+	datapipe_trace_record(datapipe, t_input,
+			      (use_cache == USE_CACHE) ?
+			      datapipe->cached_data : indata);
+
 	execute_datapipe_input_triggers(datapipe, indata, use_cache,
 					cache_indata);
 
+	t_filter = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
 	if (datapipe->read_only == READ_ONLY) {
 		data = indata;
 	} else {
 		data = execute_datapipe_filters(datapipe, indata, use_cache);
 	}
 
-	execute_datapipe_output_triggers(datapipe, data, USE_INDATA);
+	t_output = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	/* Skip the output triggers if nothing changed since last time */
+	if ((datapipe->suppress_unchanged == SUPPRESS_UNCHANGED) &&
+	    (datapipe->output_valid == TRUE) &&
+	    (datapipe->output_data == data)) {
+		datapipe->skipped_count++;
+	} else {
+		if (datapipe->suppress_unchanged == SUPPRESS_UNCHANGED) {
+			datapipe->output_data = data;
+			datapipe->output_valid = TRUE;
+		}
+
+		triggers += datapipe_get_output_trigger_refcount(*datapipe);
+		execute_datapipe_output_triggers(datapipe, data, USE_INDATA);
+	}
+
+	t_done = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	datapipe_update_stats(datapipe, triggers,
+			      t_output - t_filter,
+			      (t_filter - t_input) + (t_done - t_output));
 
 EXIT:
 	return data;
@@ -202,9 +571,6 @@ EXIT:
 void append_filter_to_datapipe(datapipe_struct *const datapipe,
 			       gpointer (*filter)(gpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_filter_to_datapipe() called "
@@ -226,11 +592,9 @@ void append_filter_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->filters = g_slist_append(datapipe->filters, filter);
+	g_ptr_array_add(datapipe->filters, filter);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -246,10 +610,6 @@ EXIT:
 void remove_filter_from_datapipe(datapipe_struct *const datapipe,
 				 gpointer (*filter)(gpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_filter_from_datapipe() called "
@@ -271,20 +631,14 @@ void remove_filter_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->filters);
-
-	datapipe->filters = g_slist_remove(datapipe->filters, filter);
-
 	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->filters)) {
+	if (g_ptr_array_remove(datapipe->filters, filter) == FALSE) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing filter");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -299,9 +653,6 @@ EXIT:
 void append_input_trigger_to_datapipe(datapipe_struct *const datapipe,
 				      void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_input_trigger_to_datapipe() called "
@@ -316,12 +667,9 @@ void append_input_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->input_triggers = g_slist_append(datapipe->input_triggers,
-						  trigger);
+	g_ptr_array_add(datapipe->input_triggers, trigger);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -337,10 +685,6 @@ EXIT:
 void remove_input_trigger_from_datapipe(datapipe_struct *const datapipe,
 					void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_input_trigger_from_datapipe() called "
@@ -355,21 +699,14 @@ void remove_input_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->input_triggers);
-
-	datapipe->input_triggers = g_slist_remove(datapipe->input_triggers,
-						  trigger);
-
 	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->input_triggers)) {
+	if (g_ptr_array_remove(datapipe->input_triggers, trigger) == FALSE) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing input trigger");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -384,9 +721,6 @@ EXIT:
 void append_output_trigger_to_datapipe(datapipe_struct *const datapipe,
 				       void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_output_trigger_to_datapipe() called "
@@ -401,12 +735,9 @@ void append_output_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->output_triggers = g_slist_append(datapipe->output_triggers,
-						   trigger);
+	g_ptr_array_add(datapipe->output_triggers, trigger);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -422,10 +753,6 @@ EXIT:
 void remove_output_trigger_from_datapipe(datapipe_struct *const datapipe,
 					 void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_output_trigger_from_datapipe() called "
@@ -440,21 +767,14 @@ void remove_output_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->output_triggers);
-
-	datapipe->output_triggers = g_slist_remove(datapipe->output_triggers,
-						   trigger);
-
 	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->output_triggers)) {
+	if (g_ptr_array_remove(datapipe->output_triggers, trigger) == FALSE) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing output trigger");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	execute_datapipe_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -483,7 +803,7 @@ void append_refcount_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->refcount_triggers = g_slist_append(datapipe->refcount_triggers, trigger);
+	g_ptr_array_add(datapipe->refcount_triggers, trigger);
 
 EXIT:
 	return;
@@ -499,8 +819,6 @@ EXIT:
 void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 					   void (*trigger)(void))
 {
-	guint oldlen;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_refcount_trigger_from_datapipe() called "
@@ -515,12 +833,8 @@ void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->refcount_triggers);
-
-	datapipe->refcount_triggers = g_slist_remove(datapipe->refcount_triggers, trigger);
-
 	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->refcount_triggers)) {
+	if (g_ptr_array_remove(datapipe->refcount_triggers, trigger) == FALSE) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing refcount trigger");
 		goto EXIT;
@@ -530,21 +844,127 @@ EXIT:
 	return;
 }
 
+/**
+ * Run all queued deferred datapipe executions
+ *
+ * @param data Unused
+ * @return Always returns FALSE to disable the idle callback
+ */
+static gboolean execute_deferred_datapipes_cb(gpointer data)
+{
+	GSList *list = deferred_list;
+	GSList *item;
+
+	(void)data;
+
+	/* Executions deferred by the triggers go to the next round */
+	deferred_list = NULL;
+	deferred_id = 0;
+
+	for (item = list; item != NULL; item = item->next) {
+		datapipe_struct *datapipe = item->data;
+
+		datapipe->deferred = FALSE;
+		(void)execute_datapipe(datapipe, datapipe->deferred_data,
+				       datapipe->deferred_use_cache,
+				       datapipe->deferred_cache_indata);
+	}
+
+	g_slist_free(list);
+
+	return FALSE;
+}
+
+/**
+ * Queue a datapipe execution for the next main loop iteration
+ *
+ * Only the latest value matters: if the datapipe already has a
+ * queued execution, it is replaced, and the filters and triggers run
+ * just once.  A request to re-run the pipe from the cache does not
+ * replace a queued new value.  Datapipes that do not pass data as
+ * pointers are executed immediately instead
+ *
+ * @param datapipe The datapipe to execute
+ * @param indata The input data to run through the datapipe
+ * @param use_cache USE_CACHE to use data from cache,
+ *                  USE_INDATA to use indata
+ * @param cache_indata CACHE_INDATA to cache the indata,
+ *                     DONT_CACHE_INDATA to keep the old data
+ */
+void execute_datapipe_deferred(datapipe_struct *const datapipe,
+			       gpointer indata,
+			       const data_source_t use_cache,
+			       const caching_policy_t cache_indata)
+{
+	if (datapipe == NULL) {
+		mce_log(LL_ERR,
+			"execute_datapipe_deferred() called "
+			"without a valid datapipe");
+		goto EXIT;
+	}
+
+	/* Queued allocated data would have no owner */
+	if ((datapipe->free_cache == FREE_CACHE) ||
+	    (datapipe->datasize != 0)) {
+		(void)execute_datapipe(datapipe, indata,
+				       use_cache, cache_indata);
+		goto EXIT;
+	}
+
+	if (datapipe->deferred == TRUE) {
+		datapipe->stats.coalesced_count++;
+
+		/* Keep the queued value over a plain re-run request */
+		if ((use_cache == USE_CACHE) &&
+		    (datapipe->deferred_use_cache == USE_INDATA))
+			goto EXIT;
+
+		/* The replaced value would have been cached */
+		if ((datapipe->deferred_use_cache == USE_INDATA) &&
+		    (datapipe->deferred_cache_indata == CACHE_INDATA))
+			datapipe->cached_data = datapipe->deferred_data;
+	} else {
+		datapipe->deferred = TRUE;
+		deferred_list = g_slist_append(deferred_list, datapipe);
+	}
+
+	datapipe->deferred_data = indata;
+	datapipe->deferred_use_cache = use_cache;
+	datapipe->deferred_cache_indata = cache_indata;
+
+	/* Run at default priority so that the queued state changes
+	 * are not starved by timers and I/O handled before idles */
+	if (deferred_id == 0)
+		deferred_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+					      execute_deferred_datapipes_cb,
+					      NULL, NULL);
+
+EXIT:
+	return;
+}
+
 /**
  * Initialise a datapipe
  *
  * @param datapipe The datapipe to manipulate
+ * @param name The name of the datapipe, used in diagnostics
  * @param read_only READ_ONLY if the datapipe is read only,
  *                  READ_WRITE if it's read/write
  * @param free_cache FREE_CACHE if the cached data needs to be freed,
  *                   DONT_FREE_CACHE if the cache data should not be freed
+ * @param suppress_unchanged SUPPRESS_UNCHANGED to skip output triggers
+ *                           when the filtered value does not change,
+ *                           DONT_SUPPRESS_UNCHANGED to always run them;
+ *                           only usable with pipes passing data as pointers
  * @param datasize Pass size of memory to copy,
  *		   or 0 if only passing pointers or data as pointers
  * @param initial_data Initial cache content
  */
 void setup_datapipe(datapipe_struct *const datapipe,
+		    const gchar *const name,
 		    const read_only_policy_t read_only,
 		    const cache_free_policy_t free_cache,
+		    const change_policy_t suppress_unchanged,
 		    const gsize datasize, gpointer initial_data)
 {
 	if (datapipe == NULL) {
@@ -554,14 +974,33 @@ void setup_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->filters = NULL;
-	datapipe->input_triggers = NULL;
-	datapipe->output_triggers = NULL;
-	datapipe->refcount_triggers = NULL;
+	datapipe->name = name;
+	datapipe->filters = g_ptr_array_new();
+	datapipe->input_triggers = g_ptr_array_new();
+	datapipe->output_triggers = g_ptr_array_new();
+	datapipe->refcount_triggers = g_ptr_array_new();
 	datapipe->datasize = datasize;
 	datapipe->read_only = read_only;
 	datapipe->free_cache = free_cache;
 	datapipe->cached_data = initial_data;
+	datapipe->suppress_unchanged = suppress_unchanged;
+	datapipe->output_valid = FALSE;
+	datapipe->output_data = NULL;
+	datapipe->skipped_count = 0;
+	memset(&datapipe->stats, 0, sizeof datapipe->stats);
+	datapipe->deferred = FALSE;
+	datapipe->deferred_data = NULL;
+
+	/* Comparing pointers to allocated data would be meaningless */
+	if ((suppress_unchanged == SUPPRESS_UNCHANGED) &&
+	    ((free_cache == FREE_CACHE) || (datasize != 0))) {
+		mce_log(LL_ERR,
+			"setup_datapipe() called with SUPPRESS_UNCHANGED "
+			"on a datapipe that does not pass data as pointers");
+		datapipe->suppress_unchanged = DONT_SUPPRESS_UNCHANGED;
+	}
+
+	datapipe_list = g_slist_append(datapipe_list, datapipe);
 
 EXIT:
 	return;
@@ -582,25 +1021,25 @@ void free_datapipe(datapipe_struct *const datapipe)
 	}
 
 	/* Warn about still registered filters/triggers */
-	if (datapipe->filters != NULL) {
+	if (datapipe_get_array_refcount(datapipe->filters) != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered filter(s)");
 	}
 
-	if (datapipe->input_triggers != NULL) {
+	if (datapipe_get_array_refcount(datapipe->input_triggers) != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered input_trigger(s)");
 	}
 
-	if (datapipe->output_triggers != NULL) {
+	if (datapipe_get_array_refcount(datapipe->output_triggers) != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered output_trigger(s)");
 	}
 
-	if (datapipe->refcount_triggers != NULL) {
+	if (datapipe_get_array_refcount(datapipe->refcount_triggers) != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered refcount_trigger(s)");
@@ -610,6 +1049,39 @@ void free_datapipe(datapipe_struct *const datapipe)
 		g_free(datapipe->cached_data);
 	}
 
+	if (datapipe->filters != NULL) {
+		g_ptr_array_free(datapipe->filters, TRUE);
+		datapipe->filters = NULL;
+	}
+
+	if (datapipe->input_triggers != NULL) {
+		g_ptr_array_free(datapipe->input_triggers, TRUE);
+		datapipe->input_triggers = NULL;
+	}
+
+	if (datapipe->output_triggers != NULL) {
+		g_ptr_array_free(datapipe->output_triggers, TRUE);
+		datapipe->output_triggers = NULL;
+	}
+
+	if (datapipe->refcount_triggers != NULL) {
+		g_ptr_array_free(datapipe->refcount_triggers, TRUE);
+		datapipe->refcount_triggers = NULL;
+	}
+
+	datapipe_list = g_slist_remove(datapipe_list, datapipe);
+
+	/* Drop a pending deferred execution */
+	if (datapipe->deferred == TRUE) {
+		deferred_list = g_slist_remove(deferred_list, datapipe);
+		datapipe->deferred = FALSE;
+
+		if ((deferred_list == NULL) && (deferred_id != 0)) {
+			g_source_remove(deferred_id);
+			deferred_id = 0;
+		}
+	}
+
 EXIT:
 	return;
 }
@@ -23,22 +23,59 @@
 
 #include <glib.h>
 
+/** Number of buckets in the datapipe execution latency histogram */
+#define DATAPIPE_HISTOGRAM_BUCKETS	6
+
+/**
+ * Datapipe execution statistics
+ *
+ * Histogram bucket N counts executions that took less than
+ * 10^(N+1) microseconds; the last bucket collects the rest
+ */
+typedef struct {
+	guint exec_count;		/**< Number of executions */
+	guint trigger_count;		/**< Number of trigger calls */
+	guint64 filter_time;		/**< Time spent in filters [us] */
+	guint64 trigger_time;		/**< Time spent in triggers [us] */
+	guint64 max_time;		/**< Slowest execution [us] */
+	guint coalesced_count;		/**< Deferred executions that were
+					 *   merged into a later one */
+	guint histogram[DATAPIPE_HISTOGRAM_BUCKETS];
+					/**< Execution latency histogram */
+} datapipe_stats_t;
+
 /**
  * Datapipe structure
  *
  * Only access this struct through the functions
  */
 typedef struct {
-	GSList *filters;		/**< The filters */
-	GSList *input_triggers;		/**< Triggers called on indata */
-	GSList *output_triggers;	/**< Triggers called on outdata */
-	GSList *refcount_triggers;	/**< Triggers called on
+	const gchar *name;		/**< Name used in diagnostics */
+	GPtrArray *filters;		/**< The filters */
+	GPtrArray *input_triggers;	/**< Triggers called on indata */
+	GPtrArray *output_triggers;	/**< Triggers called on outdata */
+	GPtrArray *refcount_triggers;	/**< Triggers called on
 					 *   reference count changes
 					 */
 	gpointer cached_data;		/**< Latest cached data */
 	gsize datasize;			/**< Size of data; NULL == automagic */
 	gboolean free_cache;		/**< Free the cache? */
 	gboolean read_only;		/**< Datapipe is read only */
+	gboolean suppress_unchanged;	/**< Skip output triggers when
+					 *   the filtered value does
+					 *   not change */
+	gboolean output_valid;		/**< Is output_data valid? */
+	gconstpointer output_data;	/**< Data last passed to
+					 *   the output triggers */
+	guint skipped_count;		/**< Number of executions where
+					 *   output triggers were skipped */
+	datapipe_stats_t stats;		/**< Execution statistics */
+	gboolean deferred;		/**< Is a deferred execution queued? */
+	gpointer deferred_data;		/**< Indata for deferred execution */
+	gboolean deferred_use_cache;	/**< Data source for deferred
+					 *   execution */
+	gboolean deferred_cache_indata;	/**< Caching policy for deferred
+					 *   execution */
 } datapipe_struct;
 
 /**
@@ -57,6 +94,16 @@ typedef enum {
 	FREE_CACHE = TRUE		/**< Free the cache */
 } cache_free_policy_t;
 
+/**
+ * Policy used for output triggers when the value does not change
+ */
+typedef enum {
+	/** Run output triggers on every execution */
+	DONT_SUPPRESS_UNCHANGED = FALSE,
+	/** Skip output triggers if the filtered value equals the previous one */
+	SUPPRESS_UNCHANGED = TRUE
+} change_policy_t;
+
 /**
  * Policy for the data source
  */
@@ -88,12 +135,33 @@ typedef enum {
 
 /* Reference count */
 
+/** Retrieve the number of entries in a datapipe callback array */
+#define datapipe_get_array_refcount(_array)	((_array) ? (_array)->len : 0u)
 /** Retrieve the filter reference count from a datapipe */
-#define datapipe_get_filter_refcount(_datapipe)	(g_slist_length((_datapipe).filters))
+#define datapipe_get_filter_refcount(_datapipe)	(datapipe_get_array_refcount((_datapipe).filters))
 /** Retrieve the input trigger reference count from a datapipe */
-#define datapipe_get_input_trigger_refcount(_datapipe)	(g_slist_length((_datapipe).input_triggers))
+#define datapipe_get_input_trigger_refcount(_datapipe)	(datapipe_get_array_refcount((_datapipe).input_triggers))
 /** Retrieve the output trigger reference count from a datapipe */
-#define datapipe_get_output_trigger_refcount(_datapipe)	(g_slist_length((_datapipe).output_triggers))
+#define datapipe_get_output_trigger_refcount(_datapipe)	(datapipe_get_array_refcount((_datapipe).output_triggers))
+
+/* Statistics */
+
+/** Retrieve the number of executions with suppressed output triggers */
+#define datapipe_get_skipped_count(_datapipe)	((_datapipe).skipped_count)
+/** Retrieve the name of a datapipe */
+#define datapipe_get_name(_datapipe)	((_datapipe).name ? (_datapipe).name : "unnamed")
+
+void datapipe_foreach(void (*callback)(const datapipe_struct *const datapipe,
+				       gpointer user_data),
+		      gpointer user_data);
+
+/* Execution trace */
+void datapipe_trace_foreach(void (*callback)(guint64 time,
+					     const gchar *name,
+					     gint value,
+					     gpointer user_data),
+			    gpointer user_data);
+gboolean datapipe_trace_replay(const gchar *const path);
 
 /* Datapipe execution */
 void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
@@ -110,6 +178,10 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 			       gpointer indata,
 			       const data_source_t use_cache,
 			       const caching_policy_t cache_indata);
+void execute_datapipe_deferred(datapipe_struct *const datapipe,
+			       gpointer indata,
+			       const data_source_t use_cache,
+			       const caching_policy_t cache_indata);
 
 /* Filters */
 void append_filter_to_datapipe(datapipe_struct *const datapipe,
@@ -136,8 +208,10 @@ void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 					   void (*trigger)(void));
 
 void setup_datapipe(datapipe_struct *const datapipe,
+		    const gchar *const name,
 		    const read_only_policy_t read_only,
 		    const cache_free_policy_t free_cache,
+		    const change_policy_t suppress_unchanged,
 		    const gsize datasize, gpointer initial_data);
 void free_datapipe(datapipe_struct *const datapipe);
 
@@ -20,18 +20,15 @@
  * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <glib.h>
-#include <gio/gio.h>
 #include <glib/gstdio.h>		/* g_access() */
-#include <glib-object.h>		/* g_signal_connect(),
-					 * G_OBJECT(),
-					 * G_CALLBACK()
-					 */
 
 #include <errno.h>			/* errno */
+#include <stdlib.h>			/* strtol() */
 #include <fcntl.h>			/* open() */
 #include <dirent.h>			/* opendir(), readdir(), telldir() */
 #include <string.h>			/* strcmp() */
 #include <unistd.h>			/* close() */
+#include <time.h>			/* clockid_t, CLOCK_REALTIME */
 #include <sys/ioctl.h>			/* ioctl() */
 #include <sys/types.h>			/* DIR */
 #include <linux/input.h>		/* struct input_event,
@@ -65,26 +62,41 @@
 #include "mce.h"
 #include "event-input.h"
 
-#include "mce-io.h"			/* mce_read_string_from_file(),
+#include "mce-io.h"			/* mce_read_cached_string_from_file(),
 					 * mce_write_string_to_file(),
 					 * mce_suspend_io_monitor(),
 					 * mce_resume_io_monitor(),
 					 * mce_register_io_monitor_chunk(),
+					 * mce_register_io_monitor_chunk_batch(),
 					 * mce_unregister_io_monitor(),
 					 * mce_get_io_monitor_name(),
 					 * mce_get_io_monitor_fd()
 					 */
-#include "mce-lib.h"			/* bitsize_of(),
-					 * set_bit(), clear_bit(), test_bit(),
-					 * bitfield_to_string(),
-					 * string_to_bitfield()
+#include "mce-lib.h"			/* mce_lib_get_time_us(),
+					 * mce_bitset_t,
+					 * mce_bitset_clear_all(),
+					 * mce_bitset_set(), mce_bitset_clear(),
+					 * mce_bitset_test(),
+					 * mce_bitset_set_array(),
+					 * mce_bitset_andnot(),
+					 * mce_bitset_intersects(),
+					 * mce_bitset_is_empty(),
+					 * mce_bitset_from_string(),
+					 * mce_bitset_to_string()
 					 */
 #include "mce-log.h"			/* mce_log(), LL_* */
 #include "mce-conf.h"			/* mce_conf_get_int(),
 					 * mce_conf_get_string()
 					 */
 #include "datapipe.h"			/* execute_datapipe() */
+#include "mce-dbus.h"			/* mce_dbus_handler_add(),
+					 * dbus_send_message(),
+					 * dbus_new_method_reply()
+					 */
 #include "evdev.h"
+#include "filewatcher.h"		/* filewatcher_create_dir(),
+					 * filewatcher_delete()
+					 */
 /** ID for touchscreen I/O monitor timeout source */
 static guint touchscreen_io_monitor_timeout_cb_id = 0;
 
@@ -101,12 +113,15 @@ static GSList *keyboard_dev_list = NULL;
 /** List of misc input devices */
 static GSList *misc_dev_list = NULL;
 
-/** GFile pointer for the directory we monitor */
-static GFile *dev_input_gfp = NULL;
-/** GFileMonitor pointer for the directory we monitor */
-static GFileMonitor *dev_input_gfmp = NULL;
-/** The handler ID for the signal handler */
-static gulong dev_input_handler_id = 0;
+/** inotify watcher for the directory we monitor */
+static filewatcher_t *dev_input_watcher = NULL;
+/** Device nodes changed since the last hotplug update;
+ *  path -> GINT_TO_POINTER(TRUE) if the node exists */
+static GHashTable *dev_input_changes = NULL;
+/** Has the directory content been lost and needs a rescan? */
+static gboolean dev_input_rescan = FALSE;
+/** ID for hotplug update timeout source */
+static guint dev_input_update_cb_id = 0;
 
 /** Time in milliseconds before the key press is considered long */
 static gint longdelay = DEFAULT_HOME_LONG_DELAY;
@@ -115,6 +130,7 @@ static gint longdelay = DEFAULT_HOME_LONG_DELAY;
 static gboolean gpio_key_disable_exists = FALSE;
 
 static void update_inputdevices(const gchar *device, gboolean add);
+static void schedule_switch_resync(void);
 
 #ifndef FF_STATUS_CNT
 # ifdef FF_STATUS_MAX
@@ -132,10 +148,6 @@ static void update_inputdevices(const gchar *device, gboolean add);
 # endif
 #endif
 
-/** Calculate how many elements an array of longs bitmap needs to
- *  have enough space for bc items */
-#define EVDEVBITS_LEN(bc) (((bc)+LONG_BIT-1)/LONG_BIT)
-
 /** Supported codes for one evdev event type
  */
 typedef struct
@@ -145,7 +157,7 @@ typedef struct
 	/** event code count for this type */
 	int cnt;
 	/** bitmask of supported event codes */
-	unsigned long bit[0];
+	mce_bitset_t bits;
 } evdevbits_t;
 
 /** Create empty event code bitmap for one evdev event type
@@ -177,9 +189,14 @@ static evdevbits_t *evdevbits_create(int type)
 	default: break;
 	}
 
+	if( cnt > MCE_BITSET_BITS ) {
+		mce_log(LL_WARN, "%s: %d codes do not fit in a bitset",
+			evdev_get_event_type_name(type), cnt);
+		cnt = MCE_BITSET_BITS;
+	}
+
 	if( cnt > 0 ) {
-		int len = EVDEVBITS_LEN(cnt);
-		self = g_malloc0(sizeof *self + len * sizeof *self->bit);
+		self = g_malloc0(sizeof *self);
 		self->type = type;
 		self->cnt  = cnt;
 	}
@@ -201,10 +218,8 @@ static void evdevbits_delete(evdevbits_t *self)
  */
 static void evdevbits_clear(evdevbits_t *self)
 {
-	if( self ) {
-		int len = EVDEVBITS_LEN(self->cnt);
-		memset(self->bit, 0, len * sizeof *self->bit);
-	}
+	if( self )
+		mce_bitset_clear_all(&self->bits);
 }
 
 /** Read supported codes from file descriptor
@@ -217,7 +232,8 @@ static void evdevbits_clear(evdevbits_t *self)
 static int evdevbits_probe(evdevbits_t *self, int fd)
 {
 	int res = 0;
-	if( self && ioctl(fd, EVIOCGBIT(self->type, self->cnt), self->bit) == -1 ) {
+	if( self && ioctl(fd, EVIOCGBIT(self->type, sizeof self->bits.word),
+			  self->bits.word) == -1 ) {
 		mce_log(LL_WARN, "EVIOCGBIT(%s, %d): %m",
 			evdev_get_event_type_name(self->type), self->cnt);
 		evdevbits_clear(self);
@@ -236,11 +252,25 @@ static int evdevbits_probe(evdevbits_t *self, int fd)
 static int evdevbits_test(const evdevbits_t *self, int bit)
 {
 	int res = 0;
-	if( self && (unsigned)bit < (unsigned)self->cnt ) {
-		int i = bit / LONG_BIT;
-		unsigned long m = 1ul << (bit % LONG_BIT);
-		if( self->bit[i] & m ) res = 1;
-	}
+	if( self && (unsigned)bit < (unsigned)self->cnt )
+		res = mce_bitset_test(&self->bits, bit);
+	return res;
+}
+
+/** Test if any of the evdev event codes in a mask are set in bitmap
+ *
+ * The test is done a word at a time
+ *
+ * @param self evdevbits_t object, or NULL
+ * @param mask event codes to check
+ *
+ * @return 1 if any of the codes is supported, 0 otherwise
+ */
+static int evdevbits_test_any(const evdevbits_t *self, const mce_bitset_t *mask)
+{
+	int res = 0;
+	if( self )
+		res = mce_bitset_intersects(&self->bits, mask);
 	return res;
 }
 
@@ -297,18 +327,14 @@ static int evdevinfo_has_type(const evdevinfo_t *self, int type)
 /** Check if any of given event types are supported
  *
  * @param self evdevinfo_t object
- * @param types array of evdev event types
+ * @param types bitmask of evdev event types
  *
  * @return 1 if at least on of the types is supported, 0 otherwise
  */
-static int evdevinfo_has_types(const evdevinfo_t *self, const int *types)
+static int evdevinfo_has_types(const evdevinfo_t *self,
+			       const mce_bitset_t *types)
 {
-  int res = 0;
-  for( size_t i = 0; types[i] >= 0; ++i ) {
-	  if( (res = evdevinfo_has_type(self, types[i])) )
-		  break;
-  }
-  return res;
+  return evdevbits_test_any(self->mask[0], types);
 }
 
 /** Check if event code is supported
@@ -332,19 +358,39 @@ static int evdevinfo_has_code(const evdevinfo_t *self, int type, int code)
  *
  * @param self evdevinfo_t object
  * @param type evdev event type
- * @param code array of evdev event codes
+ * @param codes bitmask of evdev event codes
  *
  * @return 1 if at least on of the event codes for type is supported, 0 otherwise
  */
-static int evdevinfo_has_codes(const evdevinfo_t *self, int type, const int *codes)
+static int evdevinfo_has_codes(const evdevinfo_t *self, int type,
+			       const mce_bitset_t *codes)
 {
 	int res = 0;
 
-	if( evdevinfo_has_type(self, type) ) {
-		for( size_t i = 0; codes[i] != -1; ++i ) {
-			if( (res = evdevbits_test(self->mask[type], codes[i])) )
-				break;
-		}
+	if( evdevinfo_has_type(self, type) )
+		res = evdevbits_test_any(self->mask[type], codes);
+	return res;
+}
+
+/** Check if only the given event codes are supported
+ *
+ * @param self evdevinfo_t object
+ * @param type evdev event type
+ * @param codes bitmask of evdev event codes
+ *
+ * @return 1 if no other event codes for type are supported, 0 otherwise
+ */
+static int evdevinfo_has_only_codes(const evdevinfo_t *self, int type,
+				    const mce_bitset_t *codes)
+{
+	int res = 1;
+
+	if( evdevinfo_has_type(self, type) && self->mask[type] ) {
+		mce_bitset_t rest = self->mask[type]->bits;
+
+		mce_bitset_andnot(&rest, codes);
+
+		res = mce_bitset_is_empty(&rest);
 	}
 	return res;
 }
@@ -461,6 +507,30 @@ static evdev_type_t get_evdev_type(int fd)
 	  -1
 	};
 
+	/* Proximity and ambient light sensor events */
+	static const int als_ps_lut[] = {
+		ABS_DISTANCE,
+		ABS_MISC,
+		-1
+	};
+
+	/* The above as bitmasks, built on the first call */
+	static mce_bitset_t keypad_mask;
+	static mce_bitset_t switch_mask;
+	static mce_bitset_t misc_mask;
+	static mce_bitset_t all_but_abs_mask;
+	static mce_bitset_t als_ps_mask;
+	static gboolean masks_ready = FALSE;
+
+	if( !masks_ready ) {
+		mce_bitset_set_array(&keypad_mask, keypad_lut);
+		mce_bitset_set_array(&switch_mask, switch_lut);
+		mce_bitset_set_array(&misc_mask, misc_lut);
+		mce_bitset_set_array(&all_but_abs_mask, all_but_abs_lut);
+		mce_bitset_set_array(&als_ps_mask, als_ps_lut);
+		masks_ready = TRUE;
+	}
+
 	/* MCE has no use for accelerometers etc */
 	if( evdevinfo_has_code(feat, EV_KEY, BTN_Z) ||
 	    evdevinfo_has_code(feat, EV_ABS, ABS_Z) ) {
@@ -488,8 +558,8 @@ static evdev_type_t get_evdev_type(int fd)
 	}
 
 	/* Some keys and swithes are processed at mce level */
-	if( evdevinfo_has_codes(feat, EV_KEY, keypad_lut ) ||
-	    evdevinfo_has_codes(feat, EV_SW,  switch_lut ) ) {
+	if( evdevinfo_has_codes(feat, EV_KEY, &keypad_mask) ||
+	    evdevinfo_has_codes(feat, EV_SW,  &switch_mask) ) {
 		res = EVDEV_INPUT;
 		goto cleanup;
 	}
@@ -500,34 +570,21 @@ static evdev_type_t get_evdev_type(int fd)
 	 * in more appropriate place and should not be used for
 	 * "user activity" tracking. */
 	if( evdevinfo_has_type(feat, EV_ABS) &&
-	    !evdevinfo_has_types(feat, all_but_abs_lut) ) {
+	    !evdevinfo_has_types(feat, &all_but_abs_mask) ) {
 		int maybe_als = evdevinfo_has_code(feat, EV_ABS, ABS_MISC);
 		int maybe_ps  = evdevinfo_has_code(feat, EV_ABS, ABS_DISTANCE);
 
 		// supports one of the two, but not both ...
-		if( maybe_als != maybe_ps ) {
-			for( int code = 0; ; ++code ) {
-				switch( code ) {
-				case ABS_CNT:
-					// ... and no other events supported
-					res = EVDEV_REJECT;
-					goto cleanup;
-
-				case ABS_DISTANCE:
-				case ABS_MISC:
-					continue;
-
-				default:
-					break;
-				}
-				if( evdevinfo_has_code(feat, EV_ABS, code) )
-					break;
-			}
+		// ... and no other events supported
+		if( maybe_als != maybe_ps &&
+		    evdevinfo_has_only_codes(feat, EV_ABS, &als_ps_mask) ) {
+			res = EVDEV_REJECT;
+			goto cleanup;
 		}
 	}
 
 	/* Track events that can be considered as "user activity" */
-	if( evdevinfo_has_types(feat, misc_lut) ) {
+	if( evdevinfo_has_types(feat, &misc_mask) ) {
 		res = EVDEV_ACTIVITY;
 		goto cleanup;
 	}
@@ -539,6 +596,473 @@ cleanup:
 	return res;
 }
 
+/** Cached evdev classifications, survives mce restarts but not reboots */
+#define EVDEV_TYPE_CACHE_PATH G_STRINGIFY(MCE_RUN_DIR)"/evdev-types.cache"
+
+/** Lookup table for device identity -> evdev_type_t + 1 */
+static GHashTable *evdev_type_cache = NULL;
+
+/** Has the classification cache changed since it was last saved? */
+static gboolean evdev_type_cache_dirty = FALSE;
+
+/** Construct identity string for an evdev device node
+ *
+ * The identity is made from EVIOCGID data, device name and physical
+ * path; devices with matching identity are assumed to have identical
+ * capabilities and thus can share the classification result.
+ *
+ * @param fd   file descriptor of the device node
+ * @param name device name as reported by EVIOCGNAME
+ *
+ * @return identity string that must be released with g_free(),
+ *         or NULL if the device can't be identified
+ */
+static gchar *evdev_type_cache_identity(int fd, const char *name)
+{
+	struct input_id id;
+	char phys[256];
+
+	memset(&id, 0, sizeof id);
+
+	if( ioctl(fd, EVIOCGID, &id) == -1 )
+		return NULL;
+
+	if( ioctl(fd, EVIOCGPHYS(sizeof phys), phys) < 0 )
+		*phys = 0;
+	phys[sizeof phys - 1] = 0;
+
+	/* Line based cache file; do not cache odd names */
+	if( strchr(name, '\n') || strchr(phys, '\n') )
+		return NULL;
+
+	return g_strdup_printf("%04x:%04x:%04x:%04x:%s:%s",
+			       id.bustype, id.vendor, id.product, id.version,
+			       name, phys);
+}
+
+/** Load previously cached evdev classifications
+ */
+static void evdev_type_cache_load(void)
+{
+	gchar *data = NULL;
+	gchar *now  = NULL;
+	gchar *eol  = NULL;
+
+	if( !evdev_type_cache )
+		evdev_type_cache = g_hash_table_new_full(g_str_hash,
+							 g_str_equal,
+							 g_free, NULL);
+
+	if( !(data = mce_io_load_file(EVDEV_TYPE_CACHE_PATH, NULL)) )
+		goto EXIT;
+
+	for( now = data; *now; now = eol ) {
+		gchar *key = NULL;
+		int    type;
+
+		if( (eol = strchr(now, '\n')) )
+			*eol++ = 0;
+		else
+			eol = strchr(now, 0);
+
+		type = (int)strtol(now, &key, 10);
+
+		if( key == now || *key != ' ' ||
+		    type < EVDEV_REJECT || type > EVDEV_IGNORE ) {
+			mce_log(LL_WARN, "%s: ignoring invalid line",
+				EVDEV_TYPE_CACHE_PATH);
+			continue;
+		}
+
+		g_hash_table_replace(evdev_type_cache, g_strdup(key + 1),
+				     GINT_TO_POINTER(type + 1));
+	}
+
+	mce_log(LL_DEBUG, "%s: %u cached classifications",
+		EVDEV_TYPE_CACHE_PATH, g_hash_table_size(evdev_type_cache));
+
+EXIT:
+	g_free(data);
+}
+
+/** Save evdev classifications if the cache has changed
+ */
+static void evdev_type_cache_save(void)
+{
+	GString       *data = NULL;
+	GHashTableIter iter;
+	gpointer       key, val;
+
+	if( !evdev_type_cache || !evdev_type_cache_dirty )
+		goto EXIT;
+
+	evdev_type_cache_dirty = FALSE;
+
+	data = g_string_new(NULL);
+
+	g_hash_table_iter_init(&iter, evdev_type_cache);
+	while( g_hash_table_iter_next(&iter, &key, &val) )
+		g_string_append_printf(data, "%d %s\n",
+				       GPOINTER_TO_INT(val) - 1,
+				       (const gchar *)key);
+
+	mce_io_update_file_atomic_async(EVDEV_TYPE_CACHE_PATH,
+					data->str, data->len,
+					0644, FALSE, NULL, NULL);
+
+EXIT:
+	if( data )
+		g_string_free(data, TRUE);
+}
+
+/** Release the evdev classification cache
+ */
+static void evdev_type_cache_quit(void)
+{
+	evdev_type_cache_save();
+
+	if( evdev_type_cache ) {
+		g_hash_table_unref(evdev_type_cache);
+		evdev_type_cache = NULL;
+	}
+}
+
+/** Get evdev classification, using cached results when available
+ *
+ * Probing evdev capabilities takes several ioctl() calls per device,
+ * which adds up during bootup and on every hotplug event. Devices that
+ * have been seen before are classified based on identity alone.
+ *
+ * @param fd   file descriptor to probe data from
+ * @param name device name as reported by EVIOCGNAME
+ *
+ * @return one of EVDEV_TOUCH, EVDEV_INPUT, ...
+ */
+static evdev_type_t get_evdev_type_cached(int fd, const char *name)
+{
+	evdev_type_t type;
+	gchar       *key = evdev_type_cache_identity(fd, name);
+	gpointer     val = NULL;
+
+	if( key && evdev_type_cache )
+		val = g_hash_table_lookup(evdev_type_cache, key);
+
+	if( val ) {
+		type = GPOINTER_TO_INT(val) - 1;
+		mce_log(LL_DEBUG, "%s: cached", key);
+		goto EXIT;
+	}
+
+	type = get_evdev_type(fd);
+
+	if( key && evdev_type_cache ) {
+		g_hash_table_replace(evdev_type_cache, key,
+				     GINT_TO_POINTER(type + 1));
+		key = NULL;
+		evdev_type_cache_dirty = TRUE;
+	}
+
+EXIT:
+	g_free(key);
+
+	return type;
+}
+
+/** Number of buckets in the input latency histograms */
+#define INPUT_LATENCY_BUCKETS		8
+
+/** Upper limits of the input latency histogram buckets [us];
+ *  the last bucket collects the rest */
+static const guint64 input_latency_limit[INPUT_LATENCY_BUCKETS - 1] =
+{
+	1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+/** Display changes made later than this after an input event
+ *  are not attributed to the event [us] */
+#define INPUT_LATENCY_OUTPUT_WINDOW	2000000
+
+/** Latency histogram */
+typedef struct {
+	/** Number of samples */
+	guint count;
+	/** Sum of the samples [us] */
+	guint64 total;
+	/** Largest sample [us] */
+	guint64 max;
+	/** Sample counts per bucket */
+	guint histogram[INPUT_LATENCY_BUCKETS];
+} input_latency_hist_t;
+
+/** Input latency statistics for one evdev device */
+typedef struct {
+	/** Clock used for the event time stamps */
+	clockid_t clock;
+	/** Event time stamp -> mce processing */
+	input_latency_hist_t process;
+	/** Event time stamp -> display change written */
+	input_latency_hist_t output;
+} input_latency_t;
+
+/** Lookup table for device path -> input_latency_t */
+static GHashTable *input_latency_lut = NULL;
+
+/** Log latencies exceeding this many milliseconds; 0 = disabled */
+static gint input_latency_threshold = DEFAULT_INPUT_LATENCY_THRESHOLD;
+
+/** Device of the latest user input event not yet followed by
+ *  a display change */
+static const gchar *input_latency_pending_name = NULL;
+
+/** Time stamp of the pending user input event [us, CLOCK_MONOTONIC] */
+static guint64 input_latency_pending_stamp = 0;
+
+/**
+ * Add a sample to a latency histogram
+ *
+ * @param hist The histogram
+ * @param device The device path, for logging outliers
+ * @param what Name of the histogram, for logging outliers
+ * @param latency The latency [us]
+ */
+static void input_latency_add(input_latency_hist_t *hist,
+			      const gchar *device, const gchar *what,
+			      guint64 latency)
+{
+	int i;
+
+	for (i = 0; i < INPUT_LATENCY_BUCKETS - 1; i++) {
+		if (latency < input_latency_limit[i])
+			break;
+	}
+
+	hist->histogram[i] += 1;
+	hist->count += 1;
+	hist->total += latency;
+
+	if (hist->max < latency)
+		hist->max = latency;
+
+	if ((input_latency_threshold > 0) &&
+	    (latency >= (guint64)input_latency_threshold * 1000)) {
+		mce_log(LL_WARN, "%s: %s latency %" G_GUINT64_FORMAT " us",
+			device, what, latency);
+	}
+}
+
+/**
+ * Start latency tracking for an evdev device
+ *
+ * The kernel is asked to use CLOCK_MONOTONIC for the event time
+ * stamps; older kernels keep using CLOCK_REALTIME
+ *
+ * @param fd The device file descriptor
+ * @param device The device path
+ */
+static void input_latency_register(int fd, const gchar *device)
+{
+	input_latency_t *stats;
+
+	if (input_latency_lut == NULL)
+		goto EXIT;
+
+	if ((stats = g_hash_table_lookup(input_latency_lut, device)) == NULL) {
+		stats = g_malloc0(sizeof *stats);
+		g_hash_table_replace(input_latency_lut, g_strdup(device), stats);
+	}
+
+	stats->clock = CLOCK_REALTIME;
+
+#ifdef EVIOCSCLOCKID
+	{
+		int clock = CLOCK_MONOTONIC;
+
+		if (ioctl(fd, EVIOCSCLOCKID, &clock) == 0)
+			stats->clock = CLOCK_MONOTONIC;
+		else
+			errno = 0;
+	}
+#else
+	(void)fd;
+#endif
+
+EXIT:
+	return;
+}
+
+/**
+ * Account processing latency of an input event
+ *
+ * Must be called from an I/O monitor callback
+ *
+ * @param ev The event
+ * @param user_input TRUE if a display change may follow the event
+ */
+static void input_latency_event(const struct input_event *ev,
+				gboolean user_input)
+{
+	gconstpointer iomon = mce_get_current_io_monitor();
+	gpointer key = NULL, val = NULL;
+	input_latency_t *stats;
+	guint64 stamp, now, latency = 0;
+
+	if ((iomon == NULL) || (input_latency_lut == NULL))
+		goto EXIT;
+
+	if (!g_hash_table_lookup_extended(input_latency_lut,
+					  mce_get_io_monitor_name(iomon),
+					  &key, &val))
+		goto EXIT;
+
+	stats = val;
+
+	stamp = (guint64)ev->time.tv_sec * 1000000 + ev->time.tv_usec;
+	now = mce_lib_get_time_us(stats->clock);
+
+	if (now > stamp)
+		latency = now - stamp;
+
+	input_latency_add(&stats->process, key, "process", latency);
+
+	if (user_input == TRUE) {
+		input_latency_pending_name = key;
+		input_latency_pending_stamp =
+			mce_lib_get_time_us(CLOCK_MONOTONIC) - latency;
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Account latency from user input to a display change
+ *
+ * To be called when display state or brightness is written;
+ * only the first change after an input event is accounted
+ */
+void mce_input_latency_output(void)
+{
+	input_latency_t *stats;
+	guint64 latency;
+
+	if ((input_latency_pending_name == NULL) || (input_latency_lut == NULL))
+		goto EXIT;
+
+	latency = (mce_lib_get_time_us(CLOCK_MONOTONIC) -
+		   input_latency_pending_stamp);
+
+	if (latency > INPUT_LATENCY_OUTPUT_WINDOW)
+		goto EXIT;
+
+	stats = g_hash_table_lookup(input_latency_lut,
+				    input_latency_pending_name);
+	if (stats != NULL)
+		input_latency_add(&stats->output, input_latency_pending_name,
+				  "output", latency);
+
+EXIT:
+	input_latency_pending_name = NULL;
+}
+
+/**
+ * Append one latency histogram to a D-Bus message
+ *
+ * @param array Array iterator
+ * @param device The device path
+ * @param what Name of the histogram
+ * @param hist The histogram
+ */
+static void input_latency_append_hist(DBusMessageIter *array,
+				      const gchar *device, const gchar *what,
+				      const input_latency_hist_t *hist)
+{
+	DBusMessageIter item, buckets;
+	dbus_uint32_t count = hist->count;
+	dbus_uint64_t total = hist->total;
+	dbus_uint64_t max = hist->max;
+	dbus_uint32_t bucket;
+	int i;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &device);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &what);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &count);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &total);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &max);
+
+	dbus_message_iter_open_container(&item, DBUS_TYPE_ARRAY,
+					 DBUS_TYPE_UINT32_AS_STRING, &buckets);
+	for (i = 0; i < INPUT_LATENCY_BUCKETS; i++) {
+		bucket = hist->histogram[i];
+		dbus_message_iter_append_basic(&buckets, DBUS_TYPE_UINT32,
+					       &bucket);
+	}
+	dbus_message_iter_close_container(&item, &buckets);
+
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the input latency get method call
+ *
+ * Reply is an array of (device, "process" or "output", samples,
+ * total latency [us], largest latency [us], histogram) structures
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean input_latency_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+	GHashTableIter iter;
+	gpointer key, val;
+
+	mce_log(LL_DEBUG, "Received input latency request");
+
+	if (dbus_message_get_no_reply(msg)) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if ((reply = dbus_new_method_reply(msg)) == NULL)
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if (!dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(ssuttau)", &array)) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_INPUT_LATENCY_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	if (input_latency_lut != NULL) {
+		g_hash_table_iter_init(&iter, input_latency_lut);
+		while (g_hash_table_iter_next(&iter, &key, &val)) {
+			const input_latency_t *stats = val;
+
+			input_latency_append_hist(&array, key, "process",
+						  &stats->process);
+			input_latency_append_hist(&array, key, "output",
+						  &stats->output);
+		}
+	}
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
 /**
  * Enable the specified GPIO key
  * non-existing or already enabled keys are silently ignored
@@ -548,31 +1072,27 @@ cleanup:
 static void enable_gpio_key(guint16 key)
 {
 	gchar *disabled_keys = NULL;
-	gulong *keylist = NULL;
-	gsize keylistlen;
+	mce_bitset_t keylist;
 	gchar *tmp = NULL;
 
-	if (mce_read_string_from_file(GPIO_KEY_DISABLE_PATH,
-				      &disabled_keys) == FALSE)
+	if (mce_read_cached_string_from_file(GPIO_KEY_DISABLE_PATH,
+					     &disabled_keys,
+					     MCE_SYSFS_CACHE_NOTIFY_ONLY) == FALSE)
 		goto EXIT;
 
-	keylistlen = (KEY_CNT / bitsize_of(*keylist)) +
-		     ((KEY_CNT % bitsize_of(*keylist)) ? 1 : 0);
-	keylist = g_malloc0(keylistlen * sizeof (*keylist));
+	mce_bitset_clear_all(&keylist);
 
-	if (string_to_bitfield(disabled_keys, &keylist, keylistlen) == FALSE)
+	if (mce_bitset_from_string(&keylist, disabled_keys) == FALSE)
 		goto EXIT;
 
-	clear_bit(key, &keylist);
+	mce_bitset_clear(&keylist, key);
 
-	if ((tmp = bitfield_to_string(keylist, keylistlen)) == NULL)
-		goto EXIT;
+	tmp = mce_bitset_to_string(&keylist);
 
 	(void)mce_write_string_to_file(GPIO_KEY_DISABLE_PATH, tmp);
 
 EXIT:
 	g_free(disabled_keys);
-	g_free(keylist);
 	g_free(tmp);
 
 	return;
@@ -587,31 +1107,27 @@ EXIT:
 static void disable_gpio_key(guint16 key)
 {
 	gchar *disabled_keys = NULL;
-	gulong *keylist = NULL;
-	gsize keylistlen;
+	mce_bitset_t keylist;
 	gchar *tmp = NULL;
 
-	if (mce_read_string_from_file(GPIO_KEY_DISABLE_PATH,
-				      &disabled_keys) == FALSE)
+	if (mce_read_cached_string_from_file(GPIO_KEY_DISABLE_PATH,
+					     &disabled_keys,
+					     MCE_SYSFS_CACHE_NOTIFY_ONLY) == FALSE)
 		goto EXIT;
 
-	keylistlen = (KEY_CNT / bitsize_of(*keylist)) +
-		     ((KEY_CNT % bitsize_of(*keylist)) ? 1 : 0);
-	keylist = g_malloc0(keylistlen * sizeof (*keylist));
+	mce_bitset_clear_all(&keylist);
 
-	if (string_to_bitfield(disabled_keys, &keylist, keylistlen) == FALSE)
+	if (mce_bitset_from_string(&keylist, disabled_keys) == FALSE)
 		goto EXIT;
 
-	set_bit(key, &keylist);
+	mce_bitset_set(&keylist, key);
 
-	if ((tmp = bitfield_to_string(keylist, keylistlen)) == NULL)
-		goto EXIT;
+	tmp = mce_bitset_to_string(&keylist);
 
 	(void)mce_write_string_to_file(GPIO_KEY_DISABLE_PATH, tmp);
 
 EXIT:
 	g_free(disabled_keys);
-	g_free(keylist);
 	g_free(tmp);
 
 	return;
@@ -720,28 +1236,268 @@ static void setup_touchscreen_io_monitor_timeout(void)
 				      touchscreen_io_monitor_timeout_cb, NULL);
 }
 
+#ifdef EVIOCSMASK
+/** Has EVIOCSMASK been found to be unsupported by the kernel? */
+static gboolean touchscreen_evmask_unsupported = FALSE;
+#endif
+
+/** Are touchscreen events currently filtered on the kernel side? */
+static gboolean touchscreen_evmask_narrow = FALSE;
+
+/**
+ * Program kernel side event mask for a touchscreen device
+ *
+ * While narrowed, only the events that touchscreen_frame_add()
+ * passes on, the multitouch contact reports that panels without
+ * BTN_TOUCH or ABS_PRESSURE rely on, and the power and wakeup keys
+ * that some panels send for wakeup gestures are delivered. The
+ * kernel also drops the then empty SYN_REPORT frames, so single
+ * touch position updates and other noise do not wake up mce.
+ *
+ * If the kernel does not support EVIOCSMASK, all events are
+ * delivered and filtered in touchscreen_frame_add() as before.
+ *
+ * @param fd The touchscreen file descriptor
+ * @param narrow TRUE to deliver only the events mce uses,
+ *               FALSE to deliver all events
+ */
+static void touchscreen_evmask_apply(int fd, gboolean narrow)
+{
+#ifdef EVIOCSMASK
+	static const int type_lut[] = { EV_KEY, EV_REL, EV_ABS, EV_MSC, EV_SW };
+
+	/* Key events delivered while narrowed */
+	static const int key_lut[] = {
+		BTN_TOUCH,
+		KEY_POWER,
+		KEY_WAKEUP,
+		-1
+	};
+
+	/* Absolute axis events delivered while narrowed */
+	static const int abs_lut[] = {
+		ABS_PRESSURE,
+		ABS_MT_SLOT,
+		ABS_MT_TOUCH_MAJOR,
+		ABS_MT_TOUCH_MINOR,
+		ABS_MT_WIDTH_MAJOR,
+		ABS_MT_WIDTH_MINOR,
+		ABS_MT_ORIENTATION,
+		ABS_MT_POSITION_X,
+		ABS_MT_POSITION_Y,
+		ABS_MT_TOOL_TYPE,
+		ABS_MT_BLOB_ID,
+		ABS_MT_TRACKING_ID,
+		ABS_MT_PRESSURE,
+		ABS_MT_DISTANCE,
+		ABS_MT_TOOL_X,
+		ABS_MT_TOOL_Y,
+		-1
+	};
+
+	/* Misc events delivered while narrowed */
+	static const int msc_lut[] = {
+		MSC_GESTURE,
+		-1
+	};
+
+	mce_bitset_t bits;
+	struct input_mask mask;
+	size_t i;
+
+	if ((fd == -1) || (touchscreen_evmask_unsupported == TRUE))
+		goto EXIT;
+
+	for (i = 0; i < G_N_ELEMENTS(type_lut); i++) {
+		const int *codes = NULL;
+
+		memset(bits.word, (narrow == TRUE) ? 0x00 : 0xff,
+		       sizeof bits.word);
+
+		if (narrow == TRUE) {
+			switch (type_lut[i]) {
+			case EV_KEY: codes = key_lut; break;
+			case EV_ABS: codes = abs_lut; break;
+			case EV_MSC: codes = msc_lut; break;
+			default: break;
+			}
+		}
+
+		if (codes != NULL)
+			mce_bitset_set_array(&bits, codes);
+
+		mask.type       = type_lut[i];
+		mask.codes_size = sizeof bits.word;
+		mask.codes_ptr  = (uintptr_t)bits.word;
+
+		if (ioctl(fd, EVIOCSMASK, &mask) == -1) {
+			if ((errno == ENOTTY) || (errno == EINVAL)) {
+				mce_log(LL_NOTICE, "EVIOCSMASK not supported; "
+					"touchscreen events are filtered "
+					"in userspace");
+				touchscreen_evmask_unsupported = TRUE;
+			} else {
+				mce_log(LL_WARN, "ioctl(EVIOCSMASK) failed; %s",
+					g_strerror(errno));
+			}
+			errno = 0;
+			goto EXIT;
+		}
+	}
+
+EXIT:
+	return;
+#else
+	(void)fd;
+	(void)narrow;
+#endif
+}
+
+/**
+ * Wrapper function to call touchscreen_evmask_apply() from g_slist_foreach()
+ *
+ * @param io_monitor The I/O monitor of a touchscreen device
+ * @param user_data Unused
+ */
+static void touchscreen_evmask_apply_cb(gpointer io_monitor, gpointer user_data)
+{
+	(void)user_data;
+
+	touchscreen_evmask_apply(mce_get_io_monitor_fd(io_monitor),
+				 touchscreen_evmask_narrow);
+}
+
+/**
+ * Update kernel side touchscreen event filtering
+ *
+ * While the display is on or dimmed every touchscreen event counts
+ * as user activity and the monitors are throttled by suspending them
+ * instead; otherwise only the events mce consumes are needed
+ *
+ * @param display_state The current display state
+ */
+static void touchscreen_evmask_update(display_state_t display_state)
+{
+	gboolean narrow = ((display_state != MCE_DISPLAY_ON) &&
+			   (display_state != MCE_DISPLAY_DIM));
+
+	if (touchscreen_evmask_narrow == narrow)
+		goto EXIT;
+
+	touchscreen_evmask_narrow = narrow;
+
+	mce_log(LL_DEBUG, "touchscreen event mask: %s",
+		(narrow == TRUE) ? "narrow" : "all events");
+
+	g_slist_foreach(touchscreen_dev_list,
+			(GFunc)touchscreen_evmask_apply_cb, NULL);
+
+EXIT:
+	return;
+}
+
+/**
+ * Touchscreen input frame state
+ *
+ * Events are collected up to the terminating SYN_REPORT and
+ * the policy datapipes are then run once for the whole frame
+ */
+typedef struct {
+	/** Events are being dropped until next SYN_REPORT after SYN_DROPPED */
+	gboolean resync;
+	/** The frame contains events that count as user activity */
+	gboolean activity;
+	/** The frame contains an event to be sent to touchscreen_pipe */
+	gboolean have_event;
+	/** Summary event: double tap gesture, or the latest
+	 *  pressure / touch event of the frame */
+	struct input_event event;
+} touchscreen_frame_t;
+
+/**
+ * Reset touchscreen input frame to empty state
+ *
+ * @param frame The frame to reset
+ */
+static void touchscreen_frame_clear(touchscreen_frame_t *frame)
+{
+	frame->activity = FALSE;
+	frame->have_event = FALSE;
+}
+
+/**
+ * Get touchscreen input frame state for an I/O monitor
+ *
+ * @param iomon The touchscreen I/O monitor
+ * @return The frame state, or NULL if iomon is NULL
+ */
+static touchscreen_frame_t *touchscreen_frame_get(gconstpointer iomon)
+{
+	touchscreen_frame_t *frame = NULL;
+
+	if (iomon == NULL)
+		goto EXIT;
+
+	if ((frame = mce_get_io_monitor_user_data(iomon)) == NULL) {
+		frame = g_malloc0(sizeof *frame);
+		mce_set_io_monitor_user_data(iomon, frame, g_free);
+	}
+
+EXIT:
+	return frame;
+}
+
+/**
+ * Resynchronize touchscreen state after the kernel has dropped events
+ *
+ * The partial frame is discarded; the current touch state is
+ * queried from the device and used as the summary of the next frame
+ *
+ * @param iomon The touchscreen I/O monitor
+ * @param frame The frame state
+ */
+static void touchscreen_frame_resync(gconstpointer iomon,
+				     touchscreen_frame_t *frame)
+{
+	mce_bitset_t keys;
+	int fd = mce_get_io_monitor_fd(iomon);
+
+	frame->resync = FALSE;
+	touchscreen_frame_clear(frame);
+
+	mce_bitset_clear_all(&keys);
+
+	if ((fd == -1) ||
+	    (ioctl(fd, EVIOCGKEY(sizeof keys.word), keys.word) == -1)) {
+		mce_log(LL_WARN, "%s: ioctl(EVIOCGKEY) failed; %s",
+			mce_get_io_monitor_name(iomon), g_strerror(errno));
+		errno = 0;
+		goto EXIT;
+	}
+
+	memset(&frame->event, 0, sizeof frame->event);
+	frame->event.type = EV_KEY;
+	frame->event.code = BTN_TOUCH;
+	frame->event.value = mce_bitset_test(&keys, BTN_TOUCH);
+	frame->have_event = TRUE;
+	frame->activity = TRUE;
+
+	mce_log(LL_DEBUG, "%s: resynced after SYN_DROPPED; touch=%d",
+		mce_get_io_monitor_name(iomon), frame->event.value);
+
+EXIT:
+	return;
+}
+
 /**
- * I/O monitor callback for the touchscreen
+ * Add one touchscreen event to the input frame
  *
- * @param data The new data
- * @param bytes_read The number of bytes read
- * @return FALSE to return remaining chunks (if any),
- *         TRUE to flush all remaining chunks
+ * @param frame The frame state
+ * @param ev The event
  */
-static gboolean touchscreen_iomon_cb(gpointer data, gsize bytes_read)
+static void touchscreen_frame_add(touchscreen_frame_t *frame,
+				  const struct input_event *ev)
 {
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	submode_t submode = mce_get_submode_int32();
-	struct input_event *ev;
-	gboolean flush = FALSE;
-
-	ev = data;
-
-	/* Don't process invalid reads */
-	if (bytes_read != sizeof (*ev)) {
-		goto EXIT;
-	}
-
 	mce_log(LL_DEBUG, "type: %s, code: %s, value: %d",
 		evdev_get_event_type_name(ev->type),
 		evdev_get_event_code_name(ev->type, ev->code),
@@ -754,9 +1510,49 @@ static gboolean touchscreen_iomon_cb(gpointer data, gsize bytes_read)
 		goto EXIT;
 	}
 
-	/* Generate activity */
-	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-			       USE_INDATA, CACHE_INDATA);
+	frame->activity = TRUE;
+
+	/* Only send pressure and gesture events */
+	if (((ev->type != EV_ABS) || (ev->code != ABS_PRESSURE)) &&
+	    ((ev->type != EV_KEY) || (ev->code != BTN_TOUCH)) &&
+	    ((ev->type != EV_MSC) || (ev->code != MSC_GESTURE))) {
+		goto EXIT;
+	}
+
+	/* A double tap gesture takes precedence over anything else */
+	if ((frame->have_event == TRUE) &&
+	    (frame->event.type == EV_MSC) &&
+	    (frame->event.code == MSC_GESTURE) &&
+	    (frame->event.value == 0x4)) {
+		goto EXIT;
+	}
+
+	frame->event = *ev;
+	frame->have_event = TRUE;
+
+EXIT:
+	return;
+}
+
+/**
+ * Handle one complete touchscreen input frame
+ *
+ * @param frame The frame state
+ * @return FALSE to process remaining events (if any),
+ *         TRUE to flush all remaining events
+ */
+static gboolean touchscreen_frame_handle(touchscreen_frame_t *frame)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	submode_t submode = mce_get_submode_int32();
+	gboolean flush = FALSE;
+	struct input_event *ev = &frame->event;
+
+	if (frame->activity == FALSE)
+		goto EXIT;
+
+	/* Generate activity; once per frame is enough */
+	mce_datapipe_generate_activity();
 
 	/* If the display is on/dim and visual tklock is active
 	 * or autorelock isn't active, suspend I/O monitors
@@ -776,12 +1572,8 @@ static gboolean touchscreen_iomon_cb(gpointer data, gsize bytes_read)
 		flush = TRUE;
 	}
 
-	/* Only send pressure and gesture events */
-	if (((ev->type != EV_ABS) || (ev->code != ABS_PRESSURE)) &&
-	    ((ev->type != EV_KEY) || (ev->code != BTN_TOUCH)) &&
-	    ((ev->type != EV_MSC) || (ev->code != MSC_GESTURE))) {
+	if (frame->have_event == FALSE)
 		goto EXIT;
-	}
 
 	/* If we get a double tap gesture, flush the remaining data */
 	if ((ev->type == EV_MSC) &&
@@ -799,6 +1591,69 @@ static gboolean touchscreen_iomon_cb(gpointer data, gsize bytes_read)
 				       USE_INDATA, DONT_CACHE_INDATA);
 	}
 
+EXIT:
+	touchscreen_frame_clear(frame);
+
+	return flush;
+}
+
+/**
+ * I/O monitor callback for the touchscreen
+ *
+ * @param data The events read
+ * @param chunk_size The size of each event
+ * @param chunk_count The number of events read
+ * @return FALSE to return remaining chunks (if any),
+ *         TRUE to flush all remaining chunks
+ */
+static gboolean touchscreen_iomon_cb(gpointer data, gsize chunk_size,
+				     gsize chunk_count)
+{
+	gconstpointer iomon = mce_get_current_io_monitor();
+	touchscreen_frame_t *frame = touchscreen_frame_get(iomon);
+	struct input_event *ev = data;
+	gboolean flush = FALSE;
+	gsize i;
+
+	/* Don't process invalid reads */
+	if ((chunk_size != sizeof (*ev)) || (frame == NULL)) {
+		goto EXIT;
+	}
+
+	for (i = 0; (i < chunk_count) && (flush == FALSE); i++, ev++) {
+		if (ev->type == EV_SYN) {
+			switch (ev->code) {
+			case SYN_DROPPED:
+				mce_log(LL_DEBUG, "%s: SYN_DROPPED",
+					mce_get_io_monitor_name(iomon));
+				frame->resync = TRUE;
+				touchscreen_frame_clear(frame);
+				break;
+
+			case SYN_REPORT:
+				input_latency_event(ev, frame->activity);
+
+				if (frame->resync == TRUE)
+					touchscreen_frame_resync(iomon, frame);
+				else
+					flush = touchscreen_frame_handle(frame);
+				break;
+
+			default:
+				break;
+			}
+			continue;
+		}
+
+		if (frame->resync == FALSE)
+			touchscreen_frame_add(frame, ev);
+	}
+
+	/* Whatever remains in the read buffer is discarded;
+	 * do not let a partial frame carry over */
+	if (flush == TRUE)
+		touchscreen_frame_clear(frame);
+
 EXIT:
 	return flush;
 }
@@ -868,11 +1723,19 @@ static gboolean keypress_iomon_cb(gpointer data, gsize bytes_read)
 		evdev_get_event_code_name(ev->type, ev->code),
 		ev->value);
 
+	/* The kernel dropped events; switch states must be resynced */
+	if ((ev->type == EV_SYN) && (ev->code == SYN_DROPPED)) {
+		schedule_switch_resync();
+		goto EXIT;
+	}
+
 	/* Ignore non-keypress events */
 	if ((ev->type != EV_KEY) && (ev->type != EV_SW)) {
 		goto EXIT;
 	}
 
+	input_latency_event(ev, (ev->value == 0) || (ev->value == 1));
+
 	if (ev->type == EV_KEY) {
 		if ((ev->code == KEY_SCREENLOCK) && (ev->value != 2)) {
 			(void)execute_datapipe(&lockkey_pipe,
@@ -957,9 +1820,7 @@ static gboolean keypress_iomon_cb(gpointer data, gsize bytes_read)
 	 */
 	if ((ev->value == 0) || (ev->value == 1) ||
 	    ((ev->value == 2) && (keypress_repeat_timeout_cb_id == 0))) {
-		(void)execute_datapipe(&device_inactive_pipe,
-				       GINT_TO_POINTER(FALSE),
-				       USE_INDATA, CACHE_INDATA);
+		mce_datapipe_generate_activity();
 
 		if (ev->value == 2) {
 			setup_keypress_repeat_timeout();
@@ -1018,47 +1879,57 @@ static void setup_misc_io_monitor_timeout(void)
 /**
  * I/O monitor callback for misc /dev/input devices
  *
- * @param data Unused
- * @param bytes_read Unused
+ * @param data The events read
+ * @param chunk_size The size of each event
+ * @param chunk_count The number of events read
  * @return Always returns FALSE to return remaining chunks (if any)
  */
-static gboolean misc_iomon_cb(gpointer data, gsize bytes_read)
+static gboolean misc_iomon_cb(gpointer data, gsize chunk_size,
+			      gsize chunk_count)
 {
-	struct input_event *ev;
-
-	ev = data;
+	struct input_event *ev = data;
+	gsize i;
 
 	/* Don't process invalid reads */
-	if (bytes_read != sizeof (*ev)) {
+	if (chunk_size != sizeof (*ev)) {
 		goto EXIT;
 	}
 
-	mce_log(LL_DEBUG, "type: %s, code: %s, value: %d",
-		evdev_get_event_type_name(ev->type),
-		evdev_get_event_code_name(ev->type, ev->code),
-		ev->value);
+	/* Find the first event that counts as activity */
+	for (i = 0; i < chunk_count; i++, ev++) {
+		mce_log(LL_DEBUG, "type: %s, code: %s, value: %d",
+			evdev_get_event_type_name(ev->type),
+			evdev_get_event_code_name(ev->type, ev->code),
+			ev->value);
 
-	/* Ignore synchronisation, force feedback, LED,
-	 * and force feedback status
-	 */
-	switch (ev->type) {
-	case EV_SYN:
-	case EV_LED:
-	case EV_SND:
-	case EV_FF:
-	case EV_FF_STATUS:
-		goto EXIT;
+		/* Ignore synchronisation, force feedback, LED,
+		 * and force feedback status
+		 */
+		switch (ev->type) {
+		case EV_SYN:
+		case EV_LED:
+		case EV_SND:
+		case EV_FF:
+		case EV_FF_STATUS:
+			continue;
+
+		default:
+			break;
+		}
 
-	default:
 		break;
 	}
 
+	if (i == chunk_count)
+		goto EXIT;
+
+	input_latency_event(ev, TRUE);
+
 	/* ev->type for the jack sense is EV_SW */
 	mce_log(LL_DEBUG, "ev->type: %d", ev->type);
 
 	/* Generate activity */
-	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-			       USE_INDATA, CACHE_INDATA);
+	mce_datapipe_generate_activity();
 
 	/* Suspend I/O monitors */
 	if (misc_dev_list != NULL) {
@@ -1073,77 +1944,210 @@ EXIT:
 	return FALSE;
 }
 
+/** Switches whose state is resynced from evdev devices */
+static const struct {
+	/** Switch code */
+	int code;
+	/** Datapipe tracking the switch state */
+	datapipe_struct *pipe;
+} switch_resync_lut[] = {
+	{ SW_CAMERA_LENS_COVER, &lens_cover_pipe },
+	{ SW_KEYPAD_SLIDE,      &keyboard_slide_pipe },
+	{ SW_FRONT_PROXIMITY,   &proximity_sensor_pipe },
+	{ SW_HEADPHONE_INSERT,  &jack_sense_pipe },
+	{ SW_MICROPHONE_INSERT, &jack_sense_pipe },
+	{ SW_LINEOUT_INSERT,    &jack_sense_pipe },
+	{ SW_VIDEOOUT_INSERT,   &jack_sense_pipe },
+};
+
+/** Switch and key capabilities of a keypad / switch device */
+typedef struct {
+	/** Bitmap of supported switches */
+	mce_bitset_t sw;
+	/** Does the device have any of the switches in switch_resync_lut? */
+	gboolean has_switches;
+	/** Does the device have KEY_SCREENLOCK? */
+	gboolean has_lockkey;
+} switch_caps_t;
+
+/** ID for the switch resync idle callback */
+static guint switch_resync_id = 0;
+
 /**
- * Check whether the fd in question supports the switches
- * we want information about -- if so, update their state
+ * Probe and attach switch capabilities to a keypad / switch I/O monitor
+ *
+ * The capabilities do not change, so this is done only once
+ * when the device is registered
+ *
+ * @param iomon The I/O monitor
+ * @param fd The device file descriptor
  */
-static void get_switch_state(gpointer io_monitor, gpointer user_data)
+static void switch_caps_probe(gconstpointer iomon, int fd)
 {
-	/* Get the fd of the I/O monitor */
-	const gchar *filename = mce_get_io_monitor_name(io_monitor);
-	int fd = mce_get_io_monitor_fd(io_monitor);
-	gulong *featurelist = NULL;
-	gulong *statelist = NULL;
-	gsize featurelistlen;
-	gint state;
+	switch_caps_t *caps = g_malloc0(sizeof *caps);
+	mce_bitset_t resync;
+	mce_bitset_t keys;
+	size_t i;
 
-	(void)user_data;
+	if (ioctl(fd, EVIOCGBIT(EV_SW, sizeof caps->sw.word),
+		  caps->sw.word) == -1)
+		mce_bitset_clear_all(&caps->sw);
 
-	featurelistlen = (KEY_CNT / bitsize_of(*featurelist)) +
-			 ((KEY_CNT % bitsize_of(*featurelist)) ? 1 : 0);
-	featurelist = g_malloc0(featurelistlen * sizeof (*featurelist));
-	statelist = g_malloc0(featurelistlen * sizeof (*statelist));
+	mce_bitset_clear_all(&resync);
 
-	if (ioctl(fd, EVIOCGBIT(EV_SW, SW_MAX), featurelist) == -1) {
-		mce_log(LL_ERR,
-			"ioctl(EVIOCGBIT(EV_SW, SW_MAX)) failed on `%s'; %s",
-			filename, g_strerror(errno));
-		errno = 0;
-		goto EXIT;
-	}
+	for (i = 0; i < G_N_ELEMENTS(switch_resync_lut); i++)
+		mce_bitset_set(&resync, switch_resync_lut[i].code);
 
-	if (ioctl(fd, EVIOCGSW(SW_MAX), statelist) == -1) {
-		mce_log(LL_ERR,
-			"ioctl(EVIOCGSW(SW_MAX)) failed on `%s'; %s",
-			filename, g_strerror(errno));
-		errno = 0;
-		goto EXIT;
-	}
+	caps->has_switches = mce_bitset_intersects(&caps->sw, &resync);
+
+	mce_bitset_clear_all(&keys);
+
+	if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof keys.word), keys.word) != -1)
+		caps->has_lockkey = mce_bitset_test(&keys, KEY_SCREENLOCK);
+
+	errno = 0;
+
+	mce_set_io_monitor_user_data(iomon, caps, g_free);
+}
+
+/**
+ * Update switch states
+ *
+ * Every keypad / switch device is queried once for all of its switch
+ * and key states; only datapipes whose state actually changed are run
+ */
+static void update_switch_states(void)
+{
+	gint state[G_N_ELEMENTS(switch_resync_lut)];
+	gboolean lockkey_pressed = FALSE;
+	gint jack = -1;
+	GSList *item;
+	size_t i;
+
+	for (i = 0; i < G_N_ELEMENTS(switch_resync_lut); i++)
+		state[i] = -1;
+
+	for (item = keyboard_dev_list; item != NULL; item = item->next) {
+		const gchar *filename = mce_get_io_monitor_name(item->data);
+		const switch_caps_t *caps =
+			mce_get_io_monitor_user_data(item->data);
+		int fd = mce_get_io_monitor_fd(item->data);
+		mce_bitset_t sw;
+		mce_bitset_t keys;
+
+		if ((caps == NULL) || (fd == -1))
+			continue;
+
+		if (caps->has_switches == TRUE) {
+			mce_bitset_clear_all(&sw);
+
+			if (ioctl(fd, EVIOCGSW(sizeof sw.word), sw.word) == -1) {
+				mce_log(LL_ERR,
+					"ioctl(EVIOCGSW) failed on `%s'; %s",
+					filename, g_strerror(errno));
+				errno = 0;
+			} else {
+				for (i = 0; i < G_N_ELEMENTS(switch_resync_lut); i++) {
+					int code = switch_resync_lut[i].code;
+
+					if (mce_bitset_test(&caps->sw, code) == TRUE)
+						state[i] = mce_bitset_test(&sw, code);
+				}
+			}
+		}
 
-	if (test_bit(SW_CAMERA_LENS_COVER, featurelist) == TRUE) {
-		state = test_bit(SW_CAMERA_LENS_COVER, statelist);
+		if (caps->has_lockkey == TRUE) {
+			mce_bitset_clear_all(&keys);
 
-		(void)execute_datapipe(&lens_cover_pipe, GINT_TO_POINTER(state ? COVER_CLOSED : COVER_OPEN), USE_INDATA, CACHE_INDATA);
+			if (ioctl(fd, EVIOCGKEY(sizeof keys.word), keys.word) == -1) {
+				mce_log(LL_ERR,
+					"ioctl(EVIOCGKEY) failed on `%s'; %s",
+					filename, g_strerror(errno));
+				errno = 0;
+			} else if (mce_bitset_test(&keys, KEY_SCREENLOCK) == TRUE) {
+				lockkey_pressed = TRUE;
+			}
+		}
 	}
 
-	if (test_bit(SW_KEYPAD_SLIDE, featurelist) == TRUE) {
-		state = test_bit(SW_KEYPAD_SLIDE, statelist);
+	for (i = 0; i < G_N_ELEMENTS(switch_resync_lut); i++) {
+		datapipe_struct *pipe = switch_resync_lut[i].pipe;
+		gint cover;
+
+		if (state[i] == -1)
+			continue;
+
+		/* Any inserted jack means the jack is in use */
+		if (pipe == &jack_sense_pipe) {
+			if (jack != COVER_CLOSED)
+				jack = state[i] ? COVER_CLOSED : COVER_OPEN;
+			continue;
+		}
+
+		cover = state[i] ? COVER_CLOSED : COVER_OPEN;
+
+		if (datapipe_get_gint(*pipe) == cover)
+			continue;
 
-		(void)execute_datapipe(&keyboard_slide_pipe, GINT_TO_POINTER(state ? COVER_CLOSED : COVER_OPEN), USE_INDATA, CACHE_INDATA);
+		mce_log(LL_DEBUG, "%s: resynced to %s",
+			datapipe_get_name(*pipe),
+			(cover == COVER_CLOSED) ? "closed" : "open");
+		(void)execute_datapipe(pipe, GINT_TO_POINTER(cover),
+				       USE_INDATA, CACHE_INDATA);
 	}
 
-	if (test_bit(SW_FRONT_PROXIMITY, featurelist) == TRUE) {
-		state = test_bit(SW_FRONT_PROXIMITY, statelist);
+	if ((jack != -1) && (datapipe_get_gint(jack_sense_pipe) != jack)) {
+		(void)execute_datapipe(&jack_sense_pipe, GINT_TO_POINTER(jack),
+				       USE_INDATA, CACHE_INDATA);
+	}
 
-		(void)execute_datapipe(&proximity_sensor_pipe, GINT_TO_POINTER(state ? COVER_CLOSED : COVER_OPEN), USE_INDATA, CACHE_INDATA);
+	/* A missed lock key release is delivered; a missed press is not,
+	 * since acting on a stale press would toggle the lock
+	 */
+	if ((lockkey_pressed == FALSE) &&
+	    (datapipe_get_gint(lockkey_pipe) == 1)) {
+		(void)execute_datapipe(&lockkey_pipe, GINT_TO_POINTER(0),
+				       USE_INDATA, CACHE_INDATA);
 	}
+}
 
-EXIT:
-	g_free(statelist);
-	g_free(featurelist);
+/**
+ * Idle callback for resyncing switch states
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the idle callback
+ */
+static gboolean switch_resync_cb(gpointer data)
+{
+	(void)data;
 
-	return;
+	switch_resync_id = 0;
+
+	update_switch_states();
+
+	return FALSE;
 }
 
 /**
- * Update switch states
+ * Schedule switch states to be resynced
+ *
+ * Multiple requests made before the main loop gets to
+ * run the resync are handled with a single pass
  */
-static void update_switch_states(void)
+static void schedule_switch_resync(void)
 {
+	if (switch_resync_id == 0)
+		switch_resync_id = g_idle_add(switch_resync_cb, NULL);
+}
 
-	if (keyboard_dev_list != NULL) {
-		g_slist_foreach(keyboard_dev_list,
-				(GFunc)get_switch_state, NULL);
+/**
+ * Cancel pending switch state resync
+ */
+static void cancel_switch_resync(void)
+{
+	if (switch_resync_id != 0) {
+		g_source_remove(switch_resync_id);
+		switch_resync_id = 0;
 	}
 }
 
@@ -1207,9 +2211,10 @@ static void match_and_register_io_monitor(const gchar *filename)
 			filename);
 		goto EXIT;
 	}
+	name[sizeof name - 1] = 0;
 
 	/* Probe how mce could use the evdev node */
-	type = get_evdev_type(fd);
+	type = get_evdev_type_cached(fd, name);
 	mce_log(LL_NOTICE, "%s: \"%s\", probe: %s", filename, name, evdev_class[type]);
 
 	/* Check if the device is blacklisted by name in the config files */
@@ -1229,25 +2234,29 @@ static void match_and_register_io_monitor(const gchar *filename)
 		break;
 
 	case EVDEV_TOUCH:
-		iomon = mce_register_io_monitor_chunk(fd, filename, MCE_IO_ERROR_POLICY_WARN,
-						      G_IO_IN | G_IO_ERR, FALSE, touchscreen_iomon_cb,
-						      sizeof (struct input_event));
-		if( iomon )
+		iomon = mce_register_io_monitor_chunk_batch(fd, filename, MCE_IO_ERROR_POLICY_WARN,
+							    G_IO_IN | G_IO_ERR, FALSE, touchscreen_iomon_cb,
+							    sizeof (struct input_event));
+		if( iomon ) {
+			touchscreen_evmask_apply(fd, touchscreen_evmask_narrow);
 			touchscreen_dev_list = g_slist_prepend(touchscreen_dev_list, (gpointer)iomon);
+		}
 		break;
 
 	case EVDEV_INPUT:
 		iomon = mce_register_io_monitor_chunk(fd, filename, MCE_IO_ERROR_POLICY_WARN,
 						      G_IO_IN | G_IO_ERR, FALSE, keypress_iomon_cb,
 						      sizeof (struct input_event));
-		if( iomon )
+		if( iomon ) {
+			switch_caps_probe(iomon, fd);
 			keyboard_dev_list = g_slist_prepend(keyboard_dev_list, (gpointer)iomon);
+		}
 		break;
 
 	case EVDEV_ACTIVITY:
-		iomon = mce_register_io_monitor_chunk(fd, filename, MCE_IO_ERROR_POLICY_WARN,
-						      G_IO_IN | G_IO_ERR, FALSE, misc_iomon_cb,
-						      sizeof (struct input_event));
+		iomon = mce_register_io_monitor_chunk_batch(fd, filename, MCE_IO_ERROR_POLICY_WARN,
+							    G_IO_IN | G_IO_ERR, FALSE, misc_iomon_cb,
+							    sizeof (struct input_event));
 		if( iomon ) {
 			mce_set_io_monitor_err_cb(iomon, misc_err_cb);
 			misc_dev_list = g_slist_prepend(misc_dev_list, (gpointer)iomon);
@@ -1255,6 +2264,9 @@ static void match_and_register_io_monitor(const gchar *filename)
 		break;
 	}
 
+	if( iomon )
+		input_latency_register(fd, filename);
+
 EXIT:
 	/* Close unmonitored file descriptors */
 	if( !iomon && fd != -1 ) {
@@ -1291,7 +2303,7 @@ static void update_inputdevices(const gchar *device, gboolean add)
 		iomon_id = list_entry->data;
 		touchscreen_dev_list = g_slist_remove(touchscreen_dev_list,
 						      iomon_id);
-		mce_unregister_io_monitor(iomon_id);
+		unregister_io_monitor((gpointer)iomon_id, NULL);
 	}
 
 	/* Try to find a matching keyboard I/O monitor */
@@ -1305,7 +2317,7 @@ static void update_inputdevices(const gchar *device, gboolean add)
 		iomon_id = list_entry->data;
 		keyboard_dev_list = g_slist_remove(keyboard_dev_list,
 						   iomon_id);
-		mce_unregister_io_monitor(iomon_id);
+		unregister_io_monitor((gpointer)iomon_id, NULL);
 	}
 
 	/* Try to find a matching touchscreen I/O monitor */
@@ -1319,11 +2331,14 @@ static void update_inputdevices(const gchar *device, gboolean add)
 		iomon_id = list_entry->data;
 		misc_dev_list = g_slist_remove(misc_dev_list,
 					       iomon_id);
-		mce_unregister_io_monitor(iomon_id);
+		unregister_io_monitor((gpointer)iomon_id, NULL);
 	}
 
-	if (add == TRUE)
+	if (add == TRUE) {
 		match_and_register_io_monitor(device);
+		evdev_type_cache_save();
+		schedule_switch_resync();
+	}
 }
 
 /**
@@ -1364,6 +2379,8 @@ static gboolean scan_inputdevices(void)
 		g_free(filename);
 	}
 
+	evdev_type_cache_save();
+
 	if ((direntry == NULL) && (errno != 0)) {
 		mce_log(LL_ERR,
 			"readdir() failed; %s",
@@ -1413,49 +2430,74 @@ static void unregister_inputdevices(void)
 }
 
 /**
- * Callback for directory changes
+ * Timeout function for applying /dev/input changes
  *
- * @param monitor Unused
- * @param file The file that changed
- * @param other_file Unused
- * @param event_type The event that occured
- * @param user_data Unused
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
  */
-static void dir_changed_cb(GFileMonitor *monitor,
-			   GFile *file, GFile *other_file,
-			   GFileMonitorEvent event_type, gpointer user_data)
+static gboolean dev_input_update_cb(gpointer data)
 {
-	char *filename = g_file_get_basename(file);
-	char *filepath = g_file_get_path(file);
+	GHashTableIter iter;
+	gpointer key, val;
 
-	(void)monitor;
-	(void)other_file;
-	(void)user_data;
+	(void)data;
 
-	if ((filename == NULL) || (filepath == NULL))
-		goto EXIT;
+	dev_input_update_cb_id = 0;
 
-	if (strncmp(filename,
-		    EVENT_FILE_PREFIX, strlen(EVENT_FILE_PREFIX)) != 0)
+	if (dev_input_rescan == TRUE) {
+		mce_log(LL_NOTICE, "rescanning `%s'", DEV_INPUT_PATH);
+		dev_input_rescan = FALSE;
+		g_hash_table_remove_all(dev_input_changes);
+		unregister_inputdevices();
+		(void)scan_inputdevices();
+		update_switch_states();
 		goto EXIT;
+	}
 
-	switch (event_type) {
-	case G_FILE_MONITOR_EVENT_CREATED:
-		update_inputdevices(filepath, TRUE);
-		break;
+	g_hash_table_iter_init(&iter, dev_input_changes);
+	while (g_hash_table_iter_next(&iter, &key, &val))
+		update_inputdevices(key, GPOINTER_TO_INT(val));
 
-	case G_FILE_MONITOR_EVENT_DELETED:
-		update_inputdevices(filepath, FALSE);
-		break;
+	g_hash_table_remove_all(dev_input_changes);
 
-	default:
-		break;
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Callback for directory changes
+ *
+ * Changes are collected and applied after a short delay, so that
+ * a burst of events for one device node is handled only once
+ *
+ * @param path The directory that changed
+ * @param file The entry that changed, or NULL if a rescan is needed
+ * @param exists TRUE if the entry was added, FALSE if it was removed
+ * @param user_data Unused
+ */
+static void dir_changed_cb(const char *path, const char *file,
+			   gboolean exists, gpointer user_data)
+{
+	(void)user_data;
+
+	if (file == NULL) {
+		dev_input_rescan = TRUE;
+	} else if (strncmp(file, EVENT_FILE_PREFIX,
+			   strlen(EVENT_FILE_PREFIX)) == 0) {
+		g_hash_table_replace(dev_input_changes,
+				     g_strconcat(path, "/", file, NULL),
+				     GINT_TO_POINTER(exists));
+	} else {
+		goto EXIT;
 	}
 
-EXIT:
-	g_free(filepath);
-	g_free(filename);
+	if (dev_input_update_cb_id == 0) {
+		dev_input_update_cb_id =
+			g_timeout_add(DEV_INPUT_SETTLE_DELAY,
+				      dev_input_update_cb, NULL);
+	}
 
+EXIT:
 	return;
 }
 
@@ -1466,25 +2508,46 @@ EXIT:
  */
 static void submode_trigger(gconstpointer data)
 {
-	static submode_t old_submode = MCE_NORMAL_SUBMODE;
 	submode_t submode = GPOINTER_TO_INT(data);
 
+	if (((mce_get_submode_changes() & MCE_TKLOCK_SUBMODE) == 0) ||
+	    (gpio_key_disable_exists == FALSE))
+		goto EXIT;
+
 	/* If the tklock is enabled, disable the camera focus interrupts,
 	 * since we don't use them anyway
 	 */
-	if ((submode & MCE_TKLOCK_SUBMODE) != 0) {
-		if ((old_submode & MCE_TKLOCK_SUBMODE) == 0) {
-			if (gpio_key_disable_exists == TRUE)
-				disable_gpio_key(KEY_CAMERA_FOCUS);
-		}
-	} else {
-		if ((old_submode & MCE_TKLOCK_SUBMODE) != 0) {
-			if (gpio_key_disable_exists == TRUE)
-				enable_gpio_key(KEY_CAMERA_FOCUS);
-		}
-	}
+	if ((submode & MCE_TKLOCK_SUBMODE) != 0)
+		disable_gpio_key(KEY_CAMERA_FOCUS);
+	else
+		enable_gpio_key(KEY_CAMERA_FOCUS);
+
+EXIT:
+	return;
+}
+
+/**
+ * Datapipe trigger for display state
+ *
+ * @param data The display state stored in a pointer
+ */
+static void display_state_trigger(gconstpointer data)
+{
+	static display_state_t old_display_state = MCE_DISPLAY_UNDEF;
+	display_state_t display_state = GPOINTER_TO_INT(data);
+
+	touchscreen_evmask_update(display_state);
+
+	/* Switch events may have been missed while the device was
+	 * suspended; resync when the display is powered up again
+	 */
+	if (((display_state == MCE_DISPLAY_ON) ||
+	     (display_state == MCE_DISPLAY_DIM)) &&
+	    ((old_display_state != MCE_DISPLAY_ON) &&
+	     (old_display_state != MCE_DISPLAY_DIM)))
+		schedule_switch_resync();
 
-	old_submode = submode;
+	old_display_state = display_state;
 }
 
 /**
@@ -1494,42 +2557,54 @@ static void submode_trigger(gconstpointer data)
  */
 gboolean mce_input_init(void)
 {
-	GError *error = NULL;
 	gboolean status = FALSE;
 
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&submode_pipe,
 					  submode_trigger);
-
-	/* Retrieve a GFile pointer to the directory to monitor */
-	dev_input_gfp = g_file_new_for_path(DEV_INPUT_PATH);
-
-	/* Monitor the directory */
-	if ((dev_input_gfmp = g_file_monitor_directory(dev_input_gfp,
-						       G_FILE_MONITOR_NONE,
-						       NULL, &error)) == NULL) {
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  display_state_trigger);
+
+	dev_input_changes = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, NULL);
+	input_latency_lut = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, g_free);
+	input_latency_threshold =
+		mce_conf_get_int(MCE_CONF_INPUT_LATENCY_GROUP,
+				 MCE_CONF_INPUT_LATENCY_THRESHOLD,
+				 DEFAULT_INPUT_LATENCY_THRESHOLD);
+
+	/* Monitor the directory before the initial scan, so that
+	 * devices that (dis)appear during the scan are not missed
+	 */
+	if ((dev_input_watcher = filewatcher_create_dir(DEV_INPUT_PATH,
+							dir_changed_cb,
+							NULL, NULL)) == NULL) {
 		mce_log(LL_ERR,
-			"Failed to add monitor for directory `%s'; %s",
-			DEV_INPUT_PATH, error->message);
+			"Failed to add monitor for directory `%s'",
+			DEV_INPUT_PATH);
 		goto EXIT;
 	}
 
-	/* XXX: There is a race condition here; if a file (dis)appears
-	 *      after this scan, but before we start monitoring,
-	 *      then we'll miss that device.  The race is miniscule though,
-	 *      and any workarounds are likely to be cumbersome
-	 */
+	evdev_type_cache_load();
+	touchscreen_evmask_update(datapipe_get_gint(display_state_pipe));
+
 	/* Find the initial set of input devices */
 	if ((status = scan_inputdevices()) == FALSE) {
-		g_file_monitor_cancel(dev_input_gfmp);
-		dev_input_gfmp = NULL;
+		filewatcher_delete(dev_input_watcher);
+		dev_input_watcher = NULL;
 		goto EXIT;
 	}
 
-	/* Connect "changed" signal for the directory monitor */
-	dev_input_handler_id =
-		g_signal_connect(G_OBJECT(dev_input_gfmp), "changed",
-				 G_CALLBACK(dir_changed_cb), NULL);
+	/* get_input_latency */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_INPUT_LATENCY_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 input_latency_get_dbus_cb) == NULL) {
+		status = FALSE;
+		goto EXIT;
+	}
 
 	/* Get configuration options */
 	longdelay = mce_conf_get_int(MCE_CONF_HOMEKEY_GROUP,
@@ -1542,7 +2617,6 @@ gboolean mce_input_init(void)
 
 EXIT:
 	errno = 0;
-	g_clear_error(&error);
 
 	return status;
 }
@@ -1555,17 +2629,35 @@ void mce_input_exit(void)
 	/* Remove triggers/filters from datapipes */
 	remove_output_trigger_from_datapipe(&submode_pipe,
 					    submode_trigger);
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    display_state_trigger);
+
+	filewatcher_delete(dev_input_watcher);
+	dev_input_watcher = NULL;
+
+	if (dev_input_update_cb_id != 0) {
+		g_source_remove(dev_input_update_cb_id);
+		dev_input_update_cb_id = 0;
+	}
 
-	if (dev_input_gfmp != NULL) {
-		g_signal_handler_disconnect(G_OBJECT(dev_input_gfmp),
-					    dev_input_handler_id);
-		dev_input_handler_id = 0;
-		g_file_monitor_cancel(dev_input_gfmp);
+	if (dev_input_changes != NULL) {
+		g_hash_table_unref(dev_input_changes);
+		dev_input_changes = NULL;
+	}
+
+	input_latency_pending_name = NULL;
+
+	if (input_latency_lut != NULL) {
+		g_hash_table_unref(input_latency_lut);
+		input_latency_lut = NULL;
 	}
 
 	unregister_inputdevices();
 
+	evdev_type_cache_quit();
+
 	/* Remove all timer sources */
+	cancel_switch_resync();
 	cancel_touchscreen_io_monitor_timeout();
 	cancel_keypress_repeat_timeout();
 	cancel_misc_io_monitor_timeout();
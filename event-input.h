@@ -38,6 +38,9 @@
  */
 #define MONITORING_DELAY		1
 
+/** Delay for merging /dev/input changes, in milliseconds */
+#define DEV_INPUT_SETTLE_DELAY		50
+
 /** Name of Homekey configuration group */
 #define MCE_CONF_HOMEKEY_GROUP		"HomeKey"
 
@@ -53,8 +56,19 @@
 /** Long delay for the [home] button in milliseconds */
 #define DEFAULT_HOME_LONG_DELAY		800		/* 0.8 seconds */
 
+/** Name of input latency configuration group */
+#define MCE_CONF_INPUT_LATENCY_GROUP	"InputLatency"
+
+/** Name of configuration key for the latency logging threshold */
+#define MCE_CONF_INPUT_LATENCY_THRESHOLD	"LogThreshold"
+
+/** Default latency logging threshold in milliseconds; 0 = disabled */
+#define DEFAULT_INPUT_LATENCY_THRESHOLD	0
+
 /* When MCE is made modular, this will be handled differently */
 gboolean mce_input_init(void);
 void mce_input_exit(void);
 
+void mce_input_latency_output(void);
+
 #endif /* _EVENT_INPUT_H_ */
@@ -28,7 +28,7 @@
 #include "mce.h"
 #include "event-switches.h"
 
-#include "mce-io.h"			/* mce_read_string_from_file(),
+#include "mce-io.h"			/* mce_read_cached_string_from_file(),
 					 * mce_write_string_to_file(),
 					 * mce_register_io_monitor_string(),
 					 * mce_unregister_io_monitor()
@@ -99,8 +99,7 @@ static gboolean generic_activity_iomon_cb(gpointer data, gsize bytes_read)
 	(void)bytes_read;
 
 	/* Generate activity */
-	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-			       USE_INDATA, CACHE_INDATA);
+	mce_datapipe_generate_activity();
 
 	return FALSE;
 }
@@ -327,8 +326,9 @@ static gboolean update_proximity_sensor_state(void)
 	gboolean status = FALSE;
 	gchar *tmp = NULL;
 
-	if (mce_read_string_from_file(MCE_PROXIMITY_SENSOR_STATE_PATH,
-				      &tmp) == FALSE) {
+	/* The sensor was just enabled; always read, but keep the fd */
+	if (mce_read_cached_string_from_file(MCE_PROXIMITY_SENSOR_STATE_PATH,
+					     &tmp, 0) == FALSE) {
 		goto EXIT;
 	}
 
@@ -6,6 +6,7 @@
 
 #include "filewatcher.h"
 #include "mce-log.h"
+#include "mce-wakeup.h"
 
 #include <sys/inotify.h>
 
@@ -127,15 +128,9 @@ inotify_event_debug(const struct inotify_event *eve)
 /** Object for tracking file content in a directory */
 struct filewatcher_t
 {
-  /** inotify file descriptor */
-  int inotify_fd;
-
-  /** inotify watch descriptor */
+  /** inotify watch descriptor in the shared inotify instance */
   int inotify_wd;
 
-  /** glib input watch for inotify_fd */
-  guint watch_id;
-
   /** the directory to watch over */
   char *watch_path;
 
@@ -145,13 +140,168 @@ struct filewatcher_t
   /** function to call when watch_path/watch_file changes */
   filewatcher_changed_fn changed_cb;
 
-  /** user data to pass to changed_cb */
+  /** function to call for each entry added to / removed from
+   *  watch_path; used instead of changed_cb when watch_file is NULL */
+  filewatcher_entry_fn entry_cb;
+
+  /** user data to pass to changed_cb / entry_cb */
   gpointer user_data;
 
   /** how to delete user_data when filewatcher_t is deleted */
   GDestroyNotify delete_cb;
 };
 
+/* ------------------------------------------------------------------------- *
+ * Shared inotify instance
+ * ------------------------------------------------------------------------- */
+
+/** inotify file descriptor shared by all filewatcher_t objects */
+static int filewatcher_inotify_fd = -1;
+
+/** glib input watch for filewatcher_inotify_fd */
+static guint filewatcher_inotify_id = 0;
+
+/** Wakeup accounting for filewatcher_inotify_id */
+static mce_wakeup_owner_t *filewatcher_wakeup_owner = 0;
+
+/** Lookup table: inotify watch descriptor -> GSList of filewatcher_t
+ *
+ * The kernel hands out the same watch descriptor for every
+ * inotify_add_watch() made on the same directory, so watchers
+ * for different files in one directory share a single watch.
+ */
+static GHashTable *filewatcher_inotify_lut = 0;
+
+/** File watchers whose changed_cb is due after the current read */
+static GSList *filewatcher_pending = 0;
+
+/** Get the file watchers attached to an inotify watch descriptor
+ *
+ * @param wd inotify watch descriptor
+ *
+ * @return list of filewatcher_t objects, or NULL if there are none
+ */
+static
+GSList *
+filewatcher_lookup(int wd)
+{
+  if( !filewatcher_inotify_lut )
+  {
+    return 0;
+  }
+  return g_hash_table_lookup(filewatcher_inotify_lut, GINT_TO_POINTER(wd));
+}
+
+/** Drop the shared inotify instance if no file watchers use it
+ */
+static
+void
+filewatcher_inotify_release(void)
+{
+  if( filewatcher_inotify_lut && g_hash_table_size(filewatcher_inotify_lut) )
+  {
+    goto cleanup;
+  }
+
+  if( filewatcher_inotify_lut )
+  {
+    g_hash_table_unref(filewatcher_inotify_lut), filewatcher_inotify_lut = 0;
+  }
+
+  if( filewatcher_inotify_id )
+  {
+    g_source_remove(filewatcher_inotify_id), filewatcher_inotify_id = 0;
+  }
+
+  if( filewatcher_inotify_fd != -1 )
+  {
+    if( close(filewatcher_inotify_fd) == -1 )
+    {
+      mce_log(LL_WARN, "close inotify fd: %m");
+    }
+    filewatcher_inotify_fd = -1;
+  }
+
+cleanup:
+  return;
+}
+
+/** Stop delivering inotify events to a file watcher
+ *
+ * The inotify watch itself is removed only when the
+ * last file watcher using it is detached.
+ *
+ * @param self pointer to filewatcher_t object
+ */
+static
+void
+filewatcher_detach(filewatcher_t *self)
+{
+  gpointer key = GINT_TO_POINTER(self->inotify_wd);
+  GSList  *list;
+
+  filewatcher_pending = g_slist_remove(filewatcher_pending, self);
+
+  if( self->inotify_wd == -1 || !filewatcher_inotify_lut )
+  {
+    goto cleanup;
+  }
+
+  list = g_slist_remove(filewatcher_lookup(self->inotify_wd), self);
+
+  if( list )
+  {
+    g_hash_table_insert(filewatcher_inotify_lut, key, list);
+  }
+  else
+  {
+    g_hash_table_remove(filewatcher_inotify_lut, key);
+
+    if( inotify_rm_watch(filewatcher_inotify_fd, self->inotify_wd) == -1 )
+    {
+      mce_log(LL_WARN, "inotify_rm_watch: %m");
+    }
+  }
+
+cleanup:
+
+  self->inotify_wd = -1;
+
+  filewatcher_inotify_release();
+}
+
+/** Forget an inotify watch the kernel has already removed
+ *
+ * @param wd inotify watch descriptor
+ */
+static
+void
+filewatcher_forget(int wd)
+{
+  GSList *list = filewatcher_lookup(wd);
+
+  if( !list )
+  {
+    /* removed by us, or not known at all */
+    goto cleanup;
+  }
+
+  mce_log(LL_ERR, "%s: inotify watch went defunct",
+          ((filewatcher_t *)list->data)->watch_path);
+
+  for( GSList *item = list; item; item = item->next )
+  {
+    filewatcher_t *self = item->data;
+    self->inotify_wd = -1;
+  }
+
+  g_hash_table_remove(filewatcher_inotify_lut, GINT_TO_POINTER(wd));
+  g_slist_free(list);
+
+cleanup:
+  return;
+}
+
 /* Initialize filewatcher_t object to a sane state
  *
  * @param self pointer to uninitialized filewatcher_t object
@@ -160,14 +310,12 @@ static
 void
 filewatcher_ctor(filewatcher_t *self)
 {
-  self->inotify_fd = -1;
   self->inotify_wd = -1;
   self->watch_path = 0;
   self->watch_file = 0;
 
-  self->watch_id   = 0;
-
   self->changed_cb = 0;
+  self->entry_cb   = 0;
 
   self->delete_cb  = 0;
   self->user_data  = 0;
@@ -188,72 +336,264 @@ filewatcher_dtor(filewatcher_t *self)
   }
   self->user_data = 0;
 
-  /* detach glib io watch */
-  if( self->watch_id )
+  /* detach from the shared inotify instance */
+  filewatcher_detach(self);
+
+  /* release strings */
+  g_free(self->watch_path), self->watch_path = 0;
+  g_free(self->watch_file), self->watch_file = 0;
+}
+
+/* Delete a filewatcher_t object
+ *
+ * @param self pointer to initialized filewatcher_t object, or NULL
+ */
+void
+filewatcher_delete(filewatcher_t *self)
+{
+  if( self != 0 )
   {
-    g_source_remove(self->watch_id), self->watch_id = 0;
+    filewatcher_dtor(self);
+    g_free(self);
   }
+}
+
+/** Report one inotify event to directory entry watcher
+ *
+ * Overflow of the inotify event queue is reported with NULL
+ * file name, after which the directory content must be rescanned
+ *
+ * @param self pointer to filewatcher_t object
+ * @param eve  inotify event
+ */
+static
+void
+filewatcher_process_entry(filewatcher_t *self,
+                          const struct inotify_event *eve)
+{
+  if( eve->mask & IN_Q_OVERFLOW )
+  {
+    mce_log(LL_WARN, "%s: inotify event queue overflow", self->watch_path);
+    self->entry_cb(self->watch_path, 0, FALSE, self->user_data);
+  }
+  else if( !eve->len )
+  {
+    /* events about the directory itself are not reported */
+  }
+  else if( eve->mask & (IN_CREATE | IN_MOVED_TO) )
+  {
+    self->entry_cb(self->watch_path, eve->name, TRUE, self->user_data);
+  }
+  else if( eve->mask & (IN_DELETE | IN_MOVED_FROM) )
+  {
+    self->entry_cb(self->watch_path, eve->name, FALSE, self->user_data);
+  }
+}
+
+/** Queue changed_cb of a file watcher to be called after the current read
+ *
+ * Any number of events about the tracked file within one read
+ * result in a single changed_cb call.
+ *
+ * @param self pointer to filewatcher_t object
+ */
+static
+void
+filewatcher_schedule(filewatcher_t *self)
+{
+  if( !g_slist_find(filewatcher_pending, self) )
+  {
+    filewatcher_pending = g_slist_append(filewatcher_pending, self);
+  }
+}
+
+/** Call changed_cb of all file watchers queued during the current read
+ */
+static
+void
+filewatcher_flush_pending(void)
+{
+  while( filewatcher_pending )
+  {
+    filewatcher_t *self = filewatcher_pending->data;
+
+    /* unlink first; the callback is allowed to delete self */
+    filewatcher_pending = g_slist_delete_link(filewatcher_pending,
+                                              filewatcher_pending);
+
+    self->changed_cb(self->watch_path, self->watch_file, self->user_data);
+  }
+}
+
+/** Check if a directory entry event repeats the previous one
+ *
+ * Directory entry events are tracked per path within one read,
+ * so that for example IN_CREATE followed by IN_MOVED_TO of the
+ * same entry is reported to entry watchers only once.
+ *
+ * @param eve  inotify event
+ * @param seen pointer to per read entry state table, created on demand
+ *
+ * @return TRUE if the event can be left unreported, FALSE otherwise
+ */
+static
+gboolean
+filewatcher_is_repeated(const struct inotify_event *eve, GHashTable **seen)
+{
+  gboolean repeated = FALSE;
+  gpointer state    = 0;
+  char    *key      = 0;
+
+  if( !eve->len )
+  {
+    goto cleanup;
+  }
+
+  if( eve->mask & (IN_CREATE | IN_MOVED_TO) )
+  {
+    state = GINT_TO_POINTER(TRUE + 1);
+  }
+  else if( eve->mask & (IN_DELETE | IN_MOVED_FROM) )
+  {
+    state = GINT_TO_POINTER(FALSE + 1);
+  }
+  else
+  {
+    goto cleanup;
+  }
+
+  if( !*seen )
+  {
+    *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, 0);
+  }
+
+  key = g_strdup_printf("%d/%s", eve->wd, eve->name);
+
+  if( g_hash_table_lookup(*seen, key) == state )
+  {
+    repeated = TRUE;
+  }
+  else
+  {
+    g_hash_table_replace(*seen, key, state), key = 0;
+  }
+
+cleanup:
+
+  g_free(key);
+
+  return repeated;
+}
+
+/** Deliver one inotify event to file watchers using a watch descriptor
+ *
+ * @param wd       inotify watch descriptor
+ * @param eve      inotify event
+ * @param repeated TRUE if the event is not to be reported to entry watchers
+ */
+static
+void
+filewatcher_dispatch(int wd, const struct inotify_event *eve,
+                     gboolean repeated)
+{
+  /* callbacks can delete watchers, iterate over a copy */
+  GSList *todo = g_slist_copy(filewatcher_lookup(wd));
 
-  /* detach inotify fd */
-  if( self->inotify_fd != -1 )
+  for( GSList *item = todo; item; item = item->next )
   {
-    if( self->inotify_wd != -1 )
+    filewatcher_t *self = item->data;
+
+    if( !g_slist_find(filewatcher_lookup(wd), self) )
+    {
+      /* deleted by an earlier callback */
+      continue;
+    }
+
+    if( self->entry_cb )
     {
-      if( inotify_rm_watch(self->inotify_fd, self->inotify_wd) == -1 )
+      if( !repeated )
       {
-        mce_log(LL_WARN, "inotify_rm_watch: %m");
+        filewatcher_process_entry(self, eve);
       }
-      self->inotify_wd = -1;
     }
-    if( close(self->inotify_fd) == -1 )
+    else if( eve->mask & (IN_Q_OVERFLOW | IN_IGNORED) )
     {
-      mce_log(LL_WARN, "close inotify fd: %m");
+      filewatcher_schedule(self);
+    }
+    else if( eve->len && !strcmp(self->watch_file, eve->name) )
+    {
+      filewatcher_schedule(self);
     }
-    self->inotify_fd = -1;
   }
 
-  /* release strings */
-  g_free(self->watch_path), self->watch_path = 0;
-  g_free(self->watch_file), self->watch_file = 0;
+  g_slist_free(todo);
 }
 
-/* Delete a filewatcher_t object
+/** Route one inotify event to file watchers
  *
- * @param self pointer to initialized filewatcher_t object, or NULL
+ * @param eve  inotify event
+ * @param seen pointer to per read entry state table, created on demand
  */
+static
 void
-filewatcher_delete(filewatcher_t *self)
+filewatcher_process_event(const struct inotify_event *eve, GHashTable **seen)
 {
-  if( self != 0 )
+  if( eve->mask & IN_Q_OVERFLOW )
   {
-    filewatcher_dtor(self);
-    g_free(self);
+    /* the event is not tied to any watch; everybody must re-evaluate */
+    GList *wds = 0;
+
+    if( *seen )
+    {
+      g_hash_table_remove_all(*seen);
+    }
+
+    if( filewatcher_inotify_lut )
+    {
+      wds = g_hash_table_get_keys(filewatcher_inotify_lut);
+    }
+
+    for( GList *item = wds; item; item = item->next )
+    {
+      filewatcher_dispatch(GPOINTER_TO_INT(item->data), eve, FALSE);
+    }
+
+    g_list_free(wds);
+  }
+  else
+  {
+    filewatcher_dispatch(eve->wd, eve, filewatcher_is_repeated(eve, seen));
+
+    if( eve->mask & IN_IGNORED )
+    {
+      filewatcher_forget(eve->wd);
+    }
   }
 }
 
 /** Process inotify events
  *
- * @param self pointer to filewatcher_t object
+ * @param fd inotify file descriptor to read from
  *
  * @return TRUE on success, or FALSE if further processing is not possible
  */
 static
 gboolean
-filewatcher_process_events(filewatcher_t *self)
+filewatcher_process_events(int fd)
 {
-  gboolean res = FALSE;
-  gboolean flg = FALSE;
+  gboolean    res  = FALSE;
+  GHashTable *seen = 0;
 
   char buf[2048];
   int todo, size;
   struct inotify_event *eve;
 
-  if( !self || self->inotify_fd == -1 )
+  if( fd == -1 )
   {
     goto cleanup;
   }
 
-  todo = read(self->inotify_fd, buf, sizeof buf);
+  todo = read(fd, buf, sizeof buf);
 
   if( todo < 0 )
   {
@@ -301,28 +641,20 @@ filewatcher_process_events(filewatcher_t *self)
     inotify_event_debug(eve);
 #endif
 
-    if( eve->len && !strcmp(self->watch_file, eve->name) )
-    {
-      flg = TRUE;
-    }
-
-    if( eve->mask & IN_IGNORED )
-    {
-      mce_log(LL_ERR, "inotify watch went defunct");
-      flg = TRUE;
-      goto cleanup;
-    }
+    filewatcher_process_event(eve, &seen);
   }
 
   res = TRUE;
 
 cleanup:
 
-  if( flg && self && self->changed_cb )
+  if( seen )
   {
-    self->changed_cb(self->watch_path, self->watch_file, self->user_data);
+    g_hash_table_unref(seen);
   }
 
+  filewatcher_flush_pending();
+
   return res;
 }
 
@@ -330,7 +662,7 @@ cleanup:
  *
  * @param source (not used)
  * @param condition (not used)
- * @param data pointer to filewatcher_t object (as void pointer)
+ * @param data (not used)
  *
  * @return TRUE to keep the io watch alive, or
  *         FALSE if the io watch must be released
@@ -341,24 +673,114 @@ filewatcher_input_cb(GIOChannel *source,
                      GIOCondition condition,
                      gpointer data)
 {
-  (void)source; (void)condition;
+  (void)source; (void)condition; (void)data;
 
-  filewatcher_t *self = data;
-  gboolean keep_going = filewatcher_process_events(self);
+  gint64   started    = mce_wakeup_begin();
+  gboolean keep_going = filewatcher_process_events(filewatcher_inotify_fd);
+
+  mce_wakeup_account(filewatcher_wakeup_owner, started);
 
   if( !keep_going )
   {
     mce_log(LL_WARN, "stopping inotify event io watch");
-    self->watch_id = 0;
+    filewatcher_inotify_id = 0;
   }
 
   return keep_going;
 }
 
-/** Helper for setting up inotify file descriptor
+/** Helper for setting up glib io watch for the shared inotify fd
+ *
+ * @return TRUE on success, or FALSE on failure
+ */
+static
+gboolean
+filewatcher_setup_iowatch(void)
+{
+  gboolean success = FALSE;
+
+  GIOChannel *chan  = 0;
+  GError     *err   = 0;
+
+  if( !(chan = g_io_channel_unix_new(filewatcher_inotify_fd)) )
+  {
+    mce_log(LL_WARN, "%s: %m", "g_io_channel_unix_new");
+    goto cleanup;
+  }
+
+  /* the channel does not own the fd  */
+  g_io_channel_set_close_on_unref(chan, FALSE);
+
+  /* Set to NULL encoding so that we can turn off the buffering */
+  if( g_io_channel_set_encoding(chan, NULL, &err) != G_IO_STATUS_NORMAL )
+  {
+    mce_log(LL_WARN, "%s: %s", "g_io_channel_set_encoding",
+            (err && err->message) ? err->message : "unknown");
+  }
+  g_io_channel_set_buffered(chan, FALSE);
+
+  filewatcher_wakeup_owner = mce_wakeup_owner("inotify", "filewatcher");
+  filewatcher_inotify_id = g_io_add_watch(chan, G_IO_IN,
+                                          filewatcher_input_cb, 0);
+
+  if( !filewatcher_inotify_id )
+  {
+    mce_log(LL_WARN, "%s: %m", "g_io_add_watch");
+    goto cleanup;
+  }
+
+  success = TRUE;
+
+cleanup:
+
+  g_clear_error(&err);
+
+  if( chan ) g_io_channel_unref(chan);
+
+  return success;
+}
+
+/** Make sure the shared inotify instance is available
+ *
+ * @return TRUE on success, or FALSE on failure
+ */
+static
+gboolean
+filewatcher_inotify_acquire(void)
+{
+  gboolean success = FALSE;
+
+  if( filewatcher_inotify_fd == -1 )
+  {
+    filewatcher_inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if( filewatcher_inotify_fd == -1 )
+    {
+      mce_log(LL_WARN, "inotify_init: %m");
+      goto cleanup;
+    }
+  }
+
+  if( !filewatcher_inotify_lut )
+  {
+    filewatcher_inotify_lut = g_hash_table_new(g_direct_hash,
+                                               g_direct_equal);
+  }
+
+  if( !filewatcher_inotify_id && !filewatcher_setup_iowatch() )
+  {
+    goto cleanup;
+  }
+
+  success = TRUE;
+
+cleanup:
+  return success;
+}
+
+/** Helper for adding inotify watch for filewatcher_t object
  *
  * @note This function is meant to be called form
- *       filewatcher_create() function only!
+ *       filewatcher_start() function only!
  *
  * @param self pointer to filewatcher_t object
  *
@@ -366,10 +788,12 @@ filewatcher_input_cb(GIOChannel *source,
  */
 static
 gboolean
-filewatcher_setup_inotify(filewatcher_t *self)
+filewatcher_attach(filewatcher_t *self)
 {
   gboolean success = FALSE;
 
+  /* Adding a watch for an already watched directory replaces
+   * the event mask; it must be the same for all watchers */
   uint32_t mask = (0
                    | IN_CREATE
                    | IN_DELETE
@@ -379,14 +803,9 @@ filewatcher_setup_inotify(filewatcher_t *self)
                    | IN_DONT_FOLLOW
                    | IN_ONLYDIR);
 
-  self->inotify_fd = inotify_init1(IN_CLOEXEC);
-  if( self->inotify_fd == -1 )
-  {
-    mce_log(LL_WARN, "inotify_init: %m");
-    goto cleanup;
-  }
+  GSList  *list;
 
-  self->inotify_wd = inotify_add_watch(self->inotify_fd,
+  self->inotify_wd = inotify_add_watch(filewatcher_inotify_fd,
                                        self->watch_path,  mask);
   if( self->inotify_wd == -1 )
   {
@@ -394,52 +813,40 @@ filewatcher_setup_inotify(filewatcher_t *self)
     goto cleanup;
   }
 
+  list = g_slist_append(filewatcher_lookup(self->inotify_wd), self);
+  g_hash_table_insert(filewatcher_inotify_lut,
+                      GINT_TO_POINTER(self->inotify_wd), list);
+
   success = TRUE;
 
 cleanup:
   return success;
 }
 
-/** Helper for setting up glib io watch for inotify file descriptor
+/** Start delivering inotify events to filewatcher_t object
  *
- * @note This function is meant to be called form
- *       filewatcher_create() function only!
+ * All file watchers share one inotify file descriptor and
+ * glib io watch, and the events are routed by watch descriptor.
+ *
+ * @note This function is meant to be called from
+ *       filewatcher_create*() functions only!
  *
  * @param self pointer to filewatcher_t object
  *
- * @return TRUE on success, or FALSE on failure
+ * @return self on success, or NULL after deleting self on failure
  */
 static
-gboolean
-filewatcher_setup_iowatch(filewatcher_t *self)
+filewatcher_t *
+filewatcher_start(filewatcher_t *self)
 {
   gboolean success = FALSE;
 
-  GIOChannel *chan  = 0;
-  GError     *err   = 0;
-
-  if( !(chan = g_io_channel_unix_new(self->inotify_fd)) )
+  if( !filewatcher_inotify_acquire() )
   {
-    mce_log(LL_WARN, "%s: %m", "g_io_channel_unix_new");
     goto cleanup;
   }
-
-  /* the channel does not own the fd  */
-  g_io_channel_set_close_on_unref(chan, FALSE);
-
-  /* Set to NULL encoding so that we can turn off the buffering */
-  if( g_io_channel_set_encoding(chan, NULL, &err) != G_IO_STATUS_NORMAL )
+  if( !filewatcher_attach(self) )
   {
-    mce_log(LL_WARN, "%s: %s", "g_io_channel_set_encoding",
-            (err && err->message) ? err->message : "unknown");
-  }
-  g_io_channel_set_buffered(chan, FALSE);
-
-  self->watch_id = g_io_add_watch(chan, G_IO_IN, filewatcher_input_cb, self);
-
-  if( !self->watch_id )
-  {
-    mce_log(LL_WARN, "%s: %m", "g_io_add_watch");
     goto cleanup;
   }
 
@@ -447,17 +854,19 @@ filewatcher_setup_iowatch(filewatcher_t *self)
 
 cleanup:
 
-  g_clear_error(&err);
-
-  if( chan ) g_io_channel_unref(chan);
+  if( !success )
+  {
+    filewatcher_delete(self), self = 0;
+  }
 
-  return success;
+  return self;
 }
 
 /** Create an filewatcher_t object
  *
  * An inotify watcher is started for the given director/file.
- * A glib io watch is used to process the inotify events.
+ * The inotify events are read via one glib io watch that is
+ * shared by all filewatcher_t objects.
  * The change_cb is called when contents of the tracked file
  * are assumed to have changed.
  *
@@ -481,8 +890,6 @@ filewatcher_create(const char *dirpath,
                    gpointer user_data,
                    GDestroyNotify delete_cb)
 {
-  gboolean success = FALSE;
-
   filewatcher_t *self = g_malloc0(sizeof *self);
   filewatcher_ctor(self);
 
@@ -494,25 +901,45 @@ filewatcher_create(const char *dirpath,
   self->user_data  = user_data;
   self->delete_cb  = delete_cb;
 
-  if( !filewatcher_setup_inotify(self) )
-  {
-    goto cleanup;
-  }
-  if( !filewatcher_setup_iowatch(self) )
-  {
-    goto cleanup;
-  }
+  return filewatcher_start(self);
+}
 
-  success = TRUE;
+/** Create an filewatcher_t object for tracking directory entries
+ *
+ * An inotify watcher is started for the given directory, and
+ * the entry_cb is called for every file that is created in,
+ * moved to, deleted from or moved out of the directory.
+ *
+ * If the kernel side inotify event queue overflows, entry_cb
+ * is called with NULL file name; the directory content is then
+ * unknown and should be rescanned.
+ *
+ * @note The entry_cb must not delete the filewatcher_t object.
+ *
+ * @param dirpath directory to watch over
+ * @param entry_cb function to call when dirpath entries change
+ * @param user_data extra parameter to pass to entry_cb
+ * @param delete_cb called on user_data when filewatcher_t itself is deleted
+ *
+ * @return pointer to filewatcher_t object, or NULL in case of errors
+ */
+filewatcher_t *
+filewatcher_create_dir(const char *dirpath,
+                       filewatcher_entry_fn entry_cb,
+                       gpointer user_data,
+                       GDestroyNotify delete_cb)
+{
+  filewatcher_t *self = g_malloc0(sizeof *self);
+  filewatcher_ctor(self);
 
-cleanup:
+  self->watch_path = g_strdup(dirpath);
 
-  if( !success )
-  {
-    filewatcher_delete(self), self = 0;
-  }
+  self->entry_cb   = entry_cb;
 
-  return self;
+  self->user_data  = user_data;
+  self->delete_cb  = delete_cb;
+
+  return filewatcher_start(self);
 }
 
 /** Force calling the change notification callback
@@ -19,6 +19,11 @@ typedef void (*filewatcher_changed_fn)(const char *path,
 				       const char *file,
 				       gpointer user_data);
 
+typedef void (*filewatcher_entry_fn)(const char *path,
+				     const char *file,
+				     gboolean exists,
+				     gpointer user_data);
+
 typedef struct filewatcher_t filewatcher_t;
 
 filewatcher_t *filewatcher_create(const char *dirpath,
@@ -27,6 +32,11 @@ filewatcher_t *filewatcher_create(const char *dirpath,
                                   gpointer user_data,
                                   GDestroyNotify delete_cb);
 
+filewatcher_t *filewatcher_create_dir(const char *dirpath,
+                                      filewatcher_entry_fn entry_cb,
+                                      gpointer user_data,
+                                      GDestroyNotify delete_cb);
+
 void filewatcher_delete(filewatcher_t *self);
 
 void filewatcher_force_trigger(filewatcher_t *self);
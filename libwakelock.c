@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <time.h>
 
 /** Whether to write debug logging to stderr
  *
@@ -139,6 +140,172 @@ static const char lwl_unlock_path[] = "/sys/power/wake_unlock";
 /** Sysfs entry for allow/block suspend */
 static const char lwl_state_path[] = "/sys/power/state";
 
+/** Cached file descriptor for lwl_lock_path */
+static int        lwl_lock_fd   = -1;
+
+/** Cached file descriptor for lwl_unlock_path */
+static int        lwl_unlock_fd = -1;
+
+/** Number of wakelock names whose kernel side state is cached */
+#define LWL_CACHE_SIZE 16
+
+/** Kernel side wakelock states known to the cache */
+enum {
+	LWL_STATE_UNLOCKED, /**< Unlocked via wakelock_unlock() */
+	LWL_STATE_LOCKED,   /**< Locked without timeout */
+	LWL_STATE_TIMED,    /**< Locked with timeout; can expire any time */
+};
+
+/** Cached kernel side state of one wakelock */
+typedef struct {
+	char name[64]; /**< Wakelock name, or empty string if unused */
+	int  state;    /**< LWL_STATE_LOCKED etc */
+
+	unsigned  acquires; /**< Number of unlocked -> locked transitions */
+	long long since;    /**< Start of the current hold [ns], or -1 */
+	long long expires;  /**< End of a timed hold [ns], or -1 */
+	long long held;     /**< Total time of finished holds [ns] */
+	long long longest;  /**< Longest finished hold [ns] */
+} lwl_cache_t;
+
+/** Cache of wakelock states, used for skipping redundant writes */
+static lwl_cache_t lwl_cache[LWL_CACHE_SIZE];
+
+/** Helper for finding or creating a wakelock cache entry
+ *
+ * @param name The name of the wakelock
+ * @param add  Non-zero to create a missing entry
+ * @return cache entry, or NULL if not cached
+ */
+static lwl_cache_t *lwl_cache_lookup(const char *name, int add)
+{
+	lwl_cache_t *unused = 0;
+
+	for( int i = 0; i < LWL_CACHE_SIZE; ++i ) {
+		if( !*lwl_cache[i].name ) {
+			if( !unused ) unused = &lwl_cache[i];
+		}
+		else if( !strcmp(lwl_cache[i].name, name) ) {
+			return &lwl_cache[i];
+		}
+	}
+
+	/* names that do not fit are just not cached */
+	if( !add || !unused || strlen(name) >= sizeof unused->name )
+		return 0;
+
+	lwl_concat(unused->name, sizeof unused->name, name, NULL);
+	unused->state   = LWL_STATE_UNLOCKED;
+	unused->since   = -1;
+	unused->expires = -1;
+	return unused;
+}
+
+/** Get monotonic time for wakelock accounting
+ *
+ * @return nanoseconds since some reference point in time
+ */
+static long long lwl_get_time(void)
+{
+	struct timespec ts = { 0, 0 };
+
+	/* clock_gettime() is async-signal-safe */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Get the end of the current hold of a wakelock
+ *
+ * @param entry wakelock cache entry
+ * @param now   current time [ns]
+ * @return end of the hold [ns]; now if the hold is still going on
+ */
+static long long lwl_hold_end(const lwl_cache_t *entry, long long now)
+{
+	if( entry->expires >= 0 && entry->expires < now )
+		return entry->expires;
+	return now;
+}
+
+/** Account the end of the current hold of a wakelock
+ *
+ * @param entry wakelock cache entry
+ * @param end   end of the hold [ns]
+ */
+static void lwl_hold_finish(lwl_cache_t *entry, long long end)
+{
+	long long hold;
+
+	if( entry->since < 0 )
+		return;
+
+	hold = end - entry->since;
+	if( hold < 0 ) hold = 0;
+
+	entry->held += hold;
+	if( entry->longest < hold )
+		entry->longest = hold;
+
+	entry->since   = -1;
+	entry->expires = -1;
+}
+
+/** Account locking of a wakelock
+ *
+ * Relocking an already held wakelock only updates the expiry time;
+ * a timed hold that already expired is finished first
+ *
+ * @param entry wakelock cache entry
+ * @param ns    timeout in nanoseconds, or negative value for no timeout
+ */
+static void lwl_hold_start(lwl_cache_t *entry, long long ns)
+{
+	long long now = lwl_get_time();
+
+	if( entry->since >= 0 && entry->expires >= 0 && entry->expires <= now )
+		lwl_hold_finish(entry, entry->expires);
+
+	if( entry->since < 0 ) {
+		entry->since = now;
+		entry->acquires += 1;
+	}
+
+	entry->expires = (ns < 0) ? -1 : now + ns;
+}
+
+/** Helper for writing to sysfs files via cached file descriptor
+ *
+ * The file is opened on first use and kept open; after write
+ * failures it is closed and opened again on the next write.
+ *
+ * @param path  sysfs file to write to
+ * @param cache where the file descriptor is cached
+ * @param data  string to write
+ */
+static void lwl_write_cached(const char *path, int *cache, const char *data)
+{
+	int size = strlen(data);
+
+	lwl_debug(path, " << ", data, NULL);
+
+	if( *cache == -1 ) {
+		*cache = TEMP_FAILURE_RETRY(open(path, O_WRONLY | O_CLOEXEC));
+		if( *cache == -1 ) {
+			lwl_debug(path, ": open: ", strerror(errno),
+				  "\n", NULL);
+			return;
+		}
+	}
+
+	errno = 0;
+	if( TEMP_FAILURE_RETRY(write(*cache, data, size)) != size ) {
+		lwl_debug(path, ": write: ", strerror(errno), "\n", NULL);
+		TEMP_FAILURE_RETRY(close(*cache));
+		*cache = -1;
+	}
+}
+
 /** Helper for writing to sysfs files
  */
 static void lwl_write_file(const char *path, const char *data)
@@ -185,14 +352,24 @@ void wakelock_lock(const char *name, long long ns)
 	if( lwl_enabled() && !lwl_shutting_down ) {
 		char tmp[64];
 		char num[64];
+		lwl_cache_t *entry = lwl_cache_lookup(name, 1);
+
 		if( ns < 0 ) {
+			/* already locked without timeout -> nothing to do */
+			if( entry && entry->state == LWL_STATE_LOCKED )
+				return;
 			lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
 		} else {
-			lwl_concat(tmp, sizeof tmp, name,
+			lwl_concat(tmp, sizeof tmp, name, " ",
 				   lwl_number(num, sizeof num, ns),
 				   "\n", NULL);
 		}
-		lwl_write_file(lwl_lock_path, tmp);
+		lwl_write_cached(lwl_lock_path, &lwl_lock_fd, tmp);
+
+		if( entry ) {
+			entry->state = (ns < 0) ? LWL_STATE_LOCKED : LWL_STATE_TIMED;
+			lwl_hold_start(entry, ns);
+		}
 	}
 }
 
@@ -206,11 +383,71 @@ void wakelock_unlock(const char *name)
 {
 	if( lwl_enabled() ) {
 		char tmp[64];
+		lwl_cache_t *entry;
+
 		lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
-		lwl_write_file(lwl_unlock_path, tmp);
+
+		/* On exit path we might have been called from a signal
+		 * handler that interrupted a cache update -> leave the
+		 * cache and the cached file descriptor alone and make
+		 * sure the unlock reaches the kernel */
+		if( lwl_shutting_down ) {
+			lwl_write_file(lwl_unlock_path, tmp);
+			return;
+		}
+
+		/* already unlocked -> nothing to do */
+		entry = lwl_cache_lookup(name, 0);
+		if( entry && entry->state == LWL_STATE_UNLOCKED )
+			return;
+
+		lwl_write_cached(lwl_unlock_path, &lwl_unlock_fd, tmp);
+
+		if( entry ) {
+			entry->state = LWL_STATE_UNLOCKED;
+			lwl_hold_finish(entry,
+					lwl_hold_end(entry, lwl_get_time()));
+		}
 	}
 }
 
+/** Get accounting information about a wakelock used by this process
+ *
+ * Only wakelocks that fit in the state cache are accounted for;
+ * the current hold, if any, is included in the totals
+ *
+ * @param index index of the wakelock, starting from zero
+ * @param stats where to store the accounting information
+ * @return 1 if stats was filled in, or 0 if there is no such wakelock
+ */
+int wakelock_get_stats(int index, wakelock_stats_t *stats)
+{
+	long long now = lwl_get_time();
+
+	for( int i = 0; i < LWL_CACHE_SIZE; ++i ) {
+		const lwl_cache_t *entry = &lwl_cache[i];
+		long long hold = 0;
+
+		if( !*entry->name || index-- > 0 )
+			continue;
+
+		if( entry->since >= 0 ) {
+			hold = lwl_hold_end(entry, now) - entry->since;
+			if( hold < 0 ) hold = 0;
+		}
+
+		stats->name     = entry->name;
+		stats->acquires = entry->acquires;
+		stats->held     = entry->held + hold;
+		stats->longest  = (entry->longest < hold) ? hold : entry->longest;
+		stats->locked   = (entry->since >= 0 &&
+				   lwl_hold_end(entry, now) == now);
+		return 1;
+	}
+
+	return 0;
+}
+
 /** Use sysfs interface to allow automatic entry to suspend
  *
  * After this call the device will enter suspend mode once all
@@ -13,6 +13,16 @@ extern "C" {
 };
 # endif
 
+/** Accounting information about one wakelock */
+typedef struct
+{
+	const char *name;     /**< Wakelock name */
+	unsigned    acquires; /**< Number of times the wakelock was taken */
+	long long   held;     /**< Total time the wakelock was held [ns] */
+	long long   longest;  /**< Longest single hold [ns] */
+	int         locked;   /**< Non-zero if the wakelock is held now */
+} wakelock_stats_t;
+
 void wakelock_lock  (const char *name, long long ns);
 void wakelock_unlock(const char *name);
 
@@ -20,6 +30,8 @@ void wakelock_allow_suspend(void);
 void wakelock_block_suspend(void);
 void wakelock_block_suspend_until_exit(void);
 
+int  wakelock_get_stats(int index, wakelock_stats_t *stats);
+
 void lwl_enable_logging(void);
 
 # ifdef __cplusplus
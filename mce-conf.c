@@ -20,12 +20,36 @@
  */
 #include <glib.h>
 #include <glob.h>
+#include <stdio.h>			/* snprintf() */
 #include <string.h>
+#include <fcntl.h>			/* open() */
+#include <unistd.h>			/* close() */
+#include <sys/mman.h>			/* mmap(), munmap() */
+#include <sys/stat.h>			/* stat(), fstat() */
 
 #include "mce.h"
 #include "mce-conf.h"
 
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-io.h"			/* mce_io_update_file_atomic_async() */
+
+/** Path to the snapshot of the merged configuration */
+#define MCE_CONF_SNAPSHOT_PATH	G_STRINGIFY(MCE_VAR_DIR)"/mce-conf.snapshot"
+
+/** Magic number at the start of the configuration snapshot */
+#define MCE_CONF_SNAPSHOT_MAGIC	"MCECONF1"
+
+/**
+ * Configuration snapshot file header
+ *
+ * The header is followed by stamp_size bytes describing the source
+ * ini-files and data_size bytes of merged key file data
+ */
+typedef struct {
+	char magic[8];			/**< MCE_CONF_SNAPSHOT_MAGIC */
+	guint32 stamp_size;		/**< Size of the source file stamps */
+	guint32 data_size;		/**< Size of the key file data */
+} mce_conf_snapshot_t;
 
 /** Pointer to the keyfile structure where config values are read from */
 static gpointer keyfile = NULL;
@@ -52,36 +76,156 @@ static gpointer mce_conf_get_keyfile(void)
 	return keyfile;
 }
 
+/** Value types held in the lookup cache */
+typedef enum {
+	CONF_TYPE_BOOL = 'b',		/**< gboolean */
+	CONF_TYPE_INT = 'i',		/**< gint */
+	CONF_TYPE_INT_LIST = 'I',	/**< Array of gint */
+	CONF_TYPE_STRING = 's',		/**< String */
+	CONF_TYPE_STRING_LIST = 'S',	/**< NULL terminated string array */
+} conf_type_t;
+
+/** Parsed configuration value */
+typedef struct {
+	gboolean found;			/**< Was the key set and valid */
+	gsize length;			/**< Number of list items */
+	union {
+		gboolean b;		/**< CONF_TYPE_BOOL value */
+		gint i;			/**< CONF_TYPE_INT value */
+		gint *il;		/**< CONF_TYPE_INT_LIST value */
+		gchar *s;		/**< CONF_TYPE_STRING value */
+		gchar **sl;		/**< CONF_TYPE_STRING_LIST value */
+	} data;				/**< The value */
+	conf_type_t type;		/**< Type of the value */
+} conf_value_t;
+
+/** Lookup cache for parsed values; "type[group]key" -> conf_value_t
+ *
+ * The key file does not change after mce_conf_init(), so every
+ * value needs to be parsed only once */
+static GHashTable *conf_cache = NULL;
+
 /**
- * Get a boolean configuration value
+ * Release a cached configuration value
+ *
+ * @param aptr conf_value_t (as a void pointer)
+ */
+static void conf_value_free(gpointer aptr)
+{
+	conf_value_t *val = aptr;
+
+	switch (val->type) {
+	case CONF_TYPE_INT_LIST:
+		g_free(val->data.il);
+		break;
+	case CONF_TYPE_STRING:
+		g_free(val->data.s);
+		break;
+	case CONF_TYPE_STRING_LIST:
+		g_strfreev(val->data.sl);
+		break;
+	default:
+		break;
+	}
+
+	g_free(val);
+}
+
+/**
+ * Look up a parsed configuration value, parsing it if needed
  *
  * @param group The configuration group to get the value from
  * @param key The configuration key to get the value of
- * @param defaultval The default value to use if the key isn't set
- * @param keyfileptr A keyfile pointer, or NULL to use the default keyfile
- * @return The configuration value on success, the default value on failure
+ * @param type Type the value should be parsed as
+ * @return Cached value; check the found member for validity
  */
-gboolean mce_conf_get_bool(const gchar *group, const gchar *key,
-			   const gboolean defaultval)
+static const conf_value_t *mce_conf_lookup(const gchar *group,
+					   const gchar *key,
+					   conf_type_t type)
 {
-	gboolean tmp = FALSE;
 	GError *error = NULL;
+	gchar buf[128];
+	const gchar *id = buf;
+	gchar *tmp = NULL;
+	conf_value_t *val = NULL;
 
 	gpointer keyfileptr = mce_conf_get_keyfile();
 
-	tmp = g_key_file_get_boolean(keyfileptr, group, key, &error);
+	if (conf_cache == NULL)
+		conf_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free, conf_value_free);
+
+	/* Lookups are frequent; avoid heap allocations unless the
+	 * identifier does not fit in the stack buffer */
+	if (snprintf(buf, sizeof buf, "%c[%s]%s",
+		     type, group, key) >= (int)sizeof buf)
+		id = tmp = g_strdup_printf("%c[%s]%s", type, group, key);
+
+	if ((val = g_hash_table_lookup(conf_cache, id)) != NULL)
+		goto EXIT;
+
+	val = g_new0(conf_value_t, 1);
+	val->type = type;
+
+	switch (type) {
+	case CONF_TYPE_BOOL:
+		val->data.b = g_key_file_get_boolean(keyfileptr, group, key,
+						     &error);
+		break;
+	case CONF_TYPE_INT:
+		val->data.i = g_key_file_get_integer(keyfileptr, group, key,
+						     &error);
+		break;
+	case CONF_TYPE_INT_LIST:
+		val->data.il = g_key_file_get_integer_list(keyfileptr,
+							   group, key,
+							   &val->length,
+							   &error);
+		break;
+	case CONF_TYPE_STRING:
+		val->data.s = g_key_file_get_string(keyfileptr, group, key,
+						    &error);
+		break;
+	case CONF_TYPE_STRING_LIST:
+		val->data.sl = g_key_file_get_string_list(keyfileptr,
+							  group, key,
+							  &val->length,
+							  &error);
+		break;
+	}
 
 	if (error != NULL) {
 		mce_log(LL_DEBUG,
-			"Could not get config key %s/%s; %s; "
-			"defaulting to `%d'",
-			group, key, error->message, defaultval);
-		tmp = defaultval;
+			"Could not get config key %s/%s; %s",
+			group, key, error->message);
+		val->length = 0;
+	} else {
+		val->found = TRUE;
 	}
 
+	g_hash_table_replace(conf_cache, tmp ?: g_strdup(id), val), tmp = NULL;
+
+EXIT:
 	g_clear_error(&error);
+	g_free(tmp);
 
-	return tmp;
+	return val;
+}
+
+/**
+ * Get a boolean configuration value
+ *
+ * @param group The configuration group to get the value from
+ * @param key The configuration key to get the value of
+ * @param defaultval The default value to use if the key isn't set
+ * @return The configuration value on success, the default value on failure
+ */
+gboolean mce_conf_get_bool(const gchar *group, const gchar *key,
+			   const gboolean defaultval)
+{
+	const conf_value_t *val = mce_conf_lookup(group, key, CONF_TYPE_BOOL);
+
+	return val->found ? val->data.b : defaultval;
 }
 
 /**
@@ -90,30 +234,35 @@ gboolean mce_conf_get_bool(const gchar *group, const gchar *key,
  * @param group The configuration group to get the value from
  * @param key The configuration key to get the value of
  * @param defaultval The default value to use if the key isn't set
- * @param keyfileptr A keyfile pointer, or NULL to use the default keyfile
  * @return The configuration value on success, the default value on failure
  */
 gint mce_conf_get_int(const gchar *group, const gchar *key,
 		      const gint defaultval)
 {
-	gint tmp = -1;
-	GError *error = NULL;
-
-	gpointer keyfileptr = mce_conf_get_keyfile();
+	const conf_value_t *val = mce_conf_lookup(group, key, CONF_TYPE_INT);
 
-	tmp = g_key_file_get_integer(keyfileptr, group, key, &error);
+	return val->found ? val->data.i : defaultval;
+}
 
-	if (error != NULL) {
-		mce_log(LL_DEBUG,
-			"Could not get config key %s/%s; %s; "
-			"defaulting to `%d'",
-			group, key, error->message, defaultval);
-		tmp = defaultval;
-	}
+/**
+ * Get an integer list configuration value without copying it
+ *
+ * @param group The configuration group to get the value from
+ * @param key The configuration key to get the value of
+ * @param length The length of the list, or NULL if not needed
+ * @return The configuration value on success, NULL on failure;
+ *         owned by mce-conf, must not be freed by the caller
+ */
+const gint *mce_conf_peek_int_list(const gchar *group, const gchar *key,
+				   gsize *length)
+{
+	const conf_value_t *val = mce_conf_lookup(group, key,
+						  CONF_TYPE_INT_LIST);
 
-	g_clear_error(&error);
+	if (length)
+		*length = val->length;
 
-	return tmp;
+	return val->found ? val->data.il : NULL;
 }
 
 /**
@@ -122,31 +271,36 @@ gint mce_conf_get_int(const gchar *group, const gchar *key,
  * @param group The configuration group to get the value from
  * @param key The configuration key to get the value of
  * @param length The length of the list, or NULL if not needed
- * @param keyfileptr A keyfile pointer, or NULL to use the default keyfile
  * @return The configuration value on success, NULL on failure
  */
 gint *mce_conf_get_int_list(const gchar *group, const gchar *key,
 			    gsize *length)
 {
-	gint *tmp = NULL;
-	GError *error = NULL;
+	gsize len = 0;
+	const gint *tmp = mce_conf_peek_int_list(group, key, &len);
 
-	gpointer keyfileptr = mce_conf_get_keyfile();
+	if (length)
+		*length = len;
 
-	tmp = g_key_file_get_integer_list(keyfileptr, group, key,
-					  length, &error);
-
-	if (error != NULL) {
-		mce_log(LL_DEBUG,
-			"Could not get config key %s/%s; %s",
-			group, key, error->message);
-		if( length )
-			*length = 0;
-	}
+	return tmp ? g_memdup(tmp, len * sizeof *tmp) : NULL;
+}
 
-	g_clear_error(&error);
+/**
+ * Get a string configuration value without copying it
+ *
+ * @param group The configuration group to get the value from
+ * @param key The configuration key to get the value of
+ * @param defaultval The default value to use if the key isn't set
+ * @return The configuration value on success, the default value on failure;
+ *         owned by mce-conf, must not be freed by the caller
+ */
+const gchar *mce_conf_peek_string(const gchar *group, const gchar *key,
+				  const gchar *defaultval)
+{
+	const conf_value_t *val = mce_conf_lookup(group, key,
+						  CONF_TYPE_STRING);
 
-	return tmp;
+	return val->found ? val->data.s : defaultval;
 }
 
 /**
@@ -155,34 +309,34 @@ gint *mce_conf_get_int_list(const gchar *group, const gchar *key,
  * @param group The configuration group to get the value from
  * @param key The configuration key to get the value of
  * @param defaultval The default value to use if the key isn't set
- * @param keyfileptr A keyfile pointer, or NULL to use the default keyfile
  * @return The configuration value on success, the default value on failure
  */
 gchar *mce_conf_get_string(const gchar *group, const gchar *key,
 			   const gchar *defaultval)
 {
-	gchar *tmp = NULL;
-	GError *error = NULL;
-
-	gpointer keyfileptr = mce_conf_get_keyfile();
-
-	tmp = g_key_file_get_string(keyfileptr, group, key, &error);
+	return g_strdup(mce_conf_peek_string(group, key, defaultval));
+}
 
-	if (error != NULL) {
-		mce_log(LL_DEBUG,
-			"Could not get config key %s/%s; %s; %s%s%s",
-			group, key, error->message,
-			defaultval ? "defaulting to `" : "no default set",
-			defaultval ? defaultval : "",
-			defaultval ? "'" : "");
-
-		if (defaultval != NULL)
-			tmp = g_strdup(defaultval);
-	}
+/**
+ * Get a string list configuration value without copying it
+ *
+ * @param group The configuration group to get the value from
+ * @param key The configuration key to get the value of
+ * @param length The length of the list, or NULL if not needed
+ * @return The configuration value on success, NULL on failure;
+ *         owned by mce-conf, must not be freed by the caller
+ */
+const gchar * const *mce_conf_peek_string_list(const gchar *group,
+					       const gchar *key,
+					       gsize *length)
+{
+	const conf_value_t *val = mce_conf_lookup(group, key,
+						  CONF_TYPE_STRING_LIST);
 
-	g_clear_error(&error);
+	if (length)
+		*length = val->length;
 
-	return tmp;
+	return val->found ? (const gchar * const *)val->data.sl : NULL;
 }
 
 /**
@@ -191,31 +345,15 @@ gchar *mce_conf_get_string(const gchar *group, const gchar *key,
  * @param group The configuration group to get the value from
  * @param key The configuration key to get the value of
  * @param length The length of the list, or NULL if not needed
- * @param keyfileptr A keyfile pointer, or NULL to use the default keyfile
  * @return The configuration value on success, NULL on failure
  */
 gchar **mce_conf_get_string_list(const gchar *group, const gchar *key,
 				 gsize *length)
 {
-	gchar **tmp = NULL;
-	GError *error = NULL;
+	const gchar * const *tmp = mce_conf_peek_string_list(group, key,
+							     length);
 
-	gpointer keyfileptr = mce_conf_get_keyfile();
-
-	tmp = g_key_file_get_string_list(keyfileptr, group, key,
-					 length, &error);
-
-	if (error != NULL) {
-		mce_log(LL_DEBUG,
-			"Could not get config key %s/%s; %s",
-			group, key, error->message);
-		if( length )
-			*length = 0;
-	}
-
-	g_clear_error(&error);
-
-	return tmp;
+	return tmp ? g_strdupv((gchar **)tmp) : NULL;
 }
 
 gchar **mce_conf_get_keys(const gchar *group, gsize *length)
@@ -370,22 +508,166 @@ static int mce_conf_glob_error_cb(const char *path, int err)
   return 0;
 }
 
+/** Describe the ini-files that make up the configuration
+ *
+ * The description changes whenever files are added, removed
+ * or modified, and is used for validating the snapshot.
+ *
+ * @param gb ini-files found by glob()
+ *
+ * @return description of the files, or NULL on failure
+ */
+static GString *mce_conf_get_stamp(const glob_t *gb)
+{
+	GString *stamp = g_string_new(0);
+
+	for( size_t i = 0; i < gb->gl_pathc; ++i ) {
+		const char *path = gb->gl_pathv[i];
+		struct stat st;
+
+		if( stat(path, &st) == -1 ) {
+			mce_log(LL_WARN, "%s: stat: %m", path);
+			g_string_free(stamp, TRUE), stamp = 0;
+			break;
+		}
+
+		g_string_append_printf(stamp, "%s %lld %lld.%09ld\n", path,
+				       (long long)st.st_size,
+				       (long long)st.st_mtim.tv_sec,
+				       (long)st.st_mtim.tv_nsec);
+	}
+
+	return stamp;
+}
+
+/** Load merged configuration from snapshot file
+ *
+ * @param stamp description of the current ini-files
+ *
+ * @return key file, or NULL if the snapshot is missing or stale
+ */
+static GKeyFile *mce_conf_load_snapshot(const GString *stamp)
+{
+	GKeyFile *ini  = 0;
+	GError   *err  = 0;
+	int       fd   = -1;
+	void     *base = MAP_FAILED;
+	size_t    size = 0;
+
+	const mce_conf_snapshot_t *hdr;
+	const char *data;
+	struct stat st;
+
+	if( (fd = open(MCE_CONF_SNAPSHOT_PATH, O_RDONLY)) == -1 )
+		goto EXIT;
+
+	if( fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof *hdr )
+		goto EXIT;
+
+	size = st.st_size;
+	base = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if( base == MAP_FAILED )
+		goto EXIT;
+
+	hdr  = base;
+	data = (const char *)(hdr + 1);
+
+	if( memcmp(hdr->magic, MCE_CONF_SNAPSHOT_MAGIC, sizeof hdr->magic) )
+		goto EXIT;
+
+	if( sizeof *hdr + hdr->stamp_size + hdr->data_size != size )
+		goto EXIT;
+
+	if( hdr->stamp_size != stamp->len ||
+	    memcmp(data, stamp->str, stamp->len) )
+		goto EXIT;
+
+	data += hdr->stamp_size;
+
+	ini = g_key_file_new();
+
+	if( !g_key_file_load_from_data(ini, data, hdr->data_size, 0, &err) ) {
+		mce_log(LL_WARN, "%s: can't load: %s", MCE_CONF_SNAPSHOT_PATH,
+			err->message ?: "unknown");
+		g_key_file_free(ini), ini = 0;
+	}
+
+EXIT:
+	g_clear_error(&err);
+
+	if( base != MAP_FAILED )
+		munmap(base, size);
+
+	if( fd != -1 )
+		close(fd);
+
+	return ini;
+}
+
+/** Save merged configuration to snapshot file
+ *
+ * @param stamp description of the ini-files the data was merged from
+ * @param ini   merged key file
+ */
+static void mce_conf_save_snapshot(const GString *stamp, GKeyFile *ini)
+{
+	mce_conf_snapshot_t hdr;
+
+	gsize  len  = 0;
+	gchar *data = g_key_file_to_data(ini, &len, 0);
+	gchar *buff = 0;
+	size_t size = sizeof hdr + stamp->len + len;
+
+	if( !data )
+		goto EXIT;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, MCE_CONF_SNAPSHOT_MAGIC, sizeof hdr.magic);
+	hdr.stamp_size = stamp->len;
+	hdr.data_size  = len;
+
+	buff = g_malloc(size);
+	memcpy(buff, &hdr, sizeof hdr);
+	memcpy(buff + sizeof hdr, stamp->str, stamp->len);
+	memcpy(buff + sizeof hdr + stamp->len, data, len);
+
+	mce_io_update_file_atomic_async(MCE_CONF_SNAPSHOT_PATH, buff, size,
+					0644, FALSE, 0, 0);
+
+EXIT:
+	g_free(buff);
+	g_free(data);
+}
+
 /** Process config data from /etc/mce/mce.d/xxx.ini files
+ *
+ * If none of the ini-files have changed since the previous
+ * run, the merged data is loaded from a snapshot instead
  */
 static GKeyFile *mce_conf_read_ini_files(void)
 {
 	static const char pattern[] = MCE_CONF_DIR"/[0-9][0-9]*.ini";
 
-	GKeyFile *ini = g_key_file_new();
+	GKeyFile *ini   = 0;
+	GString  *stamp = 0;
 	glob_t    gb;
 
 	memset(&gb, 0, sizeof gb);
 
 	if( glob(pattern, 0, mce_conf_glob_error_cb, &gb) != 0 ) {
 		mce_log(LL_WARN, "no mce configuration ini-files found");
+		ini = g_key_file_new();
 		goto EXIT;
 	}
 
+	if( (stamp = mce_conf_get_stamp(&gb)) &&
+	    (ini = mce_conf_load_snapshot(stamp)) ) {
+		mce_log(LL_NOTICE, "using %s", MCE_CONF_SNAPSHOT_PATH);
+		goto EXIT;
+	}
+
+	ini = g_key_file_new();
+
 	for( size_t i = 0; i < gb.gl_pathc; ++i ) {
 		const char *path = gb.gl_pathv[i];
 		GError     *err  = 0;
@@ -403,7 +685,13 @@ static GKeyFile *mce_conf_read_ini_files(void)
 		g_key_file_free(tmp);
 	}
 
+	if( stamp )
+		mce_conf_save_snapshot(stamp, ini);
+
 EXIT:
+	if( stamp )
+		g_string_free(stamp, TRUE);
+
 	globfree(&gb);
 
 	return ini;
@@ -602,6 +890,8 @@ void mce_conf_exit(void)
 	g_strfreev(keybd_cached), keybd_cached = 0;
 	g_strfreev(black_cached), black_cached = 0;
 
+	if( conf_cache ) g_hash_table_unref(conf_cache), conf_cache = 0;
+
 	if( keyfile ) g_key_file_free(keyfile), keyfile = 0;
 
 	return;
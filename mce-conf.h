@@ -29,10 +29,17 @@ gint mce_conf_get_int(const gchar *group, const gchar *key,
 		      const gint defaultval);
 gint *mce_conf_get_int_list(const gchar *group, const gchar *key,
 			    gsize *length);
+const gint *mce_conf_peek_int_list(const gchar *group, const gchar *key,
+				   gsize *length);
 gchar *mce_conf_get_string(const gchar *group, const gchar *key,
 			   const gchar *defaultval);
+const gchar *mce_conf_peek_string(const gchar *group, const gchar *key,
+				  const gchar *defaultval);
 gchar **mce_conf_get_string_list(const gchar *group, const gchar *key,
 				 gsize *length);
+const gchar * const *mce_conf_peek_string_list(const gchar *group,
+					       const gchar *key,
+					       gsize *length);
 gchar **mce_conf_get_keys(const gchar *group, gsize *length);
 
 gboolean mce_conf_init(void);
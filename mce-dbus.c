@@ -32,23 +32,120 @@
 #include "mce-dbus.h"
 
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-io.h"			/* mce_io_monitor_stats_foreach() */
+#include "mce-lib.h"			/* mce_lib_get_time_ms(),
+					 * mce_lib_get_time_us()
+					 */
+#include "mce-wakeup.h"			/* mce_wakeup_owner(),
+					 * mce_wakeup_begin(),
+					 * mce_wakeup_account(),
+					 * mce_wakeup_stats_foreach()
+					 */
+#include "mce-memstat.h"		/* mce_memstat_alloc(),
+					 * mce_memstat_free(),
+					 * mce_memstat_foreach(),
+					 * mce_memstat_get_rss()
+					 */
 
 #include "mce-gconf.h"
 
 /** List of all D-Bus handlers */
 static GSList *dbus_handlers = NULL;
-/** List iterator for msg_handler */
+/** Next handler to be examined by msg_handler */
 static GSList *msg_handler_iter = NULL;
 
+/** Maximum number of distinct senders tracked per handler */
+#define HANDLER_STATS_MAX_SENDERS	16
+
+/** Number of senders reported per handler */
+#define HANDLER_STATS_TOP_SENDERS	3
+
+/** D-Bus handlers indexed by message type and member/error name;
+ *  name -> GSList of handler_struct, most recently added first */
+static GHashTable *dbus_handler_index[DBUS_NUM_MESSAGE_TYPES];
+
+/** Message property checked by a compiled match rule */
+typedef enum {
+	RULE_INVALID = -1,		/**< Unsupported key */
+	RULE_ARG = 0,			/**< String argument */
+	RULE_PATH = 1,			/**< Object path */
+	RULE_SENDER = 2			/**< Sender bus name */
+} rule_kind_t;
+
+/** Current owner of a well-known name used in sender rules */
+typedef struct {
+	gchar *name;			/**< Well-known bus name */
+	gchar *owner;			/**< Unique name of the owner,
+					 *   or NULL if not owned */
+	gchar *match;			/**< D-Bus match for owner changes */
+	guint refs;			/**< Number of rules using the entry */
+} sender_owner_t;
+
+/** Sender rule owner cache; bus name -> sender_owner_t */
+static GHashTable *sender_owners = NULL;
+
+/** Compiled form of one key='value' pair of a handler match rule */
+typedef struct {
+	rule_kind_t kind;		/**< What to compare */
+	gint arg;			/**< Argument index for RULE_ARG */
+	gchar *value;			/**< Expected value */
+	gchar sep;			/**< Namespace separator, or '\0'
+					 *   for exact match */
+	sender_owner_t *owner;		/**< Owner of a well-known sender
+					 *   name, or NULL */
+} rule_struct;
+
 /** D-Bus handler structure */
 typedef struct {
 	gboolean (*callback)(DBusMessage *const msg);	/**< Handler callback */
-	gchar *interface;		/**< The interface to listen on */
-	gchar *rules;			/**< Additional matching rules */
-	gchar *name;			/**< Method call or signal name */
+	const gchar *interface;		/**< The interface to listen on;
+					 *   interned */
+	GSList *compiled_rules;		/**< Rules parsed into rule_struct */
+	const gchar *match;		/**< D-Bus match used, or NULL;
+					 *   interned */
+	const gchar *name;		/**< Method call or signal name;
+					 *   interned */
 	guint type;			/**< DBUS_MESSAGE_TYPE */
+	guint call_count;		/**< Number of callback invocations */
+	guint64 total_time;		/**< Time spent in callback [us] */
+	guint64 max_time;		/**< Slowest callback invocation [us] */
+	GHashTable *senders;		/**< Sender name -> call count */
+	mce_wakeup_owner_t *wakeup_owner;	/**< Wakeup accounting */
 } handler_struct;
 
+/** Wakeup accounting for messages that no handler accepted */
+static mce_wakeup_owner_t *dbus_wakeup_unhandled = NULL;
+
+/** Wakeup accounting for name owner changes seen by owner monitors */
+static mce_wakeup_owner_t *dbus_wakeup_owner_changed = NULL;
+
+/** Handler whose callback is being executed, or NULL if it was removed */
+static handler_struct *msg_handler_current = NULL;
+
+/** D-Bus name owner monitor registry entry */
+typedef struct {
+	gchar *service;			/**< Monitored bus name */
+	gchar *match;			/**< D-Bus match for the name */
+	GSList *clients;		/**< owner_client_t items */
+} owner_monitor_t;
+
+/** Owner monitor client; the cookies in module monitor lists */
+typedef struct {
+	owner_monitor_t *monitor;	/**< Registry entry */
+	gboolean (*callback)(DBusMessage *const msg);	/**< Callback */
+	GSList **monitor_list;		/**< Module list holding the client */
+} owner_client_t;
+
+/** Owner monitor registry; bus name -> owner_monitor_t */
+static GHashTable *owner_monitors = NULL;
+
+/** Next client to be examined by owner_monitor_dispatch */
+static GSList *owner_dispatch_iter = NULL;
+
+/** Reference counts for D-Bus matches shared by handlers;
+ *  match string -> number of handlers using it */
+static GHashTable *dbus_match_refs = NULL;
+
 /** Pointer to the DBusConnection */
 static DBusConnection *dbus_connection = NULL;
 
@@ -240,6 +337,241 @@ EXIT:
 	return status;
 }
 
+/** Pending outgoing signal, one per path + interface + member */
+typedef struct {
+	gchar *key;			/**< Signal identity */
+	DBusMessage *pending;		/**< Latest unsent signal, or NULL */
+	gint64 last_sent;		/**< When the signal was last sent [ms] */
+	guint min_interval;		/**< Minimum send interval [ms] */
+	guint timer_id;			/**< GSource ID for delayed send */
+	gboolean queued;		/**< Whether slot is in signal_queue */
+	guint sent_count;		/**< Number of signals sent */
+	guint merged_count;		/**< Number of signals replaced by
+					 *   a later one before sending */
+} signal_slot_t;
+
+/** Outgoing signal slots; key -> signal_slot_t */
+static GHashTable *signal_slots = NULL;
+
+/** Slots with a pending signal, in order of first emission */
+static GQueue *signal_queue = NULL;
+
+/** GSource ID for flushing pending signals */
+static guint signal_flush_id = 0;
+
+/**
+ * Send the pending signal of a slot
+ *
+ * @param slot The signal slot
+ */
+static void signal_slot_send(signal_slot_t *slot)
+{
+	if (slot->pending == NULL)
+		goto EXIT;
+
+	(void)dbus_send_message(slot->pending), slot->pending = NULL;
+	slot->last_sent = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+	slot->sent_count++;
+
+EXIT:
+	return;
+}
+
+/**
+ * Timer callback for sending a rate limited signal
+ *
+ * @param data The signal slot
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean signal_slot_timer_cb(gpointer data)
+{
+	signal_slot_t *slot = data;
+
+	slot->timer_id = 0;
+	signal_slot_send(slot);
+
+	return FALSE;
+}
+
+/**
+ * Release a signal slot
+ *
+ * @param data The signal_slot_t to free
+ */
+static void signal_slot_free(gpointer data)
+{
+	signal_slot_t *slot = data;
+
+	if (slot->timer_id != 0)
+		g_source_remove(slot->timer_id);
+
+	if (slot->pending != NULL)
+		dbus_message_unref(slot->pending);
+
+	g_free(slot->key);
+	g_free(slot);
+}
+
+/**
+ * Send or schedule a signal queued during the last
+ * main loop iteration
+ *
+ * @param slot The signal slot
+ * @param now The current time [ms]
+ */
+static void signal_slot_flush(signal_slot_t *slot, gint64 now)
+{
+	gint64 due;
+
+	slot->queued = FALSE;
+
+	if ((slot->pending == NULL) || (slot->timer_id != 0))
+		goto EXIT;
+
+	due = slot->last_sent + slot->min_interval;
+
+	if ((slot->sent_count == 0) || (now >= due)) {
+		signal_slot_send(slot);
+	} else {
+		slot->timer_id = g_timeout_add((guint)(due - now),
+					       signal_slot_timer_cb, slot);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Idle callback for flushing pending signals
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the idle callback
+ */
+static gboolean signal_flush_cb(gpointer data)
+{
+	gint64 now = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+	signal_slot_t *slot;
+
+	(void)data;
+
+	signal_flush_id = 0;
+
+	if (signal_queue == NULL)
+		goto EXIT;
+
+	/* Send in emission order, so that clients see e.g.
+	 * display state changes and related signals the same
+	 * way as without coalescing */
+	while ((slot = g_queue_pop_head(signal_queue)) != NULL)
+		signal_slot_flush(slot, now);
+
+EXIT:
+
+	return FALSE;
+}
+
+/**
+ * Send a D-Bus signal, collapsing repeated broadcasts
+ * Side-effects: frees msg
+ *
+ * Signals are sent once the current main loop iteration is done,
+ * in the order they were first emitted; if the same signal is
+ * emitted again before that, the pending message is replaced in
+ * place and only the last one gets sent.  With min_interval the
+ * signal is additionally sent at most once per interval, the
+ * latest value winning.
+ * Messages other than signals are sent immediately.
+ *
+ * @param msg The D-Bus message to send
+ * @param min_interval Minimum interval between signals [ms], or 0
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean dbus_send_message_coalesced(DBusMessage *const msg,
+				     const guint min_interval)
+{
+	signal_slot_t *slot = NULL;
+	gchar *key = NULL;
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+		return dbus_send_message(msg);
+
+	key = g_strdup_printf("%s %s.%s",
+			      dbus_message_get_path(msg),
+			      dbus_message_get_interface(msg),
+			      dbus_message_get_member(msg));
+
+	if (signal_slots == NULL) {
+		signal_slots = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     NULL, signal_slot_free);
+		signal_queue = g_queue_new();
+	} else {
+		slot = g_hash_table_lookup(signal_slots, key);
+	}
+
+	if (slot == NULL) {
+		slot = g_new0(signal_slot_t, 1);
+		slot->key = key, key = NULL;
+		g_hash_table_insert(signal_slots, slot->key, slot);
+	}
+
+	slot->min_interval = min_interval;
+
+	if (slot->pending != NULL) {
+		dbus_message_unref(slot->pending);
+		slot->merged_count++;
+	}
+
+	slot->pending = msg;
+
+	/* Rate limited slots waiting for a timer are sent from
+	 * the timer callback; others keep their queue position */
+	if ((slot->queued == FALSE) && (slot->timer_id == 0)) {
+		g_queue_push_tail(signal_queue, slot);
+		slot->queued = TRUE;
+	}
+
+	if (signal_flush_id == 0)
+		signal_flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+						  signal_flush_cb, NULL,
+						  NULL);
+
+	g_free(key);
+
+	return TRUE;
+}
+
+/**
+ * Send all pending coalesced signals right away
+ */
+static void dbus_flush_coalesced_signals(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (signal_flush_id != 0)
+		g_source_remove(signal_flush_id), signal_flush_id = 0;
+
+	if (signal_slots == NULL)
+		goto EXIT;
+
+	/* Queued signals first, in emission order */
+	while ((value = g_queue_pop_head(signal_queue)) != NULL)
+		signal_slot_send(value);
+
+	g_queue_free(signal_queue), signal_queue = NULL;
+
+	/* Then whatever was waiting for rate limit timers */
+	g_hash_table_iter_init(&iter, signal_slots);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value) == TRUE)
+		signal_slot_send(value);
+
+	g_hash_table_destroy(signal_slots), signal_slots = NULL;
+
+EXIT:
+	return;
+}
+
 /**
  * Generic function to send D-Bus messages and signals
  * to send a signal, call dbus_send with service == NULL
@@ -442,140 +774,63 @@ EXIT:
 	return status;
 }
 
-/** Helper for appending gconf string list to dbus message
- *
- * @param conf GConfValue of string list type
- * @param pcount number of items in the returned array is stored here
- * @return array of string pointers that can be easily added to DBusMessage
- */
-static const char **string_array_from_gconf_value(GConfValue *conf, int *pcount)
-{
-	const char **array = 0;
-	int    count = 0;
-
-	GSList *list, *item;
-
-	if( conf->type != GCONF_VALUE_LIST )
-		goto EXIT;
-
-	if( gconf_value_get_list_type(conf) != GCONF_VALUE_STRING )
-		goto EXIT;
-
-	list = gconf_value_get_list(conf);
-
-	for( item = list; item; item = item->next )
-		++count;
-
-	array = g_malloc_n(count, sizeof *array);
-	count = 0;
-
-	for( item = list; item; item = item->next )
-		array[count++] = gconf_value_get_string(item->data);
-
-EXIT:
-	return *pcount = count, array;
-}
-
-/** Helper for appending gconf int list to dbus message
+/**
+ * D-Bus callback for the log verbosity set method call
  *
- * @param conf GConfValue of int list type
- * @param pcount number of items in the returned array is stored here
- * @return array of integers that can be easily added to DBusMessage
- */
-static dbus_int32_t *int_array_from_gconf_value(GConfValue *conf, int *pcount)
-{
-	dbus_int32_t *array = 0;
-	int           count = 0;
-
-	GSList *list, *item;
-
-	if( conf->type != GCONF_VALUE_LIST )
-		goto EXIT;
-
-	if( gconf_value_get_list_type(conf) != GCONF_VALUE_INT )
-		goto EXIT;
-
-	list = gconf_value_get_list(conf);
-
-	for( item = list; item; item = item->next )
-		++count;
-
-	array = g_malloc_n(count, sizeof *array);
-	count = 0;
-
-	for( item = list; item; item = item->next )
-		array[count++] = gconf_value_get_int(item->data);
-
-EXIT:
-	return *pcount = count, array;
-}
-
-/** Helper for appending gconf bool list to dbus message
+ * Takes a source file pattern and a verbosity; an empty pattern
+ * sets the global verbosity, and a negative verbosity removes the
+ * rule for the pattern
  *
- * @param conf GConfValue of bool list type
- * @param pcount number of items in the returned array is stored here
- * @return array of booleans that can be easily added to DBusMessage
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
  */
-static dbus_bool_t *bool_array_from_gconf_value(GConfValue *conf, int *pcount)
+static gboolean log_verbosity_set_dbus_cb(DBusMessage *const msg)
 {
-	dbus_bool_t *array = 0;
-	int          count = 0;
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	const char *pattern = NULL;
+	dbus_int32_t verbosity = 0;
+	DBusError error = DBUS_ERROR_INIT;
 
-	GSList *list, *item;
+	mce_log(LL_DEBUG, "Received log verbosity set request");
 
-	if( conf->type != GCONF_VALUE_LIST )
+	if (!dbus_message_get_args(msg, &error,
+				   DBUS_TYPE_STRING, &pattern,
+				   DBUS_TYPE_INT32, &verbosity,
+				   DBUS_TYPE_INVALID)) {
+		mce_log(LL_ERR, "%s: %s", error.name, error.message);
+		reply = dbus_message_new_error(msg, error.name, error.message);
 		goto EXIT;
+	}
 
-	if( gconf_value_get_list_type(conf) != GCONF_VALUE_BOOL )
+	if (*pattern == 0) {
+		mce_log_set_verbosity(CLAMP(verbosity, LL_NONE, LL_DEBUG));
+	} else if (!mce_log_set_file_verbosity(pattern, verbosity)) {
+		reply = dbus_message_new_error(msg, DBUS_ERROR_LIMITS_EXCEEDED,
+					       "too many log verbosity rules");
 		goto EXIT;
+	}
 
-	list = gconf_value_get_list(conf);
-
-	for( item = list; item; item = item->next )
-		++count;
-
-	array = g_malloc_n(count, sizeof *array);
-	count = 0;
+	mce_log(LL_NOTICE, "log verbosity for '%s' set to %d",
+		*pattern ? pattern : "*", verbosity);
 
-	for( item = list; item; item = item->next )
-		array[count++] = gconf_value_get_bool(item->data);
+	reply = dbus_new_method_reply(msg);
 
 EXIT:
-	return *pcount = count, array;
-}
-
-/** Helper for appending gconf float list to dbus message
- *
- * @param conf GConfValue of float list type
- * @param pcount number of items in the returned array is stored here
- * @return array of doubles that can be easily added to DBusMessage
- */
-static double *float_array_from_gconf_value(GConfValue *conf, int *pcount)
-{
-	double *array = 0;
-	int     count = 0;
-
-	GSList *list, *item;
-
-	if( conf->type != GCONF_VALUE_LIST )
-		goto EXIT;
-
-	if( gconf_value_get_list_type(conf) != GCONF_VALUE_FLOAT )
-		goto EXIT;
-
-	list = gconf_value_get_list(conf);
-
-	for( item = list; item; item = item->next )
-		++count;
-
-	array = g_malloc_n(count, sizeof *array);
-	count = 0;
+	/* Send a reply if we have one */
+	if (reply) {
+		if (dbus_message_get_no_reply(msg)) {
+			dbus_message_unref(reply), reply = 0;
+			status = TRUE;
+		} else {
+			/* dbus_send_message unrefs the reply message */
+			status = dbus_send_message(reply), reply = 0;
+		}
+	}
 
-	for( item = list; item; item = item->next )
-		array[count++] = gconf_value_get_float(item->data);
+	dbus_error_free(&error);
 
-EXIT:
-	return *pcount = count, array;
+	return status;
 }
 
 /** Helper for deducing what kind of array signature we need for a list value
@@ -623,26 +878,76 @@ static const char *value_signature(GConfValue *conf)
 	return 0;
 }
 
-/** Helper for appending GConfValue to dbus message
+/** Helper for appending a list element to dbus message iterator
  *
- * @param reply DBusMessage under construction
- * @param conf GConfValue to be added to the reply
+ * @param array Append iterator of an array container
+ * @param elem Non-complex GConfValue from a list
+ *
+ * @return TRUE if the element was succesfully appended, or FALSE on failure
+ */
+static gboolean append_gconf_element_to_iter(DBusMessageIter *array,
+					     GConfValue *elem)
+{
+	gboolean res = FALSE;
+
+	switch( elem->type ) {
+	case GCONF_VALUE_STRING:
+		{
+			const char *arg = gconf_value_get_string(elem) ?: "";
+			res = dbus_message_iter_append_basic(array,
+							     DBUS_TYPE_STRING,
+							     &arg);
+		}
+		break;
+	case GCONF_VALUE_INT:
+		{
+			dbus_int32_t arg = gconf_value_get_int(elem);
+			res = dbus_message_iter_append_basic(array,
+							     DBUS_TYPE_INT32,
+							     &arg);
+		}
+		break;
+	case GCONF_VALUE_FLOAT:
+		{
+			double arg = gconf_value_get_float(elem);
+			res = dbus_message_iter_append_basic(array,
+							     DBUS_TYPE_DOUBLE,
+							     &arg);
+		}
+		break;
+	case GCONF_VALUE_BOOL:
+		{
+			dbus_bool_t arg = gconf_value_get_bool(elem);
+			res = dbus_message_iter_append_basic(array,
+							     DBUS_TYPE_BOOLEAN,
+							     &arg);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return res;
+}
+
+/** Helper for appending GConfValue as variant to dbus message iterator
+ *
+ * @param body Append iterator of DBusMessage under construction
+ * @param conf GConfValue to be added to the message
  *
  * @return TRUE if the value was succesfully appended, or FALSE on failure
  */
-static gboolean append_gconf_value_to_dbus_message(DBusMessage *reply, GConfValue *conf)
+static gboolean append_gconf_value_to_iter(DBusMessageIter *body, GConfValue *conf)
 {
 	const char *sig = 0;
 
-	DBusMessageIter body, variant, array;
+	DBusMessageIter variant, array;
 
 	if( !(sig = value_signature(conf)) ) {
 		goto bailout_message;
 	}
 
-	dbus_message_iter_init_append(reply, &body);
-
-	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_VARIANT,
+	if( !dbus_message_iter_open_container(body, DBUS_TYPE_VARIANT,
 					      sig, &variant) ) {
 		goto bailout_message;
 	}
@@ -695,53 +1000,13 @@ static gboolean append_gconf_value_to_dbus_message(DBusMessage *reply, GConfValu
 			goto bailout_variant;
 		}
 
-		switch( gconf_value_get_list_type(conf) ) {
-		case GCONF_VALUE_STRING:
-			{
-				int          cnt = 0;
-				const char **arg = string_array_from_gconf_value(conf, &cnt);
-				for( int i = 0; i < cnt; ++i ) {
-					const char *str = arg[i];
-					dbus_message_iter_append_basic(&array,
-								       DBUS_TYPE_STRING,
-								       &str);
-				}
-				g_free(arg);
-			}
-			break;
-		case GCONF_VALUE_INT:
-			{
-				int           cnt = 0;
-				dbus_int32_t *arg = int_array_from_gconf_value(conf, &cnt);
-				dbus_message_iter_append_fixed_array(&array,
-								     DBUS_TYPE_INT32,
-								     &arg, cnt);
-				g_free(arg);
-			}
-			break;
-		case GCONF_VALUE_FLOAT:
-			{
-				int     cnt = 0;
-				double *arg = float_array_from_gconf_value(conf, &cnt);
-				dbus_message_iter_append_fixed_array(&array,
-								     DBUS_TYPE_DOUBLE,
-								     &arg, cnt);
-				g_free(arg);
-			}
-			break;
-		case GCONF_VALUE_BOOL:
-			{
-				int          cnt = 0;
-				dbus_bool_t *arg = bool_array_from_gconf_value(conf, &cnt);
-				dbus_message_iter_append_fixed_array(&array,
-								     DBUS_TYPE_BOOLEAN,
-								     &arg, cnt);
-				g_free(arg);
+		/* Append the elements straight from the stored list */
+		for( GSList *item = gconf_value_get_list(conf); item;
+		     item = item->next ) {
+			if( !append_gconf_element_to_iter(&array,
+							  item->data) ) {
+				goto bailout_array;
 			}
-			break;
-
-		default:
-			goto bailout_array;
 		}
 
 		if( !dbus_message_iter_close_container(&variant, &array) ) {
@@ -753,7 +1018,7 @@ static gboolean append_gconf_value_to_dbus_message(DBusMessage *reply, GConfValu
 		goto bailout_variant;
 	}
 
-	if( !dbus_message_iter_close_container(&body, &variant) ) {
+	if( !dbus_message_iter_close_container(body, &variant) ) {
 		goto bailout_message;
 	}
 	return TRUE;
@@ -762,34 +1027,85 @@ bailout_array:
 	dbus_message_iter_abandon_container(&variant, &array);
 
 bailout_variant:
-	dbus_message_iter_abandon_container(&body, &variant);
+	dbus_message_iter_abandon_container(body, &variant);
 
 bailout_message:
 	return FALSE;
 }
 
-/**
- * D-Bus callback for the config get method call
+/** Helper for appending GConfValue to dbus message
  *
- * @param msg The D-Bus message to reply to
+ * @param reply DBusMessage under construction
+ * @param conf GConfValue to be added to the reply
  *
- * @return TRUE if reply message was successfully sent, FALSE on failure
+ * @return TRUE if the value was succesfully appended, or FALSE on failure
  */
-static gboolean config_get_dbus_cb(DBusMessage *const msg)
+static gboolean append_gconf_value_to_dbus_message(DBusMessage *reply, GConfValue *conf)
 {
-	gboolean status = FALSE;
-	DBusMessage *reply = NULL;
-	const char *key = NULL;
-	GError *err = NULL;
-	GConfValue *conf = 0;
+	DBusMessageIter body;
 
-	DBusError error = DBUS_ERROR_INIT;
+	dbus_message_iter_init_append(reply, &body);
 
-	mce_log(LL_DEBUG, "Received configuration query request");
+	return append_gconf_value_to_iter(&body, conf);
+}
 
-	if( !dbus_message_get_args(msg, &error,
-				   DBUS_TYPE_OBJECT_PATH, &key,
-				   DBUS_TYPE_INVALID) )	{
+/** Helper for appending key and GConfValue as a dict entry
+ *
+ * @param dict Append iterator for an a{sv} array
+ * @param key GConf key
+ * @param conf GConfValue to be added to the dictionary
+ *
+ * @return TRUE if the entry was succesfully appended, or FALSE on failure
+ */
+static gboolean append_gconf_entry_to_dict(DBusMessageIter *dict,
+					   const char *key, GConfValue *conf)
+{
+	DBusMessageIter entry;
+
+	if( !dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+					      0, &entry) )
+		goto bailout_dict;
+
+	if( !dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key) )
+		goto bailout_entry;
+
+	if( !append_gconf_value_to_iter(&entry, conf) )
+		goto bailout_entry;
+
+	if( !dbus_message_iter_close_container(dict, &entry) )
+		goto bailout_dict;
+
+	return TRUE;
+
+bailout_entry:
+	dbus_message_iter_abandon_container(dict, &entry);
+
+bailout_dict:
+	return FALSE;
+}
+
+/**
+ * D-Bus callback for the config get method call
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean config_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	const char *key = NULL;
+	GError *err = NULL;
+	GConfValue *conf = 0;
+
+	DBusError error = DBUS_ERROR_INIT;
+
+	mce_log(LL_DEBUG, "Received configuration query request");
+
+	if( !dbus_message_get_args(msg, &error,
+				   DBUS_TYPE_OBJECT_PATH, &key,
+				   DBUS_TYPE_INVALID) )	{
 		mce_log(LL_ERR, "%s: %s", error.name, error.message);
 		reply = dbus_message_new_error(msg, error.name, error.message);
 		goto EXIT;
@@ -834,15 +1150,6 @@ EXIT:
 	return status;
 }
 
-/** Release GSList of GConfValue objects
- *
- * @param list GSList where item->data members are pointers to GConfValue
- */
-static void value_list_free(GSList *list)
-{
-  g_slist_free_full(list, (GDestroyNotify)gconf_value_free);
-}
-
 /** Convert D-Bus string array into GSList of GConfValue objects
  *
  * @param iter D-Bus message iterator at DBUS_TYPE_ARRAY
@@ -875,6 +1182,8 @@ static GSList *value_list_from_string_array(DBusMessageIter *iter)
 }
 
 /** Convert D-Bus int32 array into GSList of GConfValue objects
+ *
+ * The array is read in place from the message buffer
  *
  * @param iter D-Bus message iterator at DBUS_TYPE_ARRAY
  * @return GSList where item->data members are pointers to GConfValue
@@ -882,30 +1191,29 @@ static GSList *value_list_from_string_array(DBusMessageIter *iter)
 static GSList *value_list_from_int_array(DBusMessageIter *iter)
 {
 	GSList *res = 0;
+	const dbus_int32_t *arr = 0;
+	int cnt = 0;
 
 	DBusMessageIter subiter;
 
 	dbus_message_iter_recurse(iter, &subiter);
+	dbus_message_iter_get_fixed_array(&subiter, &arr, &cnt);
 
-	int i = 0;
-	while ( dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_INT32 ) {
-		dbus_int32_t tmp = 0;
-		dbus_message_iter_get_basic(&subiter, &tmp);
-		dbus_message_iter_next(&subiter);
-
-		mce_log(LL_INFO, "arr[%d] = int:%d", i++, tmp);
+	/* Build from the tail so that no reversing is needed */
+	for( int i = cnt - 1; i >= 0; --i ) {
+		mce_log(LL_INFO, "arr[%d] = int:%d", i, arr[i]);
 
 		GConfValue *value = gconf_value_new(GCONF_VALUE_INT);
-		gconf_value_set_int(value, tmp);
+		gconf_value_set_int(value, arr[i]);
 		res = g_slist_prepend(res, value);
 	}
 
-	res = g_slist_reverse(res);
-
 	return res;
 }
 
 /** Convert D-Bus bool array into GSList of GConfValue objects
+ *
+ * The array is read in place from the message buffer
  *
  * @param iter D-Bus message iterator at DBUS_TYPE_ARRAY
  * @return GSList where item->data members are pointers to GConfValue
@@ -913,30 +1221,29 @@ static GSList *value_list_from_int_array(DBusMessageIter *iter)
 static GSList *value_list_from_bool_array(DBusMessageIter *iter)
 {
 	GSList *res = 0;
+	const dbus_bool_t *arr = 0;
+	int cnt = 0;
 
 	DBusMessageIter subiter;
 
 	dbus_message_iter_recurse(iter, &subiter);
+	dbus_message_iter_get_fixed_array(&subiter, &arr, &cnt);
 
-	int i = 0;
-	while ( dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_BOOLEAN ) {
-		dbus_bool_t tmp = 0;
-		dbus_message_iter_get_basic(&subiter, &tmp);
-		dbus_message_iter_next(&subiter);
-
-		mce_log(LL_INFO, "arr[%d] = bool:%s", i++, tmp ? "true" : "false");
+	/* Build from the tail so that no reversing is needed */
+	for( int i = cnt - 1; i >= 0; --i ) {
+		mce_log(LL_INFO, "arr[%d] = bool:%s", i, arr[i] ? "true" : "false");
 
 		GConfValue *value = gconf_value_new(GCONF_VALUE_BOOL);
-		gconf_value_set_bool(value, tmp);
+		gconf_value_set_bool(value, arr[i]);
 		res = g_slist_prepend(res, value);
 	}
 
-	res = g_slist_reverse(res);
-
 	return res;
 }
 
 /** Convert D-Bus double array into GSList of GConfValue objects
+ *
+ * The array is read in place from the message buffer
  *
  * @param iter D-Bus message iterator at DBUS_TYPE_ARRAY
  * @return GSList where item->data members are pointers to GConfValue
@@ -944,26 +1251,138 @@ static GSList *value_list_from_bool_array(DBusMessageIter *iter)
 static GSList *value_list_from_float_array(DBusMessageIter *iter)
 {
 	GSList *res = 0;
+	const double *arr = 0;
+	int cnt = 0;
 
 	DBusMessageIter subiter;
 
 	dbus_message_iter_recurse(iter, &subiter);
+	dbus_message_iter_get_fixed_array(&subiter, &arr, &cnt);
 
-	int i = 0;
-	while ( dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_DOUBLE ) {
-		double tmp = 0;
-		dbus_message_iter_get_basic(&subiter, &tmp);
-		dbus_message_iter_next(&subiter);
-
-		mce_log(LL_INFO, "arr[%d] = float:%g", i++, tmp);
+	/* Build from the tail so that no reversing is needed */
+	for( int i = cnt - 1; i >= 0; --i ) {
+		mce_log(LL_INFO, "arr[%d] = float:%g", i, arr[i]);
 
 		GConfValue *value = gconf_value_new(GCONF_VALUE_FLOAT);
-		gconf_value_set_float(value, tmp);
+		gconf_value_set_float(value, arr[i]);
 		res = g_slist_prepend(res, value);
 	}
 
-	res = g_slist_reverse(res);
+	return res;
+}
+
+#ifndef ENABLE_BUILTIN_GCONF
+/** Release GSList of GConfValue objects
+ *
+ * @param list GSList where item->data members are pointers to GConfValue
+ */
+static void value_list_free(GSList *list)
+{
+  g_slist_free_full(list, (GDestroyNotify)gconf_value_free);
+}
+#endif
+
+/** Helper for storing a list decoded from D-Bus
+ *
+ * With builtin-gconf the list is handed over as is, otherwise
+ * it is copied by GConf and released here
+ *
+ * @param client GConf client
+ * @param key GConf key to set
+ * @param list_type Type of the list elements
+ * @param list GSList of GConfValue objects; always consumed
+ * @param err Where to store GConf errors
+ */
+static void config_set_list(GConfClient *client, const char *key,
+			    GConfValueType list_type, GSList *list,
+			    GError **err)
+{
+#ifdef ENABLE_BUILTIN_GCONF
+	gconf_client_set_list_nocopy(client, key, list_type, list, err);
+#else
+	gconf_client_set_list(client, key, list_type, list, err);
+	value_list_free(list);
+#endif
+}
+
+/** Helper for setting GConf value from D-Bus message iterator
+ *
+ * @param client GConf client
+ * @param key GConf key to set
+ * @param iter D-Bus message iterator pointing to the value
+ * @param err Where to store GConf errors
+ *
+ * @return NULL if the value type was acceptable, or
+ *         a description of the problem
+ */
+static const char *config_set_value_from_iter(GConfClient *client,
+					      const char *key,
+					      DBusMessageIter *iter,
+					      GError **err)
+{
+	const char *res = 0;
+
+	switch( dbus_message_iter_get_arg_type(iter) ) {
+	case DBUS_TYPE_BOOLEAN:
+		{
+			dbus_bool_t arg = 0;
+			dbus_message_iter_get_basic(iter, &arg);
+			gconf_client_set_bool(client, key, arg, err);
+		}
+		break;
+	case DBUS_TYPE_INT32:
+		{
+			dbus_int32_t arg = 0;
+			dbus_message_iter_get_basic(iter, &arg);
+			gconf_client_set_int(client, key, arg, err);
+		}
+		break;
+	case DBUS_TYPE_DOUBLE:
+		{
+			double arg = 0;
+			dbus_message_iter_get_basic(iter, &arg);
+			gconf_client_set_float(client, key, arg, err);
+		}
+		break;
+	case DBUS_TYPE_STRING:
+		{
+			const char *arg = 0;
+			dbus_message_iter_get_basic(iter, &arg);
+			gconf_client_set_string(client, key, arg, err);
+		}
+		break;
+
+	case DBUS_TYPE_ARRAY:
+		switch( dbus_message_iter_get_element_type(iter) ) {
+		case DBUS_TYPE_BOOLEAN:
+			config_set_list(client, key, GCONF_VALUE_BOOL,
+					value_list_from_bool_array(iter), err);
+			break;
+		case DBUS_TYPE_INT32:
+			config_set_list(client, key, GCONF_VALUE_INT,
+					value_list_from_int_array(iter), err);
+			break;
+		case DBUS_TYPE_DOUBLE:
+			config_set_list(client, key, GCONF_VALUE_FLOAT,
+					value_list_from_float_array(iter), err);
+			break;
+		case DBUS_TYPE_STRING:
+			config_set_list(client, key, GCONF_VALUE_STRING,
+					value_list_from_string_array(iter), err);
+			break;
+		default:
+			res = "unexpected value array type";
+			goto EXIT;
+
+		}
+		break;
+
+	default:
+		res = "unexpected value type";
+		goto EXIT;
+	}
 
+EXIT:
 	return res;
 }
 
@@ -981,7 +1400,7 @@ static gboolean config_set_dbus_cb(DBusMessage *const msg)
 	const char *key = NULL;
 	GError *err = NULL;
 	GConfClient *client = 0;
-	GSList *list = 0;
+	const char *invalid = 0;
 
 	DBusError error = DBUS_ERROR_INIT;
 	DBusMessageIter body, iter;
@@ -1018,65 +1437,9 @@ static gboolean config_set_dbus_cb(DBusMessage *const msg)
 		goto EXIT;
 	}
 
-	switch( dbus_message_iter_get_arg_type(&iter) ) {
-	case DBUS_TYPE_BOOLEAN:
-		{
-			dbus_bool_t arg = 0;
-			dbus_message_iter_get_basic(&iter, &arg);
-			gconf_client_set_bool(client, key, arg, &err);
-		}
-		break;
-	case DBUS_TYPE_INT32:
-		{
-			dbus_int32_t arg = 0;
-			dbus_message_iter_get_basic(&iter, &arg);
-			gconf_client_set_int(client, key, arg, &err);
-		}
-		break;
-	case DBUS_TYPE_DOUBLE:
-		{
-			double arg = 0;
-			dbus_message_iter_get_basic(&iter, &arg);
-			gconf_client_set_float(client, key, arg, &err);
-		}
-		break;
-	case DBUS_TYPE_STRING:
-		{
-			const char *arg = 0;
-			dbus_message_iter_get_basic(&iter, &arg);
-			gconf_client_set_string(client, key, arg, &err);
-		}
-		break;
-
-	case DBUS_TYPE_ARRAY:
-		switch( dbus_message_iter_get_element_type(&iter) ) {
-		case DBUS_TYPE_BOOLEAN:
-			list = value_list_from_bool_array(&iter);
-			gconf_client_set_list(client, key, GCONF_VALUE_BOOL, list, &err);
-			break;
-		case DBUS_TYPE_INT32:
-			list = value_list_from_int_array(&iter);
-			gconf_client_set_list(client, key, GCONF_VALUE_INT, list, &err);
-			break;
-		case DBUS_TYPE_DOUBLE:
-			list = value_list_from_float_array(&iter);
-			gconf_client_set_list(client, key, GCONF_VALUE_FLOAT, list, &err);
-			break;
-		case DBUS_TYPE_STRING:
-			list = value_list_from_string_array(&iter);
-			gconf_client_set_list(client, key, GCONF_VALUE_STRING, list, &err);
-			break;
-		default:
-			reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
-						       "unexpected value array type");
-			goto EXIT;
-
-		}
-		break;
-
-	default:
+	if( (invalid = config_set_value_from_iter(client, key, &iter, &err)) ) {
 		reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
-					       "unexpected value type");
+					       invalid);
 		goto EXIT;
 	}
 
@@ -1095,119 +1458,1709 @@ static gboolean config_set_dbus_cb(DBusMessage *const msg)
 		mce_log(LL_ERR, "gconf_client_suggest_sync: %s", err->message);
 	}
 
-	if( !(reply = dbus_new_method_reply(msg)) )
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	/* it is either error reply or true, and we got here... */
+	{
+		dbus_bool_t arg = TRUE;
+		dbus_message_append_args(reply,
+					 DBUS_TYPE_BOOLEAN, &arg,
+					 DBUS_TYPE_INVALID);
+	}
+
+EXIT:
+	/* Send a reply if we have one */
+	if( reply ) {
+		if( dbus_message_get_no_reply(msg) ) {
+			dbus_message_unref(reply), reply = 0;
+			status = TRUE;
+		}
+		else {
+			/* dbus_send_message unrefs the reply message */
+			status = dbus_send_message(reply), reply = 0;
+		}
+	}
+
+	g_clear_error(&err);
+	dbus_error_free(&error);
+
+
+	return status;
+}
+
+/** Helper for appending all GConf entries under a directory to a dict
+ *
+ * @param client GConf client
+ * @param dict Append iterator for an a{sv} array
+ * @param dir GConf directory to traverse recursively
+ *
+ * @return TRUE if all entries were succesfully appended, or FALSE on failure
+ */
+static gboolean append_gconf_dir_to_dict(GConfClient *client,
+					 DBusMessageIter *dict,
+					 const char *dir)
+{
+	gboolean res = FALSE;
+	GError *err = NULL;
+	GSList *entries = 0;
+	GSList *dirs = 0;
+
+	entries = gconf_client_all_entries(client, dir, &err);
+	if( err ) {
+		mce_log(LL_ERR, "%s: %s", dir, err->message);
+		goto EXIT;
+	}
+
+	for( GSList *item = entries; item; item = item->next ) {
+		GConfEntry *entry = item->data;
+		GConfValue *conf = gconf_entry_get_value(entry);
+
+		/* Skip unset keys and value types we do not export */
+		if( !conf || !value_signature(conf) )
+			continue;
+
+		if( !append_gconf_entry_to_dict(dict,
+						gconf_entry_get_key(entry),
+						conf) )
+			goto EXIT;
+	}
+
+	dirs = gconf_client_all_dirs(client, dir, &err);
+	if( err ) {
+		mce_log(LL_ERR, "%s: %s", dir, err->message);
+		goto EXIT;
+	}
+
+	for( GSList *item = dirs; item; item = item->next ) {
+		if( !append_gconf_dir_to_dict(client, dict, item->data) )
+			goto EXIT;
+	}
+
+	res = TRUE;
+
+EXIT:
+	g_slist_free_full(dirs, g_free);
+	g_slist_free_full(entries, (GDestroyNotify)gconf_entry_free);
+	g_clear_error(&err);
+
+	return res;
+}
+
+/**
+ * D-Bus callback for the config get all method call
+ *
+ * Replies with all configuration values as a key to variant
+ * dictionary, so that clients do not need to make one round
+ * trip per setting
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean config_get_all_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	GConfClient *client = 0;
+
+	DBusMessageIter body, dict;
+
+	mce_log(LL_DEBUG, "Received configuration dump request");
+
+	if( !(client = gconf_client_get_default()) )
+		goto EXIT;
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					      DBUS_TYPE_STRING_AS_STRING
+					      DBUS_TYPE_VARIANT_AS_STRING
+					      DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					      &dict) )
+		goto FAILED;
+
+	if( !append_gconf_dir_to_dict(client, &dict, "/") ) {
+		dbus_message_iter_abandon_container(&body, &dict);
+		goto FAILED;
+	}
+
+	if( !dbus_message_iter_close_container(&body, &dict) )
+		goto FAILED;
+
+	goto EXIT;
+
+FAILED:
+	dbus_message_unref(reply);
+	reply = dbus_message_new_error(msg,
+				       "com.nokia.mce.GConf.Error",
+				       "constructing reply failed");
+
+EXIT:
+	/* Send a reply if we have one */
+	if( reply ) {
+		if( dbus_message_get_no_reply(msg) ) {
+			dbus_message_unref(reply), reply = 0;
+			status = TRUE;
+		}
+		else {
+			/* dbus_send_message unrefs the reply message */
+			status = dbus_send_message(reply), reply = 0;
+		}
+	}
+
+	return status;
+}
+
+/**
+ * D-Bus callback for the config get multiple method call
+ *
+ * Replies with a key to variant dictionary holding values for
+ * the requested keys; keys that do not exist are left out
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean config_get_multi_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	GConfClient *client = 0;
+	char **keys = 0;
+	int count = 0;
+
+	DBusError error = DBUS_ERROR_INIT;
+	DBusMessageIter body, dict;
+
+	mce_log(LL_DEBUG, "Received multiple configuration query request");
+
+	if( !dbus_message_get_args(msg, &error,
+				   DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+				   &keys, &count,
+				   DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "%s: %s", error.name, error.message);
+		reply = dbus_message_new_error(msg, error.name, error.message);
+		goto EXIT;
+	}
+
+	if( !(client = gconf_client_get_default()) )
+		goto EXIT;
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					      DBUS_TYPE_STRING_AS_STRING
+					      DBUS_TYPE_VARIANT_AS_STRING
+					      DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					      &dict) )
+		goto FAILED;
+
+	for( int i = 0; i < count; ++i ) {
+		GError *err = NULL;
+		GConfValue *conf = gconf_client_get(client, keys[i], &err);
+		gboolean ok = TRUE;
+
+		if( conf ) {
+			if( value_signature(conf) )
+				ok = append_gconf_entry_to_dict(&dict, keys[i],
+								conf);
+			gconf_value_free(conf);
+		}
+		else {
+			mce_log(LL_DEBUG, "%s: %s", keys[i],
+				err ? err->message : "unknown");
+		}
+		g_clear_error(&err);
+
+		if( !ok ) {
+			dbus_message_iter_abandon_container(&body, &dict);
+			goto FAILED;
+		}
+	}
+
+	if( !dbus_message_iter_close_container(&body, &dict) )
+		goto FAILED;
+
+	goto EXIT;
+
+FAILED:
+	dbus_message_unref(reply);
+	reply = dbus_message_new_error(msg,
+				       "com.nokia.mce.GConf.Error",
+				       "constructing reply failed");
+
+EXIT:
+	/* Send a reply if we have one */
+	if( reply ) {
+		if( dbus_message_get_no_reply(msg) ) {
+			dbus_message_unref(reply), reply = 0;
+			status = TRUE;
+		}
+		else {
+			/* dbus_send_message unrefs the reply message */
+			status = dbus_send_message(reply), reply = 0;
+		}
+	}
+
+	dbus_free_string_array(keys);
+	dbus_error_free(&error);
+
+	return status;
+}
+
+/**
+ * D-Bus callback for the config set multiple method call
+ *
+ * Applies all values from a key to variant dictionary and
+ * syncs the configuration only once; replies either TRUE or
+ * an error listing the keys that could not be set
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean config_set_multi_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	GError *err = NULL;
+	GConfClient *client = 0;
+	GString *failed = 0;
+	gboolean changed = FALSE;
+
+	DBusMessageIter body, dict;
+
+	mce_log(LL_DEBUG, "Received multiple configuration change request");
+
+	if( !(client = gconf_client_get_default()) )
+		goto EXIT;
+
+	dbus_message_iter_init(msg, &body);
+
+	if( dbus_message_iter_get_arg_type(&body) != DBUS_TYPE_ARRAY ||
+	    dbus_message_iter_get_element_type(&body) != DBUS_TYPE_DICT_ENTRY ) {
+		reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+					       "expected key to variant dictionary");
+		goto EXIT;
+	}
+	dbus_message_iter_recurse(&body, &dict);
+
+	failed = g_string_new(0);
+
+	while( dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY ) {
+		const char *key = 0;
+		const char *invalid = 0;
+
+		DBusMessageIter entry, iter;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_next(&dict);
+
+		if( dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING )
+			continue;
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+
+		if( dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT ) {
+			invalid = "expected variant";
+		}
+		else {
+			dbus_message_iter_recurse(&entry, &iter);
+			invalid = config_set_value_from_iter(client, key,
+							     &iter, &err);
+		}
+
+		if( invalid || err ) {
+			mce_log(LL_WARN, "%s: %s", key,
+				invalid ?: err->message ?: "unknown");
+			g_string_append_printf(failed, "%s%s",
+					       failed->len ? ", " : "", key);
+			g_clear_error(&err);
+		}
+		else {
+			changed = TRUE;
+		}
+	}
+
+	if( changed ) {
+		/* we changed something */
+		gconf_client_suggest_sync(client, &err);
+		if( err ) {
+			mce_log(LL_ERR, "gconf_client_suggest_sync: %s",
+				err->message);
+		}
+	}
+
+	if( failed->len ) {
+		g_string_prepend(failed, "failed to set: ");
+		reply = dbus_message_new_error(msg,
+					       "com.nokia.mce.GConf.Error",
+					       failed->str);
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	{
+		dbus_bool_t arg = TRUE;
+		dbus_message_append_args(reply,
+					 DBUS_TYPE_BOOLEAN, &arg,
+					 DBUS_TYPE_INVALID);
+	}
+
+EXIT:
+	/* Send a reply if we have one */
+	if( reply ) {
+		if( dbus_message_get_no_reply(msg) ) {
+			dbus_message_unref(reply), reply = 0;
+			status = TRUE;
+		}
+		else {
+			/* dbus_send_message unrefs the reply message */
+			status = dbus_send_message(reply), reply = 0;
+		}
+	}
+
+	if( failed )
+		g_string_free(failed, TRUE);
+
+	g_clear_error(&err);
+
+	return status;
+}
+
+/** Append execution statistics of one datapipe to a D-Bus message
+ *
+ * @param datapipe The datapipe to report
+ * @param user_data Array iterator (as a void pointer)
+ */
+static void datapipe_stats_append_cb(const datapipe_struct *const datapipe,
+				     gpointer user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter  item, hist;
+
+	const datapipe_stats_t *stats = &datapipe->stats;
+	const char    *name    = datapipe_get_name(*datapipe);
+	dbus_uint32_t  execs   = stats->exec_count;
+	dbus_uint32_t  trigs   = stats->trigger_count;
+	dbus_uint32_t  skipped = datapipe_get_skipped_count(*datapipe);
+	dbus_uint64_t  f_time  = stats->filter_time;
+	dbus_uint64_t  t_time  = stats->trigger_time;
+	dbus_uint64_t  m_time  = stats->max_time;
+	dbus_uint32_t  merged  = stats->coalesced_count;
+	dbus_uint32_t  bucket;
+
+	int i;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &execs);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &trigs);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &skipped);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &f_time);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &t_time);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &m_time);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &merged);
+
+	dbus_message_iter_open_container(&item, DBUS_TYPE_ARRAY,
+					 DBUS_TYPE_UINT32_AS_STRING, &hist);
+	for( i = 0; i < DATAPIPE_HISTOGRAM_BUCKETS; ++i ) {
+		bucket = stats->histogram[i];
+		dbus_message_iter_append_basic(&hist, DBUS_TYPE_UINT32,
+					       &bucket);
+	}
+	dbus_message_iter_close_container(&item, &hist);
+
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the datapipe statistics get method call
+ *
+ * Reply is an array of (name, executions, trigger calls,
+ * suppressed executions, filter time [us], trigger time [us],
+ * slowest execution [us], coalesced deferred executions,
+ * latency histogram) structures
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean datapipe_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+
+	mce_log(LL_DEBUG, "Received datapipe statistics request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(suuutttuau)", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_DATAPIPE_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	datapipe_foreach(datapipe_stats_append_cb, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/** Append the accounting of one I/O monitor to a D-Bus message
+ *
+ * @param file The monitored file
+ * @param wakeups Number of times the monitor has been serviced
+ * @param bytes Number of bytes read
+ * @param time Time spent servicing the monitor [us]
+ * @param user_data Array iterator (as a void pointer)
+ */
+static void iomon_stats_append_cb(const gchar *file, guint wakeups,
+				  guint64 bytes, guint64 time,
+				  gpointer user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter  item;
+
+	const char    *name  = file ?: "";
+	dbus_uint32_t  count = wakeups;
+	dbus_uint64_t  size  = bytes;
+	dbus_uint64_t  used  = time;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &count);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &size);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &used);
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the I/O monitor statistics get method call
+ *
+ * Reply is an array of (file, wakeups, bytes read,
+ * servicing time [us]) structures
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean iomon_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+
+	mce_log(LL_DEBUG, "Received I/O monitor statistics request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(sutt)", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_IOMON_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	mce_io_monitor_stats_foreach(iomon_stats_append_cb, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/** Append the wakeup accounting of one mainloop owner to a D-Bus message
+ *
+ * @param owner The owner of the dispatched sources
+ * @param wakeups Number of mainloop wakeups caused by the owner
+ * @param dispatches Number of times the owner has been dispatched
+ * @param time Time spent in the dispatches [us]
+ * @param user_data Array iterator (as a void pointer)
+ */
+static void wakeup_stats_append_cb(const gchar *owner, guint wakeups,
+				   guint dispatches, guint64 time,
+				   gpointer user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter  item;
+
+	const char    *name  = owner ?: "";
+	dbus_uint32_t  woken = wakeups;
+	dbus_uint32_t  calls = dispatches;
+	dbus_uint64_t  used  = time;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &woken);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &calls);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &used);
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the mainloop wakeup statistics get method call
+ *
+ * Reply is an array of (owner, wakeups, dispatches,
+ * dispatch time [us]) structures
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean wakeup_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+
+	mce_log(LL_DEBUG, "Received mainloop wakeup statistics request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(suut)", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_WAKEUP_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	mce_wakeup_stats_foreach(wakeup_stats_append_cb, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/** Append the memory accounting of one owner to a D-Bus message
+ *
+ * @param owner The owner of the allocations
+ * @param count Number of live allocations
+ * @param bytes Size of the live allocations [bytes]
+ * @param peak Peak size of the live allocations [bytes]
+ * @param user_data Array iterator (as a void pointer)
+ */
+static void memory_stats_append_cb(const gchar *owner, guint count,
+				   gsize bytes, gsize peak,
+				   gpointer user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter  item;
+
+	const char    *name  = owner ?: "";
+	dbus_uint32_t  live  = count;
+	dbus_uint64_t  size  = bytes;
+	dbus_uint64_t  high  = peak;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &live);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &size);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &high);
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the memory statistics get method call
+ *
+ * Reply is the resident set size [kB], the peak resident set
+ * size [kB] and an array of (owner, live allocations,
+ * live bytes, peak bytes) structures
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean memory_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+	guint rss_kb, peak_kb;
+	dbus_uint32_t rss, peak;
+
+	mce_log(LL_DEBUG, "Received memory statistics request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	/* Zeros are reported if /proc is not available */
+	mce_memstat_get_rss(&rss_kb, &peak_kb);
+	rss = rss_kb;
+	peak = peak_kb;
+
+	dbus_message_iter_init_append(reply, &body);
+	dbus_message_iter_append_basic(&body, DBUS_TYPE_UINT32, &rss);
+	dbus_message_iter_append_basic(&body, DBUS_TYPE_UINT32, &peak);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(sutt)", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_MEMORY_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	mce_memstat_foreach(memory_stats_append_cb, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/** Append one datapipe execution trace entry to a D-Bus message
+ *
+ * @param time Execution time [us]
+ * @param name Name of the executed datapipe
+ * @param value Indata of the execution
+ * @param user_data Array iterator (as a void pointer)
+ */
+static void datapipe_trace_append_cb(guint64 time, const gchar *name,
+				     gint value, gpointer user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter  item;
+
+	dbus_uint64_t t = time;
+	dbus_int32_t  v = value;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &t);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_INT32, &v);
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the datapipe execution trace get method call
+ *
+ * Reply is an array of (time [us], datapipe name, value) structures,
+ * oldest first
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean datapipe_trace_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+
+	mce_log(LL_DEBUG, "Received datapipe trace request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(tsi)", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_DATAPIPE_TRACE_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	datapipe_trace_foreach(datapipe_trace_append_cb, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/** Sender name and call count pair for handler statistics reports */
+typedef struct {
+	const char *sender;		/**< Sender bus name */
+	guint count;			/**< Number of calls */
+} sender_count_t;
+
+/**
+ * Compare sender_count_t items for sorting in descending call count order
+ *
+ * @param a First sender_count_t
+ * @param b Second sender_count_t
+ * @return <0, 0 or >0 like strcmp()
+ */
+static gint sender_count_compare(gconstpointer a, gconstpointer b)
+{
+	const sender_count_t *sa = a;
+	const sender_count_t *sb = b;
+
+	return (sa->count < sb->count) - (sa->count > sb->count);
+}
+
+/** Append statistics of one D-Bus handler to a D-Bus message
+ *
+ * @param h The handler to report
+ * @param array Array iterator
+ */
+static void handler_stats_append(const handler_struct *h,
+				 DBusMessageIter *array)
+{
+	DBusMessageIter item, top, pair;
+	GArray *senders = g_array_new(FALSE, FALSE, sizeof(sender_count_t));
+
+	const char    *interface = h->interface ?: "";
+	const char    *name      = h->name ?: "";
+	dbus_uint32_t  type      = h->type;
+	dbus_uint32_t  calls     = h->call_count;
+	dbus_uint64_t  t_time    = h->total_time;
+	dbus_uint64_t  m_time    = h->max_time;
+
+	guint i;
+
+	if (h->senders != NULL) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init(&iter, h->senders);
+
+		while (g_hash_table_iter_next(&iter, &key, &value) == TRUE) {
+			sender_count_t sc = { key, GPOINTER_TO_UINT(value) };
+			g_array_append_val(senders, sc);
+		}
+
+		g_array_sort(senders, sender_count_compare);
+	}
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &interface);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &type);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &calls);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &t_time);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &m_time);
+
+	dbus_message_iter_open_container(&item, DBUS_TYPE_ARRAY, "(su)", &top);
+	for (i = 0; i < senders->len && i < HANDLER_STATS_TOP_SENDERS; i++) {
+		sender_count_t *sc = &g_array_index(senders, sender_count_t, i);
+		dbus_uint32_t count = sc->count;
+
+		dbus_message_iter_open_container(&top, DBUS_TYPE_STRUCT,
+						 0, &pair);
+		dbus_message_iter_append_basic(&pair, DBUS_TYPE_STRING,
+					       &sc->sender);
+		dbus_message_iter_append_basic(&pair, DBUS_TYPE_UINT32,
+					       &count);
+		dbus_message_iter_close_container(&top, &pair);
+	}
+	dbus_message_iter_close_container(&item, &top);
+
+	dbus_message_iter_close_container(array, &item);
+
+	g_array_free(senders, TRUE);
+}
+
+/**
+ * D-Bus callback for the D-Bus handler statistics get method call
+ *
+ * Reply is an array of (interface, name, message type, calls,
+ * total callback time [us], slowest callback [us], top senders)
+ * structures; top senders is an array of (sender, calls) pairs
+ * with the busiest sender first
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean handler_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+	GSList *item;
+
+	mce_log(LL_DEBUG, "Received D-Bus handler statistics request");
+
+	if( dbus_message_get_no_reply(msg) ) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(ssuutta(su))", &array) ) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_DBUS_HANDLER_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	for( item = dbus_handlers; item; item = item->next )
+		handler_stats_append(item->data, &array);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Add a reference to a D-Bus match
+ *
+ * Handlers with identical matches share one registration
+ * with the D-Bus daemon
+ *
+ * @param match The match to add
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean dbus_match_ref(const gchar *match)
+{
+	gboolean status = FALSE;
+	guint refs = 0;
+	DBusError error;
+
+	/* Register error channel */
+	dbus_error_init(&error);
+
+	if (dbus_match_refs == NULL) {
+		/* Keys are interned match strings */
+		dbus_match_refs = g_hash_table_new(g_str_hash, g_str_equal);
+	} else {
+		refs = GPOINTER_TO_UINT(g_hash_table_lookup(dbus_match_refs,
+							    match));
+	}
+
+	if (refs == 0) {
+		dbus_bus_add_match(dbus_connection, match, &error);
+
+		if (dbus_error_is_set(&error) == TRUE) {
+			mce_log(LL_CRIT,
+				"Failed to add D-Bus match '%s'; %s",
+				match, error.message);
+			dbus_error_free(&error);
+			goto EXIT;
+		}
+	}
+
+	g_hash_table_replace(dbus_match_refs, (gpointer)g_intern_string(match),
+			     GUINT_TO_POINTER(refs + 1));
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Drop a reference to a D-Bus match
+ *
+ * The match is removed from the D-Bus daemon
+ * along with the last reference
+ *
+ * @param match The match to remove
+ */
+static void dbus_match_unref(const gchar *match)
+{
+	guint refs = 0;
+	DBusError error;
+
+	/* Register error channel */
+	dbus_error_init(&error);
+
+	if (dbus_match_refs != NULL)
+		refs = GPOINTER_TO_UINT(g_hash_table_lookup(dbus_match_refs,
+							    match));
+
+	if (refs == 0) {
+		mce_log(LL_ERR, "Unreferencing unknown D-Bus match '%s'",
+			match);
+		goto EXIT;
+	}
+
+	if (--refs > 0) {
+		g_hash_table_replace(dbus_match_refs,
+				     (gpointer)g_intern_string(match),
+				     GUINT_TO_POINTER(refs));
+		goto EXIT;
+	}
+
+	g_hash_table_remove(dbus_match_refs, match);
+
+	dbus_bus_remove_match(dbus_connection, match, &error);
+
+	if (dbus_error_is_set(&error) == TRUE) {
+		mce_log(LL_CRIT,
+			"Failed to remove D-Bus match '%s'; %s",
+			match, error.message);
+		dbus_error_free(&error);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Release a sender owner cache entry
+ *
+ * @param data The sender_owner_t to free
+ */
+static void sender_owner_free(gpointer data)
+{
+	sender_owner_t *entry = data;
+
+	dbus_match_unref(entry->match);
+	g_free(entry->match);
+	g_free(entry->owner);
+	g_free(entry->name);
+	g_free(entry);
+}
+
+/**
+ * Handle the reply to a GetNameOwner query
+ *
+ * @param pending The pending call
+ * @param user_data The queried bus name
+ */
+static void sender_owner_reply_cb(DBusPendingCall *pending, void *user_data)
+{
+	const gchar *name = user_data;
+	DBusMessage *reply = NULL;
+	sender_owner_t *entry;
+	const char *owner = NULL;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if ((reply = dbus_pending_call_steal_reply(pending)) == NULL)
+		goto EXIT;
+
+	/* The name might have been released meanwhile */
+	if ((sender_owners == NULL) ||
+	    ((entry = g_hash_table_lookup(sender_owners, name)) == NULL))
+		goto EXIT;
+
+	/* No owner is reported as an error; nothing to do */
+	if (dbus_set_error_from_message(&error, reply) == TRUE)
+		goto EXIT;
+
+	if (dbus_message_get_args(reply, &error,
+				  DBUS_TYPE_STRING, &owner,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_ERR, "Failed to get owner of '%s'; %s",
+			name, error.message);
+		goto EXIT;
+	}
+
+	/* Changes seen via NameOwnerChanged are more recent */
+	if (entry->owner == NULL)
+		entry->owner = g_strdup(owner);
+
+EXIT:
+	dbus_error_free(&error);
+
+	if (reply != NULL)
+		dbus_message_unref(reply);
+
+	dbus_pending_call_unref(pending);
+}
+
+/**
+ * Track the owner of a well-known name used in a sender rule
+ *
+ * Signals carry the unique name of the sender; to match
+ * them against a well-known name the current owner of
+ * the name is cached and updated from NameOwnerChanged
+ *
+ * @param name The well-known bus name
+ * @return The cache entry, or NULL on failure
+ */
+static sender_owner_t *sender_owner_ref(const gchar *name)
+{
+	sender_owner_t *entry = NULL;
+	DBusPendingCall *pending = NULL;
+	DBusMessage *msg = NULL;
+	gchar *match = NULL;
+
+	if (sender_owners == NULL) {
+		sender_owners = g_hash_table_new_full(g_str_hash, g_str_equal,
+						      NULL,
+						      sender_owner_free);
+	} else if ((entry = g_hash_table_lookup(sender_owners,
+						name)) != NULL) {
+		entry->refs++;
+		goto EXIT;
+	}
+
+	match = g_strdup_printf("type='signal'"
+				", sender='" DBUS_SERVICE_DBUS "'"
+				", interface='" DBUS_INTERFACE_DBUS "'"
+				", member='NameOwnerChanged'"
+				", arg0='%s'", name);
+
+	if (dbus_match_ref(match) == FALSE)
+		goto EXIT;
+
+	entry = g_new0(sender_owner_t, 1);
+	entry->name = g_strdup(name);
+	entry->match = match, match = NULL;
+	entry->refs = 1;
+	g_hash_table_insert(sender_owners, entry->name, entry);
+
+	/* The match is in place; any change after the query
+	 * will be seen as NameOwnerChanged after the reply */
+	if ((msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS,
+						DBUS_PATH_DBUS,
+						DBUS_INTERFACE_DBUS,
+						"GetNameOwner")) == NULL)
+		goto EXIT;
+
+	if ((dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
+				      DBUS_TYPE_INVALID) == FALSE) ||
+	    (dbus_connection_send_with_reply(dbus_connection, msg,
+					     &pending, -1) == FALSE) ||
+	    (pending == NULL)) {
+		mce_log(LL_ERR, "Failed to query owner of '%s'", name);
+		goto EXIT;
+	}
+
+	if (dbus_pending_call_set_notify(pending, sender_owner_reply_cb,
+					 g_strdup(name), g_free) == FALSE)
+		dbus_pending_call_unref(pending);
+
+EXIT:
+	if (msg != NULL)
+		dbus_message_unref(msg);
+
+	g_free(match);
+
+	return entry;
+}
+
+/**
+ * Drop a reference to a sender owner cache entry
+ *
+ * @param entry The entry, or NULL
+ */
+static void sender_owner_unref(sender_owner_t *entry)
+{
+	if ((entry == NULL) || (--entry->refs > 0))
+		goto EXIT;
+
+	g_hash_table_remove(sender_owners, entry->name);
+
+EXIT:
+	return;
+}
+
+/**
+ * Update the sender owner cache from a NameOwnerChanged signal
+ *
+ * @param msg The D-Bus message
+ */
+static void sender_owner_update(DBusMessage *const msg)
+{
+	sender_owner_t *entry;
+	const char *name = NULL;
+	const char *prev = NULL;
+	const char *curr = NULL;
+
+	if ((sender_owners == NULL) ||
+	    (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS,
+				    "NameOwnerChanged") == FALSE))
+		goto EXIT;
+
+	if (dbus_message_get_args(msg, NULL,
+				  DBUS_TYPE_STRING, &name,
+				  DBUS_TYPE_STRING, &prev,
+				  DBUS_TYPE_STRING, &curr,
+				  DBUS_TYPE_INVALID) == FALSE)
+		goto EXIT;
+
+	if ((entry = g_hash_table_lookup(sender_owners, name)) == NULL)
+		goto EXIT;
+
+	g_free(entry->owner);
+	entry->owner = (*curr != '\0') ? g_strdup(curr) : NULL;
+
+EXIT:
+	return;
+}
+
+/**
+ * Release a compiled match rule
+ *
+ * @param data The rule_struct to free
+ */
+static void rule_free(gpointer data)
+{
+	rule_struct *rule = data;
+
+	sender_owner_unref(rule->owner);
+	g_free(rule->value);
+	g_free(rule);
+}
+
+/**
+ * Parse a match rule string into rule_struct items
+ *
+ * Accepts the same comma separated key='value' syntax
+ * that is passed on to the D-Bus daemon; supported keys
+ * are argN, argNnamespace, path, path_namespace and sender
+ *
+ * @param rules The rule string to parse, or NULL
+ * @param[out] compiled A newly allocated list of rule_struct
+ * @return TRUE on success, FALSE if the rules can't be parsed
+ */
+static gboolean compile_rules(const char *rules, GSList **compiled)
+{
+	GSList *list = NULL;
+	gboolean status = FALSE;
+
+	if (rules == NULL)
+		goto DONE;
+
+	rules += strspn(rules, " ");
+
+	while (*rules != '\0') {
+		const char *eq;
+		const char *key_end;
+		const char *value;
+		const char *value_end;
+		gboolean quot = FALSE;
+		rule_struct *rule;
+		gchar *key;
+		char *num_end;
+
+		if ((eq = strchr(rules, '=')) == NULL)
+			goto EXIT;
+
+		for (key_end = eq; key_end > rules; key_end--) {
+			if (key_end[-1] != ' ')
+				break;
+		}
+
+		eq += strspn(eq, " ");
+
+		if (eq[1] == '\'') {
+			value = eq + 2;
+			value_end = strchr(value, '\'');
+			quot = TRUE;
+		} else {
+			value = eq + 1;
+			value_end = strchrnul(value, ',');
+		}
+
+		if (value_end == NULL)
+			goto EXIT;
+
+		rule = g_new0(rule_struct, 1);
+		rule->value = g_strndup(value, value_end - value);
+		list = g_slist_prepend(list, rule);
+
+		/* Keys must match exactly; bare prefix checks would
+		 * take path_namespace for path and so on */
+		key = g_strndup(rules, key_end - rules);
+
+		if (strncmp(key, "arg", 3) == 0 &&
+		    g_ascii_isdigit(key[3])) {
+			rule->kind = RULE_ARG;
+			rule->arg = strtol(key + 3, &num_end, 10);
+
+			if (strcmp(num_end, "namespace") == 0)
+				rule->sep = '.';
+			else if (*num_end != '\0')
+				rule->kind = RULE_INVALID;
+		} else if (strcmp(key, "path") == 0) {
+			rule->kind = RULE_PATH;
+		} else if (strcmp(key, "path_namespace") == 0) {
+			rule->kind = RULE_PATH;
+			rule->sep = '/';
+
+			/* '/' is the namespace of all paths */
+			if (strcmp(rule->value, "/") == 0)
+				rule->value[0] = '\0';
+		} else if (strcmp(key, "sender") == 0) {
+			rule->kind = RULE_SENDER;
+
+			/* Signals are sent with the unique name; the bus
+			 * daemon is the only exception */
+			if ((rule->value[0] != ':') &&
+			    (strcmp(rule->value, DBUS_SERVICE_DBUS) != 0) &&
+			    (dbus_connection != NULL))
+				rule->owner = sender_owner_ref(rule->value);
+		} else {
+			rule->kind = RULE_INVALID;
+		}
+
+		g_free(key);
+
+		if (rule->kind == RULE_INVALID) {
+			mce_log(LL_ERR, "Unsupported match rule `%s'", rules);
+			goto EXIT;
+		}
+
+		rules = value_end + (quot == TRUE ? 1 : 0);
+		rules += strspn(rules, " ");
+
+		if (*rules == ',')
+			rules++;
+		rules += strspn(rules, " ");
+	}
+
+DONE:
+	*compiled = g_slist_reverse(list), list = NULL;
+	status = TRUE;
+
+EXIT:
+	g_slist_free_full(list, rule_free);
+
+	return status;
+}
+
+/**
+ * Check a value against a compiled rule
+ *
+ * @param rule The compiled rule
+ * @param val The value from the message, or NULL
+ * @return TRUE if the value matches, FALSE if not
+ */
+static gboolean rule_matches(const rule_struct *rule, const char *val)
+{
+	gsize len;
+
+	if (val == NULL)
+		return FALSE;
+
+	if (rule->owner != NULL)
+		return ((rule->owner->owner != NULL) &&
+			(strcmp(rule->owner->owner, val) == 0));
+
+	if (strcmp(rule->value, val) == 0)
+		return TRUE;
+
+	/* Namespaces match themselves and anything below them */
+	if (rule->sep == '\0')
+		return FALSE;
+
+	len = strlen(rule->value);
+
+	return ((strncmp(rule->value, val, len) == 0) &&
+		(val[len] == rule->sep));
+}
+
+/**
+ * D-Bus rule checker
+ *
+ * @param msg The D-Bus message being checked
+ * @param rules The compiled rules to check against
+ * @return TRUE if message matches the rules,
+	   FALSE if not
+ */
+static gboolean check_rules(DBusMessage *const msg,
+			    GSList *rules)
+{
+	DBusMessageIter iter;
+	gboolean have_iter = FALSE;
+	gint iter_arg = 0;
+
+	for (; rules != NULL; rules = rules->next) {
+		const rule_struct *rule = rules->data;
+		const char *val = NULL;
+
+		switch (rule->kind) {
+		case RULE_ARG:
+			/* Rules are typically ordered by argument index;
+			 * only restart the iteration when going backwards */
+			if ((have_iter == FALSE) || (iter_arg > rule->arg)) {
+				if (dbus_message_iter_init(msg, &iter) == FALSE)
+					return FALSE;
+				have_iter = TRUE;
+				iter_arg = 0;
+			}
+
+			for (; iter_arg < rule->arg; iter_arg++) {
+				if (dbus_message_iter_next(&iter) == FALSE)
+					return FALSE;
+			}
+
+			if (dbus_message_iter_get_arg_type(&iter) !=
+			    DBUS_TYPE_STRING)
+				return FALSE;
+			dbus_message_iter_get_basic(&iter, &val);
+			break;
+
+		case RULE_PATH:
+			val = dbus_message_get_path(msg);
+			break;
+
+		case RULE_SENDER:
+			val = dbus_message_get_sender(msg);
+			break;
+
+		default:
+			break;
+		}
+
+		if (rule_matches(rule, val) == FALSE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Release an owner monitor registry entry
+ *
+ * @param data The owner_monitor_t to free
+ */
+static void owner_monitor_free(gpointer data)
+{
+	owner_monitor_t *monitor = data;
+
+	dbus_match_unref(monitor->match);
+	g_slist_free(monitor->clients);
+	g_free(monitor->match);
+	g_free(monitor->service);
+	g_free(monitor);
+}
+
+/**
+ * Find the owner monitor client of a module monitor list
+ *
+ * @param service The monitored service
+ * @param monitor_list The head of the module monitor list
+ * @return The client, or NULL if the service is not in the list
+ */
+static owner_client_t *find_monitored_service(const gchar *service,
+					      GSList *monitor_list)
+{
+	owner_client_t *client = NULL;
+	owner_monitor_t *monitor;
+	GSList *item;
+
+	if ((service == NULL) || (monitor_list == NULL) ||
+	    (owner_monitors == NULL))
+		goto EXIT;
+
+	if ((monitor = g_hash_table_lookup(owner_monitors, service)) == NULL)
+		goto EXIT;
+
+	/* Typically only one or two modules track the same name */
+	for (item = monitor->clients; item != NULL; item = item->next) {
+		owner_client_t *tmp = item->data;
+
+		if (*tmp->monitor_list == monitor_list) {
+			client = tmp;
+			break;
+		}
+	}
+
+EXIT:
+	return client;
+}
+
+/**
+ * Detach an owner monitor client from the registry
+ *
+ * The registry entry and its D-Bus match are released
+ * along with the last client
+ *
+ * @param client The client to detach and free
+ */
+static void owner_client_free(owner_client_t *client)
+{
+	owner_monitor_t *monitor = client->monitor;
+	GSList *item;
+
+	if ((item = g_slist_find(monitor->clients, client)) != NULL) {
+		/* Keep owner_monitor_dispatch() going if the client
+		 * is removed from within a callback */
+		if (item == owner_dispatch_iter)
+			owner_dispatch_iter = item->next;
+
+		monitor->clients = g_slist_delete_link(monitor->clients, item);
+	}
+
+	if (monitor->clients == NULL)
+		g_hash_table_remove(owner_monitors, monitor->service);
+
+	g_free(client);
+}
+
+/**
+ * Pass a NameOwnerChanged signal to the clients monitoring the name
+ *
+ * @param msg The D-Bus message
+ * @return TRUE if the signal was passed to any client, FALSE otherwise
+ */
+static gboolean owner_monitor_dispatch(DBusMessage *const msg)
+{
+	gboolean handled = FALSE;
+	owner_monitor_t *monitor;
+	const char *service = NULL;
+	DBusMessageIter iter;
+	GSList *item;
+
+	if ((owner_monitors == NULL) ||
+	    (dbus_message_is_signal(msg, "org.freedesktop.DBus",
+				    "NameOwnerChanged") == FALSE))
+		goto EXIT;
+
+	/* The monitors track the old owner, i.e. arg1 */
+	if ((dbus_message_iter_init(msg, &iter) == FALSE) ||
+	    (dbus_message_iter_next(&iter) == FALSE) ||
+	    (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING))
+		goto EXIT;
+
+	dbus_message_iter_get_basic(&iter, &service);
+
+	if ((monitor = g_hash_table_lookup(owner_monitors, service)) == NULL)
+		goto EXIT;
+
+	for (item = monitor->clients; item != NULL;
+	     item = owner_dispatch_iter) {
+		owner_client_t *client = item->data;
+
+		owner_dispatch_iter = item->next;
+		client->callback(msg);
+		handled = TRUE;
+	}
+
+	owner_dispatch_iter = NULL;
+
+EXIT:
+	return handled;
+}
+
+/**
+ * Check whether a message interface matches a handler interface
+ *
+ * Follows dbus_message_is_method_call() semantics;
+ * a missing interface on either side matches any interface
+ *
+ * @param wanted The interface of the handler, or NULL
+ * @param have The interface of the message, or NULL
+ * @return TRUE if the interfaces match, FALSE if not
+ */
+static gboolean match_interface(const gchar *wanted, const char *have)
+{
+	return (wanted == NULL) || (have == NULL) || !strcmp(wanted, have);
+}
+
+/**
+ * Add a D-Bus handler to the lookup tables
+ *
+ * @param h The handler to add
+ */
+static void handler_index_add(handler_struct *h)
+{
+	GHashTable *index;
+	GSList *bucket;
+
+	if ((index = dbus_handler_index[h->type]) == NULL) {
+		/* Keys are the interned handler names */
+		index = g_hash_table_new(g_str_hash, g_str_equal);
+		dbus_handler_index[h->type] = index;
+	}
+
+	bucket = g_hash_table_lookup(index, h->name);
+	bucket = g_slist_prepend(bucket, h);
+	g_hash_table_replace(index, (gpointer)h->name, bucket);
+}
+
+/**
+ * Remove a D-Bus handler from the lookup tables
+ *
+ * @param h The handler to remove
+ */
+static void handler_index_remove(handler_struct *h)
+{
+	GHashTable *index;
+	GSList *bucket;
+	GSList *item;
+
+	if ((index = dbus_handler_index[h->type]) == NULL)
 		goto EXIT;
 
-	/* it is either error reply or true, and we got here... */
-	{
-		dbus_bool_t arg = TRUE;
-		dbus_message_append_args(reply,
-					 DBUS_TYPE_BOOLEAN, &arg,
-					 DBUS_TYPE_INVALID);
-	}
+	bucket = g_hash_table_lookup(index, h->name);
 
-EXIT:
-	value_list_free(list);
+	if ((item = g_slist_find(bucket, h)) == NULL)
+		goto EXIT;
 
-	/* Send a reply if we have one */
-	if( reply ) {
-		if( dbus_message_get_no_reply(msg) ) {
-			dbus_message_unref(reply), reply = 0;
-			status = TRUE;
-		}
-		else {
-			/* dbus_send_message unrefs the reply message */
-			status = dbus_send_message(reply), reply = 0;
-		}
-	}
+	/* Keep msg_handler going if the handler is removed
+	 * from within a callback */
+	if (item == msg_handler_iter)
+		msg_handler_iter = item->next;
 
-	g_clear_error(&err);
-	dbus_error_free(&error);
+	bucket = g_slist_delete_link(bucket, item);
 
+	if (bucket != NULL)
+		g_hash_table_replace(index, (gpointer)h->name, bucket);
+	else
+		g_hash_table_remove(index, h->name);
 
-	return status;
+EXIT:
+	return;
 }
 
 /**
- * D-Bus rule checker
+ * Count a call from the given sender
  *
- * @param msg The D-Bus message being checked
- * @param rules The rule string to check against
- * @return TRUE if message matches the rules,
-	   FALSE if not
+ * To keep the memory use bounded, the least active sender
+ * is forgotten when the table is full
+ *
+ * @param h The handler that was called
+ * @param sender Sender of the message, or NULL
  */
-static gboolean check_rules(DBusMessage *const msg,
-			    const char *rules)
+static void handler_stats_add_sender(handler_struct *h, const char *sender)
 {
-	if (rules == NULL)
-		return TRUE;
-	rules += strspn(rules, " ");;
-
-	while (*rules != '\0') {
-		const char *eq;
-		const char *value;
-		const char *value_end;
-		const char *val = NULL;
-		gboolean quot = FALSE;
-
-		if ((eq = strchr(rules, '=')) == NULL)
-			return FALSE;
-		eq += strspn(eq, " ");
-
-		if (eq[1] == '\'') {
-			value = eq + 2;
-			value_end = strchr(value, '\'');
-			quot = TRUE;
-		} else {
-			value = eq + 1;
-			value_end = strchrnul(value, ',');
+	gpointer key = NULL;
+	gpointer value = NULL;
+	guint count = 0;
+
+	if (sender == NULL)
+		sender = "<unknown>";
+
+	if (h->senders == NULL)
+		h->senders = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free, NULL);
+
+	if (g_hash_table_lookup_extended(h->senders, sender,
+					 &key, &value) == TRUE) {
+		count = GPOINTER_TO_UINT(value);
+	} else if (g_hash_table_size(h->senders) >=
+		   HANDLER_STATS_MAX_SENDERS) {
+		GHashTableIter iter;
+		gpointer least = NULL;
+		guint least_count = G_MAXUINT;
+
+		g_hash_table_iter_init(&iter, h->senders);
+
+		while (g_hash_table_iter_next(&iter, &key, &value) == TRUE) {
+			if (GPOINTER_TO_UINT(value) < least_count) {
+				least_count = GPOINTER_TO_UINT(value);
+				least = key;
+			}
 		}
 
-		if (value_end == NULL)
-			return FALSE;
-
-		if (strncmp(rules, "arg", 3) == 0) {
-			int fld = atoi(rules + 3);
+		g_hash_table_remove(h->senders, least);
+	}
 
-			DBusMessageIter iter;
+	g_hash_table_replace(h->senders, g_strdup(sender),
+			     GUINT_TO_POINTER(count + 1));
+}
 
-			if (dbus_message_iter_init(msg, &iter) == FALSE)
-				return FALSE;
+/**
+ * Invoke handler callback and update the handler statistics
+ *
+ * @param h The handler to call
+ * @param msg The D-Bus message to pass to the callback
+ */
+static void handler_invoke(handler_struct *h, DBusMessage *const msg)
+{
+	guint64 start = mce_lib_get_time_us(CLOCK_MONOTONIC);
+	guint64 spent;
 
-			for (; fld; fld--) {
-				if (dbus_message_iter_has_next(&iter) == FALSE)
-					return FALSE;
-				dbus_message_iter_next(&iter);
-			}
+	msg_handler_current = h;
 
-			if (dbus_message_iter_get_arg_type(&iter) !=
-			    DBUS_TYPE_STRING)
-				return FALSE;
-			dbus_message_iter_get_basic(&iter, &val);
+	h->callback(msg);
 
-		} else if (strncmp(rules, "path", 4) == 0) {
-			val = dbus_message_get_path(msg);
-		}
+	/* The handler might have been removed by the callback */
+	if (msg_handler_current == NULL)
+		goto EXIT;
 
-		if (((value_end != NULL) &&
-		     ((strncmp(value, val, value_end - value) != 0) ||
-		      (val[value_end - value] != '\0'))) ||
-		    ((value_end == NULL) &&
-		     (strcmp(value, val) != 0)))
-			return FALSE;
+	spent = mce_lib_get_time_us(CLOCK_MONOTONIC) - start;
 
-		if (value_end == NULL)
-			break;
+	h->call_count += 1;
+	h->total_time += spent;
 
-		rules = value_end + (quot == TRUE ? 1 : 0);
-		rules += strspn(rules, " ");;
+	if (h->max_time < spent)
+		h->max_time = spent;
 
-		if (*rules == ',')
-			rules++;
-		rules += strspn(rules, " ");;
-	}
+	handler_stats_add_sender(h, dbus_message_get_sender(msg));
 
-	return TRUE;
+EXIT:
+	msg_handler_current = NULL;
 }
 
 /**
@@ -1224,21 +3177,54 @@ static DBusHandlerResult msg_handler(DBusConnection *const connection,
 				     gpointer const user_data)
 {
 	guint status = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	int type = dbus_message_get_type(msg);
+	const char *interface = dbus_message_get_interface(msg);
+	const char *name = NULL;
+	mce_wakeup_owner_t *owner = NULL;
+	gint64 started = mce_wakeup_begin();
+	GSList *item;
 
 	(void)connection;
 	(void)user_data;
 
-	for (msg_handler_iter = dbus_handlers;
-	     msg_handler_iter != NULL;
-	     msg_handler_iter = g_slist_next(msg_handler_iter)) {
-		handler_struct *handler = msg_handler_iter->data;
+	/* Sender rules must see the new owner before its signals */
+	if (type == DBUS_MESSAGE_TYPE_SIGNAL)
+		sender_owner_update(msg);
+
+	if ((type == DBUS_MESSAGE_TYPE_SIGNAL) &&
+	    (owner_monitor_dispatch(msg) == TRUE)) {
+		owner = dbus_wakeup_owner_changed;
+		status = DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if ((type <= DBUS_MESSAGE_TYPE_INVALID) ||
+	    (type >= DBUS_NUM_MESSAGE_TYPES) ||
+	    (dbus_handler_index[type] == NULL))
+		goto EXIT;
+
+	if (type == DBUS_MESSAGE_TYPE_ERROR)
+		name = dbus_message_get_error_name(msg);
+	else
+		name = dbus_message_get_member(msg);
+
+	if (name == NULL)
+		goto EXIT;
+
+	/* Only the handlers registered for this message type and
+	 * name need to be examined; handlers removed by the callbacks
+	 * advance msg_handler_iter via handler_index_remove() */
+	for (item = g_hash_table_lookup(dbus_handler_index[type], name);
+	     item != NULL; item = msg_handler_iter) {
+		handler_struct *handler = item->data;
+
+		msg_handler_iter = item->next;
 
 		switch (handler->type) {
 		case DBUS_MESSAGE_TYPE_METHOD_CALL:
-			if (dbus_message_is_method_call(msg,
-							handler->interface,
-							handler->name) == TRUE) {
-				handler->callback(msg);
+			if (match_interface(handler->interface,
+					    interface) == TRUE) {
+				owner = handler->wakeup_owner;
+				handler_invoke(handler, msg);
 				status = DBUS_HANDLER_RESULT_HANDLED;
 				goto EXIT;
 			}
@@ -1246,21 +3232,17 @@ static DBusHandlerResult msg_handler(DBusConnection *const connection,
 			break;
 
 		case DBUS_MESSAGE_TYPE_ERROR:
-			if (dbus_message_is_error(msg,
-						  handler->name) == TRUE) {
-				handler->callback(msg);
-				status = DBUS_HANDLER_RESULT_HANDLED;
-				goto EXIT;
-			}
-
-			break;
+			owner = handler->wakeup_owner;
+			handler_invoke(handler, msg);
+			status = DBUS_HANDLER_RESULT_HANDLED;
+			goto EXIT;
 
 		case DBUS_MESSAGE_TYPE_SIGNAL:
-			if ((dbus_message_is_signal(msg,
-						   handler->interface,
-						   handler->name) == TRUE) &&
-			    (check_rules(msg, handler->rules) == TRUE)) {
-				handler->callback(msg);
+			if ((match_interface(handler->interface,
+					     interface) == TRUE) &&
+			    (check_rules(msg, handler->compiled_rules) == TRUE)) {
+				owner = handler->wakeup_owner;
+				handler_invoke(handler, msg);
 				status = DBUS_HANDLER_RESULT_HANDLED;
 			}
 
@@ -1275,9 +3257,29 @@ static DBusHandlerResult msg_handler(DBusConnection *const connection,
 	}
 
 EXIT:
+	msg_handler_iter = NULL;
+
+	/* The owners are looked up at registration; the handler
+	 * itself may be gone by now */
+	mce_wakeup_account((status != DBUS_HANDLER_RESULT_HANDLED) ?
+			   dbus_wakeup_unhandled : owner, started);
+
 	return status;
 }
 
+/**
+ * Pass a message to the registered handlers as if it had
+ * arrived from the bus; used by the microbenchmarks
+ *
+ * @param msg The D-Bus message to dispatch
+ * @return TRUE if some handler accepted the message, FALSE otherwise
+ */
+gboolean mce_dbus_dispatch_message(DBusMessage *const msg)
+{
+	return msg_handler(dbus_connection, msg, NULL) ==
+		DBUS_HANDLER_RESULT_HANDLED;
+}
+
 /**
  * Register a D-Bus signal or method handler
  *
@@ -1296,10 +3298,7 @@ gconstpointer mce_dbus_handler_add(const gchar *const interface,
 {
 	handler_struct *h = NULL;
 	gchar *match = NULL;
-	DBusError error;
-
-	/* Register error channel */
-	dbus_error_init(&error);
+	GSList *compiled = NULL;
 
 	if (type == DBUS_MESSAGE_TYPE_SIGNAL) {
 		if ((match = g_strdup_printf("type='signal'"
@@ -1323,62 +3322,38 @@ gconstpointer mce_dbus_handler_add(const gchar *const interface,
 		goto EXIT;
 	}
 
-	if ((h = g_try_malloc(sizeof (*h))) == NULL) {
-		mce_log(LL_CRIT, "Failed to allocate memory for h");
-		goto EXIT;
-	}
-
-	h->interface = NULL;
-
-	if (interface && (h->interface = g_strdup(interface)) == NULL) {
-		mce_log(LL_CRIT, "Failed to allocate memory for h->interface");
-		g_free(h);
-		h = NULL;
-		goto EXIT;
-	}
-
-	h->rules = NULL;
-
-	if (rules && (h->rules = g_strdup(rules)) == NULL) {
-		mce_log(LL_CRIT, "Failed to allocate memory for h->rules");
-		g_free(h->interface);
-		g_free(h);
-		h = NULL;
+	/* Parse the rules once here instead of on every message */
+	if (compile_rules(rules, &compiled) == FALSE) {
+		mce_log(LL_CRIT, "Failed to parse rules '%s' for '%s'",
+			rules, name);
 		goto EXIT;
 	}
 
-	if ((h->name = g_strdup(name)) == NULL) {
-		mce_log(LL_CRIT, "Failed to allocate memory for h->name");
-		g_free(h->interface);
-		g_free(h->rules);
-		g_free(h);
-		h = NULL;
+	/* Only register D-Bus matches for signals */
+	if ((match != NULL) && (dbus_match_ref(match) == FALSE)) {
+		mce_log(LL_CRIT, "Failed to add D-Bus match for '%s'",
+			interface);
 		goto EXIT;
 	}
 
+	/* Many handlers share the interface and name strings,
+	 * and the lookup tables are keyed with them; intern them
+	 * instead of keeping a copy per handler */
+	h = g_new0(handler_struct, 1);
+	h->interface = g_intern_string(interface);
+	h->compiled_rules = compiled, compiled = NULL;
+	h->match = g_intern_string(match);
+	h->name = g_intern_string(name);
 	h->type = type;
 	h->callback = callback;
-
-	/* Only register D-Bus matches for signals */
-	if (match != NULL) {
-		dbus_bus_add_match(dbus_connection, match, &error);
-
-		if (dbus_error_is_set(&error) == TRUE) {
-			mce_log(LL_CRIT,
-				"Failed to add D-Bus match '%s' for '%s'; %s",
-				match, h->interface, error.message);
-			dbus_error_free(&error);
-			g_free(h->interface);
-			g_free(h->rules);
-			g_free(h);
-			h = NULL;
-			goto EXIT;
-		}
-	}
+	h->wakeup_owner = mce_wakeup_owner("dbus", name);
+	mce_memstat_alloc("dbus:handlers", sizeof *h);
 
 	dbus_handlers = g_slist_prepend(dbus_handlers, h);
+	handler_index_add(h);
 
 EXIT:
+	g_slist_free_full(compiled, rule_free);
 	g_free(match);
 
 	return h;
@@ -1393,39 +3368,9 @@ EXIT:
 void mce_dbus_handler_remove(gconstpointer cookie)
 {
 	handler_struct *h = (handler_struct *)cookie;
-	gchar *match = NULL;
-	DBusError error;
-	GSList *iter;
-
-	/* Register error channel */
-	dbus_error_init(&error);
 
-	if (h->type == DBUS_MESSAGE_TYPE_SIGNAL) {
-		match = g_strdup_printf("type='signal'"
-					"%s%s%s"
-					", member='%s'"
-					"%s%s",
-					h->interface ? ", interface='" : "",
-					h->interface ? h->interface : "",
-					h->interface ? "'" : "",
-					h->name,
-					h->rules ? ", " : "",
-					h->rules ? h->rules : "");
-
-		if (match != NULL) {
-			dbus_bus_remove_match(dbus_connection, match, &error);
-
-			if (dbus_error_is_set(&error) == TRUE) {
-				mce_log(LL_CRIT,
-					"Failed to remove D-Bus match "
-					"'%s' for '%s': %s",
-					match, h->interface, error.message);
-				dbus_error_free(&error);
-			}
-		} else {
-			mce_log(LL_CRIT,
-				"Failed to allocate memory for match");
-		}
+	if (h->match != NULL) {
+		dbus_match_unref(h->match);
 	} else if (h->type != DBUS_MESSAGE_TYPE_METHOD_CALL) {
 		mce_log(LL_ERR,
 			"There's definitely a programming error somewhere; "
@@ -1433,76 +3378,18 @@ void mce_dbus_handler_remove(gconstpointer cookie)
 		/* Don't abort here, since we want to unregister it anyway */
 	}
 
-	if ((iter = g_slist_find(dbus_handlers, h))) {
-		if (iter == msg_handler_iter)
-			msg_handler_iter = iter->next;
-		dbus_handlers = g_slist_remove_link(dbus_handlers, iter);
-	}
-
-	g_free(h->interface);
-	g_free(h->rules);
-	g_free(h->name);
-	g_free(h);
-	g_free(match);
-}
-
-/**
- * Unregister a D-Bus signal or method handler;
- * to be used with g_slist_foreach()
- *
- * @param handler A pointer to the handler struct that should be removed
- * @param user_data Unused
- */
-static void mce_dbus_handler_remove_foreach(gpointer handler,
-					    gpointer user_data)
-{
-	(void)user_data;
-
-	mce_dbus_handler_remove(handler);
-}
-
-/**
- * Custom compare function used to find owner monitor entries
- *
- * @param owner_id An owner monitor cookie
- * @param name The name to search for
- * @return Less than, equal to, or greater than zero depending
- *         whether the name of the rules with the id owner_id
- *         is less than, equal to, or greater than name
- */
-static gint monitor_compare(gconstpointer owner_id, gconstpointer name)
-{
-	handler_struct *hs = (handler_struct *)owner_id;
-
-	return strcmp(hs->rules, name);
-}
-
-/**
- * Locate the specified D-Bus service in the monitor list
- *
- * @param service The service to check for
- * @param monitor_list The monitor list check
- * @return A pointer to the entry if the entry is in the list,
- *         NULL if the entry is not in the list
- */
-static GSList *find_monitored_service(const gchar *service,
-				      GSList *monitor_list)
-{
-	gchar *rule = NULL;
-	GSList *tmp = NULL;
+	if (h == msg_handler_current)
+		msg_handler_current = NULL;
 
-	if (service == NULL)
-		goto EXIT;
-
-	if ((rule = g_strdup_printf("arg1='%s'", service)) == NULL)
-		goto EXIT;
-
-	tmp = g_slist_find_custom(monitor_list, rule, monitor_compare);
+	handler_index_remove(h);
+	dbus_handlers = g_slist_remove(dbus_handlers, h);
 
-	g_free(rule);
+	if (h->senders != NULL)
+		g_hash_table_unref(h->senders);
 
-EXIT:
-	return tmp;
+	g_slist_free_full(h->compiled_rules, rule_free);
+	mce_memstat_free("dbus:handlers", sizeof *h);
+	g_free(h);
 }
 
 /**
@@ -1546,6 +3433,9 @@ static gboolean fake_owner_gone(gpointer data)
 /**
  * Add a service to a D-Bus owner monitor list
  *
+ * All monitor lists share one registry entry and one
+ * D-Bus match per monitored name
+ *
  * @param service The service to monitor
  * @param callback A D-Bus monitor callback
  * @param monitor_list The list of monitored services
@@ -1564,8 +3454,9 @@ gssize mce_dbus_owner_monitor_add(const gchar *service,
 				  GSList **monitor_list,
 				  gssize max_num)
 {
-	gconstpointer cookie;
-	gchar *rule = NULL;
+	owner_monitor_t *monitor = NULL;
+	owner_client_t *client;
+	gchar *match = NULL;
 	gssize retval = -1;
 	gssize num;
 
@@ -1596,20 +3487,37 @@ gssize mce_dbus_owner_monitor_add(const gchar *service,
 	if ((num = g_slist_length(*monitor_list)) == max_num)
 		goto EXIT;
 
-	if ((rule = g_strdup_printf("arg1='%s'", service)) == NULL)
-		goto EXIT;
+	if (owner_monitors == NULL) {
+		owner_monitors = g_hash_table_new_full(g_str_hash, g_str_equal,
+						       NULL,
+						       owner_monitor_free);
+	} else {
+		monitor = g_hash_table_lookup(owner_monitors, service);
+	}
 
 	/* Add ownership monitoring for the service */
-	cookie = mce_dbus_handler_add("org.freedesktop.DBus",
-				      "NameOwnerChanged",
-				      rule,
-				      DBUS_MESSAGE_TYPE_SIGNAL,
-				      callback);
+	if (monitor == NULL) {
+		match = g_strdup_printf("type='signal'"
+					", interface='org.freedesktop.DBus'"
+					", member='NameOwnerChanged'"
+					", arg1='%s'", service);
 
-	if (cookie == NULL)
-		goto EXIT;
+		if (dbus_match_ref(match) == FALSE)
+			goto EXIT;
+
+		monitor = g_new0(owner_monitor_t, 1);
+		monitor->service = g_strdup(service);
+		monitor->match = match, match = NULL;
+		g_hash_table_insert(owner_monitors, monitor->service, monitor);
+	}
+
+	client = g_new0(owner_client_t, 1);
+	client->monitor = monitor;
+	client->callback = callback;
+	client->monitor_list = monitor_list;
+	monitor->clients = g_slist_prepend(monitor->clients, client);
 
-	*monitor_list = g_slist_prepend(*monitor_list, (gpointer)cookie);
+	*monitor_list = g_slist_prepend(*monitor_list, client);
 	retval = num + 1;
 
 	if (dbus_bus_name_has_owner(dbus_connection, service, NULL) == FALSE)
@@ -1618,7 +3526,7 @@ gssize mce_dbus_owner_monitor_add(const gchar *service,
 				g_free);
 
 EXIT:
-	g_free(rule);
+	g_free(match);
 
 	return retval;
 }
@@ -1636,20 +3544,21 @@ EXIT:
 gssize mce_dbus_owner_monitor_remove(const gchar *service,
 				     GSList **monitor_list)
 {
+	owner_client_t *client;
 	gssize retval = -1;
-	GSList *tmp;
 
 	/* If service or monitor_list is NULL, fail */
 	if ((service == NULL) || (monitor_list == NULL))
 		goto EXIT;
 
 	/* If the service is not in the list, fail */
-	if ((tmp = find_monitored_service(service, *monitor_list)) == NULL)
+	if ((client = find_monitored_service(service,
+					     *monitor_list)) == NULL)
 		goto EXIT;
 
 	/* Remove ownership monitoring for the service */
-	mce_dbus_handler_remove(tmp->data);
-	*monitor_list = g_slist_remove(*monitor_list, tmp->data);
+	*monitor_list = g_slist_remove(*monitor_list, client);
+	owner_client_free(client);
 	retval = g_slist_length(*monitor_list);
 
 EXIT:
@@ -1663,12 +3572,19 @@ EXIT:
  */
 void mce_dbus_owner_monitor_remove_all(GSList **monitor_list)
 {
-	if ((monitor_list != NULL) && (*monitor_list != NULL)) {
-		g_slist_foreach(*monitor_list,
-				(GFunc)mce_dbus_handler_remove_foreach, NULL);
-		g_slist_free(*monitor_list);
-		*monitor_list = NULL;
+	if (monitor_list == NULL)
+		goto EXIT;
+
+	while (*monitor_list != NULL) {
+		owner_client_t *client = (*monitor_list)->data;
+
+		*monitor_list = g_slist_delete_link(*monitor_list,
+						    *monitor_list);
+		owner_client_free(client);
 	}
+
+EXIT:
+	return;
 }
 
 /**
@@ -1741,6 +3657,10 @@ gboolean mce_dbus_init(const gboolean systembus)
 	if (systembus == FALSE)
 		bus_type = DBUS_BUS_SESSION;
 
+	dbus_wakeup_unhandled = mce_wakeup_owner("dbus", "unhandled");
+	dbus_wakeup_owner_changed = mce_wakeup_owner("dbus",
+						     "NameOwnerChanged");
+
 	mce_log(LL_DEBUG, "Establishing D-Bus connection");
 
 	/* Establish D-Bus connection */
@@ -1763,6 +3683,8 @@ gboolean mce_dbus_init(const gboolean systembus)
 	if (dbus_acquire_services() == FALSE)
 		goto EXIT;
 
+	mce_startup_trace("dbus services acquired");
+
 	/* Initialise message handlers */
 	if (dbus_init_message_handler() == FALSE)
 		goto EXIT;
@@ -1777,6 +3699,14 @@ gboolean mce_dbus_init(const gboolean systembus)
 				 version_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* set_log_verbosity */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_LOG_VERBOSITY_SET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 log_verbosity_set_dbus_cb) == NULL)
+		goto EXIT;
+
 	/* get_config */
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
 				 "get_config",
@@ -1793,6 +3723,78 @@ gboolean mce_dbus_init(const gboolean systembus)
 				 config_set_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* get_config_all */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_CONFIG_GET_ALL,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 config_get_all_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_config_multi */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_CONFIG_GET_MULTI,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 config_get_multi_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* set_config_multi */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_CONFIG_SET_MULTI,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 config_set_multi_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_dbus_handler_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DBUS_HANDLER_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 handler_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_datapipe_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DATAPIPE_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 datapipe_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_iomon_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_IOMON_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 iomon_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_wakeup_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_WAKEUP_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 wakeup_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_memory_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_MEMORY_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 memory_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* get_datapipe_trace */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DATAPIPE_TRACE_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 datapipe_trace_get_dbus_cb) == NULL)
+		goto EXIT;
+
 	status = TRUE;
 
 EXIT:
@@ -1804,14 +3806,38 @@ EXIT:
  */
 void mce_dbus_exit(void)
 {
+	gint i;
+
 	/* Unregister D-Bus handlers */
-	if (dbus_handlers != NULL) {
-		g_slist_foreach(dbus_handlers,
-				(GFunc)mce_dbus_handler_remove_foreach, NULL);
-		g_slist_free(dbus_handlers);
-		dbus_handlers = NULL;
+	while (dbus_handlers != NULL)
+		mce_dbus_handler_remove(dbus_handlers->data);
+
+	for (i = 0; i < DBUS_NUM_MESSAGE_TYPES; i++) {
+		if (dbus_handler_index[i] != NULL) {
+			g_hash_table_destroy(dbus_handler_index[i]);
+			dbus_handler_index[i] = NULL;
+		}
+	}
+
+	if (owner_monitors != NULL) {
+		g_hash_table_destroy(owner_monitors);
+		owner_monitors = NULL;
+	}
+
+	if (sender_owners != NULL) {
+		g_hash_table_destroy(sender_owners);
+		sender_owners = NULL;
+	}
+
+	if (dbus_match_refs != NULL) {
+		g_hash_table_destroy(dbus_match_refs);
+		dbus_match_refs = NULL;
 	}
 
+	/* Don't lose state changes that are still queued */
+	if (dbus_connection != NULL)
+		dbus_flush_coalesced_signals();
+
 	/* If there is an established D-Bus connection, unreference it */
 	if (dbus_connection != NULL) {
 		mce_log(LL_DEBUG, "Unreferencing D-Bus connection");
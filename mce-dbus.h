@@ -26,6 +26,39 @@
 
 #include <mce/dbus-names.h>
 
+/** Name of D-Bus method for getting datapipe execution statistics */
+#define MCE_DATAPIPE_STATS_GET		"get_datapipe_stats"
+
+/** Name of D-Bus method for getting the datapipe execution trace */
+#define MCE_DATAPIPE_TRACE_GET		"get_datapipe_trace"
+
+/** Name of D-Bus method for getting all configuration values at once */
+#define MCE_CONFIG_GET_ALL		"get_config_all"
+
+/** Name of D-Bus method for getting several configuration values at once */
+#define MCE_CONFIG_GET_MULTI		"get_config_multi"
+
+/** Name of D-Bus method for setting several configuration values at once */
+#define MCE_CONFIG_SET_MULTI		"set_config_multi"
+
+/** Name of D-Bus method for getting D-Bus handler call statistics */
+#define MCE_DBUS_HANDLER_STATS_GET	"get_dbus_handler_stats"
+
+/** Name of D-Bus method for getting I/O monitor statistics */
+#define MCE_IOMON_STATS_GET		"get_iomon_stats"
+
+/** Name of D-Bus method for getting mainloop wakeup statistics */
+#define MCE_WAKEUP_STATS_GET		"get_wakeup_stats"
+
+/** Name of D-Bus method for getting RSS and per-owner memory statistics */
+#define MCE_MEMORY_STATS_GET		"get_memory_stats"
+
+/** Name of D-Bus method for getting input latency statistics */
+#define MCE_INPUT_LATENCY_GET		"get_input_latency"
+
+/** Name of D-Bus method for setting the log verbosity at runtime */
+#define MCE_LOG_VERBOSITY_SET		"set_log_verbosity"
+
 DBusConnection *dbus_connection_get(void);
 
 DBusMessage *dbus_new_signal(const gchar *const path,
@@ -38,6 +71,8 @@ DBusMessage *dbus_new_method_call(const gchar *const service,
 DBusMessage *dbus_new_method_reply(DBusMessage *const message);
 
 gboolean dbus_send_message(DBusMessage *const msg);
+gboolean dbus_send_message_coalesced(DBusMessage *const msg,
+				     const guint min_interval);
 gboolean dbus_send_message_with_reply_handler(DBusMessage *const msg,
 					      DBusPendingCallNotifyFunction callback);
 
@@ -58,6 +93,7 @@ gconstpointer mce_dbus_handler_add(const gchar *const interface,
 				   const guint type,
 				   gboolean (*callback)(DBusMessage *const msg));
 void mce_dbus_handler_remove(gconstpointer cookie);
+gboolean mce_dbus_dispatch_message(DBusMessage *const msg);
 gboolean mce_dbus_is_owner_monitored(const gchar *service,
 				     GSList *monitor_list);
 gssize mce_dbus_owner_monitor_add(const gchar *service,
@@ -0,0 +1,796 @@
+/**
+ * @file mce-deadline.c
+ * Deadline timer queue for the Mode Control Entity
+ * <p>
+ * All deadlines share one timerfd; they are kept in a min-heap
+ * ordered by expiry time and the timerfd is programmed for the
+ * earliest one.  Restarting an active deadline just updates its
+ * position in the heap, so frequent rescheduling does not churn
+ * glib sources.
+ * <p>
+ * Non-critical deadlines can be started with a slack tolerance.
+ * The timer is programmed for the latest acceptable expiry of each
+ * deadline, and whenever mce wakes up for a deadline or for the DSME
+ * heartbeat, every deadline whose tolerance window has opened is
+ * dispatched on the same wakeup.
+ * <p>
+ * The deadlines run on CLOCK_BOOTTIME when the kernel supports it,
+ * so time spent in suspend counts towards them and overdue deadlines
+ * fire right after resume; without timerfd support a glib timeout
+ * on the monotonic clock is used instead.
+ * <p>
+ * Deadlines that must be enforced while the device is suspended can
+ * be marked with mce_deadline_set_wakeup().  The earliest of those
+ * is also programmed to a second timerfd on CLOCK_BOOTTIME_ALARM,
+ * which resumes the device on expiry; that way a pending deadline
+ * does not need a wakelock to keep the device awake until it fires.
+ * If mce lacks CAP_WAKE_ALARM, such deadlines fire on resume like
+ * the others.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <errno.h>			/* errno, EAGAIN */
+#include <string.h>			/* memset() */
+#include <unistd.h>			/* read(), close() */
+#include <sys/timerfd.h>		/* timerfd_create(),
+					 * timerfd_settime(),
+					 * TFD_TIMER_ABSTIME
+					 */
+
+#include "mce-deadline.h"
+
+#include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-lib.h"			/* mce_lib_get_time_ms(),
+					 * CLOCK_BOOTTIME
+					 */
+#include "mce-wakeup.h"			/* mce_wakeup_owner(),
+					 * mce_wakeup_begin(),
+					 * mce_wakeup_account()
+					 */
+
+#ifdef ENABLE_WAKELOCKS
+# include "libwakelock.h"		/* wakelock_lock(),
+					 * wakelock_unlock()
+					 */
+#endif
+
+#ifndef CLOCK_BOOTTIME_ALARM
+/** CLOCK_BOOTTIME that resumes from suspend; not in older headers */
+# define CLOCK_BOOTTIME_ALARM		9
+#endif
+
+#ifdef ENABLE_WAKELOCKS
+/** Wakelock held while dispatching deadlines after an alarm wakeup */
+# define DEADLINE_ALARM_WAKELOCK	"mce_deadline_alarm"
+#endif
+
+/** Heap position of a deadline that is not active */
+#define DEADLINE_INACTIVE		G_MAXSIZE
+
+/** Deadline timer */
+struct mce_deadline_t {
+	const gchar *name;		/**< Name for debugging */
+	mce_deadline_cb callback;	/**< Expiry callback */
+	gpointer user_data;		/**< User data for the callback */
+	gint64 due;			/**< Earliest expiry time [ms] */
+	gint64 latest;			/**< Latest expiry time [ms] */
+	guint64 seq;			/**< Start order; breaks ties */
+	gsize pos;			/**< Position in the heap */
+	gboolean wakeup;		/**< Expiry resumes from suspend */
+	mce_wakeup_owner_t *owner;	/**< Wakeup accounting */
+};
+
+/** Heap of active deadlines; the earliest latest expiry first */
+static mce_deadline_t **deadline_heap = NULL;
+
+/** Number of active deadlines */
+static gsize deadline_heap_len = 0;
+
+/** Allocated size of the deadline heap */
+static gsize deadline_heap_size = 0;
+
+/** Number of existing deadlines */
+static guint deadline_count = 0;
+
+/** Counter for the start order of the deadlines */
+static guint64 deadline_seq = 0;
+
+/** Clock the deadlines run on */
+static clockid_t deadline_clock = CLOCK_MONOTONIC;
+
+/** Timer file descriptor; -1 if not in use */
+static int deadline_timer_fd = -1;
+
+/** I/O watch ID for the timer file descriptor */
+static guint deadline_watch_id = 0;
+
+/** Fallback timeout ID, used if timerfd is not available */
+static guint deadline_timeout_id = 0;
+
+/** Expiry time the timer is programmed for; -1 if disarmed */
+static gint64 deadline_programmed = -1;
+
+/** Number of deadlines marked with mce_deadline_set_wakeup() */
+static guint deadline_wakeup_count = 0;
+
+/** Alarm timer file descriptor; -1 if not in use */
+static int deadline_alarm_fd = -1;
+
+/** I/O watch ID for the alarm timer file descriptor */
+static guint deadline_alarm_watch_id = 0;
+
+/** Expiry time the alarm timer is programmed for; -1 if disarmed */
+static gint64 deadline_alarm_programmed = -1;
+
+/** Whether creating the alarm timer has failed; not retried */
+static gboolean deadline_alarm_failed = FALSE;
+
+/**
+ * Check heap ordering of two deadlines
+ *
+ * @param a Deadline
+ * @param b Deadline
+ * @return TRUE if the latest expiry of a is before that of b
+ */
+static gboolean mce_deadline_before(const mce_deadline_t *a,
+				    const mce_deadline_t *b)
+{
+	if (a->latest != b->latest)
+		return a->latest < b->latest;
+
+	return a->seq < b->seq;
+}
+
+/**
+ * Swap two heap slots
+ *
+ * @param i Heap position
+ * @param j Heap position
+ */
+static void mce_deadline_heap_swap(gsize i, gsize j)
+{
+	mce_deadline_t *tmp = deadline_heap[i];
+
+	deadline_heap[i] = deadline_heap[j];
+	deadline_heap[j] = tmp;
+
+	deadline_heap[i]->pos = i;
+	deadline_heap[j]->pos = j;
+}
+
+/**
+ * Move a heap slot towards the top until the heap is ordered
+ *
+ * @param i Heap position
+ */
+static void mce_deadline_heap_sift_up(gsize i)
+{
+	while (i > 0) {
+		gsize parent = (i - 1) / 2;
+
+		if (mce_deadline_before(deadline_heap[i],
+					deadline_heap[parent]) == FALSE)
+			break;
+
+		mce_deadline_heap_swap(i, parent);
+		i = parent;
+	}
+}
+
+/**
+ * Move a heap slot towards the bottom until the heap is ordered
+ *
+ * @param i Heap position
+ */
+static void mce_deadline_heap_sift_down(gsize i)
+{
+	for (;;) {
+		gsize best = i;
+		gsize l = 2 * i + 1;
+		gsize r = 2 * i + 2;
+
+		if ((l < deadline_heap_len) &&
+		    mce_deadline_before(deadline_heap[l], deadline_heap[best]))
+			best = l;
+
+		if ((r < deadline_heap_len) &&
+		    mce_deadline_before(deadline_heap[r], deadline_heap[best]))
+			best = r;
+
+		if (best == i)
+			break;
+
+		mce_deadline_heap_swap(i, best);
+		i = best;
+	}
+}
+
+/**
+ * Remove a deadline from the heap
+ *
+ * @param deadline An active deadline
+ */
+static void mce_deadline_heap_remove(mce_deadline_t *deadline)
+{
+	gsize pos = deadline->pos;
+	gsize last = --deadline_heap_len;
+	mce_deadline_t *moved;
+
+	deadline->pos = DEADLINE_INACTIVE;
+
+	if (pos == last)
+		goto EXIT;
+
+	/* Fill the hole with the last slot and restore heap order */
+	moved = deadline_heap[last];
+	deadline_heap[pos] = moved;
+	moved->pos = pos;
+	mce_deadline_heap_sift_up(pos);
+	mce_deadline_heap_sift_down(moved->pos);
+
+EXIT:
+	return;
+}
+
+static void mce_deadline_program(void);
+
+/**
+ * Find the next deadline to dispatch
+ *
+ * The heap is ordered by the latest expiry, so deadlines whose
+ * tolerance window has opened can be anywhere in it; the number
+ * of deadlines is small enough for a linear scan on wakeups
+ *
+ * @param now The current time [ms]
+ * @param seq Deadlines started at or after this are skipped
+ * @return The expired deadline with the earliest expiry, or NULL
+ */
+static mce_deadline_t *mce_deadline_find_expired(gint64 now, guint64 seq)
+{
+	mce_deadline_t *best = NULL;
+	gsize i;
+
+	for (i = 0; i < deadline_heap_len; i++) {
+		mce_deadline_t *deadline = deadline_heap[i];
+
+		if ((deadline->due > now) || (deadline->seq >= seq))
+			continue;
+
+		if ((best == NULL) || (deadline->due < best->due) ||
+		    ((deadline->due == best->due) &&
+		     (deadline->seq < best->seq)))
+			best = deadline;
+	}
+
+	return best;
+}
+
+/**
+ * Dispatch the expired deadlines
+ *
+ * Deadlines that are started from the callbacks are left
+ * for the next round, even if they have already expired
+ */
+static void mce_deadline_dispatch(void)
+{
+	gint64 now = mce_lib_get_time_ms(deadline_clock);
+	guint64 seq = deadline_seq;
+	mce_deadline_t *deadline;
+
+	deadline_programmed = -1;
+
+	while ((deadline = mce_deadline_find_expired(now, seq)) != NULL) {
+		/* The callback may delete the deadline */
+		mce_wakeup_owner_t *owner = deadline->owner;
+		gint64 started = mce_wakeup_begin();
+
+		mce_deadline_heap_remove(deadline);
+
+		mce_log(LL_DEBUG, "deadline `%s' expired%s", deadline->name,
+			(deadline->latest > now) ? " (coalesced)" : "");
+		deadline->callback(deadline->user_data);
+
+		mce_wakeup_account(owner, started);
+	}
+
+	mce_deadline_program();
+}
+
+/**
+ * I/O watch callback for the timer file descriptors
+ *
+ * @param source The timer channel
+ * @param condition Unused
+ * @param data Unused
+ * @return Always returns TRUE to keep the watch
+ */
+static gboolean mce_deadline_input_cb(GIOChannel *source,
+				      GIOCondition condition,
+				      gpointer data)
+{
+	int fd = g_io_channel_unix_get_fd(source);
+	guint64 expirations = 0;
+
+	/* The callbacks may close the alarm timer; decide now */
+	const gboolean is_alarm = (fd == deadline_alarm_fd);
+
+	(void)condition;
+	(void)data;
+
+#ifdef ENABLE_WAKELOCKS
+	/* After an alarm wakeup the device may suspend again as
+	 * soon as the timer has been read; keep it up until the
+	 * callbacks have had a chance to act */
+	if (is_alarm)
+		wakelock_lock(DEADLINE_ALARM_WAKELOCK, -1);
+#endif
+
+	if ((read(fd, &expirations, sizeof expirations) == -1) &&
+	    (errno != EAGAIN)) {
+		mce_log(LL_WARN, "Failed to read deadline timer; %m");
+	}
+
+	errno = 0;
+
+	if (is_alarm)
+		deadline_alarm_programmed = -1;
+
+	mce_deadline_dispatch();
+
+#ifdef ENABLE_WAKELOCKS
+	if (is_alarm)
+		wakelock_unlock(DEADLINE_ALARM_WAKELOCK);
+#endif
+
+	return TRUE;
+}
+
+/**
+ * Fallback timeout callback, used if timerfd is not available
+ *
+ * @param data Unused
+ * @return Always returns FALSE; the timeout is re-added as needed
+ */
+static gboolean mce_deadline_timeout_cb(gpointer data)
+{
+	(void)data;
+
+	deadline_timeout_id = 0;
+	mce_deadline_dispatch();
+
+	return FALSE;
+}
+
+/**
+ * Program a timer file descriptor
+ *
+ * @param fd The timer file descriptor
+ * @param due Absolute expiry time [ms], or -1 to disarm
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_deadline_arm(int fd, gint64 due)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof its);
+
+	/* A zero expiry would disarm the timer */
+	if (due != -1) {
+		its.it_value.tv_sec = MAX(due, 1) / 1000;
+		its.it_value.tv_nsec = (MAX(due, 1) % 1000) * 1000000;
+	}
+
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		mce_log(LL_ERR, "Failed to program deadline timer; %m");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Program the alarm timer for the earliest active wakeup deadline
+ *
+ * The wakeup deadlines are few, so they are looked up
+ * with a linear scan instead of keeping a second heap
+ */
+static void mce_deadline_program_alarm(void)
+{
+	gint64 due = -1;
+	gsize i;
+
+	if (deadline_alarm_fd == -1)
+		goto EXIT;
+
+	for (i = 0; i < deadline_heap_len; i++) {
+		const mce_deadline_t *deadline = deadline_heap[i];
+
+		if ((deadline->wakeup == TRUE) &&
+		    ((due == -1) || (deadline->latest < due)))
+			due = deadline->latest;
+	}
+
+	if (due == deadline_alarm_programmed)
+		goto EXIT;
+
+	deadline_alarm_programmed = due;
+
+	if (mce_deadline_arm(deadline_alarm_fd, due) == FALSE)
+		deadline_alarm_programmed = -1;
+
+EXIT:
+	return;
+}
+
+/**
+ * Program the timer for the earliest active deadline
+ */
+static void mce_deadline_program(void)
+{
+	gint64 due = -1;
+
+	mce_deadline_program_alarm();
+
+	if (deadline_heap_len > 0)
+		due = deadline_heap[0]->latest;
+
+	if (due == deadline_programmed)
+		goto EXIT;
+
+	deadline_programmed = due;
+
+	if (deadline_timer_fd != -1) {
+		if (mce_deadline_arm(deadline_timer_fd, due) == FALSE)
+			deadline_programmed = -1;
+
+		goto EXIT;
+	}
+
+	if (deadline_timeout_id != 0) {
+		g_source_remove(deadline_timeout_id);
+		deadline_timeout_id = 0;
+	}
+
+	if (due != -1) {
+		gint64 now = mce_lib_get_time_ms(deadline_clock);
+		gint64 delay = MAX(due - now, 0);
+
+		deadline_timeout_id = g_timeout_add((guint)MIN(delay, G_MAXUINT),
+						    mce_deadline_timeout_cb,
+						    NULL);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Set up the timer file descriptor
+ *
+ * Falls back to a glib timeout if timerfd is not available
+ */
+static void mce_deadline_init(void)
+{
+	GIOChannel *iochan = NULL;
+
+	deadline_clock = CLOCK_BOOTTIME;
+	deadline_timer_fd = timerfd_create(deadline_clock,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (deadline_timer_fd == -1) {
+		deadline_clock = CLOCK_MONOTONIC;
+		deadline_timer_fd = timerfd_create(deadline_clock,
+						   TFD_NONBLOCK | TFD_CLOEXEC);
+	}
+
+	if (deadline_timer_fd == -1) {
+		mce_log(LL_WARN, "timerfd not available; %m");
+		goto EXIT;
+	}
+
+	if ((iochan = g_io_channel_unix_new(deadline_timer_fd)) == NULL)
+		goto EXIT;
+
+	deadline_watch_id = g_io_add_watch(iochan, G_IO_IN,
+					   mce_deadline_input_cb, NULL);
+
+EXIT:
+	if (iochan != NULL)
+		g_io_channel_unref(iochan);
+
+	/* Without a watch, the timerfd is of no use */
+	if ((deadline_watch_id == 0) && (deadline_timer_fd != -1)) {
+		close(deadline_timer_fd);
+		deadline_timer_fd = -1;
+		deadline_clock = CLOCK_MONOTONIC;
+	}
+
+	deadline_programmed = -1;
+	errno = 0;
+}
+
+/**
+ * Set up the alarm timer file descriptor
+ *
+ * The alarm clock shares its time base with CLOCK_BOOTTIME,
+ * so it is only used when the deadlines run on that clock
+ */
+static void mce_deadline_open_alarm(void)
+{
+	GIOChannel *iochan = NULL;
+
+	if ((deadline_alarm_fd != -1) || (deadline_alarm_failed == TRUE))
+		goto EXIT;
+
+	if (deadline_clock != CLOCK_BOOTTIME) {
+		deadline_alarm_failed = TRUE;
+		goto EXIT;
+	}
+
+	deadline_alarm_fd = timerfd_create(CLOCK_BOOTTIME_ALARM,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (deadline_alarm_fd == -1) {
+		/* EPERM without CAP_WAKE_ALARM; EINVAL on old kernels */
+		mce_log(LL_WARN, "alarm timer not available; %m");
+		deadline_alarm_failed = TRUE;
+		goto EXIT;
+	}
+
+	if ((iochan = g_io_channel_unix_new(deadline_alarm_fd)) == NULL)
+		goto EXIT;
+
+	deadline_alarm_watch_id = g_io_add_watch(iochan, G_IO_IN,
+						 mce_deadline_input_cb,
+						 NULL);
+
+EXIT:
+	if (iochan != NULL)
+		g_io_channel_unref(iochan);
+
+	if ((deadline_alarm_watch_id == 0) && (deadline_alarm_fd != -1)) {
+		close(deadline_alarm_fd);
+		deadline_alarm_fd = -1;
+		deadline_alarm_failed = TRUE;
+	}
+
+	deadline_alarm_programmed = -1;
+	errno = 0;
+}
+
+/**
+ * Release the alarm timer file descriptor
+ */
+static void mce_deadline_close_alarm(void)
+{
+	if (deadline_alarm_watch_id != 0) {
+		g_source_remove(deadline_alarm_watch_id);
+		deadline_alarm_watch_id = 0;
+	}
+
+	if (deadline_alarm_fd != -1) {
+		close(deadline_alarm_fd);
+		deadline_alarm_fd = -1;
+	}
+
+	deadline_alarm_programmed = -1;
+}
+
+/**
+ * Release the timer file descriptor
+ */
+static void mce_deadline_quit(void)
+{
+	mce_deadline_close_alarm();
+	deadline_alarm_failed = FALSE;
+
+	if (deadline_watch_id != 0) {
+		g_source_remove(deadline_watch_id);
+		deadline_watch_id = 0;
+	}
+
+	if (deadline_timeout_id != 0) {
+		g_source_remove(deadline_timeout_id);
+		deadline_timeout_id = 0;
+	}
+
+	if (deadline_timer_fd != -1) {
+		close(deadline_timer_fd);
+		deadline_timer_fd = -1;
+	}
+
+	g_free(deadline_heap);
+	deadline_heap = NULL;
+	deadline_heap_size = 0;
+	deadline_heap_len = 0;
+}
+
+/**
+ * Create a deadline timer
+ *
+ * The timer is created inactive
+ *
+ * @param name Name for debugging; must stay valid while the timer exists
+ * @param callback The expiry callback
+ * @param user_data User data for the callback
+ * @return The deadline timer
+ */
+mce_deadline_t *mce_deadline_create(const gchar *name,
+				    mce_deadline_cb callback,
+				    gpointer user_data)
+{
+	mce_deadline_t *deadline = g_malloc0(sizeof *deadline);
+
+	if (deadline_count++ == 0)
+		mce_deadline_init();
+
+	deadline->name = name;
+	deadline->callback = callback;
+	deadline->user_data = user_data;
+	deadline->pos = DEADLINE_INACTIVE;
+	deadline->owner = mce_wakeup_owner("deadline", name);
+
+	return deadline;
+}
+
+/**
+ * Delete a deadline timer
+ *
+ * @param deadline The deadline timer, or NULL
+ */
+void mce_deadline_delete(mce_deadline_t *deadline)
+{
+	if (deadline == NULL)
+		goto EXIT;
+
+	mce_deadline_set_wakeup(deadline, FALSE);
+	mce_deadline_stop(deadline);
+	g_free(deadline);
+
+	if (--deadline_count == 0)
+		mce_deadline_quit();
+
+EXIT:
+	return;
+}
+
+/**
+ * Start a deadline timer with a slack tolerance
+ *
+ * The timer expires at the earliest after delay, and at the latest
+ * after delay + slack; within that window it is dispatched together
+ * with other wakeups.  An active timer is rescheduled
+ *
+ * @param deadline The deadline timer, or NULL
+ * @param delay Time until the earliest expiry [ms]
+ * @param slack Tolerance for a later expiry [ms]
+ */
+void mce_deadline_start_slack(mce_deadline_t *deadline,
+			      gint64 delay, gint64 slack)
+{
+	if (deadline == NULL)
+		goto EXIT;
+
+	deadline->due = mce_lib_get_time_ms(deadline_clock) + MAX(delay, 0);
+	deadline->latest = deadline->due + MAX(slack, 0);
+	deadline->seq = deadline_seq++;
+
+	if (deadline->pos == DEADLINE_INACTIVE) {
+		if (deadline_heap_len == deadline_heap_size) {
+			deadline_heap_size = MAX(deadline_heap_size * 2, 8);
+			deadline_heap = g_renew(mce_deadline_t *,
+						deadline_heap,
+						deadline_heap_size);
+		}
+
+		deadline->pos = deadline_heap_len++;
+		deadline_heap[deadline->pos] = deadline;
+	}
+
+	/* The new expiry can be either earlier or later */
+	mce_deadline_heap_sift_up(deadline->pos);
+	mce_deadline_heap_sift_down(deadline->pos);
+
+	mce_deadline_program();
+
+EXIT:
+	return;
+}
+
+/**
+ * Start a deadline timer
+ *
+ * An active timer is rescheduled
+ *
+ * @param deadline The deadline timer, or NULL
+ * @param delay Time until expiry [ms]
+ */
+void mce_deadline_start(mce_deadline_t *deadline, gint64 delay)
+{
+	mce_deadline_start_slack(deadline, delay, 0);
+}
+
+/**
+ * Stop a deadline timer
+ *
+ * @param deadline The deadline timer, or NULL
+ */
+void mce_deadline_stop(mce_deadline_t *deadline)
+{
+	if ((deadline == NULL) || (deadline->pos == DEADLINE_INACTIVE))
+		goto EXIT;
+
+	mce_deadline_heap_remove(deadline);
+	mce_deadline_program();
+
+EXIT:
+	return;
+}
+
+/**
+ * Set whether a deadline timer resumes the device from suspend
+ *
+ * Meant for policy deadlines that must be enforced on time even
+ * when nothing else wakes the device up; the other deadlines
+ * fire on the next resume, which costs no extra wakeups
+ *
+ * @param deadline The deadline timer, or NULL
+ * @param wakeup TRUE to resume from suspend on expiry, FALSE not to
+ */
+void mce_deadline_set_wakeup(mce_deadline_t *deadline, gboolean wakeup)
+{
+	if ((deadline == NULL) || (deadline->wakeup == wakeup))
+		goto EXIT;
+
+	deadline->wakeup = wakeup;
+
+	if (wakeup == TRUE) {
+		if (deadline_wakeup_count++ == 0)
+			mce_deadline_open_alarm();
+	} else if (--deadline_wakeup_count == 0) {
+		mce_deadline_close_alarm();
+	}
+
+	mce_deadline_program_alarm();
+
+EXIT:
+	return;
+}
+
+/**
+ * Check whether a deadline timer is active
+ *
+ * @param deadline The deadline timer, or NULL
+ * @return TRUE if the timer is active, FALSE otherwise
+ */
+gboolean mce_deadline_is_active(const mce_deadline_t *deadline)
+{
+	return (deadline != NULL) && (deadline->pos != DEADLINE_INACTIVE);
+}
+
+/**
+ * Dispatch deadlines on an external wakeup
+ *
+ * Called when mce is woken up anyway, e.g. for the DSME heartbeat,
+ * so that deadlines within their tolerance window can expire now
+ * instead of waking the device up again later
+ */
+void mce_deadline_wakeup(void)
+{
+	if (deadline_heap_len > 0)
+		mce_deadline_dispatch();
+}
@@ -0,0 +1,49 @@
+/**
+ * @file mce-deadline.h
+ * Headers for the deadline timer queue
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_DEADLINE_H_
+#define _MCE_DEADLINE_H_
+
+#include <glib.h>
+
+/**
+ * Callback for an expired deadline
+ *
+ * The deadline is no longer active when this is called;
+ * the callback may start it again
+ *
+ * @param user_data The user data given to mce_deadline_create()
+ */
+typedef void (*mce_deadline_cb)(gpointer user_data);
+
+/** Deadline timer; only access this struct through the functions */
+typedef struct mce_deadline_t mce_deadline_t;
+
+mce_deadline_t *mce_deadline_create(const gchar *name,
+				    mce_deadline_cb callback,
+				    gpointer user_data);
+void mce_deadline_delete(mce_deadline_t *deadline);
+void mce_deadline_start(mce_deadline_t *deadline, gint64 delay);
+void mce_deadline_start_slack(mce_deadline_t *deadline,
+			      gint64 delay, gint64 slack);
+void mce_deadline_stop(mce_deadline_t *deadline);
+void mce_deadline_set_wakeup(mce_deadline_t *deadline, gboolean wakeup);
+gboolean mce_deadline_is_active(const mce_deadline_t *deadline);
+void mce_deadline_wakeup(void);
+
+#endif /* _MCE_DEADLINE_H_ */
@@ -25,6 +25,7 @@
 
 #include <time.h>			/* time(), time_t */
 #include <errno.h>			/* errno */
+#include <poll.h>			/* poll(), POLLIN, POLLOUT */
 #include <stdlib.h>			/* exit(), free(), EXIT_FAILURE */
 #include <unistd.h>			/* getpid() */
 
@@ -61,7 +62,8 @@
 					 */
 #include "mce-dsme.h"
 
-#include "mce-lib.h"		/* mce_translate_string_to_int_with_default(),
+#include "mce-lib.h"		/* mce_lib_get_time_ms(),
+				 * mce_translate_string_to_int_with_default(),
 				 * mce_translation_t
 				 */
 #include "mce-log.h"			/* mce_log(), LL_* */
@@ -69,6 +71,7 @@
 					 * DBUS_MESSAGE_TYPE_SIGNAL
 					 */
 #include "mce-conf.h"			/* mce_conf_get_string() */
+#include "mce-deadline.h"		/* mce_deadline_wakeup() */
 #include "datapipe.h"			/* execute_datapipe(),
 					 * execute_datapippe_output_triggers(),
 					 * datapipe_get_gint(),
@@ -110,16 +113,138 @@ static GIOChannel *dsme_iochan = NULL;
 static guint dsme_data_source_id;
 /** dsme error channel GSource ID */
 static guint dsme_error_source_id;
+/** dsme outbound queue GSource ID */
+static guint dsme_send_source_id = 0;
+
+/** Messages waiting for the DSME socket to become writable */
+static GQueue dsme_send_queue = G_QUEUE_INIT;
+
+/** Time the pending system state query was queued [ms]; 0 if none */
+static gint64 dsme_query_sent = 0;
+/** Number of answered system state queries */
+static guint dsme_query_count = 0;
+/** Last system state query round-trip time [ms] */
+static gint64 dsme_query_rtt_last = 0;
+/** Longest system state query round-trip time [ms] */
+static gint64 dsme_query_rtt_max = 0;
 
 static gboolean init_dsmesock(void);
 
+/**
+ * Check whether the DSME socket is ready for I/O
+ *
+ * @param events POLLIN or POLLOUT
+ * @param timeout Time to wait [ms]; 0 to just check
+ * @return TRUE if the socket is ready, FALSE otherwise
+ */
+static gboolean dsme_socket_ready(short events, int timeout)
+{
+	struct pollfd pfd = { .fd = dsme_conn->fd, .events = events };
+
+	return (poll(&pfd, 1, timeout) == 1) && (pfd.revents & events);
+}
+
+/**
+ * Send one queued message to DSME
+ *
+ * @param msg The message to send
+ */
+static void dsme_send_message(gconstpointer msg)
+{
+	if ((dsmesock_send(dsme_conn, msg)) == -1) {
+		mce_log(LL_CRIT,
+			"dsmesock_send error: %s",
+			g_strerror(errno));
+#ifdef MCE_DSME_ERROR_POLICY
+		// FIXME: this is not how one should exit from mainloop
+		mce_quit_mainloop();
+		exit(EXIT_FAILURE);
+#endif /* MCE_DSME_ERROR_POLICY */
+	}
+}
+
+/**
+ * Send queued messages while the DSME socket is writable
+ *
+ * @param timeout Time to wait for the socket per message [ms]
+ * @return TRUE if the queue was emptied, FALSE otherwise
+ */
+static gboolean dsme_send_flush(int timeout)
+{
+	gpointer msg;
+
+	while (g_queue_is_empty(&dsme_send_queue) == FALSE) {
+		if (dsme_socket_ready(POLLOUT, timeout) == FALSE)
+			break;
+
+		msg = g_queue_pop_head(&dsme_send_queue);
+		dsme_send_message(msg);
+		g_free(msg);
+	}
+
+	return g_queue_is_empty(&dsme_send_queue);
+}
+
+/**
+ * Callback for the DSME socket becoming writable
+ *
+ * @param source Unused
+ * @param condition Unused
+ * @param data Unused
+ * @return TRUE while there are queued messages, FALSE otherwise
+ */
+static gboolean dsme_send_cb(GIOChannel *source,
+			     GIOCondition condition,
+			     gpointer data)
+{
+	gboolean keep = TRUE;
+
+	(void)source;
+	(void)condition;
+	(void)data;
+
+	if (dsme_send_flush(0) == TRUE) {
+		dsme_send_source_id = 0;
+		keep = FALSE;
+	}
+
+	return keep;
+}
+
+/**
+ * Discard the messages that could not be sent
+ */
+static void dsme_send_clear(void)
+{
+	gpointer msg;
+
+	if (dsme_send_source_id != 0) {
+		g_source_remove(dsme_send_source_id);
+		dsme_send_source_id = 0;
+	}
+
+	if (g_queue_is_empty(&dsme_send_queue) == FALSE) {
+		mce_log(LL_WARN,
+			"Dropping %u unsent DSME messages",
+			g_queue_get_length(&dsme_send_queue));
+	}
+
+	while ((msg = g_queue_pop_head(&dsme_send_queue)) != NULL)
+		g_free(msg);
+}
+
 /**
  * Generic send function for dsmesock messages
+ *
+ * The message is copied to an outbound queue that is written
+ * to the socket only when it is writable, so that a DSME that
+ * does not keep up can not stall the mainloop
  * XXX: How should we handle sending failures?
  *
  * @param msg A pointer to the message to send
+ * @param size The size of the message struct
  */
-static void mce_dsme_send(gpointer msg)
+static void mce_dsme_send(gconstpointer msg, gsize size)
 {
 	if (dsme_disabled == TRUE)
 		goto EXIT;
@@ -132,15 +257,16 @@ static void mce_dsme_send(gpointer msg)
 		exit(EXIT_FAILURE);
 	}
 
-	if ((dsmesock_send(dsme_conn, msg)) == -1) {
-		mce_log(LL_CRIT,
-			"dsmesock_send error: %s",
-			g_strerror(errno));
-#ifdef MCE_DSME_ERROR_POLICY
-		// FIXME: this is not how one should exit from mainloop
-		mce_quit_mainloop();
-		exit(EXIT_FAILURE);
-#endif /* MCE_DSME_ERROR_POLICY */
+	g_queue_push_tail(&dsme_send_queue, g_memdup(msg, size));
+
+	if (dsme_send_flush(0) == TRUE)
+		goto EXIT;
+
+	if ((dsme_send_source_id == 0) && (dsme_iochan != NULL)) {
+		mce_log(LL_DEBUG,
+			"DSME socket not writable; queueing messages");
+		dsme_send_source_id = g_io_add_watch(dsme_iochan, G_IO_OUT,
+						     dsme_send_cb, NULL);
 	}
 
 EXIT:
@@ -158,10 +284,13 @@ static void dsme_send_pong(void)
 	msg.pid = getpid();
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_PROCESSWD_PONG sent to DSME");
 
+	/* Let deadlines with slack piggyback on the heartbeat wakeup */
+	mce_deadline_wakeup();
+
 	execute_datapipe(&heartbeat_pipe, GINT_TO_POINTER(0),
 			 USE_INDATA, DONT_CACHE_INDATA);
 }
@@ -177,7 +306,7 @@ static void dsme_init_processwd(void)
 	msg.pid = getpid();
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_PROCESSWD_CREATE sent to DSME");
 }
@@ -196,7 +325,7 @@ static void dsme_exit_processwd(void)
 	msg.pid = getpid();
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_PROCESSWD_DELETE sent to DSME");
 }
@@ -210,9 +339,41 @@ static void query_system_state(void)
 	DSM_MSGTYPE_STATE_QUERY msg = DSME_MSG_INIT(DSM_MSGTYPE_STATE_QUERY);
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_STATE_QUERY sent to DSME");
+
+	/* Measure the round-trip time from the first unanswered query */
+	if (dsme_query_sent == 0)
+		dsme_query_sent = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+}
+
+/**
+ * Update the system state query round-trip statistics
+ *
+ * Called when a state indication is received; DSME answers the
+ * query with one, but it also sends them unsolicited
+ */
+static void dsme_query_answered(void)
+{
+	gint64 rtt;
+
+	if (dsme_query_sent == 0)
+		goto EXIT;
+
+	rtt = mce_lib_get_time_ms(CLOCK_MONOTONIC) - dsme_query_sent;
+	dsme_query_sent = 0;
+
+	dsme_query_count++;
+	dsme_query_rtt_last = rtt;
+	dsme_query_rtt_max = MAX(dsme_query_rtt_max, rtt);
+
+	mce_log((rtt >= DSME_QUERY_RTT_WARN) ? LL_WARN : LL_DEBUG,
+		"DSME system state query answered in %" G_GINT64_FORMAT
+		" ms", rtt);
+
+EXIT:
+	return;
 }
 
 /**
@@ -224,7 +385,7 @@ void request_powerup(void)
 	DSM_MSGTYPE_POWERUP_REQ msg = DSME_MSG_INIT(DSM_MSGTYPE_POWERUP_REQ);
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_POWERUP_REQ sent to DSME");
 }
@@ -238,7 +399,7 @@ void request_reboot(void)
 	DSM_MSGTYPE_REBOOT_REQ msg = DSME_MSG_INIT(DSM_MSGTYPE_REBOOT_REQ);
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_REBOOT_REQ sent to DSME");
 }
@@ -325,7 +486,7 @@ void request_normal_shutdown(void)
 	DSM_MSGTYPE_SHUTDOWN_REQ msg = DSME_MSG_INIT(DSM_MSGTYPE_SHUTDOWN_REQ);
 
 	/* Send the message */
-	mce_dsme_send(&msg);
+	mce_dsme_send(&msg, sizeof msg);
 	mce_log(LL_DEBUG,
 		"DSM_MSGTYPE_SHUTDOWN_REQ (DSME_NORMAL_SHUTDOWN) "
 		"sent to DSME");
@@ -392,34 +553,25 @@ static system_state_t normalise_dsme_state(dsme_state_t dsmestate)
 }
 
 /**
- * Callback for pending I/O from dsmesock
+ * Receive and handle one message from dsmesock
  *
  * XXX: is the error policy reasonable?
  *
- * @param source Unused
- * @param condition Unused
- * @param data Unused
- * @return TRUE on success, FALSE on failure
+ * @return TRUE if more messages can be handled, FALSE otherwise
  */
-static gboolean io_data_ready_cb(GIOChannel *source,
-				 GIOCondition condition,
-				 gpointer data)
+static gboolean dsme_handle_message(void)
 {
+	gboolean more = FALSE;
 	dsmemsg_generic_t *msg;
 	DSM_MSGTYPE_STATE_CHANGE_IND *msg2;
 	system_state_t oldstate = datapipe_get_gint(system_state_pipe);
 	system_state_t newstate = MCE_STATE_UNDEF;
 
-	(void)source;
-	(void)condition;
-	(void)data;
-
-	if (dsme_disabled == TRUE)
-		goto EXIT;
-
 	if ((msg = (dsmemsg_generic_t *)dsmesock_receive(dsme_conn)) == NULL)
 		goto EXIT;
 
+	more = TRUE;
+
         if (DSMEMSG_CAST(DSM_MSGTYPE_CLOSE, msg)) {
 		/* DSME socket closed: try once to reopen;
 		 * if that fails, exit
@@ -432,6 +584,9 @@ static gboolean io_data_ready_cb(GIOChannel *source,
 			mce_quit_mainloop();
 			exit(EXIT_FAILURE);
 		}
+
+		/* Continue on the next wakeup */
+		more = FALSE;
         } else if (DSMEMSG_CAST(DSM_MSGTYPE_PROCESSWD_PING, msg)) {
 		dsme_send_pong();
         } else if ((msg2 = DSMEMSG_CAST(DSM_MSGTYPE_STATE_CHANGE_IND, msg))) {
@@ -440,6 +595,8 @@ static gboolean io_data_ready_cb(GIOChannel *source,
 			"DSME device state change: %d",
 			newstate);
 
+		dsme_query_answered();
+
 		/* If we're changing to a different state,
 		 * add the transition flag, UNLESS the old state
 		 * was MCE_STATE_UNDEF
@@ -477,6 +634,44 @@ static gboolean io_data_ready_cb(GIOChannel *source,
 
 	free(msg);
 
+EXIT:
+	return more;
+}
+
+/**
+ * Callback for pending I/O from dsmesock
+ *
+ * Handles all the messages that are already available, up to
+ * DSME_RECV_BATCH_MAX, so that a burst of messages does not
+ * cost one mainloop iteration each
+ *
+ * @param source Unused
+ * @param condition Unused
+ * @param data Unused
+ * @return Always returns TRUE to keep the watch
+ */
+static gboolean io_data_ready_cb(GIOChannel *source,
+				 GIOCondition condition,
+				 gpointer data)
+{
+	guint count;
+
+	(void)source;
+	(void)condition;
+	(void)data;
+
+	if (dsme_disabled == TRUE)
+		goto EXIT;
+
+	for (count = 0; count < DSME_RECV_BATCH_MAX; count++) {
+		/* The first read is known not to block */
+		if ((count > 0) && (dsme_socket_ready(POLLIN, 0) == FALSE))
+			break;
+
+		if (dsme_handle_message() == FALSE)
+			break;
+	}
+
 EXIT:
 	return TRUE;
 }
@@ -603,6 +798,20 @@ static void close_dsmesock(void)
 	mce_log(LL_DEBUG,
 		"Shutting down dsmesock I/O channel");
 
+	/* Give DSME a moment to take the pending messages,
+	 * e.g. the process watchdog unregistration
+	 */
+	dsme_send_flush(DSME_SEND_FLUSH_TIMEOUT);
+	dsme_send_clear();
+
+	if (dsme_query_count > 0) {
+		mce_log(LL_DEBUG,
+			"DSME system state queries: %u, round-trip last %"
+			G_GINT64_FORMAT " ms, max %" G_GINT64_FORMAT " ms",
+			dsme_query_count, dsme_query_rtt_last,
+			dsme_query_rtt_max);
+	}
+
 	if (dsme_iochan != NULL) {
 		GError *error = NULL;
 		g_source_remove(dsme_data_source_id);
@@ -26,6 +26,15 @@
 /** Default delay before the user can power up the device from acting dead */
 #define TRANSITION_DELAY		1000		/**< 1 second */
 
+/** Maximum number of DSME messages handled per wakeup */
+#define DSME_RECV_BATCH_MAX		16
+
+/** Time to wait for queued DSME messages to be sent on exit; [ms] */
+#define DSME_SEND_FLUSH_TIMEOUT		500
+
+/** System state query round-trip time that is logged as slow; [ms] */
+#define DSME_QUERY_RTT_WARN		1000
+
 /** Name of Powerkey configuration group */
 #define MCE_CONF_SOFTPOWEROFF_GROUP	"SoftPowerOff"
 
@@ -418,6 +418,9 @@ void mce_gconf_exit(void)
 			gconf_notifiers = NULL;
 		}
 #ifdef ENABLE_BUILTIN_GCONF
+		/* Write values still waiting for delayed save */
+		gconf_client_save_pending(gconf_client);
+
 		/* FIME: did not notice that gconf clients are GObjects ...
 		 *       now we can't g_object_unref() the client pointers
 		 *       from builtin-gconf
@@ -41,4 +41,12 @@ void mce_gconf_notifier_remove(gpointer cb_id, gpointer user_data);
 gboolean mce_gconf_init(void);
 void mce_gconf_exit(void);
 
+#ifdef ENABLE_BUILTIN_GCONF
+/* Not part of GConf API; provided by builtin-gconf.c */
+gboolean gconf_client_set_list_nocopy(GConfClient *client, const gchar *key,
+				      GConfValueType list_type, GSList *list,
+				      GError **err);
+void gconf_client_save_pending(GConfClient *client);
+#endif
+
 #endif /* _MCE_GCONF_H_ */
@@ -20,13 +20,16 @@
  */
 #include <glib.h>
 
-#include <string.h>			/* strstr() */
+#include <sys/utsname.h>		/* uname(), struct utsname */
+
+#include <string.h>			/* strstr(), strcmp() */
 #include <stdlib.h>			/* free() */
 
 #include "mce-hal.h"
 
 #include "mce-lib.h"			/* strmemcmp() */
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-io.h"			/* mce_io_update_file_atomic_async() */
 #include "mce-dbus.h"			/* dbus_send(),
 					 * dbus_message_iter_init(),
 					 * dbus_message_iter_get_arg_type(),
@@ -65,11 +68,215 @@
 /** The sysinfo key to request */
 #define PRODUCT_SYSINFO_KEY		"/component/product"
 
+/** Path to the hardware identity cache */
+#define MCE_HAL_CACHE_PATH		G_STRINGIFY(MCE_VAR_DIR)"/mce-hal.cache"
+
+/** Cache group for the identity the cached values were probed on */
+#define MCE_HAL_CACHE_IDENTITY_GROUP	"Identity"
+
+/** Cache key for the identity the cached values were probed on */
+#define MCE_HAL_CACHE_IDENTITY_KEY	"Stamp"
+
+/** Cache group for the probed values */
+#define MCE_HAL_CACHE_VALUES_GROUP	"Values"
+
+/** Cache key for the product ID */
+#define MCE_HAL_CACHE_PRODUCT_KEY	"product"
+
 /**
  * The product ID of the device
  */
 static product_id_t product_id = PRODUCT_UNSET;
 
+/** Hardware identity cache; loaded on first use */
+static GKeyFile *hal_cache = NULL;
+
+/**
+ * Describe the kernel and device mce is running on
+ *
+ * @return A newly allocated identity string, or NULL on failure;
+ *         this string should be freed when no longer used
+ */
+static gchar *mce_hal_get_identity(void)
+{
+	static const char * const model_paths[] = {
+		"/proc/device-tree/model",
+		"/sys/class/dmi/id/product_name",
+		NULL
+	};
+
+	struct utsname un;
+	gchar *model = NULL;
+	gchar *identity = NULL;
+
+	if (uname(&un) == -1) {
+		mce_log(LL_WARN, "uname: %m");
+		goto EXIT;
+	}
+
+	for (size_t i = 0; model_paths[i]; ++i) {
+		if (g_file_get_contents(model_paths[i], &model, NULL, NULL))
+			break;
+	}
+
+	identity = g_strdup_printf("%s %s %s %s",
+				   un.release, un.version, un.machine,
+				   model ? g_strstrip(model) : "-");
+
+EXIT:
+	g_free(model);
+
+	return identity;
+}
+
+/**
+ * Get the hardware identity cache
+ *
+ * The cache is discarded if it was written on a different
+ * kernel or device than the current one
+ *
+ * @return The cache key file
+ */
+static GKeyFile *mce_hal_cache(void)
+{
+	gchar *identity = NULL;
+	gchar *stamp = NULL;
+
+	if (hal_cache != NULL)
+		goto EXIT;
+
+	identity = mce_hal_get_identity();
+	hal_cache = g_key_file_new();
+
+	if (g_key_file_load_from_file(hal_cache, MCE_HAL_CACHE_PATH,
+				      0, NULL) == TRUE) {
+		stamp = g_key_file_get_string(hal_cache,
+					      MCE_HAL_CACHE_IDENTITY_GROUP,
+					      MCE_HAL_CACHE_IDENTITY_KEY,
+					      NULL);
+
+		if ((identity != NULL) && (stamp != NULL) &&
+		    (strcmp(identity, stamp) == 0)) {
+			mce_log(LL_NOTICE, "using %s", MCE_HAL_CACHE_PATH);
+			goto EXIT;
+		}
+
+		mce_log(LL_NOTICE, "%s: stale; probing hardware",
+			MCE_HAL_CACHE_PATH);
+		g_key_file_free(hal_cache);
+		hal_cache = g_key_file_new();
+	}
+
+	/* An empty stamp never matches; without an identity
+	 * the cached values are not used on the next boot */
+	g_key_file_set_string(hal_cache,
+			      MCE_HAL_CACHE_IDENTITY_GROUP,
+			      MCE_HAL_CACHE_IDENTITY_KEY,
+			      identity ?: "");
+
+EXIT:
+	g_free(stamp);
+	g_free(identity);
+
+	return hal_cache;
+}
+
+/**
+ * Write the hardware identity cache to disk
+ */
+static void mce_hal_cache_save(void)
+{
+	gsize len = 0;
+	gchar *data = g_key_file_to_data(mce_hal_cache(), &len, NULL);
+
+	if (data != NULL) {
+		mce_io_update_file_atomic_async(MCE_HAL_CACHE_PATH, data, len,
+						0644, FALSE, 0, 0);
+	}
+
+	g_free(data);
+}
+
+/**
+ * Get a string from the hardware identity cache
+ *
+ * @param key The cache key
+ * @return A newly allocated string, or NULL if the value is not cached;
+ *         this string should be freed when no longer used
+ */
+gchar *mce_hal_cache_get_string(const gchar *const key)
+{
+	return g_key_file_get_string(mce_hal_cache(),
+				     MCE_HAL_CACHE_VALUES_GROUP, key, NULL);
+}
+
+/**
+ * Store a string to the hardware identity cache
+ *
+ * @param key The cache key
+ * @param value The value to cache, or NULL to drop the cached value
+ */
+void mce_hal_cache_set_string(const gchar *const key,
+			      const gchar *const value)
+{
+	gchar *old = mce_hal_cache_get_string(key);
+
+	if (value == NULL) {
+		if (old == NULL)
+			goto EXIT;
+
+		g_key_file_remove_key(mce_hal_cache(),
+				      MCE_HAL_CACHE_VALUES_GROUP, key, NULL);
+	} else {
+		if ((old != NULL) && (strcmp(old, value) == 0))
+			goto EXIT;
+
+		g_key_file_set_string(mce_hal_cache(),
+				      MCE_HAL_CACHE_VALUES_GROUP, key, value);
+	}
+
+	mce_hal_cache_save();
+
+EXIT:
+	g_free(old);
+}
+
+/**
+ * Get an integer from the hardware identity cache
+ *
+ * @param key The cache key
+ * @param defval The value to return if the value is not cached
+ * @return The cached value, or defval
+ */
+gint mce_hal_cache_get_int(const gchar *const key, const gint defval)
+{
+	GError *error = NULL;
+	gint value = g_key_file_get_integer(mce_hal_cache(),
+					    MCE_HAL_CACHE_VALUES_GROUP,
+					    key, &error);
+
+	if (error != NULL)
+		value = defval;
+
+	g_clear_error(&error);
+
+	return value;
+}
+
+/**
+ * Store an integer to the hardware identity cache
+ *
+ * @param key The cache key
+ * @param value The value to cache
+ */
+void mce_hal_cache_set_int(const gchar *const key, const gint value)
+{
+	gchar *tmp = g_strdup_printf("%d", value);
+
+	mce_hal_cache_set_string(key, tmp);
+	g_free(tmp);
+}
+
 /**
  * Retrieve a sysinfo value via D-Bus
  *
@@ -131,7 +338,12 @@ product_id_t get_product_id(void)
 	if (product_id != PRODUCT_UNSET)
 		goto EXIT;
 
-	product_id = PRODUCT_UNKNOWN;
+	/* Avoid the blocking sysinfod query on repeat boots */
+	product_id = mce_hal_cache_get_int(MCE_HAL_CACHE_PRODUCT_KEY,
+					   PRODUCT_UNKNOWN);
+
+	if (product_id != PRODUCT_UNKNOWN)
+		goto EXIT;
 
 	if( !get_sysinfo_value(PRODUCT_SYSINFO_KEY, &tmp, &len) ) {
 		// nothing
@@ -161,6 +373,8 @@ product_id_t get_product_id(void)
 
 	if ( product_id == PRODUCT_UNKNOWN ) {
 		mce_log(LL_ERR,	"Failed to get the product ID");
+	} else {
+		mce_hal_cache_set_int(MCE_HAL_CACHE_PRODUCT_KEY, product_id);
 	}
 
 EXIT:
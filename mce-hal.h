@@ -53,4 +53,10 @@ typedef enum {
 gboolean get_sysinfo_value(const gchar *const key, guint8 **array, gulong *len);
 product_id_t get_product_id(void);
 
+gchar *mce_hal_cache_get_string(const gchar *const key);
+void mce_hal_cache_set_string(const gchar *const key,
+			      const gchar *const value);
+gint mce_hal_cache_get_int(const gchar *const key, const gint defval);
+void mce_hal_cache_set_int(const gchar *const key, const gint value);
+
 #endif /* _MCE_HAL_H_ */
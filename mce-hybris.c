@@ -11,8 +11,8 @@
  * elements these functions turn in to "NOP and return failure".
  *
  * In addition to the above this module also:
- * - moves sensor input data via pipe from worker thread context to the
- *   thread that is running the glib mainloop.
+ * - moves sensor input data via ring buffer from worker thread context
+ *   to the thread that is running the glib mainloop.
  * - proxies diagnostic output from hybris-plugin to mce_log()
  * ========================================================================= */
 
@@ -24,9 +24,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <sys/eventfd.h>
 
 #include <glib.h>
 
@@ -34,26 +36,31 @@ static void mce_hybris_ps_set_hook(mce_hybris_ps_fn cb);
 static void mce_hybris_als_set_hook(mce_hybris_als_fn cb);
 
 /* ------------------------------------------------------------------------- *
- * Feeding sensor data via pipe to glib mainloop goes roughly as follows
+ * Feeding sensor data via ring buffer to glib mainloop goes roughly as follows
  *
  * --- mce-libhybris-plugin worker thread --
  * 1) uses blocking poll_dev->poll() function to read sensor data
- * 2) uses a set of callbacks to write the data to a pipe
+ * 2) uses a set of callbacks to store the data to a ring buffer, and
+ *    rings an eventfd doorbell if the mainloop is waiting for data
  * --- mce-libhybris-module --
- * 3) iowatch reads the data from pipe
+ * 3) iowatch on the eventfd drains all the data from the ring buffer
  * 4) and passes the data to mce via another set of callbacks
  * --- mce sensor handling code --
  * 5) can act on the data in the context that runs gmainloop
+ *
+ * The ring buffer has a single producer (the worker thread) and a
+ * single consumer (the mainloop); each side only writes its own index,
+ * so no locking is needed.
  * ------------------------------------------------------------------------- */
 
-/** Sensor enumeration for mux @ worker thread -> pipe -> demux @ mainloop */
+/** Sensor enumeration for mux @ worker thread -> ring -> demux @ mainloop */
 enum
 {
   EVEPIPE_ALS,
   EVEPIPE_PS,
 };
 
-/** Sensor data passed over pipe */
+/** Sensor data passed over ring buffer */
 typedef struct
 {
   int64_t time;  // time stamp from android side
@@ -61,7 +68,10 @@ typedef struct
   float   value; // sensor data from android side
 } evepipe_t;
 
-/** Initialize once flag for sensor data pipe */
+/** Number of slots in the sensor data ring buffer; must be power of 2 */
+#define EVEPIPE_RING_SIZE 256
+
+/** Initialize once flag for sensor data ring buffer */
 static bool evepipe_done = false;
 
 /** Callback for handling proximity data */
@@ -70,13 +80,60 @@ static mce_hybris_ps_fn  evepipe_ps_cb  = 0;
 /** Callback for handling ambient light data */
 static mce_hybris_als_fn evepipe_als_cb = 0;
 
-/** The sensor data pipe */
-static int               evepipe_fd[2]  = { -1, -1 };
+/** The sensor data ring buffer */
+static evepipe_t         evepipe_ring[EVEPIPE_RING_SIZE];
+
+/** Number of samples stored; written by the worker thread only */
+static volatile gint     evepipe_head   = 0;
+
+/** Number of samples consumed; written by the mainloop only */
+static volatile gint     evepipe_tail   = 0;
+
+/** Non-zero if the mainloop waits for the doorbell */
+static volatile gint     evepipe_armed  = 1;
+
+/** Number of samples dropped due to full ring buffer */
+static volatile gint     evepipe_drops  = 0;
 
-/** I/O watch id for the sensor data pipe */
+/** The doorbell eventfd */
+static int               evepipe_fd     = -1;
+
+/** I/O watch id for the doorbell eventfd */
 static guint             evepipe_id     = 0;
 
-/** I/O watch callback for handling pipe input
+/** Pass all samples in the ring buffer to mce
+ */
+static void evepipe_drain(void)
+{
+  guint tail = (guint)g_atomic_int_get(&evepipe_tail);
+  guint head = (guint)g_atomic_int_get(&evepipe_head);
+
+  for( ; tail != head; ++tail ) {
+    const evepipe_t *eve = &evepipe_ring[tail & (EVEPIPE_RING_SIZE - 1)];
+
+    switch( eve->type ) {
+    case EVEPIPE_PS:
+      if( evepipe_ps_cb ) {
+        evepipe_ps_cb(eve->time, eve->value);
+      }
+      break;
+
+    case EVEPIPE_ALS:
+      if( evepipe_als_cb ) {
+        evepipe_als_cb(eve->time, eve->value);
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  /* release the slots back to the worker thread */
+  g_atomic_int_set(&evepipe_tail, (gint)tail);
+}
+
+/** I/O watch callback for handling the doorbell
  *
  * @param channel    (not used)
  * @param condition  (not used)
@@ -93,9 +150,9 @@ static gboolean evepipe_recv_cb(GIOChannel *channel,
 
   gboolean keep_going = TRUE;
 
-  evepipe_t eve[64];
+  uint64_t cnt = 0;
 
-  int rc = read(evepipe_fd[0], eve, sizeof eve);
+  int rc = read(evepipe_fd, &cnt, sizeof cnt);
 
   if( rc < 0 ) {
     switch( errno ) {
@@ -104,32 +161,32 @@ static gboolean evepipe_recv_cb(GIOChannel *channel,
       break;
 
     default:
-      mce_log(LL_ERR, "failed to read sensor events: %m");
+      mce_log(LL_ERR, "failed to read sensor event doorbell: %m");
       keep_going = FALSE;
       break;
     }
     goto cleanup;
   }
 
-  rc /= sizeof *eve;
+  for( ;; ) {
+    evepipe_drain();
 
-  for( int i = 0; i < rc; ++i ) {
-    switch( eve[i].type ) {
-    case EVEPIPE_PS:
-      if( evepipe_ps_cb ) {
-        evepipe_ps_cb(eve[i].time, eve[i].value);
-      }
-      break;
+    /* ask for the doorbell, then check for samples that were
+     * stored after draining but before arming */
+    g_atomic_int_set(&evepipe_armed, 1);
 
-    case EVEPIPE_ALS:
-      if( evepipe_als_cb ) {
-        evepipe_als_cb(eve[i].time, eve[i].value);
-      }
+    if( g_atomic_int_get(&evepipe_head) == g_atomic_int_get(&evepipe_tail) )
       break;
 
-    default:
+    /* if the worker already took the arming, the doorbell is
+     * ringing and the samples get drained on the next wakeup */
+    if( !g_atomic_int_compare_and_exchange(&evepipe_armed, 1, 0) )
       break;
-    }
+  }
+
+  if( (rc = g_atomic_int_get(&evepipe_drops)) ) {
+    g_atomic_int_add(&evepipe_drops, -rc);
+    mce_log(LL_WARN, "sensor event ring buffer full; %d events lost", rc);
   }
 
 cleanup:
@@ -142,7 +199,10 @@ cleanup:
   return keep_going;
 }
 
-/** Write sensor data to the pipe
+/** Store sensor data to the ring buffer
+ *
+ * Called from the worker thread; if the ring buffer is full the
+ * sample is dropped, and the mainloop reports how many got lost
  *
  * @param timestamp nanoseconds
  * @param type      EVEPIPE_ALS or EVEPIPE_PS
@@ -150,24 +210,39 @@ cleanup:
  */
 static void evepipe_send(int64_t timestamp, int32_t type, float data)
 {
-  evepipe_t eve =
-  {
-    .time  = timestamp,
-    .type  = type,
-    .value = data,
-  };
+  guint head = (guint)g_atomic_int_get(&evepipe_head);
+  guint tail = (guint)g_atomic_int_get(&evepipe_tail);
+
+  if( head - tail >= EVEPIPE_RING_SIZE ) {
+    g_atomic_int_inc(&evepipe_drops);
+    goto EXIT;
+  }
+
+  evepipe_t *eve = &evepipe_ring[head & (EVEPIPE_RING_SIZE - 1)];
+
+  eve->time  = timestamp;
+  eve->type  = type;
+  eve->value = data;
 
-  int rc = TEMP_FAILURE_RETRY(write(evepipe_fd[1], &eve, sizeof eve));
+  /* publish the sample; the atomic store orders the slot writes */
+  g_atomic_int_set(&evepipe_head, (gint)(head + 1));
 
-  if( rc != sizeof eve ) {
-    // TODO: since this happens from separate thread, we might want
-    //       to do something bit more clever in case the sensor data
-    //       overflows the pipe ...
-    abort();
+  /* ring the doorbell only when the mainloop is waiting */
+  if( g_atomic_int_compare_and_exchange(&evepipe_armed, 1, 0) ) {
+    uint64_t cnt = 1;
+
+    if( TEMP_FAILURE_RETRY(write(evepipe_fd, &cnt, sizeof cnt)) != sizeof cnt ) {
+      // the eventfd counter can't overflow with single increments,
+      // so failing here means the doorbell is broken
+      abort();
+    }
   }
+
+EXIT:
+  return;
 }
 
-/** Write PS data to the sensor data pipe
+/** Store PS data to the sensor data ring buffer
  *
  * @param timestamp nanoseconds
  * @param distance  centimeters
@@ -177,7 +252,7 @@ static void evepipe_send_ps(int64_t timestamp, float distance)
   evepipe_send(timestamp, EVEPIPE_PS, distance);
 }
 
-/** Write ALS data to the sensor data pipe
+/** Store ALS data to the sensor data ring buffer
  * @param timestamp nanoseconds
  * @param ligt      lux
  */
@@ -186,7 +261,7 @@ static void evepipe_send_als(int64_t timestamp, float light)
   evepipe_send(timestamp, EVEPIPE_ALS, light);
 }
 
-/** Close sensor data pipe
+/** Close sensor data doorbell
  *
  * @param reset_done true if we wish to return to uninitialized
  *                   state, or false to preserve "already tried
@@ -197,14 +272,13 @@ static void evepipe_quit(bool reset_done)
   /* remove io watch */
   if( evepipe_id ) g_source_remove(evepipe_id), evepipe_id = 0;
 
-  /* close pipe file descriptors */
-  if( evepipe_fd[1] != -1 ) close(evepipe_fd[1]), evepipe_fd[1] = -1;
-  if( evepipe_fd[0] != -1 ) close(evepipe_fd[0]), evepipe_fd[0] = -1;
+  /* close doorbell file descriptor */
+  if( evepipe_fd != -1 ) close(evepipe_fd), evepipe_fd = -1;
 
   if( reset_done ) evepipe_done = false;
 }
 
-/** Initialize sensor data pipe
+/** Initialize sensor data ring buffer and doorbell
  *
  * @return true on success, or false in case of errors
  */
@@ -218,11 +292,16 @@ static bool evepipe_init(void)
 
   evepipe_done = true;
 
-  if( pipe(evepipe_fd) == -1 ) {
+  g_atomic_int_set(&evepipe_head, 0);
+  g_atomic_int_set(&evepipe_tail, 0);
+  g_atomic_int_set(&evepipe_armed, 1);
+  g_atomic_int_set(&evepipe_drops, 0);
+
+  if( (evepipe_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 ) {
     goto EXIT;
   }
 
-  if( !(chn = g_io_channel_unix_new(evepipe_fd[0])) ) {
+  if( !(chn = g_io_channel_unix_new(evepipe_fd)) ) {
     goto EXIT;
   }
 
@@ -297,6 +376,100 @@ EXIT:
   return module_path;
 }
 
+/** Plugin handle, set once the plugin has been loaded */
+static void *mce_hybris_base = 0;
+
+/** Flag for: plugin load has been attempted */
+static bool mce_hybris_done = false;
+
+/** Path of the plugin being loaded by the preload thread */
+static char *mce_hybris_preload_path = 0;
+
+/** Load error reported by the preload thread, or NULL */
+static char *mce_hybris_preload_error = 0;
+
+/** Thread that is loading the plugin in the background, or NULL */
+static GThread *mce_hybris_preload_thread = 0;
+
+/** INTERNAL Load the hybris plugin DSO
+ *
+ * Can be called from any thread; does not call mce_log()
+ *
+ * @param path path to the plugin DSO
+ * @param err  where to store error text, to be released with free()
+ *
+ * @return handle for the plugin, or NULL in case of errors
+ */
+static void *mce_hybris_load_plugin(const char *path, char **err)
+{
+  void *base = dlopen(path, RTLD_NOW|RTLD_LOCAL|RTLD_DEEPBIND);
+
+  if( !base ) {
+    const char *msg = dlerror();
+    *err = strdup(msg ?: "unknown error");
+  }
+
+  return base;
+}
+
+/** INTERNAL Preload thread entry point
+ *
+ * The dlopen() and the relocations it implies are the expensive part
+ * of taking the plugin into use and do not touch any mce state, so
+ * they can be done while the rest of mce is still starting up.
+ *
+ * @param data (unused)
+ *
+ * @return NULL
+ */
+static gpointer mce_hybris_preload_cb(gpointer data)
+{
+  (void)data;
+
+  mce_hybris_base = mce_hybris_load_plugin(mce_hybris_preload_path,
+                                           &mce_hybris_preload_error);
+  return 0;
+}
+
+/** Start loading the hybris plugin in the background
+ *
+ * Must be called from the mainloop thread after mce_conf_init().
+ * The thunk functions block only if they are called before the
+ * background load has finished; if the thread can not be started
+ * the plugin is loaded synchronously on first use as before.
+ */
+void mce_hybris_start_preload(void)
+{
+  GError *error = 0;
+
+  if( mce_hybris_done || mce_hybris_preload_thread )
+    goto EXIT;
+
+  if( !(mce_hybris_preload_path = mce_hybris_module_path()) )
+    goto EXIT;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+  mce_hybris_preload_thread = g_thread_try_new("hybris_preload",
+                                               mce_hybris_preload_cb,
+                                               0, &error);
+#else
+  if( !g_thread_supported() )
+    g_thread_init(0);
+  mce_hybris_preload_thread = g_thread_create(mce_hybris_preload_cb,
+                                              0, TRUE, &error);
+#endif
+
+  if( !mce_hybris_preload_thread ) {
+    mce_log(LL_WARN, "failed to start hybris preload: %s",
+            error ? error->message : "unknown error");
+    free(mce_hybris_preload_path), mce_hybris_preload_path = 0;
+  }
+
+EXIT:
+  g_clear_error(&error);
+  return;
+}
+
 /** Lookup function address from hybris plugin
  *
  * @name function name
@@ -305,31 +478,41 @@ EXIT:
  */
 static void *mce_hybris_lookup_function(const char *name)
 {
-  static void *base   = 0;
-  static bool  done   = false;
-
   void *addr = 0;
 
-  if( !done ) {
+  if( !mce_hybris_done ) {
     char *path = 0;
+    char *err  = 0;
+
+    mce_hybris_done = true;
 
-    done = true;
+    if( mce_hybris_preload_thread ) {
+      /* Wait for the background load to finish */
+      g_thread_join(mce_hybris_preload_thread);
+      mce_hybris_preload_thread = 0;
+      path = mce_hybris_preload_path, mce_hybris_preload_path = 0;
+      err  = mce_hybris_preload_error, mce_hybris_preload_error = 0;
+    }
+    else if( (path = mce_hybris_module_path()) ) {
+      mce_hybris_base = mce_hybris_load_plugin(path, &err);
+    }
 
-    if( !(path = mce_hybris_module_path()) ) {
+    if( !path ) {
       mce_log(LL_WARN, "could not locate hybris plugin");
     }
-    else if( !(base = dlopen(path, RTLD_NOW|RTLD_LOCAL|RTLD_DEEPBIND)) ) {
-      mce_log(LL_WARN, "%s: failed to load: %s", path, dlerror());
+    else if( !mce_hybris_base ) {
+      mce_log(LL_WARN, "%s: failed to load: %s", path, err);
     }
     else {
       mce_log(LL_NOTICE, "loaded hybris plugin");
-      mce_hybris_set_logging_proxy(base);
+      mce_hybris_set_logging_proxy(mce_hybris_base);
     }
+    free(err);
     free(path);
   }
 
-  if( base ) {
-    if( !(addr = dlsym(base, name)) ) {
+  if( mce_hybris_base ) {
+    if( !(addr = dlsym(mce_hybris_base, name)) ) {
       mce_log(LL_ERR, "%s: failed to lookup: %s", name, dlerror());
     }
   }
@@ -84,6 +84,7 @@ bool mce_hybris_als_set_callback(mce_hybris_als_fn cb);
  * - - - - - - - - - - - - - - - - - - - */
 
 void mce_hybris_quit(void);
+void mce_hybris_start_preload(void);
 
 /* - - - - - - - - - - - - - - - - - - - *
  * internal to module <--> plugin
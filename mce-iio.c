@@ -0,0 +1,699 @@
+/**
+ * @file mce-iio.c
+ * IIO buffered sensor capture for the Mode Control Entity
+ * <p>
+ * Sets up the buffer of an Industrial I/O device to capture a single
+ * channel together with its time stamp, and delivers the samples in
+ * batches through a chunk I/O monitor; with a watermark above one,
+ * a high-rate sensor costs one wakeup per batch instead of one per
+ * sample
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>		/* g_access() */
+
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open(), O_RDONLY, O_NONBLOCK */
+#include <stdio.h>			/* sscanf() */
+#include <string.h>			/* memcpy(), strcmp(), strrchr() */
+#include <time.h>			/* CLOCK_REALTIME */
+#include <unistd.h>			/* close(), R_OK, W_OK */
+
+#include "mce-iio.h"
+
+#include "mce-io.h"			/* mce_read_string_from_file(),
+					 * mce_write_string_to_file(),
+					 * mce_register_io_monitor_chunk_batch(),
+					 * mce_set_io_monitor_user_data(),
+					 * mce_get_io_monitor_user_data(),
+					 * mce_get_current_io_monitor(),
+					 * mce_get_io_monitor_fd(),
+					 * mce_unregister_io_monitor()
+					 */
+#include "mce-lib.h"			/* mce_lib_get_time_ns() */
+#include "mce-log.h"			/* mce_log(), LL_* */
+
+/** Name of the IIO time stamp scan element */
+#define MCE_IIO_TIMESTAMP		"in_timestamp"
+
+/** Buffer length in multiples of the watermark */
+#define MCE_IIO_BUFFER_WATERMARKS	4
+
+/** Layout of one element in an IIO scan */
+typedef struct {
+	/** TRUE if the element is part of the scan */
+	gboolean enabled;
+	/** Scan index; elements are ordered by it */
+	gint index;
+	/** TRUE if the value is stored big endian */
+	gboolean big_endian;
+	/** TRUE if the value is signed */
+	gboolean is_signed;
+	/** Number of significant bits */
+	guint bits;
+	/** Number of bytes the value takes in the scan */
+	guint storage;
+	/** Number of bits to shift right to get the value */
+	guint shift;
+	/** Byte offset of the value in the scan */
+	gsize offset;
+} mce_iio_element_t;
+
+/** IIO capture */
+struct mce_iio_t {
+	/** Device directory in sysfs */
+	gchar *sysfs;
+	/** Path to the buffer device node */
+	gchar *devnode;
+	/** Chunk I/O monitor for the buffer device node */
+	gconstpointer iomon;
+	/** Layout of the captured channel */
+	mce_iio_element_t value;
+	/** Layout of the time stamp */
+	mce_iio_element_t timestamp;
+	/** Size of one scan in bytes */
+	gsize scan_size;
+	/** Channel scale */
+	gdouble scale;
+	/** Channel offset, applied before the scale */
+	gdouble offset;
+	/** TRUE if the device stamps samples with CLOCK_MONOTONIC */
+	gboolean monotonic;
+	/** Batch callback */
+	mce_iio_batch_cb callback;
+	/** User data for the batch callback */
+	gpointer user_data;
+	/** Sample buffer handed to the batch callback */
+	mce_iio_sample_t *samples;
+	/** Number of samples the sample buffer holds */
+	gsize samples_max;
+};
+
+/**
+ * Find the sysfs directory of an IIO device
+ *
+ * @param name The device name, as reported by the driver
+ * @return The directory path; free with g_free(),
+ *         or NULL if there is no such device
+ */
+static gchar *mce_iio_find_device(const gchar *name)
+{
+	gchar *sysfs = NULL;
+	const gchar *entry;
+	GDir *dir;
+
+	if ((name == NULL) || (*name == '\0'))
+		goto EXIT;
+
+	if ((dir = g_dir_open(MCE_IIO_SYSFS_DIR, 0, NULL)) == NULL)
+		goto EXIT;
+
+	while ((sysfs == NULL) && ((entry = g_dir_read_name(dir)) != NULL)) {
+		gchar *path;
+		gchar *str = NULL;
+
+		if (g_str_has_prefix(entry, "iio:device") == FALSE)
+			continue;
+
+		path = g_strdup_printf(MCE_IIO_SYSFS_DIR "/%s/name", entry);
+
+		if ((g_access(path, R_OK) == 0) &&
+		    (mce_read_string_from_file(path, &str) == TRUE) &&
+		    (strcmp(g_strstrip(str), name) == 0))
+			sysfs = g_strdup_printf(MCE_IIO_SYSFS_DIR "/%s",
+						entry);
+
+		g_free(str);
+		g_free(path);
+	}
+
+	g_dir_close(dir);
+
+EXIT:
+	return sysfs;
+}
+
+/**
+ * Read a floating point attribute of an IIO device
+ *
+ * @param sysfs The device directory
+ * @param attr The attribute name
+ * @param defval The value to use if the attribute can't be read
+ * @return The attribute value, or defval
+ */
+static gdouble mce_iio_get_attr(const gchar *sysfs, const gchar *attr,
+				gdouble defval)
+{
+	gdouble value = defval;
+	gchar *path = g_strdup_printf("%s/%s", sysfs, attr);
+	gchar *str = NULL;
+	gchar *end = NULL;
+
+	if ((g_access(path, R_OK) != 0) ||
+	    (mce_read_string_from_file(path, &str) == FALSE))
+		goto EXIT;
+
+	value = g_ascii_strtod(str, &end);
+
+	if (end == str)
+		value = defval;
+
+EXIT:
+	g_free(str);
+	g_free(path);
+
+	return value;
+}
+
+/**
+ * Write an attribute of an IIO device
+ *
+ * @param sysfs The device directory
+ * @param attr The attribute name, relative to the device directory
+ * @param value The value to write
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_iio_set_attr(const gchar *sysfs, const gchar *attr,
+				 const gchar *value)
+{
+	gchar *path = g_strdup_printf("%s/%s", sysfs, attr);
+	gboolean status = mce_write_string_to_file(path, value);
+
+	g_free(path);
+
+	return status;
+}
+
+/**
+ * Check whether a device has an attribute
+ *
+ * @param sysfs The device directory
+ * @param attr The attribute name, relative to the device directory
+ * @return TRUE if the attribute exists and is writable
+ */
+static gboolean mce_iio_has_attr(const gchar *sysfs, const gchar *attr)
+{
+	gchar *path = g_strdup_printf("%s/%s", sysfs, attr);
+	gboolean status = (g_access(path, W_OK) == 0);
+
+	g_free(path);
+
+	return status;
+}
+
+/**
+ * Read the layout of a scan element
+ *
+ * @param sysfs The device directory
+ * @param element The scan element name, e.g. "in_illuminance"
+ * @param[out] layout The element layout
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_iio_get_element(const gchar *sysfs, const gchar *element,
+				    mce_iio_element_t *layout)
+{
+	gboolean status = FALSE;
+	gchar *path = g_strdup_printf("%s/scan_elements/%s_type",
+				      sysfs, element);
+	gchar *str = NULL;
+	gchar endian = 0;
+	gchar sign = 0;
+	guint storage = 0;
+
+	memset(layout, 0, sizeof *layout);
+
+	if (mce_read_string_from_file(path, &str) == FALSE)
+		goto EXIT;
+
+	/* Format: [be|le]:[s|u]bits/storagebits>>shift */
+	if ((sscanf(str, "%ce:%c%u/%u>>%u", &endian, &sign,
+		    &layout->bits, &storage, &layout->shift) != 5) ||
+	    ((storage != 8) && (storage != 16) &&
+	     (storage != 32) && (storage != 64)) ||
+	    (layout->bits == 0) || (layout->bits > storage)) {
+		mce_log(LL_ERR, "%s: unsupported scan element type `%s'",
+			element, g_strstrip(str));
+		goto EXIT;
+	}
+
+	layout->big_endian = (endian == 'b');
+	layout->is_signed = (sign == 's');
+	layout->storage = storage / 8;
+
+	g_free(path);
+	path = g_strdup_printf("scan_elements/%s_index", element);
+	layout->index = (gint)mce_iio_get_attr(sysfs, path, -1);
+
+	if (layout->index < 0) {
+		mce_log(LL_ERR, "%s: no scan index", element);
+		goto EXIT;
+	}
+
+	layout->enabled = TRUE;
+	status = TRUE;
+
+EXIT:
+	g_free(str);
+	g_free(path);
+
+	return status;
+}
+
+/**
+ * Enable only the given scan elements of an IIO device
+ *
+ * @param sysfs The device directory
+ * @param channel The channel scan element to enable
+ * @param timestamp TRUE to enable the time stamp scan element too
+ */
+static void mce_iio_select_elements(const gchar *sysfs, const gchar *channel,
+				    gboolean timestamp)
+{
+	gchar *path = g_strdup_printf("%s/scan_elements", sysfs);
+	gchar *channel_en = g_strdup_printf("%s_en", channel);
+	const gchar *entry;
+	GDir *dir;
+
+	if ((dir = g_dir_open(path, 0, NULL)) == NULL)
+		goto EXIT;
+
+	while ((entry = g_dir_read_name(dir)) != NULL) {
+		gchar *attr;
+		gboolean enable;
+
+		if (g_str_has_suffix(entry, "_en") == FALSE)
+			continue;
+
+		enable = (strcmp(entry, channel_en) == 0) ||
+			 ((timestamp == TRUE) &&
+			  (strcmp(entry, MCE_IIO_TIMESTAMP "_en") == 0));
+
+		attr = g_strdup_printf("scan_elements/%s", entry);
+		mce_iio_set_attr(sysfs, attr, enable ? "1" : "0");
+		g_free(attr);
+	}
+
+	g_dir_close(dir);
+
+EXIT:
+	g_free(channel_en);
+	g_free(path);
+}
+
+/**
+ * Compute the scan layout of the captured elements
+ *
+ * Each element is aligned to its own size, in scan index order,
+ * and the scan is padded to the alignment of its largest element
+ *
+ * @param iio The IIO capture
+ */
+static void mce_iio_layout_scan(mce_iio_t *iio)
+{
+	mce_iio_element_t *order[2] = { &iio->value, &iio->timestamp };
+	gsize offset = 0;
+	guint largest = 0;
+	gint i;
+
+	if ((iio->timestamp.enabled == TRUE) &&
+	    (iio->timestamp.index < iio->value.index)) {
+		order[0] = &iio->timestamp;
+		order[1] = &iio->value;
+	}
+
+	for (i = 0; i < 2; i++) {
+		mce_iio_element_t *element = order[i];
+
+		if (element->enabled == FALSE)
+			continue;
+
+		if (offset % element->storage)
+			offset += element->storage -
+				  offset % element->storage;
+
+		element->offset = offset;
+		offset += element->storage;
+		largest = MAX(largest, element->storage);
+	}
+
+	if (offset % largest)
+		offset += largest - offset % largest;
+
+	iio->scan_size = offset;
+}
+
+/**
+ * Extract an element from a scan
+ *
+ * @param element The element layout
+ * @param scan The scan data
+ * @return The element value
+ */
+static gint64 mce_iio_get_value(const mce_iio_element_t *element,
+				const guint8 *scan)
+{
+	const guint8 *data = scan + element->offset;
+	guint64 raw = 0;
+	guint16 u16;
+	guint32 u32;
+	guint64 u64;
+
+	switch (element->storage) {
+	case 1:
+		raw = data[0];
+		break;
+
+	case 2:
+		memcpy(&u16, data, sizeof u16);
+		raw = element->big_endian ? GUINT16_FROM_BE(u16) :
+					    GUINT16_FROM_LE(u16);
+		break;
+
+	case 4:
+		memcpy(&u32, data, sizeof u32);
+		raw = element->big_endian ? GUINT32_FROM_BE(u32) :
+					    GUINT32_FROM_LE(u32);
+		break;
+
+	default:
+		memcpy(&u64, data, sizeof u64);
+		raw = element->big_endian ? GUINT64_FROM_BE(u64) :
+					    GUINT64_FROM_LE(u64);
+		break;
+	}
+
+	raw >>= element->shift;
+
+	if (element->bits < 64) {
+		guint64 mask = (G_GUINT64_CONSTANT(1) << element->bits) - 1;
+
+		raw &= mask;
+
+		/* Sign extend */
+		if ((element->is_signed == TRUE) &&
+		    (raw & (G_GUINT64_CONSTANT(1) << (element->bits - 1))))
+			raw |= ~mask;
+	}
+
+	return (gint64)raw;
+}
+
+/**
+ * Batch I/O monitor callback for the IIO buffer device node
+ *
+ * @param data The scans read
+ * @param chunk_size The size of one scan
+ * @param chunk_count The number of scans
+ * @return Always returns FALSE
+ */
+static gboolean mce_iio_iomon_cb(gpointer data, gsize chunk_size,
+				 gsize chunk_count)
+{
+	mce_iio_t *iio =
+		mce_get_io_monitor_user_data(mce_get_current_io_monitor());
+	const guint8 *scan = data;
+	gint64 now = mce_lib_get_time_ns(CLOCK_MONOTONIC);
+	gint64 adjust = 0;
+	gsize i;
+
+	if (iio == NULL)
+		goto EXIT;
+
+	if (chunk_count > iio->samples_max) {
+		iio->samples_max = chunk_count;
+		iio->samples = g_renew(mce_iio_sample_t, iio->samples,
+				       iio->samples_max);
+	}
+
+	/* Map realtime stamps onto the monotonic clock */
+	if (iio->monotonic == FALSE)
+		adjust = now - mce_lib_get_time_ns(CLOCK_REALTIME);
+
+	for (i = 0; i < chunk_count; i++, scan += chunk_size) {
+		gint64 raw = mce_iio_get_value(&iio->value, scan);
+
+		iio->samples[i].value = (raw + iio->offset) * iio->scale;
+
+		if (iio->timestamp.enabled == TRUE)
+			iio->samples[i].time =
+				mce_iio_get_value(&iio->timestamp, scan) +
+				adjust;
+		else
+			iio->samples[i].time = now;
+	}
+
+	iio->callback(iio->samples, chunk_count, iio->user_data);
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Check whether an IIO device is present
+ *
+ * @param name The device name, as reported by the driver
+ * @return TRUE if the device exists, FALSE otherwise
+ */
+gboolean mce_iio_exists(const gchar *name)
+{
+	gchar *sysfs = mce_iio_find_device(name);
+	gboolean status = (sysfs != NULL);
+
+	g_free(sysfs);
+
+	return status;
+}
+
+/**
+ * Read the current value of an IIO channel directly
+ *
+ * @note Many drivers refuse direct reads while the buffer is enabled
+ *
+ * @param name The device name, as reported by the driver
+ * @param channel The channel, e.g. "in_illuminance"
+ * @param[out] value The channel value with scale and offset applied
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_iio_read(const gchar *name, const gchar *channel,
+		      gdouble *value)
+{
+	gboolean status = FALSE;
+	gchar *sysfs = mce_iio_find_device(name);
+	gchar *attr = NULL;
+	gdouble raw;
+
+	if (sysfs == NULL)
+		goto EXIT;
+
+	/* Prefer the processed value, if the driver provides one */
+	attr = g_strdup_printf("%s_input", channel);
+
+	if ((raw = mce_iio_get_attr(sysfs, attr, G_MAXDOUBLE)) != G_MAXDOUBLE) {
+		*value = raw;
+		status = TRUE;
+		goto EXIT;
+	}
+
+	g_free(attr);
+	attr = g_strdup_printf("%s_raw", channel);
+
+	if ((raw = mce_iio_get_attr(sysfs, attr, G_MAXDOUBLE)) == G_MAXDOUBLE)
+		goto EXIT;
+
+	g_free(attr);
+	attr = g_strdup_printf("%s_offset", channel);
+	raw += mce_iio_get_attr(sysfs, attr, 0);
+
+	g_free(attr);
+	attr = g_strdup_printf("%s_scale", channel);
+	*value = raw * mce_iio_get_attr(sysfs, attr, 1);
+
+	status = TRUE;
+
+EXIT:
+	g_free(attr);
+	g_free(sysfs);
+
+	return status;
+}
+
+/**
+ * Start buffered capture of an IIO channel
+ *
+ * @param name The device name, as reported by the driver
+ * @param channel The channel scan element, e.g. "in_illuminance"
+ * @param trigger The trigger to use, or NULL/empty for the current one
+ * @param watermark The number of samples to collect per wakeup
+ * @param callback The batch callback
+ * @param user_data User data for the batch callback
+ * @return The IIO capture, or NULL on failure
+ */
+mce_iio_t *mce_iio_open(const gchar *name, const gchar *channel,
+			const gchar *trigger, guint watermark,
+			mce_iio_batch_cb callback, gpointer user_data)
+{
+	mce_iio_t *iio = NULL;
+	gchar *sysfs = NULL;
+	gchar *str = NULL;
+	gint fd = -1;
+
+	if ((sysfs = mce_iio_find_device(name)) == NULL) {
+		mce_log(LL_WARN, "IIO device `%s' not found", name);
+		goto EXIT;
+	}
+
+	iio = g_malloc0(sizeof *iio);
+	iio->sysfs = sysfs, sysfs = NULL;
+	iio->devnode = g_strdup_printf("/dev/%s",
+				       strrchr(iio->sysfs, '/') + 1);
+	iio->callback = callback;
+	iio->user_data = user_data;
+	watermark = MAX(watermark, 1);
+
+	/* The buffer must be disabled while it is being configured */
+	mce_iio_set_attr(iio->sysfs, "buffer/enable", "0");
+
+	if ((trigger != NULL) && (*trigger != '\0'))
+		mce_iio_set_attr(iio->sysfs, "trigger/current_trigger",
+				 trigger);
+
+	/* Ask for stamps that are comparable with the rest of mce */
+	if (mce_iio_has_attr(iio->sysfs, "current_timestamp_clock"))
+		iio->monotonic = mce_iio_set_attr(iio->sysfs,
+						  "current_timestamp_clock",
+						  "monotonic");
+
+	mce_iio_select_elements(iio->sysfs, channel, TRUE);
+
+	if (mce_iio_get_element(iio->sysfs, channel, &iio->value) == FALSE)
+		goto ERROR;
+
+	if (mce_iio_get_element(iio->sysfs, MCE_IIO_TIMESTAMP,
+				&iio->timestamp) == FALSE)
+		mce_log(LL_DEBUG, "%s: no time stamps; using read time",
+			name);
+
+	mce_iio_layout_scan(iio);
+
+	str = g_strdup_printf("%s_scale", channel);
+	iio->scale = mce_iio_get_attr(iio->sysfs, str, 1);
+	g_free(str);
+
+	str = g_strdup_printf("%s_offset", channel);
+	iio->offset = mce_iio_get_attr(iio->sysfs, str, 0);
+	g_free(str);
+
+	str = g_strdup_printf("%u", watermark * MCE_IIO_BUFFER_WATERMARKS);
+	mce_iio_set_attr(iio->sysfs, "buffer/length", str);
+	g_free(str);
+
+	/* Older kernels wake up on every sample */
+	if (mce_iio_has_attr(iio->sysfs, "buffer/watermark")) {
+		str = g_strdup_printf("%u", watermark);
+		mce_iio_set_attr(iio->sysfs, "buffer/watermark", str);
+		g_free(str);
+	}
+
+	str = NULL;
+
+	if (mce_iio_set_attr(iio->sysfs, "buffer/enable", "1") == FALSE)
+		goto ERROR;
+
+	if ((fd = open(iio->devnode, O_RDONLY | O_NONBLOCK)) == -1) {
+		mce_log(LL_ERR, "Failed to open `%s'; %s",
+			iio->devnode, g_strerror(errno));
+		goto ERROR;
+	}
+
+	if ((iio->iomon = mce_register_io_monitor_chunk_batch(fd,
+							       iio->devnode,
+							       MCE_IO_ERROR_POLICY_WARN,
+							       G_IO_IN | G_IO_PRI | G_IO_ERR,
+							       FALSE,
+							       mce_iio_iomon_cb,
+							       iio->scan_size)) == NULL) {
+		close(fd);
+		goto ERROR;
+	}
+
+	mce_set_io_monitor_user_data(iio->iomon, iio, NULL);
+
+	mce_log(LL_DEBUG, "%s: capturing %s; %zu byte scans, watermark %u",
+		name, channel, iio->scan_size, watermark);
+
+	goto EXIT;
+
+ERROR:
+	mce_iio_close(iio);
+	iio = NULL;
+
+EXIT:
+	g_free(sysfs);
+
+	return iio;
+}
+
+/**
+ * Pause or resume buffered capture of an IIO channel
+ *
+ * The buffer device stays open, so that the capture can be
+ * resumed without reconfiguring the device
+ *
+ * @param iio The IIO capture, or NULL
+ * @param enabled TRUE to resume the capture, FALSE to pause it
+ */
+void mce_iio_set_enabled(mce_iio_t *iio, gboolean enabled)
+{
+	if (iio == NULL)
+		goto EXIT;
+
+	mce_iio_set_attr(iio->sysfs, "buffer/enable", enabled ? "1" : "0");
+
+EXIT:
+	return;
+}
+
+/**
+ * Stop buffered capture of an IIO channel
+ *
+ * @param iio The IIO capture, or NULL
+ */
+void mce_iio_close(mce_iio_t *iio)
+{
+	if (iio == NULL)
+		goto EXIT;
+
+	if (iio->iomon != NULL) {
+		/* The iomon does not close external file descriptors,
+		 * and the buffer device can be open only once */
+		gint fd = mce_get_io_monitor_fd(iio->iomon);
+
+		mce_unregister_io_monitor(iio->iomon);
+
+		if (fd != -1)
+			close(fd);
+	}
+
+	mce_iio_set_attr(iio->sysfs, "buffer/enable", "0");
+
+	g_free(iio->samples);
+	g_free(iio->devnode);
+	g_free(iio->sysfs);
+	g_free(iio);
+
+EXIT:
+	return;
+}
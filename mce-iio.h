@@ -0,0 +1,57 @@
+/**
+ * @file mce-iio.h
+ * Headers for the IIO buffered sensor capture
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_IIO_H_
+#define _MCE_IIO_H_
+
+#include <glib.h>
+
+/** IIO devices in sysfs */
+#define MCE_IIO_SYSFS_DIR		"/sys/bus/iio/devices"
+
+/** One sample captured from an IIO buffer */
+typedef struct {
+	/** Sample time [ns, CLOCK_MONOTONIC] */
+	gint64 time;
+	/** Channel value with the driver scale and offset applied */
+	gdouble value;
+} mce_iio_sample_t;
+
+/**
+ * Callback for a batch of IIO samples
+ *
+ * @param samples The samples, oldest first
+ * @param count The number of samples
+ * @param user_data The user data given to mce_iio_open()
+ */
+typedef void (*mce_iio_batch_cb)(const mce_iio_sample_t *samples,
+				 gsize count, gpointer user_data);
+
+/** IIO capture; only access this struct through the functions */
+typedef struct mce_iio_t mce_iio_t;
+
+gboolean mce_iio_exists(const gchar *name);
+gboolean mce_iio_read(const gchar *name, const gchar *channel,
+		      gdouble *value);
+mce_iio_t *mce_iio_open(const gchar *name, const gchar *channel,
+			const gchar *trigger, guint watermark,
+			mce_iio_batch_cb callback, gpointer user_data);
+void mce_iio_set_enabled(mce_iio_t *iio, gboolean enabled);
+void mce_iio_close(mce_iio_t *iio);
+
+#endif /* _MCE_IIO_H_ */
@@ -28,13 +28,29 @@
 					 * fflush()
 					 */
 #include <stdlib.h>			/* exit(), strtoul(), EXIT_FAILURE */
-#include <string.h>			/* strlen() */
-#include <unistd.h>			/* close(), read(), ftruncate() */
+#include <string.h>			/* strlen(), strcmp() */
+#include <unistd.h>			/* close(), read(), pread(),
+					 * ftruncate()
+					 */
+
+#ifdef ENABLE_IOMON_EPOLL
+# include <sys/epoll.h>			/* epoll_create1(), epoll_ctl(),
+					 * epoll_wait()
+					 */
+#endif
 
 #include "mce.h"
 #include "mce-io.h"
 
+#include "mce-lib.h"			/* mce_lib_get_time_ms() */
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-wakeup.h"			/* mce_wakeup_owner(),
+					 * mce_wakeup_begin(),
+					 * mce_wakeup_account()
+					 */
+#include "mce-memstat.h"		/* mce_memstat_alloc(),
+					 * mce_memstat_free()
+					 */
 
 #ifdef ENABLE_WAKELOCKS
 # include "libwakelock.h"		/* API for wakelocks */
@@ -43,6 +59,22 @@
 /** List of all file monitors */
 static GSList *file_monitors = NULL;
 
+#ifdef ENABLE_WAKELOCKS
+/** Delay before releasing the input handler wakelock [ms]
+ *
+ * Keeping the wakelock over bursts of input means the state cache
+ * in libwakelock can skip the sysfs writes for all but the first
+ * and the last read of the burst
+ */
+# define INPUT_WAKELOCK_GRACE_MS		100
+
+/** ID for the input handler wakelock release timer */
+static guint input_wakelock_release_id = 0;
+
+/** Monotonic time when the input handler wakelock can be released [ms] */
+static gint64 input_wakelock_release_tick = 0;
+#endif
+
 /** I/O monitor type */
 typedef enum {
 	IOMON_UNSET = -1,			/**< I/O monitor type unset */
@@ -55,8 +87,12 @@ typedef struct {
 	gchar *file;				/**< Monitored file */
 	GIOChannel *iochan;			/**< I/O channel */
 	iomon_cb callback;			/**< Callback */
+	iomon_batch_cb batch_callback;		/**< Callback for all chunks
+						 *   from one read */
 	iomon_err_cb err_callback;	/**< error callback */
 	gulong chunk_size;			/**< Read-chunk size */
+	gchar *buffer;				/**< Read buffer for chunk I/O */
+	gsize buffer_size;			/**< Size of the read buffer */
 	guint data_source_id;			/**< GSource ID for data */
 	guint error_source_id;			/**< GSource ID for errors */
 	gint fd;				/**< File Descriptor */
@@ -68,11 +104,31 @@ typedef struct {
 	gboolean suspended;			/**< Is the I/O monitor
 						 *   suspended? */
 	gboolean seekable;			/**< is the I/O channel seekable */
+	gboolean in_epoll_set;			/**< Is the monitor serviced
+						 *   via the epoll set? */
+	gpointer user_data;			/**< Data owned by the user */
+	GDestroyNotify user_data_free;		/**< Destructor for user_data */
+	guint wakeups;				/**< Number of times the monitor
+						 *   has been serviced */
+	guint64 bytes;				/**< Number of bytes read */
+	guint64 time;				/**< Time spent servicing the
+						 *   monitor [us] */
+	mce_wakeup_owner_t *wakeup_owner;	/**< Wakeup accounting */
 } iomon_struct;
 
+/** I/O monitor whose callback is currently being executed */
+static iomon_struct *iomon_current = NULL;
+
+/** I/O monitor being dispatched from the epoll set;
+ *  reset if the monitor is unregistered during the dispatch */
+static iomon_struct *iomon_dispatched = NULL;
+
 /** Suffix used for temporary files */
 #define TMP_SUFFIX				".tmp"
 
+/** Maximum number of bytes read at once by chunk I/O monitors */
+#define IOMON_CHUNK_READ_SIZE			4096
+
 /**
  * Helper function for closing files that checks for NULL,
  * prints proper error messages and NULLs the file pointer after close
@@ -356,79 +412,818 @@ EXIT2:
 	if ((status == FALSE) || (close_on_exit == TRUE)) {
 		(void)mce_close_file(file, &new_fp);
 
-		if (fp != NULL)
-			*fp = NULL;
+		if (fp != NULL)
+			*fp = NULL;
+	}
+
+	/* Ignore error */
+	errno = 0;
+
+EXIT:
+	return status;
+}
+
+/* ========================================================================= *
+ * SYSFS VALUE CACHE
+ * ========================================================================= */
+
+/** Maximum length of a cached attribute value */
+#define SYSFS_CACHE_VALUE_MAX			4096
+
+/** Cached sysfs attribute */
+typedef struct {
+	gchar *path;				/**< Path to the attribute */
+	int fd;					/**< Persistent file descriptor */
+	gchar *value;				/**< Latest value read */
+	gboolean valid;				/**< Is the value up to date? */
+	gint64 stamp;				/**< When the value was read [ms] */
+	guint notify_id;			/**< GSource ID for POLLPRI */
+	guint read_count;			/**< Number of actual reads */
+	guint hit_count;			/**< Number of cache hits */
+} sysfs_cache_entry_t;
+
+/** Cached attributes; path -> sysfs_cache_entry_t */
+static GHashTable *sysfs_cache = NULL;
+
+/**
+ * Read the current attribute value into the cache
+ *
+ * @param entry The cache entry to update
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean sysfs_cache_refresh(sysfs_cache_entry_t *entry)
+{
+	gboolean status = FALSE;
+	gchar *buffer = g_malloc(SYSFS_CACHE_VALUE_MAX + 1);
+	ssize_t rc;
+
+	/* Reading from offset zero also re-arms sysfs_notify() */
+	do {
+		rc = pread(entry->fd, buffer, SYSFS_CACHE_VALUE_MAX, 0);
+	} while ((rc == -1) && (errno == EINTR));
+
+	if (rc == -1) {
+		mce_log(LL_ERR,
+			"Failed to read from `%s'; %s",
+			entry->path, g_strerror(errno));
+		entry->valid = FALSE;
+		g_free(buffer);
+		goto EXIT;
+	}
+
+	buffer[rc] = 0;
+
+	g_free(entry->value);
+	entry->value = buffer;
+	entry->valid = TRUE;
+	entry->stamp = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+	entry->read_count++;
+
+	status = TRUE;
+
+EXIT:
+	/* Reset errno,
+	 * to avoid false positives down the line
+	 */
+	errno = 0;
+
+	return status;
+}
+
+/**
+ * Callback for sysfs_notify() on a cached attribute
+ *
+ * @param source Unused
+ * @param condition The I/O condition
+ * @param data The cache entry
+ * @return TRUE to keep the watch, FALSE if the attribute went away
+ */
+static gboolean sysfs_cache_notify_cb(GIOChannel *source,
+				      GIOCondition condition,
+				      gpointer data)
+{
+	sysfs_cache_entry_t *entry = data;
+	gboolean keep = TRUE;
+
+	/* Silence warnings */
+	(void)source;
+
+	if (condition & (G_IO_HUP | G_IO_NVAL)) {
+		/* Fall back to age based refreshing */
+		entry->valid = FALSE;
+		entry->notify_id = 0;
+		keep = FALSE;
+		goto EXIT;
+	}
+
+	/* The notification stays pending until the attribute is read,
+	 * so refresh right away instead of just invalidating */
+	(void)sysfs_cache_refresh(entry);
+
+EXIT:
+	return keep;
+}
+
+/**
+ * Release a cache entry
+ *
+ * @param data The cache entry to free
+ */
+static void sysfs_cache_entry_free(gpointer data)
+{
+	sysfs_cache_entry_t *entry = data;
+
+	mce_log(LL_DEBUG, "%s: %u reads, %u cache hits",
+		entry->path, entry->read_count, entry->hit_count);
+
+	if (entry->notify_id != 0)
+		g_source_remove(entry->notify_id);
+
+	if (entry->fd != -1)
+		close(entry->fd);
+
+	g_free(entry->value);
+	g_free(entry->path);
+	g_slice_free(sysfs_cache_entry_t, entry);
+}
+
+/**
+ * Find or create the cache entry for a file
+ *
+ * @param file Path to the file
+ * @return The cache entry, or NULL if the file can't be opened
+ */
+static sysfs_cache_entry_t *sysfs_cache_lookup(const gchar *const file)
+{
+	sysfs_cache_entry_t *entry = NULL;
+	int fd;
+
+	if (sysfs_cache == NULL) {
+		sysfs_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    NULL,
+						    sysfs_cache_entry_free);
+	} else if ((entry = g_hash_table_lookup(sysfs_cache, file)) != NULL) {
+		goto EXIT;
+	}
+
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) == -1) {
+		mce_log(LL_ERR,
+			"Cannot open `%s' for reading; %s",
+			file, g_strerror(errno));
+
+		/* Ignore error */
+		errno = 0;
+		goto EXIT;
+	}
+
+	entry = g_slice_new0(sysfs_cache_entry_t);
+	entry->path = g_strdup(file);
+	entry->fd = fd;
+
+	/* Only sysfs attributes can signal changes via POLLPRI */
+	if (g_str_has_prefix(file, "/sys/")) {
+		GIOChannel *iochan = g_io_channel_unix_new(fd);
+
+		entry->notify_id = g_io_add_watch(iochan,
+						  G_IO_PRI | G_IO_ERR |
+						  G_IO_HUP | G_IO_NVAL,
+						  sysfs_cache_notify_cb,
+						  entry);
+		/* The watch holds a reference to the channel */
+		g_io_channel_unref(iochan);
+	}
+
+	g_hash_table_insert(sysfs_cache, entry->path, entry);
+
+EXIT:
+	return entry;
+}
+
+/**
+ * Get the up to date cache entry for a file
+ *
+ * @param file Path to the file
+ * @param max_age_ms The oldest cached value to accept [ms];
+ *                   0 to always read the file,
+ *                   MCE_SYSFS_CACHE_NOTIFY_ONLY to rely on
+ *                   sysfs_notify() and invalidation on write
+ * @return The cache entry with a valid value, or NULL on failure
+ */
+static sysfs_cache_entry_t *sysfs_cache_get(const gchar *const file,
+					    gint max_age_ms)
+{
+	sysfs_cache_entry_t *entry = NULL;
+
+	if (file == NULL) {
+		mce_log(LL_CRIT, "file == NULL!");
+		goto EXIT;
+	}
+
+	if ((entry = sysfs_cache_lookup(file)) == NULL)
+		goto EXIT;
+
+	if ((entry->valid == TRUE) &&
+	    ((max_age_ms == MCE_SYSFS_CACHE_NOTIFY_ONLY) ||
+	     ((mce_lib_get_time_ms(CLOCK_MONOTONIC) - entry->stamp) <
+	      max_age_ms))) {
+		entry->hit_count++;
+		goto EXIT;
+	}
+
+	if (sysfs_cache_refresh(entry) == FALSE)
+		entry = NULL;
+
+EXIT:
+	return entry;
+}
+
+/**
+ * Read a string from a file via the sysfs value cache
+ *
+ * The file is kept open; sysfs attributes that support
+ * sysfs_notify() are refreshed as soon as they change,
+ * other values are re-read once older than max_age_ms
+ *
+ * @param file Path to the file
+ * @param[out] string A newly allocated string with the file contents
+ * @param max_age_ms The oldest cached value to accept [ms];
+ *                   0 to always read the file,
+ *                   MCE_SYSFS_CACHE_NOTIFY_ONLY to rely on
+ *                   sysfs_notify() and invalidation on write
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_read_cached_string_from_file(const gchar *const file,
+					  gchar **string, gint max_age_ms)
+{
+	sysfs_cache_entry_t *entry;
+	gboolean status = FALSE;
+
+	if ((entry = sysfs_cache_get(file, max_age_ms)) == NULL)
+		goto EXIT;
+
+	*string = g_strdup(entry->value);
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Read a number representation of a string from a file
+ * via the sysfs value cache
+ *
+ * @param file Path to the file
+ * @param[out] number A number representation of the file contents
+ * @param max_age_ms The oldest cached value to accept [ms];
+ *                   0 to always read the file,
+ *                   MCE_SYSFS_CACHE_NOTIFY_ONLY to rely on
+ *                   sysfs_notify() and invalidation on write
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_read_cached_number_string_from_file(const gchar *const file,
+						 gulong *number,
+						 gint max_age_ms)
+{
+	sysfs_cache_entry_t *entry;
+	gboolean status = FALSE;
+	char *end = NULL;
+	gulong value;
+
+	if ((entry = sysfs_cache_get(file, max_age_ms)) == NULL)
+		goto EXIT;
+
+	errno = 0;
+	value = strtoul(entry->value, &end, 10);
+
+	if ((end == entry->value) || (errno == ERANGE)) {
+		mce_log(LL_ERR,
+			"Could not match any values when reading from `%s'",
+			file);
+
+		/* Ignore error */
+		errno = 0;
+		goto EXIT;
+	}
+
+	*number = value;
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Invalidate the cached value of a file
+ *
+ * Called by the write helpers, so that values written
+ * by mce itself are never served stale from the cache
+ *
+ * @param file Path to the file
+ */
+void mce_invalidate_cached_file(const gchar *const file)
+{
+	sysfs_cache_entry_t *entry;
+
+	if ((sysfs_cache == NULL) || (file == NULL))
+		goto EXIT;
+
+	if ((entry = g_hash_table_lookup(sysfs_cache, file)) != NULL)
+		entry->valid = FALSE;
+
+EXIT:
+	return;
+}
+
+/**
+ * Drop the cache entry of a file
+ *
+ * Needed when the file is replaced rather than written to,
+ * since the cached descriptor would keep referring to the
+ * old file
+ *
+ * @param file Path to the file
+ */
+static void sysfs_cache_forget(const gchar *const file)
+{
+	if ((sysfs_cache != NULL) && (file != NULL))
+		g_hash_table_remove(sysfs_cache, file);
+}
+
+/**
+ * Release all cached file values and descriptors
+ */
+void mce_sysfs_cache_exit(void)
+{
+	if (sysfs_cache != NULL) {
+		g_hash_table_destroy(sysfs_cache);
+		sysfs_cache = NULL;
+	}
+}
+
+/**
+ * Write a string to a file
+ *
+ * @param file Path to the file
+ * @param string The string to write
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_write_string_to_file(const gchar *const file,
+				  const gchar *const string)
+{
+	gboolean status = FALSE;
+	FILE *fp = NULL;
+	gint retval;
+
+	if (file == NULL) {
+		mce_log(LL_CRIT, "file == NULL!");
+		goto EXIT;
+	}
+
+	if (string == NULL) {
+		mce_log(LL_CRIT, "string == NULL!");
+		goto EXIT;
+	}
+
+	if ((fp = fopen(file, "w")) == NULL) {
+		mce_log(LL_ERR,
+			"Cannot open `%s' for %s; %s",
+			file,
+			"writing",
+			g_strerror(errno));
+
+		/* Ignore error */
+		errno = 0;
+		goto EXIT;
+	}
+
+	retval = fprintf(fp, "%s", string);
+
+	/* Was the write successful? */
+	if (retval < 0) {
+		mce_log(LL_ERR,
+			"Failed to write to `%s'; %s",
+			file, g_strerror(errno));
+
+		/* Ignore error */
+		errno = 0;
+		goto EXIT2;
+	}
+
+	status = TRUE;
+
+EXIT2:
+	(void)mce_close_file(file, &fp);
+
+	mce_invalidate_cached_file(file);
+
+EXIT:
+	return status;
+}
+
+/* ========================================================================= *
+ * ASYNCHRONOUS OUTPUT WRITES
+ * ========================================================================= */
+
+/** Lock for the output writer queue and the output async state */
+static GMutex *output_mutex = NULL;
+
+/** Condition for waking up the writer / waiting for the writer */
+static GCond *output_cond = NULL;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+/** Storage for output_mutex */
+static GMutex output_mutex_storage;
+
+/** Storage for output_cond */
+static GCond output_cond_storage;
+#endif
+
+/** Outputs with a value waiting for the writer; data is output_state_t */
+static GQueue output_queue = G_QUEUE_INIT;
+
+/** Output writer thread */
+static GThread *output_thread = NULL;
+
+/** Output the writer is currently writing to, or NULL */
+static output_state_t *output_current = NULL;
+
+/** Should the writer exit once the queue is empty? */
+static gboolean output_quit = FALSE;
+
+/**
+ * Finish an asynchronous write on the mainloop
+ *
+ * Cached reads of the file can only be invalidated once the
+ * value has actually been written; a read made in between
+ * would cache the old value again
+ *
+ * @param output control structure for writing to a file
+ * @param written When the write was completed [us]
+ */
+static void mce_io_output_completed(output_state_t *output, gint64 written)
+{
+	mce_invalidate_cached_file(output->path);
+
+	if (output->written_cb != NULL)
+		output->written_cb(written);
+}
+
+/**
+ * Idle callback for finishing completed asynchronous writes
+ *
+ * @param data The output_state_t that was written to
+ * @return Always returns FALSE, to disable the idle source
+ */
+static gboolean mce_io_output_complete_cb(gpointer data)
+{
+	output_state_t *output = data;
+	gint64 written;
+
+	/* The writer may have been stopped already */
+	if (output_mutex == NULL) {
+		output->async_complete_id = 0;
+		written = output->async_written;
+	} else {
+		g_mutex_lock(output_mutex);
+		output->async_complete_id = 0;
+		written = output->async_written;
+		g_mutex_unlock(output_mutex);
+	}
+
+	mce_io_output_completed(output, written);
+
+	return FALSE;
+}
+
+/**
+ * Write a number to an output file, opening the file if needed
+ *
+ * Does not touch the cached value; the caller takes care of it
+ *
+ * @param output control structure for writing to a file
+ * @param number The number to write
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_write_output(output_state_t *output, const gulong number)
+{
+	gboolean status = FALSE;
+
+	if( !output->file ) {
+		output->file = fopen(output->path, output->truncate_file ? "w" : "a");
+		if( !output->file ) {
+			mce_log(LL_ERR,"%s: can't open %s: %m", output->context, output->path);
+			goto EXIT;
+		}
+	}
+	else if( output->truncate_file && !output->use_pwrite )
+	{
+		rewind(output->file);
+		if( ftruncate(fileno(output->file), 0) == -1 ) {
+			mce_log(LL_WARN,"%s: can't truncate %s: %m", output->context, output->path);
+		}
+	}
+
+	// from now on assume success
+	status = TRUE;
+
+	if( output->use_pwrite ) {
+		char data[32];
+		int size = snprintf(data, sizeof data, "%lu", number);
+
+		if( pwrite(fileno(output->file), data, size, 0) != size ) {
+			mce_log(LL_WARN,"%s: can't write %s: %m", output->context, output->path);
+			status = FALSE;
+		}
+	}
+	else {
+		if( fprintf(output->file, "%lu", number) < 0 ) {
+			mce_log(LL_WARN,"%s: can't write %s: %m", output->context, output->path);
+			status = FALSE;
+		}
+
+		if( fflush(output->file) == EOF ) {
+			mce_log(LL_WARN,"%s: can't flush %s: %m", output->context, output->path);
+			status = FALSE;
+		}
+	}
+
+EXIT:
+
+	if( output->close_on_exit && output->file ) {
+		if( fclose(output->file) == EOF ) {
+			mce_log(LL_WARN,"%s: can't close %s: %m", output->context, output->path);
+		}
+		output->file = 0;
+	}
+
+	return status;
+}
+
+/**
+ * Worker thread for asynchronous output writes
+ *
+ * @param data Unused
+ * @return Always returns NULL
+ */
+static gpointer mce_io_output_thread(gpointer data)
+{
+	output_state_t *output;
+	gboolean status;
+	gulong number;
+
+	(void)data;
+
+	g_mutex_lock(output_mutex);
+
+	for (;;) {
+		if ((output = g_queue_pop_head(&output_queue)) == NULL) {
+			if (output_quit == TRUE)
+				break;
+
+			g_cond_wait(output_cond, output_mutex);
+			continue;
+		}
+
+		number = output->async_value;
+		output->async_queued = FALSE;
+		output_current = output;
+		g_mutex_unlock(output_mutex);
+
+		status = mce_write_output(output, number);
+
+		g_mutex_lock(output_mutex);
+		output->write_count++;
+		output->async_written = g_get_monotonic_time();
+
+		/* Retry the value the next time it is posted */
+		if (status == FALSE)
+			output->cached_valid = FALSE;
+
+		/* The rest is done on the mainloop */
+		if (output->async_complete_id == 0)
+			output->async_complete_id =
+				g_idle_add_full(G_PRIORITY_DEFAULT,
+						mce_io_output_complete_cb,
+						output, NULL);
+
+		output_current = NULL;
+		g_cond_broadcast(output_cond);
+	}
+
+	g_mutex_unlock(output_mutex);
+
+	return NULL;
+}
+
+/**
+ * Release the synchronization objects of the output writer
+ */
+static void mce_io_output_release_sync(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	if (output_cond != NULL)
+		g_cond_clear(output_cond);
+	if (output_mutex != NULL)
+		g_mutex_clear(output_mutex);
+#else
+	if (output_cond != NULL)
+		g_cond_free(output_cond);
+	if (output_mutex != NULL)
+		g_mutex_free(output_mutex);
+#endif
+	output_cond = NULL;
+	output_mutex = NULL;
+}
+
+/**
+ * Start the output writer thread if not already running
+ *
+ * @return TRUE if the writer is available, FALSE otherwise
+ */
+static gboolean mce_io_output_start(void)
+{
+	GError *error = NULL;
+
+	if (output_thread != NULL)
+		goto EXIT;
+
+	output_quit = FALSE;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_init(&output_mutex_storage), output_mutex = &output_mutex_storage;
+	g_cond_init(&output_cond_storage), output_cond = &output_cond_storage;
+
+	output_thread = g_thread_try_new("mce-output", mce_io_output_thread,
+					 NULL, &error);
+#else
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+	output_mutex = g_mutex_new();
+	output_cond = g_cond_new();
+
+	output_thread = g_thread_create(mce_io_output_thread, NULL,
+					TRUE, &error);
+#endif
+
+	if (output_thread == NULL) {
+		mce_log(LL_ERR, "Failed to start output writer thread; %s",
+			error ? error->message : "unknown");
+		mce_io_output_release_sync();
+	}
+
+	g_clear_error(&error);
+
+EXIT:
+	return output_thread != NULL;
+}
+
+/**
+ * Check whether a value is already cached as written to the output
+ *
+ * The path is compared by contents, so that an equal path in another
+ * buffer hits the cache and a recycled buffer does not
+ *
+ * @param output control structure for writing to a file
+ * @param number The value about to be written
+ * @return TRUE if the value need not be written again, FALSE otherwise
+ */
+static gboolean mce_io_output_cache_hit(const output_state_t *output,
+					const gulong number)
+{
+	return (output->skip_unchanged && output->cached_valid &&
+		output->cached_value == number &&
+		!g_strcmp0(output->cached_path, output->path));
+}
+
+/**
+ * Remember the value written to the output
+ *
+ * @param output control structure for writing to a file
+ * @param valid TRUE if the value is known to be in the file
+ * @param number The value written
+ */
+static void mce_io_output_cache_store(output_state_t *output,
+				      gboolean valid, const gulong number)
+{
+	output->cached_valid = valid;
+	output->cached_value = number;
+
+	if( g_strcmp0(output->cached_path, output->path) ) {
+		g_free(output->cached_path);
+		output->cached_path = g_strdup(output->path);
+	}
+}
+
+/**
+ * Post a value to be written by the output writer thread
+ *
+ * If the output already has a value waiting for the writer,
+ * the old value is replaced with the new one
+ *
+ * @param output control structure for writing to a file
+ * @param number The number to write
+ *
+ * @return TRUE if the value was posted or need not be written,
+ *         FALSE if the writer is not available
+ */
+static gboolean mce_io_output_post(output_state_t *output,
+				   const gulong number)
+{
+	if (mce_io_output_start() == FALSE)
+		return FALSE;
+
+	g_mutex_lock(output_mutex);
+
+	/* The cached value tracks the latest posted value */
+	if (mce_io_output_cache_hit(output, number) == TRUE) {
+		output->skip_count++;
+		goto EXIT;
+	}
+
+	if (output->async_queued == TRUE) {
+		output->drop_count++;
+	} else {
+		output->async_queued = TRUE;
+		g_queue_push_tail(&output_queue, output);
+		g_cond_broadcast(output_cond);
 	}
 
-	/* Ignore error */
-	errno = 0;
+	output->async_value = number;
+	mce_io_output_cache_store(output, TRUE, number);
 
 EXIT:
-	return status;
+	g_mutex_unlock(output_mutex);
+
+	return TRUE;
 }
 
 /**
- * Write a string to a file
+ * Wait until the output writer is done with an output
  *
- * @param file Path to the file
- * @param string The string to write
- * @return TRUE on success, FALSE on failure
+ * Meant for ordering the writes with other hardware accesses;
+ * when this returns, all values posted to the output have been
+ * written and the completed writes have been finished
+ *
+ * @param output control structure for writing to a file
  */
-gboolean mce_write_string_to_file(const gchar *const file,
-				  const gchar *const string)
+void mce_io_output_flush(output_state_t *output)
 {
-	gboolean status = FALSE;
-	FILE *fp = NULL;
-	gint retval;
+	guint complete_id;
+	gint64 written;
 
-	if (file == NULL) {
-		mce_log(LL_CRIT, "file == NULL!");
+	if ((output == NULL) || (output_mutex == NULL))
 		goto EXIT;
-	}
 
-	if (string == NULL) {
-		mce_log(LL_CRIT, "string == NULL!");
-		goto EXIT;
-	}
+	g_mutex_lock(output_mutex);
 
-	if ((fp = fopen(file, "w")) == NULL) {
-		mce_log(LL_ERR,
-			"Cannot open `%s' for %s; %s",
-			file,
-			"writing",
-			g_strerror(errno));
+	while ((output->async_queued == TRUE) || (output_current == output))
+		g_cond_wait(output_cond, output_mutex);
 
-		/* Ignore error */
-		errno = 0;
-		goto EXIT;
+	complete_id = output->async_complete_id;
+	output->async_complete_id = 0;
+	written = output->async_written;
+
+	g_mutex_unlock(output_mutex);
+
+	if (complete_id != 0) {
+		g_source_remove(complete_id);
+		mce_io_output_completed(output, written);
 	}
 
-	retval = fprintf(fp, "%s", string);
+EXIT:
+	return;
+}
 
-	/* Was the write successful? */
-	if (retval < 0) {
-		mce_log(LL_ERR,
-			"Failed to write to `%s'; %s",
-			file, g_strerror(errno));
+/**
+ * Finish all pending output writes and stop the writer thread
+ *
+ * Blocks until the posted values are written; to be called on exit
+ */
+void mce_io_quit_output_writer(void)
+{
+	if (output_thread == NULL)
+		goto EXIT;
 
-		/* Ignore error */
-		errno = 0;
-		goto EXIT2;
-	}
+	g_mutex_lock(output_mutex);
+	output_quit = TRUE;
+	g_cond_broadcast(output_cond);
+	g_mutex_unlock(output_mutex);
 
-	status = TRUE;
+	g_thread_join(output_thread), output_thread = NULL;
 
-EXIT2:
-	(void)mce_close_file(file, &fp);
+	mce_io_output_release_sync();
 
 EXIT:
-	return status;
+	return;
 }
 
 /**
  * Cleanup function for output file control structures
  *
- * Closes file stream associated with output if it is open
+ * Waits for pending asynchronous writes to the output
+ * and closes file stream associated with output if it is open
  *
  * It is explicitly permitted to call this function:
  * 1) with NULL output parameter
@@ -440,11 +1235,25 @@ EXIT:
 
 void mce_close_output(output_state_t *output)
 {
+	if( output && output->async )
+		mce_io_output_flush(output);
+
 	if( output && output->file ) {
 		if( fclose(output->file) == EOF ) {
 			mce_log(LL_WARN,"%s: can't close %s: %m", output->context, output->path);
 		}
 		output->file = 0;
+
+		mce_log(LL_DEBUG, "%s: %u writes, %u skipped as unchanged, "
+			"%u dropped as superseded",
+			output->context, output->write_count,
+			output->skip_count, output->drop_count);
+	}
+
+	/* Do not trust the cached value after reopening */
+	if( output ) {
+		output->cached_valid = FALSE;
+		g_free(output->cached_path), output->cached_path = NULL;
 	}
 }
 
@@ -455,6 +1264,10 @@ void mce_close_output(output_state_t *output)
  * It should thus not be used in cases where atomicity is expected.
  * For atomic replace, use mce_write_number_string_to_file_atomic()
  *
+ * For outputs with the async flag set the value is written by
+ * the output writer thread; the return value then only tells
+ * whether the value was accepted for writing
+ *
  * @param output control structure for writing to a file
  * @param number The number to write
  *
@@ -483,43 +1296,30 @@ gboolean mce_write_number_string_to_file(output_state_t *output, const gulong nu
 		goto EXIT;
 	}
 
-	if( !output->file ) {
-		output->file = fopen(output->path, output->truncate_file ? "w" : "a");
-		if( !output->file ) {
-			mce_log(LL_ERR,"%s: can't open %s: %m", output->context, output->path);
-			goto EXIT;
-		}
-	}
-	else if( output->truncate_file )
-	{
-		rewind(output->file);
-		if( ftruncate(fileno(output->file), 0) == -1 ) {
-			mce_log(LL_WARN,"%s: can't truncate %s: %m", output->context, output->path);
-		}
+	/* Cached reads are invalidated once the writer is done */
+	if( output->async && mce_io_output_post(output, number) ) {
+		status = TRUE;
+		goto EXIT;
 	}
 
-	// from now on assume success
-	status = TRUE;
-
-	if( fprintf(output->file, "%lu", number) < 0 ) {
-		mce_log(LL_WARN,"%s: can't write %s: %m", output->context, output->path);
-		status = FALSE;
+	/* Skip writes that would not change anything */
+	if( mce_io_output_cache_hit(output, number) ) {
+		output->skip_count++;
+		status = TRUE;
+		goto EXIT;
 	}
 
-	if( fflush(output->file) == EOF ) {
-		mce_log(LL_WARN,"%s: can't flush %s: %m", output->context, output->path);
-		status = FALSE;
-	}
+	status = mce_write_output(output, number);
 
-EXIT:
+	output->write_count++;
+	mce_io_output_cache_store(output, status, number);
 
-	if( output->close_on_exit && output->file ) {
-		if( fclose(output->file) == EOF ) {
-			mce_log(LL_WARN,"%s: can't close %s: %m", output->context, output->path);
-		}
-		output->file = 0;
-	}
+	if( status )
+		mce_io_output_completed(output, g_get_monotonic_time());
+	else
+		mce_invalidate_cached_file(output->path);
 
+EXIT:
 	return status;
 }
 
@@ -627,6 +1427,9 @@ EXIT2:
 EXIT:
 	g_free(tmpname);
 
+	/* The cached descriptor refers to the replaced file */
+	sysfs_cache_forget(file);
+
 	return status;
 }
 
@@ -645,9 +1448,11 @@ static gboolean io_string_cb(GIOChannel *source,
 {
 	iomon_struct *iomon = data;
 	gchar *str = NULL;
-	gsize bytes_read;
+	gsize bytes_read = 0;
 	GError *error = NULL;
 	gboolean status = TRUE;
+	mce_wakeup_owner_t *owner = NULL;
+	gint64 started = mce_wakeup_begin();
 
 	/* Silence warnings */
 	(void)condition;
@@ -658,6 +1463,8 @@ static gboolean io_string_cb(GIOChannel *source,
 		goto EXIT;
 	}
 
+	/* Still valid if the callback unregisters the monitor */
+	owner = iomon->wakeup_owner;
 	iomon->latest_io_condition = 0;
 
 	/* Seek to the beginning of the file before reading if needed */
@@ -688,7 +1495,14 @@ static gboolean io_string_cb(GIOChannel *source,
 			"Empty read from %s",
 			iomon->file);
 	} else {
+		/* The callback may unregister the monitor */
+		iomon_current = iomon;
 		(void)iomon->callback(str, bytes_read);
+
+		if (iomon_current != iomon)
+			iomon = NULL;
+
+		iomon_current = NULL;
 	}
 
 	g_free(str);
@@ -699,7 +1513,16 @@ static gboolean io_string_cb(GIOChannel *source,
 	errno = 0;
 	g_clear_error(&error);
 
+	if (iomon == NULL)
+		goto EXIT;
+
+	iomon->wakeups += 1;
+	iomon->bytes += bytes_read;
+	iomon->time += g_get_monotonic_time() - started;
+
 EXIT:
+	mce_wakeup_account(owner, started);
+
 	if ((status == FALSE) &&
 	    (iomon != NULL) &&
 	    (iomon->error_policy == MCE_IO_ERROR_POLICY_EXIT)) {
@@ -730,6 +1553,60 @@ static const char *io_status_name(GIOStatus io_status)
 	return status_name;
 }
 
+#ifdef ENABLE_WAKELOCKS
+/**
+ * Timer callback for releasing the input handler wakelock
+ *
+ * If more input has been read since the timer was started,
+ * the timer is started again for the rest of the grace period
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean input_wakelock_release_cb(gpointer data)
+{
+	gint64 left = (input_wakelock_release_tick -
+		       g_get_monotonic_time() / 1000);
+
+	(void)data;
+
+	if (left > 0) {
+		input_wakelock_release_id =
+			g_timeout_add((guint)left,
+				      input_wakelock_release_cb, NULL);
+		goto EXIT;
+	}
+
+	input_wakelock_release_id = 0;
+	wakelock_unlock("mce_input_handler");
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Release the input handler wakelock after a grace period
+ *
+ * Called after every read; to keep that cheap, only the release
+ * time is moved and the timer is started only if it is not running
+ */
+static void input_wakelock_release_later(void)
+{
+	input_wakelock_release_tick = (g_get_monotonic_time() / 1000 +
+				       INPUT_WAKELOCK_GRACE_MS);
+
+	if (input_wakelock_release_id != 0)
+		goto EXIT;
+
+	input_wakelock_release_id =
+		g_timeout_add(INPUT_WAKELOCK_GRACE_MS,
+			      input_wakelock_release_cb, NULL);
+
+EXIT:
+	return;
+}
+#endif
+
 /**
  * Callback for successful chunk I/O
  *
@@ -744,14 +1621,16 @@ static gboolean io_chunk_cb(GIOChannel *source,
 			    gpointer data)
 {
 	iomon_struct *iomon = data;
-	gchar *buffer = NULL;
-	gsize bytes_want = 4096;
 	gsize bytes_read = 0;
 	gsize chunks_read = 0;
 	gsize chunks_done = 0;
 	GIOStatus io_status;
 	GError *error = NULL;
 	gboolean status = TRUE;
+	ssize_t rc;
+	int read_errno = 0;
+	mce_wakeup_owner_t *owner = NULL;
+	gint64 started = mce_wakeup_begin();
 
 	/* Silence warnings */
 	(void)condition;
@@ -762,6 +1641,8 @@ static gboolean io_chunk_cb(GIOChannel *source,
 		goto EXIT;
 	}
 
+	/* Still valid if the callback unregisters the monitor */
+	owner = iomon->wakeup_owner;
 	iomon->latest_io_condition = 0;
 
 	/* Seek to the beginning of the file before reading if needed */
@@ -779,14 +1660,6 @@ static gboolean io_chunk_cb(GIOChannel *source,
 		g_clear_error(&error);
 	}
 
-	if( iomon->chunk_size < bytes_want ) {
-		bytes_want -= bytes_want % iomon->chunk_size;
-	} else {
-		bytes_want = iomon->chunk_size;
-	}
-
-	buffer = g_malloc(bytes_want);
-
 #ifdef ENABLE_WAKELOCKS
 	/* Since the locks on kernel side are released once all
 	 * events are read, we must obtain the userspace lock
@@ -794,25 +1667,66 @@ static gboolean io_chunk_cb(GIOChannel *source,
 	wakelock_lock("mce_input_handler", -1);
 #endif
 
-	io_status = g_io_channel_read_chars(source, buffer,
-					    bytes_want, &bytes_read, &error);
-
-
-	/* If the read was interrupted, ignore */
-	if (io_status == G_IO_STATUS_AGAIN) {
-		g_clear_error(&error);
+	/* The channel is unbuffered and in binary mode, so reading
+	 * straight from the file descriptor gives the same data as
+	 * g_io_channel_read_chars() without the extra copying
+	 */
+	do {
+		rc = read(g_io_channel_unix_get_fd(source),
+			  iomon->buffer, iomon->buffer_size);
+	} while ((rc == -1) && (errno == EINTR));
+
+	if (rc > 0) {
+		bytes_read = (gsize)rc;
+		io_status = G_IO_STATUS_NORMAL;
+	} else if (rc == 0) {
+		io_status = G_IO_STATUS_EOF;
+	} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+		io_status = G_IO_STATUS_AGAIN;
+	} else {
+		read_errno = errno;
+		io_status = G_IO_STATUS_ERROR;
 	}
 
 	if( bytes_read % iomon->chunk_size ) {
 		mce_log(LL_WARN, "Incomplete chunks read from: %s", iomon->file);
 	}
 
-	/* Process the data, and optionally ignore some of it */
-	if( (chunks_read = bytes_read / iomon->chunk_size) ) {
-		gchar *chunk = buffer;
+	chunks_read = bytes_read / iomon->chunk_size;
+
+	iomon_current = iomon;
+
+	/* Process the data, and optionally ignore some of it;
+	 * the callbacks may unregister the monitor, in which
+	 * case iomon_current is reset and iomon is gone */
+	if( chunks_read && iomon->batch_callback ) {
+		gboolean skip;
+
+		chunks_done = chunks_read;
+		skip = iomon->batch_callback(iomon->buffer, iomon->chunk_size,
+					     chunks_read);
+
+		if( iomon_current != iomon )
+			goto UNREGISTERED;
+
+		if( skip && iomon->seekable ) {
+			/* if possible, seek to the end of file */
+			g_io_channel_seek_position(iomon->iochan, 0,
+						   G_SEEK_END, &error);
+		}
+	}
+	else if( chunks_read ) {
+		gchar *chunk = iomon->buffer;
 		for( ; chunks_done < chunks_read ; chunk += iomon->chunk_size ) {
+			gboolean skip;
+
 			++chunks_done;
-			if (iomon->callback(chunk, iomon->chunk_size) != TRUE) {
+			skip = iomon->callback(chunk, iomon->chunk_size);
+
+			if( iomon_current != iomon )
+				goto UNREGISTERED;
+
+			if (skip != TRUE) {
 				continue;
 			}
 			/* if possible, seek to the end of file */
@@ -825,30 +1739,37 @@ static gboolean io_chunk_cb(GIOChannel *source,
 		}
 	}
 
+	iomon_current = NULL;
+
 	mce_log(LL_INFO, "%s: status=%s, data=%d/%d=%d+%d, skipped=%d",
 		iomon->file, io_status_name(io_status),
 		bytes_read, (int)iomon->chunk_size, chunks_read,
 		bytes_read % (int)iomon->chunk_size, chunks_read - chunks_done);
 
 #ifdef ENABLE_WAKELOCKS
-	/* Release the lock after we're done with processing it */
-	wakelock_unlock("mce_input_handler");
+	/* Release the lock shortly after we're done with processing;
+	 * more input is likely to follow */
+	input_wakelock_release_later();
 #endif
 
-
-	g_free(buffer);
-
 	/* Were there any errors? */
 	if (error != NULL) {
+		mce_log(LL_ERR,	"%s: seek error: %s",
+			iomon->file, error->message);
+
+		/* Reset errno,
+		 * to avoid false positives down the line
+		 */
+		errno = 0;
+		g_clear_error(&error);
+	}
+
+	if (io_status == G_IO_STATUS_ERROR) {
 		mce_log(LL_ERR,
 			"Error when reading from %s: %s",
-			iomon->file, error->message);
+			iomon->file, g_strerror(read_errno));
 
-		if ((error->code == G_IO_CHANNEL_ERROR_FAILED) &&
-		    (errno == ENODEV) &&
-		    (iomon->seekable)) {
-			errno = 0;
-			g_clear_error(&error);
+		if ((read_errno == ENODEV) && (iomon->seekable)) {
 			g_io_channel_seek_position(iomon->iochan, 0,
 						   G_SEEK_END, &error);
 			if( error ) {
@@ -872,7 +1793,25 @@ static gboolean io_chunk_cb(GIOChannel *source,
 			iomon->file);
 	}
 
+	iomon->wakeups += 1;
+	iomon->bytes += bytes_read;
+	iomon->time += g_get_monotonic_time() - started;
+
+	goto EXIT;
+
+UNREGISTERED:
+	/* The monitor was unregistered by a callback;
+	 * it must not be touched any more */
+	iomon_current = NULL;
+	iomon = NULL;
+
+#ifdef ENABLE_WAKELOCKS
+	input_wakelock_release_later();
+#endif
+
 EXIT:
+	mce_wakeup_account(owner, started);
+
 	if ((status == FALSE) &&
 	    (iomon != NULL) &&
 	    (iomon->error_policy == MCE_IO_ERROR_POLICY_EXIT)) {
@@ -936,27 +1875,218 @@ static gboolean io_error_cb(GIOChannel *source,
 		iomon->latest_io_condition |= condition;
 	}
 
-	if (loglevel != LL_NONE) {
-		mce_log(loglevel,
-			"Error accessing %s (condition: %d). %s",
-			iomon->file, condition,
-			(exit_on_error == TRUE) ? "Exiting" : "Ignoring");
+	if (loglevel != LL_NONE) {
+		mce_log(loglevel,
+			"Error accessing %s (condition: %d). %s",
+			iomon->file, condition,
+			(exit_on_error == TRUE) ? "Exiting" : "Ignoring");
+	}
+
+EXIT:
+	if ((iomon != NULL) && (exit_on_error == TRUE)) {
+		// FIXME: this is not how one should exit from mainloop
+		mce_quit_mainloop();
+		exit(EXIT_FAILURE);
+	}
+
+	/* Call error callback if set */
+	if (iomon->err_callback) {
+		iomon->err_callback(iomon, condition);
+	}
+
+	return TRUE;
+}
+
+#ifdef ENABLE_IOMON_EPOLL
+/** Maximum number of ready monitors serviced per main loop wakeup */
+# define IOMON_EPOLL_MAX_DISPATCH		32
+
+/** File descriptor for the epoll set shared by chunk I/O monitors */
+static int iomon_epoll_fd = -1;
+
+/** GSource ID for the epoll set watch */
+static guint iomon_epoll_watch_id = 0;
+
+/** Number of I/O monitors in the epoll set */
+static guint iomon_epoll_count = 0;
+
+/**
+ * Callback for activity in the epoll set
+ *
+ * The ready monitors are fetched one at a time, so that a
+ * monitor unregistered by a callback is never dispatched
+ * from a stale event array
+ *
+ * @param source Unused
+ * @param condition Unused
+ * @param data Unused
+ * @return Always returns TRUE, to keep the watch
+ */
+static gboolean iomon_epoll_cb(GIOChannel *source,
+			       GIOCondition condition,
+			       gpointer data)
+{
+	struct epoll_event event;
+	guint dispatched;
+
+	/* Silence warnings */
+	(void)source;
+	(void)condition;
+	(void)data;
+
+	for (dispatched = 0; dispatched < IOMON_EPOLL_MAX_DISPATCH;
+	     ++dispatched) {
+		iomon_struct *iomon;
+		int rc;
+
+		rc = epoll_wait(iomon_epoll_fd, &event, 1, 0);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc != 1)
+			break;
+
+		iomon = event.data.ptr;
+		iomon_dispatched = iomon;
+
+		if (event.events & (EPOLLIN | EPOLLPRI))
+			io_chunk_cb(iomon->iochan, G_IO_IN, iomon);
+
+		/* The data callback may have unregistered or
+		 * suspended the monitor */
+		if ((iomon_dispatched != iomon) ||
+		    (iomon->in_epoll_set == FALSE))
+			continue;
+
+		if ((event.events & (EPOLLHUP | EPOLLERR)) == 0)
+			continue;
+
+		if (event.events & EPOLLHUP)
+			io_error_cb(iomon->iochan, G_IO_HUP, iomon);
+		else
+			io_error_cb(iomon->iochan, G_IO_ERR, iomon);
+
+		/* The epoll set is level triggered, so the condition
+		 * would be reported again right away; suspend the
+		 * monitor unless the error callback removed it */
+		if ((iomon_dispatched == iomon) &&
+		    (iomon->in_epoll_set == TRUE)) {
+			mce_log(LL_WARN, "%s: suspended after %s",
+				iomon->file,
+				(event.events & EPOLLHUP) ? "hangup" : "error");
+			mce_suspend_io_monitor(iomon);
+		}
+	}
+
+	iomon_dispatched = NULL;
+
+	/* Reset errno,
+	 * to avoid false positives down the line
+	 */
+	errno = 0;
+
+	return TRUE;
+}
+
+/**
+ * Add a chunk I/O monitor to the epoll set
+ *
+ * The epoll set and its main loop watch are created when
+ * the first monitor is added
+ *
+ * @param iomon The I/O monitor to add
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean iomon_epoll_add(iomon_struct *iomon)
+{
+	struct epoll_event event;
+	gboolean status = FALSE;
+
+	if (iomon_epoll_fd == -1) {
+		GIOChannel *iochan;
+
+		if ((iomon_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+			mce_log(LL_ERR, "Failed to create epoll set; %s",
+				g_strerror(errno));
+			goto EXIT;
+		}
+
+		iochan = g_io_channel_unix_new(iomon_epoll_fd);
+		iomon_epoll_watch_id = g_io_add_watch(iochan, G_IO_IN,
+						      iomon_epoll_cb, NULL);
+		/* The watch holds a reference to the channel */
+		g_io_channel_unref(iochan);
+	}
+
+	memset(&event, 0, sizeof event);
+	event.data.ptr = iomon;
+
+	if (iomon->monitored_io_conditions & G_IO_IN)
+		event.events |= EPOLLIN;
+	if (iomon->monitored_io_conditions & G_IO_PRI)
+		event.events |= EPOLLPRI;
+
+	if (epoll_ctl(iomon_epoll_fd, EPOLL_CTL_ADD,
+		      g_io_channel_unix_get_fd(iomon->iochan), &event) == -1) {
+		mce_log(LL_WARN, "%s: can't add to epoll set; %s",
+			iomon->file, g_strerror(errno));
+		goto EXIT;
 	}
 
+	iomon->in_epoll_set = TRUE;
+	++iomon_epoll_count;
+	status = TRUE;
+
 EXIT:
-	if ((iomon != NULL) && (exit_on_error == TRUE)) {
-		// FIXME: this is not how one should exit from mainloop
-		mce_quit_mainloop();
-		exit(EXIT_FAILURE);
+	/* Reset errno,
+	 * to avoid false positives down the line
+	 */
+	errno = 0;
+
+	return status;
+}
+
+/**
+ * Remove a chunk I/O monitor from the epoll set
+ *
+ * The epoll set is released along with the last monitor
+ *
+ * @param iomon The I/O monitor to remove
+ */
+static void iomon_epoll_remove(iomon_struct *iomon)
+{
+	if (iomon->in_epoll_set == FALSE)
+		goto EXIT;
+
+	/* Failure is expected if the fd was already closed; the
+	 * kernel drops closed descriptors from the set anyway */
+	if (epoll_ctl(iomon_epoll_fd, EPOLL_CTL_DEL,
+		      g_io_channel_unix_get_fd(iomon->iochan), NULL) == -1) {
+		mce_log(LL_DEBUG, "%s: can't remove from epoll set; %s",
+			iomon->file, g_strerror(errno));
+		errno = 0;
 	}
 
-	/* Call error callback if set */
-	if (iomon->err_callback) {
-		iomon->err_callback(iomon, condition);
+	iomon->in_epoll_set = FALSE;
+
+	if (--iomon_epoll_count > 0)
+		goto EXIT;
+
+	g_source_remove(iomon_epoll_watch_id), iomon_epoll_watch_id = 0;
+
+	if (close(iomon_epoll_fd) == -1) {
+		mce_log(LL_ERR, "Failed to close epoll set; %s",
+			g_strerror(errno));
+		errno = 0;
 	}
 
-	return TRUE;
+	iomon_epoll_fd = -1;
+
+EXIT:
+	return;
 }
+#endif /* ENABLE_IOMON_EPOLL */
 
 /**
  * Suspend an I/O monitor
@@ -975,6 +2105,14 @@ void mce_suspend_io_monitor(gconstpointer io_monitor)
 	if (iomon->suspended == TRUE)
 		goto EXIT;
 
+#ifdef ENABLE_IOMON_EPOLL
+	if (iomon->in_epoll_set == TRUE) {
+		iomon_epoll_remove(iomon);
+		iomon->suspended = TRUE;
+		goto EXIT;
+	}
+#endif
+
 	/* Remove I/O watches */
 	g_source_remove(iomon->data_source_id);
 	g_source_remove(iomon->error_source_id);
@@ -1037,6 +2175,16 @@ void mce_resume_io_monitor(gconstpointer io_monitor)
 			g_clear_error(&error);
 		}
 
+#ifdef ENABLE_IOMON_EPOLL
+		/* Chunk monitors share one epoll set; fall back to
+		 * glib watches if the fd can't be added to it */
+		if ((iomon->type == IOMON_CHUNK) &&
+		    (iomon_epoll_add(iomon) == TRUE)) {
+			iomon->suspended = FALSE;
+			goto EXIT;
+		}
+#endif
+
 		iomon->error_source_id = g_io_add_watch(iomon->iochan,
 							G_IO_HUP | G_IO_NVAL,
 							io_error_cb, iomon);
@@ -1154,18 +2302,27 @@ static iomon_struct *mce_register_io_monitor(const gint fd,
 
 	iomon->fd = fd;
 	iomon->file = g_strdup(file);
+	iomon->wakeup_owner = mce_wakeup_owner("iomon", file);
 	iomon->iochan = iochan;
 	iomon->callback = callback;
+	iomon->batch_callback = NULL;
 	iomon->error_policy = error_policy;
 	iomon->monitored_io_conditions = monitored_conditions;
 	iomon->latest_io_condition = 0;
 	iomon->rewind = FALSE;
 	iomon->chunk_size = 0;
+	iomon->buffer = NULL;
+	iomon->buffer_size = 0;
 	iomon->err_callback = 0;
+	iomon->in_epoll_set = FALSE;
+	iomon->user_data = NULL;
+	iomon->user_data_free = NULL;
 
 	mce_determine_io_monitor_seekable(iomon);
 
 	file_monitors = g_slist_prepend(file_monitors, iomon);
+	mce_memstat_alloc("iomon:monitors",
+			  sizeof *iomon + strlen(iomon->file) + 1);
 
 	iomon->suspended = TRUE;
 
@@ -1263,6 +2420,19 @@ gconstpointer mce_register_io_monitor_chunk(const gint fd,
 	/* Set the read chunk size */
 	iomon->chunk_size = chunk_size;
 
+	/* Allocate the read buffer once; it holds as many whole
+	 * chunks as fit in IOMON_CHUNK_READ_SIZE, but at least one
+	 */
+	if (chunk_size < IOMON_CHUNK_READ_SIZE) {
+		iomon->buffer_size = IOMON_CHUNK_READ_SIZE -
+				     IOMON_CHUNK_READ_SIZE % chunk_size;
+	} else {
+		iomon->buffer_size = chunk_size;
+	}
+
+	iomon->buffer = g_malloc(iomon->buffer_size);
+	mce_memstat_alloc("iomon:buffers", iomon->buffer_size);
+
 	/* Verify that the rewind policy is sane */
 	if (iomon->seekable) {
 		/* Set the rewind policy */
@@ -1308,6 +2478,71 @@ EXIT:
 	return iomon;
 }
 
+/**
+ * Dummy per-chunk callback for batch chunk I/O monitors
+ *
+ * @param data Unused
+ * @param bytes_read Unused
+ * @return Always returns FALSE
+ */
+static gboolean io_chunk_batch_dummy_cb(gpointer data, gsize bytes_read)
+{
+	(void)data;
+	(void)bytes_read;
+
+	return FALSE;
+}
+
+/**
+ * Register an I/O monitor; reads chunks of specified size and
+ * passes all chunks from one read to the callback at once
+ *
+ * @param fd File Descriptor; this takes priority over file; -1 if not used
+ * @param file Path to the file
+ * @param error_policy MCE_IO_ERROR_POLICY_EXIT to exit on error,
+ *                     MCE_IO_ERROR_POLICY_WARN to warn about errors
+ *                                              but ignore them,
+ *                     MCE_IO_ERROR_POLICY_IGNORE to silently ignore errors
+ * @param monitored_conditions The GIOConditions to monitor
+ * @param rewind_policy TRUE to seek to the beginning,
+ *                      FALSE to stay at current position
+ * @param callback Function to call with the array of chunks;
+ *                 it returns TRUE to ignore any data left unread
+ * @param chunk_size The number of bytes in each chunk
+ * @return An I/O monitor cookie on success, NULL on failure
+ */
+gconstpointer mce_register_io_monitor_chunk_batch(const gint fd,
+						  const gchar *const file,
+						  error_policy_t error_policy,
+						  GIOCondition monitored_conditions,
+						  gboolean rewind_policy,
+						  iomon_batch_cb callback,
+						  gulong chunk_size)
+{
+	iomon_struct *iomon = NULL;
+
+	if (callback == NULL) {
+		mce_log(LL_CRIT, "callback == NULL!");
+		goto EXIT;
+	}
+
+	/* The watch is serviced from the mainloop, so the batch
+	 * callback is in place before any data gets dispatched
+	 */
+	iomon = (iomon_struct *)mce_register_io_monitor_chunk(fd, file,
+							       error_policy,
+							       monitored_conditions,
+							       rewind_policy,
+							       io_chunk_batch_dummy_cb,
+							       chunk_size);
+
+	if (iomon != NULL)
+		iomon->batch_callback = callback;
+
+EXIT:
+	return iomon;
+}
+
 /**
  * Unregister an I/O monitor
  * Note: This does NOT shutdown I/O channels created from file descriptors
@@ -1368,7 +2603,22 @@ void mce_unregister_io_monitor(gconstpointer io_monitor)
 		g_clear_error(&error);
 	}
 
+	if (iomon->user_data_free != NULL)
+		iomon->user_data_free(iomon->user_data);
+
+	if (iomon_current == iomon)
+		iomon_current = NULL;
+
+	if (iomon_dispatched == iomon)
+		iomon_dispatched = NULL;
+
+	if (iomon->buffer != NULL)
+		mce_memstat_free("iomon:buffers", iomon->buffer_size);
+	mce_memstat_free("iomon:monitors",
+			 sizeof *iomon + strlen(iomon->file) + 1);
+
 	g_io_channel_unref(iomon->iochan);
+	g_free(iomon->buffer);
 	g_free(iomon->file);
 	g_slice_free(iomon_struct, iomon);
 
@@ -1392,6 +2642,59 @@ void mce_set_io_monitor_err_cb(gconstpointer io_monitor, iomon_err_cb err_cb)
 	}
 }
 
+/**
+ * Attach user data to an I/O monitor
+ *
+ * The data is released with free_cb when the I/O monitor
+ * is unregistered or when new user data is attached
+ *
+ * @param io_monitor A pointer to the I/O monitor
+ * @param user_data The data to attach
+ * @param free_cb Destructor for user_data, or NULL
+ */
+void mce_set_io_monitor_user_data(gconstpointer io_monitor,
+				  gpointer user_data,
+				  GDestroyNotify free_cb)
+{
+	iomon_struct *iomon = (iomon_struct *)io_monitor;
+
+	if (iomon == NULL)
+		goto EXIT;
+
+	if (iomon->user_data_free != NULL)
+		iomon->user_data_free(iomon->user_data);
+
+	iomon->user_data = user_data;
+	iomon->user_data_free = free_cb;
+
+EXIT:
+	return;
+}
+
+/**
+ * Return the user data attached to an I/O monitor
+ *
+ * @param io_monitor An opaque pointer to the I/O monitor structure
+ * @return The user data, or NULL if none is attached
+ */
+gpointer mce_get_io_monitor_user_data(gconstpointer io_monitor)
+{
+	iomon_struct *iomon = (iomon_struct *)io_monitor;
+
+	return iomon ? iomon->user_data : NULL;
+}
+
+/**
+ * Return the I/O monitor whose callback is being executed
+ *
+ * @return An opaque pointer to the I/O monitor structure,
+ *         or NULL when called outside I/O monitor callbacks
+ */
+gconstpointer mce_get_current_io_monitor(void)
+{
+	return iomon_current;
+}
+
 /**
  * Return the name of the monitored file
  *
@@ -1420,6 +2723,25 @@ int mce_get_io_monitor_fd(gconstpointer io_monitor)
 	return iomon->fd;
 }
 
+/**
+ * Report the accounting of all registered I/O monitors
+ *
+ * @param callback Function to call for each I/O monitor
+ * @param user_data Data to pass to the callback
+ */
+void mce_io_monitor_stats_foreach(iomon_stats_cb callback,
+				  gpointer user_data)
+{
+	GSList *item;
+
+	for (item = file_monitors; item != NULL; item = item->next) {
+		const iomon_struct *iomon = item->data;
+
+		callback(iomon->file, iomon->wakeups, iomon->bytes,
+			 iomon->time, user_data);
+	}
+}
+
 /**
  * Test whether there's a settings lock due to pending
  * backup/restore or device clear/factory reset operation
@@ -1602,6 +2924,12 @@ gboolean mce_io_save_file(const char *path,
 		goto EXIT;
 	}
 
+	/* Make sure the data is on disk before it replaces anything */
+	if( fsync(fd) == -1 ) {
+		mce_log(LL_WARN, "fsync(%s): %m", path);
+		goto EXIT;
+	}
+
 	res = TRUE;
 
 EXIT:
@@ -1707,3 +3035,293 @@ EXIT:
 
 	return res;
 }
+
+/* ========================================================================= *
+ * ASYNCHRONOUS FILE SAVING
+ * ========================================================================= */
+
+/** Completion callback registered for an asynchronous save */
+typedef struct {
+	mce_io_save_done_cb cb;			/**< Function to call */
+	gpointer user_data;			/**< Data to pass along */
+} mce_io_save_done_t;
+
+/** Asynchronous file save request */
+typedef struct {
+	gchar *path;				/**< File to write to */
+	void *data;				/**< Copy of the data to write */
+	size_t size;				/**< Length of the data */
+	mode_t mode;				/**< Protection bits to apply */
+	gboolean keep_backup;			/**< Keep the backup file? */
+	gboolean success;			/**< Result of the save */
+	GSList *done;				/**< mce_io_save_done_t items */
+} mce_io_save_t;
+
+/** Lock for the save queue and the worker state */
+static GMutex *save_mutex = NULL;
+
+/** Condition for waking up the worker / waiting for the worker */
+static GCond *save_cond = NULL;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+/** Storage for save_mutex */
+static GMutex save_mutex_storage;
+
+/** Storage for save_cond */
+static GCond save_cond_storage;
+#endif
+
+/** Requests waiting for the worker; data is mce_io_save_t */
+static GQueue save_queue = G_QUEUE_INIT;
+
+/** Save worker thread */
+static GThread *save_thread = NULL;
+
+/** Is the worker busy with a request taken from the queue? */
+static gboolean save_busy = FALSE;
+
+/** Should the worker exit once the queue is empty? */
+static gboolean save_quit = FALSE;
+
+/**
+ * Release an asynchronous save request
+ *
+ * @param req The request to free
+ */
+static void mce_io_save_free(mce_io_save_t *req)
+{
+	g_slist_foreach(req->done, (GFunc)g_free, NULL);
+	g_slist_free(req->done);
+	g_free(req->data);
+	g_free(req->path);
+	g_free(req);
+}
+
+/**
+ * Notify completion of an asynchronous save in the main loop
+ *
+ * @param data The completed request
+ * @return Always returns FALSE to disable the idle callback
+ */
+static gboolean mce_io_save_done_cb_idle(gpointer data)
+{
+	mce_io_save_t *req = data;
+	GSList *item;
+
+	for (item = req->done; item != NULL; item = item->next) {
+		mce_io_save_done_t *done = item->data;
+
+		done->cb(req->path, req->success, done->user_data);
+	}
+
+	mce_io_save_free(req);
+
+	return FALSE;
+}
+
+/**
+ * Worker thread for asynchronous saves
+ *
+ * @param data Unused
+ * @return Always returns NULL
+ */
+static gpointer mce_io_save_thread(gpointer data)
+{
+	mce_io_save_t *req;
+
+	(void)data;
+
+	g_mutex_lock(save_mutex);
+
+	for (;;) {
+		if ((req = g_queue_pop_head(&save_queue)) == NULL) {
+			save_busy = FALSE;
+			g_cond_broadcast(save_cond);
+
+			if (save_quit == TRUE)
+				break;
+
+			g_cond_wait(save_cond, save_mutex);
+			continue;
+		}
+
+		save_busy = TRUE;
+		g_mutex_unlock(save_mutex);
+
+		req->success = mce_io_update_file_atomic(req->path,
+							 req->data, req->size,
+							 req->mode,
+							 req->keep_backup);
+
+		if (req->done != NULL)
+			g_idle_add(mce_io_save_done_cb_idle, req);
+		else
+			mce_io_save_free(req);
+
+		g_mutex_lock(save_mutex);
+	}
+
+	g_mutex_unlock(save_mutex);
+
+	return NULL;
+}
+
+/**
+ * Release the synchronization objects of the save worker
+ */
+static void mce_io_save_release_sync(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	if (save_cond != NULL)
+		g_cond_clear(save_cond);
+	if (save_mutex != NULL)
+		g_mutex_clear(save_mutex);
+#else
+	if (save_cond != NULL)
+		g_cond_free(save_cond);
+	if (save_mutex != NULL)
+		g_mutex_free(save_mutex);
+#endif
+	save_cond = NULL;
+	save_mutex = NULL;
+}
+
+/**
+ * Start the asynchronous save worker if not already running
+ *
+ * @return TRUE if the worker is available, FALSE otherwise
+ */
+static gboolean mce_io_save_start(void)
+{
+	GError *error = NULL;
+
+	if (save_thread != NULL)
+		goto EXIT;
+
+	save_quit = FALSE;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_init(&save_mutex_storage), save_mutex = &save_mutex_storage;
+	g_cond_init(&save_cond_storage), save_cond = &save_cond_storage;
+
+	save_thread = g_thread_try_new("mce-save", mce_io_save_thread,
+				       NULL, &error);
+#else
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+	save_mutex = g_mutex_new();
+	save_cond = g_cond_new();
+
+	save_thread = g_thread_create(mce_io_save_thread, NULL, TRUE, &error);
+#endif
+
+	if (save_thread == NULL) {
+		mce_log(LL_ERR, "Failed to start file save thread; %s",
+			error ? error->message : "unknown");
+		mce_io_save_release_sync();
+	}
+
+	g_clear_error(&error);
+
+EXIT:
+	return save_thread != NULL;
+}
+
+/**
+ * Atomically update a file contents without blocking the main loop
+ *
+ * The data is copied and written with mce_io_update_file_atomic()
+ * in a worker thread.  If a save of the same path is still waiting
+ * for the worker, only the latest data gets written; the completion
+ * callbacks of both requests are called with the result.  The
+ * callbacks are called from the main loop.  If the worker can not
+ * be started, the file is saved synchronously.
+ *
+ * @param path file to write to
+ * @param data start of the data to write
+ * @param size length of the data to write
+ * @param mode protection bits to apply
+ * @param keep_backup whether to keep backup file on successful update
+ * @param done_cb function to call when done, or NULL
+ * @param user_data data to pass to done_cb
+ */
+void mce_io_update_file_atomic_async(const char *path,
+				     const void *data, size_t size,
+				     mode_t mode, gboolean keep_backup,
+				     mce_io_save_done_cb done_cb,
+				     gpointer user_data)
+{
+	mce_io_save_t *req = NULL;
+	GList *item;
+
+	if (mce_io_save_start() == FALSE) {
+		gboolean success = mce_io_update_file_atomic(path, data, size,
+							     mode,
+							     keep_backup);
+		if (done_cb != NULL)
+			done_cb(path, success, user_data);
+		goto EXIT;
+	}
+
+	g_mutex_lock(save_mutex);
+
+	/* Coalesce with a request that has not been started yet */
+	for (item = save_queue.head; item != NULL; item = item->next) {
+		mce_io_save_t *queued = item->data;
+
+		if (!strcmp(queued->path, path)) {
+			req = queued;
+			g_free(req->data);
+			break;
+		}
+	}
+
+	if (req == NULL) {
+		req = g_new0(mce_io_save_t, 1);
+		req->path = g_strdup(path);
+		g_queue_push_tail(&save_queue, req);
+	}
+
+	req->data = g_memdup(data, size);
+	req->size = size;
+	req->mode = mode;
+	req->keep_backup = keep_backup;
+
+	if (done_cb != NULL) {
+		mce_io_save_done_t *done = g_new0(mce_io_save_done_t, 1);
+
+		done->cb = done_cb;
+		done->user_data = user_data;
+		req->done = g_slist_append(req->done, done);
+	}
+
+	g_cond_broadcast(save_cond);
+	g_mutex_unlock(save_mutex);
+
+EXIT:
+	return;
+}
+
+/**
+ * Finish all pending asynchronous saves and stop the worker
+ *
+ * Blocks until the queued data is on disk; to be called on exit
+ */
+void mce_io_quit_async_saves(void)
+{
+	if (save_thread == NULL)
+		goto EXIT;
+
+	g_mutex_lock(save_mutex);
+	save_quit = TRUE;
+	g_cond_broadcast(save_cond);
+	g_mutex_unlock(save_mutex);
+
+	g_thread_join(save_thread), save_thread = NULL;
+
+	mce_io_save_release_sync();
+
+EXIT:
+	return;
+}
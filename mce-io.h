@@ -55,6 +55,27 @@ typedef struct {
 	 *  FALSE to leave the file open */
 	gboolean close_on_exit;
 
+	/** TRUE to skip writing a value equal to the last one written,
+	 *  FALSE to write every value; only for files that are not
+	 *  modified by anything else */
+	gboolean skip_unchanged;
+
+	/** TRUE to write with pwrite() at offset zero instead of
+	 *  rewinding and truncating the stream; only for sysfs nodes
+	 *  and similar files where each write replaces the value */
+	gboolean use_pwrite;
+
+	/** TRUE to hand the writes over to the output writer thread;
+	 *  only the latest value posted before the thread gets to the
+	 *  output is written, so use only for outputs such as
+	 *  brightness levels where intermediate values can be dropped */
+	gboolean async;
+
+	/** Called on the mainloop after a value has been written, with
+	 *  the completion time from g_get_monotonic_time() [us]; NULL
+	 *  if not needed */
+	void (*written_cb)(gint64 written);
+
 	/* runtime configuration */
 
 	/** Path to the file, or NULL (in which case one misconfiguration
@@ -69,13 +90,62 @@ typedef struct {
 	/** TRUE if missing path configuration error has already been
 	 *  written for this file */
 	gboolean invalid_config_reported;
+
+	/** TRUE if cached_value holds the last value written */
+	gboolean cached_valid;
+
+	/** Last value successfully written */
+	gulong cached_value;
+
+	/** Copy of the path the cached value was written to */
+	gchar *cached_path;
+
+	/** Number of writes done */
+	guint write_count;
+
+	/** Number of writes skipped as unchanged */
+	guint skip_count;
+
+	/** TRUE if async_value is waiting for the writer thread */
+	gboolean async_queued;
+
+	/** Latest value posted to the writer thread */
+	gulong async_value;
+
+	/** Number of posted values superseded before being written */
+	guint drop_count;
+
+	/** Idle source for finishing a completed asynchronous write */
+	guint async_complete_id;
+
+	/** When the writer thread completed the latest write [us] */
+	gint64 async_written;
 } output_state_t;
 
+/** Staleness limit for cached file reads that relies on sysfs_notify()
+ *  and invalidation on write only; see mce_read_cached_string_from_file() */
+#define MCE_SYSFS_CACHE_NOTIFY_ONLY		(-1)
+
 /** Function pointer for I/O monitor callback */
 typedef gboolean (*iomon_cb)(gpointer data, gsize bytes_read);
+/** Function pointer for batch chunk I/O monitor callback */
+typedef gboolean (*iomon_batch_cb)(gpointer data, gsize chunk_size,
+				   gsize chunk_count);
 /** Function pointer for I/O monitor error callback */
 typedef void (*iomon_err_cb)(gpointer data, GIOCondition condition);
 
+/** Callback for mce_io_monitor_stats_foreach()
+ *
+ * @param file The monitored file
+ * @param wakeups Number of times the monitor has been serviced
+ * @param bytes Number of bytes read
+ * @param time Time spent servicing the monitor [us]
+ * @param user_data The user data given to mce_io_monitor_stats_foreach()
+ */
+typedef void (*iomon_stats_cb)(const gchar *file, guint wakeups,
+			       guint64 bytes, guint64 time,
+			       gpointer user_data);
+
 gboolean mce_close_file(const gchar *const file, FILE **fp);
 gboolean mce_read_chunk_from_file(const gchar *const file, void **data,
 				  gssize *len, int flags);
@@ -84,9 +154,17 @@ gboolean mce_read_number_string_from_file(const gchar *const file,
 					  gulong *number, FILE **fp,
 					  gboolean rewind,
 					  gboolean close_on_exit);
+gboolean mce_read_cached_string_from_file(const gchar *const file,
+					  gchar **string, gint max_age_ms);
+gboolean mce_read_cached_number_string_from_file(const gchar *const file,
+						 gulong *number,
+						 gint max_age_ms);
+void mce_invalidate_cached_file(const gchar *const file);
+void mce_sysfs_cache_exit(void);
 gboolean mce_write_string_to_file(const gchar *const file,
 				  const gchar *const string);
 void mce_close_output(output_state_t *output);
+void mce_io_output_flush(output_state_t *output);
 gboolean mce_write_number_string_to_file(output_state_t *output, const gulong number);
 gboolean mce_write_number_string_to_file_atomic(const gchar *const file,
 						const gulong number);
@@ -105,10 +183,24 @@ gconstpointer mce_register_io_monitor_chunk(const gint fd,
 					    gboolean rewind_policy,
 					    iomon_cb callback,
 					    gulong chunk_size);
+gconstpointer mce_register_io_monitor_chunk_batch(const gint fd,
+						  const gchar *const file,
+						  error_policy_t error_policy,
+						  GIOCondition monitored_conditions,
+						  gboolean rewind_policy,
+						  iomon_batch_cb callback,
+						  gulong chunk_size);
 void mce_set_io_monitor_err_cb(gconstpointer io_monitor, iomon_err_cb err_cb);
+void mce_set_io_monitor_user_data(gconstpointer io_monitor,
+				  gpointer user_data,
+				  GDestroyNotify free_cb);
+gpointer mce_get_io_monitor_user_data(gconstpointer io_monitor);
+gconstpointer mce_get_current_io_monitor(void);
 void mce_unregister_io_monitor(gconstpointer io_monitor);
 const gchar *mce_get_io_monitor_name(gconstpointer io_monitor);
 int mce_get_io_monitor_fd(gconstpointer io_monitor);
+void mce_io_monitor_stats_foreach(iomon_stats_cb callback,
+				  gpointer user_data);
 
 gboolean mce_are_settings_locked(void);
 gboolean mce_unlock_settings(void);
@@ -124,4 +216,16 @@ gboolean mce_io_update_file_atomic(const char *path,
 				   const void *data, size_t size,
 				   mode_t mode, gboolean keep_backup);
 
+/** Function pointer for asynchronous file save completion callback */
+typedef void (*mce_io_save_done_cb)(const char *path, gboolean success,
+				    gpointer user_data);
+
+void mce_io_update_file_atomic_async(const char *path,
+				     const void *data, size_t size,
+				     mode_t mode, gboolean keep_backup,
+				     mce_io_save_done_cb done_cb,
+				     gpointer user_data);
+void mce_io_quit_async_saves(void);
+void mce_io_quit_output_writer(void);
+
 #endif /* _MCE_IO_H_ */
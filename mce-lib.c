@@ -22,25 +22,39 @@
 #include <glib.h>
 
 #include <stdio.h>			/* sscanf() */
-#include <string.h>			/* strcmp() */
+#include <string.h>			/* strcmp(), memset() */
+#include <time.h>			/* clock_gettime() */
 
 #include "mce.h"                        /* MCE_INVALID_TRANSLATION */
 #include "mce-lib.h"                    /* mce_translation_t */
 
 #include "mce-log.h"			/* mce_log(), LL_* */
 
+/**
+ * Clear all bits of a bitset
+ *
+ * @param self The bitset
+ */
+void mce_bitset_clear_all(mce_bitset_t *self)
+{
+	memset(self->word, 0, sizeof self->word);
+}
+
 /**
  * Set a bit
  *
+ * Bits beyond MCE_BITSET_BITS are ignored
+ *
+ * @param self The bitset
  * @param bit The bit to set
- * @param bitfield A pointer to an array with the bitfield
  */
-void set_bit(guint bit, gulong **bitfield)
+void mce_bitset_set(mce_bitset_t *self, guint bit)
 {
-	if ((bitfield == NULL) || (*bitfield == NULL))
+	if (bit >= MCE_BITSET_BITS)
 		goto EXIT;
 
-	(*bitfield)[bit / bitsize_of(**bitfield)] |= 1UL << (bit % bitsize_of(**bitfield));
+	self->word[bit / MCE_BITSET_WORD_BITS] |=
+		1UL << (bit % MCE_BITSET_WORD_BITS);
 
 EXIT:
 	return;
@@ -49,15 +63,18 @@ EXIT:
 /**
  * Clear a bit
  *
+ * Bits beyond MCE_BITSET_BITS are ignored
+ *
+ * @param self The bitset
  * @param bit The bit to clear
- * @param bitfield A pointer to an array with the bitfield
  */
-void clear_bit(guint bit, gulong **bitfield)
+void mce_bitset_clear(mce_bitset_t *self, guint bit)
 {
-	if ((bitfield == NULL) || (*bitfield == NULL))
+	if (bit >= MCE_BITSET_BITS)
 		goto EXIT;
 
-	(*bitfield)[bit / bitsize_of(**bitfield)] &= ~(1UL << (bit % bitsize_of(**bitfield)));
+	self->word[bit / MCE_BITSET_WORD_BITS] &=
+		~(1UL << (bit % MCE_BITSET_WORD_BITS));
 
 EXIT:
 	return;
@@ -66,46 +83,200 @@ EXIT:
 /**
  * Test whether a bit is set
  *
+ * @param self The bitset
  * @param bit The bit to test for
- * @param bitfield An array with the bitfield
  * @return TRUE if the bit is set,
- *         FALSE if the bit is unset
+ *         FALSE if the bit is unset or beyond MCE_BITSET_BITS
+ */
+gboolean mce_bitset_test(const mce_bitset_t *self, guint bit)
+{
+	if (bit >= MCE_BITSET_BITS)
+		return FALSE;
+
+	return (self->word[bit / MCE_BITSET_WORD_BITS] >>
+		(bit % MCE_BITSET_WORD_BITS)) & 1;
+}
+
+/**
+ * Set the bits listed in an array
+ *
+ * @param self The bitset
+ * @param bits The bits to set, terminated with -1
+ */
+void mce_bitset_set_array(mce_bitset_t *self, const int *bits)
+{
+	gsize i;
+
+	for (i = 0; bits[i] != -1; i++)
+		mce_bitset_set(self, (guint)bits[i]);
+}
+
+/**
+ * Set the bits that are set in another bitset
+ *
+ * @param self The bitset to modify
+ * @param other The bits to set
+ */
+void mce_bitset_or(mce_bitset_t *self, const mce_bitset_t *other)
+{
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++)
+		self->word[i] |= other->word[i];
+}
+
+/**
+ * Clear the bits that are not set in another bitset
+ *
+ * @param self The bitset to modify
+ * @param other The bits to keep
+ */
+void mce_bitset_and(mce_bitset_t *self, const mce_bitset_t *other)
+{
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++)
+		self->word[i] &= other->word[i];
+}
+
+/**
+ * Clear the bits that are set in another bitset
+ *
+ * @param self The bitset to modify
+ * @param other The bits to clear
+ */
+void mce_bitset_andnot(mce_bitset_t *self, const mce_bitset_t *other)
+{
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++)
+		self->word[i] &= ~other->word[i];
+}
+
+/**
+ * Check whether two bitsets have any bits in common
+ *
+ * @param self The first bitset
+ * @param other The second bitset
+ * @return TRUE if at least one bit is set in both, FALSE otherwise
  */
-gboolean test_bit(guint bit, const gulong *bitfield)
+gboolean mce_bitset_intersects(const mce_bitset_t *self,
+			       const mce_bitset_t *other)
 {
-	return ((1UL << (bit % bitsize_of(*bitfield))) &
-		(((gulong *)bitfield)[bit / bitsize_of(*bitfield)])) != 0;
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++) {
+		if (self->word[i] & other->word[i])
+			return TRUE;
+	}
+
+	return FALSE;
 }
 
 /**
- * Convert a string to a bitfield
+ * Check whether a bitset has no bits set
  *
+ * @param self The bitset
+ * @return TRUE if no bits are set, FALSE otherwise
+ */
+gboolean mce_bitset_is_empty(const mce_bitset_t *self)
+{
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++) {
+		if (self->word[i] != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Count the bits that are set
+ *
+ * @param self The bitset
+ * @return The number of bits set
+ */
+guint mce_bitset_count(const mce_bitset_t *self)
+{
+	guint count = 0;
+	gsize i;
+
+	for (i = 0; i < MCE_BITSET_WORDS; i++)
+		count += __builtin_popcountl(self->word[i]);
+
+	return count;
+}
+
+/**
+ * Find the next set bit
+ *
+ * Iterate over the set bits with:
+ * for (b = mce_bitset_next(set, 0); b != -1; b = mce_bitset_next(set, b + 1))
+ *
+ * @param self The bitset
+ * @param bit The bit to start searching from
+ * @return The first set bit at or after bit, or -1 if there is none
+ */
+gint mce_bitset_next(const mce_bitset_t *self, guint bit)
+{
+	gsize i = bit / MCE_BITSET_WORD_BITS;
+	gulong word;
+
+	if (bit >= MCE_BITSET_BITS)
+		return -1;
+
+	/* Skip the bits below the start in the first word */
+	word = self->word[i] & (~0UL << (bit % MCE_BITSET_WORD_BITS));
+
+	for (;;) {
+		if (word != 0)
+			return (gint)(i * MCE_BITSET_WORD_BITS) +
+			       __builtin_ctzl(word);
+
+		if (++i >= MCE_BITSET_WORDS)
+			break;
+
+		word = self->word[i];
+	}
+
+	return -1;
+}
+
+/**
+ * Set the bits listed in a string
+ *
+ * @param self The bitset to modify
  * @param string The string with comma-separated numbers
- *               to turn into a bitfield
- * @param[in,out] bitfield A bitfield to return the string in
- * @param bitfieldsize The size of the bitfield
+ *               of the bits to set
  * @return TRUE on success,
  *         FALSE if the string could not be parsed numerically
- *               or if a number was out of range for the bitfield
+ *               or if a number was out of range for the bitset
  */
-gboolean string_to_bitfield(const gchar *string,
-			    gulong **bitfield, gsize bitfieldsize)
+gboolean mce_bitset_from_string(mce_bitset_t *self, const gchar *string)
 {
-	gchar *tmp = (gchar *)string;
+	const gchar *tmp = string;
 	gboolean status = FALSE;
 	int offset = 0;
 	guint num;
 
-	if ((string == NULL) || (bitfield == NULL) || (*bitfield == NULL))
+	if (string == NULL)
 		goto EXIT;
 
 	while ((sscanf(tmp, "%u%n", &num, &offset) != 0) && (offset != 0)) {
 		/* Make sure we can represent this number */
-		if (num > (bitfieldsize * bitsize_of(**bitfield)))
+		if (num >= MCE_BITSET_BITS)
 			goto EXIT;
 
-		set_bit(num, bitfield);
-		tmp += (offset + 1);
+		mce_bitset_set(self, num);
+
+		/* Skip the number and the separator after it */
+		tmp += offset;
+
+		if (*tmp == '\0')
+			break;
+
+		tmp++;
 		offset = 0;
 	}
 
@@ -116,54 +287,25 @@ EXIT:
 }
 
 /**
- * Convert a bitfield to a string
+ * Convert a bitset to a string
  *
- * @param bitfield The bitfield to convert to a comma-separated string
- *                 with the numbers of the set bits
- * @param bitfieldsize The size of the bitfield
- * @return A string with the newly allocated string on success,
- *         NULL on failure
+ * The string always starts with 0; this way a string with
+ * no other bits set still represents an empty mask
+ *
+ * @param self The bitset to convert to a comma-separated string
+ *             with the numbers of the set bits
+ * @return A newly allocated string; free with g_free()
  */
-char *bitfield_to_string(const gulong *bitfield, gsize bitfieldsize)
+gchar *mce_bitset_to_string(const mce_bitset_t *self)
 {
-	gchar *tmp = NULL;
-	guint i, j;
-
-	/* Always pass 0; this way a NULL string represents failure,
-	 * and a string with no bits set will represent an empty mask;
-	 * we also simplify the g_strdup_printf() case quite a bit
-	 */
-	if ((tmp = strdup("0")) == NULL) {
-		mce_log(LL_CRIT,
-			"Failed to allocate memory "
-			"for tmp");
-		goto EXIT;
-	}
+	GString *tmp = g_string_new("0");
+	gint bit;
 
-	for (i = 0; i < bitfieldsize; i++) {
-		for (j = 0; bitfield[i] && j < bitsize_of(*bitfield); j++) {
-			if (bitfield[i] & (1UL << j)) {
-				gchar *tmp2;
-
-				tmp2 = g_strdup_printf("%s,%u",
-						       tmp, (i * bitsize_of(*bitfield)) + j);
-
-				g_free(tmp);
-
-				if (tmp2 == NULL) {
-					mce_log(LL_CRIT,
-						"Failed to allocate memory "
-						"for tmp2");
-					goto EXIT;
-				}
-
-				tmp = tmp2;
-			}
-		}
-	}
+	for (bit = mce_bitset_next(self, 0); bit != -1;
+	     bit = mce_bitset_next(self, bit + 1))
+		g_string_append_printf(tmp, ",%d", bit);
 
-EXIT:
-	return tmp;
+	return g_string_free(tmp, FALSE);
 }
 
 /**
@@ -187,6 +329,227 @@ const gchar *bin_to_string(guint bin)
 	return bin_string;
 }
 
+/** Number ranges up to this many times the entry count are indexed
+ *  with a direct lookup array; sparser ones are binary searched */
+#define TRANSLATION_DENSE_FACTOR	4
+
+/** Lookup index for a mce_translation_t mapping */
+typedef struct {
+	/** Number of entries, not counting the terminator */
+	gint count;
+	/** Smallest number in the mapping */
+	gint min;
+	/** Largest number in the mapping */
+	gint max;
+	/** Entry per number - min; -1 for gaps; NULL if sparse */
+	gint *dense;
+	/** Entries sorted by number; NULL if dense */
+	gint *sorted;
+	/** String -> entry + 1 */
+	GHashTable *strings;
+} translation_index_t;
+
+/** Lookup indices for the mappings used so far; mapping -> index */
+static GHashTable *translation_indices = NULL;
+
+/**
+ * Compare two entries of a mapping by number, then by position
+ *
+ * @param a Pointer to the position of the first entry
+ * @param b Pointer to the position of the second entry
+ * @param data The mce_translation_t mapping
+ * @return <0, 0 or >0 like strcmp()
+ */
+static gint translation_compare(gconstpointer a, gconstpointer b,
+				gpointer data)
+{
+	const mce_translation_t *translation = data;
+	gint ia = *(const gint *)a;
+	gint ib = *(const gint *)b;
+	gint na = translation[ia].number;
+	gint nb = translation[ib].number;
+
+	if (na != nb)
+		return (na < nb) ? -1 : 1;
+
+	return ia - ib;
+}
+
+/**
+ * Free a mapping lookup index
+ *
+ * @param data The translation_index_t to free
+ */
+static void translation_index_free(gpointer data)
+{
+	translation_index_t *index = data;
+
+	if (index == NULL)
+		goto EXIT;
+
+	g_free(index->dense);
+	g_free(index->sorted);
+
+	if (index->strings != NULL)
+		g_hash_table_destroy(index->strings);
+
+	g_free(index);
+
+EXIT:
+	return;
+}
+
+/**
+ * Get the lookup index for a mapping, building it on first use
+ *
+ * Validates the mapping while indexing it; when numbers or strings
+ * are duplicated, the first entry wins just like in a linear scan
+ *
+ * @param translation A mce_translation_t mapping
+ * @return The lookup index for the mapping
+ */
+static const translation_index_t *
+translation_index_get(const mce_translation_t translation[])
+{
+	translation_index_t *index = NULL;
+	gint i;
+
+	if (translation_indices == NULL)
+		translation_indices = g_hash_table_new_full(g_direct_hash,
+							    g_direct_equal,
+							    NULL,
+							    translation_index_free);
+
+	index = g_hash_table_lookup(translation_indices, translation);
+
+	if (index != NULL)
+		goto EXIT;
+
+	index = g_new0(translation_index_t, 1);
+	index->strings = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (i = 0; translation[i].number != MCE_INVALID_TRANSLATION; i++) {
+		if ((i == 0) || (translation[i].number < index->min))
+			index->min = translation[i].number;
+
+		if ((i == 0) || (translation[i].number > index->max))
+			index->max = translation[i].number;
+
+		if (translation[i].string == NULL) {
+			mce_log(LL_WARN, "translation %p: entry %d "
+				"has no string", translation, i);
+			continue;
+		}
+
+		if (g_hash_table_lookup(index->strings,
+					translation[i].string) != NULL) {
+			mce_log(LL_DEBUG, "translation %p: duplicate "
+				"string `%s'", translation,
+				translation[i].string);
+			continue;
+		}
+
+		g_hash_table_insert(index->strings,
+				    (gpointer)translation[i].string,
+				    GINT_TO_POINTER(i + 1));
+	}
+
+	index->count = i;
+
+	if (index->count == 0)
+		goto INSERT;
+
+	if (((gint64)index->max - index->min) <
+	    (gint64)index->count * TRANSLATION_DENSE_FACTOR) {
+		gint size = index->max - index->min + 1;
+
+		index->dense = g_new(gint, size);
+
+		for (i = 0; i < size; i++)
+			index->dense[i] = -1;
+
+		for (i = 0; i < index->count; i++) {
+			gint slot = translation[i].number - index->min;
+
+			if (index->dense[slot] == -1)
+				index->dense[slot] = i;
+		}
+	} else {
+		index->sorted = g_new(gint, index->count);
+
+		for (i = 0; i < index->count; i++)
+			index->sorted[i] = i;
+
+		g_qsort_with_data(index->sorted, index->count, sizeof (gint),
+				  translation_compare, (gpointer)translation);
+	}
+
+INSERT:
+	g_hash_table_insert(translation_indices, (gpointer)translation, index);
+
+EXIT:
+	return index;
+}
+
+/**
+ * Find the entry for a number in a mapping
+ *
+ * @param translation A mce_translation_t mapping
+ * @param number The number to look up
+ * @return The position of the first entry with the number,
+ *         or -1 if there is no such entry
+ */
+static gint translation_find_number(const mce_translation_t translation[],
+				    gint number)
+{
+	const translation_index_t *index = translation_index_get(translation);
+	gint entry = -1;
+	gint lo = 0;
+	gint hi;
+
+	if ((index->count == 0) ||
+	    (number < index->min) || (number > index->max))
+		goto EXIT;
+
+	if (index->dense != NULL) {
+		entry = index->dense[number - index->min];
+		goto EXIT;
+	}
+
+	/* Find the first sorted entry with the number */
+	hi = index->count;
+
+	while (lo < hi) {
+		gint mid = lo + (hi - lo) / 2;
+
+		if (translation[index->sorted[mid]].number < number)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo < index->count) &&
+	    (translation[index->sorted[lo]].number == number))
+		entry = index->sorted[lo];
+
+EXIT:
+	return entry;
+}
+
+/**
+ * Drop the lookup indices of all mappings
+ *
+ * Must be called when mappings may go away, i.e. after
+ * the modules have been unloaded
+ */
+void mce_translation_cache_clear(void)
+{
+	if (translation_indices != NULL) {
+		g_hash_table_destroy(translation_indices);
+		translation_indices = NULL;
+	}
+}
+
 /**
  * Translate an integer to its string representation;
  * if no valid mapping exists, return the provided default string
@@ -200,23 +563,16 @@ const gchar *bin_to_string(guint bin)
 const gchar *mce_translate_int_to_string_with_default(const mce_translation_t translation[], gint number, const gchar *default_string)
 {
 	const gchar *string;
-	gint i = 0;
-
-	/* This might seem awkward, but it's made to allow sparse
-	 * number spaces
-	 */
-	do {
-		string = translation[i].string;
-	} while (translation[i].number != MCE_INVALID_TRANSLATION &&
-		 translation[i++].number != number);
-
-	/* XXX: will this really behave correctly if there's only
-	 * one (MCE_INVALID_TRANSLATION) element in the structure?
-	 */
-	if ((translation[i].number == MCE_INVALID_TRANSLATION) &&
-	    (translation[i - 1].number != number) &&
-	    (default_string != NULL))
+	gint entry = translation_find_number(translation, number);
+
+	if (entry != -1) {
+		string = translation[entry].string;
+	} else if (default_string != NULL) {
 		string = default_string;
+	} else {
+		/* The terminating entry holds the fallback string */
+		string = translation[translation_index_get(translation)->count].string;
+	}
 
 	return string;
 }
@@ -246,24 +602,22 @@ const gchar *mce_translate_int_to_string(const mce_translation_t translation[],
  */
 gint mce_translate_string_to_int_with_default(const mce_translation_t translation[], const gchar *const string, gint default_integer)
 {
-	gint number = MCE_INVALID_TRANSLATION;
-	gint i = 0;
+	const translation_index_t *index = translation_index_get(translation);
+	gint number = default_integer;
+	gint entry;
 
-	while (translation[i].number != MCE_INVALID_TRANSLATION) {
-		/* If the string matches, set number and stop searching */
-		if (!strcmp(translation[i].string, string)) {
-			number = translation[i].number;
-			break;
-		}
+	if (string == NULL)
+		goto EXIT;
 
-		i++;
-	}
+	entry = GPOINTER_TO_INT(g_hash_table_lookup(index->strings, string));
 
-	if (translation[i].number == MCE_INVALID_TRANSLATION)
-		number = default_integer;
+	if (entry != 0)
+		number = translation[entry - 1].number;
 
+EXIT:
 	return number;
 }
+
 /**
  * Translate a string to its integer representation
  *
@@ -359,3 +713,40 @@ gboolean strmemcmp(guint8 *mem, const gchar *str, gulong len)
 EXIT:
 	return result;
 }
+
+/**
+ * Get a time stamp from a clock
+ *
+ * @param clock_id The clock to read; CLOCK_MONOTONIC, CLOCK_BOOTTIME, ...
+ * @return Nanoseconds since the starting point of the clock
+ */
+gint64 mce_lib_get_time_ns(clockid_t clock_id)
+{
+	struct timespec ts = { 0, 0 };
+
+	clock_gettime(clock_id, &ts);
+
+	return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get a time stamp from a clock in microseconds
+ *
+ * @param clock_id The clock to read; CLOCK_MONOTONIC, CLOCK_BOOTTIME, ...
+ * @return Microseconds since the starting point of the clock
+ */
+gint64 mce_lib_get_time_us(clockid_t clock_id)
+{
+	return mce_lib_get_time_ns(clock_id) / 1000;
+}
+
+/**
+ * Get a time stamp from a clock in milliseconds
+ *
+ * @param clock_id The clock to read; CLOCK_MONOTONIC, CLOCK_BOOTTIME, ...
+ * @return Milliseconds since the starting point of the clock
+ */
+gint64 mce_lib_get_time_ms(clockid_t clock_id)
+{
+	return mce_lib_get_time_ns(clock_id) / 1000000;
+}
@@ -24,22 +24,58 @@
 
 #include <glib.h>
 
+#include <time.h>			/* clockid_t, CLOCK_MONOTONIC */
+
+#ifndef CLOCK_BOOTTIME
+/** Monotonic clock that includes suspend; not in older headers */
+# define CLOCK_BOOTTIME			7
+#endif
+
 /** Find the number of bits of a type */
 #define bitsize_of(__x)			(guint)(sizeof (__x) * 8)
 
+/** Number of bits in a bitset; enough for any evdev code space */
+#define MCE_BITSET_BITS			1024
+
+/** Number of bits in one bitset word */
+#define MCE_BITSET_WORD_BITS		(sizeof (gulong) * 8)
+
+/** Number of words in a bitset */
+#define MCE_BITSET_WORDS		(MCE_BITSET_BITS / MCE_BITSET_WORD_BITS)
+
+/** Fixed size bitset
+ *
+ * The word array has the same layout as the bitmaps the kernel
+ * fills in for EVIOCGBIT, EVIOCGKEY, EVIOCGSW etc ioctls
+ */
+typedef struct {
+	/** Bits 0-63 in word[0] on 64-bit systems, etc */
+	gulong word[MCE_BITSET_WORDS];
+} mce_bitset_t;
+
 /** translation structure */
 typedef struct {
 	const gint number;		/**< Number representation */
 	const gchar *const string;	/**< String representation */
 } mce_translation_t;
 
-void set_bit(guint bit, gulong **bitfield);
-void clear_bit(guint bit, gulong **bitfield);
-gboolean test_bit(guint bit, const gulong *bitfield);
+void mce_bitset_clear_all(mce_bitset_t *self);
+void mce_bitset_set(mce_bitset_t *self, guint bit);
+void mce_bitset_clear(mce_bitset_t *self, guint bit);
+gboolean mce_bitset_test(const mce_bitset_t *self, guint bit);
+void mce_bitset_set_array(mce_bitset_t *self, const int *bits);
 
-gboolean string_to_bitfield(const gchar *string,
-			    gulong **bitfield, gsize bitfieldsize);
-char *bitfield_to_string(const gulong *bitfield, gsize bitfieldsize);
+void mce_bitset_or(mce_bitset_t *self, const mce_bitset_t *other);
+void mce_bitset_and(mce_bitset_t *self, const mce_bitset_t *other);
+void mce_bitset_andnot(mce_bitset_t *self, const mce_bitset_t *other);
+gboolean mce_bitset_intersects(const mce_bitset_t *self,
+			       const mce_bitset_t *other);
+gboolean mce_bitset_is_empty(const mce_bitset_t *self);
+guint mce_bitset_count(const mce_bitset_t *self);
+gint mce_bitset_next(const mce_bitset_t *self, guint bit);
+
+gboolean mce_bitset_from_string(mce_bitset_t *self, const gchar *string);
+gchar *mce_bitset_to_string(const mce_bitset_t *self);
 
 const gchar *bin_to_string(guint bin);
 
@@ -50,10 +86,15 @@ const gchar *mce_translate_int_to_string(const mce_translation_t translation[],
 gint mce_translate_string_to_int_with_default(const mce_translation_t translation[], const gchar *const string, gint default_number);
 gint mce_translate_string_to_int(const mce_translation_t translation[],
 				 const gchar *const string);
+void mce_translation_cache_clear(void);
 
 gchar *strstr_delim(const gchar *const haystack, const char *needle,
 		    const char *const delimiter);
 gboolean strmemcmp(guint8 *mem, const gchar *str, gulong len);
 
+gint64 mce_lib_get_time_ns(clockid_t clock_id);
+gint64 mce_lib_get_time_us(clockid_t clock_id);
+gint64 mce_lib_get_time_ms(clockid_t clock_id);
+
 
 #endif /* _MCE_LIB_H_ */
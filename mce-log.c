@@ -22,10 +22,14 @@
 #include <glib/gprintf.h>
 
 #ifdef OSSOLOG_COMPILE
-#include <stdio.h>			/* fprintf() */
-#include <stdarg.h>			/* va_start(), va_end(), vfprintf() */
+#include <stdio.h>			/* fprintf(), snprintf() */
+#include <stdarg.h>			/* va_start(), va_end(), vsnprintf() */
+#include <stdint.h>			/* uint64_t */
+#include <stdlib.h>			/* atexit() */
 #include <string.h>			/* strdup() */
 #include <syslog.h>			/* openlog(), closelog(), vsyslog() */
+#include <unistd.h>			/* read(), write(), close() */
+#include <sys/eventfd.h>		/* eventfd(), EFD_CLOEXEC */
 
 #include "mce-log.h"
 
@@ -33,6 +37,68 @@ static unsigned int logverbosity = LL_WARN;	/**< Log verbosity */
 static int logtype = MCE_LOG_STDERR;		/**< Output for log messages */
 static char *logname = NULL;
 
+/** Per source file verbosity rule */
+typedef struct {
+	/** Glob pattern for the source file name, e.g. "tklock.c" */
+	char pattern[MCE_LOG_RULE_PATTERN_MAX];
+	/** Verbosity for the matching files */
+	int level;
+} log_rule_t;
+
+/** Per source file verbosity rules; the latest match wins
+ *
+ * Only changed from the mainloop thread; a log call site in
+ * another thread may use a stale level for one message
+ */
+static log_rule_t log_rules[MCE_LOG_RULES_MAX];
+
+/** Number of per source file verbosity rules */
+static int log_rule_count = 0;
+
+volatile int mce_log_generation = 1;
+
+/** Message waiting in the log ring */
+typedef struct {
+	/** Set once the message is complete; cleared by the writer */
+	volatile gint ready;
+	/** Level of the message */
+	loglevel_t level;
+	/** The formatted message, truncated if needed */
+	char text[MCE_LOG_RING_MESSAGE_MAX];
+} log_slot_t;
+
+/** Ring of messages waiting for the log writer thread */
+static log_slot_t log_ring[MCE_LOG_RING_SIZE];
+
+/** Number of slots claimed by the logging threads */
+static volatile gint log_head = 0;
+
+/** Number of slots written out by the log writer */
+static volatile gint log_tail = 0;
+
+/** Number of messages dropped because the ring was full */
+static volatile gint log_dropped = 0;
+
+/** Flag for: the log writer is about to wait for the doorbell */
+static volatile gint log_armed = 0;
+
+/** Flag for: the log writer should exit once the ring is empty */
+static volatile gint log_quit = 0;
+
+/** Doorbell for waking up the log writer */
+static int log_doorbell = -1;
+
+/** Log writer thread; NULL when logging synchronously */
+static GThread *log_thread = NULL;
+
+/** Serialises the ring readers; the writer thread and flushes */
+static GMutex *log_reader_mutex = NULL;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+/** Storage for log_reader_mutex */
+static GMutex log_reader_mutex_storage;
+#endif
+
 /** Make sure loglevel is in the supported range
  *
  * @param loglevel level to check
@@ -71,6 +137,254 @@ static const char *mce_log_level_tag(loglevel_t loglevel)
 	return res;
 }
 
+/** Invalidate the verbosity cached by the log call sites
+ */
+static void mce_log_invalidate_sites(void)
+{
+	int generation = mce_log_generation + 1;
+
+	/* Zero means "never looked up" for the call sites */
+	mce_log_generation = generation ?: 1;
+}
+
+/** Check a source file name against a verbosity rule pattern
+ *
+ * The pattern is matched against the full path, the base name
+ * and the base name without the extension, so that e.g. "tklock",
+ * "tklock.c" and "display*" all work as expected
+ *
+ * @param pattern glob pattern
+ * @param file source file name
+ *
+ * @return TRUE if the file matches, FALSE otherwise
+ */
+static gboolean mce_log_rule_match(const char *pattern, const char *file)
+{
+	gboolean match = FALSE;
+	const char *base = strrchr(file, '/');
+	char stem[MCE_LOG_RULE_PATTERN_MAX];
+	char *dot;
+
+	base = base ? base + 1 : file;
+
+	if (g_pattern_match_simple(pattern, file) ||
+	    g_pattern_match_simple(pattern, base)) {
+		match = TRUE;
+		goto EXIT;
+	}
+
+	snprintf(stem, sizeof stem, "%s", base);
+
+	if ((dot = strrchr(stem, '.')) != NULL)
+		*dot = 0;
+
+	match = g_pattern_match_simple(pattern, stem);
+
+EXIT:
+	return match;
+}
+
+/** Get the verbosity for a source file
+ *
+ * @param file source file name, or NULL
+ *
+ * @return verbosity from the latest matching rule, or the global one
+ */
+static int mce_log_file_verbosity(const char *file)
+{
+	int i;
+
+	if (file == NULL)
+		goto EXIT;
+
+	for (i = log_rule_count - 1; i >= 0; i--) {
+		if (mce_log_rule_match(log_rules[i].pattern, file))
+			return log_rules[i].level;
+	}
+
+EXIT:
+	return logverbosity;
+}
+
+/** Look up the verbosity for a log call site
+ *
+ * Called by the mce_log() macro when the cached level is stale
+ *
+ * @param site verbosity cache of the call site
+ */
+void mce_log_site_resolve(mce_log_site_t *site)
+{
+	site->level = mce_log_file_verbosity(site->file);
+	site->generation = mce_log_generation;
+}
+
+/** Write a formatted message to the log output
+ *
+ * @param loglevel The level of severity for this message
+ * @param msg The message
+ */
+static void mce_log_emit(loglevel_t loglevel, const char *msg)
+{
+	if (logtype == MCE_LOG_STDERR) {
+		fprintf(stderr, "%s: %s: %s\n",
+			logname,
+			mce_log_level_tag(loglevel),
+			msg);
+	} else {
+		/* loglevels are subset of syslog priorities, so
+		 * we can use loglevel as is for syslog priority */
+		syslog(loglevel, "%s", msg);
+	}
+}
+
+/** Ring the log writer doorbell if the writer is waiting for it
+ */
+static void mce_log_ring_doorbell(void)
+{
+	uint64_t one = 1;
+
+	if (g_atomic_int_compare_and_exchange(&log_armed, 1, 0)) {
+		if (write(log_doorbell, &one, sizeof one) == -1) {
+			/* Nothing sensible to do; the writer
+			 * will catch up on the next message */
+		}
+	}
+}
+
+/** Format a message into the log ring
+ *
+ * Only the slot claim is shared between the logging threads; it is
+ * done with compare-and-swap, so logging never waits for the writer
+ *
+ * @param loglevel The level of severity for this message
+ * @param file The source file name, or NULL
+ * @param function The function name, or NULL
+ * @param fmt The format string for this message
+ * @param args Input to the format string
+ */
+static void mce_log_ring_add(loglevel_t loglevel, const char *file,
+			     const char *function, const char *fmt,
+			     va_list args)
+{
+	log_slot_t *slot;
+	gint head;
+	int used = 0;
+
+	do {
+		head = g_atomic_int_get(&log_head);
+
+		if ((guint)(head - g_atomic_int_get(&log_tail)) >=
+		    MCE_LOG_RING_SIZE) {
+			g_atomic_int_inc(&log_dropped);
+			goto EXIT;
+		}
+	} while (!g_atomic_int_compare_and_exchange(&log_head,
+						    head, head + 1));
+
+	slot = &log_ring[(guint)head % MCE_LOG_RING_SIZE];
+	slot->level = loglevel;
+
+	if (file && function) {
+		used = snprintf(slot->text, sizeof slot->text,
+				"%s: %s(): ", file, function);
+		if (used < 0 || used >= (int)sizeof slot->text)
+			used = 0;
+	}
+
+	vsnprintf(slot->text + used, sizeof slot->text - used, fmt, args);
+
+	g_atomic_int_set(&slot->ready, 1);
+
+	mce_log_ring_doorbell();
+
+EXIT:
+	return;
+}
+
+/** Check whether the oldest slot in the log ring is complete
+ *
+ * @return TRUE if there is a message to write out, FALSE otherwise
+ */
+static gboolean mce_log_ring_ready(void)
+{
+	gint tail = g_atomic_int_get(&log_tail);
+
+	return g_atomic_int_get(&log_ring[(guint)tail %
+					  MCE_LOG_RING_SIZE].ready);
+}
+
+/** Write out the complete messages from the log ring
+ *
+ * The caller must hold log_reader_mutex
+ */
+static void mce_log_ring_drain(void)
+{
+	gint dropped;
+
+	while (mce_log_ring_ready()) {
+		gint tail = g_atomic_int_get(&log_tail);
+		log_slot_t *slot = &log_ring[(guint)tail % MCE_LOG_RING_SIZE];
+
+		mce_log_emit(slot->level, slot->text);
+
+		g_atomic_int_set(&slot->ready, 0);
+		g_atomic_int_set(&log_tail, tail + 1);
+	}
+
+	do {
+		dropped = g_atomic_int_get(&log_dropped);
+	} while (dropped &&
+		 !g_atomic_int_compare_and_exchange(&log_dropped, dropped, 0));
+
+	if (dropped) {
+		gchar msg[64];
+
+		snprintf(msg, sizeof msg,
+			 "log ring full; %d messages dropped", dropped);
+		mce_log_emit(LL_WARN, msg);
+	}
+}
+
+/** Log writer thread
+ *
+ * Does the slow part of logging, i.e. syslog() or stderr output,
+ * so that it is not done on the mainloop
+ *
+ * @param data Unused
+ * @return Always returns NULL
+ */
+static gpointer mce_log_writer_thread(gpointer data)
+{
+	uint64_t count;
+
+	(void)data;
+
+	for (;;) {
+		g_mutex_lock(log_reader_mutex);
+		mce_log_ring_drain();
+		g_mutex_unlock(log_reader_mutex);
+
+		if (g_atomic_int_get(&log_quit) && !mce_log_ring_ready())
+			break;
+
+		/* Arm the doorbell, then re-check to close the race
+		 * with a message that was completed in between */
+		g_atomic_int_set(&log_armed, 1);
+
+		if (mce_log_ring_ready() || g_atomic_int_get(&log_quit)) {
+			if (g_atomic_int_compare_and_exchange(&log_armed,
+							      1, 0))
+				continue;
+		}
+
+		if (read(log_doorbell, &count, sizeof count) == -1) {
+			/* EINTR; drain and wait again */
+		}
+	}
+
+	return NULL;
+}
+
 /**
  * Log debug message with optional filename and function name attached
  *
@@ -85,9 +399,19 @@ void mce_log_file(loglevel_t loglevel, const char *const file,
 
 	loglevel = mce_log_level_normalize(loglevel);
 
-	if (logverbosity >= loglevel) {
+	/* The mce_log() call sites have already been filtered, but
+	 * mce_log_raw() and the hybris plugin log proxy come here
+	 * directly; the rule lookup is done only for enabled levels */
+	if (mce_log_file_verbosity(file) >= (int)loglevel) {
 		gchar *msg = 0;
 
+		if (log_thread != NULL) {
+			va_start(args, fmt);
+			mce_log_ring_add(loglevel, file, function, fmt, args);
+			va_end(args);
+			goto EXIT;
+		}
+
 		va_start(args, fmt);
 		g_vasprintf(&msg, fmt, args);
 		va_end(args);
@@ -98,19 +422,126 @@ void mce_log_file(loglevel_t loglevel, const char *const file,
 			g_free(msg), msg = tmp;
 		}
 
-		if (logtype == MCE_LOG_STDERR) {
-			fprintf(stderr, "%s: %s: %s\n",
-				logname,
-				mce_log_level_tag(loglevel),
-				msg);
-		} else {
-			/* loglevels are subset of syslog priorities, so
-			 * we can use loglevel as is for syslog priority */
-			syslog(loglevel, "%s", msg);
-		}
+		mce_log_emit(loglevel, msg);
 
 		g_free(msg);
 	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Write out the buffered log messages right away
+ *
+ * Also used on the crash path, so it does not wait for the writer
+ * thread; if the writer is busy, it is left to finish
+ */
+void mce_log_flush(void)
+{
+	if (log_reader_mutex == NULL)
+		goto EXIT;
+
+	if (!g_mutex_trylock(log_reader_mutex))
+		goto EXIT;
+
+	mce_log_ring_drain();
+	g_mutex_unlock(log_reader_mutex);
+
+EXIT:
+	return;
+}
+
+/**
+ * Stop the log writer thread and return to synchronous logging
+ */
+void mce_log_stop_async(void)
+{
+	if (log_thread == NULL)
+		goto EXIT;
+
+	g_atomic_int_set(&log_quit, 1);
+	g_atomic_int_set(&log_armed, 1);
+	mce_log_ring_doorbell();
+
+	g_thread_join(log_thread), log_thread = NULL;
+
+	/* Messages from other threads that raced with the stop */
+	g_mutex_lock(log_reader_mutex);
+	mce_log_ring_drain();
+	g_mutex_unlock(log_reader_mutex);
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_clear(log_reader_mutex);
+#else
+	g_mutex_free(log_reader_mutex);
+#endif
+	log_reader_mutex = NULL;
+
+	close(log_doorbell), log_doorbell = -1;
+
+EXIT:
+	return;
+}
+
+/**
+ * Start the log writer thread
+ *
+ * From now on messages are formatted into a ring buffer and
+ * written out by a separate thread.  Must be called after
+ * daemonizing, since threads do not survive fork()
+ */
+void mce_log_start_async(void)
+{
+	GError *error = NULL;
+
+	if (log_thread != NULL)
+		goto EXIT;
+
+	if ((log_doorbell = eventfd(0, EFD_CLOEXEC)) == -1) {
+		mce_log(LL_WARN, "log writer doorbell: eventfd: %m");
+		goto EXIT;
+	}
+
+	g_atomic_int_set(&log_quit, 0);
+	g_atomic_int_set(&log_armed, 0);
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_init(&log_reader_mutex_storage);
+	log_reader_mutex = &log_reader_mutex_storage;
+
+	log_thread = g_thread_try_new("mce-log", mce_log_writer_thread,
+				      NULL, &error);
+#else
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+	log_reader_mutex = g_mutex_new();
+
+	log_thread = g_thread_create(mce_log_writer_thread, NULL,
+				     TRUE, &error);
+#endif
+
+	if (log_thread == NULL) {
+#if GLIB_CHECK_VERSION(2,32,0)
+		g_mutex_clear(log_reader_mutex);
+#else
+		g_mutex_free(log_reader_mutex);
+#endif
+		log_reader_mutex = NULL;
+		close(log_doorbell), log_doorbell = -1;
+
+		mce_log(LL_WARN, "Failed to start log writer thread; %s",
+			error ? error->message : "unknown");
+		goto EXIT;
+	}
+
+	/* Write out what is left when mce exits */
+	atexit(mce_log_stop_async);
+
+EXIT:
+	g_clear_error(&error);
+	return;
 }
 
 /**
@@ -122,6 +553,60 @@ void mce_log_file(loglevel_t loglevel, const char *const file,
 void mce_log_set_verbosity(const int verbosity)
 {
 	logverbosity = verbosity;
+	mce_log_invalidate_sites();
+}
+
+/**
+ * Set log verbosity for the source files matching a pattern
+ *
+ * Setting a new verbosity for an existing pattern replaces the old
+ * rule, and the latest rule matching a file is used
+ *
+ * @param pattern glob pattern for the source file; see
+ *                mce_log_rule_match() for what is matched
+ * @param verbosity minimum level for log level, or
+ *                  a negative value to remove the rule
+ *
+ * @return 1 on success, 0 if the pattern is too long or
+ *         there are too many rules
+ */
+int mce_log_set_file_verbosity(const char *pattern, int verbosity)
+{
+	int status = 0;
+	int i;
+
+	if (strlen(pattern) >= MCE_LOG_RULE_PATTERN_MAX)
+		goto EXIT;
+
+	/* Remove the old rule, keeping the order of the others */
+	for (i = 0; i < log_rule_count; i++) {
+		if (!strcmp(log_rules[i].pattern, pattern))
+			break;
+	}
+
+	if (i < log_rule_count) {
+		memmove(log_rules + i, log_rules + i + 1,
+			(log_rule_count - i - 1) * sizeof *log_rules);
+		log_rule_count--;
+	}
+
+	if (verbosity >= 0) {
+		if (log_rule_count >= MCE_LOG_RULES_MAX)
+			goto EXIT;
+
+		snprintf(log_rules[log_rule_count].pattern,
+			 sizeof log_rules[log_rule_count].pattern,
+			 "%s", pattern);
+		log_rules[log_rule_count].level = verbosity;
+		log_rule_count++;
+	}
+
+	status = 1;
+
+EXIT:
+	mce_log_invalidate_sites();
+
+	return status;
 }
 
 /**
@@ -146,25 +631,12 @@ void mce_log_open(const char *const name, const int facility, const int type)
  */
 void mce_log_close(void)
 {
+	mce_log_stop_async();
+
 	g_free(logname), logname = 0;
 
 	if (logtype == MCE_LOG_SYSLOG)
 		closelog();
 }
 
-/**
- * Log level testing predicate
- *
- * For testing whether given level of logging is allowed
- * before spending cpu time for gathering parameters etc
- *
- * @param loglevel level of logging we might do
- *
- * @return 1 if logging at givel level is enabled, 0 if not
- */
-int mce_log_p(const loglevel_t loglevel)
-{
-	return logverbosity >= loglevel;
-}
-
 #endif /* OSSOLOG_COMPILE */
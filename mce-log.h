@@ -26,6 +26,18 @@
 #define MCE_LOG_SYSLOG			1	/**< Log to syslog */
 #define MCE_LOG_STDERR			0	/**< Log to stderr */
 
+/** Number of messages the asynchronous log ring can hold */
+#define MCE_LOG_RING_SIZE		256
+
+/** Maximum length of a message in the asynchronous log ring */
+#define MCE_LOG_RING_MESSAGE_MAX	512
+
+/** Maximum number of per source file verbosity rules */
+#define MCE_LOG_RULES_MAX		16
+
+/** Maximum length of a source file pattern in a verbosity rule */
+#define MCE_LOG_RULE_PATTERN_MAX	64
+
 /** Severity of loglevels (subset of syslog priorities) */
 typedef enum {
 	LL_NONE    = 0,			/**< No logging at all */
@@ -40,26 +52,88 @@ typedef enum {
 	LL_DEFAULT = LL_WARN,		/**< Default log level */
 } loglevel_t;
 
+/**
+ * Compile time upper limit for logging
+ *
+ * Log calls above this level are dropped from the build;
+ * e.g. -DMCE_LOG_LEVEL_MAX=LL_INFO for release builds
+ */
+#ifndef MCE_LOG_LEVEL_MAX
+# define MCE_LOG_LEVEL_MAX		LL_DEBUG
+#endif
+
 #ifdef OSSOLOG_COMPILE
+/** Verbosity cache for a log call site; one static instance per site */
+typedef struct {
+	/** Source file of the call site */
+	const char *file;
+	/** Value of mce_log_generation the level was looked up at */
+	int generation;
+	/** Verbosity for the source file */
+	int level;
+} mce_log_site_t;
+
+/** Changed whenever any verbosity setting changes; never zero */
+extern volatile int mce_log_generation;
+
+void mce_log_site_resolve(mce_log_site_t *site);
+
+/**
+ * Check whether logging at a level is enabled for a call site
+ *
+ * Costs a compile time constant check and two compares
+ * in the common case where the cached level is up to date
+ */
+#define mce_log_site_p(__site, __loglevel)\
+	(((__loglevel) <= MCE_LOG_LEVEL_MAX) &&\
+	 (((__site)->generation == mce_log_generation) ||\
+	  (mce_log_site_resolve(__site), 1)) &&\
+	 ((int)(__loglevel) <= (__site)->level))
+
 void mce_log_file(loglevel_t loglevel, const char *const file,
 		  const char *const function, const char *const fmt, ...)
 	__attribute__((format(printf, 4, 5)));
 #define mce_log_raw(__loglevel, __fmt, __args...)	mce_log_file(__loglevel, NULL, NULL, __fmt , ## __args)
-#define mce_log(__loglevel, __fmt, __args...)		mce_log_file(__loglevel, __FILE__, __FUNCTION__, __fmt , ## __args)
+#define mce_log(__loglevel, __fmt, __args...) do {\
+	static mce_log_site_t mce_log_site_ = { __FILE__, 0, 0 };\
+	if (mce_log_site_p(&mce_log_site_, __loglevel))\
+		mce_log_file(__loglevel, __FILE__, __FUNCTION__,\
+			     __fmt , ## __args);\
+} while (0)
+/**
+ * Log level testing predicate
+ *
+ * For testing whether given level of logging is allowed
+ * before spending cpu time for gathering parameters etc
+ */
+#define mce_log_p(__loglevel) ({\
+	static mce_log_site_t mce_log_site_ = { __FILE__, 0, 0 };\
+	mce_log_site_p(&mce_log_site_, __loglevel); })
 void mce_log_set_verbosity(const int verbosity);
+int mce_log_set_file_verbosity(const char *pattern, int verbosity);
 void mce_log_open(const char *const name, const int facility, const int type);
 void mce_log_close(void);
-int mce_log_p(const loglevel_t loglevel);
+void mce_log_start_async(void);
+void mce_log_stop_async(void);
+void mce_log_flush(void);
 #else
 /** Dummy version used when logging is disabled at compile time */
 #define mce_log(_loglevel, _fmt, ...)			do {} while (0)
 /** Dummy version used when logging is disabled at compile time */
 #define mce_log_set_verbosity(_verbosity)		do {} while (0)
 /** Dummy version used when logging is disabled at compile time */
+#define mce_log_set_file_verbosity(_pattern, _verbosity)	0
+/** Dummy version used when logging is disabled at compile time */
 #define mce_log_open(_name, _facility, _type)		do {} while (0)
 /** Dummy version used when logging is disabled at compile time */
 #define mce_log_close()					do {} while (0)
 /** Dummy version used when logging is disabled at compile time */
+#define mce_log_start_async()				do {} while (0)
+/** Dummy version used when logging is disabled at compile time */
+#define mce_log_stop_async()				do {} while (0)
+/** Dummy version used when logging is disabled at compile time */
+#define mce_log_flush()					do {} while (0)
+/** Dummy version used when logging is disabled at compile time */
 #define mce_log_p(_loglevel)				0
 #endif /* OSSOLOG_COMPILE */
 
@@ -0,0 +1,225 @@
+/**
+ * @file mce-memstat.c
+ * Per-owner memory accounting for the Mode Control Entity
+ * <p>
+ * The mce components that keep long lived allocations -- LED
+ * patterns, ALS color profiles, builtin-gconf entries, D-Bus
+ * handlers and I/O monitors -- report them with mce_memstat_alloc()
+ * and mce_memstat_free().  The live size and the peak size are
+ * tracked per owner, so that the growth of the resident set can
+ * be attributed to the component that caused it.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <stdlib.h>			/* strtoul() */
+#include <string.h>			/* strstr() */
+
+#include "mce-memstat.h"
+
+#include "mce-io.h"			/* mce_read_string_from_file() */
+#include "mce-log.h"			/* mce_log(), LL_* */
+
+/** Path to the status file of the mce process */
+#define MEMSTAT_PROC_STATUS_PATH	"/proc/self/status"
+
+/** Accounting of one owner */
+typedef struct {
+	guint count;			/**< Number of live allocations */
+	gsize bytes;			/**< Size of live allocations */
+	gsize peak;			/**< Peak size of live allocations */
+} memstat_t;
+
+/** Accounting of owners; owner -> memstat_t
+ *
+ * Created on the first allocation, so that components
+ * initialised before the mainloop are accounted too
+ */
+static GHashTable *memstat_owners = NULL;
+
+/**
+ * Account a long lived allocation
+ *
+ * @param owner Owner of the allocation
+ * @param bytes Size of the allocation [bytes]
+ */
+void mce_memstat_alloc(const gchar *owner, gsize bytes)
+{
+	memstat_t *stats;
+
+	if (memstat_owners == NULL)
+		memstat_owners = g_hash_table_new_full(g_str_hash,
+						       g_str_equal,
+						       g_free, g_free);
+
+	if ((stats = g_hash_table_lookup(memstat_owners, owner)) == NULL) {
+		stats = g_malloc0(sizeof *stats);
+		g_hash_table_insert(memstat_owners, g_strdup(owner), stats);
+	}
+
+	stats->count += 1;
+	stats->bytes += bytes;
+
+	if (stats->peak < stats->bytes)
+		stats->peak = stats->bytes;
+}
+
+/**
+ * Account the release of a long lived allocation
+ *
+ * @param owner Owner of the allocation
+ * @param bytes Size of the allocation [bytes]
+ */
+void mce_memstat_free(const gchar *owner, gsize bytes)
+{
+	memstat_t *stats;
+
+	/* Releases after mce_memstat_exit() are not accounted */
+	if (memstat_owners == NULL)
+		goto EXIT;
+
+	if ((stats = g_hash_table_lookup(memstat_owners, owner)) == NULL) {
+		mce_log(LL_WARN, "%s: release without allocation", owner);
+		goto EXIT;
+	}
+
+	if (stats->count == 0 || stats->bytes < bytes) {
+		mce_log(LL_WARN, "%s: more released than allocated", owner);
+		stats->count = 0;
+		stats->bytes = 0;
+		goto EXIT;
+	}
+
+	stats->count -= 1;
+	stats->bytes -= bytes;
+
+EXIT:
+	return;
+}
+
+/**
+ * Iterate over the memory accounting of all owners
+ *
+ * @param callback The function to call for each owner
+ * @param user_data Data to pass to the callback
+ */
+void mce_memstat_foreach(mce_memstat_cb callback, gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (memstat_owners == NULL)
+		goto EXIT;
+
+	g_hash_table_iter_init(&iter, memstat_owners);
+
+	while (g_hash_table_iter_next(&iter, &key, &value) == TRUE) {
+		const memstat_t *stats = value;
+
+		callback(key, stats->count, stats->bytes, stats->peak,
+			 user_data);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Parse one "VmXXX:  1234 kB" line of the process status
+ *
+ * @param status Contents of the process status file
+ * @param key Name of the field, including the colon
+ * @return The value of the field [kB], or 0 if not found
+ */
+static guint mce_memstat_parse_status(const gchar *status, const gchar *key)
+{
+	const gchar *line = strstr(status, key);
+
+	if (line == NULL)
+		return 0;
+
+	return strtoul(line + strlen(key), NULL, 10);
+}
+
+/**
+ * Get the resident set size of mce
+ *
+ * @param[out] rss Current resident set size [kB]
+ * @param[out] peak Peak resident set size [kB]
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_memstat_get_rss(guint *rss, guint *peak)
+{
+	gchar *status = NULL;
+	gboolean retval = FALSE;
+
+	*rss = *peak = 0;
+
+	if (mce_read_string_from_file(MEMSTAT_PROC_STATUS_PATH,
+				      &status) == FALSE)
+		goto EXIT;
+
+	*rss = mce_memstat_parse_status(status, "VmRSS:");
+	*peak = mce_memstat_parse_status(status, "VmHWM:");
+
+	retval = TRUE;
+
+EXIT:
+	g_free(status);
+
+	return retval;
+}
+
+/**
+ * Write the memory accounting to the log
+ */
+void mce_memstat_dump(void)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	guint rss, peak;
+
+	if (mce_memstat_get_rss(&rss, &peak) == TRUE)
+		mce_log(LL_NOTICE, "RSS %u kB, peak %u kB", rss, peak);
+
+	if (memstat_owners == NULL)
+		goto EXIT;
+
+	mce_log(LL_NOTICE, "%-32s %8s %10s %10s",
+		"OWNER", "COUNT", "BYTES", "PEAK");
+
+	g_hash_table_iter_init(&iter, memstat_owners);
+
+	while (g_hash_table_iter_next(&iter, &key, &value) == TRUE) {
+		const memstat_t *stats = value;
+
+		mce_log(LL_NOTICE, "%-32s %8u %10zu %10zu",
+			(const gchar *)key, stats->count,
+			stats->bytes, stats->peak);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Exit function for the memory accounting
+ */
+void mce_memstat_exit(void)
+{
+	if (memstat_owners != NULL)
+		g_hash_table_unref(memstat_owners), memstat_owners = NULL;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file mce-memstat.h
+ * Headers for the per-owner memory accounting
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_MEMSTAT_H_
+#define _MCE_MEMSTAT_H_
+
+#include <glib.h>
+
+/**
+ * Callback for mce_memstat_foreach()
+ *
+ * @param owner Owner of the allocations, e.g. "led:patterns"
+ * @param count Number of live allocations
+ * @param bytes Size of the live allocations [bytes]
+ * @param peak Largest size the live allocations have had [bytes]
+ * @param user_data The user data given to mce_memstat_foreach()
+ */
+typedef void (*mce_memstat_cb)(const gchar *owner, guint count,
+			       gsize bytes, gsize peak,
+			       gpointer user_data);
+
+void mce_memstat_alloc(const gchar *owner, gsize bytes);
+void mce_memstat_free(const gchar *owner, gsize bytes);
+void mce_memstat_foreach(mce_memstat_cb callback, gpointer user_data);
+gboolean mce_memstat_get_rss(guint *rss, guint *peak);
+void mce_memstat_dump(void);
+
+void mce_memstat_exit(void);
+
+#endif /* _MCE_MEMSTAT_H_ */
@@ -23,37 +23,85 @@
 
 #include <stdio.h>			/* fprintf(), stdout */
 #include <string.h>			/* strcmp() */
-
-#include "mce.h"			/* module_info_struct */
+#include "mce.h"			/* module_info_struct,
+					 * mce_startup_trace()
+					 */
 #include "mce-modules.h"
 
+#include "mce-lib.h"			/* mce_lib_get_time_us() */
 #include "mce-log.h"			/* mce_log(), LL_* */
 #include "mce-conf.h"			/* mce_conf_get_string(),
 					 * mce_conf_get_string_list()
 					 */
+#include "mce-dbus.h"			/* mce_dbus_handler_add(),
+					 * dbus_send_message(),
+					 * dbus_new_method_reply(),
+					 * MCE_REQUEST_IF
+					 */
 
-/** List of all loaded modules */
+/** Bookkeeping for a module */
+typedef struct {
+	/** Module name, as in the configuration */
+	gchar *name;
+	/** Module handle; NULL if the module is not loaded */
+	GModule *module;
+	/** Loaded once the mainloop is idle */
+	gboolean deferred;
+	/** Time spent in g_module_open(), including the init
+	 *  function of the module [us] */
+	gint64 load_time;
+} mce_module_t;
+
+/** List of all modules, in reverse load order */
 static GSList *modules = NULL;
 
+/** Deferred modules that are not loaded yet, in load order */
+static GSList *modules_deferred = NULL;
+
+/** Module path from the configuration */
+static gchar *modules_path = NULL;
+
+/** ID for the deferred module loading idle source */
+static guint modules_deferred_id = 0;
+
+static void mce_modules_load_deferred(void);
+
 /**
  * Dump information about mce modules to stdout
+ *
+ * The deferred modules are loaded first, so that
+ * their information is available too
  */
 void mce_modules_dump_info(void)
 {
-	GModule *module;
+	mce_module_t *entry;
 	gint i;
 
-	for (i = 0; (module = g_slist_nth_data(modules, i)) != NULL; i++) {
-		const gchar *modulename = g_module_name(module);
+	mce_modules_load_deferred();
+
+	for (i = 0; (entry = g_slist_nth_data(modules, i)) != NULL; i++) {
+		GModule *module = entry->module;
+		const gchar *modulename;
 		module_info_struct *modinfo;
 		gchar *tmp = NULL;
 		gpointer mip;
 
+		if (module == NULL)
+			continue;
+
+		modulename = g_module_name(module);
+
 		fprintf(stdout,
 			_("\n"
 			  "Module: %s\n"),
 			modulename);
 
+		fprintf(stdout,
+			"        %-32s %" G_GINT64_FORMAT " us%s\n",
+			_("load time:"),
+			entry->load_time,
+			entry->deferred ? _(" (deferred)") : "");
+
 		if (g_module_symbol(module,
 				    "module_info",
 				    &mip) == FALSE) {
@@ -155,56 +203,253 @@ static gchar * mce_modules_build_path(const gchar *directory,
 	return g_strdup_printf("%s/%s.so", directory, module_name);
 }
 
+/**
+ * Load a module and measure the time it takes
+ *
+ * The time covers loading and relocating the shared object
+ * as well as its g_module_check_init(); opening the object
+ * separately just to split the two would add a second
+ * dlopen() to every module load
+ *
+ * @param name The name of the module
+ * @param deferred TRUE if the load was deferred, FALSE otherwise
+ */
+static void mce_modules_load(const gchar *name, gboolean deferred)
+{
+	mce_module_t *entry = g_malloc0(sizeof *entry);
+	gchar *tmp = mce_modules_build_path(modules_path, name);
+	gint64 started;
+
+	entry->name = g_strdup(name);
+	entry->deferred = deferred;
+
+	mce_log(LL_INFO,
+		"Loading module: %s from %s",
+		name, modules_path);
+
+	started = mce_lib_get_time_us(CLOCK_MONOTONIC);
+	entry->module = g_module_open(tmp, 0);
+	entry->load_time = mce_lib_get_time_us(CLOCK_MONOTONIC) - started;
+
+	mce_startup_trace("module %s%s", name,
+			  deferred ? " (deferred)" : "");
+
+	if (entry->module != NULL) {
+		/* XXX: check dependencies, conflicts, et al */
+		mce_log(LL_DEBUG,
+			"Module %s: loaded in %" G_GINT64_FORMAT " us",
+			name, entry->load_time);
+	} else {
+		const char *err = g_module_error();
+		mce_log(LL_ERR, "%s", err ?: "unknown error");
+		mce_log(LL_ERR,
+			"Failed to load module: %s; skipping",
+			name);
+	}
+
+	modules = g_slist_prepend(modules, entry);
+
+	g_free(tmp);
+}
+
+/**
+ * Idle callback for loading the deferred modules
+ *
+ * Loads one module per call, so that the mainloop can
+ * serve other events between the loads
+ *
+ * @param data Unused
+ * @return TRUE while there are modules to load, FALSE otherwise
+ */
+static gboolean mce_modules_deferred_cb(gpointer data)
+{
+	gchar *name;
+
+	(void)data;
+
+	if ((name = g_slist_nth_data(modules_deferred, 0)) != NULL) {
+		modules_deferred = g_slist_delete_link(modules_deferred,
+						       modules_deferred);
+		mce_modules_load(name, TRUE);
+		g_free(name);
+	}
+
+	if (modules_deferred != NULL)
+		return TRUE;
+
+	mce_log(LL_DEBUG, "All deferred modules loaded");
+	modules_deferred_id = 0;
+
+	return FALSE;
+}
+
+/**
+ * Load the deferred modules that are not loaded yet right away
+ */
+static void mce_modules_load_deferred(void)
+{
+	if (modules_deferred_id != 0) {
+		g_source_remove(modules_deferred_id);
+		modules_deferred_id = 0;
+	}
+
+	while (modules_deferred != NULL)
+		mce_modules_deferred_cb(NULL);
+}
+
+/**
+ * Check whether a module is listed
+ *
+ * @param list NULL terminated list of module names, or NULL
+ * @param name The name of the module
+ * @return TRUE if the module is in the list, FALSE otherwise
+ */
+static gboolean mce_modules_in_list(gchar **list, const gchar *name)
+{
+	gint i;
+
+	for (i = 0; list && list[i]; i++) {
+		if (!strcmp(list[i], name))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * D-Bus callback for the get module load statistics method call
+ *
+ * Replies with an array of (name, loaded, deferred, load time [us])
+ * structures, in load order; the load time includes the time spent
+ * in the init function of the module
+ *
+ * @param msg The D-Bus message to reply to
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean mce_modules_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array, item;
+	GSList *list = NULL;
+	GSList *iter;
+
+	mce_log(LL_DEBUG, "Received module stats get request");
+
+	if (dbus_message_get_no_reply(msg)) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if ((reply = dbus_new_method_reply(msg)) == NULL)
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if (!dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(sbbt)", &array)) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_MODULES_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	list = g_slist_reverse(g_slist_copy(modules));
+
+	for (iter = list; iter != NULL; iter = iter->next) {
+		mce_module_t *entry = iter->data;
+		const char *name = entry->name;
+		dbus_bool_t loaded = (entry->module != NULL);
+		dbus_bool_t deferred = entry->deferred;
+		dbus_uint64_t load_time = entry->load_time;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+						 NULL, &item);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_BOOLEAN,
+					       &loaded);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_BOOLEAN,
+					       &deferred);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64,
+					       &load_time);
+		dbus_message_iter_close_container(&array, &item);
+	}
+
+	g_slist_free(list);
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
 /**
  * Init function for the mce-modules component
  *
+ * The modules listed as deferred are loaded one at a time
+ * from a low priority idle callback once mce is up and running
+ *
  * @return TRUE on success, FALSE on failure
  */
 gboolean mce_modules_init(void)
 {
 	gchar **modlist = NULL;
+	gchar **deferred = NULL;
 	gsize length;
-	gchar *path = NULL;
 
 	/* Get the module path */
-	path = mce_conf_get_string(MCE_CONF_MODULES_GROUP,
-				   MCE_CONF_MODULES_PATH,
-				   DEFAULT_MCE_MODULE_PATH);
+	modules_path = mce_conf_get_string(MCE_CONF_MODULES_GROUP,
+					   MCE_CONF_MODULES_PATH,
+					   DEFAULT_MCE_MODULE_PATH);
 
 	/* Get the list modules to load */
 	modlist = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
 					   MCE_CONF_MODULES_MODULES,
 					   &length);
 
+	/* Get the list of modules to load later on */
+	deferred = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
+					    MCE_CONF_MODULES_DEFERRED,
+					    &length);
+
+	/* get_module_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_MODULES_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 mce_modules_stats_get_dbus_cb) == NULL)
+		mce_log(LL_WARN, "Failed to add module stats D-Bus handler");
+
 	if (modlist != NULL) {
 		gint i;
 
 		for (i = 0; modlist[i]; i++) {
-			GModule *module;
-			gchar *tmp = mce_modules_build_path(path, modlist[i]);
-
-			mce_log(LL_INFO,
-				"Loading module: %s from %s",
-				modlist[i], path);
-
-			if ((module = g_module_open(tmp, 0)) != NULL) {
-				/* XXX: check dependencies, conflicts, et al */
-				modules = g_slist_prepend(modules, module);
-			} else {
-				const char *err = g_module_error();
-				mce_log(LL_ERR, "%s", err ?: "unknown error");
-				mce_log(LL_ERR,
-					"Failed to load module: %s; skipping",
-					modlist[i]);
+			if (mce_modules_in_list(deferred, modlist[i])) {
+				modules_deferred =
+					g_slist_append(modules_deferred,
+						       g_strdup(modlist[i]));
+				continue;
 			}
 
-			g_free(tmp);
+			mce_modules_load(modlist[i], FALSE);
 		}
 
 		g_strfreev(modlist);
 	}
 
-	g_free(path);
+	g_strfreev(deferred);
+
+	if (modules_deferred != NULL) {
+		modules_deferred_id =
+			g_idle_add_full(G_PRIORITY_LOW,
+					mce_modules_deferred_cb,
+					NULL, NULL);
+	}
 
 	return TRUE;
 }
@@ -214,17 +459,32 @@ gboolean mce_modules_init(void)
  */
 void mce_modules_exit(void)
 {
-	GModule *module;
+	mce_module_t *entry;
 	gint i;
 
+	if (modules_deferred_id != 0) {
+		g_source_remove(modules_deferred_id);
+		modules_deferred_id = 0;
+	}
+
+	g_slist_free_full(modules_deferred, g_free);
+	modules_deferred = NULL;
+
 	if (modules != NULL) {
-		for (i = 0; (module = g_slist_nth_data(modules, i)) != NULL; i++) {
-			g_module_close(module);
+		for (i = 0; (entry = g_slist_nth_data(modules, i)) != NULL; i++) {
+			if (entry->module != NULL)
+				g_module_close(entry->module);
+
+			g_free(entry->name);
+			g_free(entry);
 		}
 
 		g_slist_free(modules);
 		modules = NULL;
 	}
 
+	g_free(modules_path);
+	modules_path = NULL;
+
 	return;
 }
@@ -32,6 +32,15 @@
 /** Name of configuration key for modules to load */
 #define MCE_CONF_MODULES_MODULES	"Modules"
 
+/**
+ * Name of configuration key for modules to load once the mainloop
+ * is idle; these must not be needed for the first display unblank
+ */
+#define MCE_CONF_MODULES_DEFERRED	"DeferredModules"
+
+/** Name of the D-Bus method for the module load statistics */
+#define MCE_MODULES_STATS_GET		"get_module_stats"
+
 /** Default value for module path */
 #define DEFAULT_MCE_MODULE_PATH		"/usr/lib/mce/modules"
 
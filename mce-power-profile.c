@@ -0,0 +1,89 @@
+/**
+ * @file mce-power-profile.c
+ * Power profiles for the Mode Control Entity
+ * <p>
+ * The power saving mode module picks a profile based on the power
+ * saving mode and thermal state, and publishes it through
+ * power_profile_pipe.  Modules look up the runtime costs the active
+ * profile allows from here instead of reacting to power saving mode
+ * on their own, and re-read them from a power_profile_pipe trigger.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include "mce-power-profile.h"
+
+#include "datapipe.h"			/* datapipe_get_gint() */
+
+/** Runtime costs for each power profile; indexed by power_profile_t */
+static const mce_power_profile_t power_profiles[] = {
+	[POWER_PROFILE_NORMAL] = {
+		.name                = "normal",
+		.als_poll_scale      = 1,
+		.fade_min_step_time  = 0,
+		.led_breathe         = TRUE,
+		.activity_window_min = 0,
+	},
+	[POWER_PROFILE_POWERSAVE] = {
+		.name                = "powersave",
+		.als_poll_scale      = 2,
+		.fade_min_step_time  = 32,
+		.led_breathe         = FALSE,
+		.activity_window_min = 1000,
+	},
+	[POWER_PROFILE_THERMAL] = {
+		.name                = "thermal",
+		.als_poll_scale      = 4,
+		.fade_min_step_time  = 64,
+		.led_breathe         = FALSE,
+		.activity_window_min = 2000,
+	},
+};
+
+/**
+ * Select the power profile to use
+ *
+ * @param power_saving_mode TRUE if power saving mode is active
+ * @param thermal_state The device thermal state
+ * @return The power profile for the given state
+ */
+power_profile_t mce_power_profile_select(gboolean power_saving_mode,
+					 thermal_state_t thermal_state)
+{
+	power_profile_t profile = POWER_PROFILE_NORMAL;
+
+	if (thermal_state == THERMAL_STATE_OVERHEATED)
+		profile = POWER_PROFILE_THERMAL;
+	else if (power_saving_mode == TRUE)
+		profile = POWER_PROFILE_POWERSAVE;
+
+	return profile;
+}
+
+/**
+ * Get the runtime costs allowed by the active power profile
+ *
+ * @return The active power profile; never NULL
+ */
+const mce_power_profile_t *mce_power_profile_get(void)
+{
+	gint profile = datapipe_get_gint(power_profile_pipe);
+
+	if ((profile < 0) || (profile >= (gint)G_N_ELEMENTS(power_profiles)))
+		profile = POWER_PROFILE_NORMAL;
+
+	return &power_profiles[profile];
+}
@@ -0,0 +1,44 @@
+/**
+ * @file mce-power-profile.h
+ * Headers for the power profiles of the Mode Control Entity
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_POWER_PROFILE_H_
+#define _MCE_POWER_PROFILE_H_
+
+#include <glib.h>
+
+#include "mce.h"			/* power_profile_t */
+
+/** Runtime costs allowed by a power profile */
+typedef struct {
+	/** Name of the profile, for diagnostics */
+	const gchar *name;
+	/** Multiplier for the ALS poll interval */
+	gint als_poll_scale;
+	/** Minimum brightness fade step time [ms] */
+	gint fade_min_step_time;
+	/** Are software breathing LED animations allowed? */
+	gboolean led_breathe;
+	/** Minimum activity merging window [ms] */
+	gint activity_window_min;
+} mce_power_profile_t;
+
+power_profile_t mce_power_profile_select(gboolean power_saving_mode,
+					 thermal_state_t thermal_state);
+const mce_power_profile_t *mce_power_profile_get(void);
+
+#endif /* _MCE_POWER_PROFILE_H_ */
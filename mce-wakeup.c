@@ -0,0 +1,329 @@
+/**
+ * @file mce-wakeup.c
+ * Mainloop wakeup accounting for the Mode Control Entity
+ * <p>
+ * A poll function installed on the default main context counts
+ * the mainloop wakeups.  The mce components that dispatch work
+ * from the mainloop -- I/O monitors, deadlines, D-Bus messages,
+ * file watchers and the signal pipe -- look up their owner once
+ * with mce_wakeup_owner(), bracket each dispatch with
+ * mce_wakeup_begin() and mce_wakeup_account(), and the first
+ * dispatch after a wakeup is charged for it.  Wakeups and mainloop
+ * time that nobody reports, such as plain glib timeouts, are
+ * charged to "other".
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include "mce-wakeup.h"
+
+#include "mce-log.h"			/* mce_log(), LL_* */
+
+/** Maximum number of separately accounted owners */
+#define WAKEUP_STATS_MAX_OWNERS		128
+
+/** Accounting of one owner */
+struct mce_wakeup_owner_t {
+	guint wakeups;			/**< Wakeups charged to the owner */
+	guint dispatches;		/**< Number of dispatches */
+	guint64 time;			/**< Time spent dispatching [us] */
+};
+
+/** Accounting of owners; "kind:name" -> mce_wakeup_owner_t */
+static GHashTable *wakeup_owners = NULL;
+
+/** Accounting of the wakeups nobody was charged for */
+static mce_wakeup_owner_t wakeup_other = { 0, 0, 0 };
+
+/** Number of dispatches in progress; only the outermost is accounted */
+static guint wakeup_depth = 0;
+
+/** Main context the poll function is installed on */
+static GMainContext *wakeup_context = NULL;
+
+/** Whether the latest wakeup has not been charged yet */
+static gboolean wakeup_pending = FALSE;
+
+/** Total number of mainloop wakeups */
+static guint wakeup_count = 0;
+
+/** When the latest poll returned [us]; 0 when not polled yet */
+static gint64 wakeup_poll_returned = 0;
+
+/** Total time spent outside poll [us] */
+static guint64 wakeup_busy = 0;
+
+/** Time reported by mce_wakeup_account() [us] */
+static guint64 wakeup_accounted = 0;
+
+/** When the accounting was started [us] */
+static gint64 wakeup_started = 0;
+
+/**
+ * Look up, or create, the accounting of an owner
+ *
+ * When the table is full, the new owners of the same
+ * kind are accounted together under "kind:*"
+ *
+ * The owner is meant to be looked up once, when the source
+ * is set up; the accounting stays valid until mce_wakeup_exit()
+ *
+ * @param kind Kind of the owner, e.g. "iomon" or "dbus"
+ * @param name Name of the owner within the kind
+ * @return The accounting of the owner, or NULL if the wakeup
+ *         accounting is not initialised
+ */
+mce_wakeup_owner_t *mce_wakeup_owner(const gchar *kind, const gchar *name)
+{
+	gchar *key = NULL;
+	mce_wakeup_owner_t *stats = NULL;
+
+	if (wakeup_owners == NULL)
+		goto EXIT;
+
+	key = g_strdup_printf("%s:%s", kind, name ?: "");
+
+	if ((stats = g_hash_table_lookup(wakeup_owners, key)) != NULL)
+		goto EXIT;
+
+	if (g_hash_table_size(wakeup_owners) >= WAKEUP_STATS_MAX_OWNERS) {
+		g_free(key);
+		key = g_strdup_printf("%s:*", kind);
+
+		if ((stats = g_hash_table_lookup(wakeup_owners, key)) != NULL)
+			goto EXIT;
+	}
+
+	stats = g_malloc0(sizeof *stats);
+	g_hash_table_insert(wakeup_owners, key, stats), key = NULL;
+
+EXIT:
+	g_free(key);
+
+	return stats;
+}
+
+/**
+ * Start one dispatch from the mainloop
+ *
+ * Every call must be paired with mce_wakeup_account()
+ *
+ * @return When the dispatch started, to be passed to mce_wakeup_account()
+ */
+gint64 mce_wakeup_begin(void)
+{
+	wakeup_depth += 1;
+
+	return g_get_monotonic_time();
+}
+
+/**
+ * Account one dispatch from the mainloop
+ *
+ * If this is the first dispatch after a mainloop wakeup,
+ * the owner is charged for the wakeup too.  Dispatches
+ * nested in another one, e.g. a D-Bus message handled from
+ * within an I/O monitor callback, are part of the outer
+ * dispatch and are not accounted separately.
+ *
+ * @param owner The owner from mce_wakeup_owner(), or NULL
+ * @param started When the dispatch started, from mce_wakeup_begin()
+ */
+void mce_wakeup_account(mce_wakeup_owner_t *owner, gint64 started)
+{
+	gint64 spent;
+
+	if (wakeup_depth > 0)
+		wakeup_depth -= 1;
+
+	if ((wakeup_depth > 0) || (owner == NULL) || (wakeup_owners == NULL))
+		goto EXIT;
+
+	spent = g_get_monotonic_time() - started;
+
+	owner->dispatches += 1;
+	owner->time += spent;
+	wakeup_accounted += spent;
+
+	if (wakeup_pending == TRUE) {
+		owner->wakeups += 1;
+		wakeup_pending = FALSE;
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Poll function for the main context
+ *
+ * @param ufds File descriptors to poll
+ * @param nfsd Number of file descriptors
+ * @param timeout_ Poll timeout [ms], or -1 to wait forever
+ * @return The return value of g_poll()
+ */
+static gint mce_wakeup_poll_cb(GPollFD *ufds, guint nfsd, gint timeout_)
+{
+	gint rc;
+
+	if (wakeup_poll_returned != 0)
+		wakeup_busy += g_get_monotonic_time() - wakeup_poll_returned;
+
+	if (wakeup_pending == TRUE) {
+		wakeup_other.wakeups += 1;
+		wakeup_pending = FALSE;
+	}
+
+	rc = g_poll(ufds, nfsd, timeout_);
+
+	wakeup_poll_returned = g_get_monotonic_time();
+
+	/* A poll with zero timeout does not sleep; not a wakeup */
+	if (timeout_ != 0) {
+		wakeup_count += 1;
+		wakeup_pending = TRUE;
+	}
+
+	return rc;
+}
+
+/**
+ * Iterate over the wakeup accounting of all owners
+ *
+ * Mainloop time that was not reported by any owner is listed
+ * under MCE_WAKEUP_OWNER_OTHER, after the named owners
+ *
+ * @param callback The function to call for each owner
+ * @param user_data Data to pass to the callback
+ */
+void mce_wakeup_stats_foreach(mce_wakeup_stats_cb callback,
+			      gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (wakeup_owners == NULL)
+		goto EXIT;
+
+	g_hash_table_iter_init(&iter, wakeup_owners);
+
+	while (g_hash_table_iter_next(&iter, &key, &value) == TRUE) {
+		const mce_wakeup_owner_t *stats = value;
+
+		callback(key, stats->wakeups, stats->dispatches,
+			 stats->time, user_data);
+	}
+
+	callback(MCE_WAKEUP_OWNER_OTHER, wakeup_other.wakeups, 0,
+		 (wakeup_busy > wakeup_accounted) ?
+		 (wakeup_busy - wakeup_accounted) : 0,
+		 user_data);
+
+EXIT:
+	return;
+}
+
+/**
+ * Compare owners, the one with the most wakeups first
+ *
+ * @param a Owner name
+ * @param b Owner name
+ * @param user_data Unused
+ * @return <0, 0 or >0 like strcmp()
+ */
+static gint mce_wakeup_compare(gconstpointer a, gconstpointer b,
+			       gpointer user_data)
+{
+	const mce_wakeup_owner_t *sa = g_hash_table_lookup(wakeup_owners, a);
+	const mce_wakeup_owner_t *sb = g_hash_table_lookup(wakeup_owners, b);
+
+	(void)user_data;
+
+	if (sa->wakeups != sb->wakeups)
+		return (sa->wakeups < sb->wakeups) ? 1 : -1;
+
+	return (sa->time < sb->time) - (sa->time > sb->time);
+}
+
+/**
+ * Write the wakeup accounting to the log
+ */
+void mce_wakeup_stats_dump(void)
+{
+	GList *owners = NULL;
+	gint64 uptime;
+
+	if (wakeup_owners == NULL)
+		goto EXIT;
+
+	uptime = g_get_monotonic_time() - wakeup_started;
+
+	mce_log(LL_NOTICE, "%u wakeups in %" G_GINT64_FORMAT " s",
+		wakeup_count, uptime / G_USEC_PER_SEC);
+	mce_log(LL_NOTICE, "%-48s %8s %10s %12s",
+		"OWNER", "WAKEUPS", "DISPATCHES", "TIME_US");
+
+	owners = g_hash_table_get_keys(wakeup_owners);
+	owners = g_list_sort_with_data(owners, mce_wakeup_compare, NULL);
+
+	for (GList *item = owners; item; item = item->next) {
+		const mce_wakeup_owner_t *stats =
+			g_hash_table_lookup(wakeup_owners, item->data);
+
+		mce_log(LL_NOTICE, "%-48s %8u %10u %12" G_GUINT64_FORMAT,
+			(const gchar *)item->data, stats->wakeups,
+			stats->dispatches, stats->time);
+	}
+
+	mce_log(LL_NOTICE, "%-48s %8u %10s %12" G_GUINT64_FORMAT,
+		MCE_WAKEUP_OWNER_OTHER, wakeup_other.wakeups, "-",
+		(wakeup_busy > wakeup_accounted) ?
+		(wakeup_busy - wakeup_accounted) : 0);
+
+EXIT:
+	g_list_free(owners);
+}
+
+/**
+ * Init function for the mainloop wakeup accounting
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_wakeup_init(void)
+{
+	wakeup_owners = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free, g_free);
+	wakeup_started = g_get_monotonic_time();
+
+	wakeup_context = g_main_context_default();
+	g_main_context_set_poll_func(wakeup_context, mce_wakeup_poll_cb);
+
+	return TRUE;
+}
+
+/**
+ * Exit function for the mainloop wakeup accounting
+ */
+void mce_wakeup_exit(void)
+{
+	/* NULL restores the default poll function */
+	if (wakeup_context != NULL)
+		g_main_context_set_poll_func(wakeup_context, NULL);
+	wakeup_context = NULL;
+
+	if (wakeup_owners != NULL)
+		g_hash_table_unref(wakeup_owners), wakeup_owners = NULL;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file mce-wakeup.h
+ * Headers for the mainloop wakeup accounting
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_WAKEUP_H_
+#define _MCE_WAKEUP_H_
+
+#include <glib.h>
+
+/** Owner that mainloop activity nobody accounted for is charged to */
+#define MCE_WAKEUP_OWNER_OTHER		"other"
+
+/** Accounting of one owner of dispatched sources */
+typedef struct mce_wakeup_owner_t mce_wakeup_owner_t;
+
+/**
+ * Callback for mce_wakeup_stats_foreach()
+ *
+ * @param owner Owner of the dispatched sources, "kind:name"
+ * @param wakeups Number of mainloop wakeups caused by the owner
+ * @param dispatches Number of times the owner has been dispatched
+ * @param time Time spent in the dispatches [us]
+ * @param user_data The user data given to mce_wakeup_stats_foreach()
+ */
+typedef void (*mce_wakeup_stats_cb)(const gchar *owner, guint wakeups,
+				    guint dispatches, guint64 time,
+				    gpointer user_data);
+
+mce_wakeup_owner_t *mce_wakeup_owner(const gchar *kind, const gchar *name);
+gint64 mce_wakeup_begin(void);
+void mce_wakeup_account(mce_wakeup_owner_t *owner, gint64 started);
+void mce_wakeup_stats_foreach(mce_wakeup_stats_cb callback,
+			      gpointer user_data);
+void mce_wakeup_stats_dump(void);
+
+gboolean mce_wakeup_init(void);
+void mce_wakeup_exit(void);
+
+#endif /* _MCE_WAKEUP_H_ */
@@ -22,8 +22,11 @@
 #include <glib-object.h>		/* g_type_init() */
 
 #include <errno.h>			/* errno, ENOMEM */
-#include <fcntl.h>			/* open(), O_RDWR, O_CREAT */
-#include <stdio.h>			/* fprintf(), sprintf(),
+#include <fcntl.h>			/* open(), O_RDWR, O_CREAT, O_EXCL,
+					 * O_NOFOLLOW, O_CLOEXEC
+					 */
+#include <stdarg.h>			/* va_list, va_start(), va_end() */
+#include <stdio.h>			/* fprintf(), sprintf(), fdopen(),
 					 * stdout, stderr
 					 */
 #include <getopt.h>			/* getopt_long(),
@@ -39,7 +42,7 @@
 #include <unistd.h>			/* close(), lockf(), fork(), chdir(),
 					 * getpid(), getppid(), setsid(),
 					 * write(), getdtablesize(), dup(),
-					 * F_TLOCK
+					 * unlink(), F_TLOCK
 					 */
 #include <sys/stat.h>			/* umask() */
 
@@ -77,6 +80,8 @@
 					 * jack_sense_pipe,
 					 * power_saving_mode_pipe,
 					 * thermal_state_pipe,
+					 * power_profile_pipe,
+					 * display_prewake_pipe,
 					 * MCE_STATE_UNDEF,
 					 * MCE_INVALID_MODE_INT32,
 					 * CALL_STATE_NONE,
@@ -87,10 +92,12 @@
 					 * LOCK_UNDEF,
 					 * BATTERY_STATUS_UNDEF,
 					 * THERMAL_STATE_UNDEF,
+					 * POWER_PROFILE_NORMAL,
 					 * DEFAULT_INACTIVITY_TIMEOUT
 					 */
 
 #include "mce-log.h"			/* mce_log_open(), mce_log_close(),
+					 * mce_log_start_async(), mce_log_flush(),
 					 * mce_log_set_verbosity(), mce_log(),
 					 * LL_*
 					 */
@@ -106,6 +113,24 @@
 #include "mce-gconf.h"			/* mce_gconf_init(),
 					 * mce_gconf_exit()
 					 */
+#include "mce-io.h"			/* mce_io_quit_async_saves(),
+					 * mce_io_quit_output_writer(),
+					 * mce_sysfs_cache_exit()
+					 */
+#include "mce-power-profile.h"		/* mce_power_profile_get() */
+#include "mce-lib.h"			/* mce_translation_cache_clear(),
+					 * mce_lib_get_time_us()
+					 */
+#include "mce-wakeup.h"			/* mce_wakeup_init(),
+					 * mce_wakeup_exit(),
+					 * mce_wakeup_owner(),
+					 * mce_wakeup_begin(),
+					 * mce_wakeup_account(),
+					 * mce_wakeup_stats_dump()
+					 */
+#include "mce-memstat.h"		/* mce_memstat_exit(),
+					 * mce_memstat_dump()
+					 */
 #include "mce-modules.h"		/* mce_modules_dump_info(),
 					 * mce_modules_init(),
 					 * mce_modules_exit()
@@ -117,7 +142,8 @@
 					 * mce_switches_exit()
 					 */
 #include "datapipe.h"			/* setup_datapipe(),
-					 * free_datapipe()
+					 * free_datapipe(),
+					 * datapipe_trace_replay()
 					 */
 #include "modetransition.h"		/* mce_mode_init(),
 					 * mce_mode_exit()
@@ -130,6 +156,9 @@
 #include "powerkey.h"			/* mce_powerkey_init(),
 					 * mce_powerkey_exit()
 					 */
+#ifdef ENABLE_HYBRIS
+# include "mce-hybris.h"		/* mce_hybris_start_preload() */
+#endif
 #ifdef ENABLE_WAKELOCKS
 # include "libwakelock.h"
 #endif
@@ -165,6 +194,102 @@ static void no_error_check_write(int fd, const void *data, size_t size)
 		rc = rc;
 }
 
+/** Startup trace file; NULL if startup tracing is disabled */
+static FILE *startup_trace_file = NULL;
+
+/** Time mce was started [us, CLOCK_MONOTONIC] */
+static gint64 startup_trace_start = 0;
+
+/**
+ * Record a startup phase in the startup trace
+ *
+ * Each line holds the CLOCK_MONOTONIC time, which is comparable with
+ * the monotonic timestamps reported by systemd-analyze and journalctl,
+ * the time since mce was started and the name of the phase
+ *
+ * @param fmt printf style format for the name of the phase
+ * @param ... Arguments for the format
+ */
+void mce_startup_trace(const char *fmt, ...)
+{
+	gint64 now;
+	va_list va;
+
+	if (startup_trace_file == NULL)
+		goto EXIT;
+
+	now = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	fprintf(startup_trace_file, "%10.6f %10.6f ",
+		now * 1e-6, (now - startup_trace_start) * 1e-6);
+
+	va_start(va, fmt);
+	vfprintf(startup_trace_file, fmt, va);
+	va_end(va);
+
+	fputc('\n', startup_trace_file);
+	fflush(startup_trace_file);
+
+EXIT:
+	return;
+}
+
+/**
+ * Start writing the startup trace
+ *
+ * A trace left over from an earlier run is replaced; the new file
+ * is created exclusively, so that a symlink planted in its place
+ * does not get followed
+ *
+ * @param path The file to write the trace to
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_startup_trace_open(const char *path)
+{
+	gboolean status = FALSE;
+	int fd = -1;
+
+	if ((unlink(path) == -1) && (errno != ENOENT)) {
+		mce_log(LL_ERR, "%s: failed to remove old startup trace; %m",
+			path);
+		goto EXIT;
+	}
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL |
+		       O_NOFOLLOW | O_CLOEXEC, 0600)) == -1) {
+		mce_log(LL_ERR, "%s: failed to open startup trace; %m", path);
+		goto EXIT;
+	}
+
+	if ((startup_trace_file = fdopen(fd, "w")) == NULL) {
+		mce_log(LL_ERR, "%s: failed to open startup trace; %m", path);
+		close(fd);
+		goto EXIT;
+	}
+
+	fprintf(startup_trace_file,
+		"# mce startup trace\n"
+		"# monotonic[s] since-start[s] phase\n");
+	mce_startup_trace("start");
+
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Stop writing the startup trace
+ */
+static void mce_startup_trace_close(void)
+{
+	if (startup_trace_file != NULL) {
+		mce_startup_trace("exit");
+		fclose(startup_trace_file);
+		startup_trace_file = NULL;
+	}
+}
+
 static const char usage_fmt[] =
 "Usage: %s [OPTION]...\n"
 "Mode Control Entity\n"
@@ -180,6 +305,14 @@ static const char usage_fmt[] =
 "  -v, --verbose              increase debug message verbosity\n"
 "  -t, --trace=<what>         enable domain specific debug logging;\n"
 "                               supported values: \"wakelocks\"\n"
+"  -R, --replay-datapipes=<file>\n"
+"                             feed a datapipe trace recorded with\n"
+"                               mcetool --get-datapipe-trace back to the\n"
+"                               datapipes after startup\n"
+"  -P, --trace-startup[=<file>]\n"
+"                             write a timeline of the startup phases\n"
+"                               to <file>; default: "
+DEFAULT_STARTUP_TRACE_FILE "\n"
 "  -h, --help                 display this help and exit\n"
 "  -V, --version              output version information and exit\n"
 "\n"
@@ -265,6 +398,98 @@ void mce_quit_mainloop(void)
 	g_main_loop_quit(mainloop);
 }
 
+/** Activity pulses within this many milliseconds are merged; -1 = unknown */
+static gint activity_window = -1;
+
+/** Timer for the activity merging window */
+static guint activity_window_id = 0;
+
+/** Has activity been merged into the current window? */
+static gboolean activity_pending = FALSE;
+
+/**
+ * Timeout callback for the activity merging window
+ *
+ * @param data Unused
+ * @return TRUE to keep the window open if activity was just sent,
+ *         FALSE to close it
+ */
+static gboolean activity_window_cb(gpointer data)
+{
+	(void)data;
+
+	if (activity_pending == FALSE) {
+		activity_window_id = 0;
+		return FALSE;
+	}
+
+	activity_pending = FALSE;
+
+	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
+			       USE_INDATA, CACHE_INDATA);
+
+	return TRUE;
+}
+
+/**
+ * Generate user activity from input devices
+ *
+ * Runs device_inactive_pipe at most once per activity window;
+ * the power profile may stretch the configured window.
+ * Activity while the device is inactive or the display is not
+ * fully on is always sent immediately, and activity merged into the
+ * window is sent when the window closes
+ */
+void mce_datapipe_generate_activity(void)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	gint window;
+
+	if (activity_window < 0) {
+		activity_window = mce_conf_get_int(MCE_CONF_ACTIVITY_GROUP,
+						   MCE_CONF_ACTIVITY_WINDOW,
+						   DEFAULT_ACTIVITY_WINDOW);
+		if (activity_window < 0)
+			activity_window = 0;
+	}
+
+	if ((activity_window_id != 0) &&
+	    (display_state == MCE_DISPLAY_ON) &&
+	    (datapipe_get_gbool(device_inactive_pipe) == FALSE)) {
+		activity_pending = TRUE;
+		goto EXIT;
+	}
+
+	activity_pending = FALSE;
+
+	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
+			       USE_INDATA, CACHE_INDATA);
+
+	window = MAX(activity_window,
+		     mce_power_profile_get()->activity_window_min);
+
+	if ((window > 0) && (activity_window_id == 0)) {
+		activity_window_id = g_timeout_add(window,
+						   activity_window_cb, NULL);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Cancel the activity merging window
+ */
+static void mce_datapipe_quit_activity(void)
+{
+	if (activity_window_id != 0) {
+		g_source_remove(activity_window_id);
+		activity_window_id = 0;
+	}
+
+	activity_pending = FALSE;
+}
+
 #ifdef ENABLE_WAKELOCKS
 /** Disable automatic suspend and remove wakelocks mce might hold
  *
@@ -302,6 +527,9 @@ static void mce_exit_via_signal(int signr)
 	/* Cancel auto suspend */
 	mce_cleanup_wakelocks();
 #endif
+	/* Best effort attempt to get the buffered messages out */
+	mce_log_flush();
+
 	/* Try to exit via default handler */
 	signal(signr, SIG_DFL);
 	sigaddset(&ss, signr);
@@ -330,7 +558,9 @@ static void signal_handler(const gint signr)
 {
 	switch (signr) {
 	case SIGUSR1:
-		/* We'll probably want some way to communicate with MCE */
+		/* Dump the mainloop wakeup and memory accounting to the log */
+		mce_wakeup_stats_dump();
+		mce_memstat_dump();
 		break;
 
 	case SIGHUP:
@@ -392,6 +622,9 @@ static void install_signal_handlers(void)
 /** Pipe used for transferring signals out of signal handler context */
 static int signal_pipe[2] = {-1, -1};
 
+/** Wakeup accounting for the signal pipe */
+static mce_wakeup_owner_t *signal_pipe_wakeup_owner = 0;
+
 /** GIO callback for reading signals from pipe
  *
  * @param channel   io channel for signal pipe
@@ -406,6 +639,7 @@ static gboolean mce_rx_signal_cb(GIOChannel *channel,
 	// we just want the cb ...
 	(void)channel; (void)condition; (void)data;
 
+	gint64 started = mce_wakeup_begin();
 	int sig = 0;
 	int got = TEMP_FAILURE_RETRY(read(signal_pipe[0], &sig, sizeof sig));
 
@@ -415,6 +649,7 @@ static gboolean mce_rx_signal_cb(GIOChannel *channel,
 
 	/* handle the signal */
 	signal_handler(sig);
+	mce_wakeup_account(signal_pipe_wakeup_owner, started);
 
 	/* keep the io watch */
 	return TRUE;
@@ -503,6 +738,8 @@ static gboolean mce_init_signal_pipe(void)
 	if( (channel = g_io_channel_unix_new(signal_pipe[0])) == 0 )
 		goto EXIT;
 
+	signal_pipe_wakeup_owner = mce_wakeup_owner("signal", "pipe");
+
 	if( !g_io_add_watch(channel, G_IO_IN, mce_rx_signal_cb, 0) )
 		goto EXIT;
 
@@ -753,8 +990,10 @@ int main(int argc, char **argv)
 	gboolean daemonflag = FALSE;
 	gboolean systembus = TRUE;
 	gboolean debugmode = FALSE;
+	const char *replay_path = NULL;
+	const char *startup_trace_path = NULL;
 
-	const char optline[] = "dsTSMDqvhVt:";
+	const char optline[] = "dsTSMDqvhVt:R:P::";
 
 	struct option const options[] = {
 		{ "daemonflag",       no_argument,       0, 'd' },
@@ -768,9 +1007,14 @@ int main(int argc, char **argv)
 		{ "help",             no_argument,       0, 'h' },
 		{ "version",          no_argument,       0, 'V' },
 		{ "trace",            required_argument, 0, 't' },
+		{ "replay-datapipes", required_argument, 0, 'R' },
+		{ "trace-startup",    optional_argument, 0, 'P' },
 		{ 0, 0, 0, 0 }
         };
 
+	/* Take the reference time before doing anything else */
+	startup_trace_start = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
 	/* Initialise support for locales, and set the program-name */
 	if (init_locales(PRG_NAME) != 0)
 		goto EXIT;
@@ -824,6 +1068,12 @@ int main(int argc, char **argv)
 			if( !mce_enable_trace(optarg) )
 				exit(EXIT_FAILURE);
 			break;
+		case 'R':
+			replay_path = optarg;
+			break;
+		case 'P':
+			startup_trace_path = optarg ?: DEFAULT_STARTUP_TRACE_FILE;
+			break;
 		default:
 			usage();
 			exit(EXIT_FAILURE);
@@ -852,12 +1102,26 @@ int main(int argc, char **argv)
 	if (daemonflag == TRUE)
 		daemonize();
 
+	/* Move log output off the mainloop; threads
+	 * do not survive daemonize(), so start it here */
+	mce_log_start_async();
+
+	/* The trace file is opened after daemonizing,
+	 * but the times are relative to the start of mce
+	 */
+	if ((startup_trace_path != NULL) &&
+	    (mce_startup_trace_open(startup_trace_path) == FALSE))
+		exit(EXIT_FAILURE);
+
 	/* Initialise GType system */
 	g_type_init();
 
 	/* Register a mainloop */
 	mainloop = g_main_loop_new(NULL, FALSE);
 
+	/* Account the mainloop wakeups from the start */
+	mce_wakeup_init();
+
 	/* Signal handlers can be installed once we have a mainloop */
 	if( !mce_init_signal_pipe() ) {
 		mce_log(LL_CRIT, "Failed to initialise signal pipe");
@@ -873,6 +1137,15 @@ int main(int argc, char **argv)
 			"Failed to initialise configuration options");
 		exit(EXIT_FAILURE);
 	}
+	mce_startup_trace("conf");
+
+#ifdef ENABLE_HYBRIS
+	/* Start loading the hybris plugin while the rest of
+	 * mce is being initialised
+	 * pre-requisite: mce_conf_init()
+	 */
+	mce_hybris_start_preload();
+#endif
 
 	/* Initialise D-Bus */
 	if (mce_dbus_init(systembus) == FALSE) {
@@ -881,6 +1154,7 @@ int main(int argc, char **argv)
 		mce_log_close();
 		exit(EXIT_FAILURE);
 	}
+	mce_startup_trace("dbus");
 
 	/* Initialise GConf
 	 * pre-requisite: g_type_init()
@@ -891,71 +1165,110 @@ int main(int argc, char **argv)
 		mce_log_close();
 		exit(EXIT_FAILURE);
 	}
+	mce_startup_trace("gconf");
 
 	/* Setup all datapipes */
-	setup_datapipe(&system_state_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&system_state_pipe, "system_state",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(MCE_STATE_UNDEF));
-	setup_datapipe(&master_radio_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&master_radio_pipe, "master_radio",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&call_state_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&call_state_pipe, "call_state",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(CALL_STATE_NONE));
-	setup_datapipe(&call_type_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&call_type_pipe, "call_type",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(NORMAL_CALL));
-	setup_datapipe(&alarm_ui_state_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&alarm_ui_state_pipe, "alarm_ui_state",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(MCE_ALARM_UI_INVALID_INT32));
-	setup_datapipe(&submode_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&submode_pipe, "submode",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(MCE_NORMAL_SUBMODE));
-	setup_datapipe(&display_state_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&display_state_pipe, "display_state",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(MCE_DISPLAY_UNDEF));
-	setup_datapipe(&display_brightness_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&display_brightness_pipe, "display_brightness",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&led_brightness_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&led_brightness_pipe, "led_brightness",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&led_pattern_activate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&led_pattern_activate_pipe, "led_pattern_activate",
+		       READ_ONLY, FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, NULL);
-	setup_datapipe(&led_pattern_deactivate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&led_pattern_deactivate_pipe, "led_pattern_deactivate",
+		       READ_ONLY, FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, NULL);
-	setup_datapipe(&key_backlight_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&key_backlight_pipe, "key_backlight",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&keypress_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&keypress_pipe, "keypress",
+		       READ_ONLY, FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       sizeof (struct input_event), NULL);
-	setup_datapipe(&touchscreen_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&touchscreen_pipe, "touchscreen",
+		       READ_ONLY, FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       sizeof (struct input_event), NULL);
-	setup_datapipe(&device_inactive_pipe, READ_WRITE, DONT_FREE_CACHE,
+	setup_datapipe(&device_inactive_pipe, "device_inactive",
+		       READ_WRITE, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(FALSE));
-	setup_datapipe(&lockkey_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&lockkey_pipe, "lockkey",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&keyboard_slide_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&keyboard_slide_pipe, "keyboard_slide",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&lid_cover_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&lid_cover_pipe, "lid_cover",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&lens_cover_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&lens_cover_pipe, "lens_cover",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&proximity_sensor_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&proximity_sensor_pipe, "proximity_sensor",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&tk_lock_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&tk_lock_pipe, "tk_lock",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(LOCK_UNDEF));
-	setup_datapipe(&charger_state_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&charger_state_pipe, "charger_state",
+		       READ_ONLY, DONT_FREE_CACHE, SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&battery_status_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&battery_status_pipe, "battery_status",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(BATTERY_STATUS_UNDEF));
-	setup_datapipe(&battery_level_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&battery_level_pipe, "battery_level",
+		       READ_ONLY, DONT_FREE_CACHE, SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(100));
-	setup_datapipe(&camera_button_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&camera_button_pipe, "camera_button",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(CAMERA_BUTTON_UNDEF));
-	setup_datapipe(&inactivity_timeout_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&inactivity_timeout_pipe, "inactivity_timeout",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(DEFAULT_INACTIVITY_TIMEOUT));
-	setup_datapipe(&audio_route_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&audio_route_pipe, "audio_route",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(AUDIO_ROUTE_UNDEF));
-	setup_datapipe(&usb_cable_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&usb_cable_pipe, "usb_cable",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&jack_sense_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&jack_sense_pipe, "jack_sense",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&power_saving_mode_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&power_saving_mode_pipe, "power_saving_mode",
+		       READ_ONLY, DONT_FREE_CACHE, SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&thermal_state_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&thermal_state_pipe, "thermal_state",
+		       READ_ONLY, DONT_FREE_CACHE, SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(THERMAL_STATE_UNDEF));
-	setup_datapipe(&heartbeat_pipe, READ_ONLY, DONT_FREE_CACHE,
+	setup_datapipe(&power_profile_pipe, "power_profile",
+		       READ_ONLY, DONT_FREE_CACHE, SUPPRESS_UNCHANGED,
+		       0, GINT_TO_POINTER(POWER_PROFILE_NORMAL));
+	setup_datapipe(&heartbeat_pipe, "heartbeat",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
+		       0, GINT_TO_POINTER(0));
+	setup_datapipe(&display_prewake_pipe, "display_prewake",
+		       READ_ONLY, DONT_FREE_CACHE, DONT_SUPPRESS_UNCHANGED,
 		       0, GINT_TO_POINTER(0));
 
 	/* Initialise mode management
@@ -977,6 +1290,7 @@ int main(int argc, char **argv)
 			goto EXIT;
 		}
 	}
+	mce_startup_trace("dsme");
 
 	/* Initialise powerkey driver */
 	if (mce_powerkey_init() == FALSE) {
@@ -989,6 +1303,7 @@ int main(int argc, char **argv)
 	if (mce_input_init() == FALSE) {
 		goto EXIT;
 	}
+	mce_startup_trace("input");
 
 	/* Initialise switch driver */
 	if (mce_switches_init() == FALSE) {
@@ -999,6 +1314,7 @@ int main(int argc, char **argv)
 	if (mce_tklock_init() == FALSE) {
 		goto EXIT;
 	}
+	mce_startup_trace("tklock");
 
 	/* Load all modules */
 	if (mce_modules_init() == FALSE) {
@@ -1010,8 +1326,15 @@ int main(int argc, char **argv)
 		goto EXIT;
 	}
 
+	/* Start feeding a recorded trace to the datapipes */
+	if ((replay_path != NULL) &&
+	    (datapipe_trace_replay(replay_path) == FALSE)) {
+		goto EXIT;
+	}
+
 	/* MCE startup succeeded */
 	status = EXIT_SUCCESS;
+	mce_startup_trace("mainloop");
 
 	/* Run the main loop */
 	g_main_loop_run(mainloop);
@@ -1023,6 +1346,9 @@ EXIT:
 	/* Unload all modules */
 	mce_modules_exit();
 
+	/* The translation tables of the modules are gone */
+	mce_translation_cache_clear();
+
 	/* Call the exit function for all components */
 	mce_tklock_exit();
 	mce_switches_exit();
@@ -1031,7 +1357,11 @@ EXIT:
 	mce_dsme_exit();
 	mce_mode_exit();
 
+	mce_datapipe_quit_activity();
+
 	/* Free all datapipes */
+	free_datapipe(&display_prewake_pipe);
+	free_datapipe(&power_profile_pipe);
 	free_datapipe(&thermal_state_pipe);
 	free_datapipe(&power_saving_mode_pipe);
 	free_datapipe(&jack_sense_pipe);
@@ -1066,15 +1396,31 @@ EXIT:
 
 	/* Call the exit function for all subsystems */
 	mce_gconf_exit();
+
+	/* Make sure pending settings reach the disk */
+	mce_io_quit_async_saves();
+
+	/* Stop the hardware output writer */
+	mce_io_quit_output_writer();
+
+	/* Close the cached sysfs attributes */
+	mce_sysfs_cache_exit();
 	mce_dbus_exit();
 	mce_conf_exit();
 
+	mce_wakeup_exit();
+
+	/* Releases made after this are not accounted */
+	mce_memstat_exit();
+
 	/* If the mainloop is initialised, unreference it */
 	if (mainloop != NULL) {
 		g_main_loop_unref(mainloop);
 		mainloop = 0;
 	}
 
+	mce_startup_trace_close();
+
 	/* Log a farewell message and close the log */
 	mce_log(LL_INFO, "Exiting...");
 
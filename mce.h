@@ -260,6 +260,16 @@ typedef enum {
 	THERMAL_STATE_OVERHEATED = 1,
 } thermal_state_t;
 
+/** Power profile; selects the runtime costs mce allows itself */
+typedef enum {
+	/** Normal operation */
+	POWER_PROFILE_NORMAL = 0,
+	/** Power saving mode is active */
+	POWER_PROFILE_POWERSAVE = 1,
+	/** The device is overheated */
+	POWER_PROFILE_THERMAL = 2,
+} power_profile_t;
+
 /** LED brightness */
 datapipe_struct led_brightness_pipe;
 /** State of device; read only */
@@ -326,8 +336,12 @@ datapipe_struct jack_sense_pipe;
 datapipe_struct power_saving_mode_pipe;
 /** Thermal state; read only */
 datapipe_struct thermal_state_pipe;
+/** Power profile; read only */
+datapipe_struct power_profile_pipe;
 /** Heartbeat; read only */
 datapipe_struct heartbeat_pipe;
+/** Hint that the display is likely to be unblanked soon; read only */
+datapipe_struct display_prewake_pipe;
 
 /* XXX: use HAL */
 /** Does the device have a flicker key? */
@@ -342,11 +356,30 @@ extern gboolean has_flicker_key;
  */
 #define DEFAULT_INACTIVITY_TIMEOUT	33
 
+/** Name of Activity configuration group */
+#define MCE_CONF_ACTIVITY_GROUP		"Activity"
+
+/** Name of the configuration key for the activity merging window */
+#define MCE_CONF_ACTIVITY_WINDOW	"PulseWindow"
+
+/** Default activity merging window, in milliseconds */
+#define DEFAULT_ACTIVITY_WINDOW		250
+
+/** Default file for the --trace-startup timeline */
+#define DEFAULT_STARTUP_TRACE_FILE	G_STRINGIFY(MCE_RUN_DIR) "/startup.trace"
+
 submode_t mce_get_submode_int32(void);
 gboolean mce_add_submode_int32(const submode_t submode);
 gboolean mce_rem_submode_int32(const submode_t submode);
+submode_t mce_get_submode_changes(void);
+void mce_submode_begin(void);
+void mce_submode_commit(void);
 
 void mce_abort(void) __attribute__((noreturn));
 void mce_quit_mainloop(void);
 
+void mce_datapipe_generate_activity(void);
+
+void mce_startup_trace(const char *fmt, ...) G_GNUC_PRINTF(1, 2);
+
 #endif /* _MCE_H_ */
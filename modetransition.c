@@ -53,6 +53,44 @@
 					 * remove_output_trigger_from_datapipe()
 					 */
 
+/** Nesting depth of submode transactions */
+static gint submode_transaction_depth = 0;
+
+/** Whether submode_pipe is being executed */
+static gboolean submode_flushing = FALSE;
+
+/** Submode to hand to submode_pipe; valid during transaction / flush */
+static submode_t submode_target = MCE_NORMAL_SUBMODE;
+
+/** Submode bits changed by the latest submode_pipe execution */
+static submode_t submode_changes = 0;
+
+/**
+ * Execute submode_pipe until it matches the target submode
+ *
+ * Changes made by submode triggers are not executed recursively;
+ * they are collected and handed to the pipe after all triggers
+ * have seen the current change
+ */
+static void mce_submode_flush(void)
+{
+	submode_t old_submode;
+
+	submode_flushing = TRUE;
+
+	while ((old_submode = datapipe_get_gint(submode_pipe)) !=
+	       submode_target) {
+		submode_t submode = submode_target;
+
+		submode_changes = old_submode ^ submode;
+		execute_datapipe(&submode_pipe, GINT_TO_POINTER(submode),
+				 USE_INDATA, CACHE_INDATA);
+		mce_log(LL_DEBUG, "Submode changed to %d", submode);
+	}
+
+	submode_flushing = FALSE;
+}
+
 /**
  * Set the MCE submode flags
  *
@@ -61,14 +99,12 @@
  */
 static gboolean mce_set_submode_int32(const submode_t submode)
 {
-	submode_t old_submode = datapipe_get_gint(submode_pipe);
+	submode_target = submode;
 
-	if (old_submode == submode)
+	if ((submode_transaction_depth > 0) || (submode_flushing == TRUE))
 		goto EXIT;
 
-	execute_datapipe(&submode_pipe, GINT_TO_POINTER(submode),
-			 USE_INDATA, CACHE_INDATA);
-	mce_log(LL_DEBUG, "Submode changed to %d", submode);
+	mce_submode_flush();
 
 EXIT:
 	return TRUE;
@@ -82,7 +118,7 @@ EXIT:
  */
 gboolean mce_add_submode_int32(const submode_t submode)
 {
-	submode_t old_submode = datapipe_get_gint(submode_pipe);
+	submode_t old_submode = mce_get_submode_int32();
 
 	return mce_set_submode_int32(old_submode | submode);
 }
@@ -95,7 +131,7 @@ gboolean mce_add_submode_int32(const submode_t submode)
  */
 gboolean mce_rem_submode_int32(const submode_t submode)
 {
-	submode_t old_submode = datapipe_get_gint(submode_pipe);
+	submode_t old_submode = mce_get_submode_int32();
 
 	return mce_set_submode_int32(old_submode & ~submode);
 }
@@ -103,6 +139,9 @@ gboolean mce_rem_submode_int32(const submode_t submode)
 /**
  * Return all set MCE submode flags
  *
+ * Inside a submode transaction this includes the changes
+ * that have not been committed yet
+ *
  * @return All set submode flags OR:ed together
  */
 submode_t mce_get_submode_int32(void) G_GNUC_PURE;
@@ -110,9 +149,65 @@ submode_t mce_get_submode_int32(void)
 {
 	submode_t submode = datapipe_get_gint(submode_pipe);
 
+	if ((submode_transaction_depth > 0) || (submode_flushing == TRUE))
+		submode = submode_target;
+
 	return submode;
 }
 
+/**
+ * Return the submode flags changed by the latest submode_pipe execution
+ *
+ * Meant for submode_pipe triggers, which can use this
+ * to react only to the bits they are interested in
+ *
+ * @return Changed submode flags OR:ed together
+ */
+submode_t mce_get_submode_changes(void)
+{
+	return submode_changes;
+}
+
+/**
+ * Start a submode transaction
+ *
+ * Submode changes made until the matching mce_submode_commit()
+ * are combined into one submode_pipe execution;
+ * transactions can be nested
+ */
+void mce_submode_begin(void)
+{
+	if ((submode_transaction_depth == 0) && (submode_flushing == FALSE))
+		submode_target = datapipe_get_gint(submode_pipe);
+
+	submode_transaction_depth++;
+}
+
+/**
+ * Finish a submode transaction
+ *
+ * When the outermost transaction is committed, submode_pipe is
+ * executed once, if the submode changed at all
+ */
+void mce_submode_commit(void)
+{
+	if (submode_transaction_depth <= 0) {
+		mce_log(LL_ERR, "Submode commit without a transaction");
+		goto EXIT;
+	}
+
+	if (--submode_transaction_depth > 0)
+		goto EXIT;
+
+	if (submode_flushing == TRUE)
+		goto EXIT;
+
+	mce_submode_flush();
+
+EXIT:
+	return;
+}
+
 /**
  * Handle system state change
  *
@@ -187,6 +282,9 @@ gboolean mce_mode_init(void)
 	append_output_trigger_to_datapipe(&system_state_pipe,
 					  system_state_trigger);
 
+	/* Report the bootup submodes with one submode change */
+	mce_submode_begin();
+
 	/* If the bootup file exists, mce has crashed / restarted;
 	 * since it exists in /var/run it will be removed when we reboot.
 	 *
@@ -238,6 +336,8 @@ gboolean mce_mode_init(void)
 	status = TRUE;
 
 EXIT:
+	mce_submode_commit();
+
 	return status;
 }
 
@@ -83,9 +83,173 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 100
 };
 
+/** Delay for merging bursts of BME signals [ms] */
+#define BATTERY_UPDATE_DELAY		50
+
 /** Cached value of the charger connected state */
 static gint cached_charger_connected = -1;
 
+/** Aggregated battery and charger state */
+typedef struct {
+	/** Battery status; BATTERY_STATUS_UNDEF if not known */
+	battery_status_t status;
+	/** Battery level [%]; -1 if not known */
+	gint level;
+	/** Charger state; -1 if not known */
+	gint charger;
+	/** Battery full LED pattern state; -1 if not known */
+	gint led_full;
+	/** Battery charging LED pattern state; -1 if not known */
+	gint led_charging;
+	/** Flag: a signal asked for user activity to be generated */
+	gboolean activity;
+} battery_state_t;
+
+/** Initializer for battery_state_t; everything unknown */
+#define BATTERY_STATE_INIT { \
+	.status = BATTERY_STATUS_UNDEF, \
+	.level = -1, \
+	.charger = -1, \
+	.led_full = -1, \
+	.led_charging = -1, \
+	.activity = FALSE, \
+}
+
+/** State as reported by BME signals since the last update */
+static battery_state_t pending_state = BATTERY_STATE_INIT;
+
+/** State as last propagated to the datapipes */
+static battery_state_t applied_state = BATTERY_STATE_INIT;
+
+/** Timer for the aggregated state update; 0 if not active */
+static guint battery_update_id = 0;
+
+/**
+ * Update LED pattern state if it has changed
+ *
+ * @param pattern The name of the LED pattern
+ * @param want The requested state; -1 if unchanged
+ * @param have Pointer to the applied state
+ */
+static void battery_update_led(const gchar *pattern, gint want, gint *have)
+{
+	if ((want == -1) || (want == *have))
+		goto EXIT;
+
+	*have = want;
+
+	execute_datapipe_output_triggers(want ?
+					 &led_pattern_activate_pipe :
+					 &led_pattern_deactivate_pipe,
+					 pattern, USE_INDATA);
+
+EXIT:
+	return;
+}
+
+/**
+ * Propagate the aggregated battery and charger state
+ *
+ * Datapipes are executed only for values that actually
+ * changed since the last update
+ */
+static void battery_update_state(void)
+{
+	battery_state_t *want = &pending_state;
+	battery_state_t *have = &applied_state;
+
+	if ((want->charger != -1) &&
+	    (want->charger != datapipe_get_gbool(charger_state_pipe))) {
+		mce_log(LL_DEBUG, "charger: %d -> %d",
+			have->charger, want->charger);
+		execute_datapipe(&charger_state_pipe,
+				 GINT_TO_POINTER(want->charger),
+				 USE_INDATA, CACHE_INDATA);
+	}
+	have->charger = want->charger;
+
+	if ((want->status != BATTERY_STATUS_UNDEF) &&
+	    (want->status != have->status)) {
+		mce_log(LL_DEBUG, "battery status: %d -> %d",
+			have->status, want->status);
+		have->status = want->status;
+		execute_datapipe(&battery_status_pipe,
+				 GINT_TO_POINTER(have->status),
+				 USE_INDATA, CACHE_INDATA);
+	}
+
+	if ((want->level != -1) && (want->level != have->level)) {
+		mce_log(LL_DEBUG, "battery level: %d -> %d",
+			have->level, want->level);
+		have->level = want->level;
+		execute_datapipe(&battery_level_pipe,
+				 GINT_TO_POINTER(have->level),
+				 USE_INDATA, CACHE_INDATA);
+	}
+
+	/* Switch patterns off before switching others on */
+	if (want->led_full == FALSE)
+		battery_update_led(MCE_LED_PATTERN_BATTERY_FULL,
+				   want->led_full, &have->led_full);
+	if (want->led_charging == FALSE)
+		battery_update_led(MCE_LED_PATTERN_BATTERY_CHARGING,
+				   want->led_charging, &have->led_charging);
+
+	battery_update_led(MCE_LED_PATTERN_BATTERY_FULL,
+			   want->led_full, &have->led_full);
+	battery_update_led(MCE_LED_PATTERN_BATTERY_CHARGING,
+			   want->led_charging, &have->led_charging);
+
+	if (want->activity == TRUE) {
+		want->activity = FALSE;
+
+		/* Generate activity */
+		(void)execute_datapipe(&device_inactive_pipe,
+				       GINT_TO_POINTER(FALSE),
+				       USE_INDATA, CACHE_INDATA);
+	}
+}
+
+/**
+ * Timeout callback for the aggregated state update
+ *
+ * @param data Unused
+ * @return Always returns FALSE to disable the timeout
+ */
+static gboolean battery_update_cb(gpointer data)
+{
+	(void)data;
+
+	battery_update_id = 0;
+	battery_update_state();
+
+	return FALSE;
+}
+
+/**
+ * Schedule propagation of the aggregated state
+ *
+ * The timer is not restarted by further signals, so that a
+ * steady stream of signals can not postpone the update
+ */
+static void battery_schedule_update(void)
+{
+	if (battery_update_id == 0)
+		battery_update_id = g_timeout_add(BATTERY_UPDATE_DELAY,
+						  battery_update_cb, NULL);
+}
+
+/**
+ * Cancel pending propagation of the aggregated state
+ */
+static void battery_cancel_update(void)
+{
+	if (battery_update_id != 0) {
+		g_source_remove(battery_update_id);
+		battery_update_id = 0;
+	}
+}
+
 /**
  * D-Bus callback for the battery full signal
  *
@@ -101,12 +265,11 @@ static gboolean battery_full_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received battery full signal");
 
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
-	execute_datapipe_output_triggers(&led_pattern_activate_pipe, MCE_LED_PATTERN_BATTERY_FULL, USE_INDATA);
+	pending_state.status = BATTERY_STATUS_FULL;
+	pending_state.led_charging = FALSE;
+	pending_state.led_full = TRUE;
 
-	execute_datapipe(&battery_status_pipe,
-			 GINT_TO_POINTER(BATTERY_STATUS_FULL),
-			 USE_INDATA, CACHE_INDATA);
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -129,11 +292,9 @@ static gboolean battery_ok_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received battery ok signal");
 
-//	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_LOW, USE_INDATA);
+	pending_state.status = BATTERY_STATUS_OK;
 
-	execute_datapipe(&battery_status_pipe,
-			 GINT_TO_POINTER(BATTERY_STATUS_OK),
-			 USE_INDATA, CACHE_INDATA);
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -156,11 +317,9 @@ static gboolean battery_low_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received battery low signal");
 
-//	execute_datapipe_output_triggers(&led_pattern_activate_pipe, MCE_LED_PATTERN_BATTERY_LOW, USE_INDATA);
+	pending_state.status = BATTERY_STATUS_LOW;
 
-	execute_datapipe(&battery_status_pipe,
-			 GINT_TO_POINTER(BATTERY_STATUS_LOW),
-			 USE_INDATA, CACHE_INDATA);
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -183,9 +342,9 @@ static gboolean battery_empty_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received battery empty signal");
 
-	execute_datapipe(&battery_status_pipe,
-			 GINT_TO_POINTER(BATTERY_STATUS_EMPTY),
-			 USE_INDATA, CACHE_INDATA);
+	pending_state.status = BATTERY_STATUS_EMPTY;
+
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -270,9 +429,8 @@ static gboolean battery_state_changed_dbus_cb(DBusMessage *const msg)
 		"Percentage: %d",
 		percentage);
 
-	execute_datapipe(&battery_level_pipe,
-			 GINT_TO_POINTER(percentage),
-			 USE_INDATA, CACHE_INDATA);
+	pending_state.level = percentage;
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -288,7 +446,6 @@ EXIT:
  */
 static gboolean charger_charging_on_dbus_cb(DBusMessage *const msg)
 {
-	gboolean old_charger_state = datapipe_get_gbool(charger_state_pipe);
 	gboolean status = FALSE;
 
 	(void)msg;
@@ -296,17 +453,11 @@ static gboolean charger_charging_on_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received charger_charging_on signal");
 
-	/* Only update the charger state if needed */
-	if (old_charger_state == FALSE) {
-		execute_datapipe(&charger_state_pipe, GINT_TO_POINTER(TRUE),
-				 USE_INDATA, CACHE_INDATA);
-	}
-
-	/* In case these are active; there's no harm to call them anyway */
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_FULL, USE_INDATA);
-//	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_LOW, USE_INDATA);
+	pending_state.charger = TRUE;
+	pending_state.led_full = FALSE;
+	pending_state.led_charging = TRUE;
 
-	execute_datapipe_output_triggers(&led_pattern_activate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -322,7 +473,6 @@ static gboolean charger_charging_on_dbus_cb(DBusMessage *const msg)
  */
 static gboolean charger_charging_off_dbus_cb(DBusMessage *const msg)
 {
-	gboolean old_charger_state = datapipe_get_gbool(charger_state_pipe);
 	gboolean status = FALSE;
 
 	(void)msg;
@@ -330,14 +480,10 @@ static gboolean charger_charging_off_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received charger_charging_off signal");
 
-	/* Only update the charger state if needed */
-	if (old_charger_state == TRUE) {
-		execute_datapipe(&charger_state_pipe, GINT_TO_POINTER(FALSE),
-				 USE_INDATA, CACHE_INDATA);
-	}
+	pending_state.charger = FALSE;
+	pending_state.led_charging = FALSE;
 
-	/* In case these are active; there's no harm to call them anyway */
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -353,7 +499,6 @@ static gboolean charger_charging_off_dbus_cb(DBusMessage *const msg)
  */
 static gboolean charger_charging_failed_dbus_cb(DBusMessage *const msg)
 {
-	gboolean old_charger_state = datapipe_get_gbool(charger_state_pipe);
 	gboolean status = FALSE;
 
 	(void)msg;
@@ -361,19 +506,14 @@ static gboolean charger_charging_failed_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received charger_charging_failed signal");
 
-	/* Only update the charger state if needed */
-	if (old_charger_state == TRUE) {
-		execute_datapipe(&charger_state_pipe, GINT_TO_POINTER(FALSE),
-				 USE_INDATA, CACHE_INDATA);
-	}
-
-	/* In case these are active; there's no harm to call them anyway */
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_FULL, USE_INDATA);
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
+	pending_state.charger = FALSE;
+	pending_state.led_full = FALSE;
+	pending_state.led_charging = FALSE;
 
 	/* Generate activity */
-	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-			       USE_INDATA, CACHE_INDATA);
+	pending_state.activity = TRUE;
+
+	battery_schedule_update();
 
 	status = TRUE;
 
@@ -398,12 +538,12 @@ static gboolean charger_connected_dbus_cb(DBusMessage *const msg)
 
 	if (cached_charger_connected != 1) {
 		/* Generate activity */
-		(void)execute_datapipe(&device_inactive_pipe,
-				       GINT_TO_POINTER(FALSE),
-				       USE_INDATA, CACHE_INDATA);
+		pending_state.activity = TRUE;
 		cached_charger_connected = 1;
 	}
 
+	battery_schedule_update();
+
 	status = TRUE;
 
 //EXIT:
@@ -418,7 +558,6 @@ static gboolean charger_connected_dbus_cb(DBusMessage *const msg)
  */
 static gboolean charger_disconnected_dbus_cb(DBusMessage *const msg)
 {
-	gboolean old_charger_state = datapipe_get_gbool(charger_state_pipe);
 	gboolean status = FALSE;
 
 	(void)msg;
@@ -426,24 +565,18 @@ static gboolean charger_disconnected_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG,
 		"Received charger_disconnected signal");
 
-	/* Only update the charger state if needed */
-	if (old_charger_state == TRUE) {
-		execute_datapipe(&charger_state_pipe, GINT_TO_POINTER(FALSE),
-				 USE_INDATA, CACHE_INDATA);
-	}
-
-	/* In case these are active; there's no harm to call them anyway */
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_FULL, USE_INDATA);
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
+	pending_state.charger = FALSE;
+	pending_state.led_full = FALSE;
+	pending_state.led_charging = FALSE;
 
 	if (cached_charger_connected != 0) {
 		/* Generate activity */
-		(void)execute_datapipe(&device_inactive_pipe,
-				       GINT_TO_POINTER(FALSE),
-				       USE_INDATA, CACHE_INDATA);
+		pending_state.activity = TRUE;
 		cached_charger_connected = 0;
 	}
 
+	battery_schedule_update();
+
 	status = TRUE;
 
 //EXIT:
@@ -573,5 +706,7 @@ void g_module_unload(GModule *module)
 {
 	(void)module;
 
+	battery_cancel_update();
+
 	return;
 }
@@ -138,8 +138,19 @@ static GSList *call_state_monitor_list = NULL;
 /** Keep track of whether call state is monitored */
 static gboolean call_state_is_monitored = FALSE;
 
-/** Reference counter for number of active calls */
-static unsigned char num_of_active_calls = 0;
+/** State of one ofono voice call */
+typedef struct {
+	/** Call state derived from the ofono State property */
+	call_state_t state;
+	/** Value of the ofono Emergency property */
+	gboolean emergency;
+} ofono_call_t;
+
+/** Tracked ofono calls; D-Bus object path -> ofono_call_t */
+static GHashTable *ofono_calls = NULL;
+
+/** ID for the call state recomputing idle callback */
+static guint ofono_calls_update_id = 0;
 
 /**
  * Send the call state and type
@@ -467,26 +478,174 @@ EXIT:
 	return status;
 }
 
+/**
+ * Get the rank of a call state when combining the states of calls
+ *
+ * @param state The call state
+ * @return The rank; a higher rank takes precedence
+ */
+static gint ofono_call_state_rank(call_state_t state)
+{
+	gint rank = 0;
+
+	switch (state) {
+	case CALL_STATE_RINGING:
+		rank = 2;
+		break;
+
+	case CALL_STATE_ACTIVE:
+		rank = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return rank;
+}
+
+/**
+ * Recompute the call state from the tracked ofono calls
+ *
+ * The datapipes are executed only if the result differs
+ * from their current contents
+ */
+static void ofono_calls_evaluate(void)
+{
+	call_state_t old_call_state = datapipe_get_gint(call_state_pipe);
+	call_type_t old_call_type = datapipe_get_gint(call_type_pipe);
+	call_state_t call_state = CALL_STATE_NONE;
+	call_type_t call_type = NORMAL_CALL;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, ofono_calls);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value) == TRUE) {
+		const ofono_call_t *call = value;
+
+		if (ofono_call_state_rank(call->state) >
+		    ofono_call_state_rank(call_state))
+			call_state = call->state;
+
+		if (call->emergency == TRUE)
+			call_type = EMERGENCY_CALL;
+	}
+
+	if ((call_state == old_call_state) && (call_type == old_call_type))
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "ofono calls: %u; call state %i:%i -> %i:%i",
+		g_hash_table_size(ofono_calls),
+		old_call_state, old_call_type, call_state, call_type);
+
+	(void)execute_datapipe(&call_state_pipe,
+			       GINT_TO_POINTER(call_state),
+			       USE_INDATA, CACHE_INDATA);
+
+	(void)execute_datapipe(&call_type_pipe,
+			       GINT_TO_POINTER(call_type),
+			       USE_INDATA, CACHE_INDATA);
+
+EXIT:
+	return;
+}
+
+/**
+ * Idle callback for recomputing the call state
+ *
+ * @param data Unused
+ * @return Always returns FALSE to disable the idle callback
+ */
+static gboolean ofono_calls_update_cb(gpointer data)
+{
+	(void)data;
+
+	ofono_calls_update_id = 0;
+	ofono_calls_evaluate();
+
+	return FALSE;
+}
+
+/**
+ * Schedule recomputing of the call state
+ *
+ * All ofono signals already queued get handled before the call
+ * state is recomputed; the high priority keeps the delay short
+ * since call setup is latency critical
+ */
+static void ofono_calls_schedule_update(void)
+{
+	if (ofono_calls_update_id == 0)
+		ofono_calls_update_id =
+			g_idle_add_full(G_PRIORITY_HIGH,
+					ofono_calls_update_cb, NULL, NULL);
+}
+
+/**
+ * Get the tracked state of an ofono call
+ *
+ * @param path The D-Bus object path of the call
+ * @return The call state, created if not tracked yet
+ */
+static ofono_call_t *ofono_call_get(const gchar *path)
+{
+	ofono_call_t *call = g_hash_table_lookup(ofono_calls, path);
+
+	if (call == NULL) {
+		call = g_slice_new0(ofono_call_t);
+		call->state = CALL_STATE_NONE;
+		call->emergency = FALSE;
+		g_hash_table_insert(ofono_calls, g_strdup(path), call);
+		mce_log(LL_DEBUG, "tracking ofono call %s", path);
+	}
+
+	return call;
+}
+
+/**
+ * Stop tracking an ofono call
+ *
+ * @param path The D-Bus object path of the call
+ * @return TRUE if the call was tracked, FALSE otherwise
+ */
+static gboolean ofono_call_remove(const gchar *path)
+{
+	gboolean removed = g_hash_table_remove(ofono_calls, path);
+
+	if (removed == TRUE)
+		mce_log(LL_DEBUG, "forgetting ofono call %s", path);
+
+	return removed;
+}
+
+/**
+ * Free the tracked state of an ofono call
+ *
+ * @param data The ofono_call_t to free
+ */
+static void ofono_call_free(gpointer data)
+{
+	g_slice_free(ofono_call_t, data);
+}
+
 /**
  * Parses an ofono property message from given iterator.
  *
- * Actions related to the property are done.
+ * The property is stored in the tracked state of the call.
  *
+ * @param call The tracked state of the call
  * @param it Iterator to ofono property.
  * @return TRUE on success, FALSE on failure.
  */
-static gboolean ofono_handle_call_property(DBusMessageIter *it)
+static gboolean ofono_handle_call_property(ofono_call_t *call,
+					   DBusMessageIter *it)
 {
 	gboolean status = FALSE;
-	gboolean call_state_changed = FALSE;
 	DBusMessageIter varit;
 	gchar *propname;
 	gchar *prop_value_str;
-	gboolean prop_value_bool;
-	call_state_t old_call_state = datapipe_get_gint(call_state_pipe);
-	call_type_t old_call_type = datapipe_get_gint(call_type_pipe);
-	call_state_t call_state = old_call_state;
-	call_type_t call_type = old_call_type;
+	dbus_bool_t prop_value_bool;
 
 	if (dbus_message_iter_get_arg_type(it) != DBUS_TYPE_STRING) {
 		mce_log(LL_WARN, "Parsing failure with ofono signal");
@@ -512,24 +671,12 @@ static gboolean ofono_handle_call_property(DBusMessageIter *it)
 
 		if (!strcmp(prop_value_str, "incoming") ||
 		    !strcmp(prop_value_str, "dialing")) {
-			num_of_active_calls += 1;
-			call_state = CALL_STATE_RINGING;
+			call->state = CALL_STATE_RINGING;
 		} else if (!strcmp(prop_value_str, "disconnected")) {
-			num_of_active_calls -= 1;
-            /* Only set state to NONE if there are no remaining calls.
-             * This information could also be verified from ofono if
-             * some dbus signals are expected to go missing. */
-			if (num_of_active_calls <= 0) {
-				num_of_active_calls = 0;
-				call_state = CALL_STATE_NONE;
-			}
+			call->state = CALL_STATE_NONE;
 		} else {
-			call_state = CALL_STATE_ACTIVE;
+			call->state = CALL_STATE_ACTIVE;
 		}
-
-		if (old_call_state != call_state)
-			call_state_changed = TRUE;
-
 	} else if (!strcmp(propname, "Emergency")) {
 		if (dbus_message_iter_get_arg_type(&varit) != DBUS_TYPE_BOOLEAN) {
 			mce_log(LL_WARN, "Parsing failure with ofono signal");
@@ -537,51 +684,57 @@ static gboolean ofono_handle_call_property(DBusMessageIter *it)
 		}
 		dbus_message_iter_get_basic(&varit, (void *)&prop_value_bool);
 
-		if (prop_value_bool) {
-			call_type = EMERGENCY_CALL;
-		} else {
-			call_type = NORMAL_CALL;
-		}
-
-		if (old_call_type != call_type)
-			call_state_changed = TRUE;
-
+		call->emergency = prop_value_bool ? TRUE : FALSE;
 	} else {
 		mce_log(LL_DEBUG,
 		        "No handling for property '%s' from ofono", propname);
 	}
 
-	if (call_state_changed) {
-		(void)execute_datapipe(&call_state_pipe,
-					   GINT_TO_POINTER(call_state),
-					   USE_INDATA, CACHE_INDATA);
-
-		(void)execute_datapipe(&call_type_pipe,
-					   GINT_TO_POINTER(call_type),
-					   USE_INDATA, CACHE_INDATA);
-	}
-
 	status = TRUE;
 EXIT:
 	return status;
 }
 
+/**
+ * Update the tracked state of an ofono call
+ *
+ * The call state is recomputed only if the call changed;
+ * calls that have ended, or were created for an unknown path
+ * without a call state, are no longer tracked
+ *
+ * @param path The D-Bus object path of the call
+ * @param call The tracked state of the call, after the update;
+ *             not valid after the call
+ * @param old The tracked state of the call, before the update
+ */
+static void ofono_call_changed(const gchar *path, const ofono_call_t *call,
+			       const ofono_call_t *old)
+{
+	if ((call->state != old->state) ||
+	    (call->emergency != old->emergency))
+		ofono_calls_schedule_update();
+
+	/* Drop the entry even if nothing changed, so that signals
+	 * for unknown or already ended calls do not pile up */
+	if (call->state == CALL_STATE_NONE)
+		(void)ofono_call_remove(path);
+}
+
 /**
  * D-Bus callback for ofono call added signal.
  *
  * @param msg The D-Bus message.
  * @return TRUE on success, FALSE on failure.
  */
- static gboolean ofono_call_added_dbus_cb(DBusMessage *const msg)
- {
+static gboolean ofono_call_added_dbus_cb(DBusMessage *const msg)
+{
 	gboolean status = FALSE;
 	DBusMessageIter msgit;
 	DBusMessageIter arrit;
 	DBusMessageIter entit;
-	DBusError error;
-
-	/* Register error channel */
-	dbus_error_init(&error);
+	const gchar *path = NULL;
+	ofono_call_t *call;
+	ofono_call_t old;
 
 	mce_log(LL_DEBUG,
 		"Received call added signal from ofono");
@@ -594,6 +747,8 @@ EXIT:
 		goto EXIT;
 	}
 
+	dbus_message_iter_get_basic(&msgit, (void *)&path);
+
 	if (!dbus_message_iter_next(&msgit) ||
 	    dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
 		mce_log(LL_WARN, "Parsing failure with ofono signal");
@@ -602,52 +757,96 @@ EXIT:
 
 	dbus_message_iter_recurse(&msgit, &arrit);
 
-	if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_DICT_ENTRY) {
-		mce_log(LL_WARN, "Parsing failure with ofono signal");
-		goto EXIT;
-	}
+	call = ofono_call_get(path);
+	old = *call;
 
-	dbus_message_iter_recurse(&arrit, &entit);
+	while (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_DICT_ENTRY) {
+		dbus_message_iter_recurse(&arrit, &entit);
 
-	do {
-		if (!ofono_handle_call_property(&entit)) {
+		if (!ofono_handle_call_property(call, &entit)) {
 			mce_log(LL_WARN,
 			        "Failed to parse call property change from ofono");
 		}
-		goto EXIT;
-	} while (dbus_message_iter_next(&entit));
+
+		dbus_message_iter_next(&arrit);
+	}
+
+	ofono_call_changed(path, call, &old);
 
 	status = TRUE;
 EXIT:
 	return status;
- }
+}
 
 /**
- * D-Bus callback for ofono call property changed signal.
+ * D-Bus callback for ofono call removed signal.
  *
  * @param msg The D-Bus message.
  * @return TRUE on success, FALSE on failure.
  */
- static gboolean ofono_call_props_changed_dbus_cb(DBusMessage *const msg)
- {
+static gboolean ofono_call_removed_dbus_cb(DBusMessage *const msg)
+{
 	gboolean status = FALSE;
-	DBusMessageIter msgit;
+	const gchar *path = NULL;
 	DBusError error;
 
 	/* Register error channel */
 	dbus_error_init(&error);
 
+	mce_log(LL_DEBUG,
+		"Received call removed signal from ofono");
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_OBJECT_PATH, &path,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_WARN, "Parsing failure with ofono signal; %s",
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	if (ofono_call_remove(path) == TRUE)
+		ofono_calls_schedule_update();
+
+	status = TRUE;
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for ofono call property changed signal.
+ *
+ * @param msg The D-Bus message.
+ * @return TRUE on success, FALSE on failure.
+ */
+static gboolean ofono_call_props_changed_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	const gchar *path = dbus_message_get_path(msg);
+	DBusMessageIter msgit;
+	ofono_call_t *call;
+	ofono_call_t old;
+
 	mce_log(LL_DEBUG,
 		"Received call property changed signal from ofono");
 
+	if (path == NULL) {
+		mce_log(LL_WARN, "Parsing failure with ofono signal");
+		goto EXIT;
+	}
+
 	dbus_message_iter_init(msg, &msgit);
 
-	if (!ofono_handle_call_property(&msgit)) {
+	call = ofono_call_get(path);
+	old = *call;
+
+	if (!ofono_handle_call_property(call, &msgit)) {
 		mce_log(LL_WARN,
 		        "Failed to parse call property change from ofono");
-		goto EXIT;
 	}
 
+	ofono_call_changed(path, call, &old);
+
 	status = TRUE;
 EXIT:
 	return status;
@@ -674,6 +873,9 @@ const gchar *g_module_check_init(GModule *module)
 				 change_call_state_dbus_cb) == NULL)
 		goto EXIT;
 
+	ofono_calls = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    g_free, ofono_call_free);
+
 	/* get_call_state */
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
 				 MCE_CALL_STATE_GET,
@@ -690,6 +892,14 @@ const gchar *g_module_check_init(GModule *module)
 				 ofono_call_added_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* Listen to call removed signal from ofono */
+	if (mce_dbus_handler_add(OFONO_VOICEMGR_SIGNAL_IF,
+				 OFONO_CALL_REMOVED_SIG,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_SIGNAL,
+				 ofono_call_removed_dbus_cb) == NULL)
+		goto EXIT;
+
 	/* Listen to call property change signal from ofono */
 	if (mce_dbus_handler_add(OFONO_VOICE_SIGNAL_IF,
 				 OFONO_VOICE_PROP_CHANGED_SIG,
@@ -714,5 +924,15 @@ void g_module_unload(GModule *module)
 {
 	(void)module;
 
+	if (ofono_calls_update_id != 0) {
+		g_source_remove(ofono_calls_update_id);
+		ofono_calls_update_id = 0;
+	}
+
+	if (ofono_calls != NULL) {
+		g_hash_table_destroy(ofono_calls);
+		ofono_calls = NULL;
+	}
+
 	return;
 }
@@ -31,13 +31,16 @@
 #include <string.h>
 
 #include "mce-log.h"
+#include "mce-lib.h"
 #include "mce-dbus.h"
+#include "mce-deadline.h"
 
 #ifdef ENABLE_WAKELOCKS
 # include "../libwakelock.h"
 #endif
 
 typedef struct client_t client_t;
+typedef struct client_stats_t client_stats_t;
 
 G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 G_MODULE_EXPORT void         g_module_unload    (GModule *module);
@@ -58,14 +61,23 @@ static DBusConnection *systembus = 0;
 /** Clients we are tracking over D-Bus */
 static GHashTable *clients = 0;
 
+/** Tracked clients in a max-heap ordered by cpu-keepalive timeout */
+static GPtrArray *client_heap = 0;
+
+/** Keepalive accounting per dbus name; outlives the tracked clients */
+static GHashTable *client_stats = 0;
+
 /** Timestamp of wakeup from dsme */
 static time_t wakeup_started  = 0;
 
 /** Timeout for "clients should have issued keep alive requests" */
 static time_t wakeup_timeout  = 0;
 
-/** Timer for releasing cpu-keepalive wakelock */
-static guint timer_id = 0;
+/** Deadline for releasing cpu-keepalive wakelock */
+static mce_deadline_t *timer_deadline = 0;
+
+/** Boottime the cpu-keepalive timer was programmed for */
+static time_t timer_when = 0;
 
 /** Maximum delay between MCE_CPU_KEEPALIVE_START_REQ method calls */
 #ifdef ENABLE_WAKELOCKS
@@ -74,6 +86,12 @@ static guint timer_id = 0;
 # define MCE_CPU_KEEPALIVE_PERIOD_SECONDS (60*60*24) // 1 day
 #endif
 
+/** Method call for getting wakelock and keepalive client accounting */
+#define MCE_CPU_KEEPALIVE_STATS_REQ "get_wakelock_stats"
+
+/** Maximum number of dbus names to keep keepalive accounting for */
+#define MCE_CPU_KEEPALIVE_STATS_MAX 64
+
 /** Maximum delay between rtc wakeup and the 1st keep alive request */
 #define MCE_RTC_WAKEUP_1ST_TIMEOUT_SECONDS   2
 
@@ -86,7 +104,10 @@ static guint timer_id = 0;
  *
  * ========================================================================= */
 
-/** Get monotonic timestamp not affected by system time / timezone changes
+/** Get boottime timestamp not affected by system time / timezone changes
+ *
+ * Unlike CLOCK_MONOTONIC, includes the time spent in suspend, so
+ * keepalive periods expire on the same clock mce deadlines use
  *
  * @return seconds since some reference point in time
  */
@@ -94,9 +115,7 @@ static
 time_t
 cpu_keepalive_get_time(void)
 {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return ts.tv_sec;
+  return mce_lib_get_time_ms(CLOCK_BOOTTIME) / 1000;
 }
 
 /* ========================================================================= *
@@ -262,8 +281,281 @@ struct client_t
 
   /** Upper bound for reneval of cpu keepalive for this client */
   time_t  timeout;
+
+  /** Position in client_heap */
+  guint   heap_index;
+
+  /** Keepalive accounting for the dbus name */
+  client_stats_t *stats;
+
+  /** Start of the current keepalive period, or 0 if none */
+  time_t  active_since;
 };
 
+/** Keepalive accounting information for a dbus name */
+struct client_stats_t
+{
+  /** Number of keepalive requests */
+  guint   requests;
+
+  /** Total time of finished keepalive periods [s] */
+  time_t  held;
+
+  /** Longest finished keepalive period [s] */
+  time_t  longest;
+};
+
+/* ========================================================================= *
+ *
+ * CLIENT TIMEOUT HEAP
+ *
+ * ========================================================================= */
+
+/** Store a client to a client heap slot
+ *
+ * @param index heap slot
+ * @param self pointer to client_t structure
+ */
+static
+void
+client_heap_set(guint index, client_t *self)
+{
+  g_ptr_array_index(client_heap, index) = self;
+  self->heap_index = index;
+}
+
+/** Move a client towards the top of the heap as needed
+ *
+ * @param self pointer to client_t structure
+ */
+static
+void
+client_heap_sift_up(client_t *self)
+{
+  guint index = self->heap_index;
+
+  while( index > 0 )
+  {
+    guint     parent = (index - 1) / 2;
+    client_t *other  = g_ptr_array_index(client_heap, parent);
+
+    if( other->timeout >= self->timeout )
+      break;
+
+    client_heap_set(index, other);
+    index = parent;
+  }
+
+  client_heap_set(index, self);
+}
+
+/** Move a client towards the bottom of the heap as needed
+ *
+ * @param self pointer to client_t structure
+ */
+static
+void
+client_heap_sift_down(client_t *self)
+{
+  guint index = self->heap_index;
+
+  for( ;; )
+  {
+    guint     child = 2 * index + 1;
+    client_t *other;
+
+    if( child >= client_heap->len )
+      break;
+
+    other = g_ptr_array_index(client_heap, child);
+
+    if( child + 1 < client_heap->len )
+    {
+      client_t *right = g_ptr_array_index(client_heap, child + 1);
+
+      if( right->timeout > other->timeout )
+	other = right, child += 1;
+    }
+
+    if( self->timeout >= other->timeout )
+      break;
+
+    client_heap_set(index, other);
+    index = child;
+  }
+
+  client_heap_set(index, self);
+}
+
+/** Add a client to the heap
+ *
+ * @param self pointer to client_t structure
+ */
+static
+void
+client_heap_insert(client_t *self)
+{
+  g_ptr_array_add(client_heap, self);
+  self->heap_index = client_heap->len - 1;
+  client_heap_sift_up(self);
+}
+
+/** Remove a client from the heap
+ *
+ * @param self pointer to client_t structure
+ */
+static
+void
+client_heap_remove(client_t *self)
+{
+  client_t *last = g_ptr_array_index(client_heap, client_heap->len - 1);
+  guint     index = self->heap_index;
+
+  g_ptr_array_set_size(client_heap, client_heap->len - 1);
+
+  if( last != self )
+  {
+    client_heap_set(index, last);
+    client_heap_sift_up(last);
+    client_heap_sift_down(last);
+  }
+}
+
+/** Get the latest client cpu-keepalive timeout
+ *
+ * @return timeout of the client at the top of the heap, or 0 if none
+ */
+static
+time_t
+client_heap_get_max(void)
+{
+  time_t    res  = 0;
+  client_t *self = 0;
+
+  if( client_heap && client_heap->len > 0 )
+  {
+    self = g_ptr_array_index(client_heap, 0);
+    res  = self->timeout;
+  }
+
+  return res;
+}
+
+/* ========================================================================= *
+ *
+ * CLIENT BOOKKEEPING
+ *
+ * ========================================================================= */
+
+/** Find or create keepalive accounting for a dbus name
+ *
+ * When the table is full, accounting for names that are no
+ * longer tracked is dropped to make room
+ *
+ * @param dbus_name name of the dbus client
+ *
+ * @return pointer to client_stats_t structure, or NULL if table is full
+ */
+static
+client_stats_t *
+client_stats_lookup(const char *dbus_name)
+{
+  client_stats_t *stats = g_hash_table_lookup(client_stats, dbus_name);
+
+  if( stats )
+  {
+    goto EXIT;
+  }
+
+  if( g_hash_table_size(client_stats) >= MCE_CPU_KEEPALIVE_STATS_MAX )
+  {
+    GHashTableIter iter;
+    gpointer key, val;
+
+    g_hash_table_iter_init(&iter, client_stats);
+    while( g_hash_table_iter_next(&iter, &key, &val) )
+    {
+      if( !g_hash_table_lookup(clients, key) )
+      {
+	g_hash_table_iter_remove(&iter);
+	break;
+      }
+    }
+
+    if( g_hash_table_size(client_stats) >= MCE_CPU_KEEPALIVE_STATS_MAX )
+    {
+      mce_log(LL_WARN, "no room for accounting client %s", dbus_name);
+      goto EXIT;
+    }
+  }
+
+  stats = g_malloc0(sizeof *stats);
+  g_hash_table_insert(client_stats, g_strdup(dbus_name), stats);
+
+EXIT:
+  return stats;
+}
+
+/** Account the end of the current client keepalive period
+ *
+ * @param self pointer to client_t structure
+ * @param now  current monotonic time
+ */
+static
+void
+client_stats_finish(client_t *self, time_t now)
+{
+  time_t end  = (self->timeout < now) ? self->timeout : now;
+  time_t hold = end - self->active_since;
+
+  if( !self->active_since )
+  {
+    goto EXIT;
+  }
+
+  if( hold < 0 ) hold = 0;
+
+  if( self->stats )
+  {
+    self->stats->held += hold;
+    if( self->stats->longest < hold )
+    {
+      self->stats->longest = hold;
+    }
+  }
+
+  self->active_since = 0;
+
+EXIT:
+  return;
+}
+
+/** Account a client keepalive request
+ *
+ * @param self pointer to client_t structure
+ * @param now  current monotonic time
+ */
+static
+void
+client_stats_start(client_t *self, time_t now)
+{
+  /* The previous period ran out before this request */
+  if( self->active_since && self->timeout < now )
+  {
+    client_stats_finish(self, now);
+  }
+
+  if( !self->active_since )
+  {
+    self->active_since = now;
+  }
+
+  if( self->stats )
+  {
+    self->stats->requests += 1;
+  }
+}
+
 /** Clear client cpu-keepalive timeout
  *
  * @param self pointer to client_t structure
@@ -272,7 +564,10 @@ static
 void
 client_clear_timeout(client_t *self)
 {
+  client_stats_finish(self, cpu_keepalive_get_time());
+
   self->timeout = 0;
+  client_heap_sift_down(self);
 }
 
 
@@ -285,9 +580,12 @@ static
 void
 client_update_timeout(client_t *self, time_t when)
 {
+  client_stats_start(self, cpu_keepalive_get_time());
+
   if( self->timeout < when )
   {
     self->timeout = when;
+    client_heap_sift_up(self);
   }
 }
 
@@ -310,6 +608,9 @@ client_create(const char *dbus_name)
   self->dbus_name  = g_strdup(dbus_name);
   self->match_rule = g_strdup_printf(client_match_fmt, self->dbus_name);
   self->timeout    = 0;
+  self->stats      = client_stats_lookup(dbus_name);
+
+  client_heap_insert(self);
 
   mce_log(LL_NOTICE, "added cpu-keepalive client %s", self->dbus_name);
 
@@ -335,6 +636,9 @@ client_delete(client_t *self)
   {
     mce_log(LL_NOTICE, "removed cpu-keepalive client %s", self->dbus_name);
 
+    client_stats_finish(self, cpu_keepalive_get_time());
+    client_heap_remove(self);
+
     /* NULL error -> match will be removed asynchronously */
     dbus_bus_remove_match(systembus, self->match_rule, 0);
 
@@ -367,26 +671,18 @@ client_delete_cb(void *self)
  * enter late suspend according to other policies.
  *
  * @param data (not used)
- *
- * @return FALSE (to stop then timer from repeating)
  */
 static
-gboolean
+void
 cpu_keepalive_timer_cb(gpointer data)
 {
   (void)data;
 
-  if( timer_id != 0 )
-  {
-    mce_log(LL_NOTICE, "cpu-keepalive ended");
-    timer_id = 0;
+  mce_log(LL_NOTICE, "cpu-keepalive ended");
 
 #ifdef ENABLE_WAKELOCKS
-    wakelock_unlock(cpu_wakelock);
+  wakelock_unlock(cpu_wakelock);
 #endif
-  }
-
-  return FALSE;
 }
 
 /** Cancel end of cpu-keepalive timer
@@ -395,10 +691,7 @@ static
 void
 cpu_keepalive_cancel_timer(void)
 {
-  if( timer_id != 0 )
-  {
-    g_source_remove(timer_id), timer_id = 0;
-  }
+  mce_deadline_stop(timer_deadline);
 }
 
 /** Reset cpu-keepalive timer
@@ -409,51 +702,49 @@ static
 void
 cpu_keepalive_set_timer(time_t when)
 {
-  cpu_keepalive_cancel_timer();
-
   time_t now = cpu_keepalive_get_time();
 
   if( when < now ) when = now;
 
-  mce_log(LL_NOTICE, "cpu-keepalive ends at T%+d", (int)(now - when));
-
-  if( now < when )
-  {
-    timer_id = g_timeout_add_seconds(when - now,
-				     cpu_keepalive_timer_cb, 0);
-  }
-  else
+  /* Renewals often leave the end of the period where it was */
+  if( mce_deadline_is_active(timer_deadline) && timer_when == when )
   {
-    timer_id = g_idle_add(cpu_keepalive_timer_cb, 0);
+    goto EXIT;
   }
+
+  cpu_keepalive_cancel_timer();
+
+  timer_when = when;
+
+  mce_log(LL_NOTICE, "cpu-keepalive ends at T%+d", (int)(now - when));
+
+  /* A zero delay expires from the next mainloop iteration */
+  mce_deadline_start(timer_deadline, (gint64)(when - now) * 1000);
+
+EXIT:
+  return;
 }
 
 /** Re-evaluate the end of cpu-keepalive period
  *
- * Calculates maximum of wakeup period and per client renew periods
- * and uses it to reprogram the end of cpu-keepalive period
+ * Takes maximum of wakeup period and the latest client renew period,
+ * which is kept at the top of the client heap, and uses it to
+ * reprogram the end of cpu-keepalive period
  */
 static
 void
 cpu_keepalive_rethink(void)
 {
   time_t maxtime = wakeup_timeout;
-
-  GHashTableIter iter;
-  gpointer key, val;
+  time_t clienttime = client_heap_get_max();
 
 #ifdef ENABLE_WAKELOCKS
   wakelock_lock(cpu_wakelock, -1);
 #endif
 
-  g_hash_table_iter_init(&iter, clients);
-  while( g_hash_table_iter_next (&iter, &key, &val) )
+  if( maxtime < clienttime )
   {
-    client_t *client = val;
-    if( maxtime < client->timeout )
-    {
-      maxtime = client->timeout;
-    }
+    maxtime = clienttime;
   }
   cpu_keepalive_set_timer(maxtime);
 }
@@ -792,6 +1083,129 @@ cpu_keepalive_wakeup_cb(DBusMessage *const msg)
   return success;
 }
 
+/** Helper for appending one accounting entry to a stats reply
+ *
+ * @param array    dbus array iterator to append to
+ * @param kind     "wakelock" or "client"
+ * @param name     name of the wakelock or dbus client
+ * @param count    number of acquires / keepalive requests
+ * @param held_ms  total held time in milliseconds
+ * @param max_ms   longest hold in milliseconds
+ * @param active   TRUE if currently held
+ */
+static
+void
+cpu_keepalive_append_stats(DBusMessageIter *array, const char *kind,
+			   const char *name, guint count,
+			   guint64 held_ms, guint64 max_ms, gboolean active)
+{
+  DBusMessageIter item;
+  dbus_uint32_t   cnt = count;
+  dbus_uint64_t   tot = held_ms;
+  dbus_uint64_t   max = max_ms;
+  dbus_bool_t     act = active;
+
+  dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &kind);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &cnt);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &tot);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &max);
+  dbus_message_iter_append_basic(&item, DBUS_TYPE_BOOLEAN, &act);
+  dbus_message_iter_close_container(array, &item);
+}
+
+/** D-Bus callback for the MCE_CPU_KEEPALIVE_STATS_REQ method call
+ *
+ * Reply is an array of ("wakelock" or "client", name, acquires,
+ * total held time [ms], longest hold [ms], held now) structures;
+ * ongoing holds are included in the totals
+ *
+ * @param msg The D-Bus message
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static
+gboolean
+cpu_keepalive_stats_cb(DBusMessage *const msg)
+{
+  mce_log(LL_INFO, "got method call");
+
+  gboolean        success = FALSE;
+  DBusMessage    *reply   = 0;
+  DBusMessageIter body, array;
+  GHashTableIter  iter;
+  gpointer        key, val;
+  time_t          now = cpu_keepalive_get_time();
+
+  if( dbus_message_get_no_reply(msg) )
+  {
+    success = TRUE;
+    goto EXIT;
+  }
+
+  if( !(reply = dbus_new_method_reply(msg)) )
+  {
+    goto EXIT;
+  }
+
+  dbus_message_iter_init_append(reply, &body);
+
+  if( !dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					"(ssuttb)", &array) )
+  {
+    mce_log(LL_CRIT, "failed to append reply to %s",
+	    MCE_CPU_KEEPALIVE_STATS_REQ);
+    dbus_message_unref(reply);
+    goto EXIT;
+  }
+
+#ifdef ENABLE_WAKELOCKS
+  wakelock_stats_t lock;
+
+  for( int i = 0; wakelock_get_stats(i, &lock); ++i )
+  {
+    cpu_keepalive_append_stats(&array, "wakelock", lock.name,
+			       lock.acquires,
+			       lock.held / 1000000,
+			       lock.longest / 1000000,
+			       lock.locked != 0);
+  }
+#endif
+
+  g_hash_table_iter_init(&iter, client_stats);
+  while( g_hash_table_iter_next(&iter, &key, &val) )
+  {
+    const client_stats_t *stats  = val;
+    client_t             *client = g_hash_table_lookup(clients, key);
+    time_t                held   = stats->held;
+    time_t                hold   = 0;
+    gboolean              active = FALSE;
+
+    if( client && client->active_since )
+    {
+      time_t end = (client->timeout < now) ? client->timeout : now;
+
+      hold   = MAX(end - client->active_since, 0);
+      active = (client->timeout > now);
+      held  += hold;
+    }
+
+    cpu_keepalive_append_stats(&array, "client", key, stats->requests,
+			       (guint64)held * 1000,
+			       (guint64)MAX(stats->longest, hold) * 1000,
+			       active);
+  }
+
+  dbus_message_iter_close_container(&body, &array);
+
+  /* dbus_send_message() unrefs the message */
+  success = dbus_send_message(reply), reply = 0;
+
+EXIT:
+  return success;
+}
+
 /* ========================================================================= *
  *
  * D-BUS SIGNAL HANDLERS
@@ -887,6 +1301,7 @@ static struct
   { MCE_CPU_KEEPALIVE_START_REQ,  cpu_keepalive_start_cb,  0 },
   { MCE_CPU_KEEPALIVE_STOP_REQ,   cpu_keepalive_stop_cb,   0 },
   { MCE_CPU_KEEPALIVE_WAKEUP_REQ, cpu_keepalive_wakeup_cb, 0 },
+  { MCE_CPU_KEEPALIVE_STATS_REQ,  cpu_keepalive_stats_cb,  0 },
   { 0, 0, 0 }
 };
 
@@ -959,15 +1374,24 @@ const gchar *g_module_check_init(GModule *module)
     goto EXIT;
   }
 
+  /* The wakelock keeps the device up; no need for a wakeup alarm */
+  timer_deadline = mce_deadline_create("cpu_keepalive",
+				       cpu_keepalive_timer_cb, 0);
+
+  client_heap = g_ptr_array_new();
+
+  client_stats = g_hash_table_new_full(g_str_hash, g_str_equal,
+				       g_free, g_free);
+
+  clients = g_hash_table_new_full(g_str_hash, g_str_equal,
+				  g_free, client_delete_cb);
+
   if( !cpu_keepalive_attach_to_dbus() )
   {
     status = "attaching to dbus connection failed";
     goto EXIT;
   }
 
-  clients = g_hash_table_new_full(g_str_hash, g_str_equal,
-				  g_free, client_delete_cb);
-
 EXIT:
 
   mce_log(LL_NOTICE, "loaded %s, status: %s", module_name, status ?: "ok");
@@ -990,12 +1414,26 @@ void g_module_unload(GModule *module)
     g_hash_table_unref(clients), clients = 0;
   }
 
+  /* Clients remove themselves from the heap when deleted */
+  if( client_heap )
+  {
+    g_ptr_array_free(client_heap, TRUE), client_heap = 0;
+  }
+
+  /* Clients refer to their accounting data -> purge clients first */
+  if( client_stats )
+  {
+    g_hash_table_unref(client_stats), client_stats = 0;
+  }
+
   if( systembus )
   {
     cpu_keepalive_detach_from_dbus();
     dbus_connection_unref(systembus), systembus = 0;
   }
 
+  mce_deadline_delete(timer_deadline), timer_deadline = 0;
+
   mce_log(LL_NOTICE, "unloaded %s", module_name);
 
   return;
@@ -30,6 +30,7 @@
 #include <stdio.h>			/* O_RDWR */
 #include <string.h>			/* strcmp() */
 #include <unistd.h>			/* close() */
+#include <math.h>			/* pow() */
 #include <linux/fb.h>			/* FBIOBLANK,
 					 * FB_BLANK_POWERDOWN,
 					 * FB_BLANK_UNBLANK
@@ -49,6 +50,7 @@
 					 * charger_state_pipe,
 					 * display_state_pipe,
 					 * display_brightness_pipe,
+					 * display_prewake_pipe,
 					 * inactivity_timeout_pipe,
 					 * led_pattern_deactivate_pipe,
 					 * submode_pipe,
@@ -60,9 +62,12 @@
 #include "mce-io.h"			/* mce_close_file(),
 					 * mce_read_string_from_file(),
 					 * mce_read_number_string_from_file(),
-					 * mce_write_number_string_to_file()
+					 * mce_write_number_string_to_file(),
+					 * mce_io_output_flush()
 					 */
-#include "mce-lib.h"			/* strstr_delim(),
+#include "mce-lib.h"			/* mce_lib_get_time_ms(),
+					 * mce_lib_get_time_us(),
+					 * strstr_delim(),
 					 * mce_translate_string_to_int_with_default(),
 					 * mce_translation_t
 					 */
@@ -76,6 +81,7 @@
 					 * mce_dbus_owner_monitor_add(),
 					 * mce_dbus_owner_monitor_remove(),
 					 * dbus_send_message(),
+					 * dbus_send_message_coalesced(),
 					 * dbus_new_method_reply(),
 					 * dbus_new_signal(),
 					 * dbus_message_append_args(),
@@ -117,6 +123,17 @@
 					 * remove_output_trigger_from_datapipe()
 					 */
 #include "tklock.h"
+#include "event-input.h"		/* mce_input_latency_output() */
+#include "mce-hal.h"			/* mce_hal_cache_get_string(),
+					 * mce_hal_cache_set_string()
+					 */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start(),
+					 * mce_deadline_stop(),
+					 * mce_deadline_is_active()
+					 */
+#include "mce-power-profile.h"		/* mce_power_profile_get() */
 
 #ifdef ENABLE_WAKELOCKS
 # include "../libwakelock.h"		/* API for wakelocks */
@@ -211,14 +228,14 @@ static guint use_low_power_mode_gconf_cb_id = 0;
 /** Display low power mode timeout setting */
 static gint disp_lpm_timeout = DEFAULT_BLANK_TIMEOUT;
 
-/** ID for display blank prevention timer source */
-static guint blank_prevent_timeout_cb_id = 0;
+/** Deadline for display blank prevention */
+static mce_deadline_t *blank_prevent_deadline = NULL;
 
 /** GConf callback ID for display blanking timeout setting */
 static guint adaptive_dimming_enabled_gconf_cb_id = 0;
 
-/** ID for adaptive display dimming timer source */
-static guint adaptive_dimming_timeout_cb_id = 0;
+/** Deadline for adaptive display dimming */
+static mce_deadline_t *adaptive_dimming_deadline = NULL;
 
 /** Use adaptive timeouts for dimming */
 static gboolean adaptive_dimming_enabled = DEFAULT_ADAPTIVE_DIMMING_ENABLED;
@@ -235,8 +252,8 @@ static gint blank_prevent_timeout = BLANK_PREVENT_TIMEOUT;
 /** Bootup dim additional timeout */
 static gint bootup_dim_additional_timeout = 0;
 
-/** ID for high brightness mode timer source */
-static guint hbm_timeout_cb_id = 0;
+/** Deadline for high brightness mode */
+static mce_deadline_t *hbm_deadline = NULL;
 
 /** Cached brightness, last value written; [0, maximum_display_brightness] */
 static gint cached_brightness = -1;
@@ -261,19 +278,79 @@ static const gchar *cabc_mode = DEFAULT_CABC_MODE;
  */
 static const gchar *psm_cabc_mode = NULL;
 
-/** Fadeout step length */
-static gint brightness_fade_steplength = 2;
+/** Brightness at the start of the current fade */
+static gint brightness_fade_start = -1;
+/** Start time of the current fade; in milliseconds, CLOCK_MONOTONIC */
+static gint64 brightness_fade_start_time = 0;
+/** Duration of the current fade; in milliseconds */
+static gint brightness_fade_duration = 0;
+/** Minimum step time of the current fade; in milliseconds */
+static gint brightness_fade_min_step_time = BRIGHTNESS_FADE_MIN_STEP_TIME;
 
 /** Brightness fade timeout callback ID */
 static guint brightness_fade_timeout_cb_id = 0;
-/** Display dimming timeout callback ID */
-static guint dim_timeout_cb_id = 0;
-/** Low power mode timeout callback ID */
-static guint lpm_timeout_cb_id = 0;
-/** Low power mode proximity blank timeout callback ID */
-static guint lpm_proximity_blank_timeout_cb_id = 0;
-/** Display blanking timeout callback ID */
-static guint blank_timeout_cb_id = 0;
+/** Display dimming deadline */
+static mce_deadline_t *dim_deadline = NULL;
+/** Low power mode deadline */
+static mce_deadline_t *lpm_deadline = NULL;
+/** Low power mode proximity blank deadline */
+static mce_deadline_t *lpm_proximity_blank_deadline = NULL;
+/** Display blanking deadline */
+static mce_deadline_t *blank_deadline = NULL;
+/** Deadline for reverting an unused framebuffer prewake */
+static mce_deadline_t *prewake_deadline = NULL;
+
+/** Time of the pending framebuffer prewake [us, CLOCK_MONOTONIC] */
+static gint64 prewake_time = 0;
+/** Time the prewake framebuffer power-up took [us] */
+static gint64 prewake_cost = 0;
+/** Number of prewakes followed by an unblank */
+static guint prewake_hits = 0;
+/** Number of prewakes reverted because no unblank followed */
+static guint prewake_misses = 0;
+/** Total framebuffer power-up time taken off the unblank path [us] */
+static gint64 prewake_saved = 0;
+
+/** Statistics for one stage of a display state transition */
+typedef struct {
+	guint count;			/**< Number of samples */
+	gint64 total;			/**< Sum of the delays [us] */
+	gint64 max;			/**< Largest delay [us] */
+	gint64 last;			/**< Latest delay [us] */
+} display_transition_stage_t;
+
+/** Statistics for one type of display state transition */
+typedef struct {
+	/** From the request to the policy decision */
+	display_transition_stage_t policy;
+	/** From the policy decision to the framebuffer power change */
+	display_transition_stage_t framebuffer;
+	/** From the policy decision to the first completed backlight write */
+	display_transition_stage_t backlight;
+} display_transition_stats_t;
+
+/** Number of display states in the transition statistics */
+#define DISPLAY_TRANSITION_STATES	(MCE_DISPLAY_ON + 1)
+
+/** Transition statistics, indexed by the old and the new display state */
+static display_transition_stats_t
+display_transition_stats[DISPLAY_TRANSITION_STATES][DISPLAY_TRANSITION_STATES];
+
+/** Time stamps of the display state transition being timed [us] */
+static struct {
+	display_state_t from;		/**< Display state being left */
+	display_state_t to;		/**< Display state being entered */
+	gint64 request;			/**< Request time */
+	gint64 decision;		/**< Policy decision time, or 0 */
+	gint64 framebuffer;		/**< Framebuffer power time, or 0 */
+	gint64 backlight;		/**< First backlight write time, or 0 */
+} display_transition = {
+	.from = MCE_DISPLAY_UNDEF,
+	.to = MCE_DISPLAY_UNDEF,
+};
+
+/** Time of the pending display state request [us], or 0 */
+static gint64 display_transition_request_time = 0;
 
 /** Charger state */
 static gboolean charger_connected = FALSE;
@@ -281,12 +358,18 @@ static gboolean charger_connected = FALSE;
 /** Maximum display brightness, hw specific */
 static gint maximum_display_brightness = DEFAULT_MAXIMUM_DISPLAY_BRIGHTNESS;
 
+static void display_transition_backlight(gint64 written);
+
 /** File used to set display brightness */
 static output_state_t brightness_output =
 {
   .context = "brightness",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .skip_unchanged = TRUE,
+  .use_pwrite = TRUE,
+  .async = TRUE,
+  .written_cb = display_transition_backlight,
 };
 
 /** File used to get maximum display brightness */
@@ -312,6 +395,8 @@ static output_state_t high_brightness_mode_output =
   .context = "high_brightness_mode",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .skip_unchanged = TRUE,
+  .use_pwrite = TRUE,
 };
 
 /** Is display high brightness mode supported */
@@ -354,6 +439,36 @@ static const mce_translation_t brightness_change_policy_translation[] = {
 	}
 };
 
+/** Brightness fade curves */
+typedef enum {
+	/** Curve not set */
+	BRIGHTNESS_FADE_CURVE_INVALID = MCE_INVALID_TRANSLATION,
+	/** Backlight level changes at a constant rate */
+	BRIGHTNESS_FADE_CURVE_LINEAR = 0,
+	/** Perceived brightness changes at a constant rate */
+	BRIGHTNESS_FADE_CURVE_PERCEPTUAL = 1,
+	/** Default brightness fade curve */
+	DEFAULT_BRIGHTNESS_FADE_CURVE = BRIGHTNESS_FADE_CURVE_LINEAR
+} brightness_fade_curve_t;
+
+/** Mapping of brightness fade curve integer <-> curve string */
+static const mce_translation_t brightness_fade_curve_translation[] = {
+	{
+		.number = BRIGHTNESS_FADE_CURVE_LINEAR,
+		.string = "linear",
+	}, {
+		.number = BRIGHTNESS_FADE_CURVE_PERCEPTUAL,
+		.string = "perceptual",
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = NULL
+	}
+};
+
+/** Brightness fade curve */
+static brightness_fade_curve_t brightness_fade_curve =
+					DEFAULT_BRIGHTNESS_FADE_CURVE;
+
 /** Real display brightness setting; [1, 5] */
 static gint real_disp_brightness = DEFAULT_DISP_BRIGHTNESS;
 
@@ -675,19 +790,31 @@ static gboolean get_display_type_from_sysfs_probe(display_type_t *display_type)
 		NULL
 	};
 
-	gboolean   res = FALSE;
-	gchar     *set = 0;
-	gchar     *max = 0;
+	gboolean    res    = FALSE;
+	gchar      *set    = 0;
+	gchar      *max    = 0;
+	gchar      *cached = 0;
+	const char *found  = 0;
 
 	glob_t    gb;
 
 	memset(&gb, 0, sizeof gb);
 
+	/* The backlight chosen on a previous boot, if it still works;
+	 * the glob below is slow on some kernels */
+	if( (cached = mce_hal_cache_get_string(DISPLAY_SYSFS_PROBE_CACHE_KEY)) &&
+	    get_brightness_controls(cached, &set, &max) ) {
+		found = cached;
+		goto EXIT;
+	}
+
 	/* Assume: Any match from fixed list will be true positive.
 	 * Check them before possibly ambiguous backlight class entries. */
 	for( size_t i = 0; lut[i]; ++i ) {
-		if( get_brightness_controls(lut[i], &set, &max) )
+		if( get_brightness_controls(lut[i], &set, &max) ) {
+			found = lut[i];
 			goto EXIT;
+		}
 	}
 
 	if( glob(pattern, 0, display_glob_err_cb, &gb) != 0 ) {
@@ -702,11 +829,15 @@ static gboolean get_display_type_from_sysfs_probe(display_type_t *display_type)
 	for( size_t i = 0; i < gb.gl_pathc; ++i ) {
 		const char *path = gb.gl_pathv[i];
 
-		if( get_brightness_controls(path, &set, &max) )
+		if( get_brightness_controls(path, &set, &max) ) {
+			found = path;
 			goto EXIT;
+		}
 	}
 
 EXIT:
+	mce_hal_cache_set_string(DISPLAY_SYSFS_PROBE_CACHE_KEY, found);
+
 	/* Have we found both brightness and max_brightness files? */
 	if( set && max ) {
 		mce_log(LL_NOTICE, "applying DISPLAY_TYPE_GENERIC from sysfs probe");
@@ -726,6 +857,7 @@ EXIT:
 
 	g_free(max);
 	g_free(set);
+	g_free(cached);
 
 	globfree(&gb);
 
@@ -1082,20 +1214,15 @@ static void write_high_brightness_value(int number)
  * Timeout callback for the high brightness mode
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean hbm_timeout_cb(gpointer data)
+static void hbm_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	hbm_timeout_cb_id = 0;
-
 	/* Disable high brightness mode */
 	write_high_brightness_value(0);
 	set_hbm_level = 0;
 	update_display_timers(FALSE);
-
-	return FALSE;
 }
 
 /**
@@ -1103,11 +1230,8 @@ static gboolean hbm_timeout_cb(gpointer data)
  */
 static void cancel_hbm_timeout(void)
 {
-	/* Remove the timeout source for the high brightness mode */
-	if (hbm_timeout_cb_id != 0) {
-		g_source_remove(hbm_timeout_cb_id);
-		hbm_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for the high brightness mode */
+	mce_deadline_stop(hbm_deadline);
 }
 
 /**
@@ -1118,8 +1242,7 @@ static void setup_hbm_timeout(void)
 	cancel_hbm_timeout();
 
 	/* Setup new timeout */
-	hbm_timeout_cb_id = g_timeout_add_seconds(DEFAULT_HBM_TIMEOUT,
-						  hbm_timeout_cb, NULL);
+	mce_deadline_start(hbm_deadline, DEFAULT_HBM_TIMEOUT * 1000);
 }
 
 /**
@@ -1154,7 +1277,7 @@ static void update_high_brightness_mode(gint hbm_level)
 	 */
 	if (set_hbm_level == 0) {
 		cancel_hbm_timeout();
-	} else if (hbm_timeout_cb_id == 0) {
+	} else if (mce_deadline_is_active(hbm_deadline) == FALSE) {
 		setup_hbm_timeout();
 	}
 
@@ -1216,6 +1339,160 @@ EXIT:
 	return;
 }
 
+/**
+ * Get the index of a display state in the transition statistics
+ *
+ * @param state The display state
+ * @return Index in the statistics table, or -1 for unknown states
+ */
+static gint display_transition_index(display_state_t state)
+{
+	return ((state >= MCE_DISPLAY_OFF) && (state <= MCE_DISPLAY_ON)) ?
+		(gint)state : -1;
+}
+
+/**
+ * Add a sample to display transition stage statistics
+ *
+ * @param stage The stage statistics to update
+ * @param delay The stage delay [us]
+ */
+static void display_transition_sample(display_transition_stage_t *stage,
+				      gint64 delay)
+{
+	stage->count++;
+	stage->total += delay;
+	stage->last = delay;
+
+	if (stage->max < delay)
+		stage->max = delay;
+}
+
+/**
+ * Get the statistics for the transition being timed
+ *
+ * @return The statistics, or NULL if no transition is being timed
+ */
+static display_transition_stats_t *display_transition_current(void)
+{
+	gint from = display_transition_index(display_transition.from);
+	gint to = display_transition_index(display_transition.to);
+
+	if ((display_transition.decision == 0) || (from < 0) || (to < 0))
+		return NULL;
+
+	/* Stop timing once the state has been stable for a while */
+	if (mce_lib_get_time_us(CLOCK_MONOTONIC) - display_transition.decision >
+	    DISPLAY_TRANSITION_WINDOW * 1000) {
+		display_transition.decision = 0;
+		return NULL;
+	}
+
+	return &display_transition_stats[from][to];
+}
+
+/**
+ * Time stamp a display state request
+ */
+static void display_transition_request(void)
+{
+	if (display_transition_request_time == 0)
+		display_transition_request_time =
+			mce_lib_get_time_us(CLOCK_MONOTONIC);
+}
+
+/**
+ * Time stamp the policy decision to switch the display state
+ *
+ * @param from The display state being left
+ * @param to The display state being entered
+ */
+static void display_transition_decide(display_state_t from,
+				      display_state_t to)
+{
+	display_transition_stats_t *stats;
+	gint64 now = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	display_transition.from = from;
+	display_transition.to = to;
+	display_transition.request = (display_transition_request_time ?
+				      display_transition_request_time : now);
+	display_transition.decision = now;
+	display_transition.framebuffer = 0;
+	display_transition.backlight = 0;
+
+	if ((stats = display_transition_current()) == NULL)
+		goto EXIT;
+
+	display_transition_sample(&stats->policy,
+				  now - display_transition.request);
+
+EXIT:
+	return;
+}
+
+/**
+ * Time stamp a framebuffer power change
+ */
+static void display_transition_framebuffer(void)
+{
+	display_transition_stats_t *stats;
+
+	if (display_transition.framebuffer != 0)
+		goto EXIT;
+
+	if ((stats = display_transition_current()) == NULL)
+		goto EXIT;
+
+	display_transition.framebuffer = mce_lib_get_time_us(CLOCK_MONOTONIC);
+	display_transition_sample(&stats->framebuffer,
+				  display_transition.framebuffer -
+				  display_transition.decision);
+
+EXIT:
+	return;
+}
+
+/**
+ * Time stamp a completed backlight write
+ *
+ * @param written When the driver write completed [us, CLOCK_MONOTONIC]
+ */
+static void display_transition_backlight(gint64 written)
+{
+	display_transition_stats_t *stats;
+
+	if (display_transition.backlight != 0)
+		goto EXIT;
+
+	if ((stats = display_transition_current()) == NULL)
+		goto EXIT;
+
+	/* Writes completed before the decision belong to an
+	 * earlier transition */
+	if (written < display_transition.decision)
+		goto EXIT;
+
+	display_transition.backlight = written;
+	display_transition_sample(&stats->backlight,
+				  display_transition.backlight -
+				  display_transition.decision);
+
+	mce_log(LL_DEBUG, "display %d -> %d: policy %lld us, "
+		"framebuffer %lld us, backlight %lld us",
+		display_transition.from, display_transition.to,
+		(long long)(display_transition.decision -
+			    display_transition.request),
+		(long long)(display_transition.framebuffer ?
+			    display_transition.framebuffer -
+			    display_transition.decision : -1),
+		(long long)(display_transition.backlight -
+			    display_transition.decision));
+
+EXIT:
+	return;
+}
+
 /**
  * Call the FBIOBLANK ioctl
  *
@@ -1245,6 +1522,11 @@ static gboolean backlight_ioctl(int value)
 	}
 
 	if (value != old_value) {
+		/* Backlight writes are done by the output writer thread;
+		 * make sure the panel power change is not reordered
+		 * with the brightness written before it */
+		mce_io_output_flush(&brightness_output);
+
 		if (ioctl(fd, FBIOBLANK, value) == -1) {
 			mce_log(LL_CRIT,
 				"ioctl() FBIOBLANK (%d) failed on `%s'; %s",
@@ -1271,6 +1553,9 @@ static gboolean backlight_ioctl(int value)
 		}
 
 		old_value = value;
+
+		/* Only time stamp the power changes actually made */
+		display_transition_framebuffer();
 	}
 
 	status = TRUE;
@@ -1290,6 +1575,9 @@ static void write_brightness_value_default(int number)
 static void write_brightness_value_hybris(int number)
 {
 	mce_hybris_backlight_set_brightness(number);
+
+	/* The libhybris write is synchronous */
+	display_transition_backlight(mce_lib_get_time_us(CLOCK_MONOTONIC));
 }
 #endif
 
@@ -1318,46 +1606,106 @@ static void write_brightness_value(int number)
 		mce_log(LL_DEBUG, "value=%d", number);
 
 	write_brightness_value_hook(number);
+
+	/* Account input to display change latency */
+	mce_input_latency_output();
+}
+
+/**
+ * Get the brightness along the current fade
+ *
+ * @param elapsed Time since the fade started; in milliseconds
+ * @return The brightness; [0, maximum_display_brightness]
+ */
+static gint brightness_fade_level(gint64 elapsed)
+{
+	gdouble pos = 1.0;
+	gdouble from = brightness_fade_start;
+	gdouble to = target_brightness;
+	gdouble level;
+
+	if ((elapsed < brightness_fade_duration) &&
+	    (brightness_fade_duration > 0))
+		pos = (gdouble)elapsed / brightness_fade_duration;
+
+	if ((brightness_fade_curve == BRIGHTNESS_FADE_CURVE_PERCEPTUAL) &&
+	    (maximum_display_brightness > 0)) {
+		/* Interpolate in perceived brightness,
+		 * then map back to backlight levels */
+		from = pow(from / maximum_display_brightness,
+			   1.0 / BRIGHTNESS_FADE_GAMMA);
+		to = pow(to / maximum_display_brightness,
+			 1.0 / BRIGHTNESS_FADE_GAMMA);
+		level = from + (to - from) * pos;
+		level = pow(level, BRIGHTNESS_FADE_GAMMA) *
+			maximum_display_brightness;
+	} else {
+		level = from + (to - from) * pos;
+	}
+
+	return (gint)(level + 0.5);
 }
 
 /**
  * Timeout callback for the brightness fade
  *
+ * The brightness is computed from the time elapsed since the fade
+ * started, so late timer dispatch does not stretch the fade; the
+ * next step is scheduled for when the next backlight level is due
+ *
  * @param data Unused
- * @return Returns TRUE to repeat, until the cached brightness has reached
- *         the destination value; when this happens, FALSE is returned
+ * @return Always returns FALSE; the timer is re-armed as needed
  */
 static gboolean brightness_fade_timeout_cb(gpointer data)
 {
-	gboolean retval = TRUE;
+	gint64 elapsed;
+	gint remaining;
+	gint step_time;
+	gint levels;
 
 	(void)data;
 
+	brightness_fade_timeout_cb_id = 0;
+
+	elapsed = (mce_lib_get_time_ms(CLOCK_MONOTONIC) -
+		   brightness_fade_start_time);
+
 	if ((cached_brightness <= 0) && (target_brightness != 0)) {
 		backlight_ioctl(FB_BLANK_UNBLANK);
 	}
 
 	if ((cached_brightness == -1) ||
-	    (ABS(cached_brightness -
-		 target_brightness) < brightness_fade_steplength)) {
+	    (elapsed >= brightness_fade_duration)) {
 		cached_brightness = target_brightness;
-		retval = FALSE;
-	} else if (target_brightness > cached_brightness) {
-		cached_brightness += brightness_fade_steplength;
+		write_brightness_value(cached_brightness);
 	} else {
-		cached_brightness -= brightness_fade_steplength;
-	}
+		gint level = brightness_fade_level(elapsed);
 
-	write_brightness_value(cached_brightness);
+		if (level != cached_brightness) {
+			cached_brightness = level;
+			write_brightness_value(cached_brightness);
+		}
+	}
 
 	if (cached_brightness == 0) {
 		backlight_ioctl(FB_BLANK_POWERDOWN);
 	}
 
-	if (retval == FALSE)
-		 brightness_fade_timeout_cb_id = 0;
+	if (cached_brightness == target_brightness)
+		goto EXIT;
 
-	return retval;
+	/* Spread the remaining time over the remaining levels */
+	remaining = brightness_fade_duration - elapsed;
+	levels = ABS(target_brightness - cached_brightness);
+	step_time = CLAMP(remaining / levels,
+			  brightness_fade_min_step_time,
+			  MAX(remaining, brightness_fade_min_step_time));
+
+	brightness_fade_timeout_cb_id =
+		g_timeout_add(step_time, brightness_fade_timeout_cb, NULL);
+
+EXIT:
+	return FALSE;
 }
 
 /**
@@ -1375,12 +1723,31 @@ static void cancel_brightness_fade_timeout(void)
 /**
  * Setup the brightness fade timeout
  *
- * @param step_time The time between each brightness step
+ * The fade starts from the current brightness
+ *
+ * @param duration The time the whole fade should take; in milliseconds
  */
-static void setup_brightness_fade_timeout(gint step_time)
+static void setup_brightness_fade_timeout(gint duration)
 {
+	gint levels = ABS(target_brightness - cached_brightness);
+	gint step_time;
+
 	cancel_brightness_fade_timeout();
 
+	/* The power profile may ask for fewer, longer steps */
+	brightness_fade_min_step_time =
+		MAX(BRIGHTNESS_FADE_MIN_STEP_TIME,
+		    mce_power_profile_get()->fade_min_step_time);
+	step_time = brightness_fade_min_step_time;
+
+	brightness_fade_start = cached_brightness;
+	brightness_fade_start_time = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+	brightness_fade_duration = MAX(duration, 0);
+
+	if (levels > 0)
+		step_time = MAX(brightness_fade_duration / levels,
+				brightness_fade_min_step_time);
+
 	/* Setup new timeout */
 	brightness_fade_timeout_cb_id =
 		g_timeout_add(step_time, brightness_fade_timeout_cb, NULL);
@@ -1396,7 +1763,9 @@ static void setup_brightness_fade_timeout(gint step_time)
 static void update_brightness_fade(gint new_brightness)
 {
 	gboolean increase = (new_brightness >= cached_brightness);
-	gint step_time = 10;
+	gint levels = ABS(new_brightness - cached_brightness);
+	gint step_time;
+	gint duration;
 
 	/* This should never happen, but just in case */
 	if (cached_brightness == new_brightness)
@@ -1427,32 +1796,92 @@ static void update_brightness_fade(gint new_brightness)
 	target_brightness = new_brightness;
 
 	if (increase == TRUE) {
+		step_time = brightness_increase_step_time;
+
 		if (brightness_increase_policy == BRIGHTNESS_CHANGE_STEP_TIME)
-			step_time = brightness_increase_step_time;
-		else {
-			step_time = brightness_increase_constant_time /
-				    (new_brightness - cached_brightness);
-		}
+			duration = -1;
+		else
+			duration = brightness_increase_constant_time;
 	} else {
+		step_time = brightness_decrease_step_time;
+
 		if (brightness_decrease_policy == BRIGHTNESS_CHANGE_STEP_TIME)
-			step_time = brightness_decrease_step_time;
-		else {
-			step_time = brightness_decrease_constant_time /
-				    (cached_brightness - new_brightness);
-		}
+			duration = -1;
+		else
+			duration = brightness_decrease_constant_time;
 	}
 
-	/* Special case */
-	if (step_time == 5) {
-		step_time = 2;
-		brightness_fade_steplength = 2;
-	} else {
-		brightness_fade_steplength = 1;
+	if (duration < 0) {
+		/* The old stepper took two levels every 2 ms
+		 * for the 5 ms step-time; keep the same pace */
+		if (step_time == 5)
+			step_time = 1;
+
+		duration = step_time * levels;
+	}
+
+	setup_brightness_fade_timeout(duration);
+
+EXIT:
+	return;
+}
+
+/**
+ * Deadline callback for an unused framebuffer prewake
+ *
+ * Policy did not unblank the display; power the framebuffer down again
+ *
+ * @param data Unused
+ */
+static void prewake_timeout_cb(gpointer data)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+
+	(void)data;
+
+	prewake_time = 0;
+	prewake_misses++;
+
+	if (((display_state == MCE_DISPLAY_OFF) ||
+	     (display_state == MCE_DISPLAY_LPM_OFF)) &&
+	    (cached_brightness <= 0))
+		backlight_ioctl(FB_BLANK_POWERDOWN);
+
+	mce_log(LL_DEBUG, "prewake not used; %u hits, %u misses",
+		prewake_hits, prewake_misses);
+}
+
+/**
+ * Account the end of a framebuffer prewake
+ *
+ * @param used TRUE if the display is being unblanked,
+ *             FALSE if it is staying off
+ */
+static void prewake_finish(gboolean used)
+{
+	if (prewake_time == 0)
+		goto EXIT;
+
+	mce_deadline_stop(prewake_deadline);
+
+	if (used == FALSE) {
+		prewake_misses++;
+		goto EXIT;
 	}
 
-	setup_brightness_fade_timeout(step_time);
+	prewake_hits++;
+	prewake_saved += prewake_cost;
+
+	mce_log(LL_INFO, "prewake saved %lld us; started %lld ms "
+		"before unblank; %u hits, %u misses, %lld ms saved in total",
+		(long long)prewake_cost,
+		(long long)((mce_lib_get_time_us(CLOCK_MONOTONIC) -
+			     prewake_time) / 1000),
+		prewake_hits, prewake_misses,
+		(long long)(prewake_saved / 1000));
 
 EXIT:
+	prewake_time = 0;
 	return;
 }
 
@@ -1567,16 +1996,13 @@ EXIT:
  * Timeout callback for display blanking
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean blank_timeout_cb(gpointer data)
+static void blank_timeout_cb(gpointer data)
 {
 	display_state_t display_off_state = MCE_DISPLAY_LPM_OFF;
 
 	(void)data;
 
-	blank_timeout_cb_id = 0;
-
 	if ((use_low_power_mode == FALSE) ||
 	    (low_power_mode_supported == FALSE) ||
 	    (is_dismiss_low_power_mode_enabled() == TRUE))
@@ -1585,8 +2011,6 @@ static gboolean blank_timeout_cb(gpointer data)
 	(void)execute_datapipe(&display_state_pipe,
 			       GINT_TO_POINTER(display_off_state),
 			       USE_INDATA, CACHE_INDATA);
-
-	return FALSE;
 }
 
 /**
@@ -1594,11 +2018,8 @@ static gboolean blank_timeout_cb(gpointer data)
  */
 static void cancel_blank_timeout(void)
 {
-	/* Remove the timeout source for display blanking */
-	if (blank_timeout_cb_id != 0) {
-		g_source_remove(blank_timeout_cb_id);
-		blank_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for display blanking */
+	mce_deadline_stop(blank_deadline);
 }
 
 /**
@@ -1627,8 +2048,7 @@ static void setup_blank_timeout(void)
 		goto EXIT;
 
 	/* Setup new timeout */
-	blank_timeout_cb_id =
-		g_timeout_add_seconds(timeout, blank_timeout_cb, NULL);
+	mce_deadline_start(blank_deadline, timeout * 1000);
 
 EXIT:
 	return;
@@ -1638,19 +2058,14 @@ EXIT:
  * Timeout callback for low power mode proximity blank
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean lpm_proximity_blank_timeout_cb(gpointer data)
+static void lpm_proximity_blank_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	lpm_proximity_blank_timeout_cb_id = 0;
-
 	(void)execute_datapipe(&display_state_pipe,
 			       GINT_TO_POINTER(MCE_DISPLAY_LPM_OFF),
 			       USE_INDATA, CACHE_INDATA);
-
-	return FALSE;
 }
 
 /**
@@ -1658,11 +2073,8 @@ static gboolean lpm_proximity_blank_timeout_cb(gpointer data)
  */
 static void cancel_lpm_proximity_blank_timeout(void)
 {
-	/* Remove the timeout source for low power mode */
-	if (lpm_proximity_blank_timeout_cb_id != 0) {
-		g_source_remove(lpm_proximity_blank_timeout_cb_id);
-		lpm_proximity_blank_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for low power mode */
+	mce_deadline_stop(lpm_proximity_blank_deadline);
 }
 
 /**
@@ -1683,28 +2095,21 @@ static void setup_lpm_proximity_blank_timeout(void)
 	     (call_state == CALL_STATE_ACTIVE)))
 		timeout = 0;
 
-	lpm_proximity_blank_timeout_cb_id =
-		g_timeout_add_seconds(timeout,
-				      lpm_proximity_blank_timeout_cb, NULL);
+	mce_deadline_start(lpm_proximity_blank_deadline, timeout * 1000);
 }
 
 /**
  * Timeout callback for low power mode
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean lpm_timeout_cb(gpointer data)
+static void lpm_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	lpm_timeout_cb_id = 0;
-
 	(void)execute_datapipe(&display_state_pipe,
 			       GINT_TO_POINTER(MCE_DISPLAY_LPM_ON),
 			       USE_INDATA, CACHE_INDATA);
-
-	return FALSE;
 }
 
 /**
@@ -1712,11 +2117,8 @@ static gboolean lpm_timeout_cb(gpointer data)
  */
 static void cancel_lpm_timeout(void)
 {
-	/* Remove the timeout source for low power mode */
-	if (lpm_timeout_cb_id != 0) {
-		g_source_remove(lpm_timeout_cb_id);
-		lpm_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for low power mode */
+	mce_deadline_stop(lpm_deadline);
 }
 
 /**
@@ -1735,9 +2137,7 @@ static void setup_lpm_timeout(void)
 	    ((use_low_power_mode == TRUE) &&
 	     (is_dismiss_low_power_mode_enabled() == FALSE))) {
 		/* Setup new timeout */
-		lpm_timeout_cb_id =
-			g_timeout_add_seconds(disp_lpm_timeout,
-					      lpm_timeout_cb, NULL);
+		mce_deadline_start(lpm_deadline, disp_lpm_timeout * 1000);
 	} else {
 		setup_blank_timeout();
 	}
@@ -1747,16 +2147,12 @@ static void setup_lpm_timeout(void)
  * Timeout callback for adaptive dimming timeout
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean adaptive_dimming_timeout_cb(gpointer data)
+static void adaptive_dimming_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	adaptive_dimming_timeout_cb_id = 0;
 	adaptive_dimming_index = 0;
-
-	return FALSE;
 }
 
 /**
@@ -1764,11 +2160,8 @@ static gboolean adaptive_dimming_timeout_cb(gpointer data)
  */
 static void cancel_adaptive_dimming_timeout(void)
 {
-	/* Remove the timeout source for adaptive dimming */
-	if (adaptive_dimming_timeout_cb_id != 0) {
-		g_source_remove(adaptive_dimming_timeout_cb_id);
-		adaptive_dimming_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for adaptive dimming */
+	mce_deadline_stop(adaptive_dimming_deadline);
 }
 
 /**
@@ -1782,9 +2175,8 @@ static void setup_adaptive_dimming_timeout(void)
 		goto EXIT;
 
 	/* Setup new timeout */
-	adaptive_dimming_timeout_cb_id =
-		g_timeout_add_seconds(adaptive_dimming_threshold,
-				      adaptive_dimming_timeout_cb, NULL);
+	mce_deadline_start(adaptive_dimming_deadline,
+			   adaptive_dimming_threshold);
 
 EXIT:
 	return;
@@ -1794,16 +2186,13 @@ EXIT:
  * Timeout callback for display dimming
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean dim_timeout_cb(gpointer data)
+static void dim_timeout_cb(gpointer data)
 {
 	submode_t submode = mce_get_submode_int32();
 
 	(void)data;
 
-	dim_timeout_cb_id = 0;
-
 	if ((submode & MCE_MALF_SUBMODE) == 0) {
 		(void)execute_datapipe(&display_state_pipe,
 				       GINT_TO_POINTER(MCE_DISPLAY_DIM),
@@ -1816,8 +2205,6 @@ static gboolean dim_timeout_cb(gpointer data)
 				       GINT_TO_POINTER(MCE_DISPLAY_OFF),
 				       USE_INDATA, CACHE_INDATA);
 	}
-
-	return FALSE;
 }
 
 /**
@@ -1825,11 +2212,8 @@ static gboolean dim_timeout_cb(gpointer data)
  */
 static void cancel_dim_timeout(void)
 {
-	/* Remove the timeout source for display dimming */
-	if (dim_timeout_cb_id != 0) {
-		g_source_remove(dim_timeout_cb_id);
-		dim_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for display dimming */
+	mce_deadline_stop(dim_deadline);
 }
 
 /**
@@ -1860,29 +2244,22 @@ static void setup_dim_timeout(void)
 	}
 
 	/* Setup new timeout */
-	dim_timeout_cb_id =
-		g_timeout_add_seconds(dim_timeout,
-				      dim_timeout_cb, NULL);
+	mce_deadline_start(dim_deadline, dim_timeout * 1000);
 }
 
 /**
  * Timeout callback for display blanking pause
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean blank_prevent_timeout_cb(gpointer data)
+static void blank_prevent_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	blank_prevent_timeout_cb_id = 0;
-
 	/* Remove all name monitors for the blanking pause requester */
 	mce_dbus_owner_monitor_remove_all(&blanking_pause_monitor_list);
 
 	update_blanking_inhibit(FALSE);
-
-	return FALSE;
 }
 
 /**
@@ -1890,10 +2267,7 @@ static gboolean blank_prevent_timeout_cb(gpointer data)
  */
 static void cancel_blank_prevent(void)
 {
-	if (blank_prevent_timeout_cb_id != 0) {
-		g_source_remove(blank_prevent_timeout_cb_id);
-		blank_prevent_timeout_cb_id = 0;
-	}
+	mce_deadline_stop(blank_prevent_deadline);
 }
 
 /**
@@ -1905,9 +2279,8 @@ static void request_display_blanking_pause(void)
 	update_blanking_inhibit(TRUE);
 
 	/* Setup new timeout */
-	blank_prevent_timeout_cb_id =
-		g_timeout_add_seconds(blank_prevent_timeout,
-				      blank_prevent_timeout_cb, NULL);
+	mce_deadline_start(blank_prevent_deadline,
+			   blank_prevent_timeout * 1000);
 }
 
 /**
@@ -1963,7 +2336,7 @@ static void update_blanking_inhibit(gboolean timed_inhibit)
 		}
 
 		cancel_blank_prevent();
-	} else if (blank_prevent_timeout_cb_id == 0) {
+	} else if (mce_deadline_is_active(blank_prevent_deadline) == FALSE) {
 		blanking_inhibited = FALSE;
 		dimming_inhibited = FALSE;
 	}
@@ -2253,8 +2626,8 @@ static gboolean send_display_status(DBusMessage *const method_call)
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(msg);
+	/* Send the message; flapping signals are collapsed */
+	status = dbus_send_message_coalesced(msg, 0);
 
 EXIT:
 	return status;
@@ -2283,6 +2656,122 @@ EXIT:
 	return status;
 }
 
+/**
+ * Append display state transition stage statistics to a D-Bus reply
+ *
+ * @param array The array container to append to
+ * @param from Name of the display state being left
+ * @param to Name of the display state being entered
+ * @param name Name of the stage
+ * @param stage The stage statistics
+ */
+static void display_transition_append_stage(DBusMessageIter *array,
+					    const char *from, const char *to,
+					    const char *name,
+					    const display_transition_stage_t *stage)
+{
+	DBusMessageIter item;
+	dbus_uint32_t count = stage->count;
+	dbus_uint64_t total = stage->total;
+	dbus_uint64_t max = stage->max;
+	dbus_uint64_t last = stage->last;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, 0, &item);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &from);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &to);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &count);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &total);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &max);
+	dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &last);
+	dbus_message_iter_close_container(array, &item);
+}
+
+/**
+ * D-Bus callback for the display transition statistics get method call
+ *
+ * Reply is an array of (old state, new state, "policy", "framebuffer"
+ * or "backlight", samples, total delay [us], largest delay [us],
+ * latest delay [us]) structures; stages without samples are left out
+ *
+ * @param msg The D-Bus message to reply to
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean display_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	static const char * const names[DISPLAY_TRANSITION_STATES] = {
+		[MCE_DISPLAY_OFF]     = "off",
+		[MCE_DISPLAY_LPM_OFF] = "lpm_off",
+		[MCE_DISPLAY_LPM_ON]  = "lpm_on",
+		[MCE_DISPLAY_DIM]     = "dim",
+		[MCE_DISPLAY_ON]      = "on",
+	};
+
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array;
+	gint from, to;
+
+	mce_log(LL_DEBUG, "Received display stats get request");
+
+	if (dbus_message_get_no_reply(msg)) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if ((reply = dbus_new_method_reply(msg)) == NULL)
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if (!dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(sssuttt)", &array)) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_DISPLAY_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	for (from = 0; from < DISPLAY_TRANSITION_STATES; from++) {
+		for (to = 0; to < DISPLAY_TRANSITION_STATES; to++) {
+			const display_transition_stats_t *stats =
+				&display_transition_stats[from][to];
+
+			if (stats->policy.count == 0)
+				continue;
+
+			display_transition_append_stage(&array,
+							names[from], names[to],
+							"policy",
+							&stats->policy);
+
+			if (stats->framebuffer.count != 0)
+				display_transition_append_stage(&array,
+								names[from],
+								names[to],
+								"framebuffer",
+								&stats->framebuffer);
+
+			if (stats->backlight.count != 0)
+				display_transition_append_stage(&array,
+								names[from],
+								names[to],
+								"backlight",
+								&stats->backlight);
+		}
+	}
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
 /**
  * D-Bus callback to switch demo mode on or off
  *
@@ -3117,11 +3606,8 @@ static void suspend_init(void)
 
 	/* or fall back to waiting for uptime to reach some minimum value */
 	if( !init_done_watcher ) {
-		struct timespec ts;
-
 		/* Assume that monotonic clock == uptime */
-		if( clock_gettime(CLOCK_MONOTONIC, &ts) == 0 )
-			uptime = ts.tv_sec;
+		uptime = mce_lib_get_time_ms(CLOCK_MONOTONIC) / 1000;
 
 		if( uptime + delay < ready )
 			delay = ready - uptime;
@@ -3156,6 +3642,8 @@ static gpointer display_state_filter(gpointer data)
 	submode_t submode = mce_get_submode_int32();
 	gpointer new_data;
 
+	display_transition_request();
+
 	/* Ignore display on requests during transition to shutdown
          * and reboot, when in acting dead and when system state is unknown
 	 */
@@ -3269,8 +3757,13 @@ static void display_state_trigger(gconstpointer data)
 	if (cached_display_state == display_state)
 		goto EXIT;
 
+	display_transition_decide(cached_display_state, display_state);
+
 	update_high_brightness_mode(cached_hbm_level);
 
+	prewake_finish((display_state != MCE_DISPLAY_OFF) &&
+		       (display_state != MCE_DISPLAY_LPM_OFF));
+
 	switch (display_state) {
 	case MCE_DISPLAY_OFF:
 	case MCE_DISPLAY_LPM_OFF:
@@ -3297,6 +3790,10 @@ static void display_state_trigger(gconstpointer data)
 	 */
 	send_display_status(NULL);
 
+	/* The first display state write ends the boot critical path */
+	if (cached_display_state == MCE_DISPLAY_UNDEF)
+		mce_startup_trace("display state %d", display_state);
+
 	/* Update the cached value */
 	cached_display_state = display_state;
 
@@ -3304,6 +3801,9 @@ static void display_state_trigger(gconstpointer data)
 	update_display_timers(FALSE);
 
 EXIT:
+	/* Requests that did not change the state are not timed */
+	display_transition_request_time = 0;
+
 #ifdef ENABLE_WAKELOCKS
 	suspend_rethink();
 #endif
@@ -3387,7 +3887,7 @@ static void device_inactive_trigger(gconstpointer data)
 		/* Adjust the adaptive dimming timeouts,
 		 * even if we don't use them
 		 */
-		if (adaptive_dimming_timeout_cb_id != 0) {
+		if (mce_deadline_is_active(adaptive_dimming_deadline) == TRUE) {
 			if (g_slist_nth(possible_dim_timeouts,
 					dim_timeout_index +
 					adaptive_dimming_index + 1) != NULL)
@@ -3514,6 +4014,51 @@ static void proximity_sensor_trigger(gconstpointer data)
 	}
 }
 
+/**
+ * Handle display prewake hints
+ *
+ * Powers up the framebuffer with the backlight still off, so that
+ * the power-up is out of the way by the time policy decides to
+ * unblank; if no unblank follows, the prewake deadline reverts it
+ *
+ * @param data Unused
+ */
+static void display_prewake_trigger(gconstpointer data)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	gint64 start;
+
+	(void)data;
+
+	if ((display_state != MCE_DISPLAY_OFF) &&
+	    (display_state != MCE_DISPLAY_LPM_OFF))
+		goto EXIT;
+
+	if (cached_brightness > 0)
+		goto EXIT;
+
+	/* Already powered up; just extend the deadline */
+	if (prewake_time != 0) {
+		mce_deadline_start(prewake_deadline, DISPLAY_PREWAKE_TIMEOUT);
+		goto EXIT;
+	}
+
+	start = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
+	if (backlight_ioctl(FB_BLANK_UNBLANK) == FALSE)
+		goto EXIT;
+
+	prewake_time = start;
+	prewake_cost = mce_lib_get_time_us(CLOCK_MONOTONIC) - start;
+	mce_deadline_start(prewake_deadline, DISPLAY_PREWAKE_TIMEOUT);
+
+	mce_log(LL_DEBUG, "prewake; framebuffer power-up took %lld us",
+		(long long)prewake_cost);
+
+EXIT:
+	return;
+}
+
 /**
  * Handle alarm UI state change
  *
@@ -3545,6 +4090,23 @@ const gchar *g_module_check_init(GModule *module)
 
 	(void)module;
 
+	/* Create the display timers */
+	blank_prevent_deadline =
+		mce_deadline_create("blank_prevent",
+				    blank_prevent_timeout_cb, NULL);
+	adaptive_dimming_deadline =
+		mce_deadline_create("adaptive_dimming",
+				    adaptive_dimming_timeout_cb, NULL);
+	hbm_deadline = mce_deadline_create("hbm", hbm_timeout_cb, NULL);
+	dim_deadline = mce_deadline_create("dim", dim_timeout_cb, NULL);
+	lpm_deadline = mce_deadline_create("lpm", lpm_timeout_cb, NULL);
+	lpm_proximity_blank_deadline =
+		mce_deadline_create("lpm_proximity_blank",
+				    lpm_proximity_blank_timeout_cb, NULL);
+	blank_deadline = mce_deadline_create("blank", blank_timeout_cb, NULL);
+	prewake_deadline = mce_deadline_create("prewake",
+					       prewake_timeout_cb, NULL);
+
 	/* Initialise the display type and the relevant paths */
 	(void)get_display_type();
 
@@ -3593,6 +4155,8 @@ const gchar *g_module_check_init(GModule *module)
 					  proximity_sensor_trigger);
 	append_output_trigger_to_datapipe(&alarm_ui_state_pipe,
 					  alarm_ui_state_trigger);
+	append_output_trigger_to_datapipe(&display_prewake_pipe,
+					  display_prewake_trigger);
 
 	if( !max_brightness_file ) {
 		mce_log(LL_NOTICE,
@@ -3710,6 +4274,14 @@ const gchar *g_module_check_init(GModule *module)
 				 display_orientation_change_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* get_display_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DISPLAY_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 display_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
 	/* Turning demo mode on/off */
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
 				 MCE_DBUS_DEMO_MODE_REQ,
@@ -3883,6 +4455,13 @@ const gchar *g_module_check_init(GModule *module)
 				 MCE_CONF_CONSTANT_TIME_DECREASE,
 				 DEFAULT_BRIGHTNESS_DECREASE_CONSTANT_TIME);
 
+	str = mce_conf_get_string(MCE_CONF_DISPLAY_GROUP,
+				  MCE_CONF_BRIGHTNESS_FADE_CURVE,
+				  "");
+
+	brightness_fade_curve = mce_translate_string_to_int_with_default(brightness_fade_curve_translation, str, DEFAULT_BRIGHTNESS_FADE_CURVE);
+	g_free(str);
+
 	/* Note: Transition to MCE_DISPLAY_OFF can be made already
 	 * here, but the MCE_DISPLAY_ON state is blocked until mCE
 	 * gets notification from DSME */
@@ -3924,6 +4503,8 @@ void g_module_unload(GModule *module)
 	update_display_timers(TRUE);
 
 	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&display_prewake_pipe,
+					    display_prewake_trigger);
 	remove_output_trigger_from_datapipe(&alarm_ui_state_pipe,
 					    alarm_ui_state_trigger);
 	remove_output_trigger_from_datapipe(&proximity_sensor_pipe,
@@ -3964,11 +4545,25 @@ void g_module_unload(GModule *module)
 	g_free(low_power_mode_file);
 
 	/* Remove all timer sources */
-	cancel_blank_prevent();
 	cancel_brightness_fade_timeout();
-	cancel_dim_timeout();
-	cancel_adaptive_dimming_timeout();
-	cancel_blank_timeout();
+
+	/* Delete the display timers */
+	mce_deadline_delete(blank_prevent_deadline);
+	blank_prevent_deadline = NULL;
+	mce_deadline_delete(adaptive_dimming_deadline);
+	adaptive_dimming_deadline = NULL;
+	mce_deadline_delete(hbm_deadline);
+	hbm_deadline = NULL;
+	mce_deadline_delete(dim_deadline);
+	dim_deadline = NULL;
+	mce_deadline_delete(lpm_deadline);
+	lpm_deadline = NULL;
+	mce_deadline_delete(lpm_proximity_blank_deadline);
+	lpm_proximity_blank_deadline = NULL;
+	mce_deadline_delete(blank_deadline);
+	blank_deadline = NULL;
+	mce_deadline_delete(prewake_deadline);
+	prewake_deadline = NULL;
 
 	return;
 }
@@ -42,6 +42,9 @@
 /** Name of the configuration key for the constant time brightness decrease */
 #define MCE_CONF_CONSTANT_TIME_DECREASE		"ConstantTimeDecrease"
 
+/** Name of the configuration key for the brightness fade curve */
+#define MCE_CONF_BRIGHTNESS_FADE_CURVE		"BrightnessFadeCurve"
+
 /** Default brightness increase step-time */
 #define DEFAULT_BRIGHTNESS_INCREASE_STEP_TIME		5
 
@@ -54,6 +57,12 @@
 /** Default brightness decrease constant time */
 #define DEFAULT_BRIGHTNESS_DECREASE_CONSTANT_TIME	3000
 
+/** Shortest interval between brightness fade steps; in milliseconds */
+#define BRIGHTNESS_FADE_MIN_STEP_TIME			16
+
+/** Gamma used for the perceptual brightness fade curve */
+#define BRIGHTNESS_FADE_GAMMA				2.2
+
 /** Default timeout for the high brightness mode; in seconds */
 #define DEFAULT_HBM_TIMEOUT				1800	/* 30 min */
 
@@ -112,9 +121,29 @@
 /** Generic maximum brightness file */
 #define DISPLAY_GENERIC_MAX_BRIGHTNESS_FILE	"/backlight_max"
 
+/** Hardware identity cache key for the backlight found by sysfs probe */
+#define DISPLAY_SYSFS_PROBE_CACHE_KEY		"display_sysfs_probe"
+
 /** Path to the framebuffer device */
 #define FB_DEVICE				"/dev/fb0"
 
+/**
+ * Time to keep the framebuffer powered up after a prewake hint,
+ * if no unblank follows; in milliseconds
+ *
+ * Covers a short power key press and the doublepress delay
+ */
+#define DISPLAY_PREWAKE_TIMEOUT			2500
+
+/**
+ * Time after a display state decision within which the framebuffer
+ * and backlight changes are accounted to it; in milliseconds
+ */
+#define DISPLAY_TRANSITION_WINDOW		5000
+
+/** Name of D-Bus method for getting display transition statistics */
+#define MCE_DISPLAY_STATS_GET			"get_display_stats"
+
 /** Path to the GConf settings for the display */
 #ifndef MCE_GCONF_DISPLAY_PATH
 #define MCE_GCONF_DISPLAY_PATH			"/system/osso/dsm/display"
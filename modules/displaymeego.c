@@ -72,6 +72,7 @@
 					 * ---
 					 * mce_dbus_handler_add(),
 					 * dbus_send_message(),
+					 * dbus_send_message_coalesced(),
 					 * dbus_new_method_reply(),
 					 * dbus_new_signal(),
 					 * dbus_message_append_args(),
@@ -1000,8 +1001,8 @@ static gboolean send_display_status(DBusMessage *const method_call)
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(msg);
+	/* Send the message; flapping signals are collapsed */
+	status = dbus_send_message_coalesced(msg, 0);
 
 EXIT:
 	return status;
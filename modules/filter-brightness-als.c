@@ -42,7 +42,8 @@
 					 * mce_register_io_monitor_chunk(),
 					 * mce_unregister_io_monitor()
 					 */
-#include "mce-lib.h"			/* mce_translate_string_to_int_with_default(),
+#include "mce-lib.h"			/* mce_lib_get_time_ms(),
+					 * mce_translate_string_to_int_with_default(),
 					 * mce_translation_t
 					 */
 #include "mce-hal.h"			/* get_sysinfo_value() */
@@ -80,8 +81,23 @@
 					 * remove_filter_from_datapipe(),
 					 * remove_output_trigger_from_datapipe()
 					 */
-#include "median_filter.h"		/* median_filter_init(),
-					 * median_filter_map()
+#include "mce-power-profile.h"		/* mce_power_profile_get() */
+#include "mce-memstat.h"		/* mce_memstat_alloc(),
+					 * mce_memstat_free()
+					 */
+#include "als_lut.h"			/* als_lut_compile(),
+					 * als_lut_lookup()
+					 */
+#include "sample_filter.h"		/* sample_filter_create(),
+					 * sample_filter_delete(),
+					 * sample_filter_reset(),
+					 * sample_filter_map()
+					 */
+#include "mce-iio.h"			/* mce_iio_exists(),
+					 * mce_iio_read(),
+					 * mce_iio_open(),
+					 * mce_iio_close(),
+					 * mce_iio_sample_t
 					 */
 
 #ifdef ENABLE_HYBRIS
@@ -253,13 +269,12 @@ static als_profile_struct display_als_profiles_rm696[] = {
 	}
 };
 
-/** ALS profile for libhybris use
+/** ALS profile for libhybris and IIO use
  *
  * Semi-automatically generated from display_als_profiles_rm696.
  *
  * FIXME: ok for testing purposes, needs to be revisited
  */
-#ifdef ENABLE_HYBRIS
 static als_profile_struct display_als_profiles_hybris[] =
 {
 	/* Minimum / brightness=1 */
@@ -331,7 +346,6 @@ static als_profile_struct display_als_profiles_hybris[] =
 		{  30,  60, 100, 100, },
 	},
 };
-#endif /* ENABLE_HYBRIS */
 
 /**
  * ALS profile for the display in:
@@ -706,8 +720,29 @@ static gboolean als_poll_active = FALSE;
  */
 #ifdef ENABLE_HYBRIS
 static gint hybris_als_last = 0;
+/** Time stamp of the last libhybris als value [ms] */
+static gint64 hybris_als_time = 0;
 #endif
 
+/** IIO capture for the ALS; NULL when not capturing */
+static mce_iio_t *als_iio = NULL;
+
+/** IIO ALS device name, as reported by the driver */
+static gchar *als_iio_device = NULL;
+
+/** IIO ALS channel */
+static gchar *als_iio_channel = NULL;
+
+/** Last lux value received from the IIO buffer
+ *
+ * Many IIO drivers refuse direct reads while the buffer is enabled,
+ * so the latest buffered value is used instead while capturing
+ */
+static gint als_iio_last = 0;
+
+/** Time stamp of the last buffered IIO lux value [ms] */
+static gint64 als_iio_time = 0;
+
 /** ID for the ALS I/O monitor */
 static gconstpointer als_iomon_id = NULL;
 
@@ -737,8 +772,10 @@ static gint als_threshold_max = -1;
 static gboolean als_available = TRUE;
 /** Filter things through ALS? */
 static gboolean als_enabled = TRUE;
-/** Pass input through a median filter? */
-static gboolean use_median_filter = FALSE;
+/** Sensor specific configuration key for the ALS filter chain */
+static const gchar *als_filter_conf_key = NULL;
+/** Built-in filter chain for the ALS */
+static const gchar *als_filter_default = DEFAULT_ALS_FILTER_CHAIN;
 /** Lux reading from the ALS */
 static gint als_lux = -1;
 /** Lux cache for delayed brightness stepdown */
@@ -749,6 +786,14 @@ static als_profile_struct *display_als_profiles = NULL;
 static als_profile_struct *led_als_profiles = NULL;
 /** ALS profiles for the keyboard backlight */
 static als_profile_struct *kbd_als_profiles = NULL;
+/** Compiled ALS profiles for the display */
+static als_lut_t display_als_lut[ALS_PROFILE_MAXIMUM + 1];
+/** Compiled ALS profile for the LED */
+static als_lut_t led_als_lut;
+/** Compiled ALS profile for the keyboard backlight */
+static als_lut_t kbd_als_lut;
+/** Interpolate the brightness between ALS levels? */
+static gboolean als_interpolate = DEFAULT_ALS_INTERPOLATE;
 /** ALS lower threshold for display brightness */
 static gint display_brightness_lower = -1;
 /** ALS upper threshold for display brightness */
@@ -783,12 +828,18 @@ static gchar *display_id = NULL;
 /** Display state */
 static display_state_t display_state = MCE_DISPLAY_UNDEF;
 
-/** Median filter */
-static median_filter_struct median_filter;
+/** Filter chain for the ALS readings */
+static sample_filter_t *als_filter = NULL;
 
 /** ALS poll interval */
 static gint als_poll_interval = ALS_DISPLAY_ON_POLL_FREQ;
 
+/** Current ALS poll interval, backed off from als_poll_interval */
+static gint als_poll_current = ALS_DISPLAY_ON_POLL_FREQ;
+
+/** Upper limit for the backed off ALS poll interval */
+static gint als_poll_interval_max = DEFAULT_ALS_POLL_INTERVAL_MAX;
+
 /** ID for ALS poll timer source */
 static guint als_poll_timer_cb_id = 0;
 
@@ -819,11 +870,14 @@ typedef enum {
 #ifdef ENABLE_HYBRIS
 	ALS_TYPE_HYBRIS = 5,
 #endif
+	/** Industrial I/O subsystem ALS */
+	ALS_TYPE_IIO = 6,
 } als_type_t;
 
 static void cancel_als_poll_timer(void);
 static void cancel_brightness_delay_timer(void);
-static void als_iomon_common(gint lux, gboolean no_delay);
+static void als_lux_apply(gint new_lux);
+static void als_lux_update(gint new_lux, gboolean no_delay);
 static gboolean set_color_profile(const gchar *id);
 static gboolean save_color_profile(const gchar *id);
 static gboolean is_raw_color_profile_valid(const gint *raw_color_profile,
@@ -929,7 +983,22 @@ static als_type_t get_als_type(void)
 	if (als_type != ALS_TYPE_UNSET)
 		goto EXIT;
 
-	if (g_access(ALS_DEVICE_PATH_AVAGO, R_OK) == 0) {
+	als_iio_device = mce_conf_get_string(MCE_CONF_ALS_GROUP,
+					     MCE_CONF_ALS_IIO_DEVICE,
+					     DEFAULT_ALS_IIO_DEVICE);
+
+	/* An explicitly configured IIO sensor takes precedence */
+	if ((als_iio_device != NULL) && (*als_iio_device != '\0') &&
+	    (mce_iio_exists(als_iio_device) == TRUE)) {
+		als_type = ALS_TYPE_IIO;
+		als_iio_channel = mce_conf_get_string(MCE_CONF_ALS_GROUP,
+						      MCE_CONF_ALS_IIO_CHANNEL,
+						      DEFAULT_ALS_IIO_CHANNEL);
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_IIO;
+
+		/* IIO sensors report plain lux */
+		display_als_profiles = display_als_profiles_hybris;
+	} else if (g_access(ALS_DEVICE_PATH_AVAGO, R_OK) == 0) {
 		als_type = ALS_TYPE_AVAGO;
 		als_device_path = ALS_DEVICE_PATH_AVAGO;
 		als_calib0_output.path = ALS_CALIB_PATH_AVAGO;
@@ -937,7 +1006,7 @@ static als_type_t get_als_type(void)
 		als_threshold_max = ALS_THRESHOLD_MAX_AVAGO;
 		display_als_profiles = display_als_profiles_rm696;
 		led_als_profiles = led_als_profiles_rm696;
-		use_median_filter = FALSE;
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_AVAGO;
 
 		display_cpa_enable_path = COLOUR_PHASE_ENABLE_PATH;
 		display_cpa_coefficients_path = COLOUR_PHASE_COEFFICIENTS_PATH;
@@ -954,7 +1023,7 @@ static als_type_t get_als_type(void)
 		display_als_profiles = display_als_profiles_rm680;
 		led_als_profiles = led_als_profiles_rm680;
 		kbd_als_profiles = kbd_als_profiles_rm680;
-		use_median_filter = FALSE;
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_DIPRO;
 
 		display_cpa_enable_path = COLOUR_PHASE_ENABLE_PATH;
 		display_cpa_coefficients_path = COLOUR_PHASE_COEFFICIENTS_PATH;
@@ -970,7 +1039,8 @@ static als_type_t get_als_type(void)
 		display_als_profiles = display_als_profiles_rx51;
 		led_als_profiles = led_als_profiles_rx51;
 		kbd_als_profiles = kbd_als_profiles_rx51;
-		use_median_filter = TRUE;
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_TSL2563;
+		als_filter_default = DEFAULT_ALS_FILTER_CHAIN_TSL;
 	} else if (g_access(ALS_LUX_PATH_TSL2562, R_OK) == 0) {
 		als_type = ALS_TYPE_TSL2562;
 		als_lux_path = ALS_LUX_PATH_TSL2562;
@@ -979,11 +1049,13 @@ static als_type_t get_als_type(void)
 		display_als_profiles = display_als_profiles_rx44;
 		led_als_profiles = led_als_profiles_rx44;
 		kbd_als_profiles = kbd_als_profiles_rx44;
-		use_median_filter = TRUE;
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_TSL2562;
+		als_filter_default = DEFAULT_ALS_FILTER_CHAIN_TSL;
 	}
 #ifdef ENABLE_HYBRIS
 	else if( mce_hybris_als_init() ) {
 		als_type = ALS_TYPE_HYBRIS;
+		als_filter_conf_key = MCE_CONF_ALS_FILTER_CHAIN_HYBRIS;
 
 		// FIXME: uses rm696 profile data, need real ones
 		display_als_profiles = display_als_profiles_hybris;
@@ -1078,51 +1150,57 @@ EXIT:
 }
 
 /**
- * Use the ALS profiles to calculate proper ALS modified values;
- * also reprogram the sensor thresholds if the sensor supports such
+ * Compile an ALS profile into a lookup table
  *
- * @param profiles The profile struct to use for calculations
- * @param profile The profile to use
- * @param lux The lux value
- * @param[in,out] level The old level; will be replaced by the new level
- * @param[out] lower The new lower ALS interrupt threshold
- * @param[out] upper The new upper ALS interrupt threshold
- * @return The brightness in % of maximum
+ * @param[out] lut The lookup table to fill in
+ * @param profile The profile to compile
  */
-static gint filter_data(als_profile_struct *profiles, als_profile_t profile,
-			gint lux, gint *level, gint *lower, gint *upper)
+static void compile_profile(als_lut_t *lut, const als_profile_struct *profile)
 {
-	gint tmp = *level;
-	gint i;
-
-	if (tmp == -1)
-		tmp = 0;
-	else if (tmp > ALS_RANGES)
-		tmp = ALS_RANGES;
-
-	for (i = 0; i < ALS_RANGES; i++) {
-		*level = i;
+	if (als_lut_compile(lut, profile) == FALSE) {
+		/* This is a programming error! */
+		mce_log(LL_CRIT, "ALS profile lacks terminating { -1, -1 }");
+	}
+}
 
-		if (profiles[profile].range[i][0] == -1)
-			break;
+/**
+ * Compile the ALS profiles of the detected sensor
+ */
+static void als_luts_compile(void)
+{
+	gint i;
 
-		if (lux < profiles[profile].range[i][(((i + 1) - tmp) > 0) ? 1 : 0])
-			break;
+	if (display_als_profiles != NULL) {
+		for (i = ALS_PROFILE_MINIMUM; i <= ALS_PROFILE_MAXIMUM; i++)
+			compile_profile(&display_als_lut[i],
+					&display_als_profiles[i]);
 	}
 
-	*lower = (i == 0) ? 0 : profiles[profile].range[i - 1][0];
+	/* XXX: the LED and keyboard always use the NORMAL profile */
+	if (led_als_profiles != NULL)
+		compile_profile(&led_als_lut,
+				&led_als_profiles[ALS_PROFILE_NORMAL]);
 
-	if (i >= ALS_RANGES) {
-		/* This is a programming error! */
-		mce_log(LL_CRIT,
-			"The ALS profile %d lacks terminating { -1, -1 }",
-			profile);
-		*upper = als_threshold_max;
-	} else {
-		*upper = (profiles[profile].range[i][1] == -1) ? als_threshold_max : profiles[profile].range[i][1];
-	}
+	if (kbd_als_profiles != NULL)
+		compile_profile(&kbd_als_lut,
+				&kbd_als_profiles[ALS_PROFILE_NORMAL]);
+}
 
-	return profiles[profile].value[*level];
+/**
+ * Use a compiled ALS profile to calculate proper ALS modified values
+ *
+ * @param lut The compiled profile to use
+ * @param lux The lux value
+ * @param[in,out] level The old level; will be replaced by the new level
+ * @param[out] lower The new lower ALS interrupt threshold
+ * @param[out] upper The new upper ALS interrupt threshold
+ * @return The brightness in % of maximum
+ */
+static gint filter_data(const als_lut_t *lut, gint lux,
+			gint *level, gint *lower, gint *upper)
+{
+	return als_lut_lookup(lut, lux, als_interpolate, als_threshold_max,
+			      level, lower, upper);
 }
 
 /**
@@ -1158,7 +1236,7 @@ static gpointer display_brightness_filter(gpointer data)
 		/* Not true percentage,
 		 * since this value may be boosted by high brightness mode
 		 */
-		gint percentage = filter_data(display_als_profiles, raw,
+		gint percentage = filter_data(&display_als_lut[raw],
 					      als_lux, &display_als_level,
 					      &display_brightness_lower,
 					      &display_brightness_upper);
@@ -1188,8 +1266,7 @@ static gpointer led_brightness_filter(gpointer data)
 
 	if ((als_enabled == TRUE) && (led_als_profiles != NULL)) {
 		/* XXX: this always uses the NORMAL profile */
-		gint percentage = filter_data(led_als_profiles,
-					      ALS_PROFILE_NORMAL,
+		gint percentage = filter_data(&led_als_lut,
 					      als_lux, &led_als_level,
 					      &led_brightness_lower,
 					      &led_brightness_upper);
@@ -1215,8 +1292,7 @@ static gpointer key_backlight_filter(gpointer data)
 
 	if ((als_enabled == TRUE) && (kbd_als_profiles != NULL)) {
 		/* XXX: this always uses the NORMAL profile */
-		gint percentage = filter_data(kbd_als_profiles,
-					      ALS_PROFILE_NORMAL,
+		gint percentage = filter_data(&kbd_als_lut,
 					      als_lux, &kbd_als_level,
 					      &kbd_brightness_lower,
 					      &kbd_brightness_upper);
@@ -1229,43 +1305,69 @@ static gpointer key_backlight_filter(gpointer data)
 }
 
 /**
- * Wrapper function for median_filter_init()
+ * Create or reset the ALS filter chain
  *
- * @return TRUE on success, FALSE on failure
+ * The chain is read from the configuration the first time around;
+ * the sensor specific key takes precedence over the generic one.
+ * Later calls just discard the filter state
  */
-static gboolean als_median_filter_init(void)
+static void als_filter_init(void)
 {
-	gboolean status = TRUE;
+	const gchar *spec;
 
-	if (use_median_filter == FALSE)
+	if (als_filter != NULL) {
+		sample_filter_reset(als_filter);
 		goto EXIT;
+	}
 
-	/* Re-initialise the median filter */
-	if (median_filter_init(&median_filter,
-			       MEDIAN_FILTER_WINDOW_SIZE) == FALSE) {
-		mce_log(LL_CRIT, "median_filter_init() failed");
-		als_enabled = FALSE;
-		status = FALSE;
+	spec = mce_conf_peek_string(MCE_CONF_ALS_GROUP,
+				    MCE_CONF_ALS_FILTER_CHAIN,
+				    als_filter_default);
+
+	if (als_filter_conf_key != NULL)
+		spec = mce_conf_peek_string(MCE_CONF_ALS_GROUP,
+					    als_filter_conf_key, spec);
+
+	mce_log(LL_DEBUG, "ALS filter chain: `%s'", spec);
+
+	if ((als_filter = sample_filter_create(spec)) == NULL) {
+		mce_log(LL_WARN, "Invalid ALS filter chain `%s'; "
+			"using `%s'", spec, als_filter_default);
+		als_filter = sample_filter_create(als_filter_default);
 	}
 
 EXIT:
-	return status;
+	return;
 }
 
 /**
- * Wrapper function for median_filter_map()
+ * Pass a value through the ALS filter chain
  *
+ * @param time The time of the sample [ms]
  * @param value The value to insert
- * @return The filtered value
+ * @return The filtered value, or -1 if the filter dropped the sample
  */
-static gint als_median_filter_map(gint value)
+static gint als_filter_map(gint64 time, gint value)
 {
-	return (use_median_filter == TRUE) ?
-		median_filter_map(&median_filter, value) : value;
+	gdouble filtered = value;
+
+	if (als_filter == NULL)
+		goto EXIT;
+
+	if (sample_filter_map(als_filter, time, &filtered) == FALSE) {
+		mce_log(LL_DEBUG, "ALS filter dropped lux %d", value);
+		value = -1;
+		goto EXIT;
+	}
+
+	value = CLAMP(filtered + 0.5, 0, G_MAXINT);
+
+EXIT:
+	return value;
 }
 
 /**
- * Read a value from the ALS and update the median filter
+ * Read a value from the ALS and update the ALS filter
  *
  * @return the filtered result of the read,
  *         -1 on failure,
@@ -1275,6 +1377,7 @@ static gint als_read_value_filtered(void)
 {
 	gint filtered_read = -2;
 	void *tmp = NULL;
+	gint64 time = mce_lib_get_time_ms(CLOCK_MONOTONIC);
 	gulong lux;
 
 	if (als_enabled == FALSE)
@@ -1330,9 +1433,23 @@ static gint als_read_value_filtered(void)
 	else if( get_als_type() == ALS_TYPE_HYBRIS ) {
 		mce_log(LL_DEBUG, "faking lux read = %d", hybris_als_last);
 		lux = hybris_als_last;
+		time = hybris_als_time;
 	}
 #endif
-	else {
+	else if (get_als_type() == ALS_TYPE_IIO) {
+		gdouble value = 0.0;
+
+		if (als_iio != NULL) {
+			lux = als_iio_last;
+			time = als_iio_time;
+		} else if (mce_iio_read(als_iio_device, als_iio_channel,
+					&value) == TRUE) {
+			lux = CLAMP(value + 0.5, 0, G_MAXINT);
+		} else {
+			filtered_read = -1;
+			goto EXIT;
+		}
+	} else {
 		/* Read lux value from ALS */
 		if (mce_read_number_string_from_file(als_lux_path,
 						     &lux, &als_fp,
@@ -1342,7 +1459,7 @@ static gint als_read_value_filtered(void)
 		}
 	}
 
-	filtered_read = als_median_filter_map(lux);
+	filtered_read = als_filter_map(time, lux);
 
 EXIT:
 	g_free(tmp);
@@ -1403,19 +1520,138 @@ EXIT:
 	return;
 }
 
+/**
+ * Get the colour phase level for a lux value
+ *
+ * @param lux The lux value
+ * @return The colour phase profile index,
+ *         -1 if there is no profile or no level for the lux value
+ */
+static gint display_cpa_level(gint lux)
+{
+	gint level = -1;
+	gint i;
+
+	if (display_cpa_profile() == NULL)
+		goto EXIT;
+
+	for (i = 0; display_cpa_profile()[i].range[0] != -1; i++) {
+		if ((lux >= display_cpa_profile()[i].range[0]) &&
+		    ((lux < display_cpa_profile()[i].range[1]) ||
+		     (display_cpa_profile()[i].range[1] == -1))) {
+			level = i;
+			break;
+		}
+	}
+
+EXIT:
+	return level;
+}
+
+/**
+ * Get the lux range within which no brightness level changes
+ *
+ * @param[out] lower The largest of the lower thresholds
+ * @param[out] upper The smallest of the upper thresholds
+ */
+static void als_get_thresholds(gint *lower, gint *upper)
+{
+	/* The lower threshold is the largest of the lower thresholds */
+	*lower = display_brightness_lower;
+
+	if (led_als_profiles != NULL)
+		*lower = MAX(*lower, led_brightness_lower);
+
+	if (kbd_als_profiles != NULL)
+		*lower = MAX(*lower, kbd_brightness_lower);
+
+	/* The upper threshold is the smallest of the upper thresholds */
+	*upper = display_brightness_upper;
+
+	if (led_als_profiles != NULL)
+		*upper = MIN(*upper, led_brightness_upper);
+
+	if (kbd_als_profiles != NULL)
+		*upper = MIN(*upper, kbd_brightness_upper);
+}
+
+/**
+ * Check whether a lux value is outside the current brightness steps
+ *
+ * @param lux The new lux value
+ * @return TRUE if the brightness or colour phase level would change,
+ *         FALSE if the lux value is within the current levels
+ */
+static gboolean als_lux_crosses_step(gint lux)
+{
+	gboolean crosses = TRUE;
+	gint lower;
+	gint upper;
+
+	/* No levels have been chosen yet, or the brightness
+	 * follows the lux within the levels too
+	 */
+	if ((display_brightness_lower == -1) || (als_interpolate == TRUE))
+		goto EXIT;
+
+	als_get_thresholds(&lower, &upper);
+
+	if ((lux < lower) || (lux >= upper))
+		goto EXIT;
+
+	if (display_cpa_level(lux) != display_cpa_level(als_lux))
+		goto EXIT;
+
+	crosses = FALSE;
+
+EXIT:
+	return crosses;
+}
+
+/**
+ * Adjust the ALS poll interval after a reading
+ *
+ * The interval doubles while the readings stay within the current
+ * brightness levels, up to als_poll_interval_max, and snaps back to
+ * als_poll_interval as soon as a level changes
+ *
+ * @param changed TRUE if the last reading changed the brightness level
+ * @return TRUE if the poll interval changed, FALSE otherwise
+ */
+static gboolean als_poll_backoff(gboolean changed)
+{
+	gboolean status = FALSE;
+	gint interval = als_poll_interval;
+
+	if ((changed == FALSE) && (als_poll_interval_max > als_poll_interval))
+		interval = MIN(als_poll_current * 2, als_poll_interval_max);
+
+	if (interval == als_poll_current)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "ALS poll interval %d -> %d ms",
+		als_poll_current, interval);
+	als_poll_current = interval;
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
 /**
  * Timer callback for polling of the Ambient Light Sensor
  *
  * @param data Unused
- * @return Always returns TRUE, for continuous polling,
-           unless the ALS is disabled
+ * @return TRUE for continuous polling at the same interval,
+ *         FALSE if the ALS is disabled or the timer was rearmed
+ *         with a new interval
  */
 static gboolean als_poll_timer_cb(gpointer data)
 {
 	gboolean status = FALSE;
+	gboolean changed = FALSE;
+	gboolean rearm = FALSE;
 	gint new_lux;
-	gint lower;
-	gint upper;
 
 	(void)data;
 
@@ -1432,70 +1668,32 @@ static gboolean als_poll_timer_cb(gpointer data)
 	    ((als_lux == new_lux) && (display_brightness_lower != -1)))
 		goto EXIT2;
 
-	als_lux = new_lux;
-
-	/* Re-filter the brightness */
-	(void)execute_datapipe(&display_brightness_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-	(void)execute_datapipe(&led_brightness_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-	(void)execute_datapipe(&key_backlight_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-
-	/* Adjust the colour phase coefficients */
-	if (display_cpa_profile() != NULL) {
-		gint level = -1;
-		gint i;
-
-		for (i = 0; display_cpa_profile()[i].range[0] != -1; i++) {
-			if ((als_lux >= display_cpa_profile()[i].range[0]) &&
-			    ((als_lux < display_cpa_profile()[i].range[1]) ||
-			     (display_cpa_profile()[i].range[1] == -1))) {
-				level = i;
-				break;
-			}
-		}
-
-		if (level != -1) {
-			mce_write_string_to_file(display_cpa_coefficients_path, display_cpa_profile()[level].coefficients);
-
-			/* If this is the first time we adjust the colour phase
-			 * coefficients, enable cpa adjustment
-			 */
-			if (display_cpa_enabled == FALSE) {
-				mce_write_string_to_file(display_cpa_enable_path, "1");
-			}
-		}
+	/* Skip recomputing while the lux stays within the current levels */
+	if (als_lux_crosses_step(new_lux) == FALSE) {
+		als_lux = new_lux;
+		goto EXIT2;
 	}
 
-	/* The lower threshold is the largest of the lower thresholds */
-	lower = display_brightness_lower;
-
-	if (led_als_profiles != NULL)
-		lower = MAX(lower, led_brightness_lower);
-
-	if (kbd_als_profiles != NULL)
-		lower = MAX(lower, kbd_brightness_lower);
-
-	/* The upper threshold is the smallest of the upper thresholds */
-	upper = display_brightness_upper;
-
-	if (led_als_profiles != NULL)
-		upper = MIN(upper, led_brightness_upper);
-
-	if (kbd_als_profiles != NULL)
-		upper = MIN(upper, kbd_brightness_upper);
-
-	if (als_external_refcount == 0)
-		adjust_als_thresholds(lower, upper);
+	als_lux_apply(new_lux);
+	changed = TRUE;
 
 EXIT2:
 	status = TRUE;
 
+	/* Back off while the readings are stable */
+	if (als_poll_backoff(changed) == TRUE) {
+		status = FALSE;
+		rearm = TRUE;
+	}
+
 EXIT:
 	if (status == FALSE)
 		als_poll_timer_cb_id = 0;
 
+	if (rearm == TRUE)
+		als_poll_timer_cb_id = g_timeout_add(als_poll_current,
+						     als_poll_timer_cb, NULL);
+
 	return status;
 }
 
@@ -1513,26 +1711,63 @@ static gboolean brightness_delay_timer_cb(gpointer data)
 
 	brightness_delay_timer_cb_id = 0;
 	/* No delay for lux setting this time, as we already waited. */
-	als_iomon_common(delayed_lux, TRUE);
+	als_lux_update(delayed_lux, TRUE);
 
 	return status;
 }
 
 /**
- * I/O monitor callback for the Ambient Light Sensor
+ * Take a new filtered lux value into use
  *
- * @param lux The lux value
- * @param no_delay If TRUE, do not use stepdown delay
+ * Re-filter the brightness, adjust the colour phase
+ * and reprogram the ALS thresholds
+ *
+ * @param new_lux The filtered lux value
  */
-static void als_iomon_common(gint lux, gboolean no_delay)
+static void als_lux_apply(gint new_lux)
 {
-	cover_state_t proximity_sensor_state =
-				datapipe_get_gint(proximity_sensor_pipe);
-	gint new_lux;
+	gint level;
 	gint lower;
 	gint upper;
 
-	new_lux = als_median_filter_map(lux);
+	als_lux = new_lux;
+
+	/* Re-filter the brightness once the ALS readings settle */
+	execute_datapipe_deferred(&display_brightness_pipe, NULL,
+				  USE_CACHE, DONT_CACHE_INDATA);
+	execute_datapipe_deferred(&led_brightness_pipe, NULL,
+				  USE_CACHE, DONT_CACHE_INDATA);
+	execute_datapipe_deferred(&key_backlight_pipe, NULL,
+				  USE_CACHE, DONT_CACHE_INDATA);
+
+	/* Adjust the colour phase coefficients */
+	if ((level = display_cpa_level(als_lux)) != -1) {
+		mce_write_string_to_file(display_cpa_coefficients_path, display_cpa_profile()[level].coefficients);
+
+		/* If this is the first time we adjust the colour phase
+		 * coefficients, enable cpa adjustment
+		 */
+		if (display_cpa_enabled == FALSE) {
+			mce_write_string_to_file(display_cpa_enable_path, "1");
+		}
+	}
+
+	als_get_thresholds(&lower, &upper);
+
+	if (als_external_refcount == 0)
+		adjust_als_thresholds(lower, upper);
+}
+
+/**
+ * Handle a new filtered lux value from the Ambient Light Sensor
+ *
+ * @param new_lux The filtered lux value, -1 if there is none
+ * @param no_delay If TRUE, do not use stepdown delay
+ */
+static void als_lux_update(gint new_lux, gboolean no_delay)
+{
+	cover_state_t proximity_sensor_state =
+				datapipe_get_gint(proximity_sensor_pipe);
 
 	/* There's no point in readjusting the brightness
 	 * if the read failed; also no readjustment is needed
@@ -1550,6 +1785,15 @@ static void als_iomon_common(gint lux, gboolean no_delay)
 	if (proximity_sensor_state == COVER_CLOSED)
 		goto EXIT;
 
+	/* Nothing to recompute while the lux stays within the
+	 * current levels; this also discards a pending step-down
+	 */
+	if (als_lux_crosses_step(new_lux) == FALSE) {
+		cancel_brightness_delay_timer();
+		als_lux = new_lux;
+		goto EXIT;
+	}
+
 	/* Step-down is delayed */
 	if (als_lux > new_lux) {
 		if (no_delay == FALSE) {
@@ -1561,7 +1805,7 @@ static void als_iomon_common(gint lux, gboolean no_delay)
 					g_timeout_add_seconds(brightness_stepdown_delay,
 										  brightness_delay_timer_cb, NULL);
 			}
-			delayed_lux = lux;
+			delayed_lux = new_lux;
 			goto EXIT;
 		}
 	} else {
@@ -1569,68 +1813,22 @@ static void als_iomon_common(gint lux, gboolean no_delay)
 		cancel_brightness_delay_timer();
 	}
 
-	als_lux = new_lux;
-
-	/* Re-filter the brightness */
-	(void)execute_datapipe(&display_brightness_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-	(void)execute_datapipe(&led_brightness_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-	(void)execute_datapipe(&key_backlight_pipe, NULL,
-			       USE_CACHE, DONT_CACHE_INDATA);
-
-	/* Adjust the colour phase coefficients */
-	if (display_cpa_profile() != NULL) {
-		gint level = -1;
-		gint i;
-
-		for (i = 0; display_cpa_profile()[i].range[0] != -1; i++) {
-			if ((als_lux >= display_cpa_profile()[i].range[0]) &&
-			    ((als_lux < display_cpa_profile()[i].range[1]) ||
-			     (display_cpa_profile()[i].range[1] == -1))) {
-				level = i;
-				break;
-			}
-		}
-
-		if (level != -1) {
-			mce_write_string_to_file(display_cpa_coefficients_path, display_cpa_profile()[level].coefficients);
-
-			/* If this is the first time we adjust the colour phase
-			 * coefficients, enable cpa adjustment
-			 */
-			if (display_cpa_enabled == FALSE) {
-				mce_write_string_to_file(display_cpa_enable_path, "1");
-			}
-		}
-	}
-
-	/* The lower threshold is the largest of the lower thresholds */
-	lower = display_brightness_lower;
-
-	if (led_als_profiles != NULL)
-		lower = MAX(lower, led_brightness_lower);
-
-	if (kbd_als_profiles != NULL)
-		lower = MAX(lower, kbd_brightness_lower);
-
-	/* The upper threshold is the smallest of the upper thresholds */
-	upper = display_brightness_upper;
-
-	if (led_als_profiles != NULL)
-		upper = MIN(upper, led_brightness_upper);
-
-	if (kbd_als_profiles != NULL)
-		upper = MIN(upper, kbd_brightness_upper);
-
-	if (als_external_refcount == 0)
-		adjust_als_thresholds(lower, upper);
-
+	als_lux_apply(new_lux);
 
 EXIT:
 	return;
 }
 
+/**
+ * I/O monitor callback for the Ambient Light Sensor
+ *
+ * @param time The time of the reading [ms]
+ * @param lux The lux value
+ */
+static void als_iomon_common(gint64 time, gint lux)
+{
+	als_lux_update(als_filter_map(time, lux), FALSE);
+}
 
 /**
  * I/O monitor callback for the Dipro Ambient Light Sensor
@@ -1652,7 +1850,7 @@ static gboolean als_dipro_iomon_cb(gpointer data, gsize bytes_read)
 
 	als = data;
 
-	als_iomon_common(als->lux, FALSE);
+	als_iomon_common(mce_lib_get_time_ms(CLOCK_MONOTONIC), als->lux);
 
 EXIT:
 	return FALSE;
@@ -1683,9 +1881,9 @@ static gboolean als_avago_iomon_cb(gpointer data, gsize bytes_read)
 		goto EXIT;
 
 	if ((als->status & APDS990X_ALS_SATURATED) != 0) {
-		als_iomon_common(G_MAXINT, FALSE);
+		als_iomon_common(mce_lib_get_time_ms(CLOCK_MONOTONIC), G_MAXINT);
 	} else {
-		als_iomon_common(als->lux, FALSE);
+		als_iomon_common(mce_lib_get_time_ms(CLOCK_MONOTONIC), als->lux);
 	}
 
 EXIT:
@@ -1694,7 +1892,7 @@ EXIT:
 
 /** Libhybris ALS monitor callback
  *
- * @param timestamp time of event from android adaptation
+ * @param timestamp time of event from android adaptation [ns]
  * @param light     ambient light value in lux
  */
 #ifdef ENABLE_HYBRIS
@@ -1702,10 +1900,67 @@ static void als_hybris_iomon_cb(int64_t timestamp, float light)
 {
 	mce_log(LL_DEBUG, "time:%lld lux:%g", timestamp, light);
 	hybris_als_last = (gint)(light + 0.5f);
-	als_iomon_common(hybris_als_last, FALSE);
+	hybris_als_time = timestamp / 1000000;
+	als_iomon_common(hybris_als_time, hybris_als_last);
 }
 #endif
 
+/**
+ * Batch callback for the IIO Ambient Light Sensor
+ *
+ * All the samples go through the filter chain in order,
+ * but the brightness is only updated once per batch
+ *
+ * @param samples The samples, oldest first
+ * @param count The number of samples
+ * @param user_data Unused
+ */
+static void als_iio_batch_cb(const mce_iio_sample_t *samples, gsize count,
+			     gpointer user_data)
+{
+	gint new_lux = -1;
+	gsize i;
+
+	(void)user_data;
+
+	for (i = 0; i < count; i++) {
+		gint lux;
+
+		als_iio_last = CLAMP(samples[i].value + 0.5, 0, G_MAXINT);
+		als_iio_time = samples[i].time / 1000000;
+
+		if ((lux = als_filter_map(als_iio_time, als_iio_last)) != -1)
+			new_lux = lux;
+	}
+
+	mce_log(LL_DEBUG, "IIO batch of %zu samples; lux = %d",
+		count, new_lux);
+
+	als_lux_update(new_lux, FALSE);
+}
+
+/**
+ * Start IIO buffered capture for the Ambient Light Sensor
+ */
+static void als_iio_start(void)
+{
+	gchar *trigger = mce_conf_get_string(MCE_CONF_ALS_GROUP,
+					     MCE_CONF_ALS_IIO_TRIGGER,
+					     DEFAULT_ALS_IIO_TRIGGER);
+	gint watermark = mce_conf_get_int(MCE_CONF_ALS_GROUP,
+					  MCE_CONF_ALS_IIO_WATERMARK,
+					  DEFAULT_ALS_IIO_WATERMARK);
+
+	als_iio = mce_iio_open(als_iio_device, als_iio_channel, trigger,
+			       MAX(watermark, 1), als_iio_batch_cb, NULL);
+
+	if (als_iio == NULL)
+		mce_log(LL_WARN, "IIO capture from `%s' failed",
+			als_iio_device);
+
+	g_free(trigger);
+}
+
 /**
  * Cancel Ambient Light Sensor poll timer
  */
@@ -1733,6 +1988,12 @@ static void cancel_als_poll_timer(void)
 	}
 #endif
 
+	/* Stop IIO buffered capture */
+	if (als_iio != NULL) {
+		mce_iio_close(als_iio);
+		als_iio = NULL;
+	}
+
 	/* No io monitors, timers or hooks in use */
 	als_poll_active = FALSE;
 }
@@ -1790,12 +2051,17 @@ static void setup_als_poll_timer(void)
 		break;
 #endif
 
+	case ALS_TYPE_IIO:
+		als_iio_start();
+		break;
+
 	default:
 		/* Setup new timer;
 		 * for light sensors that we don't use I/O monitor for
 		 */
 		old_poll_interval = als_poll_interval;
-		als_poll_timer_cb_id = g_timeout_add(als_poll_interval,
+		als_poll_current = als_poll_interval;
+		als_poll_timer_cb_id = g_timeout_add(als_poll_current,
 						     als_poll_timer_cb, NULL);
 		break;
 	}
@@ -1816,19 +2082,10 @@ static void cancel_brightness_delay_timer(void)
 }
 
 /**
- * Handle display state change
- *
- * @param data The display stated stored in a pointer
+ * Update the ALS poll interval for the display state and power profile
  */
-static void display_state_trigger(gconstpointer data)
+static void als_update_poll_interval(void)
 {
-	static display_state_t old_display_state = MCE_DISPLAY_UNDEF;
-	display_state = GPOINTER_TO_INT(data);
-
-	if (als_enabled == FALSE)
-		goto EXIT;
-
-	/* Update poll timeout */
 	switch (display_state) {
 	case MCE_DISPLAY_OFF:
 	case MCE_DISPLAY_LPM_OFF:
@@ -1847,7 +2104,48 @@ static void display_state_trigger(gconstpointer data)
 		break;
 	}
 
-	/* Re-fill the median filter */
+	als_poll_interval *= mce_power_profile_get()->als_poll_scale;
+}
+
+/**
+ * Handle power profile change
+ *
+ * @param data Unused
+ */
+static void power_profile_trigger(gconstpointer data)
+{
+	(void)data;
+
+	if (als_enabled == FALSE)
+		goto EXIT;
+
+	als_update_poll_interval();
+
+	/* Only timer based polling depends on the interval */
+	if (als_poll_timer_cb_id != 0)
+		setup_als_poll_timer();
+
+EXIT:
+	return;
+}
+
+/**
+ * Handle display state change
+ *
+ * @param data The display stated stored in a pointer
+ */
+static void display_state_trigger(gconstpointer data)
+{
+	static display_state_t old_display_state = MCE_DISPLAY_UNDEF;
+	display_state = GPOINTER_TO_INT(data);
+
+	if (als_enabled == FALSE)
+		goto EXIT;
+
+	/* Update poll timeout */
+	als_update_poll_interval();
+
+	/* Re-fill the ALS filter */
 	if (((old_display_state == MCE_DISPLAY_OFF) ||
 	     (old_display_state == MCE_DISPLAY_LPM_OFF) ||
 	     (old_display_state == MCE_DISPLAY_LPM_ON)) &&
@@ -1858,9 +2156,8 @@ static void display_state_trigger(gconstpointer data)
 		cancel_als_poll_timer();
 
 #ifdef ALS_DISPLAY_OFF_FLUSH_FILTER
-		/* Re-initialise the median filter */
-		if (als_median_filter_init() == FALSE)
-			goto EXIT;
+		/* Re-initialise the ALS filter */
+		als_filter_init();
 #endif /* ALS_DISPLAY_OFF_FLUSH_FILTER */
 
 		/* Read lux value from ALS */
@@ -2307,14 +2604,42 @@ static void free_dynamic_color_profile(cpa_profile_struct *color_profile)
 	g_free(color_profile);
 }
 
+/**
+ * Get the memory used by a loaded color profile
+ *
+ * @param entry The color profile
+ * @return The size of the profile and the data it owns [bytes]
+ */
+static gsize color_profile_size(const cpa_profile_entry *entry)
+{
+	gsize size = sizeof *entry + strlen(entry->name) + 1;
+	gint i;
+
+	for (i = 0; entry->profiles[i].coefficients != NULL; i++)
+		size += (sizeof entry->profiles[i] +
+			 strlen(entry->profiles[i].coefficients) + 1);
+
+	/* The terminating entry */
+	return size + sizeof entry->profiles[i];
+}
+
+/**
+ * Free the list of loaded color profiles
+ *
+ * @param profiles The list of cpa_profile_entry
+ */
 static void free_color_profiles(GSList *profiles)
 {
 	for (; profiles != NULL;
 	     profiles = g_slist_delete_link(profiles, profiles)) {
 		cpa_profile_entry *entry = profiles->data;
 
+		mce_memstat_free("als:color-profiles",
+				 color_profile_size(entry));
+
 		g_free(entry->name);
 		free_dynamic_color_profile(entry->profiles);
+		g_free(entry);
 	}
 }
 
@@ -2392,7 +2717,7 @@ static gboolean set_color_profile(const gchar *id)
 	display_cpa_profile_dynamic = color_profile->profiles;
 
 	display_brightness_lower = -1; /* To force readjustment */
-	als_iomon_common(als_lux, TRUE);
+	als_lux_update(als_lux, TRUE);
 
 	send_current_color_profile(NULL);
 
@@ -2491,7 +2816,7 @@ static gboolean init_color_profiles(void)
 					      &num_color_profile_ids);
 
 	for (i = 0; i < num_color_profile_ids; i++) {
-		cpa_profile_entry *entry = g_new0(cpa_profile_entry, 1);
+		cpa_profile_entry *entry;
 		guint n_profiles;
 		guint j;
 		gint *raw_cp = NULL;
@@ -2511,6 +2836,8 @@ static gboolean init_color_profiles(void)
 
 		status = TRUE;
 
+		entry = g_new0(cpa_profile_entry, 1);
+
 		n_profiles = raw_cp_length / 12;
 		entry->profiles = g_new0(cpa_profile_struct, n_profiles + 1);
 
@@ -2538,6 +2865,8 @@ static gboolean init_color_profiles(void)
 
 		display_cpa_profiles = g_slist_append(display_cpa_profiles,
 						      entry);
+		mce_memstat_alloc("als:color-profiles",
+				  color_profile_size(entry));
 
 		g_free(raw_cp);
 	}
@@ -2601,6 +2930,8 @@ const gchar *g_module_check_init(GModule *module)
 				  key_backlight_filter);
 	append_output_trigger_to_datapipe(&display_state_pipe,
 					  display_state_trigger);
+	append_output_trigger_to_datapipe(&power_profile_pipe,
+					  power_profile_trigger);
 
 	/* req_als_enable */
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
@@ -2657,6 +2988,13 @@ const gchar *g_module_check_init(GModule *module)
 
 	(void)get_als_type();
 
+	/* Compile the ALS profiles once for all lookups */
+	als_luts_compile();
+
+	als_interpolate = mce_conf_get_bool(MCE_CONF_ALS_GROUP,
+					    MCE_CONF_ALS_INTERPOLATE,
+					    DEFAULT_ALS_INTERPOLATE);
+
 	if ((display_cpa_profile_static != NULL) &&
 	    (init_display_id() != FALSE) &&
 	    (init_color_profiles() != FALSE)) {
@@ -2680,14 +3018,17 @@ const gchar *g_module_check_init(GModule *module)
 	 * If so, make an initial read
 	 */
 	if (get_als_type() != ALS_TYPE_NONE) {
-		/* Initialise the median filter */
-		if (als_median_filter_init() == FALSE) {
-			goto EXIT;
-		}
+		/* Initialise the ALS filter */
+		als_filter_init();
 
 		/* Calibrate the ALS */
 		calibrate_als();
 
+		als_poll_interval_max =
+			mce_conf_get_int(MCE_CONF_ALS_GROUP,
+					 MCE_CONF_ALS_POLL_INTERVAL_MAX,
+					 DEFAULT_ALS_POLL_INTERVAL_MAX);
+
 		/* Initial read of lux value from ALS */
 		if ((als_lux = als_read_value_filtered()) >= 0) {
 			/* Set initial polling interval */
@@ -2753,7 +3094,12 @@ void g_module_unload(GModule *module)
 	/* Close the ALS file pointer */
 	(void)mce_close_file(als_lux_path, &als_fp);
 
+	sample_filter_delete(als_filter);
+	als_filter = NULL;
+
 	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&power_profile_pipe,
+					    power_profile_trigger);
 	remove_output_trigger_from_datapipe(&display_state_pipe,
 					    display_state_trigger);
 	remove_filter_from_datapipe(&key_backlight_pipe,
@@ -2767,5 +3113,10 @@ void g_module_unload(GModule *module)
 	cancel_als_poll_timer();
 	cancel_brightness_delay_timer();
 
+	g_free(als_iio_channel);
+	als_iio_channel = NULL;
+	g_free(als_iio_device);
+	als_iio_device = NULL;
+
 	return;
 }
@@ -44,6 +44,45 @@
 /** Name of the configuration key for the brightness level step-down policy */
 #define MCE_CONF_STEP_DOWN_POLICY		"StepDownPolicy"
 
+/** Name of the configuration key for the maximum ALS poll interval */
+#define MCE_CONF_ALS_POLL_INTERVAL_MAX		"PollIntervalMax"
+
+/** Name of the configuration key for brightness interpolation */
+#define MCE_CONF_ALS_INTERPOLATE		"InterpolateBrightness"
+
+/** Name of the configuration key for the ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN		"FilterChain"
+
+/** Name of the configuration key for the Avago ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_AVAGO		"FilterChainAvago"
+
+/** Name of the configuration key for the Dipro ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_DIPRO		"FilterChainDipro"
+
+/** Name of the configuration key for the TSL2563 ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_TSL2563	"FilterChainTSL2563"
+
+/** Name of the configuration key for the TSL2562 ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_TSL2562	"FilterChainTSL2562"
+
+/** Name of the configuration key for the libhybris ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_HYBRIS	"FilterChainHybris"
+
+/** Name of the configuration key for the IIO ALS filter chain */
+#define MCE_CONF_ALS_FILTER_CHAIN_IIO		"FilterChainIIO"
+
+/** Name of the configuration key for the IIO ALS device name */
+#define MCE_CONF_ALS_IIO_DEVICE			"IIODevice"
+
+/** Name of the configuration key for the IIO ALS channel */
+#define MCE_CONF_ALS_IIO_CHANNEL		"IIOChannel"
+
+/** Name of the configuration key for the IIO ALS trigger */
+#define MCE_CONF_ALS_IIO_TRIGGER		"IIOTrigger"
+
+/** Name of the configuration key for the IIO ALS buffer watermark */
+#define MCE_CONF_ALS_IIO_WATERMARK		"IIOWatermark"
+
 /*  Paths for Avago APDS990x (QPDS-T900) ALS */
 
 /** Device path for Avago ALS */
@@ -148,7 +187,12 @@ struct dipro_als {
  */
 #define ALS_DISPLAY_OFF_POLL_FREQ	0		/* Milliseconds */
 /**
- * Define this to re-initialise the median filter on display blank;
+ * Default upper limit for the ALS poll interval;
+ * polling backs off towards this while the readings are stable
+ */
+#define DEFAULT_ALS_POLL_INTERVAL_MAX	24000		/* Milliseconds */
+/**
+ * Define this to re-initialise the ALS filter on display blank;
  * this will trigger a re-read on wakeup
  */
 #define ALS_DISPLAY_OFF_FLUSH_FILTER
@@ -156,15 +200,30 @@ struct dipro_als {
 /** Brightness stepdown delay, secs */
 #define ALS_BRIGHTNESS_STEPDOWN_DELAY	5
 
-/** Window size for the median filter */
-#define MEDIAN_FILTER_WINDOW_SIZE	5
+/** Default setting for brightness interpolation between ALS levels */
+#define DEFAULT_ALS_INTERPOLATE		FALSE
+
+/** Default filter chain for sensors that filter in hardware */
+#define DEFAULT_ALS_FILTER_CHAIN	""
+
+/** Default filter chain for the TSL256x sensors */
+#define DEFAULT_ALS_FILTER_CHAIN_TSL	"median:5:50"
+
+/** Default IIO ALS device name; empty to not use IIO */
+#define DEFAULT_ALS_IIO_DEVICE		""
+
+/** Default IIO ALS channel */
+#define DEFAULT_ALS_IIO_CHANNEL		"in_illuminance"
+
+/** Default IIO ALS trigger; empty to use the one set up by the system */
+#define DEFAULT_ALS_IIO_TRIGGER		""
+
+/** Default number of IIO ALS samples to deliver per wakeup */
+#define DEFAULT_ALS_IIO_WATERMARK	1
 
 /** Sysinfo identifier for the ALS calibration values */
 #define ALS_CALIB_IDENTIFIER		"/device/als_calib"
 
-/** Number of ranges in ALS profile */
-#define ALS_RANGES			11
-
 /** Path to display manager */
 #define DISPLAY_MANAGER_PATH			"/sys/devices/platform/omapdss/manager0"
 /** Colour phase adjustment enable path */
@@ -172,14 +231,6 @@ struct dipro_als {
 /** Colour phase adjustment coefficients path */
 #define COLOUR_PHASE_COEFFICIENTS_PATH		DISPLAY_MANAGER_PATH "/cpr_coef"
 
-/** ALS profile */
-typedef struct {
-	/** Lower and upper bound for each brightness range */
-	const gint range[ALS_RANGES][2];
-	/** Brightness in % + possible HBM boost (boost level * 256) */
-	const gint value[ALS_RANGES + 1];
-} als_profile_struct;
-
 
 /** Colour phase adjustment matrix */
 typedef struct {
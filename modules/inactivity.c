@@ -26,10 +26,17 @@
 #include "mce.h"
 
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start_slack(),
+					 * mce_deadline_stop()
+					 */
 #include "mce-dbus.h"			/* Direct:
 					 * ---
 					 * mce_dbus_handler_add(),
+					 * dbus_send(),
 					 * dbus_send_message(),
+					 * dbus_send_message_coalesced(),
 					 * dbus_new_method_reply(),
 					 * dbus_new_signal(),
 					 * dbus_message_append_args(),
@@ -88,14 +95,26 @@ typedef struct {
 /** Maximum amount of monitored activity callbacks */
 #define ACTIVITY_CB_MAX_MONITORED	16
 
+/**
+ * Tolerance for a late inactivity timeout, to let it share
+ * a wakeup with other timers; in milliseconds
+ */
+#define INACTIVITY_TIMEOUT_SLACK		1000
+
 /** List of activity callbacks */
 static GSList *activity_callbacks = NULL;
 
 /** List of monitored activity requesters */
 static GSList *activity_cb_monitor_list = NULL;
 
-/** ID for inactivity timeout source */
-static guint inactivity_timeout_cb_id = 0;
+/** Activity callbacks waiting to be called from the idle loop */
+static GSList *activity_cb_pending = NULL;
+
+/** ID for the activity callback dispatch idle source */
+static guint activity_cb_dispatch_id = 0;
+
+/** Deadline for the inactivity timeout */
+static mce_deadline_t *inactivity_deadline = NULL;
 
 /** Device inactivity state */
 static gboolean device_inactive = FALSE;
@@ -143,8 +162,8 @@ static gboolean send_inactivity_status(DBusMessage *const method_call)
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(msg);
+	/* Send the message; flapping signals are collapsed */
+	status = dbus_send_message_coalesced(msg, 0);
 
 EXIT:
 	return status;
@@ -172,6 +191,38 @@ EXIT:
 	return status;
 }
 
+/**
+ * Free an activity callback
+ *
+ * @param cb The activity callback
+ */
+static void activity_cb_free(activity_cb_t *cb)
+{
+	g_free(cb->owner);
+	g_free(cb->service);
+	g_free(cb->path);
+	g_free(cb->interface);
+	g_free(cb->method_name);
+	g_free(cb);
+}
+
+/**
+ * Check whether two activity callbacks call the same method
+ *
+ * @param a The first activity callback
+ * @param b The second activity callback
+ * @return TRUE if the callbacks have the same destination,
+ *         FALSE otherwise
+ */
+static gboolean activity_cb_same_target(const activity_cb_t *a,
+					const activity_cb_t *b)
+{
+	return (!strcmp(a->service, b->service) &&
+		!strcmp(a->path, b->path) &&
+		!strcmp(a->interface, b->interface) &&
+		!strcmp(a->method_name, b->method_name));
+}
+
 /**
  * Remove an activity cb from the list of monitored processes
  * and the callback itself
@@ -195,12 +246,7 @@ static void remove_activity_cb(const gchar *owner)
 
 		/* Is this the matching sender? */
 		if (!strcmp(cb->owner, owner)) {
-			g_free(cb->owner);
-			g_free(cb->service);
-			g_free(cb->path);
-			g_free(cb->interface);
-			g_free(cb->method_name);
-			g_free(cb);
+			activity_cb_free(cb);
 
 			activity_callbacks =
 				g_slist_remove(activity_callbacks,
@@ -266,6 +312,7 @@ static gboolean add_activity_callback_dbus_cb(DBusMessage *const msg)
 	const gchar *interface = NULL;
 	const gchar *method_name = NULL;
 	activity_cb_t *tmp = NULL;
+	GSList *iter;
 	gboolean result = FALSE;
 	gboolean status = FALSE;
 	DBusError error;
@@ -300,6 +347,26 @@ static gboolean add_activity_callback_dbus_cb(DBusMessage *const msg)
 		goto EXIT;
 	}
 
+	tmp = g_malloc(sizeof (activity_cb_t));
+
+	tmp->owner = g_strdup(sender);
+	tmp->service = g_strdup(service);
+	tmp->path = g_strdup(path);
+	tmp->interface = g_strdup(interface);
+	tmp->method_name = g_strdup(method_name);
+
+	/* Re-registering the same callback is a no-op */
+	for (iter = activity_callbacks; iter != NULL; iter = iter->next) {
+		const activity_cb_t *cb = iter->data;
+
+		if (!strcmp(cb->owner, sender) &&
+		    activity_cb_same_target(cb, tmp)) {
+			activity_cb_free(tmp);
+			result = TRUE;
+			goto EXIT2;
+		}
+	}
+
 	if (mce_dbus_owner_monitor_add(sender,
 				       activity_cb_monitor_dbus_cb,
 				       &activity_cb_monitor_list,
@@ -307,17 +374,10 @@ static gboolean add_activity_callback_dbus_cb(DBusMessage *const msg)
 		mce_log(LL_ERR,
 			"Failed to add name owner monitoring for `%s'",
 			sender);
+		activity_cb_free(tmp);
 		goto EXIT2;
 	}
 
-	tmp = g_malloc(sizeof (activity_cb_t));
-
-	tmp->owner = g_strdup(sender);
-	tmp->service = g_strdup(service);
-	tmp->path = g_strdup(path);
-	tmp->interface = g_strdup(interface);
-	tmp->method_name = g_strdup(method_name);
-
 	activity_callbacks = g_slist_prepend(activity_callbacks, tmp);
 
 	result = TRUE;
@@ -387,55 +447,87 @@ EXIT:
 }
 
 /**
- * Call all activity callbacks, then unregister them
+ * Idle callback for calling the pending activity callbacks
+ *
+ * Each destination is called only once, even if several clients
+ * registered the same callback; the calls do not expect a reply,
+ * so unresponsive clients do not leave pending calls behind
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the idle source
  */
-static void call_activity_callbacks(void)
+static gboolean activity_cb_dispatch_cb(gpointer data)
 {
-	GSList *tmp = activity_callbacks;
+	GSList *tmp;
 
-	while (tmp != NULL) {
-		activity_cb_t *cb;
+	(void)data;
 
-		cb = tmp->data;
+	activity_cb_dispatch_id = 0;
 
-		/* Call the calback */
-		(void)dbus_send(cb->service, cb->path,
-				cb->interface, cb->method_name,
-				NULL,
-				DBUS_TYPE_INVALID);
+	for (tmp = activity_cb_pending; tmp != NULL; tmp = tmp->next) {
+		activity_cb_t *cb = tmp->data;
+		GSList *prev;
 
-		g_free(cb->owner);
-		g_free(cb->service);
-		g_free(cb->path);
-		g_free(cb->interface);
-		g_free(cb->method_name);
-		g_free(cb);
+		for (prev = activity_cb_pending; prev != tmp;
+		     prev = prev->next) {
+			if (activity_cb_same_target(prev->data, cb) == TRUE)
+				break;
+		}
 
-		tmp = g_slist_next(tmp);
+		/* Call the callback */
+		if (prev == tmp)
+			(void)dbus_send(cb->service, cb->path,
+					cb->interface, cb->method_name,
+					NULL,
+					DBUS_TYPE_INVALID);
 	}
 
-	g_slist_free(activity_callbacks);
+	g_slist_free_full(activity_cb_pending,
+			  (GDestroyNotify)activity_cb_free);
+	activity_cb_pending = NULL;
+
+	return FALSE;
+}
+
+/**
+ * Call all activity callbacks, then unregister them
+ *
+ * The callbacks are unregistered right away, but called from a low
+ * priority idle source so that they do not compete with the handling
+ * of the user input that ended the inactivity
+ */
+static void call_activity_callbacks(void)
+{
+	if (activity_callbacks == NULL)
+		goto EXIT;
+
+	activity_cb_pending = g_slist_concat(activity_cb_pending,
+					     activity_callbacks);
 	activity_callbacks = NULL;
 
 	mce_dbus_owner_monitor_remove_all(&activity_cb_monitor_list);
+
+	if (activity_cb_dispatch_id == 0)
+		activity_cb_dispatch_id =
+			g_idle_add_full(G_PRIORITY_LOW,
+					activity_cb_dispatch_cb,
+					NULL, NULL);
+
+EXIT:
+	return;
 }
 
 /**
  * Timeout callback for inactivity
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean inactivity_timeout_cb(gpointer data)
+static void inactivity_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	inactivity_timeout_cb_id = 0;
-
 	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(TRUE),
 			       USE_INDATA, CACHE_INDATA);
-
-	return FALSE;
 }
 
 /**
@@ -443,11 +535,8 @@ static gboolean inactivity_timeout_cb(gpointer data)
  */
 static void cancel_inactivity_timeout(void)
 {
-	/* Remove inactivity timeout source */
-	if (inactivity_timeout_cb_id != 0) {
-		g_source_remove(inactivity_timeout_cb_id);
-		inactivity_timeout_cb_id = 0;
-	}
+	/* Stop inactivity timeout */
+	mce_deadline_stop(inactivity_deadline);
 }
 
 /**
@@ -464,8 +553,8 @@ static void setup_inactivity_timeout(void)
 		timeout = 30;
 
 	/* Setup new timeout */
-	inactivity_timeout_cb_id =
-		g_timeout_add_seconds(timeout, inactivity_timeout_cb, NULL);
+	mce_deadline_start_slack(inactivity_deadline, timeout * 1000,
+				 INACTIVITY_TIMEOUT_SLACK);
 }
 
 /**
@@ -545,6 +634,9 @@ const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	inactivity_deadline = mce_deadline_create("inactivity",
+						  inactivity_timeout_cb, NULL);
+
 	/* Append triggers/filters to datapipes */
 	append_filter_to_datapipe(&device_inactive_pipe,
 				  device_inactive_filter);
@@ -601,6 +693,17 @@ void g_module_unload(GModule *module)
 
 	/* Remove all timer sources */
 	cancel_inactivity_timeout();
+	mce_deadline_delete(inactivity_deadline);
+	inactivity_deadline = NULL;
+
+	if (activity_cb_dispatch_id != 0) {
+		g_source_remove(activity_cb_dispatch_id);
+		activity_cb_dispatch_id = 0;
+	}
+
+	g_slist_free_full(activity_cb_pending,
+			  (GDestroyNotify)activity_cb_free);
+	activity_cb_pending = NULL;
 
 	return;
 }
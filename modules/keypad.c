@@ -146,6 +146,7 @@ static output_state_t led_brightness_kb0_output =
   .context = "led_brightness_kb0",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 /** Key backlight channel 1 backlight path */
 static output_state_t led_brightness_kb1_output =
@@ -153,6 +154,7 @@ static output_state_t led_brightness_kb1_output =
   .context = "led_brightness_kb1",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 /** Key backlight channel 2 backlight path */
 static output_state_t led_brightness_kb2_output =
@@ -160,6 +162,7 @@ static output_state_t led_brightness_kb2_output =
   .context = "led_brightness_kb2",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 /** Key backlight channel 3 backlight path */
 static output_state_t led_brightness_kb3_output =
@@ -167,6 +170,7 @@ static output_state_t led_brightness_kb3_output =
   .context = "led_brightness_kb3",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 /** Key backlight channel 4 backlight path */
 static output_state_t led_brightness_kb4_output =
@@ -174,6 +178,7 @@ static output_state_t led_brightness_kb4_output =
   .context = "led_brightness_kb4",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 /** Key backlight channel 5 backlight path */
 static output_state_t led_brightness_kb5_output =
@@ -181,6 +186,7 @@ static output_state_t led_brightness_kb5_output =
   .context = "led_brightness_kb5",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .async = TRUE,
 };
 
 /** Path to engine 3 mode */
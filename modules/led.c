@@ -23,10 +23,16 @@
 
 #include <errno.h>                      /* errno, EINVAL, ERANGE */
 #include <fcntl.h>			/* open(), O_RDWR, O_CREAT */
+#include <poll.h>			/* poll(), POLLIN */
 #include <stdlib.h>			/* strtoul() */
 #include <string.h>			/* strcmp(), strcpy(), strdup() */
-#include <unistd.h>			/* close(), W_OK */
+#include <unistd.h>			/* close(), pwrite(), W_OK */
+#include <sys/eventfd.h>		/* eventfd(), EFD_CLOEXEC */
 #include <sys/ioctl.h>			/* ioctl() */
+#include <sys/timerfd.h>		/* timerfd_create(),
+					 * timerfd_settime(),
+					 * TFD_CLOEXEC
+					 */
 #include <linux/i2c-dev.h>		/* I2C_SLAVE_FORCE,
 					 * I2C_SMBUS
 					 */
@@ -43,12 +49,27 @@
 					 * mce_write_string_to_file(),
 					 * mce_write_number_string_to_file()
 					 */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start_slack(),
+					 * mce_deadline_stop()
+					 */
 #include "mce-hal.h"			/* get_product_id(),
 					 * product_id_t
 					 */
-#include "mce-lib.h"			/* bin_to_string() */
+#include "mce-lib.h"			/* mce_lib_get_time_ms(),
+					 * bin_to_string(),
+					 * mce_translate_string_to_int_with_default(),
+					 * mce_translation_t,
+					 * MCE_INVALID_TRANSLATION
+					 */
 #include "mce-log.h"			/* mce_log(), LL_* */
-#include "mce-conf.h"			/* mce_conf_get_string_list() */
+#include "mce-memstat.h"		/* mce_memstat_alloc(),
+					 * mce_memstat_free()
+					 */
+#include "mce-conf.h"			/* mce_conf_get_string_list(),
+					 * mce_conf_get_string()
+					 */
 #include "mce-dbus.h"			/* Direct:
 					 * ---
 					 * mce_dbus_handler_add(),
@@ -86,6 +107,7 @@
 					 * append_output_trigger_to_datapipe(),
 					 * remove_output_trigger_from_datapipe()
 					 */
+#include "mce-power-profile.h"		/* mce_power_profile_get() */
 
 /** Module name */
 #define MODULE_NAME		"led"
@@ -105,10 +127,26 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 /** The pattern queue */
 static GQueue *pattern_stack = NULL;
+/** Lookup table for the patterns; key is the pattern name */
+static GHashTable *pattern_lut = NULL;
+/**
+ * Binary heap of the patterns that are both active and enabled;
+ * the most important pattern is at index 0
+ */
+static GPtrArray *pattern_heap = NULL;
+/** Load order counter for the patterns */
+static guint pattern_seq = 0;
 /** The pattern combination rule queue */
 static GQueue *combination_rule_list = NULL;
 /** The pattern combination rule queue */
 static GQueue *combination_rule_xref_list = NULL;
+/** Lookup table for the combination rules; key is the rule name */
+static GHashTable *combination_rule_lut = NULL;
+/**
+ * Lookup table for the combination rule cross references;
+ * key is the pattern name, value lists the rules using the pattern
+ */
+static GHashTable *combination_rule_xref_lut = NULL;
 /** The D-Bus controlled LED switch */
 static gboolean led_enabled = FALSE;
 
@@ -175,13 +213,15 @@ typedef struct {
 	gboolean enabled;		/**< Is the pattern enabled? */
 	guint engine1_mux;		/**< Muxing for engine 1 */
 	guint engine2_mux;		/**< Muxing for engine 2 */
-	/** Pattern for the R-channel/engine 1 */
-	gchar channel1[CHANNEL_SIZE + 1];
-	/** Pattern for the G-channel/engine 2 */
-	gchar channel2[CHANNEL_SIZE + 1];
-	/** Pattern for the B-channel */
-	gchar channel3[CHANNEL_SIZE + 1];
+	/** Pattern for the R-channel/engine 1, or NULL if not used */
+	gchar *channel1;
+	/** Pattern for the G-channel/engine 2, or NULL if not used */
+	gchar *channel2;
+	/** Pattern for the B-channel, or NULL if not used */
+	gchar *channel3;
 	guint gconf_cb_id;		/**< Callback ID for GConf entry */
+	guint seq;			/**< Load order of the pattern */
+	gint heap_index;		/**< Index in pattern_heap, or -1 */
 } pattern_struct;
 
 /** Pattern combination rule struct; this is also used for cross-referencing */
@@ -200,6 +240,30 @@ static gint active_brightness = -1;
 /** Currently driven leds */
 static guint current_lysti_led_pattern = 0;
 
+/** Number of LED controller engines */
+#define LED_ENGINE_COUNT	3
+
+/** What an LED controller engine is known to hold */
+typedef struct {
+	/** Last mode written, or NULL if unknown */
+	const gchar *mode;
+	/** TRUE if program and leds hold what was loaded */
+	gboolean loaded;
+	/** Program loaded to the engine */
+	gchar program[CHANNEL_SIZE + 1];
+	/** Leds muxed to the engine; Lysti only */
+	guint leds;
+} led_engine_state_t;
+
+/** State of the LED controller engines 1-3 */
+static led_engine_state_t led_engine[LED_ENGINE_COUNT];
+
+/** Number of engine program uploads done */
+static guint led_engine_loads = 0;
+
+/** Number of engine program uploads avoided */
+static guint led_engine_reuses = 0;
+
 /** Brightness levels for the mono-LED */
 static const gchar *const brightness_map[] = {
 	BRIGHTNESS_LEVEL_0,
@@ -220,6 +284,55 @@ static const gchar *const brightness_map[] = {
 	BRIGHTNESS_LEVEL_15
 };
 
+/** How mono-LED on/off patterns are animated */
+typedef enum {
+	/** Animation mode not set */
+	LED_ANIMATION_INVALID = MCE_INVALID_TRANSLATION,
+	/** Use the kernel timer trigger */
+	LED_ANIMATION_KERNEL = 0,
+	/** Blink from the LED animation worker */
+	LED_ANIMATION_BLINK = 1,
+	/** Breathe from the LED animation worker */
+	LED_ANIMATION_BREATHE = 2,
+	/** Default animation mode */
+	DEFAULT_LED_ANIMATION = LED_ANIMATION_KERNEL
+} led_animation_mode_t;
+
+/** Mapping of mono-LED animation mode strings */
+static const mce_translation_t led_animation_translation[] = {
+	{
+		.number = LED_ANIMATION_KERNEL,
+		.string = "kernel",
+	}, {
+		.number = LED_ANIMATION_BLINK,
+		.string = "blink",
+	}, {
+		.number = LED_ANIMATION_BREATHE,
+		.string = "breathe",
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = NULL
+	}
+};
+
+/** Configured mono-LED animation mode */
+static led_animation_mode_t led_animation_mode = DEFAULT_LED_ANIMATION;
+
+/** State of the mono-LED animation worker */
+static struct {
+	GThread *thread;		/**< Worker, or NULL if not running */
+	int wake_fd;			/**< Eventfd for stopping the worker */
+	int led_fd;			/**< Brightness file of the LED */
+	led_animation_mode_t mode;	/**< Blink or breathe */
+	gint on_period;			/**< On/rise period [ms] */
+	gint off_period;		/**< Off/fall period [ms] */
+	gint brightness;		/**< Peak level; index to brightness_map */
+} led_animation = {
+	.thread = NULL,
+	.wake_fd = -1,
+	.led_fd = -1,
+};
+
 /** LED type */
 typedef enum {
 	/** LED type unset */
@@ -239,9 +352,9 @@ typedef enum {
 } led_type_t;
 
 /**
- * The ID of the LED timer
+ * Deadline for the LED pattern timeout
  */
-static guint led_pattern_timeout_cb_id = 0;
+static mce_deadline_t *led_pattern_deadline = NULL;
 
 /**
  * The configuration group containing the LED pattern
@@ -254,6 +367,7 @@ static output_state_t led_current_rm_output =
   .context = "led_current_rm",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .skip_unchanged = TRUE,
 };
 
 /** Path to green channel LED current path */
@@ -262,6 +376,7 @@ static output_state_t led_current_g_output =
   .context = "led_current_g",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .skip_unchanged = TRUE,
 };
 
 /** Path to blue channel LED current path */
@@ -270,6 +385,7 @@ static output_state_t led_current_b_output =
   .context = "led_current_b",
   .truncate_file = TRUE,
   .close_on_exit = FALSE,
+  .skip_unchanged = TRUE,
 };
 
 /** Path to monochrome/red channel LED brightness path  */
@@ -569,6 +685,178 @@ static gint queue_prio_compare(gconstpointer entry1,
 	return psp1->priority - psp2->priority;
 }
 
+/**
+ * Check whether a pattern goes before another one in the pattern heap
+ *
+ * Equal priority patterns are ordered like g_queue_insert_sorted()
+ * orders them in the pattern stack; the last loaded pattern first
+ *
+ * @param psp1 The first pattern
+ * @param psp2 The second pattern
+ * @return TRUE if psp1 is more important than psp2, FALSE otherwise
+ */
+static gboolean pattern_heap_before(const pattern_struct *psp1,
+				    const pattern_struct *psp2)
+{
+	if (psp1->priority != psp2->priority)
+		return psp1->priority < psp2->priority;
+
+	return psp1->seq > psp2->seq;
+}
+
+/**
+ * Store a pattern in a pattern heap slot
+ *
+ * @param index The heap slot
+ * @param psp The pattern
+ */
+static void pattern_heap_set(guint index, pattern_struct *psp)
+{
+	g_ptr_array_index(pattern_heap, index) = psp;
+	psp->heap_index = index;
+}
+
+/**
+ * Move a pattern towards the top of the pattern heap as needed
+ *
+ * @param index The heap slot of the pattern
+ */
+static void pattern_heap_sift_up(guint index)
+{
+	pattern_struct *psp = g_ptr_array_index(pattern_heap, index);
+
+	while (index > 0) {
+		guint parent = (index - 1) / 2;
+		pattern_struct *tmp = g_ptr_array_index(pattern_heap, parent);
+
+		if (pattern_heap_before(psp, tmp) == FALSE)
+			break;
+
+		pattern_heap_set(index, tmp);
+		index = parent;
+	}
+
+	pattern_heap_set(index, psp);
+}
+
+/**
+ * Move a pattern towards the bottom of the pattern heap as needed
+ *
+ * @param index The heap slot of the pattern
+ */
+static void pattern_heap_sift_down(guint index)
+{
+	pattern_struct *psp = g_ptr_array_index(pattern_heap, index);
+
+	for (;;) {
+		guint child = 2 * index + 1;
+		pattern_struct *tmp;
+
+		if (child >= pattern_heap->len)
+			break;
+
+		if ((child + 1 < pattern_heap->len) &&
+		    pattern_heap_before(g_ptr_array_index(pattern_heap,
+							  child + 1),
+					g_ptr_array_index(pattern_heap, child)))
+			child++;
+
+		tmp = g_ptr_array_index(pattern_heap, child);
+
+		if (pattern_heap_before(tmp, psp) == FALSE)
+			break;
+
+		pattern_heap_set(index, tmp);
+		index = child;
+	}
+
+	pattern_heap_set(index, psp);
+}
+
+/**
+ * Add or remove a pattern in the pattern heap
+ *
+ * The pattern is kept in the heap if it is both active and enabled
+ *
+ * @param psp The pattern
+ */
+static void pattern_heap_update(pattern_struct *psp)
+{
+	gboolean queued = (psp->active == TRUE) && (psp->enabled == TRUE);
+
+	if ((queued == TRUE) && (psp->heap_index < 0)) {
+		g_ptr_array_add(pattern_heap, psp);
+		pattern_heap_sift_up(pattern_heap->len - 1);
+	} else if ((queued == FALSE) && (psp->heap_index >= 0)) {
+		guint index = psp->heap_index;
+		pattern_struct *last = g_ptr_array_index(pattern_heap,
+							 pattern_heap->len - 1);
+
+		g_ptr_array_set_size(pattern_heap, pattern_heap->len - 1);
+		psp->heap_index = -1;
+
+		if (last != psp) {
+			pattern_heap_set(index, last);
+			pattern_heap_sift_up(index);
+			pattern_heap_sift_down(last->heap_index);
+		}
+	}
+}
+
+/**
+ * Set the active state of a pattern
+ *
+ * @param psp The pattern
+ * @param active TRUE to activate the pattern, FALSE to deactivate it
+ */
+static void pattern_set_active(pattern_struct *psp, gboolean active)
+{
+	psp->active = active;
+	pattern_heap_update(psp);
+}
+
+/**
+ * Get the memory used by a pattern
+ *
+ * @param psp The pattern
+ * @return The size of the pattern and the strings it owns [bytes]
+ */
+static gsize pattern_size(const pattern_struct *psp)
+{
+	gsize size = sizeof *psp;
+
+	if (psp->name != NULL)
+		size += strlen(psp->name) + 1;
+
+	if (psp->channel1 != NULL)
+		size += strlen(psp->channel1) + 1;
+
+	if (psp->channel2 != NULL)
+		size += strlen(psp->channel2) + 1;
+
+	if (psp->channel3 != NULL)
+		size += strlen(psp->channel3) + 1;
+
+	return size;
+}
+
+/**
+ * Add a newly loaded pattern to the pattern stack
+ *
+ * @param psp The pattern
+ */
+static void pattern_add(pattern_struct *psp)
+{
+	psp->seq = pattern_seq++;
+	psp->heap_index = -1;
+
+	mce_memstat_alloc("led:patterns", pattern_size(psp));
+
+	g_queue_insert_sorted(pattern_stack, psp, queue_prio_compare, NULL);
+	g_hash_table_replace(pattern_lut, psp->name, psp);
+	pattern_heap_update(psp);
+}
+
 /**
  * Set Lysti-LED brightness
  *
@@ -706,22 +994,313 @@ static void mono_set_brightness(gint brightness)
 	mce_log(LL_DEBUG, "Brightness set to %d", brightness);
 }
 
+/**
+ * Get the mode sysfs path of an LED controller engine
+ *
+ * @param engine Engine index; 0-2
+ * @return The path, or NULL if not configured
+ */
+static const gchar *led_engine_mode_path(guint engine)
+{
+	const gchar *const paths[LED_ENGINE_COUNT] = {
+		engine1_mode_path, engine2_mode_path, engine3_mode_path
+	};
+
+	return paths[engine];
+}
+
+/**
+ * Set the mode of an LED controller engine
+ *
+ * Writes are skipped if the engine already is in the requested mode
+ *
+ * @param engine Engine index; 0-2
+ * @param mode MCE_LED_DISABLED_MODE, MCE_LED_LOAD_MODE or MCE_LED_RUN_MODE
+ */
+static void led_engine_set_mode(guint engine, const gchar *mode)
+{
+	led_engine_state_t *state = &led_engine[engine];
+
+	if ((state->mode != NULL) && !strcmp(state->mode, mode))
+		goto EXIT;
+
+	if (mce_write_string_to_file(led_engine_mode_path(engine), mode))
+		state->mode = mode;
+	else
+		state->mode = NULL;
+
+EXIT:
+	return;
+}
+
+/**
+ * Load a program to an LED controller engine unless already loaded
+ *
+ * @param engine Engine index; 0-2
+ * @param leds_path Path to the engine leds file, or NULL if muxing
+ *                  is not used
+ * @param leds Leds to mux to the engine
+ * @param load_path Path to the engine load file
+ * @param program The engine program
+ */
+static void led_engine_load(guint engine,
+			    const gchar *leds_path, guint leds,
+			    const gchar *load_path, const gchar *program)
+{
+	led_engine_state_t *state = &led_engine[engine];
+	gboolean success = TRUE;
+
+	if ((state->loaded == TRUE) &&
+	    ((leds_path == NULL) || (state->leds == leds)) &&
+	    !strcmp(state->program, program)) {
+		led_engine_reuses++;
+		goto EXIT;
+	}
+
+	state->loaded = FALSE;
+	led_engine_loads++;
+
+	/* Changing the leds also needs a reload of the program */
+	led_engine_set_mode(engine, MCE_LED_LOAD_MODE);
+
+	if (leds_path != NULL)
+		success &= mce_write_string_to_file(leds_path,
+						    bin_to_string(leds));
+
+	success &= mce_write_string_to_file(load_path, program);
+
+	if (success == FALSE)
+		goto EXIT;
+
+	g_strlcpy(state->program, program, sizeof state->program);
+	state->leds = leds;
+	state->loaded = TRUE;
+
+EXIT:
+	mce_log(LL_DEBUG, "engine %u: %u loads, %u reused",
+		engine + 1, led_engine_loads, led_engine_reuses);
+}
+
+/**
+ * Get the LED animation level at a point of the animation cycle
+ *
+ * @param t Time since the start of the cycle [ms]
+ * @param delay Where to store the time until the next update [ms]
+ * @return Brightness level; index to brightness_map
+ */
+static gint led_animation_level(gint t, gint *delay)
+{
+	gint on = led_animation.on_period;
+	gint off = led_animation.off_period;
+	gint level = 0;
+
+	if (led_animation.mode == LED_ANIMATION_BLINK) {
+		if (t < on) {
+			level = led_animation.brightness;
+			*delay = on - t;
+		} else {
+			*delay = on + off - t;
+		}
+	} else {
+		/* Rise during the on-period, fall during the off-period;
+		 * smoothstep(x) = x * x * (3 - 2 * x) eases both ends
+		 */
+		gint64 x = (t < on) ? (gint64)t * 1024 / on :
+				      (gint64)(on + off - t) * 1024 / off;
+		gint64 y = x * x * (3 * 1024 - 2 * x) / (1024 * 1024);
+
+		level = (gint)((y * led_animation.brightness + 512) / 1024);
+		*delay = LED_ANIMATION_STEP_TIME;
+	}
+
+	return level;
+}
+
+/**
+ * Worker thread for the software LED animation
+ *
+ * Sleeps on a timerfd between the brightness changes and writes
+ * only changed levels; exits when led_animation.wake_fd is signaled
+ *
+ * @param data Unused
+ * @return Always returns NULL
+ */
+static gpointer led_animation_thread(gpointer data)
+{
+	gint period = led_animation.on_period + led_animation.off_period;
+	gint64 start = mce_lib_get_time_ms(CLOCK_MONOTONIC);
+	struct pollfd pfd[2];
+	gint last = -1;
+	int tfd;
+
+	(void)data;
+
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+		mce_log(LL_ERR, "Failed to create LED animation timer; %m");
+		goto EXIT;
+	}
+
+	pfd[0].fd = led_animation.wake_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = tfd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		struct itimerspec its;
+		guint64 expirations;
+		gint delay = 0;
+		gint64 elapsed;
+		gint level;
+
+		/* CLOCK_MONOTONIC does not advance while the device is
+		 * suspended; the animation continues where it was */
+		elapsed = mce_lib_get_time_ms(CLOCK_MONOTONIC) - start;
+		level = led_animation_level(elapsed % period, &delay);
+
+		if (level != last) {
+			const gchar *str = brightness_map[level];
+			ssize_t len = strlen(str);
+
+			if (pwrite(led_animation.led_fd, str, len, 0) != len)
+				mce_log(LL_WARN, "Failed to write LED "
+					"brightness; %m");
+			last = level;
+		}
+
+		memset(&its, 0, sizeof its);
+		its.it_value.tv_sec = delay / 1000;
+		its.it_value.tv_nsec = (delay % 1000) * 1000000 + 1;
+
+		if (timerfd_settime(tfd, 0, &its, NULL) == -1) {
+			mce_log(LL_ERR, "Failed to arm LED animation timer; %m");
+			goto EXIT;
+		}
+
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			mce_log(LL_ERR, "LED animation poll failed; %m");
+			goto EXIT;
+		}
+
+		if (pfd[0].revents != 0)
+			break;
+
+		if (read(tfd, &expirations, sizeof expirations) == -1)
+			errno = 0;
+	}
+
+EXIT:
+	if (tfd != -1)
+		close(tfd);
+
+	return NULL;
+}
+
+/**
+ * Stop the software LED animation if running
+ *
+ * Waits for the worker to exit, so that no animation writes can
+ * follow the brightness writes done after this
+ */
+static void led_animation_stop(void)
+{
+	guint64 one = 1;
+
+	if (led_animation.thread == NULL)
+		goto EXIT;
+
+	if (write(led_animation.wake_fd, &one, sizeof one) == -1)
+		mce_log(LL_ERR, "Failed to stop LED animation; %m");
+
+	g_thread_join(led_animation.thread), led_animation.thread = NULL;
+
+	close(led_animation.led_fd), led_animation.led_fd = -1;
+	close(led_animation.wake_fd), led_animation.wake_fd = -1;
+
+	/* The level the animation left is not known */
+	active_brightness = -1;
+
+EXIT:
+	return;
+}
+
+/**
+ * Start the software LED animation for a mono-LED pattern
+ *
+ * @param pattern A pointer to a pattern_struct with the pattern
+ * @param mode LED_ANIMATION_BLINK or LED_ANIMATION_BREATHE
+ * @return TRUE if the animation was started, FALSE on failure
+ */
+static gboolean led_animation_start(const pattern_struct *const pattern,
+				    led_animation_mode_t mode)
+{
+	GError *error = NULL;
+
+	led_animation_stop();
+
+	if (led_brightness_rm_output.path == NULL)
+		goto EXIT;
+
+	led_animation.mode = mode;
+	led_animation.on_period = pattern->on_period;
+	led_animation.off_period = pattern->off_period;
+	led_animation.brightness = CLAMP(pattern->brightness, 0, 15);
+
+	if ((led_animation.led_fd = open(led_brightness_rm_output.path,
+					 O_WRONLY | O_CLOEXEC)) == -1) {
+		mce_log(LL_ERR, "Failed to open `%s'; %m",
+			led_brightness_rm_output.path);
+		goto EXIT;
+	}
+
+	if ((led_animation.wake_fd = eventfd(0, EFD_CLOEXEC)) == -1) {
+		mce_log(LL_ERR, "Failed to create LED animation eventfd; %m");
+		goto EXIT;
+	}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	led_animation.thread = g_thread_try_new("mce-led", led_animation_thread,
+						NULL, &error);
+#else
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+	led_animation.thread = g_thread_create(led_animation_thread, NULL,
+					       TRUE, &error);
+#endif
+
+	if (led_animation.thread == NULL)
+		mce_log(LL_ERR, "Failed to start LED animation thread; %s",
+			error ? error->message : "unknown");
+
+	g_clear_error(&error);
+
+EXIT:
+	if (led_animation.thread == NULL) {
+		if (led_animation.wake_fd != -1)
+			close(led_animation.wake_fd), led_animation.wake_fd = -1;
+		if (led_animation.led_fd != -1)
+			close(led_animation.led_fd), led_animation.led_fd = -1;
+	}
+
+	return led_animation.thread != NULL;
+}
+
 /**
  * Disable the Lysti-LED
  */
 static void lysti_disable_led(void)
 {
 	/* Disable engine 1 */
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_DISABLED_MODE);
+	led_engine_set_mode(0, MCE_LED_DISABLED_MODE);
 
 	if (get_led_type() == LED_TYPE_LYSTI_MONO) {
 		/* Turn off the led */
 		(void)mce_write_number_string_to_file(&led_brightness_rm_output, 0);
 	} else if (get_led_type() == LED_TYPE_LYSTI_RGB) {
 		/* Disable engine 2 */
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_DISABLED_MODE);
+		led_engine_set_mode(1, MCE_LED_DISABLED_MODE);
 
 		/* Turn off all three leds */
 		(void)mce_write_number_string_to_file(&led_brightness_rm_output, 0);
@@ -736,20 +1315,17 @@ static void lysti_disable_led(void)
 static void njoy_disable_led(void)
 {
 	/* Disable engine 1 */
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_DISABLED_MODE);
+	led_engine_set_mode(0, MCE_LED_DISABLED_MODE);
 
 	if (get_led_type() == LED_TYPE_NJOY_MONO) {
 		/* Turn off the led */
 		(void)mce_write_number_string_to_file(&led_brightness_rm_output, 0);
 	} else if (get_led_type() == LED_TYPE_NJOY_RGB) {
 		/* Disable engine 2 */
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_DISABLED_MODE);
+		led_engine_set_mode(1, MCE_LED_DISABLED_MODE);
 
 		/* Disable engine 3 */
-		(void)mce_write_string_to_file(engine3_mode_path,
-					       MCE_LED_DISABLED_MODE);
+		led_engine_set_mode(2, MCE_LED_DISABLED_MODE);
 
 		/* Turn off all three leds */
 		(void)mce_write_number_string_to_file(&led_brightness_rm_output, 0);
@@ -763,6 +1339,8 @@ static void njoy_disable_led(void)
  */
 static void mono_disable_led(void)
 {
+	led_animation_stop();
+
 	(void)mce_write_string_to_file(MCE_LED_TRIGGER_PATH,
 				       MCE_LED_TRIGGER_NONE);
 	mono_set_brightness(0);
@@ -799,18 +1377,13 @@ static void disable_led(void)
  * Timeout callback for LED patterns
  *
  * @param data Unused
- * @return Always returns FALSE to disable timeout
  */
-static gboolean led_pattern_timeout_cb(gpointer data)
+static void led_pattern_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	led_pattern_timeout_cb_id = 0;
-
-	active_pattern->active = FALSE;
+	pattern_set_active(active_pattern, FALSE);
 	led_update_active_pattern();
-
-	return FALSE;
 }
 
 /**
@@ -819,10 +1392,7 @@ static gboolean led_pattern_timeout_cb(gpointer data)
 static void cancel_pattern_timeout(void)
 {
 	/* Remove old timeout */
-	if (led_pattern_timeout_cb_id != 0) {
-		g_source_remove(led_pattern_timeout_cb_id);
-		led_pattern_timeout_cb_id = 0;
-	}
+	mce_deadline_stop(led_pattern_deadline);
 }
 
 /**
@@ -833,8 +1403,8 @@ static void setup_pattern_timeout(gint timeout)
 	cancel_pattern_timeout();
 
 	/* Setup new timeout */
-	led_pattern_timeout_cb_id =
-		g_timeout_add_seconds(timeout, led_pattern_timeout_cb, NULL);
+	mce_deadline_start_slack(led_pattern_deadline, timeout * 1000,
+				 LED_PATTERN_TIMEOUT_SLACK);
 }
 
 /**
@@ -847,32 +1417,24 @@ static void lysti_program_led(const pattern_struct *const pattern)
 	/* Disable old LED patterns */
 	lysti_disable_led();
 
-	/* Load new patterns, one engine at a time */
+	/* Load new patterns, one engine at a time;
+	 * programs the engines already hold are not uploaded again
+	 */
 
 	/* Engine 1 */
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_LOAD_MODE);
-	(void)mce_write_string_to_file(engine1_leds_path,
-				       bin_to_string(pattern->engine1_mux));
-	(void)mce_write_string_to_file(engine1_load_path,
-				       pattern->channel1);
+	led_engine_load(0, engine1_leds_path, pattern->engine1_mux,
+			engine1_load_path, pattern->channel1);
 
 	/* Engine 2; if needed */
 	if (get_led_type() == LED_TYPE_LYSTI_RGB) {
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_LOAD_MODE);
-		(void)mce_write_string_to_file(engine2_leds_path,
-					       bin_to_string(pattern->engine2_mux));
-		(void)mce_write_string_to_file(engine2_load_path,
-					       pattern->channel2);
+		led_engine_load(1, engine2_leds_path, pattern->engine2_mux,
+				engine2_load_path, pattern->channel2);
 
 		/* Run the new pattern; enable engines in reverse order */
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_RUN_MODE);
+		led_engine_set_mode(1, MCE_LED_RUN_MODE);
 	}
 
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_RUN_MODE);
+	led_engine_set_mode(0, MCE_LED_RUN_MODE);
 
         /* Save what colors we are driving */
         current_lysti_led_pattern = pattern->engine1_mux | pattern->engine2_mux;
@@ -893,36 +1455,28 @@ static void njoy_program_led(const pattern_struct *const pattern)
 	/* Disable old LED patterns */
 	njoy_disable_led();
 
-	/* Load new patterns */
+	/* Load new patterns;
+	 * programs the engines already hold are not uploaded again
+	 */
 
 	/* Engine 1 */
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_LOAD_MODE);
-	(void)mce_write_string_to_file(engine1_load_path,
-				       pattern->channel1);
+	led_engine_load(0, NULL, 0, engine1_load_path, pattern->channel1);
 
 	if (get_led_type() == LED_TYPE_NJOY_RGB) {
 		/* Engine 2 */
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_LOAD_MODE);
-		(void)mce_write_string_to_file(engine2_load_path,
-					       pattern->channel2);
+		led_engine_load(1, NULL, 0, engine2_load_path,
+				pattern->channel2);
 
 		/* Engine 3 */
-		(void)mce_write_string_to_file(engine3_mode_path,
-					       MCE_LED_LOAD_MODE);
-		(void)mce_write_string_to_file(engine3_load_path,
-					       pattern->channel3);
+		led_engine_load(2, NULL, 0, engine3_load_path,
+				pattern->channel3);
 
 		/* Run the new pattern; enable engines in reverse order */
-		(void)mce_write_string_to_file(engine3_mode_path,
-					       MCE_LED_RUN_MODE);
-		(void)mce_write_string_to_file(engine2_mode_path,
-					       MCE_LED_RUN_MODE);
+		led_engine_set_mode(2, MCE_LED_RUN_MODE);
+		led_engine_set_mode(1, MCE_LED_RUN_MODE);
 	}
 
-	(void)mce_write_string_to_file(engine1_mode_path,
-				       MCE_LED_RUN_MODE);
+	led_engine_set_mode(0, MCE_LED_RUN_MODE);
 
 	/* Reset brightness */
         njoy_set_brightness(-1);
@@ -957,12 +1511,16 @@ static void mono_program_led(const pattern_struct *const pattern)
 		goto EXIT;
 	}
 
+	led_animation_stop();
+
 	/* If we have a normal, on/off pattern,
-	 * use a timer trigger, otherwise disable the trigger
+	 * use a timer trigger, otherwise disable the trigger;
+	 * without the timer trigger, animate from the worker
 	 */
-	if (pattern->off_period != 0) {
-		(void)mce_write_string_to_file(MCE_LED_TRIGGER_PATH,
-					       MCE_LED_TRIGGER_TIMER);
+	if ((pattern->off_period != 0) &&
+	    (led_animation_mode == LED_ANIMATION_KERNEL) &&
+	    (mce_write_string_to_file(MCE_LED_TRIGGER_PATH,
+				      MCE_LED_TRIGGER_TIMER) == TRUE)) {
 		(void)mce_write_number_string_to_file(&led_off_period_output,
 						      (unsigned)pattern->off_period);
 		(void)mce_write_number_string_to_file(&led_on_period_output,
@@ -970,6 +1528,18 @@ static void mono_program_led(const pattern_struct *const pattern)
 	} else {
 		(void)mce_write_string_to_file(MCE_LED_TRIGGER_PATH,
 					       MCE_LED_TRIGGER_NONE);
+
+		/* Breathing costs more wakeups than blinking;
+		 * the power profile decides whether it is allowed */
+		if ((pattern->off_period != 0) &&
+		    (led_animation_start(pattern,
+					 ((led_animation_mode ==
+					   LED_ANIMATION_BREATHE) &&
+					  (mce_power_profile_get()->led_breathe ==
+					   TRUE)) ?
+					 LED_ANIMATION_BREATHE :
+					 LED_ANIMATION_BLINK) == TRUE))
+			goto EXIT;
 	}
 
 	mono_set_brightness(pattern->brightness);
@@ -1005,6 +1575,65 @@ static void program_led(const pattern_struct *const pattern)
 	}
 }
 
+/**
+ * Check whether an active and enabled pattern can be shown
+ *
+ * @param psp The pattern
+ * @param display_state The current display state
+ * @param system_state The current system state
+ * @return TRUE if the pattern can be shown, FALSE otherwise
+ */
+static gboolean pattern_is_visible(const pattern_struct *psp,
+				   display_state_t display_state,
+				   system_state_t system_state)
+{
+	mce_log(LL_DEBUG,
+		"pattern: %s, active: %d, enabled: %d",
+		psp->name, psp->active, psp->enabled);
+
+	/* If the LED is disabled,
+	 * only patterns with visibility 5 are shown
+	 */
+	if ((led_enabled == FALSE) && (psp->policy != 5))
+		return FALSE;
+
+	/* Always show pattern with visibility 3 or 5 */
+	if ((psp->policy == 3) || (psp->policy == 5))
+		return TRUE;
+
+	/* Acting dead behaviour */
+	if (system_state == MCE_STATE_ACTDEAD) {
+		/* If we're in acting dead,
+		 * show patterns with visibility 4
+		 */
+		if (psp->policy == 4)
+			return TRUE;
+
+		/* If we're in acting dead
+		 * and the display is off, show pattern
+		 */
+		if ((display_state == MCE_DISPLAY_OFF) &&
+		    (psp->policy == 2))
+			return TRUE;
+
+		/* If the display is on and visibility is 2,
+		 * or if visibility is 1/0, ignore pattern
+		 */
+		return FALSE;
+	}
+
+	/* If the display is off or in low power mode,
+	 * we can use any active pattern
+	 */
+	if ((display_state == MCE_DISPLAY_OFF) ||
+	    (display_state == MCE_DISPLAY_LPM_OFF) ||
+	    (display_state == MCE_DISPLAY_LPM_ON))
+		return TRUE;
+
+	/* If the pattern should be shown with screen on, use it */
+	return psp->policy == 1;
+}
+
 /**
  * Recalculate active pattern and update the pattern timer
  */
@@ -1012,74 +1641,43 @@ static void led_update_active_pattern(void)
 {
 	display_state_t display_state = datapipe_get_gint(display_state_pipe);
 	system_state_t system_state = datapipe_get_gint(system_state_pipe);
-	pattern_struct *new_active_pattern;
-	gint i = 0;
+	pattern_struct *new_active_pattern = NULL;
+	guint i;
 
 	if (g_queue_is_empty(pattern_stack) == TRUE) {
 		disable_led();
 		goto EXIT;
 	}
 
-	while ((new_active_pattern = g_queue_peek_nth(pattern_stack,
-						      i++)) != NULL) {
-		mce_log(LL_DEBUG,
-			"pattern: %s, active: %d, enabled: %d",
-			new_active_pattern->name,
-			new_active_pattern->active,
-			new_active_pattern->enabled);
+	/* Usually the most important pattern can be shown */
+	if (pattern_heap->len > 0) {
+		new_active_pattern = g_ptr_array_index(pattern_heap, 0);
 
-		/* If the pattern is deactivated, ignore */
-		if (new_active_pattern->active == FALSE)
-			continue;
+		if (pattern_is_visible(new_active_pattern, display_state,
+				       system_state) == FALSE)
+			new_active_pattern = NULL;
+	}
 
-		/* If the pattern is disabled through GConf, ignore */
-		if (new_active_pattern->enabled == FALSE)
-			continue;
+	/* Otherwise pick the most important visible one */
+	for (i = 1; (new_active_pattern == NULL) && (i < pattern_heap->len);
+	     i++) {
+		pattern_struct *psp = g_ptr_array_index(pattern_heap, i);
+		guint j;
 
-		/* If the LED is disabled,
-		 * only patterns with visibility 5 are shown
-		 */
-		if ((led_enabled == FALSE) &&
-		    (new_active_pattern->policy != 5))
+		if (pattern_is_visible(psp, display_state,
+				       system_state) == FALSE)
 			continue;
 
-		/* Always show pattern with visibility 3 or 5 */
-		if ((new_active_pattern->policy == 3) ||
-		    (new_active_pattern->policy == 5))
-			break;
-
-		/* Acting dead behaviour */
-		if (system_state == MCE_STATE_ACTDEAD) {
-			/* If we're in acting dead,
-			 * show patterns with visibility 4
-			 */
-			if (new_active_pattern->policy == 4)
-				break;
-
-			/* If we're in acting dead
-			 * and the display is off, show pattern
-			 */
-			if ((display_state == MCE_DISPLAY_OFF) &&
-			    (new_active_pattern->policy == 2))
-				break;
+		for (j = i + 1; j < pattern_heap->len; j++) {
+			pattern_struct *tmp = g_ptr_array_index(pattern_heap, j);
 
-			/* If the display is on and visibility is 2,
-			 * or if visibility is 1/0, ignore pattern
-			 */
-			continue;
+			if ((pattern_heap_before(tmp, psp) == TRUE) &&
+			    (pattern_is_visible(tmp, display_state,
+						system_state) == TRUE))
+				psp = tmp;
 		}
 
-		/* If the display is off or in low power mode,
-		 * we can use any active pattern
-		 */
-		if ((display_state == MCE_DISPLAY_OFF) ||
-		    (display_state == MCE_DISPLAY_LPM_OFF) ||
-		    (display_state == MCE_DISPLAY_LPM_ON))
-			break;
-
-		/* If the pattern should be shown with screen on, use it */
-		if (new_active_pattern->policy == 1)
-			break;
+		new_active_pattern = psp;
 	}
 
 	if ((new_active_pattern == NULL) ||
@@ -1117,15 +1715,11 @@ EXIT:
 static pattern_struct *find_pattern_struct(const gchar *const name)
 {
 	pattern_struct *psp = NULL;
-	GList *glp;
 
-	if (name == NULL)
+	if ((name == NULL) || (pattern_lut == NULL))
 		goto EXIT;
 
-	if ((glp = g_queue_find_custom(pattern_stack,
-				       name, queue_find)) != NULL) {
-		psp = (pattern_struct *)glp->data;
-	}
+	psp = g_hash_table_lookup(pattern_lut, name);
 
 EXIT:
 	return psp;
@@ -1135,31 +1729,26 @@ EXIT:
  * Update combination rule
  *
  * @param name The rule to process
- * @param data Unused
+ * @return TRUE if the state of the combined pattern changed,
+ *         FALSE otherwise
  */
-static void update_combination_rule(gpointer name, gpointer data)
+static gboolean update_combination_rule(const gchar *const name)
 {
 	combination_rule_struct *cr;
 	gboolean enabled = TRUE;
+	gboolean changed = FALSE;
 	pattern_struct *psp;
 	GList *glp;
-	gchar *tmp;
-	gint i;
 
-	(void)data;
-
-	if ((glp = g_queue_find_custom(combination_rule_list,
-				       name, queue_find)) == NULL)
+	if ((cr = g_hash_table_lookup(combination_rule_lut, name)) == NULL)
 		goto EXIT;
 
-	cr = glp->data;
-
 	/* If all patterns in the pre_requisite list are enabled,
 	 * then enable this pattern, else disable it
 	 */
-	for (i = 0; (tmp = g_queue_peek_nth(cr->pre_requisites, i)) != NULL; i++) {
+	for (glp = cr->pre_requisites->head; glp != NULL; glp = glp->next) {
 		/* We've got a pattern name; check if that pattern is active */
-		if (((psp = find_pattern_struct(tmp)) == NULL) ||
+		if (((psp = find_pattern_struct(glp->data)) == NULL) ||
 		    (psp->active == FALSE)) {
 			enabled = FALSE;
 			break;
@@ -1169,20 +1758,30 @@ static void update_combination_rule(gpointer name, gpointer data)
 	if ((psp = find_pattern_struct(name)) == NULL)
 		goto EXIT;
 
-	psp->active = enabled;
+	if (psp->active != enabled) {
+		pattern_set_active(psp, enabled);
+		changed = TRUE;
+	}
 
 EXIT:
-	return;
+	return changed;
 }
 
 /**
  * Update activate patterns based on combination rules
  *
+ * Only the rules using the changed pattern are evaluated; if that
+ * changes the state of a combined pattern, the rules using it are
+ * evaluated in turn.  Since a rule requires all of its patterns to
+ * be active, one change can flip each combined pattern only once
+ * and the propagation always ends.
+ *
  * @param name THe name of the pattern that changed state
  */
 static void update_combination_rules(const gchar *const name)
 {
-	GList *glp;
+	GQueue changed = G_QUEUE_INIT;
+	const gchar *tmp;
 
 	if (name == NULL) {
 		mce_log(LL_CRIT,
@@ -1190,13 +1789,22 @@ static void update_combination_rules(const gchar *const name)
 		goto EXIT;
 	}
 
-	if ((glp = g_queue_find_custom(combination_rule_xref_list, name,
-				       queue_find)) != NULL) {
-		combination_rule_struct *xrf = glp->data;
+	g_queue_push_tail(&changed, (gpointer)name);
+
+	while ((tmp = g_queue_pop_head(&changed)) != NULL) {
+		combination_rule_struct *xrf;
+		GList *glp;
+
+		xrf = g_hash_table_lookup(combination_rule_xref_lut, tmp);
+
+		if (xrf == NULL)
+			continue;
 
 		/* Update all combination rules that this pattern influences */
-		g_queue_foreach(xrf->pre_requisites,
-				update_combination_rule, NULL);
+		for (glp = xrf->pre_requisites->head; glp; glp = glp->next) {
+			if (update_combination_rule(glp->data) == TRUE)
+				g_queue_push_tail(&changed, glp->data);
+		}
 	}
 
 EXIT:
@@ -1219,7 +1827,11 @@ static void led_activate_pattern(const gchar *const name)
 	}
 
 	if ((psp = find_pattern_struct(name)) != NULL) {
-		psp->active = TRUE;
+		/* Repeated activations do not change anything */
+		if (psp->active == TRUE)
+			goto EXIT;
+
+		pattern_set_active(psp, TRUE);
 		update_combination_rules(name);
 		led_update_active_pattern();
 		mce_log(LL_DEBUG,
@@ -1245,7 +1857,10 @@ static void led_deactivate_pattern(const gchar *const name)
 	pattern_struct *psp;
 
 	if ((psp = find_pattern_struct(name)) != NULL) {
-		psp->active = FALSE;
+		if (psp->active == FALSE)
+			goto EXIT;
+
+		pattern_set_active(psp, FALSE);
 		update_combination_rules(name);
 		led_update_active_pattern();
 		mce_log(LL_DEBUG,
@@ -1256,6 +1871,9 @@ static void led_deactivate_pattern(const gchar *const name)
 			"Received request to deactivate "
 			"a non-existing LED pattern");
 	}
+
+EXIT:
+	return;
 }
 
 /**
@@ -1308,6 +1926,27 @@ EXIT:
 	return;
 }
 
+/**
+ * Handle power profile change
+ *
+ * @param data Unused
+ */
+static void power_profile_trigger(gconstpointer data)
+{
+	(void)data;
+
+	/* Only the breathing animation depends on the profile */
+	if ((active_pattern == NULL) ||
+	    (led_animation_mode != LED_ANIMATION_BREATHE))
+		goto EXIT;
+
+	disable_led();
+	program_led(active_pattern);
+
+EXIT:
+	return;
+}
+
 /**
  * Handle led brightness change
  *
@@ -1406,6 +2045,7 @@ static void led_gconf_cb(GConfClient *const gcc, const guint id,
 				       &id, gconf_cb_find)) != NULL) {
 		psp = (pattern_struct *)glp->data;
 		psp->enabled = gconf_value_get_bool(gcv);
+		pattern_heap_update(psp);
 		led_update_active_pattern();
 	} else {
 		mce_log(LL_WARN, "Spurious GConf value received; confused!");
@@ -1589,14 +2229,14 @@ static gboolean led_disable_dbus_cb(DBusMessage *const msg)
 static gboolean init_combination_rules(void)
 {
 	gboolean status = FALSE;
-	gchar **crlist = NULL;
+	const gchar * const *crlist = NULL;
 	gsize length;
 	gint i;
 
 	/* Get the list of valid LED patttern combination rules */
-	crlist = mce_conf_get_string_list(MCE_CONF_LED_GROUP,
-					  MCE_CONF_LED_COMBINATION_RULES,
-					  &length);
+	crlist = mce_conf_peek_string_list(MCE_CONF_LED_GROUP,
+					   MCE_CONF_LED_COMBINATION_RULES,
+					   &length);
 
 	/* Treat failed conf-value reads as if they were due to invalid keys
 	 * rather than failed allocations; let future allocation attempts fail
@@ -1611,15 +2251,15 @@ static gboolean init_combination_rules(void)
 
 	/* Used for all combination patterns */
 	for (i = 0; crlist[i]; i++) {
-		gchar **tmp;
+		const gchar * const *tmp;
 
 		mce_log(LL_DEBUG,
 			"Getting LED pattern combination rule for: %s",
 			crlist[i]);
 
-		tmp = mce_conf_get_string_list(led_pattern_group,
-					       crlist[i],
-					       &length);
+		tmp = mce_conf_peek_string_list(led_pattern_group,
+					        crlist[i],
+					        &length);
 
 		if (tmp != NULL) {
 			combination_rule_struct *cr = NULL;
@@ -1629,15 +2269,13 @@ static gboolean init_combination_rules(void)
 				mce_log(LL_ERR,
 					"LED Pattern Combination rule `%s'",
 					crlist[i]);
-				g_strfreev(tmp);
-				goto EXIT2;
+				goto EXIT;
 			}
 
 			cr = g_slice_new(combination_rule_struct);
 
 			if (cr == NULL) {
-				g_strfreev(tmp);
-				goto EXIT2;
+				goto EXIT;
 			}
 
 			cr->rulename = strdup(tmp[0]);
@@ -1645,20 +2283,20 @@ static gboolean init_combination_rules(void)
 
 			for (j = 1; j < length; j++) {
 				gchar *str = strdup(tmp[j]);
-				GList *glp;
 				combination_rule_struct *xrf = NULL;
 
 				g_queue_push_head(cr->pre_requisites, str);
 
-				glp = g_queue_find_custom(combination_rule_xref_list, str, queue_find);
+				xrf = g_hash_table_lookup(combination_rule_xref_lut,
+							  str);
 
-				if ((glp == NULL) || (glp->data == NULL)) {
+				if (xrf == NULL) {
 					xrf = g_slice_new(combination_rule_struct);
 					xrf->rulename = str;
 					xrf->pre_requisites = g_queue_new();
 					g_queue_push_head(combination_rule_xref_list, xrf);
-				} else {
-					xrf = (combination_rule_struct *)glp->data;
+					g_hash_table_insert(combination_rule_xref_lut,
+							    xrf->rulename, xrf);
 				}
 
 				/* If the cross reference isn't in the list
@@ -1671,14 +2309,13 @@ static gboolean init_combination_rules(void)
 			}
 
 			g_queue_push_head(combination_rule_list, cr);
+			g_hash_table_replace(combination_rule_lut,
+					     cr->rulename, cr);
 		}
 	}
 
 	status = TRUE;
 
-EXIT2:
-	g_strfreev(crlist);
-
 EXIT:
 	return status;
 }
@@ -1691,15 +2328,15 @@ EXIT:
 static gboolean init_lysti_patterns(void)
 {
 	led_type_t led_type = get_led_type();
-	gchar **patternlist = NULL;
+	const gchar * const *patternlist = NULL;
 	gboolean status = FALSE;
 	gsize length;
 	gint i;
 
 	/* Get the list of valid LED patterns */
-	patternlist = mce_conf_get_string_list(MCE_CONF_LED_GROUP,
-					       MCE_CONF_LED_PATTERNS,
-					       &length);
+	patternlist = mce_conf_peek_string_list(MCE_CONF_LED_GROUP,
+					        MCE_CONF_LED_PATTERNS,
+					        &length);
 
 	/* Treat failed conf-value reads as if they were due to invalid keys
 	 * rather than failed allocations; let future allocation attempts fail
@@ -1714,15 +2351,15 @@ static gboolean init_lysti_patterns(void)
 
 	/* Used for Lysti LED patterns */
 	for (i = 0; patternlist[i]; i++) {
-		gchar **tmp;
+		const gchar * const *tmp;
 
 		mce_log(LL_DEBUG,
 			"Getting LED pattern for: %s",
 			patternlist[i]);
 
-		tmp = mce_conf_get_string_list(led_pattern_group,
-					       patternlist[i],
-					       &length);
+		tmp = mce_conf_peek_string_list(led_pattern_group,
+					        patternlist[i],
+					        &length);
 
 		if (tmp != NULL) {
 			pattern_struct *psp;
@@ -1741,7 +2378,6 @@ static gboolean init_lysti_patterns(void)
 			       CHANNEL_SIZE)))) {
 				mce_log(LL_ERR,
 					"Skipping invalid LED-pattern");
-				g_strfreev(tmp);
 				continue;
 			}
 
@@ -1774,15 +2410,13 @@ static gboolean init_lysti_patterns(void)
 				mce_log(LL_ERR,
 					"Same LED muxed to multiple engines; "
 					"skipping invalid LED-pattern");
-				g_strfreev(tmp);
 				continue;
 			}
 
-			psp = g_slice_new(pattern_struct);
+			psp = g_slice_new0(pattern_struct);
 
 			if (!psp) {
-				g_strfreev(tmp);
-				goto EXIT2;
+				goto EXIT;
 			}
 
 			psp->priority = strtoul(tmp[PATTERN_PRIO_FIELD],
@@ -1799,7 +2433,6 @@ static gboolean init_lysti_patterns(void)
 				/* Reset errno,
 				 * to avoid false positives further down
 				 */
-				g_strfreev(tmp);
 				g_slice_free(pattern_struct, psp);
 				continue;
 			}
@@ -1807,17 +2440,15 @@ static gboolean init_lysti_patterns(void)
 			psp->engine1_mux = engine1_mux;
 			psp->engine2_mux = engine2_mux;
 
+			/* Only the channels in use are stored */
 			if (led_type == LED_TYPE_LYSTI_MONO) {
-				strncpy(psp->channel1,
-				       tmp[PATTERN_E_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
+				psp->channel1 =
+					g_strdup(tmp[PATTERN_E_CHANNEL_FIELD]);
 			} else if (led_type == LED_TYPE_LYSTI_RGB) {
-				strncpy(psp->channel1,
-				       tmp[PATTERN_E1_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
-				strncpy(psp->channel2,
-				       tmp[PATTERN_E2_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
+				psp->channel1 =
+					g_strdup(tmp[PATTERN_E1_CHANNEL_FIELD]);
+				psp->channel2 =
+					g_strdup(tmp[PATTERN_E2_CHANNEL_FIELD]);
 			}
 
 			psp->active = FALSE;
@@ -1825,13 +2456,9 @@ static gboolean init_lysti_patterns(void)
 			psp->enabled = pattern_get_enabled(patternlist[i],
 							   &(psp->gconf_cb_id));
 
-			psp->name = strdup(patternlist[i]);
-
-			g_strfreev(tmp);
+			psp->name = g_strdup(patternlist[i]);
 
-			g_queue_insert_sorted(pattern_stack, psp,
-					      queue_prio_compare,
-					      NULL);
+			pattern_add(psp);
 		}
 	}
 
@@ -1844,9 +2471,6 @@ static gboolean init_lysti_patterns(void)
 
 	status = TRUE;
 
-EXIT2:
-	g_strfreev(patternlist);
-
 EXIT:
 	return status;
 }
@@ -1859,15 +2483,15 @@ EXIT:
 static gboolean init_njoy_patterns(void)
 {
 	led_type_t led_type = get_led_type();
-	gchar **patternlist = NULL;
+	const gchar * const *patternlist = NULL;
 	gboolean status = FALSE;
 	gsize length;
 	gint i;
 
 	/* Get the list of valid LED patterns */
-	patternlist = mce_conf_get_string_list(MCE_CONF_LED_GROUP,
-					       MCE_CONF_LED_PATTERNS,
-					       &length);
+	patternlist = mce_conf_peek_string_list(MCE_CONF_LED_GROUP,
+					        MCE_CONF_LED_PATTERNS,
+					        &length);
 
 	/* Treat failed conf-value reads as if they were due to invalid keys
 	 * rather than failed allocations; let future allocation attempts fail
@@ -1882,15 +2506,15 @@ static gboolean init_njoy_patterns(void)
 
 	/* Used for RGB NJoy LED patterns */
 	for (i = 0; patternlist[i]; i++) {
-		gchar **tmp;
+		const gchar * const *tmp;
 
 		mce_log(LL_DEBUG,
 			"Getting LED pattern for: %s",
 			patternlist[i]);
 
-		tmp = mce_conf_get_string_list(led_pattern_group,
-					       patternlist[i],
-					       &length);
+		tmp = mce_conf_peek_string_list(led_pattern_group,
+					        patternlist[i],
+					        &length);
 
 		if (tmp != NULL) {
 			pattern_struct *psp;
@@ -1909,15 +2533,13 @@ static gboolean init_njoy_patterns(void)
 			       CHANNEL_SIZE)))) {
 				mce_log(LL_ERR,
 					"Skipping invalid LED-pattern");
-				g_strfreev(tmp);
 				continue;
 			}
 
-			psp = g_slice_new(pattern_struct);
+			psp = g_slice_new0(pattern_struct);
 
 			if (!psp) {
-				g_strfreev(tmp);
-				goto EXIT2;
+				goto EXIT;
 			}
 
 			psp->priority = strtoul(tmp[PATTERN_PRIO_FIELD],
@@ -1934,25 +2556,21 @@ static gboolean init_njoy_patterns(void)
 				/* Reset errno,
 				 * to avoid false positives further down
 				 */
-				g_strfreev(tmp);
 				g_slice_free(pattern_struct, psp);
 				continue;
 			}
 
+			/* Only the channels in use are stored */
 			if (led_type == LED_TYPE_NJOY_MONO) {
-				strncpy(psp->channel1,
-				       tmp[PATTERN_E_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
+				psp->channel1 =
+					g_strdup(tmp[PATTERN_E_CHANNEL_FIELD]);
 			} else {
-				strncpy(psp->channel1,
-				       tmp[PATTERN_R_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
-				strncpy(psp->channel2,
-				       tmp[PATTERN_G_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
-				strncpy(psp->channel3,
-				       tmp[PATTERN_B_CHANNEL_FIELD],
-				       CHANNEL_SIZE);
+				psp->channel1 =
+					g_strdup(tmp[PATTERN_R_CHANNEL_FIELD]);
+				psp->channel2 =
+					g_strdup(tmp[PATTERN_G_CHANNEL_FIELD]);
+				psp->channel3 =
+					g_strdup(tmp[PATTERN_B_CHANNEL_FIELD]);
 			}
 
 			psp->active = FALSE;
@@ -1960,13 +2578,9 @@ static gboolean init_njoy_patterns(void)
 			psp->enabled = pattern_get_enabled(patternlist[i],
 							   &(psp->gconf_cb_id));
 
-			psp->name = strdup(patternlist[i]);
+			psp->name = g_strdup(patternlist[i]);
 
-			g_strfreev(tmp);
-
-			g_queue_insert_sorted(pattern_stack, psp,
-					      queue_prio_compare,
-					      NULL);
+			pattern_add(psp);
 		}
 	}
 
@@ -1977,9 +2591,6 @@ static gboolean init_njoy_patterns(void)
 
 	status = TRUE;
 
-EXIT2:
-	g_strfreev(patternlist);
-
 EXIT:
 	return status;
 }
@@ -1991,15 +2602,15 @@ EXIT:
  */
 static gboolean init_mono_patterns(void)
 {
-	gchar **patternlist = NULL;
+	const gchar * const *patternlist = NULL;
 	gboolean status = FALSE;
 	gsize length;
 	gint i;
 
 	/* Get the list of valid LED patterns */
-	patternlist = mce_conf_get_string_list(MCE_CONF_LED_GROUP,
-					       MCE_CONF_LED_PATTERNS,
-					       &length);
+	patternlist = mce_conf_peek_string_list(MCE_CONF_LED_GROUP,
+					        MCE_CONF_LED_PATTERNS,
+					        &length);
 
 	/* Treat failed conf-value reads as if they were due to invalid keys
 	 * rather than failed allocations; let future allocation attempts fail
@@ -2014,15 +2625,15 @@ static gboolean init_mono_patterns(void)
 
 	/* Used for single-colour LED patterns */
 	for (i = 0; patternlist[i]; i++) {
-		gint *tmp;
+		const gint *tmp;
 
 		mce_log(LL_DEBUG,
 			"Getting LED pattern for: %s",
 			patternlist[i]);
 
-		tmp = mce_conf_get_int_list(led_pattern_group,
-					    patternlist[i],
-					    &length);
+		tmp = mce_conf_peek_int_list(led_pattern_group,
+					     patternlist[i],
+					     &length);
 
 		if (tmp != NULL) {
 			pattern_struct *psp;
@@ -2030,18 +2641,16 @@ static gboolean init_mono_patterns(void)
 			if (length != NUMBER_OF_PATTERN_FIELDS) {
 				mce_log(LL_ERR,
 					"Skipping invalid LED-pattern");
-				g_free(tmp);
 				continue;
 			}
 
-			psp = g_slice_new(pattern_struct);
+			psp = g_slice_new0(pattern_struct);
 
 			if (!psp) {
-				g_free(tmp);
-				goto EXIT2;
+				goto EXIT;
 			}
 
-			psp->name = strdup(patternlist[i]);
+			psp->name = g_strdup(patternlist[i]);
 			psp->priority = tmp[PATTERN_PRIO_FIELD];
 			psp->policy = tmp[PATTERN_SCREEN_ON_FIELD];
 			psp->timeout = tmp[PATTERN_TIMEOUT_FIELD] ? tmp[PATTERN_TIMEOUT_FIELD] : -1;
@@ -2053,19 +2662,12 @@ static gboolean init_mono_patterns(void)
 			psp->enabled = pattern_get_enabled(patternlist[i],
 							   &(psp->gconf_cb_id));
 
-			g_free(tmp);
-
-			g_queue_insert_sorted(pattern_stack, psp,
-					      queue_prio_compare,
-					      NULL);
+			pattern_add(psp);
 		}
 	}
 
 	status = TRUE;
 
-EXIT2:
-	g_strfreev(patternlist);
-
 EXIT:
 	return status;
 }
@@ -2078,6 +2680,7 @@ EXIT:
 static gboolean init_patterns(void)
 {
 	gboolean status;
+	gchar *str;
 
 	switch (get_led_type()) {
 	case LED_TYPE_LYSTI_MONO:
@@ -2091,6 +2694,14 @@ static gboolean init_patterns(void)
 		break;
 
 	case LED_TYPE_DIRECT_MONO:
+		str = mce_conf_get_string(MCE_CONF_LED_GROUP,
+					  MCE_CONF_LED_MONO_ANIMATION, "");
+		led_animation_mode =
+			mce_translate_string_to_int_with_default(led_animation_translation,
+								 str,
+								 DEFAULT_LED_ANIMATION);
+		g_free(str);
+
 		status = init_mono_patterns();
 		break;
 
@@ -2122,6 +2733,8 @@ const gchar *g_module_check_init(GModule *module)
 					  system_state_trigger);
 	append_output_trigger_to_datapipe(&display_state_pipe,
 					  display_state_trigger);
+	append_output_trigger_to_datapipe(&power_profile_pipe,
+					  power_profile_trigger);
 	append_output_trigger_to_datapipe(&led_brightness_pipe,
 					  led_brightness_trigger);
 	append_output_trigger_to_datapipe(&led_pattern_activate_pipe,
@@ -2129,13 +2742,21 @@ const gchar *g_module_check_init(GModule *module)
 	append_output_trigger_to_datapipe(&led_pattern_deactivate_pipe,
 					  led_pattern_deactivate_trigger);
 
+	led_pattern_deadline = mce_deadline_create("led_pattern",
+						   led_pattern_timeout_cb,
+						   NULL);
+
 	/* Setup a pattern stack,
 	 * a combination rule stack and a cross-refernce for said stack
 	 * and initialise the patterns
 	 */
 	pattern_stack = g_queue_new();
+	pattern_lut = g_hash_table_new(g_str_hash, g_str_equal);
+	pattern_heap = g_ptr_array_new();
 	combination_rule_list = g_queue_new();
 	combination_rule_xref_list = g_queue_new();
+	combination_rule_lut = g_hash_table_new(g_str_hash, g_str_equal);
+	combination_rule_xref_lut = g_hash_table_new(g_str_hash, g_str_equal);
 
 	if (init_patterns() == FALSE)
 		goto EXIT;
@@ -2192,6 +2813,9 @@ void g_module_unload(GModule *module)
 
 	(void)module;
 
+	/* Stop the software animation */
+	led_animation_stop();
+
 	/* Close files */
 	mce_close_output(&led_current_rm_output);
 	mce_close_output(&led_current_g_output);
@@ -2208,6 +2832,8 @@ void g_module_unload(GModule *module)
 					    led_pattern_activate_trigger);
 	remove_output_trigger_from_datapipe(&led_brightness_pipe,
 					    led_brightness_trigger);
+	remove_output_trigger_from_datapipe(&power_profile_pipe,
+					    power_profile_trigger);
 	remove_output_trigger_from_datapipe(&display_state_pipe,
 					    display_state_trigger);
 	remove_output_trigger_from_datapipe(&system_state_pipe,
@@ -2243,14 +2869,29 @@ void g_module_unload(GModule *module)
 	g_free(engine2_leds_path);
 	g_free(engine3_leds_path);
 
+	/* Free the pattern lookup structures */
+	if (pattern_heap != NULL) {
+		g_ptr_array_free(pattern_heap, TRUE);
+		pattern_heap = NULL;
+	}
+
+	if (pattern_lut != NULL) {
+		g_hash_table_destroy(pattern_lut);
+		pattern_lut = NULL;
+	}
+
 	/* Free the pattern stack */
 	if (pattern_stack != NULL) {
 		pattern_struct *psp;
 
 		while ((psp = g_queue_pop_head(pattern_stack)) != NULL) {
 			mce_gconf_notifier_remove(GINT_TO_POINTER(psp->gconf_cb_id), NULL);
+			mce_memstat_free("led:patterns", pattern_size(psp));
 			g_free(psp->name);
 			psp->name = NULL;
+			g_free(psp->channel1);
+			g_free(psp->channel2);
+			g_free(psp->channel3);
 			g_slice_free(pattern_struct, psp);
 		}
 
@@ -2258,6 +2899,17 @@ void g_module_unload(GModule *module)
 		pattern_stack = NULL;
 	}
 
+	/* Free the combination rule lookup tables */
+	if (combination_rule_xref_lut != NULL) {
+		g_hash_table_destroy(combination_rule_xref_lut);
+		combination_rule_xref_lut = NULL;
+	}
+
+	if (combination_rule_lut != NULL) {
+		g_hash_table_destroy(combination_rule_lut);
+		combination_rule_lut = NULL;
+	}
+
 	/* Free the combination rule list */
 	if (combination_rule_list != NULL) {
 		combination_rule_struct *cr;
@@ -2295,6 +2947,8 @@ void g_module_unload(GModule *module)
 
 	/* Remove all timer sources */
 	cancel_pattern_timeout();
+	mce_deadline_delete(led_pattern_deadline);
+	led_pattern_deadline = NULL;
 
 	return;
 }
@@ -32,6 +32,18 @@
 /** Name of configuration key for the list of LED Pattern combination-rules */
 #define MCE_CONF_LED_COMBINATION_RULES		"CombinationRules"
 
+/** Name of configuration key for the mono-LED animation mode */
+#define MCE_CONF_LED_MONO_ANIMATION		"MonoAnimation"
+
+/**
+ * Tolerance for a late LED pattern timeout, to let it share
+ * a wakeup with other timers; in milliseconds
+ */
+#define LED_PATTERN_TIMEOUT_SLACK		2000
+
+/** Update interval for the breathing mono-LED animation; in milliseconds */
+#define LED_ANIMATION_STEP_TIME			40
+
 /**
  * Name of LED single-colour pattern configuration group for
  * RX-34
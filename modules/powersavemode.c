@@ -58,6 +58,9 @@
 					 * append_output_trigger_to_datapipe(),
 					 * remove_output_trigger_from_datapipe()
 					 */
+#include "mce-power-profile.h"		/* mce_power_profile_select(),
+					 * mce_power_profile_get()
+					 */
 
 /** Module name */
 #define MODULE_NAME		"powersavemode"
@@ -101,6 +104,9 @@ static gboolean active_power_saving_mode = FALSE;
 /** Device thermal state */
 static thermal_state_t thermal_state = THERMAL_STATE_UNDEF;
 
+/** Active power profile */
+static power_profile_t active_power_profile = POWER_PROFILE_NORMAL;
+
 /**
  * Send the PSM state
  *
@@ -151,6 +157,33 @@ EXIT:
 	return status;
 }
 
+/**
+ * Update the power profile
+ *
+ * The profile tells the other modules how much CPU time
+ * and wakeups they may spend
+ */
+static void update_power_profile(void)
+{
+	power_profile_t new_power_profile =
+		mce_power_profile_select(active_power_saving_mode,
+					 thermal_state);
+
+	if (active_power_profile == new_power_profile)
+		goto EXIT;
+
+	active_power_profile = new_power_profile;
+	(void)execute_datapipe(&power_profile_pipe,
+			       GINT_TO_POINTER(active_power_profile),
+			       USE_INDATA, CACHE_INDATA);
+
+	mce_log(LL_DEBUG, "power profile: %s",
+		mce_power_profile_get()->name);
+
+EXIT:
+	return;
+}
+
 /**
  * Update the power saving mode
  */
@@ -183,6 +216,8 @@ static void update_power_saving_mode(void)
 				       USE_INDATA, CACHE_INDATA);
 		send_psm_state(NULL);
 	}
+
+	update_power_profile();
 }
 
 /**
@@ -40,6 +40,16 @@
 					 */
 #include "mce-hal.h"			/* get_sysinfo_value() */
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-conf.h"			/* mce_conf_get_int(),
+					 * mce_conf_get_string()
+					 */
+#include "mce-iio.h"			/* mce_iio_exists(),
+					 * mce_iio_read(),
+					 * mce_iio_open(),
+					 * mce_iio_set_enabled(),
+					 * mce_iio_close(),
+					 * mce_iio_sample_t
+					 */
 #include "mce-dbus.h"			/* Direct:
 					 * ---
 					 * mce_dbus_handler_add(),
@@ -58,7 +68,13 @@
 					 * ---
 					 * MCE_REQUEST_IF
 					 */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start(),
+					 * mce_deadline_stop()
+					 */
 #include "datapipe.h"			/* execute_datapipe(),
+					 * execute_datapipe_output_triggers(),
 					 * append_input_trigger_to_datapipe(),
 					 * remove_input_trigger_from_datapipe()
 					 */
@@ -106,11 +122,38 @@ typedef enum {
 #ifdef ENABLE_HYBRIS
 	PS_TYPE_HYBRIS = 3,
 #endif
+	/** Industrial I/O subsystem sensor */
+	PS_TYPE_IIO = 4,
 } ps_type_t;
 
+/** Proximity sensor demand, from least to most demanding */
+typedef enum {
+	/** Nobody needs the proximity sensor */
+	PS_DEMAND_NONE = 0,
+	/** Changes may be detected with a delay; the sensor is duty cycled */
+	PS_DEMAND_SLOW = 1,
+	/** Changes must be detected immediately; the sensor stays on */
+	PS_DEMAND_FAST = 2,
+} ps_demand_t;
+
 /** State of proximity sensor monitoring */
 static gboolean proximity_monitor_active = FALSE;
 
+/** Proximity sensor duty cycle deadline */
+static mce_deadline_t *ps_duty_cycle_deadline = NULL;
+
+/** Is the proximity sensor being duty cycled */
+static gboolean ps_duty_cycling = FALSE;
+
+/** Is the proximity sensor powered down for the duty cycle off period */
+static gboolean ps_duty_cycle_off = FALSE;
+
+/** Duty cycle on period [ms]; from config */
+static gint ps_duty_cycle_on_time = DEFAULT_PS_DUTY_CYCLE_ON_TIME;
+
+/** Duty cycle off period [ms]; from config, 0 disables duty cycling */
+static gint ps_duty_cycle_off_time = DEFAULT_PS_DUTY_CYCLE_OFF_TIME;
+
 /** ID for the proximity sensor I/O monitor */
 static gconstpointer proximity_sensor_iomon_id = NULL;
 
@@ -143,6 +186,18 @@ static output_state_t ps_calib1_output =
 /** Proximity threshold */
 static hysteresis_t *ps_threshold = NULL;
 
+/** Proximity threshold for the IIO proximity sensor; from config */
+static hysteresis_t ps_iio_threshold;
+
+/** IIO capture for the proximity sensor; NULL when not capturing */
+static mce_iio_t *ps_iio = NULL;
+
+/** IIO proximity sensor device name, as reported by the driver */
+static gchar *ps_iio_device = NULL;
+
+/** IIO proximity sensor channel */
+static gchar *ps_iio_channel = NULL;
+
 /** Last proximity sensor state */
 static cover_state_t old_proximity_sensor_state = COVER_UNDEF;
 
@@ -171,7 +226,27 @@ static ps_type_t get_ps_type(void)
 	if (ps_type != PS_TYPE_UNSET)
 		goto EXIT;
 
-	if (g_access(PS_DEVICE_PATH_AVAGO, R_OK) == 0) {
+	ps_iio_device = mce_conf_get_string(MCE_CONF_PS_GROUP,
+					    MCE_CONF_PS_IIO_DEVICE,
+					    DEFAULT_PS_IIO_DEVICE);
+
+	/* An explicitly configured IIO sensor takes precedence */
+	if ((ps_iio_device != NULL) && (*ps_iio_device != '\0') &&
+	    (mce_iio_exists(ps_iio_device) == TRUE)) {
+		ps_type = PS_TYPE_IIO;
+		ps_iio_channel = mce_conf_get_string(MCE_CONF_PS_GROUP,
+						     MCE_CONF_PS_IIO_CHANNEL,
+						     DEFAULT_PS_IIO_CHANNEL);
+		ps_iio_threshold.threshold_rising =
+			mce_conf_get_int(MCE_CONF_PS_GROUP,
+					 MCE_CONF_PS_IIO_THRESHOLD_RISING,
+					 DEFAULT_PS_IIO_THRESHOLD_RISING);
+		ps_iio_threshold.threshold_falling =
+			mce_conf_get_int(MCE_CONF_PS_GROUP,
+					 MCE_CONF_PS_IIO_THRESHOLD_FALLING,
+					 DEFAULT_PS_IIO_THRESHOLD_FALLING);
+		ps_threshold = &ps_iio_threshold;
+	} else if (g_access(PS_DEVICE_PATH_AVAGO, R_OK) == 0) {
 		ps_type = PS_TYPE_AVAGO;
 		ps_device_path = PS_DEVICE_PATH_AVAGO;
 		ps_enable_path = PS_PATH_AVAGO_ENABLE;
@@ -243,6 +318,36 @@ static void disable_proximity_sensor(void)
 	}
 }
 
+/**
+ * Report a proximity sensor state change
+ *
+ * During a call, uncovering the sensor unblanks the display;
+ * hint the display to start powering up right away, since the
+ * state change itself is processed from the idle loop
+ *
+ * @param proximity_sensor_state The new proximity sensor state
+ */
+static void report_proximity_sensor_state(cover_state_t proximity_sensor_state)
+{
+	/* Ignore samples still queued when the sensor was powered down */
+	if (ps_duty_cycle_off == TRUE)
+		goto EXIT;
+
+	if ((proximity_sensor_state == COVER_OPEN) &&
+	    ((call_state == CALL_STATE_RINGING) ||
+	     (call_state == CALL_STATE_ACTIVE)))
+		execute_datapipe_output_triggers(&display_prewake_pipe,
+						 GINT_TO_POINTER(TRUE),
+						 USE_INDATA);
+
+	execute_datapipe_deferred(&proximity_sensor_pipe,
+				  GINT_TO_POINTER(proximity_sensor_state),
+				  USE_INDATA, CACHE_INDATA);
+
+EXIT:
+	return;
+}
+
 /**
  * Calibrate the proximity sensor using calibration values from CAL
  */
@@ -345,9 +450,7 @@ static gboolean ps_avago_iomon_cb(gpointer data, gsize bytes_read)
 
 	old_proximity_sensor_state = proximity_sensor_state;
 
-	(void)execute_datapipe(&proximity_sensor_pipe,
-			       GINT_TO_POINTER(proximity_sensor_state),
-			       USE_INDATA, CACHE_INDATA);
+	report_proximity_sensor_state(proximity_sensor_state);
 
 EXIT:
 	return FALSE;
@@ -391,9 +494,7 @@ static gboolean ps_dipro_iomon_cb(gpointer data, gsize bytes_read)
 
 	old_proximity_sensor_state = proximity_sensor_state;
 
-	(void)execute_datapipe(&proximity_sensor_pipe,
-			       GINT_TO_POINTER(proximity_sensor_state),
-			       USE_INDATA, CACHE_INDATA);
+	report_proximity_sensor_state(proximity_sensor_state);
 
 EXIT:
 	return FALSE;
@@ -427,15 +528,98 @@ static void ps_hybris_iomon_cb(int64_t timestamp, float distance)
 
 	old_proximity_sensor_state = proximity_sensor_state;
 
-	(void)execute_datapipe(&proximity_sensor_pipe,
-			       GINT_TO_POINTER(proximity_sensor_state),
-			       USE_INDATA, CACHE_INDATA);
+	report_proximity_sensor_state(proximity_sensor_state);
 
 EXIT:
 	return;
 }
 #endif /* ENABLE_HYBRIS */
 
+/**
+ * Update the proximity state from an IIO reading
+ *
+ * @param value The proximity reading
+ */
+static void update_proximity_sensor_state_iio(gdouble value)
+{
+	cover_state_t proximity_sensor_state;
+
+	if (old_proximity_sensor_state == COVER_UNDEF) {
+		if (value < ps_threshold->threshold_rising)
+			proximity_sensor_state = COVER_OPEN;
+		else
+			proximity_sensor_state = COVER_CLOSED;
+	} else if (value > ps_threshold->threshold_rising) {
+		proximity_sensor_state = COVER_CLOSED;
+	} else if (value < ps_threshold->threshold_falling) {
+		proximity_sensor_state = COVER_OPEN;
+	} else {
+		goto EXIT;
+	}
+
+	if (old_proximity_sensor_state == proximity_sensor_state)
+		goto EXIT;
+
+	old_proximity_sensor_state = proximity_sensor_state;
+
+	report_proximity_sensor_state(proximity_sensor_state);
+
+EXIT:
+	return;
+}
+
+/**
+ * Batch callback for the IIO proximity sensor
+ *
+ * Each sample goes through the hysteresis, so that a short
+ * covering within a batch is not lost
+ *
+ * @param samples The samples, oldest first
+ * @param count The number of samples
+ * @param user_data Unused
+ */
+static void ps_iio_batch_cb(const mce_iio_sample_t *samples, gsize count,
+			    gpointer user_data)
+{
+	gsize i;
+
+	(void)user_data;
+
+	for (i = 0; i < count; i++)
+		update_proximity_sensor_state_iio(samples[i].value);
+}
+
+/**
+ * Start IIO buffered capture for the proximity sensor
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ps_iio_start(void)
+{
+	gchar *trigger = mce_conf_get_string(MCE_CONF_PS_GROUP,
+					     MCE_CONF_PS_IIO_TRIGGER,
+					     DEFAULT_PS_IIO_TRIGGER);
+	gint watermark = mce_conf_get_int(MCE_CONF_PS_GROUP,
+					  MCE_CONF_PS_IIO_WATERMARK,
+					  DEFAULT_PS_IIO_WATERMARK);
+	gdouble value = 0.0;
+
+	/* Get the initial state before the buffer takes over */
+	if (mce_iio_read(ps_iio_device, ps_iio_channel, &value) == TRUE)
+		update_proximity_sensor_state_iio(value);
+
+	ps_iio = mce_iio_open(ps_iio_device, ps_iio_channel, trigger,
+			      MAX(watermark, 1), ps_iio_batch_cb, NULL);
+
+	if (ps_iio == NULL)
+		mce_log(LL_WARN, "IIO capture from `%s' failed",
+			ps_iio_device);
+
+	g_free(trigger);
+
+	return ps_iio != NULL;
+}
+
 /**
  * Update the proximity state (Avago)
  *
@@ -468,11 +652,14 @@ static void update_proximity_sensor_state_avago(void)
 	else
 		proximity_sensor_state = COVER_OPEN;
 
+	/* Samples taken while duty cycling only report changes */
+	if ((ps_duty_cycling == TRUE) &&
+	    (old_proximity_sensor_state == proximity_sensor_state))
+		goto EXIT;
+
 	old_proximity_sensor_state = proximity_sensor_state;
 
-	(void)execute_datapipe(&proximity_sensor_pipe,
-			       GINT_TO_POINTER(proximity_sensor_state),
-			       USE_INDATA, CACHE_INDATA);
+	report_proximity_sensor_state(proximity_sensor_state);
 
 EXIT:
 	g_free(tmp);
@@ -509,11 +696,14 @@ static void update_proximity_sensor_state_dipro(void)
 	else
 		proximity_sensor_state = COVER_CLOSED;
 
+	/* Samples taken while duty cycling only report changes */
+	if ((ps_duty_cycling == TRUE) &&
+	    (old_proximity_sensor_state == proximity_sensor_state))
+		goto EXIT;
+
 	old_proximity_sensor_state = proximity_sensor_state;
 
-	(void)execute_datapipe(&proximity_sensor_pipe,
-			       GINT_TO_POINTER(proximity_sensor_state),
-			       USE_INDATA, CACHE_INDATA);
+	report_proximity_sensor_state(proximity_sensor_state);
 
 EXIT:
 	g_free(tmp);
@@ -566,6 +756,12 @@ static void enable_proximity_monitor(void)
 
 			update_proximity_sensor_state_dipro();
 			break;
+
+		case PS_TYPE_IIO:
+			if (ps_iio == NULL)
+				(void)ps_iio_start();
+			break;
+
 		default:
 			break;
 		}
@@ -597,6 +793,11 @@ static void disable_proximity_monitor(void)
 		break;
 #endif
 
+	case PS_TYPE_IIO:
+		mce_iio_close(ps_iio);
+		ps_iio = NULL;
+		break;
+
 	default:
 		/* Unregister proximity sensor I/O monitor */
 		if( proximity_sensor_iomon_id ) {
@@ -610,26 +811,165 @@ EXIT:
 }
 
 /**
- * Update the proximity monitoring
+ * Check whether the proximity sensor can be duty cycled
+ *
+ * @return TRUE if the sensor has an enable control, FALSE otherwise
  */
-static void update_proximity_monitor(void)
+static gboolean ps_duty_cycle_supported(void)
+{
+	switch (get_ps_type()) {
+#ifdef ENABLE_HYBRIS
+	case PS_TYPE_HYBRIS:
+#endif
+	case PS_TYPE_IIO:
+		return TRUE;
+
+	default:
+		return ps_enable_path != NULL;
+	}
+}
+
+/**
+ * Power the proximity sensor up or down for the duty cycle
+ *
+ * Only the sensor enable control is touched; the I/O monitors and
+ * the IIO buffer stay set up, so that no descriptors get reopened
+ *
+ * @param off TRUE to power the sensor down, FALSE to power it up
+ */
+static void ps_duty_cycle_set_off(gboolean off)
+{
+	if (ps_duty_cycle_off == off)
+		goto EXIT;
+
+	ps_duty_cycle_off = off;
+
+	if (get_ps_type() == PS_TYPE_IIO) {
+		mce_iio_set_enabled(ps_iio, !off);
+	} else if (off == TRUE) {
+		disable_proximity_sensor();
+	} else {
+		enable_proximity_sensor();
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Duty cycle deadline callback; powers the sensor down or up
+ *
+ * @param user_data Unused
+ */
+static void ps_duty_cycle_cb(gpointer user_data)
+{
+	(void)user_data;
+
+	if (ps_duty_cycle_off == FALSE) {
+		ps_duty_cycle_set_off(TRUE);
+		mce_deadline_start(ps_duty_cycle_deadline,
+				   ps_duty_cycle_off_time);
+	} else {
+		ps_duty_cycle_set_off(FALSE);
+		mce_deadline_start(ps_duty_cycle_deadline,
+				   ps_duty_cycle_on_time);
+	}
+}
+
+/**
+ * Start duty cycling the proximity sensor
+ */
+static void start_ps_duty_cycle(void)
+{
+	if (ps_duty_cycling == TRUE)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "start PS duty cycle; %d ms on, %d ms off",
+		ps_duty_cycle_on_time, ps_duty_cycle_off_time);
+	ps_duty_cycling = TRUE;
+
+	/* Begin with an on period */
+	enable_proximity_monitor();
+	mce_deadline_start(ps_duty_cycle_deadline, ps_duty_cycle_on_time);
+
+EXIT:
+	return;
+}
+
+/**
+ * Stop duty cycling the proximity sensor
+ *
+ * The monitoring is left in whatever state it was in;
+ * the caller decides whether it should be enabled
+ */
+static void stop_ps_duty_cycle(void)
+{
+	if (ps_duty_cycling == FALSE)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "stop PS duty cycle");
+	ps_duty_cycling = FALSE;
+	mce_deadline_stop(ps_duty_cycle_deadline);
+
+	/* Leave the sensor powered up for the caller */
+	ps_duty_cycle_set_off(FALSE);
+
+EXIT:
+	return;
+}
+
+/**
+ * Aggregate the proximity sensor demand of all requesters
+ *
+ * Calls, alarms and D-Bus clients need immediate detection;
+ * the display and tklock policies can live with a delay
+ *
+ * @return The highest demand of all requesters
+ */
+static ps_demand_t get_ps_demand(void)
 {
 	display_state_t display_state = datapipe_get_gint(display_state_pipe);
 	submode_t submode = mce_get_submode_int32();
+	ps_demand_t demand = PS_DEMAND_NONE;
+
+	if ((call_state == CALL_STATE_RINGING) ||
+	    (call_state == CALL_STATE_ACTIVE) ||
+	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32) ||
+	    (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32) ||
+	    (ps_external_refcount > 0)) {
+		demand = PS_DEMAND_FAST;
+	} else if ((display_state == MCE_DISPLAY_ON) ||
+		   (display_state == MCE_DISPLAY_LPM_ON) ||
+		   (((submode & MCE_TKLOCK_SUBMODE) != 0) &&
+		    ((display_state == MCE_DISPLAY_OFF) ||
+		     (display_state == MCE_DISPLAY_LPM_OFF)))) {
+		demand = PS_DEMAND_SLOW;
+	}
+
+	return demand;
+}
+
+/**
+ * Update the proximity monitoring
+ */
+static void update_proximity_monitor(void)
+{
+	ps_demand_t demand;
 
 	if (get_ps_type() == PS_TYPE_NONE)
 		goto EXIT;
 
-	if ((display_state == MCE_DISPLAY_ON) ||
-	    (display_state == MCE_DISPLAY_LPM_ON) ||
-	    (((submode & MCE_TKLOCK_SUBMODE) != 0) &&
-	     ((display_state == MCE_DISPLAY_OFF) ||
-	      (display_state == MCE_DISPLAY_LPM_OFF))) ||
-	    (ps_external_refcount > 0) ||
-	    (call_state == CALL_STATE_RINGING) ||
-	    (call_state == CALL_STATE_ACTIVE) ||
-	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32) ||
-	    (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32)) {
+	demand = get_ps_demand();
+
+	if ((demand == PS_DEMAND_SLOW) && (ps_duty_cycle_off_time > 0) &&
+	    (ps_duty_cycle_supported() == TRUE)) {
+		start_ps_duty_cycle();
+		goto EXIT;
+	}
+
+	stop_ps_duty_cycle();
+
+	if (demand != PS_DEMAND_NONE) {
 		enable_proximity_monitor();
 	} else {
 		disable_proximity_monitor();
@@ -859,6 +1199,20 @@ const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	ps_duty_cycle_on_time = mce_conf_get_int(MCE_CONF_PS_GROUP,
+						 MCE_CONF_PS_DUTY_CYCLE_ON_TIME,
+						 DEFAULT_PS_DUTY_CYCLE_ON_TIME);
+	ps_duty_cycle_off_time = mce_conf_get_int(MCE_CONF_PS_GROUP,
+						  MCE_CONF_PS_DUTY_CYCLE_OFF_TIME,
+						  DEFAULT_PS_DUTY_CYCLE_OFF_TIME);
+
+	/* Duty cycling needs a period to take the samples in */
+	if (ps_duty_cycle_on_time <= 0)
+		ps_duty_cycle_off_time = 0;
+
+	ps_duty_cycle_deadline = mce_deadline_create("ps_duty_cycle",
+						     ps_duty_cycle_cb, NULL);
+
 	/* Append triggers/filters to datapipes */
 	append_input_trigger_to_datapipe(&call_state_pipe,
 					 call_state_trigger);
@@ -915,8 +1269,22 @@ void g_module_unload(GModule *module)
 	remove_input_trigger_from_datapipe(&call_state_pipe,
 					   call_state_trigger);
 
+	/* Stop duty cycling */
+	stop_ps_duty_cycle();
+	mce_deadline_delete(ps_duty_cycle_deadline);
+	ps_duty_cycle_deadline = NULL;
+
 	/* Unregister I/O monitors */
 	mce_unregister_io_monitor(proximity_sensor_iomon_id);
 
+	/* Stop IIO buffered capture */
+	mce_iio_close(ps_iio);
+	ps_iio = NULL;
+
+	g_free(ps_iio_channel);
+	ps_iio_channel = NULL;
+	g_free(ps_iio_device);
+	ps_iio_device = NULL;
+
 	return;
 }
@@ -102,4 +102,55 @@ static hysteresis_t dipro_ps_threshold_dipro = {
 /** Sysinfo identifier for the proximity sensor calibration values */
 #define PS_CALIB_IDENTIFIER		"/device/ps_calib"
 
+/** Name of proximity sensor configuration group */
+#define MCE_CONF_PS_GROUP			"ProximitySensor"
+
+/** Name of the configuration key for the IIO PS device name */
+#define MCE_CONF_PS_IIO_DEVICE			"IIODevice"
+
+/** Name of the configuration key for the IIO PS channel */
+#define MCE_CONF_PS_IIO_CHANNEL			"IIOChannel"
+
+/** Name of the configuration key for the IIO PS trigger */
+#define MCE_CONF_PS_IIO_TRIGGER			"IIOTrigger"
+
+/** Name of the configuration key for the IIO PS buffer watermark */
+#define MCE_CONF_PS_IIO_WATERMARK		"IIOWatermark"
+
+/** Name of the configuration key for the IIO PS rising threshold */
+#define MCE_CONF_PS_IIO_THRESHOLD_RISING	"IIOThresholdRising"
+
+/** Name of the configuration key for the IIO PS falling threshold */
+#define MCE_CONF_PS_IIO_THRESHOLD_FALLING	"IIOThresholdFalling"
+
+/** Name of the configuration key for the duty cycle on period */
+#define MCE_CONF_PS_DUTY_CYCLE_ON_TIME		"DutyCycleOnTime"
+
+/** Name of the configuration key for the duty cycle off period */
+#define MCE_CONF_PS_DUTY_CYCLE_OFF_TIME		"DutyCycleOffTime"
+
+/** Default IIO PS device name; empty to not use IIO */
+#define DEFAULT_PS_IIO_DEVICE			""
+
+/** Default IIO PS channel */
+#define DEFAULT_PS_IIO_CHANNEL			"in_proximity"
+
+/** Default IIO PS trigger; empty to use the one set up by the system */
+#define DEFAULT_PS_IIO_TRIGGER			""
+
+/** Default number of IIO PS samples to deliver per wakeup */
+#define DEFAULT_PS_IIO_WATERMARK		1
+
+/** Default IIO PS rising threshold */
+#define DEFAULT_PS_IIO_THRESHOLD_RISING		80
+
+/** Default IIO PS falling threshold */
+#define DEFAULT_PS_IIO_THRESHOLD_FALLING	70
+
+/** Default duty cycle on period [ms] */
+#define DEFAULT_PS_DUTY_CYCLE_ON_TIME		250
+
+/** Default duty cycle off period [ms]; 0 keeps the sensor always on */
+#define DEFAULT_PS_DUTY_CYCLE_OFF_TIME		750
+
 #endif /* _PROXIMITY_H_ */
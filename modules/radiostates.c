@@ -22,6 +22,7 @@
 #include <gmodule.h>
 
 #include <errno.h>		/* errno */
+#include <stdio.h>		/* snprintf() */
 #include <string.h>		/* strlen(), strncmp() */
 
 #include <mce/mode-names.h>	/* MCE_RADIO_STATE_MASTER */
@@ -30,7 +31,7 @@
 #include "radiostates.h"	/* MCE_RADIO_STATES_PATH */
 
 #include "mce-io.h"		/* mce_read_number_string_from_file(),
-				 * mce_write_number_string_to_file_atomic(),
+				 * mce_io_update_file_atomic_async(),
 				 * mce_are_settings_locked(),
 				 * mce_unlock_settings()
 				 */
@@ -43,6 +44,7 @@
 				 * ---
 				 * mce_dbus_handler_add(),
 				 * dbus_send_message(),
+				 * dbus_send_message_coalesced(),
 				 * dbus_new_method_reply(),
 				 * dbus_new_signal(),
 				 * dbus_message_append_args(),
@@ -192,8 +194,8 @@ static gboolean send_radio_states(DBusMessage *const method_call)
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(msg);
+	/* Send the message; flapping signals are collapsed */
+	status = dbus_send_message_coalesced(msg, 0);
 
 EXIT:
 	return status;
@@ -220,12 +222,33 @@ static void set_radio_states(const gulong states, const gulong mask)
 	}
 }
 
+/**
+ * Save one radio state file without blocking the main loop
+ *
+ * @param path The file to save
+ * @param states The radio states to store
+ */
+static void save_radio_states_file(const gchar *path, const gulong states)
+{
+	char data[32];
+	int size = snprintf(data, sizeof data, "%lu", states);
+
+	/* Write errors are logged by the save worker; no completion
+	 * callback, as it could outlive the module on unload */
+	mce_io_update_file_atomic_async(path, data, size, 0644, FALSE,
+					NULL, NULL);
+}
+
 /**
  * Save the radio states to persistant storage
  *
+ * The files are written atomically by the asynchronous save
+ * worker; unchanged files are not rewritten, and a failure to
+ * write is only logged once the save has been attempted
+ *
  * @param online_states The online radio states to store
  * @param offline_states The offline radio states to store
- * @return TRUE on success, FALSE on failure
+ * @return TRUE if the save was started, FALSE if settings are locked
  */
 static gboolean save_radio_states(const gulong online_states,
 				  const gulong offline_states)
@@ -239,12 +262,10 @@ static gboolean save_radio_states(const gulong online_states,
 		goto EXIT;
 	}
 
-	status = mce_write_number_string_to_file_atomic(MCE_ONLINE_RADIO_STATES_PATH, online_states);
-
-	if (status == FALSE)
-		goto EXIT;
+	save_radio_states_file(MCE_ONLINE_RADIO_STATES_PATH, online_states);
+	save_radio_states_file(MCE_OFFLINE_RADIO_STATES_PATH, offline_states);
 
-	status = mce_write_number_string_to_file_atomic(MCE_OFFLINE_RADIO_STATES_PATH, offline_states);
+	status = TRUE;
 
 EXIT:
 	return status;
@@ -500,6 +521,13 @@ static void master_radio_trigger(gconstpointer data)
 /** net.connman.Manager.PropertyChanged D-Bus signal */
 #define CONNMAN_PROPERTY_CHANGED_SIG "PropertyChanged"
 
+/** Delay for batching connman property changes [ms]
+ *
+ * Offline mode transitions tend to produce bursts of property
+ * change signals; reconciliation is done only after things
+ * have been quiet for this long */
+#define CONNMAN_SYNC_DELAY	100
+
 /** Placeholder for any basic dbus data type */
 typedef union
 {
@@ -558,7 +586,50 @@ static gulong connman_master = ~0lu;
  * starts to send replies before signaling the changes */
 static gboolean connman_verify_property_setting = FALSE;
 
+/** Flag: MCE master radio state has changed and needs to be sent to connman */
+static gboolean connman_master_changed = FALSE;
+
+/** The connman method call we are waiting a reply for, or NULL
+ *
+ * At most one SetProperty / GetProperties call is kept in
+ * flight; reconciliation is postponed until the reply arrives */
+static DBusPendingCall *connman_pending_call = 0;
+
+/** Timer for batched master radio state reconciliation; 0 if not active */
+static guint connman_sync_id = 0;
+
 static gboolean xconnman_get_properties(void);
+static void xconnman_schedule_sync(void);
+
+/** Forget the connman method call reply we are waiting for
+ *
+ * @param pc State data for the asynchronous method call that finished
+ *
+ * @return TRUE if pc was the outstanding call, or FALSE otherwise
+ */
+static gboolean xconnman_clear_pending(DBusPendingCall *pc)
+{
+	if( !pc || pc != connman_pending_call )
+		return FALSE;
+
+	dbus_pending_call_unref(connman_pending_call),
+		connman_pending_call = 0;
+
+	return TRUE;
+}
+
+/** Cancel the outstanding connman method call, if any
+ */
+static void xconnman_cancel_pending(void)
+{
+	if( !connman_pending_call )
+		return;
+
+	mce_log(LL_DEBUG, "cancel pending connman method call");
+	dbus_pending_call_cancel(connman_pending_call);
+	dbus_pending_call_unref(connman_pending_call),
+		connman_pending_call = 0;
+}
 
 /** Handle reply to asynchronous connman property change D-Bus method call
  *
@@ -572,6 +643,9 @@ static void xconnman_set_property_cb(DBusPendingCall *pc, void *user_data)
 	DBusMessage *rsp   = 0;
 	DBusError    err   = DBUS_ERROR_INIT;
 
+	if( !xconnman_clear_pending(pc) )
+		goto EXIT;
+
 	if( !(rsp = dbus_pending_call_steal_reply(pc)) )
 		goto EXIT;
 
@@ -594,6 +668,10 @@ static void xconnman_set_property_cb(DBusPendingCall *pc, void *user_data)
 	}
 
 EXIT:
+	/* Changes made while waiting for the reply were postponed */
+	if( !connman_pending_call )
+		xconnman_schedule_sync();
+
 	if( rsp ) dbus_message_unref(rsp);
 	dbus_error_free(&err);
 }
@@ -646,6 +724,7 @@ static gboolean xconnman_set_property_bool(const char *key, gboolean val)
 		goto EXIT;
 
 	// success
+	connman_pending_call = pc, pc = 0;
 	res = TRUE;
 
 EXIT:
@@ -655,28 +734,34 @@ EXIT:
 	return res;
 }
 
-/** Synchronize connman OfflineMode -> MCE master radio state
- */
-static void xconnman_sync_offline_to_master(void)
-{
-	if( (connman_master ^ active_radio_states) & MCE_RADIO_STATE_MASTER ) {
-		mce_log(LL_DEBUG, "sync connman OfflineMode -> mce master");
-		radio_states_change(connman_master, MCE_RADIO_STATE_MASTER);
-	}
-}
-
-/** Synchronize MCE master radio state -> connman OfflineMode
+/** Reconcile MCE master radio state and connman OfflineMode property
+ *
+ * Changes made within mce take priority and are sent to connman.
+ * Otherwise the last OfflineMode value reported by connman is
+ * applied to the MCE master radio state.
  */
-static void xconnman_sync_master_to_offline(void)
+static void xconnman_sync(void)
 {
 	gulong master;
 
 	if( !connman_running )
 		return;
 
+	/* Wait for the outstanding call to finish; the reply
+	 * handler will schedule another reconciliation */
+	if( connman_pending_call ) {
+		mce_log(LL_DEBUG, "connman call pending; sync postponed");
+		return;
+	}
+
 	master = radio_states & MCE_RADIO_STATE_MASTER;
 
-	if( connman_master != master ) {
+	if( connman_master_changed || connman_master == ~0lu ) {
+		connman_master_changed = FALSE;
+
+		if( connman_master == master )
+			return;
+
 		connman_master = master;
 		mce_log(LL_DEBUG, "sync mce master -> connman OfflineMode");
 
@@ -684,10 +769,73 @@ static void xconnman_sync_master_to_offline(void)
 		connman_verify_property_setting = TRUE;
 
 		/* ... before we get reply to set property */
-		xconnman_set_property_bool("OfflineMode", !connman_master);
+		if( !xconnman_set_property_bool("OfflineMode", !connman_master) )
+			mce_log(LL_WARN, "failed to set connman OfflineMode");
+	}
+	else if( (connman_master ^ active_radio_states) & MCE_RADIO_STATE_MASTER ) {
+		mce_log(LL_DEBUG, "sync connman OfflineMode -> mce master");
+		radio_states_change(connman_master, MCE_RADIO_STATE_MASTER);
 	}
 }
 
+/** Timer callback for batched master radio state reconciliation
+ *
+ * @param data (not used)
+ *
+ * @return FALSE to stop the timer
+ */
+static gboolean xconnman_sync_cb(gpointer data)
+{
+	(void)data;
+
+	connman_sync_id = 0;
+	xconnman_sync();
+
+	return FALSE;
+}
+
+/** Schedule master radio state reconciliation
+ *
+ * Restarts the timer, so that a burst of changes gets handled
+ * in one go after things have settled down.
+ */
+static void xconnman_schedule_sync(void)
+{
+	if( !connman_running )
+		return;
+
+	if( connman_sync_id )
+		g_source_remove(connman_sync_id);
+
+	connman_sync_id = g_timeout_add(CONNMAN_SYNC_DELAY,
+					xconnman_sync_cb, 0);
+}
+
+/** Cancel pending master radio state reconciliation
+ */
+static void xconnman_cancel_sync(void)
+{
+	if( connman_sync_id )
+		g_source_remove(connman_sync_id), connman_sync_id = 0;
+}
+
+/** Synchronize MCE master radio state -> connman OfflineMode
+ */
+static void xconnman_sync_master_to_offline(void)
+{
+	if( !connman_running )
+		return;
+
+	if( connman_master_changed )
+		return;
+
+	if( connman_master == (radio_states & MCE_RADIO_STATE_MASTER) )
+		return;
+
+	connman_master_changed = TRUE;
+	xconnman_schedule_sync();
+}
+
 /** Process connman property value change
  *
  * @param key  property name
@@ -716,7 +864,7 @@ static void xconnman_property_changed(const char *key, int type,
 		connman_verify_property_setting = FALSE;
 
 		connman_master = val->b ? 0 : MCE_RADIO_STATE_MASTER;
-		xconnman_sync_offline_to_master();
+		xconnman_schedule_sync();
 	}
 }
 
@@ -775,6 +923,9 @@ static void xconnman_get_properties_cb(DBusPendingCall *pc, void *user_data)
 
 	DBusMessageIter miter, aiter, diter, viter;
 
+	if( !xconnman_clear_pending(pc) )
+		goto EXIT;
+
 	if( !(rsp = dbus_pending_call_steal_reply(pc)) )
 		goto EXIT;
 
@@ -814,6 +965,10 @@ static void xconnman_get_properties_cb(DBusPendingCall *pc, void *user_data)
 	}
 
 EXIT:
+	/* Changes made while waiting for the reply were postponed */
+	if( !connman_pending_call )
+		xconnman_schedule_sync();
+
 	if( rsp ) dbus_message_unref(rsp);
 	dbus_error_free(&err);
 }
@@ -841,6 +996,7 @@ static gboolean xconnman_get_properties(void)
 		goto EXIT;
 
 	// success
+	connman_pending_call = pc, pc = 0;
 	res = TRUE;
 
 EXIT:
@@ -864,11 +1020,16 @@ static void xconnman_set_runstate(gboolean running)
 		connman_running ? "available" : "stopped");
 
 	if( connman_running ) {
-		xconnman_sync_master_to_offline();
+		xconnman_schedule_sync();
 	}
 	else {
 		/* force master -> offlinemode sync on connman restart */
 		connman_master = ~0lu;
+		connman_master_changed = FALSE;
+		connman_verify_property_setting = FALSE;
+
+		xconnman_cancel_sync();
+		xconnman_cancel_pending();
 	}
 }
 
@@ -1014,6 +1175,9 @@ EXIT:
  */
 static void xconnman_quit(void)
 {
+	xconnman_cancel_sync();
+	xconnman_cancel_pending();
+
 	if( connman_bus ) {
 		dbus_connection_remove_filter(connman_bus,
 					      xconnman_dbus_filter_cb, 0);
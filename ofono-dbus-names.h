@@ -7,6 +7,7 @@
 
 #define OFONO_VOICEMGR_SIGNAL_IF		"org.ofono.VoiceCallManager"
 #define OFONO_CALL_ADDED_SIG			"CallAdded"
+#define OFONO_CALL_REMOVED_SIG			"CallRemoved"
 #define OFONO_VOICE_SIGNAL_IF			"org.ofono.VoiceCall"
 #define OFONO_VOICE_PROP_CHANGED_SIG	"PropertyChanged"
 
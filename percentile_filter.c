@@ -0,0 +1,323 @@
+/**
+ * @file percentile_filter.c
+ * Streaming percentile filter -- this implements a sliding window
+ * order statistics filter, for example a median filter
+ * <p>
+ * The samples in the window are kept in two heaps: a max-heap of the
+ * samples at or below the requested percentile and a min-heap of the
+ * rest.  Each heap node knows its position, so that the oldest sample
+ * can be removed when the window slides; adding a sample, removing
+ * the oldest one and rebalancing the heaps all take O(log n) time.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include "percentile_filter.h"
+
+/** Heap holding the samples at or below the percentile; max-heap */
+#define HEAP_LOW	0
+/** Heap holding the samples above the percentile; min-heap */
+#define HEAP_HIGH	1
+
+/** One sample in the filter window */
+typedef struct {
+	gdouble value;			/**< Sample value */
+	gint heap;			/**< HEAP_LOW or HEAP_HIGH */
+	gsize pos;			/**< Position in the heap */
+} sample_t;
+
+/** Percentile filter */
+struct percentile_filter_t {
+	gsize window_size;		/**< Window size */
+	gdouble percentile;		/**< Percentile to report, 0-100 */
+	gsize samples;			/**< Current number of samples */
+	gsize oldest;			/**< Index of the oldest sample */
+	sample_t *sample;		/**< Ring buffer of samples */
+	gsize *heap[2];			/**< Heaps of sample indices */
+	gsize len[2];			/**< Number of samples in the heaps */
+};
+
+/**
+ * Check heap ordering of two samples
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH
+ * @param a Sample index
+ * @param b Sample index
+ * @return TRUE if a must be closer to the heap top than b
+ */
+static gboolean heap_before(const percentile_filter_t *filter, gint heap,
+			    gsize a, gsize b)
+{
+	gdouble va = filter->sample[a].value;
+	gdouble vb = filter->sample[b].value;
+
+	return (heap == HEAP_LOW) ? (va > vb) : (va < vb);
+}
+
+/**
+ * Swap two heap slots
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH
+ * @param i Heap position
+ * @param j Heap position
+ */
+static void heap_swap(percentile_filter_t *filter, gint heap,
+		      gsize i, gsize j)
+{
+	gsize *h = filter->heap[heap];
+	gsize tmp = h[i];
+
+	h[i] = h[j];
+	h[j] = tmp;
+
+	filter->sample[h[i]].pos = i;
+	filter->sample[h[j]].pos = j;
+}
+
+/**
+ * Move a heap slot towards the top until the heap is ordered
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH
+ * @param i Heap position
+ */
+static void heap_sift_up(percentile_filter_t *filter, gint heap, gsize i)
+{
+	gsize *h = filter->heap[heap];
+
+	while (i > 0) {
+		gsize parent = (i - 1) / 2;
+
+		if (heap_before(filter, heap, h[i], h[parent]) == FALSE)
+			break;
+
+		heap_swap(filter, heap, i, parent);
+		i = parent;
+	}
+}
+
+/**
+ * Move a heap slot towards the bottom until the heap is ordered
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH
+ * @param i Heap position
+ */
+static void heap_sift_down(percentile_filter_t *filter, gint heap, gsize i)
+{
+	gsize *h = filter->heap[heap];
+	gsize len = filter->len[heap];
+
+	for (;;) {
+		gsize best = i;
+		gsize l = 2 * i + 1;
+		gsize r = 2 * i + 2;
+
+		if ((l < len) && heap_before(filter, heap, h[l], h[best]))
+			best = l;
+
+		if ((r < len) && heap_before(filter, heap, h[r], h[best]))
+			best = r;
+
+		if (best == i)
+			break;
+
+		heap_swap(filter, heap, i, best);
+		i = best;
+	}
+}
+
+/**
+ * Add a sample to a heap
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH
+ * @param index Sample index
+ */
+static void heap_push(percentile_filter_t *filter, gint heap, gsize index)
+{
+	gsize pos = filter->len[heap]++;
+
+	filter->heap[heap][pos] = index;
+	filter->sample[index].heap = heap;
+	filter->sample[index].pos = pos;
+
+	heap_sift_up(filter, heap, pos);
+}
+
+/**
+ * Remove a sample from the heap it is in
+ *
+ * @param filter The percentile filter
+ * @param index Sample index
+ */
+static void heap_remove(percentile_filter_t *filter, gsize index)
+{
+	gint heap = filter->sample[index].heap;
+	gsize pos = filter->sample[index].pos;
+	gsize last = --filter->len[heap];
+	gsize moved;
+
+	if (pos == last)
+		goto EXIT;
+
+	/* Fill the hole with the last slot and restore heap order */
+	heap_swap(filter, heap, pos, last);
+	moved = filter->heap[heap][pos];
+	heap_sift_up(filter, heap, pos);
+	heap_sift_down(filter, heap, filter->sample[moved].pos);
+
+EXIT:
+	return;
+}
+
+/**
+ * Get the value at the top of a heap
+ *
+ * @param filter The percentile filter
+ * @param heap HEAP_LOW or HEAP_HIGH; must not be empty
+ * @return The top value
+ */
+static gdouble heap_top(const percentile_filter_t *filter, gint heap)
+{
+	return filter->sample[filter->heap[heap][0]].value;
+}
+
+/**
+ * Create a percentile filter
+ *
+ * @param window_size The window size to use; at least 1
+ * @param percentile The percentile to report, 50 for median
+ *
+ * @return The filter, or NULL if window_size is zero
+ */
+percentile_filter_t *percentile_filter_create(gsize window_size,
+					      gdouble percentile)
+{
+	percentile_filter_t *filter = NULL;
+
+	if (window_size == 0)
+		goto EXIT;
+
+	filter = g_malloc0(sizeof *filter);
+
+	filter->window_size = window_size;
+	filter->percentile = CLAMP(percentile, 0.0, 100.0);
+	filter->sample = g_malloc0(window_size * sizeof *filter->sample);
+	filter->heap[HEAP_LOW] = g_malloc0(window_size * sizeof (gsize));
+	filter->heap[HEAP_HIGH] = g_malloc0(window_size * sizeof (gsize));
+
+	percentile_filter_reset(filter);
+
+EXIT:
+	return filter;
+}
+
+/**
+ * Delete a percentile filter
+ *
+ * @param filter The percentile filter, or NULL
+ */
+void percentile_filter_delete(percentile_filter_t *filter)
+{
+	if (filter == NULL)
+		goto EXIT;
+
+	g_free(filter->heap[HEAP_HIGH]);
+	g_free(filter->heap[HEAP_LOW]);
+	g_free(filter->sample);
+	g_free(filter);
+
+EXIT:
+	return;
+}
+
+/**
+ * Discard all samples from a percentile filter
+ *
+ * @param filter The percentile filter
+ */
+void percentile_filter_reset(percentile_filter_t *filter)
+{
+	filter->samples = 0;
+	filter->oldest = 0;
+	filter->len[HEAP_LOW] = 0;
+	filter->len[HEAP_HIGH] = 0;
+}
+
+/**
+ * Insert a sample into a percentile filter
+ *
+ * Until the window has been filled, the percentile
+ * of the samples received so far is reported
+ *
+ * @param filter The percentile filter
+ * @param value The value to insert
+ * @return The filtered value; linearly interpolated between
+ *         the two nearest samples, so that for an even number
+ *         of samples the median is the average of the middle ones
+ */
+gdouble percentile_filter_map(percentile_filter_t *filter, gdouble value)
+{
+	gsize index;
+	gsize rank;
+	gdouble pos;
+	gdouble res;
+
+	/* Drop the oldest sample to make room for the new one */
+	if (filter->samples == filter->window_size) {
+		index = filter->oldest;
+		heap_remove(filter, index);
+		filter->oldest = (filter->oldest + 1) % filter->window_size;
+	} else {
+		index = (filter->oldest + filter->samples) % filter->window_size;
+		filter->samples++;
+	}
+
+	filter->sample[index].value = value;
+
+	if ((filter->len[HEAP_HIGH] > 0) &&
+	    (value >= heap_top(filter, HEAP_HIGH)))
+		heap_push(filter, HEAP_HIGH, index);
+	else
+		heap_push(filter, HEAP_LOW, index);
+
+	/* The low heap holds the samples up to the requested rank */
+	pos = filter->percentile / 100.0 * (filter->samples - 1);
+	rank = (gsize)pos + 1;
+
+	while (filter->len[HEAP_LOW] > rank) {
+		index = filter->heap[HEAP_LOW][0];
+		heap_remove(filter, index);
+		heap_push(filter, HEAP_HIGH, index);
+	}
+
+	while (filter->len[HEAP_LOW] < rank) {
+		index = filter->heap[HEAP_HIGH][0];
+		heap_remove(filter, index);
+		heap_push(filter, HEAP_LOW, index);
+	}
+
+	res = heap_top(filter, HEAP_LOW);
+	pos -= (gsize)pos;
+
+	if ((pos > 0.0) && (filter->len[HEAP_HIGH] > 0))
+		res += pos * (heap_top(filter, HEAP_HIGH) - res);
+
+	return res;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file percentile_filter.h
+ * Headers for the streaming percentile filter
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _PERCENTILE_FILTER_H_
+#define _PERCENTILE_FILTER_H_
+
+#include <glib.h>
+
+/** Percentile filter; only access this struct through the functions */
+typedef struct percentile_filter_t percentile_filter_t;
+
+percentile_filter_t *percentile_filter_create(gsize window_size,
+					      gdouble percentile);
+void percentile_filter_delete(percentile_filter_t *filter);
+void percentile_filter_reset(percentile_filter_t *filter);
+gdouble percentile_filter_map(percentile_filter_t *filter, gdouble value);
+
+#endif /* _PERCENTILE_FILTER_H_ */
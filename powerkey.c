@@ -29,6 +29,8 @@
 					 * mce_rem_submode_int32(),
 					 * submode_pipe,
 					 * system_state_pipe,
+					 * display_state_pipe,
+					 * display_prewake_pipe,
 					 * tk_lock_pipe,
 					 * keypress_pipe,
 					 * system_state_t,
@@ -36,8 +38,10 @@
 					 */
 #include "powerkey.h"
 
+#include "mce-lib.h"			/* mce_lib_get_time_us() */
 #include "mce-log.h"			/* mce_log(), LL_* */
-#include "mce-conf.h"			/* mce_conf_get_int(),
+#include "mce-conf.h"			/* mce_conf_get_bool(),
+					 * mce_conf_get_int(),
 					 * mce_conf_get_string()
 					 */
 #include "mce-dbus.h"			/* mce_dbus_handler_add(),
@@ -46,6 +50,11 @@
 					 * dbus_new_method_reply(),
 					 * dbus_message_get_no_reply(),
 					 * dbus_message_iter_init(),
+					 * dbus_message_iter_init_append(),
+					 * dbus_message_iter_open_container(),
+					 * dbus_message_iter_append_basic(),
+					 * dbus_message_iter_close_container(),
+					 * dbus_message_unref(),
 					 * dbus_message_iter_get_arg_type(),
 					 * dbus_message_iter_get_basic(),
 					 * dbus_message_iter_next(),
@@ -54,12 +63,23 @@
 					 * DBUS_MESSAGE_TYPE_METHOD_CALL,
 					 * DBUS_TYPE_BOOLEAN,
 					 * DBUS_TYPE_UINT32,
+					 * DBUS_TYPE_UINT64,
+					 * DBUS_TYPE_STRING,
+					 * DBUS_TYPE_STRUCT,
+					 * DBUS_TYPE_ARRAY,
 					 * DBUS_TYPE_INVALID,
 					 * DBusMessage, DBusMessageIter,
 					 * DBusError,
 					 * dbus_bool_t,
 					 * dbus_uint32_t
 					 */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start(),
+					 * mce_deadline_stop(),
+					 * mce_deadline_set_wakeup(),
+					 * mce_deadline_is_active()
+					 */
 #include "mce-dsme.h"			/* request_normal_shutdown(),
 					 * request_soft_poweron(),
 					 * request_soft_poweroff(),
@@ -74,16 +94,16 @@
 					 */
 
 /**
- * The ID of the timeout used when determining
+ * The deadline used when determining
  * whether the key press was short or long
  */
-static guint powerkey_timeout_cb_id = 0;
+static mce_deadline_t *powerkey_deadline = NULL;
 
 /**
- * The ID of the timeout used when determining
+ * The deadline used when determining
  * whether the key press was a double press
  */
-static guint doublepress_timeout_cb_id = 0;
+static mce_deadline_t *doublepress_deadline = NULL;
 
 /** Time in milliseconds before the key press is considered medium */
 static gint mediumdelay = DEFAULT_POWER_MEDIUM_DELAY;
@@ -105,8 +125,92 @@ static gchar *longpresssignal = NULL;
 /** D-Bus signal to send on double [power] press */
 static gchar *doublepresssignal = NULL;
 
+/** Run reversible short press actions before the double press timeout */
+static gboolean speculative_shortpress = DEFAULT_POWERKEY_SPECULATIVE;
+/** A speculative short press action awaits the double press timeout */
+static gboolean speculative_pending = FALSE;
+/** Was the tklock active before the speculative short press action */
+static gboolean speculative_tklock_was_on = FALSE;
+
+/** [power] press types for the time to action statistics */
+typedef enum {
+	/** Short press */
+	POWERKEY_PRESS_SHORT = 0,
+	/** Double press */
+	POWERKEY_PRESS_DOUBLE = 1,
+	/** Long press */
+	POWERKEY_PRESS_LONG = 2,
+	/** Number of press types */
+	POWERKEY_PRESS_COUNT
+} powerkey_press_t;
+
+/** Time to action statistics for one press type */
+typedef struct {
+	/** Number of samples */
+	guint count;
+	/** Sum of the delays [us] */
+	guint64 total;
+	/** Largest delay [us] */
+	guint64 max;
+	/** Latest delay [us] */
+	guint64 last;
+} powerkey_stats_t;
+
+/** Time to action statistics, indexed by powerkey_press_t */
+static powerkey_stats_t powerkey_stats[POWERKEY_PRESS_COUNT];
+
+/** Time of the latest [power] key event [us]; 0 if not from a key */
+static gint64 powerkey_event_time = 0;
+
 static void cancel_powerkey_timeout(void);
 
+/**
+ * Record the time from the latest [power] key event to an action
+ *
+ * Presses triggered over D-Bus are not key events and are not counted
+ *
+ * @param press The press type that was acted on
+ */
+static void powerkey_stats_add(powerkey_press_t press)
+{
+	powerkey_stats_t *stats = &powerkey_stats[press];
+	guint64 delay;
+
+	if (powerkey_event_time == 0)
+		goto EXIT;
+
+	delay = (guint64)MAX(mce_lib_get_time_us(CLOCK_MONOTONIC) -
+			     powerkey_event_time, 0);
+
+	stats->count++;
+	stats->total += delay;
+	stats->last = delay;
+
+	if (delay > stats->max)
+		stats->max = delay;
+
+	mce_log(LL_DEBUG, "[power] press %d acted on after %llu us",
+		press, (unsigned long long)delay);
+
+EXIT:
+	return;
+}
+
+/**
+ * Check whether a [power] action can be undone
+ *
+ * @param action The action
+ * @return TRUE if the action only changes the tklock state,
+ *         FALSE otherwise
+ */
+static gboolean is_reversible_action(poweraction_t action)
+{
+	return ((action == POWER_DISABLED) ||
+		(action == POWER_TKLOCK_LOCK) ||
+		(action == POWER_TKLOCK_UNLOCK) ||
+		(action == POWER_TKLOCK_BOTH));
+}
+
 /**
  * Generic logic for key presses
  *
@@ -213,24 +317,30 @@ EXIT:
  * Timeout callback for double key press
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean doublepress_timeout_cb(gpointer data)
+static void doublepress_timeout_cb(gpointer data)
 {
 	system_state_t system_state = datapipe_get_gint(system_state_pipe);
 
 	(void)data;
 
-	doublepress_timeout_cb_id = 0;
+	/* The short press action was already taken */
+	if (speculative_pending == TRUE) {
+		speculative_pending = FALSE;
+		goto EXIT;
+	}
 
 	/* doublepress timer expired without any secondary press;
 	 * thus this was a short press
 	 */
-	if (system_state == MCE_STATE_USER)
+	if (system_state == MCE_STATE_USER) {
 		generic_powerkey_handler(shortpressaction,
 					 shortpresssignal);
+		powerkey_stats_add(POWERKEY_PRESS_SHORT);
+	}
 
-	return FALSE;
+EXIT:
+	return;
 }
 
 /**
@@ -238,11 +348,45 @@ static gboolean doublepress_timeout_cb(gpointer data)
  */
 static void cancel_doublepress_timeout(void)
 {
-	/* Remove the timeout source for the [power] double key press handler */
-	if (doublepress_timeout_cb_id != 0) {
-		g_source_remove(doublepress_timeout_cb_id);
-		doublepress_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for the [power] double key press handler */
+	mce_deadline_stop(doublepress_deadline);
+
+	speculative_pending = FALSE;
+}
+
+/**
+ * Undo a speculative short press action
+ *
+ * Called when a double press turns out to follow the short press
+ *
+ * Only the tklock state snapshot taken before the action is
+ * restored; side effects that the lock change already pushed
+ * through the datapipes (display blanking, touchscreen/keypad
+ * disabling, D-Bus signals, etc.) are not undone, they just get
+ * followed by the corresponding opposite transitions
+ */
+static void rollback_speculative_shortpress(void)
+{
+	gboolean tklock_on;
+
+	if (speculative_pending == FALSE)
+		goto EXIT;
+
+	speculative_pending = FALSE;
+	tklock_on = ((mce_get_submode_int32() & MCE_TKLOCK_SUBMODE) != 0);
+
+	if (tklock_on == speculative_tklock_was_on)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "Rolling back speculative short press action");
+
+	execute_datapipe(&tk_lock_pipe,
+			 GINT_TO_POINTER(speculative_tklock_was_on ?
+					 LOCK_ON : LOCK_OFF),
+			 USE_INDATA, CACHE_INDATA);
+
+EXIT:
+	return;
 }
 
 /**
@@ -279,8 +423,7 @@ static gboolean setup_doublepress_timeout(void)
 	}
 
 	/* Setup new timeout */
-	doublepress_timeout_cb_id =
-		g_timeout_add(doublepressdelay, doublepress_timeout_cb, NULL);
+	mce_deadline_start(doublepress_deadline, doublepressdelay);
 	status = TRUE;
 
 EXIT:
@@ -292,16 +435,33 @@ EXIT:
  */
 static void handle_shortpress(void)
 {
+	system_state_t system_state = datapipe_get_gint(system_state_pipe);
+
 	cancel_powerkey_timeout();
 
-	if (doublepress_timeout_cb_id == 0) {
-		if (setup_doublepress_timeout() == FALSE)
+	if (mce_deadline_is_active(doublepress_deadline) == FALSE) {
+		if (setup_doublepress_timeout() == FALSE) {
 			generic_powerkey_handler(shortpressaction,
 						 shortpresssignal);
+			powerkey_stats_add(POWERKEY_PRESS_SHORT);
+		} else if ((speculative_shortpress == TRUE) &&
+			   (system_state == MCE_STATE_USER) &&
+			   (is_reversible_action(shortpressaction) == TRUE)) {
+			/* Act now; a double press rolls this back */
+			speculative_tklock_was_on =
+				((mce_get_submode_int32() &
+				  MCE_TKLOCK_SUBMODE) != 0);
+			generic_powerkey_handler(shortpressaction,
+						 shortpresssignal);
+			powerkey_stats_add(POWERKEY_PRESS_SHORT);
+			speculative_pending = TRUE;
+		}
 	} else {
+		rollback_speculative_shortpress();
 		cancel_doublepress_timeout();
 		generic_powerkey_handler(doublepressaction,
 					 doublepresssignal);
+		powerkey_stats_add(POWERKEY_PRESS_DOUBLE);
 	}
 }
 
@@ -367,17 +527,13 @@ EXIT:
  * Timeout callback for long key press
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean powerkey_timeout_cb(gpointer data)
+static void powerkey_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	powerkey_timeout_cb_id = 0;
-
 	handle_longpress();
-
-	return FALSE;
+	powerkey_stats_add(POWERKEY_PRESS_LONG);
 }
 
 /**
@@ -385,11 +541,8 @@ static gboolean powerkey_timeout_cb(gpointer data)
  */
 static void cancel_powerkey_timeout(void)
 {
-	/* Remove the timeout source for the [power] long key press handler */
-	if (powerkey_timeout_cb_id != 0) {
-		g_source_remove(powerkey_timeout_cb_id);
-		powerkey_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for the [power] long key press handler */
+	mce_deadline_stop(powerkey_deadline);
 }
 
 /**
@@ -400,8 +553,7 @@ static void setup_powerkey_timeout(gint powerkeydelay)
 	cancel_powerkey_timeout();
 
 	/* Setup new timeout */
-	powerkey_timeout_cb_id =
-		g_timeout_add(powerkeydelay, powerkey_timeout_cb, NULL);
+	mce_deadline_start(powerkey_deadline, powerkeydelay);
 }
 
 /**
@@ -477,6 +629,9 @@ static gboolean trigger_powerkey_event_req_dbus_cb(DBusMessage *const msg)
 
 	mce_log(LL_DEBUG, "[power] button event trigger value: %d", uintval);
 
+	/* Not a key event; keep it out of the statistics */
+	powerkey_event_time = 0;
+
 	cancel_powerkey_timeout();
 	cancel_doublepress_timeout();
 
@@ -512,6 +667,76 @@ EXIT:
 	return status;
 }
 
+/**
+ * D-Bus callback for the [power] time to action statistics get method call
+ *
+ * Reply is an array of (press type, samples, total delay [us],
+ * largest delay [us], latest delay [us]) structures
+ *
+ * @param msg The D-Bus message to reply to
+ * @return TRUE if reply message was successfully sent, FALSE on failure
+ */
+static gboolean powerkey_stats_get_dbus_cb(DBusMessage *const msg)
+{
+	static const char * const names[POWERKEY_PRESS_COUNT] = {
+		[POWERKEY_PRESS_SHORT]  = "short",
+		[POWERKEY_PRESS_DOUBLE] = "double",
+		[POWERKEY_PRESS_LONG]   = "long",
+	};
+
+	gboolean status = FALSE;
+	DBusMessage *reply = NULL;
+	DBusMessageIter body, array, item;
+	gint i;
+
+	mce_log(LL_DEBUG, "Received [power] stats get request");
+
+	if (dbus_message_get_no_reply(msg)) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if ((reply = dbus_new_method_reply(msg)) == NULL)
+		goto EXIT;
+
+	dbus_message_iter_init_append(reply, &body);
+
+	if (!dbus_message_iter_open_container(&body, DBUS_TYPE_ARRAY,
+					      "(suttt)", &array)) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_POWERKEY_STATS_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	for (i = 0; i < POWERKEY_PRESS_COUNT; i++) {
+		const char *name = names[i];
+		dbus_uint32_t count = powerkey_stats[i].count;
+		dbus_uint64_t total = powerkey_stats[i].total;
+		dbus_uint64_t max = powerkey_stats[i].max;
+		dbus_uint64_t last = powerkey_stats[i].last;
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+						 NULL, &item);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT32, &count);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &total);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &max);
+		dbus_message_iter_append_basic(&item, DBUS_TYPE_UINT64, &last);
+		dbus_message_iter_close_container(&array, &item);
+	}
+
+	dbus_message_iter_close_container(&body, &array);
+
+	/* dbus_send_message unrefs the reply message */
+	status = dbus_send_message(reply), reply = 0;
+
+EXIT:
+	return status;
+}
+
 /**
  * Datapipe trigger for the [power] key
  *
@@ -532,12 +757,30 @@ static void powerkey_trigger(gconstpointer const data)
 	ev = *evp;
 
 	if ((ev != NULL) && (ev->code == KEY_POWER)) {
+		if ((ev->value == 0) || (ev->value == 1))
+			powerkey_event_time = mce_lib_get_time_us(CLOCK_MONOTONIC);
+
 		/* If set, the [power] key was pressed */
 		if (ev->value == 1) {
+			display_state_t display_state =
+				datapipe_get_gint(display_state_pipe);
+
 			mce_log(LL_DEBUG, "[power] pressed");
 
+			/* Let the display start powering up while
+			 * the press is evaluated; if no unblank
+			 * follows, the display module reverts it
+			 */
+			if ((system_state == MCE_STATE_USER) &&
+			    ((submode & MCE_SOFTOFF_SUBMODE) == 0) &&
+			    ((display_state == MCE_DISPLAY_OFF) ||
+			     (display_state == MCE_DISPLAY_LPM_OFF)))
+				execute_datapipe_output_triggers(&display_prewake_pipe,
+								 GINT_TO_POINTER(TRUE),
+								 USE_INDATA);
+
 			/* Are we waiting for a doublepress? */
-			if (doublepress_timeout_cb_id != 0) {
+			if (mce_deadline_is_active(doublepress_deadline)) {
 				handle_shortpress();
 			} else if ((system_state == MCE_STATE_ACTDEAD) ||
 			           ((submode & MCE_SOFTOFF_SUBMODE) != 0)) {
@@ -555,7 +798,7 @@ static void powerkey_trigger(gconstpointer const data)
 			mce_log(LL_DEBUG, "[power] released");
 
 			/* Short key press */
-			if (powerkey_timeout_cb_id != 0) {
+			if (mce_deadline_is_active(powerkey_deadline)) {
 				handle_shortpress();
 
 				if ((system_state == MCE_STATE_ACTDEAD) ||
@@ -639,6 +882,16 @@ gboolean mce_powerkey_init(void)
 	gboolean status = FALSE;
 	gchar *tmp = NULL;
 
+	/* The press must be resolved on time even if the device
+	 * suspends while the key is held down */
+	powerkey_deadline = mce_deadline_create("powerkey",
+						powerkey_timeout_cb, NULL);
+	mce_deadline_set_wakeup(powerkey_deadline, TRUE);
+	doublepress_deadline = mce_deadline_create("doublepress",
+						   doublepress_timeout_cb,
+						   NULL);
+	mce_deadline_set_wakeup(doublepress_deadline, TRUE);
+
 	/* Append triggers/filters to datapipes */
 	append_input_trigger_to_datapipe(&keypress_pipe,
 					 powerkey_trigger);
@@ -651,6 +904,14 @@ gboolean mce_powerkey_init(void)
 				 trigger_powerkey_event_req_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* get_powerkey_stats */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_POWERKEY_STATS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 powerkey_stats_get_dbus_cb) == NULL)
+		goto EXIT;
+
 	/* Get configuration options */
 	longdelay = mce_conf_get_int(MCE_CONF_POWERKEY_GROUP,
 				     MCE_CONF_POWERKEY_LONG_DELAY,
@@ -685,6 +946,11 @@ gboolean mce_powerkey_init(void)
 	(void)parse_action(tmp, &doublepresssignal, &doublepressaction);
 	g_free(tmp);
 
+	speculative_shortpress =
+		mce_conf_get_bool(MCE_CONF_POWERKEY_GROUP,
+				  MCE_CONF_POWERKEY_SPECULATIVE,
+				  DEFAULT_POWERKEY_SPECULATIVE);
+
 	status = TRUE;
 
 EXIT:
@@ -702,9 +968,13 @@ void mce_powerkey_exit(void)
 	remove_input_trigger_from_datapipe(&keypress_pipe,
 					   powerkey_trigger);
 
-	/* Remove all timer sources */
+	/* Remove all timers */
 	cancel_powerkey_timeout();
 	cancel_doublepress_timeout();
+	mce_deadline_delete(powerkey_deadline);
+	powerkey_deadline = NULL;
+	mce_deadline_delete(doublepress_deadline);
+	doublepress_deadline = NULL;
 
 	g_free(doublepresssignal);
 	g_free(longpresssignal);
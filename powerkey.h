@@ -66,6 +66,9 @@ typedef enum {
 	POWER_DBUS_SIGNAL = 7
 } poweraction_t;
 
+/** Name of the D-Bus method for the [power] time to action statistics */
+#define MCE_POWERKEY_STATS_GET		"get_powerkey_stats"
+
 /** Name of Powerkey configuration group */
 #define MCE_CONF_POWERKEY_GROUP		"PowerKey"
 
@@ -87,6 +90,9 @@ typedef enum {
 /** Name of configuration key for double [power] press action */
 #define MCE_CONF_POWERKEY_DOUBLE_ACTION	"PowerKeyDoubleAction"
 
+/** Name of configuration key for speculative short [power] press actions */
+#define MCE_CONF_POWERKEY_SPECULATIVE	"PowerKeySpeculativeShortPress"
+
 /**
  * Long delay for the [power] button in milliseconds; 1.5 seconds
  */
@@ -98,6 +104,9 @@ typedef enum {
 /** Double press timeout for the [power] button in milliseconds; 0.5 seconds */
 #define DEFAULT_POWER_DOUBLE_DELAY	500
 
+/** Default for speculative short [power] press actions */
+#define DEFAULT_POWERKEY_SPECULATIVE	FALSE
+
 /* When MCE is made modular, this will be handled differently */
 gboolean mce_powerkey_init(void);
 void mce_powerkey_exit(void);
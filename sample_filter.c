@@ -0,0 +1,468 @@
+/**
+ * @file sample_filter.c
+ * Sensor sample filter chain -- this implements a configurable
+ * chain of filter stages for timestamped sensor samples
+ * <p>
+ * A chain is described by a string of stages separated by ';',
+ * each stage being a name optionally followed by ':' separated
+ * arguments, for example "outlier:200:2;median:5;ema:1000".
+ * The samples pass through the stages in the order given.
+ * <p>
+ * Available stages:
+ * <ul>
+ * <li>median[:window[:percentile]] -- sliding window percentile;
+ *     default window 5 samples, percentile 50</li>
+ * <li>ema[:tau] -- exponential moving average with a time
+ *     constant of tau milliseconds; default 1000</li>
+ * <li>ratelimit[:percent[:minimum]] -- limit the rate of change to
+ *     percent of the current value per second, but allow at least
+ *     minimum units per second; default 100, 10</li>
+ * <li>hysteresis[:percent[:minimum]] -- only follow the input once
+ *     it differs from the current value by more than percent of the
+ *     current value and by more than minimum units; default 10, 1</li>
+ * <li>outlier[:percent[:count]] -- drop samples that differ from the
+ *     previous sample by more than percent of its value, unless count
+ *     such samples arrive in a row; default 200, 2</li>
+ * </ul>
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include "sample_filter.h"
+
+#include "mce-log.h"			/* mce_log(), LL_* */
+#include "percentile_filter.h"		/* percentile_filter_create(),
+					 * percentile_filter_delete(),
+					 * percentile_filter_reset(),
+					 * percentile_filter_map()
+					 */
+
+/** Maximum number of arguments a filter stage takes */
+#define SAMPLE_STAGE_MAX_ARGS		2
+
+typedef struct sample_stage_t sample_stage_t;
+
+/** Filter stage type */
+typedef struct {
+	/** Stage name used in the chain description */
+	const gchar *name;
+	/** Number of arguments the stage takes */
+	gint args;
+	/** Default values for the arguments */
+	gdouble defaults[SAMPLE_STAGE_MAX_ARGS];
+	/** Check the arguments and set up the stage; optional */
+	gboolean (*init)(sample_stage_t *stage);
+	/** Filter a sample; return FALSE to drop it */
+	gboolean (*map)(sample_stage_t *stage, gint64 time, gdouble *value);
+} sample_stage_type_t;
+
+/** Filter stage */
+struct sample_stage_t {
+	/** Stage type */
+	const sample_stage_type_t *type;
+	/** Stage arguments */
+	gdouble arg[SAMPLE_STAGE_MAX_ARGS];
+	/** Whether prev and prev_time are valid */
+	gboolean have_prev;
+	/** Time of the previous sample [ms] */
+	gint64 prev_time;
+	/** Previous value passed on by the stage */
+	gdouble prev;
+	/** Number of consecutive outliers seen */
+	gint outliers;
+	/** Percentile filter used by the median stage */
+	percentile_filter_t *percentile;
+};
+
+/** Sample filter chain */
+struct sample_filter_t {
+	/** Filter stages, in processing order */
+	GSList *stages;
+};
+
+/**
+ * Get the time elapsed since the previous sample of a stage
+ *
+ * @param stage The filter stage; must have a previous sample
+ * @param time The time of the current sample [ms]
+ * @return Milliseconds since the previous sample, never negative
+ */
+static gdouble stage_elapsed(const sample_stage_t *stage, gint64 time)
+{
+	return (time > stage->prev_time) ? (gdouble)(time - stage->prev_time) : 0;
+}
+
+/**
+ * Set up a median stage
+ *
+ * @param stage The filter stage
+ * @return TRUE on success, FALSE if the arguments are invalid
+ */
+static gboolean median_stage_init(sample_stage_t *stage)
+{
+	gboolean status = FALSE;
+
+	if ((stage->arg[0] < 1) || (stage->arg[0] != (gsize)stage->arg[0]))
+		goto EXIT;
+
+	if ((stage->arg[1] < 0) || (stage->arg[1] > 100))
+		goto EXIT;
+
+	stage->percentile = percentile_filter_create(stage->arg[0],
+						     stage->arg[1]);
+	status = (stage->percentile != NULL);
+
+EXIT:
+	return status;
+}
+
+/**
+ * Filter a sample through a median stage
+ *
+ * @param stage The filter stage
+ * @param time Unused
+ * @param value The sample to filter
+ * @return Always returns TRUE
+ */
+static gboolean median_stage_map(sample_stage_t *stage, gint64 time,
+				 gdouble *value)
+{
+	(void)time;
+
+	*value = percentile_filter_map(stage->percentile, *value);
+
+	return TRUE;
+}
+
+/**
+ * Filter a sample through an exponential moving average stage
+ *
+ * The weight of the new sample grows with the time elapsed since
+ * the previous one, so irregular sample rates do not skew the average
+ *
+ * @param stage The filter stage
+ * @param time The time of the sample [ms]
+ * @param value The sample to filter
+ * @return Always returns TRUE
+ */
+static gboolean ema_stage_map(sample_stage_t *stage, gint64 time,
+			      gdouble *value)
+{
+	gdouble tau = stage->arg[0];
+	gdouble dt;
+
+	if ((stage->have_prev == FALSE) || (tau <= 0)) {
+		stage->prev = *value;
+	} else {
+		dt = stage_elapsed(stage, time);
+		stage->prev += (*value - stage->prev) * dt / (dt + tau);
+	}
+
+	*value = stage->prev;
+
+	return TRUE;
+}
+
+/**
+ * Filter a sample through a rate limit stage
+ *
+ * @param stage The filter stage
+ * @param time The time of the sample [ms]
+ * @param value The sample to filter
+ * @return Always returns TRUE
+ */
+static gboolean ratelimit_stage_map(sample_stage_t *stage, gint64 time,
+				    gdouble *value)
+{
+	gdouble limit;
+
+	if (stage->have_prev == FALSE) {
+		stage->prev = *value;
+	} else {
+		limit = MAX(ABS(stage->prev) * stage->arg[0] / 100,
+			    stage->arg[1]);
+		limit *= stage_elapsed(stage, time) / 1000;
+
+		stage->prev = CLAMP(*value, stage->prev - limit,
+				    stage->prev + limit);
+	}
+
+	*value = stage->prev;
+
+	return TRUE;
+}
+
+/**
+ * Filter a sample through a hysteresis stage
+ *
+ * @param stage The filter stage
+ * @param time Unused
+ * @param value The sample to filter
+ * @return Always returns TRUE
+ */
+static gboolean hysteresis_stage_map(sample_stage_t *stage, gint64 time,
+				     gdouble *value)
+{
+	gdouble limit = MAX(ABS(stage->prev) * stage->arg[0] / 100,
+			    stage->arg[1]);
+
+	(void)time;
+
+	if ((stage->have_prev == FALSE) ||
+	    (ABS(*value - stage->prev) > limit))
+		stage->prev = *value;
+
+	*value = stage->prev;
+
+	return TRUE;
+}
+
+/**
+ * Set up an outlier rejection stage
+ *
+ * @param stage The filter stage
+ * @return TRUE on success, FALSE if the arguments are invalid
+ */
+static gboolean outlier_stage_init(sample_stage_t *stage)
+{
+	return (stage->arg[1] >= 1);
+}
+
+/**
+ * Filter a sample through an outlier rejection stage
+ *
+ * @param stage The filter stage
+ * @param time Unused
+ * @param value The sample to filter
+ * @return TRUE if the sample is passed on, FALSE if it is dropped
+ */
+static gboolean outlier_stage_map(sample_stage_t *stage, gint64 time,
+				  gdouble *value)
+{
+	gboolean status = TRUE;
+	gdouble limit = MAX(ABS(stage->prev) * stage->arg[0] / 100, 1);
+
+	(void)time;
+
+	if ((stage->have_prev == FALSE) ||
+	    (ABS(*value - stage->prev) <= limit)) {
+		stage->outliers = 0;
+	} else if (++stage->outliers < stage->arg[1]) {
+		status = FALSE;
+		goto EXIT;
+	} else {
+		/* Persistent change rather than a spike */
+		stage->outliers = 0;
+	}
+
+	stage->prev = *value;
+
+EXIT:
+	return status;
+}
+
+/** Available filter stages */
+static const sample_stage_type_t sample_stage_types[] = {
+	{ "median",	2, { 5, 50 },	median_stage_init, median_stage_map },
+	{ "ema",	1, { 1000 },	NULL, ema_stage_map },
+	{ "ratelimit",	2, { 100, 10 },	NULL, ratelimit_stage_map },
+	{ "hysteresis",	2, { 10, 1 },	NULL, hysteresis_stage_map },
+	{ "outlier",	2, { 200, 2 },	outlier_stage_init, outlier_stage_map },
+	{ NULL,		0, { 0 },	NULL, NULL }
+};
+
+/**
+ * Delete a filter stage
+ *
+ * @param stage The filter stage, or NULL
+ */
+static void sample_stage_delete(sample_stage_t *stage)
+{
+	if (stage == NULL)
+		goto EXIT;
+
+	percentile_filter_delete(stage->percentile);
+	g_free(stage);
+
+EXIT:
+	return;
+}
+
+/**
+ * Create a filter stage from its description
+ *
+ * @param spec Stage description, "name[:arg[:arg]]"
+ * @return The filter stage, or NULL if the description is invalid
+ */
+static sample_stage_t *sample_stage_create(const gchar *spec)
+{
+	sample_stage_t *stage = NULL;
+	gchar **vec = g_strsplit(spec, ":", 0);
+	const sample_stage_type_t *type;
+	gint i;
+
+	for (type = sample_stage_types; type->name != NULL; type++) {
+		if (g_strcmp0(type->name, g_strstrip(vec[0])) == 0)
+			break;
+	}
+
+	if (type->name == NULL) {
+		mce_log(LL_WARN, "Unknown filter stage `%s'", vec[0]);
+		goto EXIT;
+	}
+
+	stage = g_malloc0(sizeof *stage);
+	stage->type = type;
+
+	for (i = 0; i < type->args; i++)
+		stage->arg[i] = type->defaults[i];
+
+	for (i = 0; vec[i + 1] != NULL; i++) {
+		gchar *end = NULL;
+
+		if (i >= type->args) {
+			mce_log(LL_WARN, "Too many arguments for filter "
+				"stage `%s'", type->name);
+			goto ERROR;
+		}
+
+		stage->arg[i] = g_ascii_strtod(vec[i + 1], &end);
+
+		if ((end == vec[i + 1]) || (*end != '\0') ||
+		    (stage->arg[i] < 0)) {
+			mce_log(LL_WARN, "Invalid argument `%s' for filter "
+				"stage `%s'", vec[i + 1], type->name);
+			goto ERROR;
+		}
+	}
+
+	if ((type->init != NULL) && (type->init(stage) == FALSE)) {
+		mce_log(LL_WARN, "Invalid arguments for filter stage `%s'",
+			type->name);
+		goto ERROR;
+	}
+
+	goto EXIT;
+
+ERROR:
+	sample_stage_delete(stage);
+	stage = NULL;
+
+EXIT:
+	g_strfreev(vec);
+
+	return stage;
+}
+
+/**
+ * Create a sample filter chain
+ *
+ * @param spec The chain description, see the top of this file;
+ *             NULL or an empty string creates a pass-through chain
+ * @return The filter chain, or NULL if the description is invalid
+ */
+sample_filter_t *sample_filter_create(const gchar *spec)
+{
+	sample_filter_t *chain = g_malloc0(sizeof *chain);
+	gchar **vec = g_strsplit(spec ? spec : "", ";", 0);
+	gint i;
+
+	for (i = 0; vec[i] != NULL; i++) {
+		sample_stage_t *stage;
+
+		/* Allow a trailing separator */
+		if (*g_strstrip(vec[i]) == '\0')
+			continue;
+
+		if ((stage = sample_stage_create(vec[i])) == NULL) {
+			sample_filter_delete(chain);
+			chain = NULL;
+			goto EXIT;
+		}
+
+		chain->stages = g_slist_append(chain->stages, stage);
+	}
+
+EXIT:
+	g_strfreev(vec);
+
+	return chain;
+}
+
+/**
+ * Delete a sample filter chain
+ *
+ * @param chain The filter chain, or NULL
+ */
+void sample_filter_delete(sample_filter_t *chain)
+{
+	if (chain == NULL)
+		goto EXIT;
+
+	g_slist_free_full(chain->stages, (GDestroyNotify)sample_stage_delete);
+	g_free(chain);
+
+EXIT:
+	return;
+}
+
+/**
+ * Discard the state of all stages in a sample filter chain
+ *
+ * @param chain The filter chain
+ */
+void sample_filter_reset(sample_filter_t *chain)
+{
+	GSList *item;
+
+	for (item = chain->stages; item != NULL; item = g_slist_next(item)) {
+		sample_stage_t *stage = item->data;
+
+		stage->have_prev = FALSE;
+		stage->outliers = 0;
+
+		if (stage->percentile != NULL)
+			percentile_filter_reset(stage->percentile);
+	}
+}
+
+/**
+ * Pass a sample through a sample filter chain
+ *
+ * @param chain The filter chain
+ * @param time The time of the sample [ms, monotonic]
+ * @param[in,out] value The sample; replaced with the filtered value
+ * @return TRUE if a filtered value is available,
+ *         FALSE if a stage dropped the sample
+ */
+gboolean sample_filter_map(sample_filter_t *chain, gint64 time,
+			   gdouble *value)
+{
+	gboolean status = TRUE;
+	GSList *item;
+
+	for (item = chain->stages; item != NULL; item = g_slist_next(item)) {
+		sample_stage_t *stage = item->data;
+
+		if ((status = stage->type->map(stage, time, value)) == FALSE)
+			break;
+
+		stage->have_prev = TRUE;
+		stage->prev_time = time;
+	}
+
+	return status;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file sample_filter.h
+ * Headers for the sensor sample filter chain
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _SAMPLE_FILTER_H_
+#define _SAMPLE_FILTER_H_
+
+#include <glib.h>
+
+/** Sample filter chain; only access this struct through the functions */
+typedef struct sample_filter_t sample_filter_t;
+
+sample_filter_t *sample_filter_create(const gchar *spec);
+void sample_filter_delete(sample_filter_t *chain);
+void sample_filter_reset(sample_filter_t *chain);
+gboolean sample_filter_map(sample_filter_t *chain, gint64 time,
+			   gdouble *value);
+
+#endif /* _SAMPLE_FILTER_H_ */
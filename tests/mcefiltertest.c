@@ -0,0 +1,324 @@
+/**
+ * @file mcefiltertest.c
+ * Behavior tests for the sample filter and ALS lookup table helpers
+ * of the Mode Control Entity
+ * <p>
+ * Feeds known input sequences through the filters and compares the
+ * outputs with precomputed values; every mismatch is reported on
+ * stderr, and the exit status tells whether all cases passed.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <stdio.h>			/* printf(), fprintf() */
+#include <stdlib.h>			/* EXIT_SUCCESS, EXIT_FAILURE */
+
+#include "../als_lut.h"			/* als_lut_compile(),
+					 * als_lut_lookup()
+					 */
+#include "../percentile_filter.h"	/* percentile_filter_create(),
+					 * percentile_filter_map(),
+					 * percentile_filter_reset(),
+					 * percentile_filter_delete()
+					 */
+
+/** Number of failed checks */
+static guint test_failures = 0;
+
+/** Number of checks done */
+static guint test_checks = 0;
+
+/**
+ * Record the result of one check
+ *
+ * @param name Test case name
+ * @param step Step within the test case
+ * @param got The value produced
+ * @param want The expected value
+ */
+static void test_expect(const gchar *name, guint step,
+			gdouble got, gdouble want)
+{
+	test_checks++;
+
+	/* The test data is chosen so that exact results are expected */
+	if (got != want) {
+		fprintf(stderr, "FAIL: %s[%u]: got %g, expected %g\n",
+			name, step, got, want);
+		test_failures++;
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * percentile filter
+ * ------------------------------------------------------------------------- */
+
+/** One percentile filter test case */
+typedef struct {
+	/** Test case name */
+	const gchar *name;
+	/** Window size */
+	gsize window;
+	/** Percentile */
+	gdouble percentile;
+	/** Number of samples */
+	gsize count;
+	/** Input samples */
+	gdouble input[8];
+	/** Expected output after each sample */
+	gdouble output[8];
+} percentile_case_t;
+
+/** Percentile filter test cases */
+static const percentile_case_t percentile_cases[] = {
+	{
+		/* Partial window, full window, then sliding */
+		.name = "median_window_3",
+		.window = 3, .percentile = 50, .count = 6,
+		.input  = { 1, 2,   3, 10, 0, 0 },
+		.output = { 1, 1.5, 2, 3,  3, 0 },
+	},
+	{
+		/* Even sample counts average the middle samples */
+		.name = "median_window_4",
+		.window = 4, .percentile = 50, .count = 7,
+		.input  = { 4, 1,   3, 2,   10,  0,   7 },
+		.output = { 4, 2.5, 3, 2.5, 2.5, 2.5, 4.5 },
+	},
+	{
+		/* Window edges: the oldest sample leaves first */
+		.name = "max_window_3",
+		.window = 3, .percentile = 100, .count = 5,
+		.input  = { 5, 1, 2, 0, 0 },
+		.output = { 5, 5, 5, 2, 2 },
+	},
+	{
+		.name = "min_window_3",
+		.window = 3, .percentile = 0, .count = 5,
+		.input  = { 5, 1, 2, 3, 4 },
+		.output = { 5, 1, 1, 1, 2 },
+	},
+	{
+		/* A single sample window passes the input through */
+		.name = "median_window_1",
+		.window = 1, .percentile = 50, .count = 4,
+		.input  = { 3, 9, 9, 1 },
+		.output = { 3, 9, 9, 1 },
+	},
+	{
+		/* Interpolated percentile of an odd sample count */
+		.name = "p75_window_3",
+		.window = 3, .percentile = 75, .count = 3,
+		.input  = { 0, 4,   8 },
+		.output = { 0, 3,   6 },
+	},
+};
+
+/**
+ * Run the percentile filter test cases
+ */
+static void test_percentile_filter(void)
+{
+	percentile_filter_t *filter;
+
+	for (gsize i = 0; i < G_N_ELEMENTS(percentile_cases); i++) {
+		const percentile_case_t *tc = &percentile_cases[i];
+
+		filter = percentile_filter_create(tc->window, tc->percentile);
+
+		for (gsize j = 0; j < tc->count; j++) {
+			test_expect(tc->name, j,
+				    percentile_filter_map(filter,
+							  tc->input[j]),
+				    tc->output[j]);
+		}
+
+		/* After a reset only the new samples count */
+		percentile_filter_reset(filter);
+		test_expect(tc->name, tc->count,
+			    percentile_filter_map(filter, 42), 42);
+
+		percentile_filter_delete(filter);
+	}
+
+	/* An empty window is refused */
+	test_checks++;
+
+	if ((filter = percentile_filter_create(0, 50)) != NULL) {
+		fprintf(stderr, "FAIL: window_0: filter created\n");
+		test_failures++;
+		percentile_filter_delete(filter);
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * ALS lookup table
+ * ------------------------------------------------------------------------- */
+
+/** Upper threshold used above the top range */
+#define TEST_ALS_THRESHOLD_MAX		65535
+
+/** Two ranges; level 0 below 20 lux, level 2 at 200 lux and above */
+static const als_profile_struct als_profile_plain = {
+	{ { 10, 20 }, { 100, 200 }, { -1, -1 } },
+	{ 10, 50, 90 }
+};
+
+/** Like als_profile_plain, but the top level has a HBM boost */
+static const als_profile_struct als_profile_boost = {
+	{ { 10, 20 }, { 100, 200 }, { -1, -1 } },
+	{ 10, 50, 100 + 256 }
+};
+
+/** Lower bounds out of order; looked up without searching */
+static const als_profile_struct als_profile_unsorted = {
+	{ { 10, 20 }, { 5, 200 }, { -1, -1 } },
+	{ 10, 50, 90 }
+};
+
+/** All ranges used; no room for the terminator */
+static const als_profile_struct als_profile_unterminated = {
+	{ { 1, 2 }, { 3, 4 }, { 5, 6 }, { 7, 8 }, { 9, 10 }, { 11, 12 },
+	  { 13, 14 }, { 15, 16 }, { 17, 18 }, { 19, 20 }, { 21, 22 } },
+	{ 0 }
+};
+
+/** One ALS lookup table test case */
+typedef struct {
+	/** Test case name */
+	const gchar *name;
+	/** Profile to look up from */
+	const als_profile_struct *profile;
+	/** Interpolate between levels */
+	gboolean interpolate;
+	/** Level before the lookup */
+	gint level;
+	/** Lux value */
+	gint lux;
+	/** Expected level after the lookup */
+	gint want_level;
+	/** Expected lower threshold */
+	gint want_lower;
+	/** Expected upper threshold */
+	gint want_upper;
+	/** Expected brightness */
+	gint want_value;
+} als_lut_case_t;
+
+/** ALS lookup table test cases */
+static const als_lut_case_t als_lut_cases[] = {
+	/* Level selection */
+	{ "bottom",         &als_profile_plain, FALSE, 0,   5, 0,   0,  20, 10 },
+	{ "step_up",        &als_profile_plain, FALSE, 0,  20, 1,  10, 200, 50 },
+	{ "top",            &als_profile_plain, FALSE, 1, 250, 2, 100,
+	  TEST_ALS_THRESHOLD_MAX, 90 },
+
+	/* Hysteresis: going down needs the lux below the lower bound */
+	{ "hold_1",         &als_profile_plain, FALSE, 1,  15, 1,  10, 200, 50 },
+	{ "step_down_1",    &als_profile_plain, FALSE, 1,   9, 0,   0,  20, 10 },
+	{ "hold_2",         &als_profile_plain, FALSE, 2, 150, 2, 100,
+	  TEST_ALS_THRESHOLD_MAX, 90 },
+	{ "step_down_2",    &als_profile_plain, FALSE, 2,  99, 1,  10, 200, 50 },
+
+	/* Out of range old levels are clamped */
+	{ "level_negative", &als_profile_plain, FALSE, -1, 150, 1, 10, 200, 50 },
+	{ "level_too_high", &als_profile_plain, FALSE,  7, 150, 2, 100,
+	  TEST_ALS_THRESHOLD_MAX, 90 },
+
+	/* Interpolation towards the next level */
+	{ "interp_zero",    &als_profile_plain, TRUE,  0,   0, 0,   0,  20, 10 },
+	{ "interp_half",    &als_profile_plain, TRUE,  0,  10, 0,   0,  20, 30 },
+	{ "interp_from",    &als_profile_plain, TRUE,  1,  15, 1,  10, 200, 50 },
+	{ "interp_mid",     &als_profile_plain, TRUE,  1, 110, 1,  10, 200, 70 },
+	{ "interp_top",     &als_profile_plain, TRUE,  2, 300, 2, 100,
+	  TEST_ALS_THRESHOLD_MAX, 90 },
+
+	/* No interpolation across a HBM boost change */
+	{ "boost_low",      &als_profile_boost, TRUE,  0,  10, 0,   0,  20, 30 },
+	{ "boost_edge",     &als_profile_boost, TRUE,  1, 110, 1,  10, 200, 50 },
+	{ "boost_top",      &als_profile_boost, TRUE,  1, 200, 2, 100,
+	  TEST_ALS_THRESHOLD_MAX, 356 },
+
+	/* Unsorted profiles give the same results without searching */
+	{ "unsorted_up",    &als_profile_unsorted, FALSE, 0, 20, 1, 10, 200, 50 },
+	{ "unsorted_hold",  &als_profile_unsorted, FALSE, 2, 12, 2,  5,
+	  TEST_ALS_THRESHOLD_MAX, 90 },
+	{ "unsorted_down",  &als_profile_unsorted, FALSE, 2,  4, 0,  0,  20, 10 },
+};
+
+/**
+ * Run the ALS lookup table test cases
+ */
+static void test_als_lut(void)
+{
+	als_lut_t lut;
+
+	for (gsize i = 0; i < G_N_ELEMENTS(als_lut_cases); i++) {
+		const als_lut_case_t *tc = &als_lut_cases[i];
+		gint level = tc->level;
+		gint lower = -1;
+		gint upper = -1;
+		gint value;
+
+		test_expect(tc->name, 0,
+			    als_lut_compile(&lut, tc->profile), TRUE);
+
+		value = als_lut_lookup(&lut, tc->lux, tc->interpolate,
+				       TEST_ALS_THRESHOLD_MAX,
+				       &level, &lower, &upper);
+
+		test_expect(tc->name, 1, level, tc->want_level);
+		test_expect(tc->name, 2, lower, tc->want_lower);
+		test_expect(tc->name, 3, upper, tc->want_upper);
+		test_expect(tc->name, 4, value, tc->want_value);
+	}
+
+	/* Only searchable profiles are marked sorted */
+	als_lut_compile(&lut, &als_profile_plain);
+	test_expect("sorted", 0, lut.sorted, TRUE);
+	test_expect("sorted", 1, lut.levels, 2);
+	als_lut_compile(&lut, &als_profile_unsorted);
+	test_expect("sorted", 2, lut.sorted, FALSE);
+
+	/* A profile without the terminator is reported */
+	test_expect("unterminated", 0,
+		    als_lut_compile(&lut, &als_profile_unterminated), FALSE);
+	test_expect("unterminated", 1, lut.levels, ALS_RANGES);
+}
+
+/* ========================================================================= *
+ * MAIN
+ * ========================================================================= */
+
+/**
+ * Run all test cases
+ *
+ * @param argc Unused
+ * @param argv Unused
+ * @return EXIT_SUCCESS if all checks passed, EXIT_FAILURE otherwise
+ */
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	test_percentile_filter();
+	test_als_lut();
+
+	printf("%u checks, %u failed\n", test_checks, test_failures);
+
+	return (test_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,730 @@
+/**
+ * @file mcemicrobench.c
+ * Microbenchmarks for the core primitives of the Mode Control Entity
+ * <p>
+ * Links against the mce core objects, but not against mce.c, and
+ * sets up just the configuration, D-Bus and settings parts before
+ * measuring; no modules are loaded, and of the other core components
+ * only the touchscreen/keypad lock is set up, for its own benchmark.
+ * Each benchmark is repeated until it has run long enough to give
+ * a stable figure, and the results are written to stdout as tab
+ * separated lines of benchmark name, parameter, iterations and
+ * nanoseconds per iteration.
+ * <p>
+ * Copyright © 2014 Jolla Ltd.
+ *
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <glib-object.h>		/* g_type_init() */
+
+#include <fcntl.h>			/* O_NONBLOCK */
+#include <stdio.h>			/* printf(), fflush() */
+#include <stdlib.h>			/* abort(), EXIT_SUCCESS, EXIT_FAILURE */
+#include <string.h>			/* memset() */
+#include <unistd.h>			/* pipe2(), write(), close() */
+
+#include "../mce.h"			/* MCE_INVALID_TRANSLATION,
+					 * mce_abort(), mce_quit_mainloop(),
+					 * mce_startup_trace(),
+					 * mce_datapipe_generate_activity()
+					 */
+#include "../mce-lib.h"			/* mce_lib_get_time_ns(),
+					 * mce_translate_int_to_string(),
+					 * mce_translate_string_to_int()
+					 */
+#include "../mce-log.h"			/* mce_log_open(), mce_log_close(),
+					 * mce_log(), LL_*
+					 */
+#include "../mce-conf.h"		/* mce_conf_init(), mce_conf_exit() */
+#include "../mce-dbus.h"		/* mce_dbus_init(), mce_dbus_exit(),
+					 * mce_dbus_handler_add(),
+					 * mce_dbus_handler_remove(),
+					 * mce_dbus_dispatch_message()
+					 */
+#include "../mce-gconf.h"		/* mce_gconf_init(), mce_gconf_exit(),
+					 * mce_gconf_get_bool()
+					 */
+#include "../mce-io.h"			/* mce_register_io_monitor_chunk(),
+					 * mce_unregister_io_monitor()
+					 */
+#include "../datapipe.h"		/* setup_datapipe(),
+					 * append_output_trigger_to_datapipe(),
+					 * execute_datapipe(),
+					 * free_datapipe()
+					 */
+#include "../percentile_filter.h"	/* percentile_filter_create(),
+					 * percentile_filter_map(),
+					 * percentile_filter_delete()
+					 */
+#include "../sample_filter.h"		/* sample_filter_create(),
+					 * sample_filter_map(),
+					 * sample_filter_delete()
+					 */
+#include "../tklock.h"		/* mce_tklock_init(), mce_tklock_exit(),
+					 * MCE_GCONF_TK_AUTOLOCK_ENABLED_PATH
+					 */
+
+/** Minimum run time for one benchmark to count as stable [ns] */
+#define BENCH_MIN_TIME_NS		(200 * 1000 * 1000)
+
+/** Upper limit for iterations, for benchmarks too fast to time */
+#define BENCH_MAX_ITERATIONS		(1u << 30)
+
+/** D-Bus interface used by the dispatch benchmark */
+#define BENCH_DBUS_INTERFACE		"com.nokia.mce.bench"
+/** D-Bus object path used by the dispatch benchmark */
+#define BENCH_DBUS_PATH			"/com/nokia/mce/bench"
+/** D-Bus signal used by the dispatch benchmark */
+#define BENCH_DBUS_SIGNAL		"bench"
+
+/** Chunk size used by the I/O monitor benchmark [bytes] */
+#define BENCH_IO_CHUNK_SIZE		16
+/** Chunks written to the pipe per I/O monitor benchmark iteration */
+#define BENCH_IO_CHUNKS			64
+
+/** Benchmark body
+ *
+ * @param ctx Benchmark specific context
+ * @param iterations Number of times to repeat the measured operation
+ */
+typedef void (*bench_fn)(gpointer ctx, guint64 iterations);
+
+/** Shell pattern for selecting the benchmarks to run */
+static const gchar *bench_pattern = "*";
+
+/** Results are written here so that the compiler keeps the work */
+static volatile gint64 bench_sink = 0;
+
+/** Simple deterministic pseudo random sequence for test data */
+static guint32 bench_random_state = 1;
+
+/**
+ * Get the next value of the test data sequence
+ *
+ * @return pseudo random value in range [0, 65535]
+ */
+static guint bench_random(void)
+{
+	bench_random_state = bench_random_state * 1103515245 + 12345;
+
+	return (bench_random_state >> 16) & 0xffff;
+}
+
+/**
+ * Run one benchmark and print the result
+ *
+ * The iteration count is grown until one run takes at least
+ * BENCH_MIN_TIME_NS, so that timer resolution and one-off costs
+ * do not dominate the result
+ *
+ * @param name Benchmark name
+ * @param param Benchmark parameter, e.g. number of handlers
+ * @param fn Benchmark body
+ * @param ctx Context passed to the benchmark body
+ */
+static void bench_measure(const gchar *name, guint param,
+			  bench_fn fn, gpointer ctx)
+{
+	guint64 iterations = 1;
+	gint64 elapsed = 0;
+
+	if (g_pattern_match_simple(bench_pattern, name) == FALSE)
+		goto EXIT;
+
+	for (;;) {
+		gint64 started = mce_lib_get_time_ns(CLOCK_MONOTONIC);
+
+		fn(ctx, iterations);
+		elapsed = mce_lib_get_time_ns(CLOCK_MONOTONIC) - started;
+
+		if ((elapsed >= BENCH_MIN_TIME_NS) ||
+		    (iterations >= BENCH_MAX_ITERATIONS))
+			break;
+
+		/* Grow fast while far from the target */
+		iterations *= (elapsed < BENCH_MIN_TIME_NS / 10) ? 10 : 2;
+	}
+
+	printf("%s\t%u\t%" G_GUINT64_FORMAT "\t%.1f\n",
+	       name, param, iterations, (gdouble)elapsed / iterations);
+	fflush(stdout);
+
+EXIT:
+	return;
+}
+
+/* ------------------------------------------------------------------------- *
+ * datapipes
+ * ------------------------------------------------------------------------- */
+
+/**
+ * Output trigger for the datapipe benchmark
+ *
+ * @param data The datapipe value
+ */
+static void bench_datapipe_trigger(gconstpointer data)
+{
+	bench_sink += GPOINTER_TO_INT(data);
+}
+
+/**
+ * Execute a datapipe repeatedly
+ *
+ * @param ctx The datapipe to execute
+ * @param iterations Number of executions
+ */
+static void bench_datapipe_execute(gpointer ctx, guint64 iterations)
+{
+	datapipe_struct *datapipe = ctx;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		(void)execute_datapipe(datapipe, GINT_TO_POINTER((gint)i),
+				       USE_INDATA, CACHE_INDATA);
+	}
+}
+
+/**
+ * Benchmark execute_datapipe() with varying number of output triggers
+ */
+static void bench_datapipes(void)
+{
+	static const guint triggers[] = { 0, 1, 4, 16, 64 };
+
+	for (gsize i = 0; i < G_N_ELEMENTS(triggers); i++) {
+		datapipe_struct datapipe;
+
+		memset(&datapipe, 0, sizeof datapipe);
+		setup_datapipe(&datapipe, "bench",
+			       READ_ONLY, DONT_FREE_CACHE,
+			       DONT_SUPPRESS_UNCHANGED,
+			       0, GINT_TO_POINTER(0));
+
+		for (guint n = 0; n < triggers[i]; n++) {
+			append_output_trigger_to_datapipe(&datapipe,
+							  bench_datapipe_trigger);
+		}
+
+		bench_measure("execute_datapipe", triggers[i],
+			      bench_datapipe_execute, &datapipe);
+
+		free_datapipe(&datapipe);
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * sample filters
+ * ------------------------------------------------------------------------- */
+
+/**
+ * Feed test data through a percentile filter
+ *
+ * @param ctx The percentile filter
+ * @param iterations Number of samples
+ */
+static void bench_percentile_map(gpointer ctx, guint64 iterations)
+{
+	percentile_filter_t *filter = ctx;
+	gdouble sum = 0;
+
+	for (guint64 i = 0; i < iterations; i++)
+		sum += percentile_filter_map(filter, bench_random());
+
+	bench_sink += (gint64)sum;
+}
+
+/**
+ * Feed test data through a sample filter chain
+ *
+ * @param ctx The sample filter chain
+ * @param iterations Number of samples
+ */
+static void bench_sample_map(gpointer ctx, guint64 iterations)
+{
+	sample_filter_t *chain = ctx;
+	gdouble sum = 0;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		gdouble value = bench_random();
+
+		/* Samples 100 ms apart */
+		if (sample_filter_map(chain, (gint64)i * 100, &value) == TRUE)
+			sum += value;
+	}
+
+	bench_sink += (gint64)sum;
+}
+
+/**
+ * Benchmark the median filter and a typical ALS filter chain
+ */
+static void bench_filters(void)
+{
+	static const guint windows[] = { 5, 15, 31 };
+
+	sample_filter_t *chain = NULL;
+
+	for (gsize i = 0; i < G_N_ELEMENTS(windows); i++) {
+		percentile_filter_t *filter =
+			percentile_filter_create(windows[i], 50);
+
+		if (filter == NULL)
+			continue;
+
+		bench_measure("percentile_filter_map", windows[i],
+			      bench_percentile_map, filter);
+
+		percentile_filter_delete(filter);
+	}
+
+	if ((chain = sample_filter_create("outlier:200:2;median:5;"
+					  "ema:1000")) != NULL) {
+		bench_measure("sample_filter_map", 3,
+			      bench_sample_map, chain);
+		sample_filter_delete(chain);
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * D-Bus dispatch
+ * ------------------------------------------------------------------------- */
+
+/**
+ * Signal handler for the dispatch benchmark
+ *
+ * @param msg The signal
+ * @return Always TRUE
+ */
+static gboolean bench_dbus_signal_cb(DBusMessage *const msg)
+{
+	(void)msg;
+
+	bench_sink += 1;
+
+	return TRUE;
+}
+
+/**
+ * Dispatch a signal repeatedly
+ *
+ * @param ctx The signal message
+ * @param iterations Number of dispatches
+ */
+static void bench_dbus_dispatch(gpointer ctx, guint64 iterations)
+{
+	DBusMessage *msg = ctx;
+
+	for (guint64 i = 0; i < iterations; i++)
+		(void)mce_dbus_dispatch_message(msg);
+}
+
+/**
+ * Benchmark signal dispatch with varying number of handlers
+ *
+ * Every handler has its own arg0 rule and the signal matches only
+ * the last one, so each dispatch evaluates the rules of all handlers
+ */
+static void bench_dbus(void)
+{
+	static const guint handlers[] = { 1, 8, 32, 128 };
+
+	for (gsize i = 0; i < G_N_ELEMENTS(handlers); i++) {
+		GPtrArray *cookies = g_ptr_array_new();
+		DBusMessage *msg = NULL;
+		gchar *arg = NULL;
+
+		for (guint n = 0; n < handlers[i]; n++) {
+			gchar *rules = g_strdup_printf("arg0='h%u'", n);
+			gconstpointer cookie =
+				mce_dbus_handler_add(BENCH_DBUS_INTERFACE,
+						     BENCH_DBUS_SIGNAL, rules,
+						     DBUS_MESSAGE_TYPE_SIGNAL,
+						     bench_dbus_signal_cb);
+			g_free(rules);
+
+			if (cookie != NULL)
+				g_ptr_array_add(cookies, (gpointer)cookie);
+		}
+
+		arg = g_strdup_printf("h%u", handlers[i] - 1);
+		msg = dbus_message_new_signal(BENCH_DBUS_PATH,
+					      BENCH_DBUS_INTERFACE,
+					      BENCH_DBUS_SIGNAL);
+
+		if ((msg != NULL) &&
+		    (dbus_message_append_args(msg,
+					      DBUS_TYPE_STRING, &arg,
+					      DBUS_TYPE_INVALID) == TRUE)) {
+			bench_measure("mce_dbus_dispatch_signal",
+				      handlers[i], bench_dbus_dispatch, msg);
+		}
+
+		if (msg != NULL)
+			dbus_message_unref(msg);
+		g_free(arg);
+
+		for (guint n = 0; n < cookies->len; n++)
+			mce_dbus_handler_remove(g_ptr_array_index(cookies, n));
+		g_ptr_array_free(cookies, TRUE);
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * translations and settings
+ * ------------------------------------------------------------------------- */
+
+/** Translation table resembling the ones used by the modules */
+static const mce_translation_t bench_translation[] = {
+	{ 0,  "off" },
+	{ 1,  "low" },
+	{ 2,  "medium" },
+	{ 3,  "high" },
+	{ 4,  "maximum" },
+	{ 5,  "dim" },
+	{ 6,  "on" },
+	{ 7,  "lpm-off" },
+	{ 8,  "lpm-on" },
+	{ 9,  "powered-off" },
+	{ 10, "undefined" },
+	{ 11, "unknown" },
+	{ MCE_INVALID_TRANSLATION, NULL }
+};
+
+/**
+ * Translate numbers to strings repeatedly
+ *
+ * @param ctx Unused
+ * @param iterations Number of translations
+ */
+static void bench_translate_int(gpointer ctx, guint64 iterations)
+{
+	(void)ctx;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		const gchar *str =
+			mce_translate_int_to_string(bench_translation,
+						    (gint)(i % 12));
+		bench_sink += str[0];
+	}
+}
+
+/**
+ * Translate strings to numbers repeatedly
+ *
+ * @param ctx Unused
+ * @param iterations Number of translations
+ */
+static void bench_translate_string(gpointer ctx, guint64 iterations)
+{
+	(void)ctx;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		const gchar *str = bench_translation[i % 12].string;
+
+		bench_sink += mce_translate_string_to_int(bench_translation,
+							  str);
+	}
+}
+
+/**
+ * Look up a setting repeatedly
+ *
+ * @param ctx Unused
+ * @param iterations Number of lookups
+ */
+static void bench_gconf_get(gpointer ctx, guint64 iterations)
+{
+	(void)ctx;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		gboolean value = FALSE;
+
+		(void)mce_gconf_get_bool(MCE_GCONF_TK_AUTOLOCK_ENABLED_PATH,
+					 &value);
+		bench_sink += value;
+	}
+}
+
+/**
+ * Benchmark translation table and setting lookups
+ */
+static void bench_lookups(void)
+{
+	bench_measure("mce_translate_int_to_string", 12,
+		      bench_translate_int, NULL);
+	bench_measure("mce_translate_string_to_int", 12,
+		      bench_translate_string, NULL);
+	bench_measure("mce_gconf_get_bool", 0,
+		      bench_gconf_get, NULL);
+}
+
+/* ------------------------------------------------------------------------- *
+ * I/O monitors
+ * ------------------------------------------------------------------------- */
+
+/** Number of chunks received by the I/O monitor benchmark */
+static guint64 bench_io_chunks = 0;
+
+/**
+ * Chunk callback for the I/O monitor benchmark
+ *
+ * @param data The chunk
+ * @param bytes_read Chunk size
+ * @return Always FALSE, to process all chunks that were read
+ */
+static gboolean bench_io_chunk_cb(gpointer data, gsize bytes_read)
+{
+	(void)data;
+	(void)bytes_read;
+
+	bench_io_chunks++;
+
+	return FALSE;
+}
+
+/**
+ * Push chunks through a pipe and an I/O monitor
+ *
+ * @param ctx Write end of the pipe (as a pointer)
+ * @param iterations Number of BENCH_IO_CHUNKS chunk batches
+ */
+static void bench_io_pipe(gpointer ctx, guint64 iterations)
+{
+	gint fd = GPOINTER_TO_INT(ctx);
+	gchar batch[BENCH_IO_CHUNK_SIZE * BENCH_IO_CHUNKS];
+
+	memset(batch, 0x5a, sizeof batch);
+
+	for (guint64 i = 0; i < iterations; i++) {
+		guint64 expect = bench_io_chunks + BENCH_IO_CHUNKS;
+
+		if (write(fd, batch, sizeof batch) != (ssize_t)sizeof batch)
+			break;
+
+		while (bench_io_chunks < expect)
+			g_main_context_iteration(NULL, TRUE);
+	}
+}
+
+/**
+ * Benchmark io_chunk_cb() throughput over a pipe
+ */
+static void bench_io(void)
+{
+	gconstpointer iomon = NULL;
+	gint fds[2] = { -1, -1 };
+
+	if (pipe2(fds, O_NONBLOCK) == -1) {
+		mce_log(LL_ERR, "pipe: %m");
+		goto EXIT;
+	}
+
+	iomon = mce_register_io_monitor_chunk(fds[0], "bench-pipe",
+					      MCE_IO_ERROR_POLICY_WARN,
+					      G_IO_IN | G_IO_ERR, FALSE,
+					      bench_io_chunk_cb,
+					      BENCH_IO_CHUNK_SIZE);
+	if (iomon == NULL)
+		goto EXIT;
+
+	bench_measure("io_chunk_cb_pipe", BENCH_IO_CHUNKS,
+		      bench_io_pipe, GINT_TO_POINTER(fds[1]));
+
+EXIT:
+	if (iomon != NULL)
+		mce_unregister_io_monitor(iomon);
+
+	if (fds[0] != -1)
+		close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+}
+
+/* ------------------------------------------------------------------------- *
+ * tklock policy
+ * ------------------------------------------------------------------------- */
+
+/** One recorded datapipe input for the tklock policy benchmark */
+typedef struct {
+	/** The datapipe to execute */
+	datapipe_struct *datapipe;
+	/** The value to feed in */
+	gint value;
+} bench_tklock_input_t;
+
+/** Datapipe inputs of a typical incoming call and alarm cycle */
+static const bench_tklock_input_t bench_tklock_inputs[] = {
+	{ &system_state_pipe,	MCE_STATE_USER },
+	{ &display_state_pipe,	MCE_DISPLAY_ON },
+	{ &display_state_pipe,	MCE_DISPLAY_DIM },
+	{ &display_state_pipe,	MCE_DISPLAY_OFF },
+	{ &call_state_pipe,	CALL_STATE_RINGING },
+	{ &display_state_pipe,	MCE_DISPLAY_ON },
+	{ &call_state_pipe,	CALL_STATE_ACTIVE },
+	{ &display_state_pipe,	MCE_DISPLAY_OFF },
+	{ &call_state_pipe,	CALL_STATE_NONE },
+	{ &display_state_pipe,	MCE_DISPLAY_LPM_ON },
+	{ &alarm_ui_state_pipe,	MCE_ALARM_UI_RINGING_INT32 },
+	{ &display_state_pipe,	MCE_DISPLAY_ON },
+	{ &alarm_ui_state_pipe,	MCE_ALARM_UI_OFF_INT32 },
+	{ &lid_cover_pipe,	COVER_CLOSED },
+	{ &display_state_pipe,	MCE_DISPLAY_OFF },
+	{ &lid_cover_pipe,	COVER_OPEN },
+};
+
+/**
+ * Replay the recorded inputs through the tklock policies
+ *
+ * The main loop is drained after every replay, so that the
+ * replies to the D-Bus calls the policies make do not pile up
+ *
+ * @param ctx Unused
+ * @param iterations Number of datapipe inputs to replay
+ */
+static void bench_tklock_replay(gpointer ctx, guint64 iterations)
+{
+	gsize count = G_N_ELEMENTS(bench_tklock_inputs);
+
+	(void)ctx;
+
+	for (guint64 i = 0; i < iterations; i++) {
+		const bench_tklock_input_t *input =
+			&bench_tklock_inputs[i % count];
+
+		(void)execute_datapipe(input->datapipe,
+				       GINT_TO_POINTER(input->value),
+				       USE_INDATA, CACHE_INDATA);
+
+		if ((i % count) == count - 1) {
+			while (g_main_context_iteration(NULL, FALSE) == TRUE)
+				;
+		}
+	}
+}
+
+/**
+ * Benchmark the tklock policies driven through datapipe inputs
+ */
+static void bench_tklock(void)
+{
+	if (g_pattern_match_simple(bench_pattern, "tklock_policy") == FALSE)
+		goto EXIT;
+
+	if (mce_tklock_init() == FALSE)
+		goto EXIT;
+
+	/* There is no system UI or input devices to talk to */
+	mce_log_set_verbosity(LL_CRIT);
+
+	bench_measure("tklock_policy", G_N_ELEMENTS(bench_tklock_inputs),
+		      bench_tklock_replay, NULL);
+
+	mce_log_set_verbosity(LL_WARN);
+
+	mce_tklock_exit();
+
+EXIT:
+	return;
+}
+
+/* ========================================================================= *
+ * MCE_STUBS
+ * ========================================================================= */
+
+/* The core objects call back into mce.c, which is not linked in;
+ * provide just enough of it for the benchmarks */
+
+/** Stub for mce_startup_trace(); startup is not traced here */
+void mce_startup_trace(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+/** Stub for mce_quit_mainloop(); there is no mainloop to stop */
+void mce_quit_mainloop(void)
+{
+	mce_log(LL_ERR, "exit requested while benchmarking");
+	exit(EXIT_FAILURE);
+}
+
+/** Stub for mce_datapipe_generate_activity(); no modules listen */
+void mce_datapipe_generate_activity(void)
+{
+}
+
+/** Stub for mce_abort() */
+void mce_abort(void)
+{
+	abort();
+}
+
+/* ========================================================================= *
+ * MAIN
+ * ========================================================================= */
+
+/**
+ * Run the core microbenchmarks whose names match the shell pattern
+ * given as the only argument, or all of them if there is none
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array with command line arguments
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on failure
+ */
+int main(int argc, char **argv)
+{
+	int status = EXIT_FAILURE;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: %s [<pattern>]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	mce_log_open("mcemicrobench", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_WARN);
+
+	g_type_init();
+
+	/* The settings and D-Bus code need these, but the benchmarks
+	 * run on a session bus so that no root access is needed
+	 */
+	if (mce_conf_init() == FALSE)
+		goto EXIT;
+
+	if (mce_dbus_init(FALSE) == FALSE)
+		goto EXIT;
+
+	if (mce_gconf_init() == FALSE)
+		goto EXIT;
+
+	bench_pattern = (argc > 1) ? argv[1] : "*";
+
+	printf("# benchmark\tparam\titerations\tns_per_iteration\n");
+
+	bench_datapipes();
+	bench_filters();
+	bench_dbus();
+	bench_lookups();
+	bench_io();
+	bench_tklock();
+
+	status = EXIT_SUCCESS;
+
+EXIT:
+	mce_gconf_exit();
+	mce_dbus_exit();
+	mce_conf_exit();
+	mce_log_close();
+
+	return status;
+}
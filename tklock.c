@@ -38,6 +38,12 @@
 					 * mce_write_number_string_to_file()
 					 */
 #include "mce-log.h"			/* mce_log(), LL_* */
+#include "mce-deadline.h"		/* mce_deadline_create(),
+					 * mce_deadline_delete(),
+					 * mce_deadline_start(),
+					 * mce_deadline_stop(),
+					 * mce_deadline_is_active()
+					 */
 #include "datapipe.h"			/* execute_datapipe(),
 					 * datapipe_get_gint(),
 					 * append_input_trigger_to_datapipe(),
@@ -51,6 +57,7 @@
 					 * mce_dbus_owner_monitor_remove_all(),
 					 * dbus_send(),
 					 * dbus_send_message(),
+					 * dbus_send_message_coalesced(),
 					 * dbus_new_method_reply(),
 					 * dbus_new_signal(),
 					 * dbus_message_append_args(),
@@ -89,23 +96,23 @@ static guint tk_autolock_enabled_cb_id = 0;
 /** GConf callback ID for the double tap gesture */
 static guint doubletap_gesture_policy_cb_id = 0;
 
-/** Doubletap gesture proximity timeout ID */
-static guint doubletap_proximity_timeout_cb_id = 0;
+/** Doubletap gesture proximity deadline */
+static mce_deadline_t *doubletap_proximity_deadline = NULL;
 
-/** Doubletap gesture proximity timeout ID */
-static guint pocket_mode_proximity_timeout_cb_id = 0;
+/** Pocket mode proximity deadline */
+static mce_deadline_t *pocket_mode_deadline = NULL;
 
-/** Blanking timeout ID for the visual tklock */
-static guint tklock_visual_blank_timeout_cb_id = 0;
+/** Blanking deadline for the visual tklock */
+static mce_deadline_t *tklock_visual_blank_deadline = NULL;
 
-/** Dimming timeout ID for the tklock */
-static guint tklock_dim_timeout_cb_id = 0;
+/** Dimming deadline for the tklock */
+static mce_deadline_t *tklock_dim_deadline = NULL;
 
-/** ID for touchscreen/keypad unlock source */
-static guint tklock_unlock_timeout_cb_id = 0;
+/** Deadline for touchscreen/keypad unlock */
+static mce_deadline_t *tklock_unlock_deadline = NULL;
 
-/** Powerkey repeat emulation ID */
-static guint powerkey_repeat_emulation_cb_id = 0;
+/** Powerkey repeat emulation deadline */
+static mce_deadline_t *powerkey_repeat_emulation_deadline = NULL;
 
 /** Powerkey repeats counter */
 static guint powerkey_repeat_count = 0;
@@ -197,8 +204,8 @@ static const guint doubletap_recal_delays[] = {
 /** Double tap recalibration index */
 static guint doubletap_recal_index = 0;
 
-/** Double tap recalibration toumeout identifier */
-static guint doubletap_recal_timeout_id = 0;
+/** Double tap recalibration deadline */
+static mce_deadline_t *doubletap_recal_deadline = NULL;
 
 /** Do double tap recalibration on heartbeat */
 static gboolean doubletap_recal_on_heartbeat = FALSE;
@@ -403,9 +410,8 @@ static void heartbeat_trigger(gconstpointer data)
  * Callback for doubletap recalibration
  *
  * @param data Not used.
- * @return Always FALSE for remove event source
  */
-static gboolean doubletap_recal_timeout_cb(gpointer data)
+static void doubletap_recal_timeout_cb(gpointer data)
 {
 	(void)data;
 
@@ -415,19 +421,17 @@ static gboolean doubletap_recal_timeout_cb(gpointer data)
 
 	/* If at last delay, start recalibrating on DSME heartbeat */
 	if (doubletap_recal_index == G_N_ELEMENTS(doubletap_recal_delays) - 1) {
-		doubletap_recal_timeout_id = 0;
 		doubletap_recal_on_heartbeat = TRUE;
-
-		return FALSE;
+		goto EXIT;
 	}
 
 	/* Otherwise use next delay */
 	doubletap_recal_index++;
-	doubletap_recal_timeout_id =
-	       	g_timeout_add_seconds(doubletap_recal_delays[doubletap_recal_index],
-				      doubletap_recal_timeout_cb, NULL);
+	mce_deadline_start(doubletap_recal_deadline,
+			   doubletap_recal_delays[doubletap_recal_index] * 1000);
 
-	return FALSE;
+EXIT:
+	return;
 }
 
 /**
@@ -435,9 +439,7 @@ static gboolean doubletap_recal_timeout_cb(gpointer data)
  */
 static void cancel_doubletap_recal_timeout(void)
 {
-	if (doubletap_recal_timeout_id != 0)
-		g_source_remove(doubletap_recal_timeout_id);
-	doubletap_recal_timeout_id = 0;
+	mce_deadline_stop(doubletap_recal_deadline);
 	doubletap_recal_on_heartbeat = FALSE;
 }
 
@@ -453,10 +455,8 @@ static void setup_doubletap_recal_timeout(void)
 	doubletap_recal_index = 0;
 	doubletap_recal_on_heartbeat = FALSE;
 
-	doubletap_recal_timeout_id =
-		g_timeout_add_seconds(doubletap_recal_delays[doubletap_recal_index],
-				      doubletap_recal_timeout_cb, NULL);
-
+	mce_deadline_start(doubletap_recal_deadline,
+			   doubletap_recal_delays[doubletap_recal_index] * 1000);
 }
 
 /**
@@ -539,19 +539,15 @@ EXIT:
  */
 static void cancel_pocket_mode_timeout(void)
 {
-	if (pocket_mode_proximity_timeout_cb_id != 0) {
-		g_source_remove(pocket_mode_proximity_timeout_cb_id);
-		pocket_mode_proximity_timeout_cb_id = 0;
-	}
+	mce_deadline_stop(pocket_mode_deadline);
 }
 
 /**
  * Timeout callback for doubletap gesture proximity
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean doubletap_proximity_timeout_cb(gpointer data)
+static void doubletap_proximity_timeout_cb(gpointer data)
 {
 	call_state_t call_state = datapipe_get_gint(call_state_pipe);
 	audio_route_t audio_route = datapipe_get_gint(audio_route_pipe);
@@ -562,35 +558,28 @@ static gboolean doubletap_proximity_timeout_cb(gpointer data)
 	    ((call_state == CALL_STATE_RINGING) ||
 	     (call_state == CALL_STATE_ACTIVE))) {
 		cancel_pocket_mode_timeout();
+		mce_submode_begin();
 		mce_add_submode_int32(MCE_POCKET_SUBMODE);
 		mce_add_submode_int32(MCE_PROXIMITY_TKLOCK_SUBMODE);
+		mce_submode_commit();
 	}
 
-	doubletap_proximity_timeout_cb_id = 0;
-
 	/* First disable touchscreen interrupts, then disable gesture */
 	ts_disable();
 	set_doubletap_gesture(FALSE);
 	doubletap_gesture_inhibited = TRUE;
-
-	return FALSE;
 }
 
 /**
  * Timeout callback for pocket mode
  *
  * @param data Unused
- * @return Always returns FALSE to disable the timeout
  */
-static gboolean pocket_mode_timeout_cb(gpointer data)
+static void pocket_mode_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	pocket_mode_proximity_timeout_cb_id = 0;
-
 	mce_add_submode_int32(MCE_POCKET_SUBMODE);
-
-	return FALSE;
 }
 
 /**
@@ -598,12 +587,11 @@ static gboolean pocket_mode_timeout_cb(gpointer data)
  */
 static void setup_pocket_mode_timeout(void)
 {
-	if (pocket_mode_proximity_timeout_cb_id != 0)
+	if (mce_deadline_is_active(pocket_mode_deadline) == TRUE)
 		return;
 
-	pocket_mode_proximity_timeout_cb_id =
-		g_timeout_add_seconds(DEFAULT_POCKET_MODE_PROXIMITY_TIMEOUT,
-				      pocket_mode_timeout_cb, NULL);
+	mce_deadline_start(pocket_mode_deadline,
+			   DEFAULT_POCKET_MODE_PROXIMITY_TIMEOUT * 1000);
 }
 
 /**
@@ -611,11 +599,8 @@ static void setup_pocket_mode_timeout(void)
  */
 static void cancel_doubletap_proximity_timeout(void)
 {
-	/* Remove the timer source for doubletap gesture proximity */
-	if (doubletap_proximity_timeout_cb_id != 0) {
-		g_source_remove(doubletap_proximity_timeout_cb_id);
-		doubletap_proximity_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for doubletap gesture proximity */
+	mce_deadline_stop(doubletap_proximity_deadline);
 }
 
 /**
@@ -637,9 +622,7 @@ static void setup_doubletap_proximity_timeout(void)
 	     (call_state == CALL_STATE_ACTIVE)))
 		timeout = 0;
 
-	doubletap_proximity_timeout_cb_id =
-		g_timeout_add_seconds(timeout,
-				      doubletap_proximity_timeout_cb, NULL);
+	mce_deadline_start(doubletap_proximity_deadline, timeout * 1000);
 
 EXIT:
 	return;
@@ -723,17 +706,38 @@ EXIT:
 	return;
 }
 
+/** Touchscreen/keypad event control statistics */
+typedef struct {
+	/** Number of enable/disable requests */
+	guint requests;
+	/** Number of requests that changed the sysfs state */
+	guint writes;
+	/** Number of requests that matched the cached state */
+	guint skipped;
+} event_control_stats_t;
+
+/** Touchscreen event control statistics */
+static event_control_stats_t ts_stats;
+
+/** Keypad state; uses the touch screen state type */
+static ts_state_t kp_state = MCE_TS_UNSET;
+
+/** Keypad event control statistics */
+static event_control_stats_t kp_stats;
+
 /**
  * Enable/disable touchscreen/keypad events
  *
- * @note Since nothing sensible can be done on error except reporting it,
- *       we don't return the status
  * @param output control structure for enable/disable file
  * @param enable TRUE enable events, FALSE disable events
+ * @return TRUE if the events are in the requested state,
+ *         FALSE if the state could not be modified
  */
-static void generic_event_control(output_state_t *output,
-				  const gboolean enable)
+static gboolean generic_event_control(output_state_t *output,
+				      const gboolean enable)
 {
+	gboolean status = FALSE;
+
 	if (output->path == NULL)
 		goto EXIT;
 
@@ -747,8 +751,54 @@ static void generic_event_control(output_state_t *output,
 	mce_log(LL_DEBUG,
 		"%s: events %s",
 		output->path, enable ? "enabled" : "disabled");
+	status = TRUE;
+
 EXIT:
-	return;
+	return status;
+}
+
+/**
+ * Enable/disable touchscreen/keypad events if the cached state differs
+ *
+ * The cached state is updated only after a successful write,
+ * so a failed write is retried on the next request
+ *
+ * @param output control structure for enable/disable file
+ * @param state cached event state
+ * @param stats event control statistics
+ * @param enable TRUE enable events, FALSE disable events
+ * @return TRUE if the sysfs state was changed, FALSE otherwise
+ */
+static gboolean cached_event_control(output_state_t *output,
+				     ts_state_t *state,
+				     event_control_stats_t *stats,
+				     const gboolean enable)
+{
+	ts_state_t wanted = enable ? MCE_TS_ENABLED : MCE_TS_DISABLED;
+	gboolean changed = FALSE;
+
+	stats->requests++;
+
+	if (*state == wanted) {
+		stats->skipped++;
+		goto EXIT;
+	}
+
+	/* Nothing to control; pretend the state is what was asked */
+	if (output->path == NULL) {
+		*state = wanted;
+		goto EXIT;
+	}
+
+	if (generic_event_control(output, enable) == FALSE)
+		goto EXIT;
+
+	*state = wanted;
+	stats->writes++;
+	changed = TRUE;
+
+EXIT:
+	return changed;
 }
 
 /**
@@ -756,12 +806,9 @@ EXIT:
  */
 static void ts_enable(void)
 {
-	if (ts_state != MCE_TS_ENABLED) {
-		generic_event_control(&mce_touchscreen_sysfs_disable_output,
-				      TRUE);
+	if (cached_event_control(&mce_touchscreen_sysfs_disable_output,
+				 &ts_state, &ts_stats, TRUE) == TRUE)
 		g_usleep(MCE_TOUCHSCREEN_CALIBRATION_DELAY);
-		ts_state = MCE_TS_ENABLED;
-	}
 }
 
 /**
@@ -769,11 +816,8 @@ static void ts_enable(void)
  */
 static void ts_disable(void)
 {
-	if (ts_state != MCE_TS_DISABLED) {
-		generic_event_control(&mce_touchscreen_sysfs_disable_output,
-				      FALSE);
-		ts_state = MCE_TS_DISABLED;
-	}
+	cached_event_control(&mce_touchscreen_sysfs_disable_output,
+			     &ts_state, &ts_stats, FALSE);
 }
 
 /**
@@ -781,7 +825,8 @@ static void ts_disable(void)
  */
 static void kp_enable(void)
 {
-	generic_event_control(&mce_keypad_sysfs_disable_output, TRUE);
+	cached_event_control(&mce_keypad_sysfs_disable_output,
+			     &kp_state, &kp_stats, TRUE);
 }
 
 /**
@@ -789,7 +834,190 @@ static void kp_enable(void)
  */
 static void kp_disable(void)
 {
-	generic_event_control(&mce_keypad_sysfs_disable_output, FALSE);
+	cached_event_control(&mce_keypad_sysfs_disable_output,
+			     &kp_state, &kp_stats, FALSE);
+}
+
+/** Touchscreen/keypad disable policy actions */
+typedef enum {
+	/** Leave touchscreen and keypad as they are */
+	TS_KP_ACTION_NONE = 0,
+	/** Disable touchscreen events */
+	TS_KP_ACTION_TS_DISABLE = 1 << 0,
+	/** Enable the double tap gesture instead of touchscreen events */
+	TS_KP_ACTION_DOUBLETAP = 1 << 1,
+	/** Disable keypad events */
+	TS_KP_ACTION_KP_DISABLE = 1 << 2,
+} ts_kp_action_t;
+
+/** Inputs of the touchscreen/keypad disable policy */
+typedef struct {
+	/** Display is off or in low power mode */
+	gboolean display_off;
+	/** System is in user state */
+	gboolean user_state;
+	/** Alarm UI is visible or ringing */
+	gboolean alarm_ui_visible;
+	/** Touchscreen/keypad lock UI is in normal mode */
+	gboolean tklock_ui_normal;
+	/** Submode bits */
+	submode_t submode;
+	/** There is a call in progress */
+	gboolean call_active;
+	/** The lid cover is closed */
+	gboolean lid_closed;
+	/** Touchscreen disable policy; 0-2 */
+	gint disable_ts;
+	/** Keypad disable policy; 0-2 */
+	gint disable_kp;
+} ts_kp_policy_state_t;
+
+/** Datapipe inputs of the tklock policies
+ *
+ * Updated incrementally by the policy_input_*_trigger() functions,
+ * which run ahead of the other tklock triggers on the same datapipes;
+ * the submode is read at snapshot time, since it may be
+ * in the middle of a transaction
+ */
+static struct {
+	/** Display state */
+	display_state_t display_state;
+	/** System state */
+	system_state_t system_state;
+	/** Alarm UI state */
+	alarm_ui_state_t alarm_ui_state;
+	/** Call state */
+	call_state_t call_state;
+	/** Lid cover state */
+	cover_state_t lid_cover_state;
+} policy_inputs = {
+	.display_state = MCE_DISPLAY_UNDEF,
+	.system_state = MCE_STATE_UNDEF,
+	.alarm_ui_state = MCE_ALARM_UI_INVALID_INT32,
+	.call_state = CALL_STATE_NONE,
+	.lid_cover_state = COVER_UNDEF,
+};
+
+/**
+ * Touchscreen action with tklock enabled,
+ * indexed by [display_off][disable_ts_immediately]
+ *
+ * With the display off the touchscreen is always disabled
+ * unless the double tap gesture is wanted
+ */
+static const ts_kp_action_t ts_kp_policy_ts_lut[2][3] = {
+	{ TS_KP_ACTION_NONE,
+	  TS_KP_ACTION_TS_DISABLE, TS_KP_ACTION_DOUBLETAP },
+	{ TS_KP_ACTION_TS_DISABLE,
+	  TS_KP_ACTION_TS_DISABLE, TS_KP_ACTION_DOUBLETAP },
+};
+
+/**
+ * Keypad action with tklock enabled and no call in progress,
+ * indexed by [display_off][disable_kp_immediately]
+ */
+static const ts_kp_action_t ts_kp_policy_kp_lut[2][3] = {
+	{ TS_KP_ACTION_NONE,
+	  TS_KP_ACTION_KP_DISABLE, TS_KP_ACTION_NONE },
+	{ TS_KP_ACTION_KP_DISABLE,
+	  TS_KP_ACTION_KP_DISABLE, TS_KP_ACTION_NONE },
+};
+
+/**
+ * Gather the inputs of the touchscreen/keypad disable policy
+ *
+ * @param state Storage for the policy inputs
+ */
+static void ts_kp_policy_snapshot(ts_kp_policy_state_t *state)
+{
+	display_state_t display_state = policy_inputs.display_state;
+	alarm_ui_state_t alarm_ui_state = policy_inputs.alarm_ui_state;
+
+	state->display_off = ((display_state == MCE_DISPLAY_OFF) ||
+			      (display_state == MCE_DISPLAY_LPM_OFF) ||
+			      (display_state == MCE_DISPLAY_LPM_ON));
+	state->user_state = (policy_inputs.system_state == MCE_STATE_USER);
+	state->alarm_ui_visible =
+		((alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32) ||
+		 (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32));
+	state->tklock_ui_normal = (tklock_ui_state == MCE_TKLOCK_UI_NORMAL);
+	state->submode = mce_get_submode_int32();
+	state->call_active = (policy_inputs.call_state != CALL_STATE_NONE);
+	state->lid_closed = (policy_inputs.lid_cover_state == COVER_CLOSED);
+	state->disable_ts = disable_ts_immediately;
+	state->disable_kp = disable_kp_immediately;
+}
+
+/**
+ * Decide the touchscreen/keypad disable actions
+ *
+ * This has no side effects, the result depends only on the inputs
+ *
+ * @param state The policy inputs
+ * @return A bitmask of ts_kp_action_t
+ */
+static guint ts_kp_policy_decide(const ts_kp_policy_state_t *state)
+{
+	guint actions = TS_KP_ACTION_NONE;
+	guint display_off = state->display_off ? 1 : 0;
+	guint ts = 0;
+	guint kp = 0;
+
+	/* If we're in softoff submode, always disable */
+	if ((state->submode & MCE_SOFTOFF_SUBMODE) != 0) {
+		actions = TS_KP_ACTION_TS_DISABLE | TS_KP_ACTION_KP_DISABLE;
+		goto EXIT;
+	}
+
+	/* If the Alarm UI is visible, don't disable,
+	 * unless the tklock UI is active
+	 */
+	if ((state->alarm_ui_visible == TRUE) &&
+	    (state->tklock_ui_normal == FALSE))
+		goto EXIT;
+
+	if ((state->user_state == FALSE) ||
+	    ((state->submode & MCE_MALF_SUBMODE) != 0)) {
+		actions = TS_KP_ACTION_TS_DISABLE | TS_KP_ACTION_KP_DISABLE;
+		goto EXIT;
+	}
+
+	if ((state->submode & MCE_TKLOCK_SUBMODE) == 0)
+		goto EXIT;
+
+	/* Unknown policy values behave like 0 */
+	if ((state->disable_ts > 0) && (state->disable_ts <= 2))
+		ts = state->disable_ts;
+
+	if ((state->disable_kp > 0) && (state->disable_kp <= 2))
+		kp = state->disable_kp;
+
+	actions = ts_kp_policy_ts_lut[display_off][ts];
+
+	/* Don't disable kp during call (volume keys must work) */
+	if (state->call_active == FALSE)
+		actions |= ts_kp_policy_kp_lut[display_off][kp];
+
+EXIT:
+	return actions;
+}
+
+/**
+ * Decide whether touchscreen and keypad should be enabled
+ *
+ * This has no side effects, the result depends only on the inputs
+ *
+ * @param state The policy inputs
+ * @return TRUE to enable touchscreen and keypad, FALSE to leave them
+ */
+static gboolean ts_kp_policy_decide_enable(const ts_kp_policy_state_t *state)
+{
+	/* If the cover is closed, don't bother */
+	if (state->lid_closed == TRUE)
+		return FALSE;
+
+	return ((state->user_state == TRUE) ||
+		(state->alarm_ui_visible == TRUE));
 }
 
 /**
@@ -797,25 +1025,15 @@ static void kp_disable(void)
  */
 static void ts_kp_enable_policy(void)
 {
-	system_state_t system_state = datapipe_get_gint(system_state_pipe);
-	cover_state_t lid_cover_state = datapipe_get_gint(lid_cover_pipe);
-	alarm_ui_state_t alarm_ui_state =
-				datapipe_get_gint(alarm_ui_state_pipe);
+	ts_kp_policy_state_t state;
 
-	/* If the cover is closed, don't bother */
-	if (lid_cover_state == COVER_CLOSED)
-		goto EXIT;
+	ts_kp_policy_snapshot(&state);
 
-	if ((system_state == MCE_STATE_USER) ||
-	    (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32) ||
-	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32)) {
+	if (ts_kp_policy_decide_enable(&state) == TRUE) {
 		set_doubletap_gesture(FALSE);
 		ts_enable();
 		kp_enable();
 	}
-
-EXIT:
-	return;
 }
 
 /**
@@ -823,94 +1041,27 @@ EXIT:
  */
 static void ts_kp_disable_policy(void)
 {
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	system_state_t system_state = datapipe_get_gint(system_state_pipe);
-	alarm_ui_state_t alarm_ui_state =
-				datapipe_get_gint(alarm_ui_state_pipe);
-	submode_t submode = mce_get_submode_int32();
-	call_state_t call_state = datapipe_get_gint(call_state_pipe);
+	ts_kp_policy_state_t state;
+	guint actions;
 
-	/* If we're in softoff submode, always disable */
-	if ((submode & MCE_SOFTOFF_SUBMODE) != 0) {
-		ts_disable();
-		kp_disable();
-		goto EXIT;
-	}
+	ts_kp_policy_snapshot(&state);
+	actions = ts_kp_policy_decide(&state);
 
-	/* If the Alarm UI is visible, don't disable,
-	 * unless the tklock UI is active
-	 */
-	if (((alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32) ||
-	     (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32)) &&
-	    (tklock_ui_state != MCE_TKLOCK_UI_NORMAL)) {
+	if ((actions == TS_KP_ACTION_NONE) &&
+	    (state.alarm_ui_visible == TRUE) &&
+	    (state.tklock_ui_normal == FALSE)) {
 		mce_log(LL_DEBUG,
 			"Alarm UI visible; refusing to disable touchscreen "
 			"and keypad events");
-		goto EXIT;
 	}
 
-	if ((system_state != MCE_STATE_USER) ||
-	    (is_malf_state_enabled() == TRUE)){
+	if ((actions & TS_KP_ACTION_DOUBLETAP) != 0)
+		set_doubletap_gesture(TRUE);
+	else if ((actions & TS_KP_ACTION_TS_DISABLE) != 0)
 		ts_disable();
-		kp_disable();
-	} else if (((display_state == MCE_DISPLAY_OFF) ||
-	            (display_state == MCE_DISPLAY_LPM_OFF) ||
-	            (display_state == MCE_DISPLAY_LPM_ON)) &&
-		   (is_tklock_enabled() == TRUE)) {
-		/* Display is off -- we only need to check for
-		 * disable_{ts,kp}_immediately == 2
-		 */
-		if (disable_kp_immediately == 2) {
-			if (disable_ts_immediately == 2) {
-				set_doubletap_gesture(TRUE);
-			} else {
-				ts_disable();
-			}
-		} else {
-			/*  Don't disable kp during call (volume must work) */
-			if (call_state != CALL_STATE_NONE) {
-				if (disable_ts_immediately == 2) {
-					set_doubletap_gesture(TRUE);
-				} else {
-					ts_disable();
-				}
-			} else {
-				if (disable_ts_immediately == 2) {
-					set_doubletap_gesture(TRUE);
-				} else {
-					ts_disable();
-				}
-
-				kp_disable();
-			}
-		}
-	} else if (is_tklock_enabled() == TRUE) {
-		/*  Don't disable kp during call (volume keys must work) */
-		if (call_state != CALL_STATE_NONE) {
-			if (disable_ts_immediately == 2) {
-				set_doubletap_gesture(TRUE);
-			} else if (disable_ts_immediately == 1) {
-				ts_disable();
-			}
-		} else if (disable_kp_immediately == 1) {
-			if (disable_ts_immediately == 2) {
-				set_doubletap_gesture(TRUE);
-			} else if (disable_ts_immediately == 1) {
-				ts_disable();
-			}
 
-			kp_disable();
-		} else {
-			if (disable_ts_immediately == 2) {
-				set_doubletap_gesture(TRUE);
-			} else if (disable_ts_immediately == 1) {
-				ts_disable();
-			}
-		}
-	}
-
-EXIT:
-	return;
+	if ((actions & TS_KP_ACTION_KP_DISABLE) != 0)
+		kp_disable();
 }
 
 /**
@@ -980,8 +1131,8 @@ static gboolean send_tklock_mode(DBusMessage *const method_call)
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(msg);
+	/* Send the message; flapping signals are collapsed */
+	status = dbus_send_message_coalesced(msg, 0);
 
 EXIT:
 	return status;
@@ -1258,6 +1409,7 @@ EXIT:
  */
 static void enable_tklock_raw(void)
 {
+	mce_submode_begin();
 	mce_add_submode_int32(MCE_TKLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_EVEATER_SUBMODE);
 	mce_rem_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
@@ -1265,6 +1417,7 @@ static void enable_tklock_raw(void)
 
 	/* Enable automagic relock */
 	enable_autorelock();
+	mce_submode_commit();
 }
 
 /**
@@ -1280,11 +1433,14 @@ static gboolean enable_tklock(void)
 	    (open_tklock_ui(TKLOCK_ENABLE_LPM_UI) == FALSE))
 		goto EXIT;
 
+	/* Lock and set the visual tklock bit in one submode change */
+	mce_submode_begin();
 	enable_tklock_raw();
 
 	if (is_malf_state_enabled() == FALSE) {
 		mce_add_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
 	}
+	mce_submode_commit();
 
 	if (saved_tklock_state == MCE_TKLOCK_VISUAL_STATE)
 		saved_tklock_state = MCE_TKLOCK_LOCKED_STATE;
@@ -1300,27 +1456,25 @@ EXIT:
  */
 static void cancel_tklock_visual_blank_timeout(void)
 {
-	/* Remove the timer source for visual tklock blanking */
-	if (tklock_visual_blank_timeout_cb_id != 0) {
-		g_source_remove(tklock_visual_blank_timeout_cb_id);
-		tklock_visual_blank_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for visual tklock blanking */
+	mce_deadline_stop(tklock_visual_blank_deadline);
 }
 
 /**
  * Timeout callback for visual touchscreen/keypad lock blanking
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean tklock_visual_blank_timeout_cb(gpointer data)
+static void tklock_visual_blank_timeout_cb(gpointer data)
 {
 	(void)data;
 
 	/* Keep the timeout alive while tklock_blank_disable is set */
 	if( tklock_blank_disable ) {
 		mce_log(LL_INFO, "renew fake visual_blank_timeout");
-		return TRUE;
+		mce_deadline_start(tklock_visual_blank_deadline,
+				   DISABLED_VISUAL_BLANK_DELAY * 1000);
+		goto EXIT;
 	}
 
 	cancel_tklock_visual_blank_timeout();
@@ -1333,7 +1487,8 @@ static gboolean tklock_visual_blank_timeout_cb(gpointer data)
 				       GINT_TO_POINTER(MCE_DISPLAY_LPM_ON),
 				       USE_INDATA, CACHE_INDATA);
 
-	return FALSE;
+EXIT:
+	return;
 }
 
 /**
@@ -1363,8 +1518,7 @@ static void setup_tklock_visual_blank_timeout(void)
 	}
 
 	/* Setup blank timeout */
-	tklock_visual_blank_timeout_cb_id =
-		g_timeout_add_seconds(delay, tklock_visual_blank_timeout_cb, NULL);
+	mce_deadline_start(tklock_visual_blank_deadline, delay * 1000);
 
 EXIT:
 	return;
@@ -1374,20 +1528,19 @@ EXIT:
  * Timeout callback for touchscreen/keypad lock dim
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean tklock_dim_timeout_cb(gpointer data)
+static void tklock_dim_timeout_cb(gpointer data)
 {
 	(void)data;
 
 	/* Keep the timeout alive while tklock_blank_disable is set */
 	if( tklock_blank_disable ) {
 		mce_log(LL_INFO, "renew fake visual_dim_timeout");
-		return TRUE;
+		mce_deadline_start(tklock_dim_deadline,
+				   DISABLED_VISUAL_BLANK_DELAY * 1000);
+		goto EXIT;
 	}
 
-	tklock_dim_timeout_cb_id = 0;
-
 	if (blank_immediately == TRUE) {
 		(void)execute_datapipe(&display_state_pipe,
 				       GINT_TO_POINTER(MCE_DISPLAY_LPM_ON),
@@ -1400,7 +1553,8 @@ static gboolean tklock_dim_timeout_cb(gpointer data)
 				       USE_INDATA, CACHE_INDATA);
 	}
 
-	return FALSE;
+EXIT:
+	return;
 }
 
 /**
@@ -1408,11 +1562,8 @@ static gboolean tklock_dim_timeout_cb(gpointer data)
  */
 static void cancel_tklock_dim_timeout(void)
 {
-	/* Remove the timer source for tklock dimming */
-	if (tklock_dim_timeout_cb_id != 0) {
-		g_source_remove(tklock_dim_timeout_cb_id);
-		tklock_dim_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for tklock dimming */
+	mce_deadline_stop(tklock_dim_deadline);
 }
 
 /**
@@ -1430,8 +1581,88 @@ static void setup_tklock_dim_timeout(void)
 	}
 
 	/* Setup new timeout */
-	tklock_dim_timeout_cb_id =
-		g_timeout_add_seconds(delay, tklock_dim_timeout_cb, NULL);
+	mce_deadline_start(tklock_dim_deadline, delay * 1000);
+}
+
+/** Dim/blank policy actions */
+typedef enum {
+	/** Leave the display as it is */
+	DIM_BLANK_ACTION_NONE,
+	/** Start the tklock dim timeout */
+	DIM_BLANK_ACTION_TIMEOUT,
+	/** Dim the display now */
+	DIM_BLANK_ACTION_DIM,
+	/** Blank the display now, to low power mode if supported */
+	DIM_BLANK_ACTION_BLANK,
+} dim_blank_action_t;
+
+/** Inputs of the dim/blank policy */
+typedef struct {
+	/** Current display state */
+	display_state_t display_state;
+	/** Forced display state; MCE_DISPLAY_UNDEF if not forced */
+	display_state_t force;
+	/** Dim immediately when the tklock is enabled */
+	gboolean dim_immediately;
+	/** Blank immediately when the tklock is enabled */
+	gboolean blank_immediately;
+} dim_blank_policy_state_t;
+
+/**
+ * Gather the inputs of the dim/blank policy
+ *
+ * @param state Storage for the policy inputs
+ * @param force Forced display state, see setup_dim_blank_timeout_policy()
+ */
+static void dim_blank_policy_snapshot(dim_blank_policy_state_t *state,
+				      display_state_t force)
+{
+	state->display_state = policy_inputs.display_state;
+	state->force = force;
+	state->dim_immediately = dim_immediately;
+	state->blank_immediately = blank_immediately;
+}
+
+/**
+ * Decide the dim/blank action
+ *
+ * This has no side effects, the result depends only on the inputs
+ *
+ * @param state The policy inputs
+ * @return The action to take
+ */
+static dim_blank_action_t
+dim_blank_policy_decide(const dim_blank_policy_state_t *state)
+{
+	dim_blank_action_t action = DIM_BLANK_ACTION_TIMEOUT;
+
+	/* If the display is already blank, don't bother */
+	if ((state->display_state == MCE_DISPLAY_OFF) ||
+	    (state->display_state == MCE_DISPLAY_LPM_OFF) ||
+	    (state->display_state == MCE_DISPLAY_LPM_ON)) {
+		action = DIM_BLANK_ACTION_NONE;
+		goto EXIT;
+	}
+
+	/* If we're forcing blank,
+	 * or if the display is already dimmed and we blank immediately,
+	 * or if the we dim and blank immediately, then blank
+	 *
+	 * If we dim immediately, dim the screen (blank timeout takes care
+	 * of the rest) else use the dim timeout
+	 */
+	if ((state->force == MCE_DISPLAY_OFF) ||
+	    (((state->display_state == MCE_DISPLAY_DIM) ||
+	      (state->dim_immediately == TRUE)) &&
+	     (state->blank_immediately == TRUE))) {
+		action = DIM_BLANK_ACTION_BLANK;
+	} else if ((state->force == MCE_DISPLAY_DIM) ||
+		   (state->dim_immediately == TRUE)) {
+		action = DIM_BLANK_ACTION_DIM;
+	}
+
+EXIT:
+	return action;
 }
 
 /**
@@ -1446,42 +1677,34 @@ static void setup_tklock_dim_timeout(void)
  */
 static void setup_dim_blank_timeout_policy(display_state_t force)
 {
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	dim_blank_policy_state_t state;
 
 	cancel_tklock_visual_blank_timeout();
 	cancel_tklock_unlock_timeout();
 	cancel_tklock_dim_timeout();
 
-	/* If the display is already blank, don't bother */
-	if ((display_state == MCE_DISPLAY_OFF) ||
-	    (display_state == MCE_DISPLAY_LPM_OFF) ||
-	    (display_state == MCE_DISPLAY_LPM_ON))
-		goto EXIT;
+	dim_blank_policy_snapshot(&state, force);
 
-	/* If we're forcing blank,
-	 * or if the display is already dimmed and we blank immediately,
-	 * or if the we dim and blank immediately, then blank
-	 *
-	 * If we dim immediately, dim the screen (blank timeout takes care
-	 * of the rest) else use the dim timeout
-	 */
-	if ((force == MCE_DISPLAY_OFF) ||
-	    (((display_state == MCE_DISPLAY_DIM) ||
-	      (dim_immediately == TRUE)) &&
-	     (blank_immediately == TRUE))) {
+	switch (dim_blank_policy_decide(&state)) {
+	case DIM_BLANK_ACTION_BLANK:
 		(void)execute_datapipe(&display_state_pipe,
 				       GINT_TO_POINTER(MCE_DISPLAY_LPM_ON),
 				       USE_INDATA, CACHE_INDATA);
-	} else if ((force == MCE_DISPLAY_DIM) || (dim_immediately == TRUE)) {
+		break;
+
+	case DIM_BLANK_ACTION_DIM:
 		(void)execute_datapipe(&display_state_pipe,
 				       GINT_TO_POINTER(MCE_DISPLAY_DIM),
 				       USE_INDATA, CACHE_INDATA);
-	} else {
+		break;
+
+	case DIM_BLANK_ACTION_TIMEOUT:
 		setup_tklock_dim_timeout();
-	}
+		break;
 
-EXIT:
-	return;
+	default:
+		break;
+	}
 }
 
 /**
@@ -1537,10 +1760,12 @@ static gboolean disable_tklock(void)
 	cancel_tklock_unlock_timeout();
 	cancel_tklock_dim_timeout();
 
+	mce_submode_begin();
 	mce_rem_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
 	(void)send_tklock_mode(NULL);
 	set_doubletap_gesture(FALSE);
+	mce_submode_commit();
 	ts_enable();
 	kp_enable();
 	status = TRUE;
@@ -1614,17 +1839,12 @@ EXIT:
  * Timeout callback for tklock unlock
  *
  * @param data Unused
- * @return Always returns FALSE, to disable the timeout
  */
-static gboolean tklock_unlock_timeout_cb(gpointer data)
+static void tklock_unlock_timeout_cb(gpointer data)
 {
 	(void)data;
 
-	tklock_unlock_timeout_cb_id = 0;
-
 	set_tklock_state(LOCK_OFF);
-
-	return FALSE;
 }
 
 /**
@@ -1632,11 +1852,8 @@ static gboolean tklock_unlock_timeout_cb(gpointer data)
  */
 static void cancel_tklock_unlock_timeout(void)
 {
-	/* Remove the timer source for delayed tklock unlocking */
-	if (tklock_unlock_timeout_cb_id != 0) {
-		g_source_remove(tklock_unlock_timeout_cb_id);
-		tklock_unlock_timeout_cb_id = 0;
-	}
+	/* Stop the deadline for delayed tklock unlocking */
+	mce_deadline_stop(tklock_unlock_deadline);
 }
 
 /**
@@ -1644,32 +1861,27 @@ static void cancel_tklock_unlock_timeout(void)
  */
 static void setup_tklock_unlock_timeout(void)
 {
-	cancel_tklock_unlock_timeout();
-
-	/* Setup new timeout */
-	tklock_unlock_timeout_cb_id =
-		g_timeout_add(MCE_TKLOCK_UNLOCK_DELAY,
-			      tklock_unlock_timeout_cb, NULL);
+	/* Setup new timeout; an active one is rescheduled */
+	mce_deadline_start(tklock_unlock_deadline, MCE_TKLOCK_UNLOCK_DELAY);
 }
 
 /**
  * Timeout callback for emulated powerkey repeat
  *
+ * Restarts the deadline until the repeat limit has been reached
+ *
  * @param data Unused
- * @return TRUE until the repeat limit has been reached, after that
- *         FALSE to cancel the timeout
  */
-static gboolean powerkey_repeat_emulation_cb(gpointer data)
+static void powerkey_repeat_emulation_cb(gpointer data)
 {
 	(void)data;
 
 	if (powerkey_repeat_count < DEFAULT_POWERKEY_REPEAT_LIMIT) {
 		powerkey_repeat_count++;
 		synthesise_activity();
-		return TRUE;
+		mce_deadline_start(powerkey_repeat_emulation_deadline,
+				   DEFAULT_POWERKEY_REPEAT_DELAY * 1000);
 	}
-
-	return FALSE;
 }
 
 /**
@@ -1677,11 +1889,8 @@ static gboolean powerkey_repeat_emulation_cb(gpointer data)
  */
 static void cancel_powerkey_repeat_emulation_timeout(void)
 {
-	/* Remove the timer source for powerkey pressed emulation */
-	if (powerkey_repeat_emulation_cb_id != 0) {
-		g_source_remove(powerkey_repeat_emulation_cb_id);
-		powerkey_repeat_emulation_cb_id = 0;
-	}
+	/* Stop the deadline for powerkey pressed emulation */
+	mce_deadline_stop(powerkey_repeat_emulation_deadline);
 }
 
 /**
@@ -1689,12 +1898,11 @@ static void cancel_powerkey_repeat_emulation_timeout(void)
  */
 static void setup_powerkey_repeat_emulation_timeout(void)
 {
-    cancel_powerkey_repeat_emulation_timeout();
     powerkey_repeat_count = 0;
 
-    /* Setup powerkey repeat emulation timeout */
-    powerkey_repeat_emulation_cb_id =
-	g_timeout_add_seconds(DEFAULT_POWERKEY_REPEAT_DELAY, powerkey_repeat_emulation_cb, NULL);
+    /* Setup powerkey repeat emulation timeout; an active one is rescheduled */
+    mce_deadline_start(powerkey_repeat_emulation_deadline,
+		       DEFAULT_POWERKEY_REPEAT_DELAY * 1000);
 }
 
 /**
@@ -1712,7 +1920,7 @@ static gboolean enable_autokeylock(void)
 	alarm_ui_state_t alarm_ui_state =
 				datapipe_get_gint(alarm_ui_state_pipe);
 	call_state_t call_state = datapipe_get_gint(call_state_pipe);
-	submode_t submode = datapipe_get_gint(submode_pipe);
+	submode_t submode = mce_get_submode_int32();
 	gboolean status = TRUE;
 
 	/* Don't enable automatic tklock during bootup, except when in MALF
@@ -1903,7 +2111,7 @@ static void trigger_visual_tklock(gboolean powerkey)
 	} else if (powerkey == TRUE) {
 		/* XXX: we probably want to make this configurable */
 		/* Blank screen */
-		if (tklock_dim_timeout_cb_id == 0) {
+		if (mce_deadline_is_active(tklock_dim_deadline) == FALSE) {
 			(void)execute_datapipe(&display_state_pipe,
 					       GINT_TO_POINTER(MCE_DISPLAY_LPM_ON),
 					       USE_INDATA, CACHE_INDATA);
@@ -2115,10 +2323,10 @@ static void tklock_gconf_cb(GConfClient *const gcc, const guint id,
 		if( tklock_blank_disable == old ) {
 			// no need to change the timers
 		}
-		else if( tklock_visual_blank_timeout_cb_id ) {
+		else if( mce_deadline_is_active(tklock_visual_blank_deadline) ) {
 			setup_tklock_visual_blank_timeout();
 		}
-		else if( tklock_dim_timeout_cb_id ) {
+		else if( mce_deadline_is_active(tklock_dim_deadline) ) {
 			setup_tklock_dim_timeout();
 		}
 	} else {
@@ -2131,8 +2339,10 @@ EXIT:
 
 static void return_from_proximity(void)
 {
+	mce_submode_begin();
 	mce_rem_submode_int32(MCE_PROXIMITY_TKLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_POCKET_SUBMODE);
+	mce_submode_commit();
 
 	switch (saved_tklock_state) {
 	case MCE_TKLOCK_UNLOCKED_STATE:
@@ -2317,7 +2527,7 @@ static void device_inactive_trigger(gconstpointer const data)
 
 	if (device_inactive == FALSE) {
 		if ((is_tklock_enabled() == TRUE) &&
-		    (tklock_visual_blank_timeout_cb_id != 0)) {
+		    (mce_deadline_is_active(tklock_visual_blank_deadline) == TRUE)) {
 			setup_tklock_visual_blank_timeout();
 		}
 	}
@@ -2564,6 +2774,56 @@ EXIT:
 	return;
 }
 
+/**
+ * Track the system state for the tklock policies
+ *
+ * @param data The system state stored in a pointer
+ */
+static void policy_input_system_state_trigger(gconstpointer data)
+{
+	policy_inputs.system_state = GPOINTER_TO_INT(data);
+}
+
+/**
+ * Track the display state for the tklock policies
+ *
+ * @param data The display state stored in a pointer
+ */
+static void policy_input_display_state_trigger(gconstpointer data)
+{
+	policy_inputs.display_state = GPOINTER_TO_INT(data);
+}
+
+/**
+ * Track the alarm UI state for the tklock policies
+ *
+ * @param data The alarm UI state stored in a pointer
+ */
+static void policy_input_alarm_ui_state_trigger(gconstpointer data)
+{
+	policy_inputs.alarm_ui_state = GPOINTER_TO_INT(data);
+}
+
+/**
+ * Track the call state for the tklock policies
+ *
+ * @param data The call state stored in a pointer
+ */
+static void policy_input_call_state_trigger(gconstpointer data)
+{
+	policy_inputs.call_state = GPOINTER_TO_INT(data);
+}
+
+/**
+ * Track the lid cover state for the tklock policies
+ *
+ * @param data The lid cover state stored in a pointer
+ */
+static void policy_input_lid_cover_trigger(gconstpointer data)
+{
+	policy_inputs.lid_cover_state = GPOINTER_TO_INT(data);
+}
+
 /**
  * Handle system state change
  *
@@ -2944,27 +3204,26 @@ static void tk_lock_trigger(gconstpointer data)
  */
 static void submode_trigger(gconstpointer data)
 {
-	static submode_t old_submode = MCE_NORMAL_SUBMODE;
 	submode_t submode = GPOINTER_TO_INT(data);
 
+	if ((mce_get_submode_changes() & MCE_SOFTOFF_SUBMODE) == 0)
+		goto EXIT;
+
 	/* If we transition from !softoff to softoff,
 	 * disable touchscreen and keypad events,
 	 * otherwise enable them
 	 */
 	if ((submode & MCE_SOFTOFF_SUBMODE) != 0) {
-		if ((old_submode & MCE_SOFTOFF_SUBMODE) == 0) {
-			ts_disable();
-			kp_disable();
-		}
+		ts_disable();
+		kp_disable();
 	} else {
-		if ((old_submode & MCE_SOFTOFF_SUBMODE) != 0) {
-			set_doubletap_gesture(FALSE);
-			kp_enable();
-			ts_enable();
-		}
+		set_doubletap_gesture(FALSE);
+		kp_enable();
+		ts_enable();
 	}
 
-	old_submode = submode;
+EXIT:
+	return;
 }
 
 /**
@@ -3159,6 +3418,29 @@ gboolean mce_tklock_init(void)
 {
 	gboolean status = FALSE;
 
+	/* Create the policy timers; they keep running across suspend */
+	doubletap_recal_deadline =
+		mce_deadline_create("doubletap_recal",
+				    doubletap_recal_timeout_cb, NULL);
+	doubletap_proximity_deadline =
+		mce_deadline_create("doubletap_proximity",
+				    doubletap_proximity_timeout_cb, NULL);
+	pocket_mode_deadline =
+		mce_deadline_create("pocket_mode",
+				    pocket_mode_timeout_cb, NULL);
+	tklock_visual_blank_deadline =
+		mce_deadline_create("tklock_visual_blank",
+				    tklock_visual_blank_timeout_cb, NULL);
+	tklock_dim_deadline =
+		mce_deadline_create("tklock_dim",
+				    tklock_dim_timeout_cb, NULL);
+	tklock_unlock_deadline =
+		mce_deadline_create("tklock_unlock",
+				    tklock_unlock_timeout_cb, NULL);
+	powerkey_repeat_emulation_deadline =
+		mce_deadline_create("powerkey_repeat_emulation",
+				    powerkey_repeat_emulation_cb, NULL);
+
 	/* Init event control files */
 	if (g_access(MCE_RX51_KEYBOARD_SYSFS_DISABLE_PATH, W_OK) == 0) {
 		mce_keypad_sysfs_disable_output.path =
@@ -3206,6 +3488,25 @@ gboolean mce_tklock_init(void)
 
 	errno = 0;
 
+	/* Track the policy inputs first, so that the snapshots
+	 * are up to date when the other triggers run */
+	policy_inputs.system_state = datapipe_get_gint(system_state_pipe);
+	policy_inputs.display_state = datapipe_get_gint(display_state_pipe);
+	policy_inputs.alarm_ui_state = datapipe_get_gint(alarm_ui_state_pipe);
+	policy_inputs.call_state = datapipe_get_gint(call_state_pipe);
+	policy_inputs.lid_cover_state = datapipe_get_gint(lid_cover_pipe);
+
+	append_output_trigger_to_datapipe(&system_state_pipe,
+					  policy_input_system_state_trigger);
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  policy_input_display_state_trigger);
+	append_output_trigger_to_datapipe(&alarm_ui_state_pipe,
+					  policy_input_alarm_ui_state_trigger);
+	append_output_trigger_to_datapipe(&call_state_pipe,
+					  policy_input_call_state_trigger);
+	append_output_trigger_to_datapipe(&lid_cover_pipe,
+					  policy_input_lid_cover_trigger);
+
 	/* Close the touchscreen/keypad lock and event eater UI,
 	 * to make sure MCE doesn't end up in a confused state
 	 * if restarted
@@ -3394,6 +3695,13 @@ EXIT:
  */
 void mce_tklock_exit(void)
 {
+	mce_log(LL_DEBUG, "touchscreen events: %u requests, %u writes, "
+		"%u skipped", ts_stats.requests, ts_stats.writes,
+		ts_stats.skipped);
+	mce_log(LL_DEBUG, "keypad events: %u requests, %u writes, "
+		"%u skipped", kp_stats.requests, kp_stats.writes,
+		kp_stats.skipped);
+
 	/* Remove gconf change notifiers */
 	if( tklock_blank_disable_id ) {
 		mce_gconf_notifier_remove(GINT_TO_POINTER(tklock_blank_disable_id), 0);
@@ -3438,6 +3746,16 @@ void mce_tklock_exit(void)
 					   touchscreen_trigger);
 	remove_input_trigger_from_datapipe(&device_inactive_pipe,
 					   device_inactive_trigger);
+	remove_output_trigger_from_datapipe(&lid_cover_pipe,
+					    policy_input_lid_cover_trigger);
+	remove_output_trigger_from_datapipe(&call_state_pipe,
+					    policy_input_call_state_trigger);
+	remove_output_trigger_from_datapipe(&alarm_ui_state_pipe,
+					    policy_input_alarm_ui_state_trigger);
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    policy_input_display_state_trigger);
+	remove_output_trigger_from_datapipe(&system_state_pipe,
+					    policy_input_system_state_trigger);
 
 	/* This trigger is conditional; attempt to remove it anyway */
 	remove_input_trigger_from_datapipe(&touchscreen_pipe,
@@ -3452,5 +3770,20 @@ void mce_tklock_exit(void)
 	cancel_tklock_dim_timeout();
 	cancel_doubletap_recal_timeout();
 
+	mce_deadline_delete(doubletap_recal_deadline);
+	doubletap_recal_deadline = NULL;
+	mce_deadline_delete(doubletap_proximity_deadline);
+	doubletap_proximity_deadline = NULL;
+	mce_deadline_delete(pocket_mode_deadline);
+	pocket_mode_deadline = NULL;
+	mce_deadline_delete(tklock_visual_blank_deadline);
+	tklock_visual_blank_deadline = NULL;
+	mce_deadline_delete(tklock_dim_deadline);
+	tklock_dim_deadline = NULL;
+	mce_deadline_delete(tklock_unlock_deadline);
+	tklock_unlock_deadline = NULL;
+	mce_deadline_delete(powerkey_repeat_emulation_deadline);
+	powerkey_repeat_emulation_deadline = NULL;
+
 	return;
 }
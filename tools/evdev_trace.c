@@ -7,6 +7,7 @@
 #include "../evdev.h"
 #include "../mce-log.h"
 #include <linux/input.h>
+#include <linux/uinput.h>
 
 #include <string.h>
 #include <fcntl.h>
@@ -19,17 +20,474 @@
 #include <stdlib.h>
 #include <glob.h>
 #include <getopt.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+/* ------------------------------------------------------------------------- *
+ * binary trace file
+ * ------------------------------------------------------------------------- */
+
+/** Magic bytes at the start of a binary trace file */
+static const char trace_magic[8] = "EVTRACE1";
+
+/** Trace record kinds */
+enum
+{
+  /** Device descriptor; followed by trace_dev_t payload */
+  TRACE_REC_DEVICE = 1,
+
+  /** One input event */
+  TRACE_REC_EVENT  = 2,
+};
+
+/** Size of the largest capability bitmap [bytes] */
+#define TRACE_BITS_SIZE ((KEY_CNT + 7) / 8)
+
+/** Fixed size record header, also holds the event data
+ *
+ * Events are stored as one record each, device descriptors
+ * as a record followed by size bytes of trace_dev_t.
+ */
+typedef struct
+{
+  uint16_t kind;    /**< TRACE_REC_DEVICE or TRACE_REC_EVENT */
+  uint16_t device;  /**< Index of the device in capture order */
+  uint16_t type;    /**< Event type */
+  uint16_t code;    /**< Event code */
+  int32_t  value;   /**< Event value */
+  uint32_t size;    /**< Payload size following the record */
+  int64_t  time;    /**< Event time stamp [us] */
+} trace_rec_t;
+
+/** Input device descriptor, enough to recreate it via uinput */
+typedef struct
+{
+  /** Bus, vendor, product and version */
+  struct input_id      id;
+
+  /** Device name */
+  char                 name[UINPUT_MAX_NAME_SIZE];
+
+  /** Capability bitmaps; [0] holds event types, [type] the codes */
+  uint8_t              bits[EV_CNT][TRACE_BITS_SIZE];
+
+  /** Absolute axis ranges */
+  struct input_absinfo abs[ABS_CNT];
+} trace_dev_t;
+
+/** Test bit in a byte addressed capability bitmap
+ *
+ * @param bits bitmap as lsb first bytes
+ * @param bit  bit number
+ *
+ * @return nonzero if set, zero otherwise
+ */
+static
+int
+trace_test_bit(const uint8_t *bits, int bit)
+{
+  return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+/** Number of codes defined for an event type
+ *
+ * @param type event type
+ *
+ * @return number of codes, or 0 if type has no codes
+ */
+static
+int
+trace_code_count(int type)
+{
+  switch( type )
+  {
+  case EV_KEY: return KEY_CNT;
+  case EV_REL: return REL_CNT;
+  case EV_ABS: return ABS_CNT;
+  case EV_MSC: return MSC_CNT;
+  case EV_SW:  return SW_CNT;
+  case EV_LED: return LED_CNT;
+  case EV_SND: return SND_CNT;
+  case EV_FF:  return FF_CNT;
+  default:     return 0;
+  }
+}
+
+/** Write a device descriptor to a capture file
+ *
+ * @param file   capture file
+ * @param fd     input device file descriptor
+ * @param device index of the device
+ *
+ * @return 0 on success, or -1 in case of errors
+ */
+static
+int
+trace_write_device(FILE *file, int fd, int device)
+{
+  trace_rec_t rec;
+  trace_dev_t dev;
+
+  memset(&rec, 0, sizeof rec);
+  memset(&dev, 0, sizeof dev);
+
+  if( ioctl(fd, EVIOCGID, &dev.id) == -1 ||
+      ioctl(fd, EVIOCGNAME(sizeof dev.name - 1), dev.name) == -1 ||
+      ioctl(fd, EVIOCGBIT(0, sizeof dev.bits[0]), dev.bits[0]) == -1 )
+  {
+    mce_log(LL_ERR, "device %d: failed to query capabilities: %m", device);
+    return -1;
+  }
+
+  for( int type = 1; type < EV_CNT; ++type )
+  {
+    if( !trace_test_bit(dev.bits[0], type) || !trace_code_count(type) )
+    {
+      continue;
+    }
+    ioctl(fd, EVIOCGBIT(type, sizeof dev.bits[type]), dev.bits[type]);
+  }
+
+  for( int code = 0; code < ABS_CNT; ++code )
+  {
+    if( trace_test_bit(dev.bits[EV_ABS], code) )
+    {
+      ioctl(fd, EVIOCGABS(code), &dev.abs[code]);
+    }
+  }
+
+  rec.kind   = TRACE_REC_DEVICE;
+  rec.device = device;
+  rec.size   = sizeof dev;
+
+  if( fwrite(&rec, sizeof rec, 1, file) != 1 ||
+      fwrite(&dev, sizeof dev, 1, file) != 1 )
+  {
+    mce_log(LL_ERR, "capture write failed: %m");
+    return -1;
+  }
+
+  return 0;
+}
+
+/** Write input events to a capture file
+ *
+ * @param file   capture file
+ * @param device index of the device the events came from
+ * @param eve    array of events
+ * @param count  number of events
+ *
+ * @return 0 on success, or -1 in case of errors
+ */
+static
+int
+trace_write_events(FILE *file, int device,
+                   const struct input_event *eve, int count)
+{
+  trace_rec_t rec[count];
+
+  memset(rec, 0, sizeof rec);
+
+  for( int i = 0; i < count; ++i )
+  {
+    rec[i].kind   = TRACE_REC_EVENT;
+    rec[i].device = device;
+    rec[i].type   = eve[i].type;
+    rec[i].code   = eve[i].code;
+    rec[i].value  = eve[i].value;
+    rec[i].time   = eve[i].time.tv_sec * INT64_C(1000000) +
+                    eve[i].time.tv_usec;
+  }
+
+  if( fwrite(rec, sizeof *rec, count, file) != (size_t)count )
+  {
+    mce_log(LL_ERR, "capture write failed: %m");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- *
+ * replay via uinput
+ * ------------------------------------------------------------------------- */
+
+/** Path to the uinput device node */
+#define UINPUT_PATH "/dev/uinput"
+
+/** Create a virtual input device matching a captured descriptor
+ *
+ * @param dev device descriptor
+ *
+ * @return uinput file descriptor, or -1 in case of errors
+ */
+static
+int
+replay_create_device(const trace_dev_t *dev)
+{
+  struct uinput_user_dev uidev;
+
+  /* ioctl numbers for setting the codes of each event type */
+  static const struct
+  {
+    int type;
+    unsigned long req;
+  } code_req[] =
+  {
+    { EV_KEY, UI_SET_KEYBIT },
+    { EV_REL, UI_SET_RELBIT },
+    { EV_ABS, UI_SET_ABSBIT },
+    { EV_MSC, UI_SET_MSCBIT },
+    { EV_SW,  UI_SET_SWBIT  },
+    { EV_LED, UI_SET_LEDBIT },
+    { EV_SND, UI_SET_SNDBIT },
+    { EV_FF,  UI_SET_FFBIT  },
+  };
+
+  int fd = open(UINPUT_PATH, O_WRONLY | O_NONBLOCK);
+
+  if( fd == -1 )
+  {
+    mce_log(LL_ERR, "%s: %m", UINPUT_PATH);
+    goto failed;
+  }
+
+  for( int type = 0; type < EV_CNT; ++type )
+  {
+    if( trace_test_bit(dev->bits[0], type) )
+    {
+      ioctl(fd, UI_SET_EVBIT, type);
+    }
+  }
+
+  for( size_t i = 0; i < sizeof code_req / sizeof *code_req; ++i )
+  {
+    int type = code_req[i].type;
+
+    if( !trace_test_bit(dev->bits[0], type) )
+    {
+      continue;
+    }
+
+    for( int code = 0; code < trace_code_count(type); ++code )
+    {
+      if( trace_test_bit(dev->bits[type], code) )
+      {
+        ioctl(fd, code_req[i].req, code);
+      }
+    }
+  }
+
+  memset(&uidev, 0, sizeof uidev);
+  memcpy(uidev.name, dev->name, sizeof uidev.name - 1);
+  uidev.id = dev->id;
+
+  for( int code = 0; code < ABS_CNT; ++code )
+  {
+    uidev.absmin[code]  = dev->abs[code].minimum;
+    uidev.absmax[code]  = dev->abs[code].maximum;
+    uidev.absfuzz[code] = dev->abs[code].fuzz;
+    uidev.absflat[code] = dev->abs[code].flat;
+  }
+
+  if( write(fd, &uidev, sizeof uidev) != (ssize_t)sizeof uidev )
+  {
+    mce_log(LL_ERR, "%s: device setup failed: %m", dev->name);
+    goto failed;
+  }
+
+  if( ioctl(fd, UI_DEV_CREATE) == -1 )
+  {
+    mce_log(LL_ERR, "%s: device create failed: %m", dev->name);
+    goto failed;
+  }
+
+  return fd;
+
+failed:
+
+  if( fd != -1 ) close(fd);
+
+  return -1;
+}
+
+/** Get monotonic time stamp
+ *
+ * @return current CLOCK_MONOTONIC time [us]
+ */
+static
+int64_t
+replay_get_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/** Sleep until the given monotonic time
+ *
+ * @param until CLOCK_MONOTONIC time [us]
+ */
+static
+void
+replay_wait_until(int64_t until)
+{
+  int64_t left = until - replay_get_time();
+
+  if( left > 0 )
+  {
+    struct timespec ts =
+    {
+      .tv_sec  = left / 1000000,
+      .tv_nsec = left % 1000000 * 1000,
+    };
+    TEMP_FAILURE_RETRY(nanosleep(&ts, &ts));
+  }
+}
+
+/** Replay a binary capture through uinput
+ *
+ * Virtual devices are created as their descriptors are seen and
+ * destroyed when the replay ends. The gaps between events are
+ * divided by speed; zero speed replays without any delays.
+ *
+ * @param path  capture file path
+ * @param speed replay speed relative to the capture
+ *
+ * @return 0 on success, or -1 in case of errors
+ */
+static
+int
+replay_capture(const char *path, double speed)
+{
+  int          result = -1;
+  FILE        *file   = 0;
+  int         *uifd   = 0;
+  int          uicnt  = 0;
+  int64_t      base   = -1;
+  int64_t      start  = 0;
+  long         events = 0;
+  char         magic[sizeof trace_magic];
+  trace_rec_t  rec;
+  trace_dev_t  dev;
+
+  if( !(file = fopen(path, "rb")) )
+  {
+    mce_log(LL_ERR, "%s: %m", path);
+    goto cleanup;
+  }
+
+  if( fread(magic, sizeof magic, 1, file) != 1 ||
+      memcmp(magic, trace_magic, sizeof magic) )
+  {
+    mce_log(LL_ERR, "%s: not an evdev_trace capture", path);
+    goto cleanup;
+  }
+
+  while( fread(&rec, sizeof rec, 1, file) == 1 )
+  {
+    if( rec.kind == TRACE_REC_DEVICE )
+    {
+      if( rec.size != sizeof dev || fread(&dev, sizeof dev, 1, file) != 1 )
+      {
+        mce_log(LL_ERR, "%s: truncated device descriptor", path);
+        goto cleanup;
+      }
+
+      if( rec.device >= uicnt )
+      {
+        uifd = realloc(uifd, (rec.device + 1) * sizeof *uifd);
+        while( uicnt <= rec.device )
+        {
+          uifd[uicnt++] = -1;
+        }
+      }
+
+      if( uifd[rec.device] == -1 &&
+          (uifd[rec.device] = replay_create_device(&dev)) == -1 )
+      {
+        goto cleanup;
+      }
+
+      mce_log(LL_INFO, "device %d: %s", rec.device, dev.name);
+    }
+    else if( rec.kind == TRACE_REC_EVENT )
+    {
+      struct input_event eve;
+
+      if( rec.device >= uicnt || uifd[rec.device] == -1 )
+      {
+        mce_log(LL_ERR, "%s: event for unknown device %d",
+                path, rec.device);
+        goto cleanup;
+      }
+
+      if( base < 0 )
+      {
+        base  = rec.time;
+        start = replay_get_time();
+      }
+      else if( speed > 0 && rec.time > base )
+      {
+        replay_wait_until(start + (int64_t)((rec.time - base) / speed));
+      }
+
+      memset(&eve, 0, sizeof eve);
+      eve.type  = rec.type;
+      eve.code  = rec.code;
+      eve.value = rec.value;
+
+      if( write(uifd[rec.device], &eve, sizeof eve) != (ssize_t)sizeof eve )
+      {
+        mce_log(LL_WARN, "device %d: event write failed: %m", rec.device);
+      }
+      ++events;
+    }
+    else
+    {
+      mce_log(LL_ERR, "%s: unknown record kind %d", path, rec.kind);
+      goto cleanup;
+    }
+  }
+
+  mce_log(LL_INFO, "%s: replayed %ld events in %.3f s", path, events,
+          base < 0 ? 0.0 : (replay_get_time() - start) / 1e6);
+
+  result = 0;
+
+cleanup:
+
+  for( int i = 0; i < uicnt; ++i )
+  {
+    if( uifd[i] == -1 ) continue;
+    ioctl(uifd[i], UI_DEV_DESTROY);
+    close(uifd[i]);
+  }
+  free(uifd);
+
+  if( file ) fclose(file);
+
+  return result;
+}
 
 /** Read and show input events
  *
- * @param fd   input device file descriptor to read from
- * @param title text to print before event details
+ * @param fd      input device file descriptor to read from
+ * @param title   text to print before event details
+ * @param device  index of the device
+ * @param capture capture file, or NULL
+ * @param show    if nonzero print out the events
  *
  * @return positive value on success, 0 on eof, -1 on errors
  */
 static
 int
-process_events(int fd, const char *title)
+process_events(int fd, const char *title, int device,
+               FILE *capture, int show)
 {
   struct input_event eve[256];
 
@@ -49,7 +507,12 @@ process_events(int fd, const char *title)
 
   n /= sizeof *eve;
 
-  for( int i = 0; i < n; ++i )
+  if( capture && trace_write_events(capture, device, eve, n) == -1 )
+  {
+    return -1;
+  }
+
+  for( int i = 0; show && i < n; ++i )
   {
     struct input_event *e = &eve[i];
 
@@ -66,21 +529,45 @@ process_events(int fd, const char *title)
   return 1;
 }
 
+/** Set from signal handler to make mainloop() return */
+static volatile sig_atomic_t mainloop_quit = 0;
+
+/** Signal handler for stopping a trace or capture cleanly
+ *
+ * @param sig signal number (unused)
+ */
+static
+void
+mainloop_quit_cb(int sig)
+{
+  (void)sig;
+  mainloop_quit = 1;
+}
+
 /** Mainloop for processing event input devices
  *
  * @param path  vector of input device paths
  * @param count number of paths in the path
  * @param identify if nonzero print input device information
  * @param trace stay in loop and print out events as they arrive
+ * @param capture stay in loop and write events to this file, or NULL
  */
 static
 void
-mainloop(char **path, int count, int identify, int trace)
+mainloop(char **path, int count, int identify, int trace, FILE *capture)
 {
   struct pollfd pfd[count];
 
   int closed = 0;
 
+  /* The cleanup path must not see garbage in slots not opened yet */
+  for( int i = 0; i < count; ++i )
+  {
+    pfd[i].fd      = -1;
+    pfd[i].events  = 0;
+    pfd[i].revents = 0;
+  }
+
   for( int i = 0; i < count; ++i )
   {
     if( (pfd[i].fd = evdev_open_device(path[i])) == -1 )
@@ -95,27 +582,39 @@ mainloop(char **path, int count, int identify, int trace)
       evdev_identify_device(pfd[i].fd);
       printf("\n");
     }
+
+    if( capture && trace_write_device(capture, pfd[i].fd, i) == -1 )
+    {
+      goto cleanup;
+    }
   }
 
-  if( !trace )
+  if( !trace && !capture )
   {
     goto cleanup;
   }
 
-  while( closed < count )
+  /* Interrupting a capture must not lose buffered events */
+  signal(SIGINT,  mainloop_quit_cb);
+  signal(SIGTERM, mainloop_quit_cb);
+
+  while( closed < count && !mainloop_quit )
   {
     for( int i = 0; i < count; ++i )
     {
       pfd[i].events = (pfd[i].fd < 0) ? 0 : POLLIN;
     }
 
-    poll(pfd, count, -1);
+    if( poll(pfd, count, -1) == -1 )
+    {
+      continue;
+    }
 
     for( int i = 0; i < count; ++i )
     {
       if( pfd[i].revents )
       {
-        if( process_events(pfd[i].fd, path[i]) <= 0 )
+        if( process_events(pfd[i].fd, path[i], i, capture, trace) <= 0 )
         {
           close(pfd[i].fd);
           pfd[i].fd = -1;
@@ -137,8 +636,11 @@ cleanup:
 static struct option optL[] =
 {
   { "help",     0, 0, 'h' },
-  { "trace",    0, 0, 'i' },
-  { "identify", 0, 0, 't' },
+  { "trace",    0, 0, 't' },
+  { "identify", 0, 0, 'i' },
+  { "capture",  1, 0, 'c' },
+  { "replay",   1, 0, 'r' },
+  { "speed",    1, 0, 's' },
   { 0,0,0,0 }
 };
 
@@ -147,11 +649,27 @@ static const char optS[] =
 "h" // --help
 "t" // --trace
 "i" // --identify
+"c:" // --capture
+"r:" // --replay
+"s:" // --speed
 ;
 
 /** Program name string */
 static const char *progname = 0;
 
+/** Compatibility with mce-log.h; everything is logged
+ */
+volatile int mce_log_generation = 1;
+
+/** Compatibility with mce-log.h
+ */
+void
+mce_log_site_resolve(mce_log_site_t *site)
+{
+  site->level      = LL_DEBUG;
+  site->generation = mce_log_generation;
+}
+
 /** Compatibility with mce-log.h
  */
 void
@@ -199,6 +717,14 @@ static void usage(void)
          "  -h, --help      -- this help text\n"
          "  -i, --identify  -- identify input device\n"
          "  -t, --trace     -- trace input events\n"
+         "  -c, --capture=<file>\n"
+         "                  -- write input events and device descriptors\n"
+         "                     to a binary capture file\n"
+         "  -r, --replay=<file>\n"
+         "                  -- replay a capture through uinput\n"
+         "  -s, --speed=<factor>\n"
+         "                  -- replay speed relative to the capture,\n"
+         "                     0 means as fast as possible; default 1\n"
 	 "\n"
 	 "NOTES\n"
          "  If no device paths are given, /dev/input/event* is assumed.\n"
@@ -256,6 +782,11 @@ main(int argc, char **argv)
   int f_trace    = 0;
   int f_identify = 0;
 
+  const char *capture_path = 0;
+  const char *replay_path  = 0;
+  double      replay_speed = 1.0;
+  FILE       *capture      = 0;
+
   glob_t gb;
 
   memset(&gb, 0, sizeof gb);
@@ -285,6 +816,23 @@ main(int argc, char **argv)
       f_identify = 1;
       break;
 
+    case 'c':
+      capture_path = optarg;
+      break;
+
+    case 'r':
+      replay_path = optarg;
+      break;
+
+    case 's':
+      replay_speed = strtod(optarg, 0);
+      if( replay_speed < 0 )
+      {
+        mce_log(LL_ERR, "%s: invalid replay speed", optarg);
+        goto cleanup;
+      }
+      break;
+
     case '?':
     case ':':
       goto cleanup;
@@ -295,7 +843,26 @@ main(int argc, char **argv)
     }
   }
 
-  if( !f_identify && !f_trace )
+  if( replay_path )
+  {
+    if( replay_capture(replay_path, replay_speed) == 0 )
+    {
+      result = EXIT_SUCCESS;
+    }
+    goto cleanup;
+  }
+
+  if( capture_path )
+  {
+    if( !(capture = fopen(capture_path, "wb")) ||
+        fwrite(trace_magic, sizeof trace_magic, 1, capture) != 1 )
+    {
+      mce_log(LL_ERR, "%s: %m", capture_path);
+      goto cleanup;
+    }
+  }
+
+  if( !f_identify && !f_trace && !capture )
   {
     f_identify = 1;
   }
@@ -308,7 +875,7 @@ main(int argc, char **argv)
       char *path = get_device_path(argv[i]);
       if( path ) argv[argc++] = path;
     }
-    mainloop(argv, argc, f_identify, f_trace);
+    mainloop(argv, argc, f_identify, f_trace, capture);
     while( argc > 0 )
     {
       free(argv[--argc]);
@@ -324,13 +891,15 @@ main(int argc, char **argv)
       goto cleanup;
     }
 
-    mainloop(gb.gl_pathv, gb.gl_pathc, f_identify, f_trace);
+    mainloop(gb.gl_pathv, gb.gl_pathc, f_identify, f_trace, capture);
   }
 
   result = EXIT_SUCCESS;
 
 cleanup:
 
+  if( capture ) fclose(capture);
+
   globfree(&gb);
 
   return result;
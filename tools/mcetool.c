@@ -53,6 +53,45 @@
 /** Define set config DBUS method */
 #define MCE_DBUS_SET_CONFIG_REQ                 "set_config"
 
+/** Define get all config values DBUS method */
+#define MCE_DBUS_GET_CONFIG_ALL_REQ             "get_config_all"
+
+/** Define get datapipe statistics DBUS method */
+#define MCE_DBUS_GET_DATAPIPE_STATS_REQ         "get_datapipe_stats"
+
+/** Define get datapipe trace DBUS method */
+#define MCE_DBUS_GET_DATAPIPE_TRACE_REQ         "get_datapipe_trace"
+
+/** Define get D-Bus handler statistics DBUS method */
+#define MCE_DBUS_GET_HANDLER_STATS_REQ          "get_dbus_handler_stats"
+
+/** Define get input latency statistics DBUS method */
+#define MCE_DBUS_GET_INPUT_LATENCY_REQ          "get_input_latency"
+
+/** Define get display transition statistics DBUS method */
+#define MCE_DBUS_GET_DISPLAY_STATS_REQ          "get_display_stats"
+
+/** Define get power key time to action statistics DBUS method */
+#define MCE_DBUS_GET_POWERKEY_STATS_REQ         "get_powerkey_stats"
+
+/** Define get wakelock and cpu-keepalive client accounting DBUS method */
+#define MCE_DBUS_GET_WAKELOCK_STATS_REQ         "get_wakelock_stats"
+
+/** Define get module load statistics DBUS method */
+#define MCE_DBUS_GET_MODULE_STATS_REQ           "get_module_stats"
+
+/** Define get I/O monitor statistics DBUS method */
+#define MCE_DBUS_GET_IOMON_STATS_REQ            "get_iomon_stats"
+
+/** Define get mainloop wakeup statistics DBUS method */
+#define MCE_DBUS_GET_WAKEUP_STATS_REQ           "get_wakeup_stats"
+
+/** Define get memory statistics DBUS method */
+#define MCE_DBUS_GET_MEMORY_STATS_REQ           "get_memory_stats"
+
+/** Define set log verbosity DBUS method */
+#define MCE_DBUS_SET_LOG_VERBOSITY_REQ          "set_log_verbosity"
+
 #if MCETOOL_ENABLE_EXTRA_DEBUG
 # define debugf(FMT, ARGS...) fprintf(stderr, PROG_NAME": D: "FMT, ##ARGS)
 #else
@@ -68,6 +107,13 @@
 /** Cached D-Bus connection */
 static DBusConnection *xdbus_con = NULL;
 
+/** Leave no-reply method calls queued instead of flushing each one
+ *
+ * Used in batch mode, where the queue is flushed only when
+ * blocking or before exit
+ */
+static gboolean xdbus_batch = FALSE;
+
 /** Initialize D-Bus system bus connection
  *
  * Makes a cached connection to system bus and checks if mce is present
@@ -108,12 +154,22 @@ static void xdbus_exit(void)
 {
         /* If there is an established D-Bus connection, unreference it */
         if (xdbus_con != NULL) {
+                /* Do not lose calls still queued in batch mode */
+                dbus_connection_flush(xdbus_con);
                 dbus_connection_unref(xdbus_con);
                 xdbus_con = NULL;
                 debugf("disconnected from system bus\n");
         }
 }
 
+/** Send out method calls queued in batch mode
+ */
+static void xdbus_flush(void)
+{
+        if( xdbus_con )
+                dbus_connection_flush(xdbus_con);
+}
+
 /** Make sure the cached dbus connection is not used directly */
 #define xdbus_con something_that_will_generate_error
 
@@ -176,7 +232,8 @@ static gboolean xdbus_call_va(const gchar *const service, const gchar *const pat
                         errorf("Failed to send method call\n");
                         goto EXIT;
                 }
-                dbus_connection_flush(bus);
+                if( !xdbus_batch )
+                        dbus_connection_flush(bus);
         }
 
         ack = TRUE;
@@ -543,6 +600,95 @@ static gboolean dbushelper_read_boolean(DBusMessageIter *iter, gboolean *value)
         return *value = data, TRUE;
 }
 
+/** Helper for parsing uint32 value from D-Bus message iterator
+ *
+ * @param iter D-Bus message iterator
+ * @param value Where to store the value (not modified on failure)
+ *
+ * @return TRUE if value could be read, FALSE on failure
+ */
+static gboolean dbushelper_read_uint32(DBusMessageIter *iter, guint *value)
+{
+        dbus_uint32_t data = 0;
+
+        if( !dbushelper_require_type(iter, DBUS_TYPE_UINT32) )
+                return FALSE;
+
+        dbus_message_iter_get_basic(iter, &data);
+        dbus_message_iter_next(iter);
+
+        return *value = data, TRUE;
+}
+
+/** Helper for parsing uint64 value from D-Bus message iterator
+ *
+ * @param iter D-Bus message iterator
+ * @param value Where to store the value (not modified on failure)
+ *
+ * @return TRUE if value could be read, FALSE on failure
+ */
+static gboolean dbushelper_read_uint64(DBusMessageIter *iter, guint64 *value)
+{
+        dbus_uint64_t data = 0;
+
+        if( !dbushelper_require_type(iter, DBUS_TYPE_UINT64) )
+                return FALSE;
+
+        dbus_message_iter_get_basic(iter, &data);
+        dbus_message_iter_next(iter);
+
+        return *value = data, TRUE;
+}
+
+/** Helper for parsing string value from D-Bus message iterator
+ *
+ * @param iter D-Bus message iterator
+ * @param value Where to store the value (not modified on failure)
+ *
+ * @return TRUE if value could be read, FALSE on failure
+ */
+static gboolean dbushelper_read_string(DBusMessageIter *iter, const char **value)
+{
+        const char *data = 0;
+
+        if( !dbushelper_require_type(iter, DBUS_TYPE_STRING) )
+                return FALSE;
+
+        dbus_message_iter_get_basic(iter, &data);
+        dbus_message_iter_next(iter);
+
+        return *value = data, TRUE;
+}
+
+/** Helper for checking if D-Bus message iterator has more data
+ *
+ * @param iter D-Bus message iterator
+ *
+ * @return TRUE if there is no more data to read, FALSE otherwise
+ */
+static gboolean dbushelper_read_at_end(DBusMessageIter *iter)
+{
+        return dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_INVALID;
+}
+
+/** Helper for entering struct container from D-Bus message iterator
+ *
+ * @param iter D-Bus message iterator
+ * @param sub  D-Bus message iterator for struct (not modified on failure)
+ *
+ * @return TRUE if container could be entered, FALSE on failure
+ */
+static gboolean dbushelper_read_struct(DBusMessageIter *iter, DBusMessageIter *sub)
+{
+        if( !dbushelper_require_type(iter, DBUS_TYPE_STRUCT) )
+                return FALSE;
+
+        dbus_message_iter_recurse(iter, sub);
+        dbus_message_iter_next(iter);
+
+        return TRUE;
+}
+
 /** Helper for entering variant container from D-Bus message iterator
  *
  * @param iter D-Bus message iterator
@@ -849,6 +995,117 @@ EXIT:
         return req;
 }
 
+/* ------------------------------------------------------------------------- *
+ * config cache
+ * ------------------------------------------------------------------------- */
+
+/** Reply message to get_config_all method call, or NULL */
+static DBusMessage *mcetool_config_cache_rsp = 0;
+
+/** Lookup table for variant iterators within mcetool_config_cache_rsp */
+static GHashTable  *mcetool_config_cache_lut = 0;
+
+/** Drop all prefetched config values
+ */
+static void mcetool_config_cache_clear(void)
+{
+        if( mcetool_config_cache_lut ) {
+                g_hash_table_unref(mcetool_config_cache_lut),
+                        mcetool_config_cache_lut = 0;
+        }
+        if( mcetool_config_cache_rsp ) {
+                dbus_message_unref(mcetool_config_cache_rsp),
+                        mcetool_config_cache_rsp = 0;
+        }
+}
+
+/** Prefetch all config values with a single D-Bus method call
+ *
+ * Failures are not reported, the individual getters will
+ * then just fall back to making one query per key.
+ */
+static void mcetool_config_cache_fetch(void)
+{
+        DBusMessage *req = 0;
+        DBusError    err = DBUS_ERROR_INIT;
+
+        DBusMessageIter body, dict;
+
+        mcetool_config_cache_clear();
+
+        if( !(req = mcetool_config_request(MCE_DBUS_GET_CONFIG_ALL_REQ)) )
+                goto EXIT;
+
+        mcetool_config_cache_rsp =
+                dbus_connection_send_with_reply_and_block(xdbus_init(),
+                                                          req, -1, &err);
+        if( !mcetool_config_cache_rsp ) {
+                debugf("%s: %s: %s\n", MCE_DBUS_GET_CONFIG_ALL_REQ,
+                       err.name, err.message);
+                goto EXIT;
+        }
+
+        if( !dbushelper_init_read_iterator(mcetool_config_cache_rsp, &body) )
+                goto FAILED;
+        if( !dbushelper_read_array(&body, &dict) )
+                goto FAILED;
+
+        mcetool_config_cache_lut = g_hash_table_new_full(g_str_hash,
+                                                         g_str_equal,
+                                                         0, g_free);
+
+        while( dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY ) {
+                DBusMessageIter entry, variant;
+                const char *key = 0;
+
+                dbus_message_iter_recurse(&dict, &entry);
+                dbus_message_iter_next(&dict);
+
+                if( !dbushelper_read_string(&entry, &key) )
+                        continue;
+                if( !dbushelper_read_variant(&entry, &variant) )
+                        continue;
+
+                /* Both key and iterator point to data owned by
+                 * the reply message, which is kept until cleared */
+                g_hash_table_replace(mcetool_config_cache_lut, (gpointer)key,
+                                     g_memdup(&variant, sizeof variant));
+        }
+
+        goto EXIT;
+
+FAILED:
+        mcetool_config_cache_clear();
+
+EXIT:
+        dbus_error_free(&err);
+
+        if( req ) dbus_message_unref(req);
+}
+
+/** Lookup prefetched config value
+ *
+ * @param key     The GConf key to look up
+ * @param variant Where to store iterator for the value
+ *
+ * @return TRUE if the value was prefetched, FALSE otherwise
+ */
+static gboolean mcetool_config_cache_lookup(const gchar *const key,
+                                            DBusMessageIter *variant)
+{
+        DBusMessageIter *cached = 0;
+
+        if( !mcetool_config_cache_lut )
+                return FALSE;
+
+        if( !(cached = g_hash_table_lookup(mcetool_config_cache_lut, key)) )
+                return FALSE;
+
+        /* Work on a copy so that values can be read more than once */
+        *variant = *cached;
+        return TRUE;
+}
+
 /** Return a boolean from the specified GConf key
  *
  * @param key The GConf key to get the value from
@@ -865,6 +1122,11 @@ static gboolean mcetool_gconf_get_bool(const gchar *const key, gboolean *value)
 
         DBusMessageIter body, variant;
 
+        if( mcetool_config_cache_lookup(key, &variant) ) {
+                res = dbushelper_read_boolean(&variant, value);
+                goto EXIT;
+        }
+
         if( !(req = mcetool_config_request(MCE_DBUS_GET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, &body) )
@@ -904,6 +1166,11 @@ static gboolean mcetool_gconf_get_int(const gchar *const key, gint *value)
 
         DBusMessageIter body, variant;
 
+        if( mcetool_config_cache_lookup(key, &variant) ) {
+                res = dbushelper_read_int(&variant, value);
+                goto EXIT;
+        }
+
         if( !(req = mcetool_config_request(MCE_DBUS_GET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, &body) )
@@ -944,6 +1211,11 @@ static gboolean mcetool_gconf_get_int_array(const gchar *const key, gint **value
 
         DBusMessageIter body, variant;
 
+        if( mcetool_config_cache_lookup(key, &variant) ) {
+                res = dbushelper_read_int_array(&variant, values, count);
+                goto EXIT;
+        }
+
         if( !(req = mcetool_config_request(MCE_DBUS_GET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, &body) )
@@ -989,6 +1261,9 @@ static gboolean mcetool_gconf_set_bool(const gchar *const key,
         DBusMessageIter *wpos = stack;
         DBusMessageIter *rpos = stack;
 
+        /* Prefetched values would be stale after this */
+        mcetool_config_cache_clear();
+
         if( !(req = mcetool_config_request(MCE_DBUS_SET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, wpos) )
@@ -1042,6 +1317,9 @@ static gboolean mcetool_gconf_set_int(const gchar *const key, const gint value)
         DBusMessageIter *rpos = stack;
 
         // construct request
+        /* Prefetched values would be stale after this */
+        mcetool_config_cache_clear();
+
         if( !(req = mcetool_config_request(MCE_DBUS_SET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, wpos) )
@@ -1101,6 +1379,9 @@ static gboolean mcetool_gconf_set_int_array(const gchar *const key,
         DBusMessageIter *rpos = stack;
 
         // construct request
+        /* Prefetched values would be stale after this */
+        mcetool_config_cache_clear();
+
         if( !(req = mcetool_config_request(MCE_DBUS_SET_CONFIG_REQ)) )
                 goto EXIT;
         if( !dbushelper_init_write_iterator(req, wpos) )
@@ -1229,17 +1510,19 @@ static const symbol_t powerkeyevent_lut[] =
 /** Convert power key event name to number passable to mce
  *
  * @param args string from user
+ * @param val  where to store number passable to MCE
  *
- * @return number passable to MCE, or terminate on error
+ * @return TRUE on success, or FALSE on error
  */
-static int xmce_parse_powerkeyevent(const char *args)
+static gboolean xmce_parse_powerkeyevent(const char *args, int *val)
 {
         int res = lookup(powerkeyevent_lut, args);
         if( res < 0 ) {
                 errorf("%s: not a valid power key event\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
-        return res;
+        *val = res;
+        return TRUE;
 }
 
 /** Lookup table for blanking inhibit modes
@@ -1260,17 +1543,19 @@ static const symbol_t inhibitmode_lut[] =
 /** Convert blanking inhibit mode name to number passable to MCE
  *
  * @param args string from user
+ * @param val  where to store number passable to MCE
  *
- * @return number passable to MCE, or terminate on error
+ * @return TRUE on success, or FALSE on error
  */
-static int parse_inhibitmode(const char *args)
+static gboolean parse_inhibitmode(const char *args, int *val)
 {
         int res = lookup(inhibitmode_lut, args);
         if( res < 0 ) {
                 errorf("%s: not a valid inhibit mode value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
-        return res;
+        *val = res;
+        return TRUE;
 }
 
 /** Convert blanking inhibit mode to human readable string
@@ -1299,15 +1584,17 @@ static const symbol_t radio_states_lut[] =
 /** Convert comma separated list of radio state names into bitmask
  *
  * @param args radio state list from user
+ * @param mask where to store bitmask passable to mce
  *
- * @return bitmask passable to mce, or terminate on errors
+ * @return TRUE on success, or FALSE on errors
  */
-static unsigned xmce_parse_radio_states(const char *args)
+static gboolean xmce_parse_radio_states(const char *args, unsigned *mask)
 {
-        int   res = 0;
-        char *tmp = strdup(args);
-        int   bit;
-        char *end;
+        gboolean  ack = FALSE;
+        int       res = 0;
+        char     *tmp = strdup(args);
+        int       bit;
+        char     *end;
 
         for( char *pos = tmp; pos; pos = end )
         {
@@ -1316,13 +1603,17 @@ static unsigned xmce_parse_radio_states(const char *args)
 
                 if( !(bit = lookup(radio_states_lut, pos)) ) {
                         errorf("%s: not a valid radio state\n", pos);
-                        exit(EXIT_FAILURE);
+                        goto EXIT;
                 }
 
                 res |= bit;
         }
+
+        *mask = (unsigned)res;
+        ack = TRUE;
+EXIT:
         free(tmp);
-        return (unsigned)res;
+        return ack;
 }
 
 /** Lookuptable for enabled/disabled truth values */
@@ -1336,34 +1627,38 @@ static const symbol_t enabled_lut[] =
 /** Convert enable/disable string to boolean
  *
  * @param args string from user
+ * @param val  where to store boolean passable to mce
  *
- * @return boolean passable to mce, or terminate on errors
+ * @return TRUE on success, or FALSE on errors
  */
-static gboolean xmce_parse_enabled(const char *args)
+static gboolean xmce_parse_enabled(const char *args, gboolean *val)
 {
         int res = lookup(enabled_lut, args);
         if( res < 0 ) {
                 errorf("%s: not a valid enable value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
-        return res != 0;
+        *val = (res != 0);
+        return TRUE;
 }
 
 /** Convert string to integer
  *
  * @param args string from user
+ * @param val  where to store integer number
  *
- * @return integer number, or terminate on errors
+ * @return TRUE on success, or FALSE on errors
  */
-static int xmce_parse_integer(const char *args)
+static gboolean xmce_parse_integer(const char *args, int *val)
 {
         char *end = 0;
         int   res = strtol(args, &end, 0);
         if( end <= args ) {
                 errorf("%s: not a valid integer value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
-        return res;
+        *val = res;
+        return TRUE;
 }
 
 /** Convert a comma separated string in to gint array
@@ -1457,19 +1752,81 @@ static void set_led_state(const gboolean enable)
  * @param type The type of event to trigger; valid types:
  *             "short", "double", "long"
  */
-static void xmce_powerkey_event(const char *args)
+static gboolean xmce_powerkey_event(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_powerkeyevent(args);
-        if( val < 0 ) {
-                errorf("%s: invalid power key event\n", args);
-                exit(EXIT_FAILURE);
-        }
+        int val = 0;
+        if( !xmce_parse_powerkeyevent(args, &val) )
+                return FALSE;
         /* com.nokia.mce.request.req_trigger_powerkey_event */
         dbus_uint32_t data = val;
         xmce_ipc_no_reply(MCE_TRIGGER_POWERKEY_EVENT_REQ,
                           DBUS_TYPE_UINT32, &data,
                           DBUS_TYPE_INVALID);
+        return TRUE;
+}
+
+/** Lookup table for log verbosity levels
+ *
+ * @note These must match the loglevel_t values in mce itself.
+ */
+static const symbol_t loglevel_lut[] =
+{
+        { "none",    0 },
+        { "crit",    2 },
+        { "err",     3 },
+        { "warn",    4 },
+        { "notice",  5 },
+        { "info",    6 },
+        { "debug",   7 },
+        { 0, -1 }
+};
+
+/** Set mce log verbosity, globally or for some source files
+ *
+ * @param args [PATTERN:]LEVEL, where LEVEL is a level name or number;
+ *             level "default" removes the rule for PATTERN
+ */
+static gboolean xmce_set_log_verbosity(const char *args)
+{
+        debugf("%s(%s)\n", __FUNCTION__, args);
+
+        gboolean      ack     = FALSE;
+        char         *work    = strdup(args);
+        char         *level   = strrchr(work, ':');
+        const char   *pattern = "";
+        dbus_int32_t  val;
+
+        if( level ) {
+                *level++ = 0;
+                pattern = work;
+        }
+        else {
+                level = work;
+        }
+
+        if( !strcmp(level, "default") )
+                val = -1;
+        else if( (val = lookup(loglevel_lut, level)) < 0 ) {
+                int num = 0;
+                if( !xmce_parse_integer(level, &num) )
+                        goto EXIT;
+                val = num;
+        }
+
+        if( val < 0 && !*pattern ) {
+                errorf("%s: global verbosity can't be reset\n", args);
+                goto EXIT;
+        }
+
+        xmce_ipc_no_reply(MCE_DBUS_SET_LOG_VERBOSITY_REQ,
+                          DBUS_TYPE_STRING, &pattern,
+                          DBUS_TYPE_INT32, &val,
+                          DBUS_TYPE_INVALID);
+        ack = TRUE;
+EXIT:
+        free(work);
+        return ack;
 }
 
 /** Activate/Deactivate a LED pattern
@@ -1557,32 +1914,42 @@ static void xmce_get_color_profile(void)
  *
  * @param args string of comma separated radio state names
  */
-static void xmce_enable_radio(const char *args)
+static gboolean xmce_enable_radio(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        dbus_uint32_t mask = xmce_parse_radio_states(args);
+        unsigned bits = 0;
+        if( !xmce_parse_radio_states(args, &bits) )
+                return FALSE;
+
+        dbus_uint32_t mask = bits;
         dbus_uint32_t data = mask;
 
         xmce_ipc_no_reply(MCE_RADIO_STATES_CHANGE_REQ,
                    DBUS_TYPE_UINT32, &data,
                    DBUS_TYPE_UINT32, &mask,
                    DBUS_TYPE_INVALID);
+        return TRUE;
 }
 
 /** Disable radios
  *
  * @param args string of comma separated radio state names
  */
-static void xmce_disable_radio(const char *args)
+static gboolean xmce_disable_radio(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        dbus_uint32_t mask = xmce_parse_radio_states(args);
+        unsigned bits = 0;
+        if( !xmce_parse_radio_states(args, &bits) )
+                return FALSE;
+
+        dbus_uint32_t mask = bits;
         dbus_uint32_t data = 0;
 
         xmce_ipc_no_reply(MCE_RADIO_STATES_CHANGE_REQ,
                    DBUS_TYPE_UINT32, &data,
                    DBUS_TYPE_UINT32, &mask,
                    DBUS_TYPE_INVALID);
+        return TRUE;
 }
 
 /** Get current radio state from mce and print it out
@@ -1629,7 +1996,7 @@ static void xmce_get_radio_states(void)
  *
  * @param args string with callstate and calltype separated with ':'
  */
-static void xmce_set_call_state(const char *args)
+static gboolean xmce_set_call_state(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
 
@@ -1638,7 +2005,8 @@ static void xmce_set_call_state(const char *args)
 
         if( !calltype ) {
                 errorf("%s: invalid call state value\n", args);
-                exit(EXIT_FAILURE);
+                free(callstate);
+                return FALSE;
         }
 
         *calltype++ = 0;
@@ -1649,6 +2017,7 @@ static void xmce_set_call_state(const char *args)
                           DBUS_TYPE_INVALID);
 
         free(callstate);
+        return TRUE;
 }
 
 /** Get current call state from mce and print it out
@@ -1741,16 +2110,20 @@ static void xmce_allow_display_blanking(void)
  *
  * @param args string that can be parsed to integer in [1 ... 5] range
  */
-static void xmce_set_display_brightness(const char *args)
+static gboolean xmce_set_display_brightness(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_integer(args);
+        int val = 0;
+
+        if( !xmce_parse_integer(args, &val) )
+                return FALSE;
 
         if( val < 1 || val > 5 ) {
                 errorf("%d: invalid brightness value\n", val);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
         mcetool_gconf_set_int(MCE_GCONF_DISPLAY_BRIGHTNESS_PATH, val);
+        return TRUE;
 }
 
 /** Get current display brightness from mce and print it out
@@ -1774,7 +2147,7 @@ static void xmce_get_display_brightness(void)
  *
  * @param args cabc mode name
  */
-static void xmce_set_cabc_mode(const char *args)
+static gboolean xmce_set_cabc_mode(const char *args)
 {
 	static const char * const lut[] = {
 		MCE_CABC_MODE_OFF,
@@ -1789,7 +2162,7 @@ static void xmce_set_cabc_mode(const char *args)
 	for( size_t i = 0; ; ++i ) {
 		if( !lut[i] ) {
 			errorf("%s: invalid cabc mode\n", args);
-			exit(EXIT_FAILURE);
+			return FALSE;
 		}
 		if( !strcmp(lut[i], args) )
 			break;
@@ -1798,6 +2171,7 @@ static void xmce_set_cabc_mode(const char *args)
         xmce_ipc_no_reply(MCE_CABC_MODE_REQ,
                           DBUS_TYPE_STRING, &args,
                           DBUS_TYPE_INVALID);
+        return TRUE;
 }
 
 /** Get current cabc mode from mce and print it out
@@ -1818,11 +2192,14 @@ static void xmce_get_cabc_mode(void)
  *
  * @param args string that can be parsed to integer
  */
-static void xmce_set_dim_timeout(const char *args)
+static gboolean xmce_set_dim_timeout(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_integer(args);
+        int val = 0;
+        if( !xmce_parse_integer(args, &val) )
+                return FALSE;
         mcetool_gconf_set_int(MCE_GCONF_DISPLAY_DIM_TIMEOUT_PATH, val);
+        return TRUE;
 }
 
 /** Get current dim timeout from mce and print it out
@@ -1843,26 +2220,30 @@ static void xmce_get_dim_timeout(void)
  * @param args string of comma separated integer numbers
  */
 
-static void xmce_set_dim_timeouts(const char *args)
+static gboolean xmce_set_dim_timeouts(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gint  len = 0;
-        gint *arr = parse_gint_array(args, &len);
+        gboolean  ack = FALSE;
+        gint      len = 0;
+        gint     *arr = parse_gint_array(args, &len);
 
         if( len != 5 ) {
                 errorf("%s: invalid dim timeout list\n", args);
-                exit(EXIT_FAILURE);
+                goto EXIT;
         }
 	for( gint i = 1; i < len; ++i ) {
 		if( arr[i] <= arr[i-1] ) {
 			errorf("%s: dim timeout list not in ascending order\n", args);
-			exit(EXIT_FAILURE);
+			goto EXIT;
 		}
 	}
 
         mcetool_gconf_set_int_array(MCE_GCONF_DISPLAY_DIM_TIMEOUT_LIST_PATH,
                                     arr, len);
+        ack = TRUE;
+EXIT:
         g_free(arr);
+        return ack;
 }
 
 /** Get list of "allowed" dim timeouts from mce and print them out
@@ -1889,11 +2270,14 @@ static void xmce_get_dim_timeouts(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_adaptive_dimming_mode(const char *args)
+static gboolean xmce_set_adaptive_dimming_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_DISPLAY_ADAPTIVE_DIMMING_PATH, val);
+        return TRUE;
 }
 
 /** Get current adaptive dimming mode from mce and print it out
@@ -1913,11 +2297,14 @@ static void xmce_get_adaptive_dimming_mode(void)
  *
  * @param args string that can be parsed to integer
  */
-static void xmce_set_adaptive_dimming_time(const char *args)
+static gboolean xmce_set_adaptive_dimming_time(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_integer(args);
+        int val = 0;
+        if( !xmce_parse_integer(args, &val) )
+                return FALSE;
         mcetool_gconf_set_int(MCE_GCONF_DISPLAY_ADAPTIVE_DIM_THRESHOLD_PATH, val);
+        return TRUE;
 }
 
 /** Get current adaptive dimming time from mce and print it out
@@ -1941,11 +2328,14 @@ static void xmce_get_adaptive_dimming_time(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_als_mode(const char *args)
+static gboolean xmce_set_als_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_DISPLAY_ALS_ENABLED_PATH, val);
+        return TRUE;
 }
 
 /** Get current als mode from mce and print it out
@@ -1968,11 +2358,14 @@ static void xmce_get_als_mode(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_autolock_mode(const char *args)
+static gboolean xmce_set_autolock_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_TK_AUTOLOCK_ENABLED_PATH, val);
+        return TRUE;
 }
 
 /** Get current autolock mode from mce and print it out
@@ -1995,11 +2388,14 @@ static void xmce_get_autolock_mode(void)
  *
  * @param args string that can be parsed to integer
  */
-static void xmce_set_blank_timeout(const char *args)
+static gboolean xmce_set_blank_timeout(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_integer(args);
+        int val = 0;
+        if( !xmce_parse_integer(args, &val) )
+                return FALSE;
         mcetool_gconf_set_int(MCE_GCONF_DISPLAY_BLANK_TIMEOUT_PATH, val);
+        return TRUE;
 }
 
 /** Get current blank timeout from mce and print it out
@@ -2023,15 +2419,16 @@ static void xmce_get_blank_timeout(void)
  *
  * @param args string that can be parsed to doubletap mode
  */
-static void xmce_set_doubletap_mode(const char *args)
+static gboolean xmce_set_doubletap_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
         int val = lookup(doubletap_values, args);
         if( val < 0 ) {
                 errorf("%s: invalid doubletap policy value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
         mcetool_gconf_set_int(MCE_GCONF_TK_DOUBLE_TAP_GESTURE_PATH, val);
+        return TRUE;
 }
 
 /** Get current doubletap mode from mce and print it out
@@ -2053,11 +2450,14 @@ static void xmce_get_doubletap_mode(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_power_saving_mode(const char *args)
+static gboolean xmce_set_power_saving_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_PSM_PATH, val);
+        return TRUE;
 }
 
 /** Get current power saving mode from mce and print it out
@@ -2082,16 +2482,20 @@ static void xmce_get_power_saving_mode(void)
  *
  * @param args string that can be parsed to integer
  */
-static void xmce_set_psm_threshold(const char *args)
+static gboolean xmce_set_psm_threshold(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = xmce_parse_integer(args);
+        int val = 0;
+
+        if( !xmce_parse_integer(args, &val) )
+                return FALSE;
 
         if( val < 10 || val > 50 || val % 10 ) {
                 errorf("%d: invalid psm threshold value\n", val);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
         mcetool_gconf_set_int(MCE_GCONF_PSM_THRESHOLD_PATH, val);
+        return TRUE;
 }
 
 /** Get current power saving threshold from mce and print it out
@@ -2111,11 +2515,14 @@ static void xmce_get_psm_threshold(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_forced_psm(const char *args)
+static gboolean xmce_set_forced_psm(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_FORCED_PSM_PATH, val);
+        return TRUE;
 }
 
 /** Get current forced power saving mode from mce and print it out
@@ -2138,11 +2545,14 @@ static void xmce_get_forced_psm(void)
  *
  * @param args string suitable for interpreting as enabled/disabled
  */
-static void xmce_set_low_power_mode(const char *args)
+static gboolean xmce_set_low_power_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        gboolean val = xmce_parse_enabled(args);
+        gboolean val = FALSE;
+        if( !xmce_parse_enabled(args, &val) )
+                return FALSE;
         mcetool_gconf_set_bool(MCE_GCONF_USE_LOW_POWER_MODE_PATH, val);
+        return TRUE;
 }
 
 /** Get current low power mode state from mce and print it out
@@ -2161,11 +2571,14 @@ static void xmce_get_low_power_mode(void)
  * blanking inhibit
  * ------------------------------------------------------------------------- */
 
-static void xmce_set_inhibit_mode(const char *args)
+static gboolean xmce_set_inhibit_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
-        int val = parse_inhibitmode(args);
+        int val = 0;
+        if( !parse_inhibitmode(args, &val) )
+                return FALSE;
         mcetool_gconf_set_int(MCE_GCONF_BLANKING_INHIBIT_MODE_PATH, val);
+        return TRUE;
 }
 
 /** Get current blanking inhibit mode from mce and print it out
@@ -2183,15 +2596,16 @@ static void xmce_get_inhibit_mode(void)
  * autosuspend on display blank policy
  * ------------------------------------------------------------------------- */
 
-static void xmce_set_suspend_policy(const char *args)
+static gboolean xmce_set_suspend_policy(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
         int val = lookup(suspendpol_values, args);
         if( val < 0 ) {
                 errorf("%s: invalid suspend policy value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
         mcetool_gconf_set_int(MCE_GCONF_USE_AUTOSUSPEND_PATH, val);
+        return TRUE;
 }
 
 /** Get current autosuspend policy from mce and print it out
@@ -2236,15 +2650,16 @@ static void xmce_get_tklock_mode(void)
  *
  * @param args string that can be parsed to inhibit mode
  */
-static void xmce_set_tklock_noblank(const char *args)
+static gboolean xmce_set_tklock_noblank(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
         int val = lookup(tklockblank_values, args);
         if( val < 0 ) {
                 errorf("%s: invalid lockscreen blanking policy value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
         mcetool_gconf_set_int(MCE_GCONF_TK_AUTO_BLANK_DISABLE_PATH, val);
+        return TRUE;
 }
 
 /** Get current tklock autoblank inhibit mode from mce and print it out
@@ -2296,14 +2711,510 @@ static void xmce_get_keyboard_backlight_state(void)
         printf("%-40s %s\n","Keyboard backlight:", txt);
 }
 
-/** Obtain and print mce status information
+/** Get datapipe execution statistics from mce and print them out
  */
-static void xmce_get_status(void)
+static void xmce_get_datapipe_stats(void)
 {
-        printf("\n"
-                "MCE status:\n"
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item, hist;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_DATAPIPE_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-24s %8s %8s %8s %10s %10s %8s %8s  %s\n",
+               "DATAPIPE", "EXEC", "TRIGGER", "SKIPPED",
+               "FILTER_US", "TRIGGER_US", "MAX_US", "MERGED",
+               "<10us/<100us/<1ms/<10ms/<100ms/more");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *name = 0;
+                guint       execs = 0, trigs = 0, skipped = 0, bucket = 0;
+                guint       merged = 0;
+                guint64     f_time = 0, t_time = 0, m_time = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &execs) ||
+                    !dbushelper_read_uint32(&item, &trigs) ||
+                    !dbushelper_read_uint32(&item, &skipped) ||
+                    !dbushelper_read_uint64(&item, &f_time) ||
+                    !dbushelper_read_uint64(&item, &t_time) ||
+                    !dbushelper_read_uint64(&item, &m_time) ||
+                    !dbushelper_read_uint32(&item, &merged) )
+                        goto EXIT;
+
+                if( !dbushelper_require_array_type(&item, DBUS_TYPE_UINT32) )
+                        goto EXIT;
+
+                if( !dbushelper_read_array(&item, &hist) )
+                        goto EXIT;
+
+                printf("%-24s %8u %8u %8u %10llu %10llu %8llu %8u ",
+                       name, execs, trigs, skipped,
+                       (unsigned long long)f_time,
+                       (unsigned long long)t_time,
+                       (unsigned long long)m_time, merged);
+
+                for( const char *sep = " "; !dbushelper_read_at_end(&hist); sep = "/" ) {
+                        if( !dbushelper_read_uint32(&hist, &bucket) )
+                                break;
+                        printf("%s%u", sep, bucket);
+                }
+                printf("\n");
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Get datapipe execution trace from mce and print it out
+ *
+ * The output can be fed back to mce with --replay-datapipes
+ */
+static void xmce_get_datapipe_trace(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_DATAPIPE_TRACE_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                guint64     time  = 0;
+                const char *name  = 0;
+                gint        value = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_uint64(&item, &time) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_int(&item, &value) )
+                        goto EXIT;
+
+                printf("%llu %s %d\n", (unsigned long long)time, name, value);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Get D-Bus handler call statistics from mce and print them out
+ */
+static void xmce_get_dbus_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item, top, pair;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_HANDLER_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-40s %-6s %8s %10s %8s  %s\n",
+               "HANDLER", "TYPE", "CALLS", "TOTAL_US", "MAX_US",
+               "TOP SENDERS");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *interface = 0, *name = 0, *sender = 0;
+                guint       type = 0, calls = 0, count = 0;
+                guint64     t_time = 0, m_time = 0;
+                char        handler[256];
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &interface) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &type) ||
+                    !dbushelper_read_uint32(&item, &calls) ||
+                    !dbushelper_read_uint64(&item, &t_time) ||
+                    !dbushelper_read_uint64(&item, &m_time) )
+                        goto EXIT;
+
+                if( !dbushelper_require_array_type(&item, DBUS_TYPE_STRUCT) )
+                        goto EXIT;
+
+                if( !dbushelper_read_array(&item, &top) )
+                        goto EXIT;
+
+                /* Handlers that have not been called are not interesting */
+                if( !calls )
+                        continue;
+
+                snprintf(handler, sizeof handler, "%s%s%s",
+                         *interface ? interface : "", *interface ? "." : "",
+                         name);
+
+                printf("%-40s %-6s %8u %10llu %8llu ", handler,
+                       (type == DBUS_MESSAGE_TYPE_SIGNAL) ? "signal" : "method",
+                       calls,
+                       (unsigned long long)t_time,
+                       (unsigned long long)m_time);
+
+                while( !dbushelper_read_at_end(&top) ) {
+                        if( !dbushelper_read_struct(&top, &pair) ||
+                            !dbushelper_read_string(&pair, &sender) ||
+                            !dbushelper_read_uint32(&pair, &count) )
+                                break;
+                        printf(" %s:%u", sender, count);
+                }
+                printf("\n");
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print input latency statistics
+ */
+static void xmce_get_input_latency(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item, hist;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_INPUT_LATENCY_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-20s %-8s %8s %8s %8s  %s\n",
+               "DEVICE", "LATENCY", "COUNT", "AVG_US", "MAX_US",
+               "<1/2/5/10/20/50/100/100+ ms");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *device = 0, *what = 0;
+                guint       count = 0, bucket = 0;
+                guint64     total = 0, max = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &device) ||
+                    !dbushelper_read_string(&item, &what) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &total) ||
+                    !dbushelper_read_uint64(&item, &max) )
+                        goto EXIT;
+
+                if( !dbushelper_require_array_type(&item, DBUS_TYPE_UINT32) )
+                        goto EXIT;
+
+                if( !dbushelper_read_array(&item, &hist) )
+                        goto EXIT;
+
+                printf("%-20s %-8s %8u %8llu %8llu ", device, what, count,
+                       count ? (unsigned long long)(total / count) : 0ull,
+                       (unsigned long long)max);
+
+                while( !dbushelper_read_at_end(&hist) ) {
+                        if( !dbushelper_read_uint32(&hist, &bucket) )
+                                break;
+                        printf(" %u", bucket);
+                }
+                printf("\n");
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print display state transition timing statistics
+ */
+static void xmce_get_display_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_DISPLAY_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-8s %-8s %-12s %8s %8s %8s %8s\n",
+               "FROM", "TO", "STAGE", "COUNT", "AVG_US", "MAX_US", "LAST_US");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *from = 0, *to = 0, *stage = 0;
+                guint       count = 0;
+                guint64     total = 0, max = 0, last = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &from) ||
+                    !dbushelper_read_string(&item, &to) ||
+                    !dbushelper_read_string(&item, &stage) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &total) ||
+                    !dbushelper_read_uint64(&item, &max) ||
+                    !dbushelper_read_uint64(&item, &last) )
+                        goto EXIT;
+
+                printf("%-8s %-8s %-12s %8u %8llu %8llu %8llu\n",
+                       from, to, stage, count,
+                       count ? (unsigned long long)(total / count) : 0ull,
+                       (unsigned long long)max, (unsigned long long)last);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print power key time to action statistics
+ */
+static void xmce_get_powerkey_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_POWERKEY_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-8s %8s %8s %8s %8s\n",
+               "PRESS", "COUNT", "AVG_US", "MAX_US", "LAST_US");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *press = 0;
+                guint       count = 0;
+                guint64     total = 0, max = 0, last = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &press) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &total) ||
+                    !dbushelper_read_uint64(&item, &max) ||
+                    !dbushelper_read_uint64(&item, &last) )
+                        goto EXIT;
+
+                printf("%-8s %8u %8llu %8llu %8llu\n",
+                       press, count,
+                       count ? (unsigned long long)(total / count) : 0ull,
+                       (unsigned long long)max, (unsigned long long)last);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print wakelock and cpu-keepalive client accounting
+ */
+static void xmce_get_wakelock_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_WAKELOCK_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-8s %-24s %8s %10s %10s %s\n",
+               "KIND", "NAME", "COUNT", "HELD_MS", "MAX_MS", "ACTIVE");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *kind = 0, *name = 0;
+                guint       count = 0;
+                guint64     held = 0, max = 0;
+                gboolean    active = FALSE;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &kind) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &held) ||
+                    !dbushelper_read_uint64(&item, &max) ||
+                    !dbushelper_read_boolean(&item, &active) )
+                        goto EXIT;
+
+                printf("%-8s %-24s %8u %10llu %10llu %s\n",
+                       kind, name, count,
+                       (unsigned long long)held, (unsigned long long)max,
+                       active ? "yes" : "no");
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print module load times
+ */
+static void xmce_get_module_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_MODULE_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-24s %-8s %10s\n",
+               "MODULE", "STATE", "LOAD_US");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *name = 0;
+                gboolean    loaded = FALSE, deferred = FALSE;
+                guint64     load = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_boolean(&item, &loaded) ||
+                    !dbushelper_read_boolean(&item, &deferred) ||
+                    !dbushelper_read_uint64(&item, &load) )
+                        goto EXIT;
+
+                printf("%-24s %-8s %10llu\n",
+                       name,
+                       !loaded ? "failed" : deferred ? "deferred" : "startup",
+                       (unsigned long long)load);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print resident set size and per-owner memory accounting
+ */
+static void xmce_get_memory_stats(void)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter body, array, item;
+        guint           rss = 0, peak = 0;
+
+        if( !xmce_ipc_message_reply(MCE_DBUS_GET_MEMORY_STATS_REQ, &rsp,
+                                    DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbushelper_init_read_iterator(rsp, &body) )
+                goto EXIT;
+
+        if( !dbushelper_read_uint32(&body, &rss) ||
+            !dbushelper_read_uint32(&body, &peak) )
+                goto EXIT;
+
+        printf("RSS: %u kB, peak %u kB\n\n", rss, peak);
+
+        if( !dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) )
+                goto EXIT;
+
+        if( !dbushelper_read_array(&body, &array) )
+                goto EXIT;
+
+        printf("%-24s %8s %10s %10s\n",
+               "OWNER", "COUNT", "BYTES", "PEAK");
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *owner = 0;
+                guint       count = 0;
+                guint64     bytes = 0, high = 0;
+
+                if( !dbushelper_read_struct(&array, &item) )
+                        goto EXIT;
+
+                if( !dbushelper_read_string(&item, &owner) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &bytes) ||
+                    !dbushelper_read_uint64(&item, &high) )
+                        goto EXIT;
+
+                printf("%-24s %8u %10llu %10llu\n", owner, count,
+                       (unsigned long long)bytes, (unsigned long long)high);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Obtain and print mce status information
+ */
+static void xmce_get_status(void)
+{
+        printf("\n"
+                "MCE status:\n"
                 "-----------\n");
 
+        /* Get all settings with one round trip */
+        mcetool_config_cache_fetch();
+
         xmce_get_version();
         xmce_get_radio_states();
         xmce_get_call_state();
@@ -2330,9 +3241,417 @@ static void xmce_get_status(void)
         xmce_get_suspend_policy();
         xmce_get_tklock_noblank();
 
+        mcetool_config_cache_clear();
+
         printf("\n");
 }
 
+/* ------------------------------------------------------------------------- *
+ * runtime cost monitor
+ * ------------------------------------------------------------------------- */
+
+/** Default refresh interval for --top [s] */
+#define MCETOOL_TOP_INTERVAL 2
+
+/** Maximum number of sources shown per --top refresh */
+#define MCETOOL_TOP_ROWS     24
+
+/** Accumulated cost of one event source inside mce */
+typedef struct {
+        /** Kind of source: "datapipe", "dbus", "iomon", ... */
+        const char *kind;
+        /** Source name */
+        gchar      *name;
+        /** Number of events handled */
+        guint64     events;
+        /** Time spent handling the events [us] */
+        guint64     time;
+        /** Time the source kept the device awake, for wakelocks [us] */
+        guint64     held;
+        /** Number of bytes read, for I/O monitors */
+        guint64     bytes;
+} top_row_t;
+
+/** Release a top_row_t
+ *
+ * @param data top_row_t as a void pointer
+ */
+static void top_row_free(gpointer data)
+{
+        top_row_t *row = data;
+
+        if( row ) {
+                g_free(row->name);
+                g_free(row);
+        }
+}
+
+/** Store the cost of one event source to a sample
+ *
+ * @param sample Hash table of top_row_t, keyed by "kind/name"
+ * @param kind   Kind of source, must be a static string
+ * @param name   Source name
+ * @param events Number of events handled
+ * @param time   Time spent handling the events [us]
+ * @param held   Time the device was kept awake [us]
+ * @param bytes  Number of bytes read
+ */
+static void top_sample_add(GHashTable *sample, const char *kind,
+                           const char *name, guint64 events,
+                           guint64 time, guint64 held, guint64 bytes)
+{
+        top_row_t *row = g_malloc0(sizeof *row);
+
+        row->kind   = kind;
+        row->name   = g_strdup(name);
+        row->events = events;
+        row->time   = time;
+        row->held   = held;
+        row->bytes  = bytes;
+
+        g_hash_table_replace(sample, g_strdup_printf("%s/%s", kind, name),
+                             row);
+}
+
+/** Start reading a statistics reply from mce
+ *
+ * @param method Statistics method to call
+ * @param rsp    [OUT] Where to store the reply message
+ * @param array  [OUT] Iterator for the array of structs in the reply
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean top_sample_query(const char *method, DBusMessage **rsp,
+                                 DBusMessageIter *array)
+{
+        DBusMessageIter body;
+
+        return (xmce_ipc_message_reply(method, rsp, DBUS_TYPE_INVALID) &&
+                dbushelper_init_read_iterator(*rsp, &body) &&
+                dbushelper_require_array_type(&body, DBUS_TYPE_STRUCT) &&
+                dbushelper_read_array(&body, array));
+}
+
+/** Add datapipe execution costs to a sample
+ *
+ * @param sample Hash table of top_row_t
+ */
+static void top_sample_datapipes(GHashTable *sample)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter array, item;
+
+        if( !top_sample_query(MCE_DBUS_GET_DATAPIPE_STATS_REQ, &rsp, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *name = 0;
+                guint       execs = 0, trigs = 0, skipped = 0;
+                guint64     f_time = 0, t_time = 0;
+
+                if( !dbushelper_read_struct(&array, &item) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &execs) ||
+                    !dbushelper_read_uint32(&item, &trigs) ||
+                    !dbushelper_read_uint32(&item, &skipped) ||
+                    !dbushelper_read_uint64(&item, &f_time) ||
+                    !dbushelper_read_uint64(&item, &t_time) )
+                        goto EXIT;
+
+                top_sample_add(sample, "datapipe", name, execs,
+                               f_time + t_time, 0, 0);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Add D-Bus handler costs to a sample
+ *
+ * @param sample Hash table of top_row_t
+ */
+static void top_sample_dbus(GHashTable *sample)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter array, item;
+
+        if( !top_sample_query(MCE_DBUS_GET_HANDLER_STATS_REQ, &rsp, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *interface = 0, *name = 0;
+                guint       type = 0, calls = 0;
+                guint64     t_time = 0;
+                char        handler[256];
+
+                if( !dbushelper_read_struct(&array, &item) ||
+                    !dbushelper_read_string(&item, &interface) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &type) ||
+                    !dbushelper_read_uint32(&item, &calls) ||
+                    !dbushelper_read_uint64(&item, &t_time) )
+                        goto EXIT;
+
+                snprintf(handler, sizeof handler, "%s%s%s",
+                         *interface ? interface : "", *interface ? "." : "",
+                         name);
+
+                top_sample_add(sample, "dbus", handler, calls, t_time, 0, 0);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Add I/O monitor wakeups and read volumes to a sample
+ *
+ * @param sample Hash table of top_row_t
+ */
+static void top_sample_iomon(GHashTable *sample)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter array, item;
+
+        if( !top_sample_query(MCE_DBUS_GET_IOMON_STATS_REQ, &rsp, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *file = 0;
+                guint       wakeups = 0;
+                guint64     bytes = 0, time = 0;
+
+                if( !dbushelper_read_struct(&array, &item) ||
+                    !dbushelper_read_string(&item, &file) ||
+                    !dbushelper_read_uint32(&item, &wakeups) ||
+                    !dbushelper_read_uint64(&item, &bytes) ||
+                    !dbushelper_read_uint64(&item, &time) )
+                        goto EXIT;
+
+                top_sample_add(sample, "iomon", file, wakeups, time, 0, bytes);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Add wakelock and cpu-keepalive hold times to a sample
+ *
+ * @param sample Hash table of top_row_t
+ */
+static void top_sample_wakelocks(GHashTable *sample)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter array, item;
+
+        if( !top_sample_query(MCE_DBUS_GET_WAKELOCK_STATS_REQ, &rsp, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *kind = 0, *name = 0;
+                guint       count = 0;
+                guint64     held = 0;
+                char        lock[256];
+
+                if( !dbushelper_read_struct(&array, &item) ||
+                    !dbushelper_read_string(&item, &kind) ||
+                    !dbushelper_read_string(&item, &name) ||
+                    !dbushelper_read_uint32(&item, &count) ||
+                    !dbushelper_read_uint64(&item, &held) )
+                        goto EXIT;
+
+                snprintf(lock, sizeof lock, "%s:%s", kind, name);
+
+                /* Hold times are reported in ms; they are not cpu
+                 * time, so keep them out of the US/s column */
+                top_sample_add(sample, "wakelock", lock, count,
+                               0, held * 1000, 0);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Add mainloop wakeups per owner to a sample
+ *
+ * @param sample Hash table of top_row_t
+ */
+static void top_sample_wakeups(GHashTable *sample)
+{
+        DBusMessage    *rsp = 0;
+        DBusMessageIter array, item;
+
+        if( !top_sample_query(MCE_DBUS_GET_WAKEUP_STATS_REQ, &rsp, &array) )
+                goto EXIT;
+
+        while( !dbushelper_read_at_end(&array) ) {
+                const char *owner = 0;
+                guint       wakeups = 0, dispatches = 0;
+                guint64     time = 0;
+
+                if( !dbushelper_read_struct(&array, &item) ||
+                    !dbushelper_read_string(&item, &owner) ||
+                    !dbushelper_read_uint32(&item, &wakeups) ||
+                    !dbushelper_read_uint32(&item, &dispatches) ||
+                    !dbushelper_read_uint64(&item, &time) )
+                        goto EXIT;
+
+                top_sample_add(sample, "wakeup", owner, wakeups, time, 0, 0);
+        }
+
+EXIT:
+        if( rsp ) dbus_message_unref(rsp);
+}
+
+/** Compare top_row_t deltas, most expensive first
+ *
+ * Sources are ordered by cpu time, then by the time they kept
+ * the device awake, then by the number of events
+ *
+ * @param a pointer to top_row_t pointer
+ * @param b pointer to top_row_t pointer
+ *
+ * @return negative, zero or positive, as with strcmp()
+ */
+static gint top_row_compare(gconstpointer a, gconstpointer b)
+{
+        const top_row_t *ra = *(const top_row_t * const *)a;
+        const top_row_t *rb = *(const top_row_t * const *)b;
+
+        if( ra->time != rb->time )
+                return (ra->time < rb->time) ? 1 : -1;
+        if( ra->held != rb->held )
+                return (ra->held < rb->held) ? 1 : -1;
+        if( ra->events != rb->events )
+                return (ra->events < rb->events) ? 1 : -1;
+        return strcmp(ra->name, rb->name);
+}
+
+/** Print the costs accumulated between two samples
+ *
+ * @param prev    Previous sample
+ * @param curr    Current sample
+ * @param elapsed Time between the samples [us]
+ */
+static void top_print(GHashTable *prev, GHashTable *curr, guint64 elapsed)
+{
+        GPtrArray      *rows = g_ptr_array_new_with_free_func(g_free);
+        GHashTableIter  iter;
+        gpointer        key, val;
+        double          scale = elapsed ? 1e6 / elapsed : 0;
+
+        g_hash_table_iter_init(&iter, curr);
+        while( g_hash_table_iter_next(&iter, &key, &val) ) {
+                const top_row_t *now  = val;
+                const top_row_t *then = g_hash_table_lookup(prev, key);
+                top_row_t       *row;
+
+                if( !then )
+                        continue;
+
+                /* Counters restart if mce does */
+                if( now->events < then->events || now->time < then->time ||
+                    now->held < then->held )
+                        continue;
+
+                if( now->events == then->events && now->time == then->time &&
+                    now->held == then->held )
+                        continue;
+
+                row = g_malloc0(sizeof *row);
+                row->kind   = now->kind;
+                row->name   = now->name;
+                row->events = now->events - then->events;
+                row->time   = now->time   - then->time;
+                row->held   = now->held   - then->held;
+                row->bytes  = (now->bytes > then->bytes) ?
+                        now->bytes - then->bytes : 0;
+                g_ptr_array_add(rows, row);
+        }
+
+        g_ptr_array_sort(rows, top_row_compare);
+
+        /* Redraw in place on a terminal, append otherwise */
+        if( isatty(STDOUT_FILENO) )
+                printf("\033[H\033[J");
+
+        printf("mce runtime costs over the last %.1f s\n\n",
+               elapsed / 1e6);
+        printf("%-8s %-40s %9s %9s %6s %6s %9s\n",
+               "KIND", "NAME", "EVENTS/s", "US/s", "BUSY%", "HELD%",
+               "BYTES/s");
+
+        for( guint i = 0; i < rows->len && i < MCETOOL_TOP_ROWS; ++i ) {
+                const top_row_t *row = g_ptr_array_index(rows, i);
+
+                printf("%-8s %-40.40s %9.1f %9.0f %6.2f %6.2f %9.0f\n",
+                       row->kind, row->name,
+                       row->events * scale,
+                       row->time * scale,
+                       row->time * scale / 1e4,
+                       row->held * scale / 1e4,
+                       row->bytes * scale);
+        }
+
+        if( !rows->len )
+                printf("(idle)\n");
+
+        fflush(stdout);
+
+        g_ptr_array_free(rows, TRUE);
+}
+
+/** Handle --top command line option
+ *
+ * Samples the datapipe, D-Bus handler, I/O monitor, wakelock and
+ * mainloop wakeup accounting of mce periodically and shows which sources were
+ * the most active ones during the last interval; does not return
+ * unless the arguments are invalid
+ *
+ * @param args Refresh interval in seconds, or NULL for default
+ *
+ * @return FALSE if the refresh interval can't be parsed
+ */
+static gboolean mcetool_top(const char *args)
+{
+        debugf("%s(%s)\n", __FUNCTION__, args ?: "default");
+        struct timespec  ts   = { MCETOOL_TOP_INTERVAL, 0 };
+        GHashTable      *prev = 0;
+        guint64          then = 0;
+
+        if( args && !mcetool_parse_timspec(&ts, args) ) {
+                errorf("%s: invalid refresh interval\n", args);
+                return FALSE;
+        }
+
+        for( ;; ) {
+                GHashTable *curr = g_hash_table_new_full(g_str_hash,
+                                                         g_str_equal,
+                                                         g_free,
+                                                         top_row_free);
+                struct timespec now;
+                guint64 stamp;
+
+                top_sample_datapipes(curr);
+                top_sample_dbus(curr);
+                top_sample_iomon(curr);
+                top_sample_wakelocks(curr);
+                top_sample_wakeups(curr);
+
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                stamp = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+
+                if( prev ) {
+                        top_print(prev, curr, stamp - then);
+                        g_hash_table_unref(prev);
+                }
+
+                prev = curr, then = stamp;
+
+                struct timespec left = ts;
+                TEMP_FAILURE_RETRY(nanosleep(&left, &left));
+        }
+}
+
 /* ------------------------------------------------------------------------- *
  * special
  * ------------------------------------------------------------------------- */
@@ -2346,6 +3665,9 @@ static void mcetool_block(const char *args)
         debugf("%s(%s)\n", __FUNCTION__, args ?: "inf");
         struct timespec ts;
 
+        /* Whatever was queued must reach mce before we go idle */
+        xdbus_flush();
+
         if( mcetool_parse_timspec(&ts, args) )
                 TEMP_FAILURE_RETRY(nanosleep(&ts, &ts));
         else
@@ -2356,7 +3678,7 @@ static void mcetool_block(const char *args)
  *
  * @param args optarg from command line
  */
-static void xmce_set_demo_mode(const char *args)
+static gboolean xmce_set_demo_mode(const char *args)
 {
         debugf("%s(%s)\n", __FUNCTION__, args);
         if( !strcmp(args, "on") ) {
@@ -2376,8 +3698,9 @@ static void xmce_set_demo_mode(const char *args)
         }
         else {
                 errorf("%s: invalid demo mode value\n", args);
-                exit(EXIT_FAILURE);
+                return FALSE;
         }
+        return TRUE;
 }
 
 /** usage information */
@@ -2484,9 +3807,42 @@ static const char usage_text[] =
 "  -D, --set-demo-mode=STATE\n"
 "                                    set the display demo mode  to STATE;\n"
 "                                       valid states are: 'on' and 'off'\n"
+"  -S, --get-datapipe-stats        output datapipe execution statistics\n"
+"  -X, --get-datapipe-trace        output the latest datapipe executions in\n"
+"                                    the format used by mce --replay-datapipes\n"
+"  -W, --get-dbus-stats            output D-Bus handler call statistics\n"
+"  -Q, --get-input-latency         output input event latency statistics\n"
+"  -j, --display-stats             output display state transition timing\n"
+"                                    statistics\n"
+"  -q, --powerkey-stats            output power key time to action\n"
+"                                    statistics\n"
+"  -w, --get-wakelock-stats        output wakelock and cpu-keepalive client\n"
+"                                    accounting\n"
+"  -m, --module-stats              output module load times\n"
+"  -u, --memory-stats              output resident set size and live\n"
+"                                    allocations per mce component\n"
+"  -o, --top[=SECS]                continuously show the datapipes, D-Bus\n"
+"                                    handlers, I/O monitors, wakelocks and\n"
+"                                    mainloop wakeup owners that cost mce\n"
+"                                    most time and wakeups, refreshing\n"
+"                                    every SECS seconds\n"
+"  -Z, --set-log-verbosity=<[PATTERN:]LEVEL>\n"
+"                                  set mce log verbosity; valid levels:\n"
+"                                    'crit', 'err', 'warn', 'notice',\n"
+"                                    'info', 'debug' or a number; with\n"
+"                                    a source file PATTERN, e.g.\n"
+"                                    'tklock:debug', only for the matching\n"
+"                                    files, and 'default' removes the rule\n"
 "  -N, --status                    output MCE status\n"
 "  -B, --block[=SECS]              block after executing commands\n"
 "                                    for D-Bus\n"
+"  -z, --batch[=FILE]              execute commands from FILE, or from\n"
+"                                    stdin if FILE is omitted or '-',\n"
+"                                    over one D-Bus connection; each\n"
+"                                    line holds one long option, e.g.\n"
+"                                    'set-cabc-mode=ui' or\n"
+"                                    'enable-radio wlan', and lines\n"
+"                                    starting with '#' are ignored\n"
 "  -h, --help                      display this help and exit\n"
 "  -V, --version                   output version information and exit\n"
 "\n"
@@ -2504,11 +3860,12 @@ PROG_NAME" v"G_STRINGIFY(PRG_VERSION)"\n"
 ;
 
 // Unused short options left ....
-// - - - - - - - - i j - - m - o - q - - - u - w x - z
-// - - - - - - - - - - - - - - - - Q - S - - - W X - Z
+// - - - - - - - - i - - - - - - - - - - - u - - x - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 const char OPT_S[] =
 "B::" // --block,
+"z::" // --batch,
 "P"   // --blank-prevent,
 "v"   // --cancel-blank-prevent,
 "U"   // --unblank-screen,
@@ -2533,6 +3890,17 @@ const char OPT_S[] =
 "Y:"  // --deactivate-led-pattern,
 "e:"  // --powerkey-event,
 "N"   // --status,
+"S"   // --get-datapipe-stats,
+"X"   // --get-datapipe-trace,
+"W"   // --get-dbus-stats,
+"Q"   // --get-input-latency,
+"j"   // --display-stats,
+"q"   // --powerkey-stats,
+"w"   // --get-wakelock-stats,
+"m"   // --module-stats,
+"u"   // --memory-stats,
+"o::" // --top,
+"Z:"  // --set-log-verbosity,
 "h"   // --help,
 "V"   // --version,
 "f:"  // --set-adaptive-dimming-mode
@@ -2551,6 +3919,7 @@ const char OPT_S[] =
 struct option const OPT_L[] =
 {
         { "block",                     2, 0, 'B' }, // N/A
+        { "batch",                     2, 0, 'z' }, // mcetool_batch()
         { "blank-prevent",             0, 0, 'P' }, // xmce_prevent_display_blanking()
         { "cancel-blank-prevent",      0, 0, 'v' }, // xmce_allow_display_blanking()
         { "unblank-screen",            0, 0, 'U' }, // xmce_set_display_state("on")
@@ -2576,6 +3945,17 @@ struct option const OPT_L[] =
         { "deactivate-led-pattern",    1, 0, 'Y' }, // set_led_pattern_state()
         { "powerkey-event",            1, 0, 'e' }, // xmce_powerkey_event()
         { "status",                    0, 0, 'N' }, // xmce_get_status()
+        { "get-datapipe-stats",        0, 0, 'S' }, // xmce_get_datapipe_stats()
+        { "get-datapipe-trace",        0, 0, 'X' }, // xmce_get_datapipe_trace()
+        { "get-dbus-stats",            0, 0, 'W' }, // xmce_get_dbus_stats()
+        { "get-input-latency",         0, 0, 'Q' }, // xmce_get_input_latency()
+        { "display-stats",             0, 0, 'j' }, // xmce_get_display_stats()
+        { "powerkey-stats",            0, 0, 'q' }, // xmce_get_powerkey_stats()
+        { "get-wakelock-stats",        0, 0, 'w' }, // xmce_get_wakelock_stats()
+        { "module-stats",              0, 0, 'm' }, // xmce_get_module_stats()
+        { "memory-stats",              0, 0, 'u' }, // xmce_get_memory_stats()
+        { "top",                       2, 0, 'o' }, // mcetool_top()
+        { "set-log-verbosity",         1, 0, 'Z' }, // xmce_set_log_verbosity()
         { "help",                      0, 0, 'h' }, // N/A
         { "version",                   0, 0, 'V' }, // N/A
         { "set-adaptive-dimming-mode", 1, 0, 'f' }, // xmce_set_adaptive_dimming_mode()
@@ -2591,6 +3971,236 @@ struct option const OPT_L[] =
         { 0, 0, 0, 0 }
 };
 
+/** Result of handling one option */
+typedef enum {
+        /** Option handled, continue with the next one */
+        OPTION_CONTINUE,
+        /** Option handled, stop with success (--help, --version) */
+        OPTION_DONE,
+        /** Unknown option or bad usage */
+        OPTION_FAILED,
+} option_result_t;
+
+static gboolean mcetool_batch(const char *args);
+
+/** Execute one command line option
+ *
+ * @param opt  Short option character, as returned by getopt_long()
+ * @param args Option argument, or NULL
+ *
+ * @return OPTION_CONTINUE, OPTION_DONE or OPTION_FAILED
+ */
+static option_result_t mcetool_handle_option(int opt, const char *args)
+{
+        gboolean ok = TRUE;
+
+        switch( opt )
+        {
+        case 'U': xmce_set_display_state("on");           break;
+        case 'd': xmce_set_display_state("dim");          break;
+        case 'n': xmce_set_display_state("off");          break;
+
+        case 'P': xmce_prevent_display_blanking();        break;
+        case 'v': xmce_allow_display_blanking();          break;
+
+        case 'G': ok = xmce_set_dim_timeout(args);        break;
+        case 'O': ok = xmce_set_dim_timeouts(args);       break;
+        case 'f': ok = xmce_set_adaptive_dimming_mode(args); break;
+        case 'J': ok = xmce_set_adaptive_dimming_time(args); break;
+
+        case 'H': ok = xmce_set_blank_timeout(args);      break;
+
+        case 'K': ok = xmce_set_autolock_mode(args);      break;
+        case 't': ok = xmce_set_tklock_noblank(args);     break;
+        case 'I': ok = xmce_set_inhibit_mode(args);       break;
+        case 'k': xmce_set_tklock_mode(args);             break;
+        case 'M': ok = xmce_set_doubletap_mode(args);     break;
+
+        case 'r': ok = xmce_enable_radio(args);           break;
+        case 'R': ok = xmce_disable_radio(args);          break;
+
+        case 'p': ok = xmce_set_power_saving_mode(args);  break;
+        case 'T': ok = xmce_set_psm_threshold(args);      break;
+        case 'F': ok = xmce_set_forced_psm(args);         break;
+        case 'E': ok = xmce_set_low_power_mode(args);     break;
+
+        case 's': ok = xmce_set_suspend_policy(args);     break;
+
+        case 'b': ok = xmce_set_display_brightness(args); break;
+        case 'g': ok = xmce_set_als_mode(args);           break;
+
+        case 'a': xmce_get_color_profile_ids();           break;
+        case 'A': xmce_set_color_profile(args);           break;
+        case 'C': ok = xmce_set_cabc_mode(args);          break;
+
+        case 'c': ok = xmce_set_call_state(args);         break;
+
+        case 'l': set_led_state(TRUE);                    break;
+        case 'L': set_led_state(FALSE);                   break;
+        case 'y': set_led_pattern_state(args, TRUE);      break;
+        case 'Y': set_led_pattern_state(args, FALSE);     break;
+
+        case 'e': ok = xmce_powerkey_event(args);         break;
+
+        case 'D': ok = xmce_set_demo_mode(args);          break;
+
+        case 'N': xmce_get_status();                      break;
+        case 'S': xmce_get_datapipe_stats();              break;
+        case 'X': xmce_get_datapipe_trace();              break;
+        case 'W': xmce_get_dbus_stats();                  break;
+        case 'Q': xmce_get_input_latency();               break;
+        case 'j': xmce_get_display_stats();               break;
+        case 'q': xmce_get_powerkey_stats();              break;
+        case 'w': xmce_get_wakelock_stats();              break;
+        case 'm': xmce_get_module_stats();                break;
+        case 'u': xmce_get_memory_stats();                break;
+        case 'o': ok = mcetool_top(args);                 break;
+        case 'Z': ok = xmce_set_log_verbosity(args);      break;
+        case 'B': mcetool_block(args);                    break;
+
+        case 'z':
+                if( !mcetool_batch(args) )
+                        return OPTION_FAILED;
+                break;
+
+        case 'h':
+                printf("%s\n", usage_text);
+                return OPTION_DONE;
+
+        case 'V':
+                printf("%s\n", version_text);
+                return OPTION_DONE;
+
+        default:
+                return OPTION_FAILED;
+        }
+
+        if( !ok )
+                return OPTION_FAILED;
+
+        return OPTION_CONTINUE;
+}
+
+/** Execute one batch mode command line
+ *
+ * The line holds a long option name, optionally prefixed with "--",
+ * followed by the option argument separated with '=' or white space
+ *
+ * @param line Command line; modified in place
+ *
+ * @return OPTION_CONTINUE, OPTION_DONE or OPTION_FAILED
+ */
+static option_result_t mcetool_batch_line(char *line)
+{
+        char *name = g_strstrip(line);
+        char *args = 0;
+
+        if( *name == 0 || *name == '#' )
+                return OPTION_CONTINUE;
+
+        if( !strncmp(name, "--", 2) )
+                name += 2;
+
+        args = name + strcspn(name, "= \t");
+        if( *args ) {
+                *args++ = 0;
+                args = g_strstrip(args);
+                if( *args == 0 )
+                        args = 0;
+        }
+        else {
+                args = 0;
+        }
+
+        for( const struct option *o = OPT_L; o->name; ++o ) {
+                if( strcmp(o->name, name) )
+                        continue;
+
+                if( o->val == 'z' ) {
+                        errorf("%s: can't be nested\n", name);
+                        return OPTION_FAILED;
+                }
+                if( o->has_arg == no_argument && args ) {
+                        errorf("%s: option doesn't take an argument\n", name);
+                        return OPTION_FAILED;
+                }
+                if( o->has_arg == required_argument && !args ) {
+                        errorf("%s: option requires an argument\n", name);
+                        return OPTION_FAILED;
+                }
+                return mcetool_handle_option(o->val, args);
+        }
+
+        errorf("%s: unknown command\n", name);
+        return OPTION_FAILED;
+}
+
+/** Handle --batch command line option
+ *
+ * Executes commands from a file over the already established
+ * D-Bus connection. Method calls that do not need a reply are
+ * queued and sent without waiting in between, so that a script
+ * issuing thousands of requests is limited by mce, not by
+ * process spawning and connection setup.
+ *
+ * @param args File to read, or NULL / "-" for stdin
+ *
+ * @return TRUE if all commands succeeded, FALSE otherwise
+ */
+static gboolean mcetool_batch(const char *args)
+{
+        debugf("%s(%s)\n", __FUNCTION__, args ?: "-");
+        gboolean  success = FALSE;
+        FILE     *file    = stdin;
+        char     *line    = 0;
+        size_t    size    = 0;
+        unsigned  lineno  = 0;
+        gboolean  tty     = FALSE;
+
+        if( args && strcmp(args, "-") ) {
+                if( !(file = fopen(args, "r")) ) {
+                        errorf("%s: can't open: %m\n", args);
+                        goto EXIT;
+                }
+        }
+
+        /* Interactive use wants each command to take effect at once */
+        tty = isatty(fileno(file));
+
+        xdbus_batch = TRUE;
+        success = TRUE;
+
+        while( getline(&line, &size, file) != -1 ) {
+                option_result_t res;
+
+                ++lineno;
+                res = mcetool_batch_line(line);
+
+                if( res == OPTION_FAILED ) {
+                        errorf("%s:%u: command failed\n",
+                               args ?: "stdin", lineno);
+                        success = FALSE;
+                }
+                else if( res == OPTION_DONE ) {
+                        break;
+                }
+
+                if( tty )
+                        xdbus_flush();
+        }
+
+        xdbus_flush();
+        xdbus_batch = FALSE;
+
+EXIT:
+        free(line);
+
+        if( file && file != stdin )
+                fclose(file);
+
+        return success;
+}
+
 /** Main
  *
  * @param argc Number of command line arguments
@@ -2616,66 +4226,11 @@ int main(int argc, char **argv)
                 if( opt < 0 )
                         break;
 
-                switch( opt )
-                {
-                case 'U': xmce_set_display_state("on");           break;
-                case 'd': xmce_set_display_state("dim");          break;
-                case 'n': xmce_set_display_state("off");          break;
-
-                case 'P': xmce_prevent_display_blanking();        break;
-                case 'v': xmce_allow_display_blanking();          break;
-
-                case 'G': xmce_set_dim_timeout(optarg);           break;
-                case 'O': xmce_set_dim_timeouts(optarg);          break;
-                case 'f': xmce_set_adaptive_dimming_mode(optarg); break;
-                case 'J': xmce_set_adaptive_dimming_time(optarg); break;
-
-                case 'H': xmce_set_blank_timeout(optarg);         break;
-
-                case 'K': xmce_set_autolock_mode(optarg);         break;
-                case 't': xmce_set_tklock_noblank(optarg);        break;
-                case 'I': xmce_set_inhibit_mode(optarg);          break;
-                case 'k': xmce_set_tklock_mode(optarg);           break;
-                case 'M': xmce_set_doubletap_mode(optarg);        break;
-
-                case 'r': xmce_enable_radio(optarg);              break;
-                case 'R': xmce_disable_radio(optarg);             break;
-
-                case 'p': xmce_set_power_saving_mode(optarg);     break;
-                case 'T': xmce_set_psm_threshold(optarg);         break;
-                case 'F': xmce_set_forced_psm(optarg);            break;
-                case 'E': xmce_set_low_power_mode(optarg);        break;
-
-                case 's': xmce_set_suspend_policy(optarg);        break;
-
-                case 'b': xmce_set_display_brightness(optarg);    break;
-                case 'g': xmce_set_als_mode(optarg);              break;
-
-                case 'a': xmce_get_color_profile_ids();           break;
-                case 'A': xmce_set_color_profile(optarg);         break;
-                case 'C': xmce_set_cabc_mode(optarg);             break;
-
-                case 'c': xmce_set_call_state(optarg);            break;
-
-                case 'l': set_led_state(TRUE);                    break;
-                case 'L': set_led_state(FALSE);                   break;
-                case 'y': set_led_pattern_state(optarg, TRUE);    break;
-                case 'Y': set_led_pattern_state(optarg, FALSE);   break;
-
-                case 'e': xmce_powerkey_event(optarg);            break;
-
-                case 'D': xmce_set_demo_mode(optarg);             break;
-
-                case 'N': xmce_get_status();                      break;
-                case 'B': mcetool_block(optarg);                  break;
-
-                case 'h':
-                        printf("%s\n", usage_text);
-                        exitcode = EXIT_SUCCESS;
-                        goto EXIT;
+                switch( mcetool_handle_option(opt, optarg) ) {
+                case OPTION_CONTINUE:
+                        break;
 
-                case 'V':
-                        printf("%s\n", version_text);
+                case OPTION_DONE:
                         exitcode = EXIT_SUCCESS;
                         goto EXIT;
 